@@ -6,7 +6,25 @@ cbuffer cbPerObject
 	float4x4 gWVP;
 };
 
+cbuffer cbPerFrame
+{
+	float4x4 gViewProj;
+};
+
+// Simple fixed directional light so the faces of generated primitives can be
+// told apart. Texture coordinates are not used yet.
+float4 Shade( float3 normal, float4 color )
+{
+	float3 lightDir = normalize( float3( 0.4f, 1.0f, -0.6f ) );
+	float4 shaded   = color * ( 0.35f + 0.65f * saturate( dot( normal, lightDir ) ) );
+	shaded.a = color.a;
+
+	return shaded;
+}
+
 void VS( float3 pos        : POSITION,
+         float3 normal     : NORMAL,
+         float2 texcoord   : TEXCOORD,
          float4 color      : COLOR,
 		 out float4 oPos   : SV_POSITION,
 		 out float4 oColor : COLOR )
@@ -14,8 +32,32 @@ void VS( float3 pos        : POSITION,
 		// Transform vertex to homogenous clip space
 		oPos = mul( float4( pos, 1.0f ), gWVP );
 		
-		// No need to do anything with color, pass it to the pixel shader
-		oColor = color;
+		// Light in object space.
+		oColor = Shade( normal, color );
+}
+
+// Instanced version of VS. Each instance streams in its own world matrix (one
+// row per WORLD semantic) and a color that tints the mesh.
+void InstancedVS( float3 pos           : POSITION,
+                  float3 normal        : NORMAL,
+                  float2 texcoord      : TEXCOORD,
+                  float4 color         : COLOR,
+                  float4 world0        : WORLD0,
+                  float4 world1        : WORLD1,
+                  float4 world2        : WORLD2,
+                  float4 world3        : WORLD3,
+                  float4 instanceColor : INSTANCECOLOR,
+                  out float4 oPos      : SV_POSITION,
+                  out float4 oColor    : COLOR )
+{
+		float4x4 world = float4x4( world0, world1, world2, world3 );
+		float4 posW    = mul( float4( pos, 1.0f ), world );
+
+		oPos = mul( posW, gViewProj );
+
+		// Light in world space. Assumes instances are only scaled uniformly.
+		float3 normalW = normalize( mul( normal, (float3x3) world ) );
+		oColor = Shade( normalW, color * instanceColor );
 }
 
 float4 PS( float4 pos   : SV_POSITION,
@@ -32,4 +74,14 @@ technique10 DefaultCubeTechnique
 		SetGeometryShader( NULL );
 		SetPixelShader( CompileShader( ps_4_0, PS() ) );
 	}
-}
\ No newline at end of file
+}
+
+technique10 InstancedCubeTechnique
+{
+	pass P0
+	{
+		SetVertexShader( CompileShader( vs_4_0, InstancedVS() ) );
+		SetGeometryShader( NULL );
+		SetPixelShader( CompileShader( ps_4_0, PS() ) );
+	}
+}
@@ -16,6 +16,34 @@ cbuffer cbPerObject
 	float4x4 gWVP;
 };
 
+// Quantized terrain. Each vertex is three 16 bit values (height, octahedral normal, material and
+// ambient visibility) and x/z are rebuilt from the vertex index, see QuantizedTerrain.h.
+#define TERRAIN_MATERIAL_COUNT 5
+
+cbuffer cbTerrain
+{
+	float4 gTerrainGrid;		// origin x, origin z, step x, step z
+	float2 gTerrainHeight;		// min height, height step
+	uint   gTerrainCols;
+	float4 gMaterialDiffuse[TERRAIN_MATERIAL_COUNT];
+	float4 gMaterialSpec[TERRAIN_MATERIAL_COUNT];
+};
+
+Buffer<uint> gTerrainVertices;
+
+// Grid laid over the landscape, one tile per world unit. Its strength is zero for the water and when
+// the texture is missing.
+Texture2D gGridMap;
+float gGridStrength;
+
+SamplerState gGridSampler
+{
+	Filter = ANISOTROPIC;
+	MaxAnisotropy = 8;
+	AddressU = WRAP;
+	AddressV = WRAP;
+};
+
 struct VS_IN
 {
 	float3 posL    : POSITION;
@@ -31,6 +59,7 @@ struct VS_OUT
 	float3 normalW : NORMAL;
 	float4 diffuse : DIFFUSE;
 	float4 spec    : SPECULAR;
+	float  ambient : AMBIENT;
 };
 
 VS_OUT VS( VS_IN vIn )
@@ -47,6 +76,54 @@ VS_OUT VS( VS_IN vIn )
 	// Output vertex attributes for interpolation across triangle.
 	vOut.diffuse = vIn.diffuse;
 	vOut.spec    = vIn.spec;
+	vOut.ambient = 1.0f;
+
+	return vOut;
+}
+
+float2 SignNotZero( float2 v )
+{
+	return float2( v.x >= 0.0f ? 1.0f : -1.0f, v.y >= 0.0f ? 1.0f : -1.0f );
+}
+
+float3 DecodeOctahedralNormal( uint encoded )
+{
+	float2 e = float2( encoded & 0xFF, encoded >> 8 ) / 255.0f * 2.0f - 1.0f;
+	float3 n = float3( e.x, 1.0f - abs( e.x ) - abs( e.y ), e.y );
+
+	if ( n.y < 0.0f )
+	{
+		n.xz = ( 1.0f - abs( e.yx ) ) * SignNotZero( e );
+	}
+
+	return normalize( n );
+}
+
+VS_OUT QuantizedVS( uint vertexId : SV_VertexID )
+{
+	uint row = vertexId / gTerrainCols;
+	uint col = vertexId - row * gTerrainCols;
+
+	uint height   = gTerrainVertices.Load( vertexId * 3 );
+	uint normal   = gTerrainVertices.Load( vertexId * 3 + 1 );
+	uint surface  = gTerrainVertices.Load( vertexId * 3 + 2 );
+	uint material = min( surface & 0xFF, TERRAIN_MATERIAL_COUNT - 1 );
+
+	float3 posL = float3(
+		gTerrainGrid.x + col * gTerrainGrid.z,
+		gTerrainHeight.x + height * gTerrainHeight.y,
+		gTerrainGrid.y + row * gTerrainGrid.w );
+
+	float3 normalL = DecodeOctahedralNormal( normal );
+
+	VS_OUT vOut;
+
+	vOut.posW    = mul( float4( posL, 1.0f ), gWorld );
+	vOut.normalW = mul( float4( normalL, 0.0f ), gWorld );
+	vOut.posH    = mul( float4( posL, 1.0f ), gWVP );
+	vOut.diffuse = gMaterialDiffuse[material];
+	vOut.spec    = gMaterialSpec[material];
+	vOut.ambient = ( surface >> 8 ) / 255.0f;
 
 	return vOut;
 }
@@ -59,19 +136,26 @@ float4 PS( VS_OUT pIn ) : SV_Target
 	SurfaceInfo v = { pIn.posW, pIn.normalW, pIn.diffuse, pIn.spec };
 	float3 litColor;
 
+	// Baked ambient occlusion only dims the ambient light.
+	Light light = gLight;
+	light.ambient *= pIn.ambient;
+
 	if ( gLightType == 0 )	// parallel light
 	{
-		litColor = ParallelLight( v, gLight, gEyePosW );
+		litColor = ParallelLight( v, light, gEyePosW );
 	}
 	else if ( gLightType == 1 ) // point light
 	{
-		litColor = PointLight( v, gLight, gEyePosW );
+		litColor = PointLight( v, light, gEyePosW );
 	}
 	else // spot
 	{
-		litColor = Spotlight( v, gLight, gEyePosW );
+		litColor = Spotlight( v, light, gEyePosW );
 	}
 
+	float grid = gGridMap.Sample( gGridSampler, pIn.posW.xz ).r;
+	litColor *= lerp( 1.0f, grid, gGridStrength );
+
 	return float4( litColor, pIn.diffuse.a );
 }
 
@@ -83,4 +167,14 @@ technique10 LandscapeTechnique
 		SetGeometryShader( NULL );
 		SetPixelShader( CompileShader( ps_4_0, PS() ) );
 	}
+}
+
+technique10 QuantizedLandscapeTechnique
+{
+	pass P0
+	{
+		SetVertexShader( CompileShader( vs_4_0, QuantizedVS() ) );
+		SetGeometryShader( NULL );
+		SetPixelShader( CompileShader( ps_4_0, PS() ) );
+	}
 }
\ No newline at end of file
@@ -18,13 +18,20 @@
 
 #include "graphics/light.h"		// temporary, remove this eventually  (make DXRenderer have a light manager)
 
+#include "graphics/AssetFuture.h"
+#include "graphics/BoundingVolume.h"
 #include "graphics/DemoScene.h"
+#include "graphics/ResourceRegistry.h"
 #include "runtime\gametime.h"
 
+class GeometryPool;
+class InstanceBatcher;
 class LandscapeMesh;
+class StreamingTexture;
 class WaterMesh;
 
 #include <memory>                       // Shared pointers.
+#include <vector>
 #include <wrl\wrappers\corewrappers.h>  // ComPtr.
 #include <wrl\client.h>                 // ComPtr friends.
 
@@ -59,9 +66,25 @@ private:
     void BuildLights();
     void BuildInputLayout(DXRenderer& dx);
 
+    void UpdateGridTextureSize();
+
+    void BuildPrimitiveField(DXRenderer& dx);
+    void DrawPrimitiveField(DXRenderer& dx, const D3DXMATRIX& viewProjection) const;
+    void ReportBatching(TimeT currentTime);
+
 private:
+    // One of the factory primitives scattered over the landscape.
+    struct FieldInstance
+    {
+        MeshHandle mesh;
+        D3DXMATRIX world;
+        D3DXCOLOR color;
+        MeshBounds bounds;              // World space.
+    };
+
     Microsoft::WRL::ComPtr<ID3D10InputLayout> mVertexLayout;
-    Microsoft::WRL::ComPtr<ID3D10Effect> mLandscapeEffect;
+    AssetFuture<ID3D10Effect> mLandscapeEffect;        // Held to keep the effect in the asset cache.
+    std::shared_ptr<bool> mAliveToken;                 // Expires with the scene, so late loads are ignored.
     std::shared_ptr<Camera> mCamera;
 
     Light mLights[3];
@@ -69,6 +92,15 @@ private:
 
     std::unique_ptr<LandscapeMesh> mTerrainMesh;
     std::unique_ptr<WaterMesh> mWaterMesh;
+    std::shared_ptr<StreamingTexture> mGridTexture;    // Null if the texture could not be opened.
+
+    std::vector<FieldInstance> mPrimitiveField;
+    std::unique_ptr<InstanceBatcher> mInstanceBatcher;
+    GeometryPool * mpGeometryPool;                     // The content manager's, which the primitives live in.
+    TimeT mLastBatchReportTime;
+
+    bool mBenchmarkKeyDown;
+    bool mCraterKeyDown;
 };
 
 #endif
\ No newline at end of file
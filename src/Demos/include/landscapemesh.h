@@ -20,45 +20,138 @@
 #include <memory>                       // Shared pointers.
 #include <wrl\wrappers\corewrappers.h>  // ComPtr.
 #include <wrl\client.h>                 // ComPtr friends.
+#include <string>
+#include <vector>
+
+#include "graphics/BoundingVolume.h"
+#include "terrain/DirtyRectSet.h"
+#include "terrain/GridPatches.h"
+#include "terrain/HeightField.h"
+#include "terrain/MinMaxHeightTree.h"
+#include "terrain/QuantizedTerrain.h"
+#include "terrain/TerrainOcclusion.h"
 
 // Forward declarations
+namespace Noise
+{
+    class NoiseGenerator;
+    struct FractalParams;
+}
+
 struct ID3D10Buffer;
 struct ID3D10Device;
-struct StaticMeshVertex;
-struct D3DXCOLOR;
+struct ID3D10Effect;
+struct ID3D10ShaderResourceView;
 
 /**
- * Contains information on rendering a cube mesh.
+ * Contains information on rendering a landscape mesh. The landscape heights are sampled from a fractal
+ * noise height source when the mesh is constructed.
+ *
+ * Generating the landscape is expensive, so the finished vertex and index streams can be baked to a
+ * cache file and loaded from there on the next launch.
+ *
+ * Vertices are stored quantized (see QuantizedTerrainVertex) and are read by the vertex shader from a
+ * shader resource rather than through the input assembler, so the landscape must be drawn with the
+ * QuantizedLandscapeTechnique, a null input layout and ApplyShaderConstants called beforehand.
+ * Ambient occlusion is baked into the vertices when the landscape is generated.
+ *
+ * The landscape can be edited at runtime. Edits are batched up and applied by CommitEdits, which only
+ * rebuilds and re-uploads the parts of the landscape that were changed.
  */
-class LandscapeMesh
+class LandscapeMesh : public BoundedMesh
 {
 public:
     LandscapeMesh( ID3D10Device * pRenderDevice,
 		           unsigned int rows,
 				   unsigned int cols,
-				   float spatialStep );
+				   float spatialStep,
+                   const Noise::NoiseGenerator& heightSource,
+                   const Noise::FractalParams& terrainParams,
+                   const std::wstring& cachePath = std::wstring() );
     LandscapeMesh(const LandscapeMesh&) = delete;
     virtual ~LandscapeMesh();
 
     const LandscapeMesh& operator =(const LandscapeMesh&) = delete;
 
+    // Bind the packed vertices, grid layout and material palette to the effect.
+    void ApplyShaderConstants( ID3D10Effect * pEffect ) const;
+
     void Draw( ID3D10Device *pDevice ) const;
 
+    // Draw only the landscape patches that are inside the view frustum.
+    void Draw( ID3D10Device *pDevice, const Frustum& frustum ) const;
+
     unsigned int VertexCount() const { return mVertexCount; }
     unsigned int FaceCount() const { return mFaceCount; }
-	float GetHeight( float x, float y ) const;
+    size_t VertexBufferSize() const { return sizeof(QuantizedTerrainVertex) * mVertexCount; }
+	float GetHeight( float x, float z ) const;
+
+    // Find where a ray first hits the landscape, eg for mouse picking.
+    bool Raycast( const D3DXVECTOR3& origin,
+                  const D3DXVECTOR3& direction,
+                  float maxDistance,
+                  TerrainRayHit * pHitOut ) const;
+
+    // Terrain editing brushes, see TerrainBrush. Edits change the landscape's heights straight away,
+    // but the height tree, patch bounds and vertex buffer are only updated by the next CommitEdits.
+    void Raise( float x, float z, float radius, float amount );
+    void Flatten( float x, float z, float radius, float height, float strength );
+    void Crater( float x, float z, float radius, float depth );
+
+    // Rebuild and upload the parts of the landscape changed since the last commit. Overlapping edits
+    // are merged and processed once, so call this once per frame after all edits are made.
+    void CommitEdits();
+    bool HasPendingEdits() const { return !mDirtyRects.IsEmpty(); }
+
+    const HeightField& Heights() const { return mHeightField; }
+    const MinMaxHeightTree& HeightTree() const { return mHeightTree; }
+    const GridPatches& Patches() const { return mPatches; }
+    unsigned int VisiblePatchCount() const { return mVisiblePatchCount; }
+
+    // Bounds of the whole landscape, refreshed along with the patch bounds by CommitEdits.
+    virtual const MeshBounds& Bounds() const override { return mBounds; }
 
 private:
-	void Init( ID3D10Device * pDevice, float dx );
-    static void FindVertexColor(float y, D3DXCOLOR * pDiffuse, D3DXCOLOR * pSpecular);
+    void InitHeightField();
+    void GenerateHeights( const Noise::NoiseGenerator& heightSource, const Noise::FractalParams& terrainParams );
+    void BuildHeightTree();
+    void BakeOcclusion();
+    void InitQuantization();
+    bool IsInQuantizationRange( const GridRect& rect ) const;
+    void MarkEdited( const GridRect& rect );
+    void UpdateMeshBounds();
+    void UploadVertices( ID3D10Device * pDevice, const GridRect& rect );
+    void BuildVertices( std::vector<QuantizedTerrainVertex> * pVerticesOut ) const;
+    void OptimizeMesh( std::vector<unsigned int> * pIndices ) const;
+	void CreateBuffers( ID3D10Device * pDevice, const void * pVertices, const unsigned int * pIndices );
+    void DrawRanges( ID3D10Device * pDevice ) const;
+    static unsigned char FindMaterial( float height, const D3DXVECTOR3& normal );
 
 private:
 	unsigned int mNumRows;
 	unsigned int mNumCols;
+    float mSpatialStep;
+    HeightField mHeightField;
+    MinMaxHeightTree mHeightTree;
+    GridPatches mPatches;
+    MeshBounds mBounds;
     unsigned int mVertexCount;
     unsigned int mFaceCount;
+    float mMinHeight;
+    float mHeightStep;
+    float mMaxHeight;
+    TerrainOcclusionParams mOcclusionParams;
+    std::vector<unsigned char> mAmbient;
     Microsoft::WRL::ComPtr<ID3D10Buffer> mVertexBuffer;
+    Microsoft::WRL::ComPtr<ID3D10ShaderResourceView> mVertexView;
     Microsoft::WRL::ComPtr<ID3D10Buffer> mIndexBuffer;
+
+    DirtyRectSet mDirtyRects;
+    unsigned int mPendingEditCount;
+    std::vector<QuantizedTerrainVertex> mUploadScratch;
+
+    mutable std::vector<IndexRange> mVisibleRanges;
+    mutable unsigned int mVisiblePatchCount;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,54 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef SCOTT_HAILSTORM_TERRAIN_BENCHMARKS_H
+#define SCOTT_HAILSTORM_TERRAIN_BENCHMARKS_H
+
+class LandscapeMesh;
+
+/**
+ * Micro benchmarks for the terrain systems. Each benchmark runs against an already constructed
+ * landscape and writes its timings to the log.
+ */
+namespace TerrainBenchmarks
+{
+    // Runs every terrain benchmark.
+    void RunAll(const LandscapeMesh& terrain);
+
+    // Compares height tree ray casts (single and packet) against brute force ray casts.
+    void RunRaycastBenchmark(const LandscapeMesh& terrain, unsigned int rayCount);
+
+    // Checks SIMD frustum culling against the scalar box test, for the landscape patches and for a
+    // large set of random boxes, and measures both.
+    void RunCullingBenchmark(const LandscapeMesh& terrain, unsigned int viewCount);
+
+    // Generates a gridSize x gridSize landscape, packs it into quantized vertices and reports the
+    // memory saved over full float vertices along with the worst height and normal error.
+    void RunQuantizationReport(unsigned int gridSize);
+
+    // Blasts craters of a few sizes into a gridSize x gridSize landscape and compares rebuilding just
+    // the edited areas against rebuilding the whole landscape after each edit.
+    void RunDeformationBenchmark(unsigned int gridSize, unsigned int editCount);
+
+    // Bakes terrain ambient occlusion on a gridSize x gridSize landscape with one thread and then with
+    // more threads up to the number of cores, checking every run produces the same result.
+    void RunOcclusionBenchmark(unsigned int gridSize);
+
+    // Collides batches of spheres, capsules and swept spheres with a gridSize x gridSize landscape,
+    // comparing one thread against every core and cell sorted batches against unsorted ones.
+    void RunCollisionBenchmark(unsigned int gridSize, unsigned int shapeCount);
+}
+
+#endif
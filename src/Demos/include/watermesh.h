@@ -23,6 +23,9 @@
 #include <vector>
 #include <d3dx10.h>
 
+#include "graphics/BoundingVolume.h"
+#include "terrain/GridPatches.h"
+
 // Forward declarations
 struct ID3D10Buffer;
 struct ID3D10Device;
@@ -42,7 +45,7 @@ struct WaterMeshVertex
 /**
  * Contains information on rendering a water plane with ripples.
  */
-class WaterMesh
+class WaterMesh : public BoundedMesh
 {
 public:
     WaterMesh(ID3D10Device * pRenderDevice,
@@ -53,14 +56,22 @@ public:
               float speed,
               float damping);
     WaterMesh(const WaterMesh&) = delete;
-    ~WaterMesh();
+    virtual ~WaterMesh();
 
     WaterMesh& operator =(const WaterMesh&) = delete;
 
     void Draw(ID3D10Device *pDevice) const;
 
+    // Draw only the water patches that are inside the view frustum.
+    void Draw(ID3D10Device *pDevice, const Frustum& frustum) const;
+
     unsigned int VertexCount() const { return mVertexCount; }
     unsigned int FaceCount() const { return mFaceCount; }
+    const GridPatches& Patches() const { return mPatches; }
+    unsigned int VisiblePatchCount() const { return mVisiblePatchCount; }
+
+    // Bounds of the water surface, which follow the ripples as the simulation steps.
+    virtual const MeshBounds& Bounds() const override { return mBounds; }
 
     void Perturb(unsigned int i, unsigned int j, float magnitude);
 
@@ -68,9 +79,11 @@ public:
 
 private:
     void Init(ID3D10Device * pDevice);
-    void UpdateGrid();
+    void UpdateGrid(float * pMinHeightOut, float * pMaxHeightOut);
     void UpdateNormals();
     void UpdateVertexBuffer();
+    void SetHeightRange(float minHeight, float maxHeight);
+    void DrawRanges(ID3D10Device * pDevice) const;
 	
 private:
 	unsigned int mNumRows;
@@ -93,6 +106,12 @@ private:
 
     Microsoft::WRL::ComPtr<ID3D10Buffer> mVertexBuffer;
     Microsoft::WRL::ComPtr<ID3D10Buffer> mIndexBuffer;
+
+    GridPatches mPatches;
+    MeshBounds mBounds;
+    std::vector<unsigned int> mFetchOrder;      // Grid index of each vertex in the vertex buffer.
+    mutable std::vector<IndexRange> mVisibleRanges;
+    mutable unsigned int mVisiblePatchCount;
 };
 
 #endif
\ No newline at end of file
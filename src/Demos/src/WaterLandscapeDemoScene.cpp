@@ -23,23 +23,57 @@
 
 #include "landscapemesh.h"
 #include "watermesh.h"
+#include "terrainbenchmarks.h"
 
 #include "HailstormRuntime.h"
 #include "runtime/mathutils.h"
+#include "runtime/Noise.h"
 #include "graphics/dxrenderer.h"
 #include "graphics/DirectXExceptions.h"
+#include "graphics/Frustum.h"
+#include "graphics/GeometryPool.h"
+#include "graphics/graphicscontentmanager.h"
+#include "graphics/InstanceBatcher.h"
+#include "graphics/meshfactory.h"
+#include "graphics/staticmesh.h"
+#include "graphics/StreamingTexture.h"
 #include "camera/Camera.h"
 
 #undef max
 
+// Seed used to generate the landscape. Changing it produces a different (but repeatable) landscape.
+const unsigned int LANDSCAPE_SEED = 20140611u;
+
+// The field of factory primitives is a grid this many primitives wide, with this many units between
+// neighbors. Its batching counts are logged every BATCH_REPORT_INTERVAL seconds.
+const unsigned int PRIMITIVE_FIELD_SIZE = 16;
+const float PRIMITIVE_FIELD_SPACING = 6.0f;
+const TimeT BATCH_REPORT_INTERVAL = 5.0;
+
+// The landscape is overlaid with a grid texture that repeats every world unit. It is streamed in at
+// full resolution while the camera is within GRID_FULL_DETAIL_HEIGHT units of the ground, and at half
+// the resolution for each doubling of the height past that.
+const unsigned int GRID_TEXTURE_SIZE = 512;
+const float GRID_FULL_DETAIL_HEIGHT = 16.0f;
+const float GRID_STRENGTH = 0.35f;
+
 WaterLandscapeDemoScene::WaterLandscapeDemoScene(std::shared_ptr<Camera> camera)
     : DemoScene(),
       mVertexLayout(),
+      mLandscapeEffect(),
+      mAliveToken(std::make_shared<bool>(true)),
       mWaterMesh(),
       mCamera(camera),
       mLights(),
       mLightType(0),
-      mTerrainMesh()
+      mTerrainMesh(),
+      mGridTexture(),
+      mPrimitiveField(),
+      mInstanceBatcher(),
+      mpGeometryPool(nullptr),
+      mLastBatchReportTime(0.0),
+      mBenchmarkKeyDown(false),
+      mCraterKeyDown(false)
 {
 }
 
@@ -49,18 +83,58 @@ WaterLandscapeDemoScene::~WaterLandscapeDemoScene()
 
 void WaterLandscapeDemoScene::OnInitialize(DXRenderer& dx)
 {
-    HRESULT hr = dx.LoadFxFile(L"../data/shaders/landscape.fx", &mLandscapeEffect);
+    // Compile the landscape effect in the background while the terrain is generated. Nothing is drawn
+    // until it is ready. The load can outlive the scene, so the callback checks the scene is still
+    // around before touching it.
+    DXRenderer * pRenderer = &dx;
+    std::weak_ptr<bool> sceneAlive = mAliveToken;
+
+    dx.ContentManager().loadAsync<ID3D10Effect>(
+        L"shaders\\landscape.fx",
+        [this, pRenderer, sceneAlive](const AssetFuture<ID3D10Effect>& effect)
+        {
+            if (sceneAlive.expired())
+            {
+                return;
+            }
+
+            mLandscapeEffect = effect;
+            BuildInputLayout(*pRenderer);
+        });
+
+    // Only the tail of the grid texture's mips is read now. The rest streams in over the next frames.
+    mGridTexture = dx.ContentManager().loadTexture(L"textures\\grid1m.dds", GRID_TEXTURE_SIZE);
 
     BuildLights();
-    BuildInputLayout(dx);
 
-    mTerrainMesh.reset(new LandscapeMesh(dx.GetDevice(), 129, 129, 1.0f));
+    // Rolling hills with enough height variation to reach from the sandy shore up to the snow line.
+    Noise::NoiseGenerator terrainNoise(LANDSCAPE_SEED);
+    Noise::FractalParams terrainParams;
+
+    terrainParams.basis = Noise::NoiseBasis::Simplex;
+    terrainParams.type = Noise::FractalType::Fbm;
+    terrainParams.octaves = 6;
+    terrainParams.frequency = 0.015f;
+    terrainParams.amplitude = 25.0f;
+    terrainParams.bias = 4.0f;
+
+    mTerrainMesh.reset(new LandscapeMesh(
+        dx.GetDevice(),
+        129,
+        129,
+        1.0f,
+        terrainNoise,
+        terrainParams,
+        L"../data/landscape.terraincache"));
     mWaterMesh.reset(new WaterMesh(dx.GetDevice(), 257, 257, 0.5f, 0.03f, 3.25f, 0.4f));
+
+    BuildPrimitiveField(dx);
 }
 
 void WaterLandscapeDemoScene::OnUpdate(TimeT currentTime, TimeT deltaTime)
 {
     UpdateInput();
+    mTerrainMesh->CommitEdits();
 
     // Every quarter second, generate a random wave
     static float t_base = 0.0f;
@@ -85,6 +159,28 @@ void WaterLandscapeDemoScene::OnUpdate(TimeT currentTime, TimeT deltaTime)
     // looking. In this way it looks like we are holding a flashlight.
     mLights[2].pos = mCamera->Position();
     D3DXVec3Normalize(&mLights[2].dir, &(mCamera->Target() - mCamera->Position()));
+
+    UpdateGridTextureSize();
+    ReportBatching(currentTime);
+}
+
+void WaterLandscapeDemoScene::UpdateGridTextureSize()
+{
+    if (!mGridTexture)
+    {
+        return;
+    }
+
+    D3DXVECTOR3 eye = mCamera->Position();
+    float height = eye.y - std::max(mTerrainMesh->GetHeight(eye.x, eye.z), 0.0f);
+    unsigned int size = GRID_TEXTURE_SIZE;
+
+    for (float distance = GRID_FULL_DETAIL_HEIGHT; height > distance && size > 1; distance *= 2.0f)
+    {
+        size /= 2;
+    }
+
+    mGridTexture->RequestSize(size);
 }
 
 void WaterLandscapeDemoScene::UpdateInput()
@@ -93,6 +189,45 @@ void WaterLandscapeDemoScene::UpdateInput()
     if (GetKeyState('1' & 0x8000)) { mLightType = 0; LOG_DEBUG("Renderer") << "Switched to light type 0"; }
     if (GetKeyState('2' & 0x8000)) { mLightType = 1; LOG_DEBUG("Renderer") << "Switched to light type 1"; }
     if (GetKeyState('3' & 0x8000)) { mLightType = 2; LOG_DEBUG("Renderer") << "Switched to light type 2"; }
+
+    // Run the terrain benchmarks once each time B is pressed.
+    bool benchmarkKeyDown = (GetKeyState('B') & 0x8000) != 0;
+
+    if (benchmarkKeyDown && !mBenchmarkKeyDown)
+    {
+        TerrainBenchmarks::RunAll(*mTerrainMesh);
+    }
+
+    mBenchmarkKeyDown = benchmarkKeyDown;
+
+    // Edit the terrain where the camera is looking. C blasts a crater each time it is pressed, and
+    // holding F flattens the ground towards the height at the center of the view.
+    bool craterKeyDown = (GetKeyState('C') & 0x8000) != 0;
+    bool flattenKeyDown = (GetKeyState('F') & 0x8000) != 0;
+
+    if ((craterKeyDown && !mCraterKeyDown) || flattenKeyDown)
+    {
+        D3DXVECTOR3 eye = mCamera->Position();
+        D3DXVECTOR3 direction = mCamera->Target() - eye;
+        TerrainRayHit hit;
+
+        D3DXVec3Normalize(&direction, &direction);
+
+        if (mTerrainMesh->Raycast(eye, direction, 1000.0f, &hit))
+        {
+            if (craterKeyDown && !mCraterKeyDown)
+            {
+                mTerrainMesh->Crater(hit.position.x, hit.position.z, 6.0f, 3.0f);
+            }
+
+            if (flattenKeyDown)
+            {
+                mTerrainMesh->Flatten(hit.position.x, hit.position.z, 8.0f, hit.position.y, 0.1f);
+            }
+        }
+    }
+
+    mCraterKeyDown = craterKeyDown;
 }
 
 void WaterLandscapeDemoScene::GenerateRandomWave()
@@ -106,21 +241,29 @@ void WaterLandscapeDemoScene::GenerateRandomWave()
 
 void WaterLandscapeDemoScene::OnRender(DXRenderer& dx, TimeT currentTime, TimeT deltaTime) const
 {
-    // Set the device up for rendering our landscape mesh.
-    dx.GetDevice()->IASetInputLayout(mVertexLayout.Get());
+    if (!mLandscapeEffect.succeeded())
+    {
+        return;
+    }
+
+    ID3D10Effect * pLandscapeEffect = mLandscapeEffect.get().Get();
+
     dx.GetDevice()->IASetPrimitiveTopology(D3D10_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 
     D3DXMATRIX projectionMatrix = mCamera->GetProjectionMatrix();
     
-    // Load the landscape technique.
-    ID3D10EffectTechnique * pTechnique = mLandscapeEffect->GetTechniqueByName("LandscapeTechnique");
+    // The landscape pulls its quantized vertices in the shader, while the water still uses regular
+    // vertex buffers.
+    ID3D10EffectTechnique * pTerrainTechnique = pLandscapeEffect->GetTechniqueByName("QuantizedLandscapeTechnique");
+    ID3D10EffectTechnique * pWaterTechnique = pLandscapeEffect->GetTechniqueByName("LandscapeTechnique");
 
     // Grab the shader variables we'll need.
-    ID3D10EffectMatrixVariable * pWVP = mLandscapeEffect->GetVariableByName("gWVP")->AsMatrix();
-    ID3D10EffectMatrixVariable * pWorldVar = mLandscapeEffect->GetVariableByName("gWorld")->AsMatrix();
-    ID3D10EffectVariable * pFxEyePosVar = mLandscapeEffect->GetVariableByName("gEyePosW");
-    ID3D10EffectVariable * pFxLightVar = mLandscapeEffect->GetVariableByName("gLight");
-    ID3D10EffectScalarVariable * pFxLightType = mLandscapeEffect->GetVariableByName("gLightType")->AsScalar();
+    ID3D10EffectMatrixVariable * pWVP = pLandscapeEffect->GetVariableByName("gWVP")->AsMatrix();
+    ID3D10EffectMatrixVariable * pWorldVar = pLandscapeEffect->GetVariableByName("gWorld")->AsMatrix();
+    ID3D10EffectVariable * pFxEyePosVar = pLandscapeEffect->GetVariableByName("gEyePosW");
+    ID3D10EffectVariable * pFxLightVar = pLandscapeEffect->GetVariableByName("gLight");
+    ID3D10EffectScalarVariable * pFxLightType = pLandscapeEffect->GetVariableByName("gLightType")->AsScalar();
+    ID3D10EffectScalarVariable * pFxGridStrength = pLandscapeEffect->GetVariableByName("gGridStrength")->AsScalar();
 
     // Set per frame constants
     D3DXVECTOR3 eyePos = mCamera->Position();
@@ -131,9 +274,11 @@ void WaterLandscapeDemoScene::OnRender(DXRenderer& dx, TimeT currentTime, TimeT
     pFxLightVar->SetRawValue(&selectedLight, 0, sizeof(Light));
     pFxLightType->SetInt(mLightType);
 
-    // Load the effect technique for cube
-    D3D10_TECHNIQUE_DESC technique;
-    pTechnique->GetDesc(&technique);
+    // The streamer swaps the grid texture's view whenever it gains or drops a mip.
+    pLandscapeEffect->GetVariableByName("gGridMap")->AsShaderResource()->SetResource(
+        mGridTexture ? mGridTexture->View() : nullptr);
+
+    mTerrainMesh->ApplyShaderConstants(pLandscapeEffect);
 
     // Apply the landscape technique.
     D3DXMATRIX landTransform;
@@ -142,29 +287,57 @@ void WaterLandscapeDemoScene::OnRender(DXRenderer& dx, TimeT currentTime, TimeT
     D3DXMatrixIdentity(&landTransform);
     D3DXMatrixIdentity(&waterTransform);
 
-    for (unsigned int passIndex = 0; passIndex < technique.Passes; ++passIndex)
+    D3D10_TECHNIQUE_DESC technique;
+    pTerrainTechnique->GetDesc(&technique);
+
+    // Draw the landscape mesh first. The frustum is built from the world view projection matrix, so
+    // it is in the mesh's own space and can be tested against its bounds directly.
+    D3DXMATRIX wvp = landTransform * view * projectionMatrix;
+    Frustum frustum(wvp);
+
+    if (frustum.Intersects(mTerrainMesh->Bounds()))
     {
-        ID3D10EffectPass * pPass = pTechnique->GetPassByIndex(passIndex);
-        dx.SetDefaultRendering();
+        dx.GetDevice()->IASetInputLayout(NULL);
+
+        for (unsigned int passIndex = 0; passIndex < technique.Passes; ++passIndex)
+        {
+            ID3D10EffectPass * pPass = pTerrainTechnique->GetPassByIndex(passIndex);
+            dx.SetDefaultRendering();
 
-        // Draw the landscape mesh first
-        D3DXMATRIX wvp = landTransform * view * projectionMatrix;
+            pWVP->SetMatrix((float*)&wvp);
+            pWorldVar->SetMatrix((float*)&landTransform);
+            pFxGridStrength->SetFloat(mGridTexture ? GRID_STRENGTH : 0.0f);
 
-        pWVP->SetMatrix((float*)&wvp);
-        pWorldVar->SetMatrix((float*)&landTransform);
+            pPass->Apply(0);
+            mTerrainMesh->Draw(dx.GetDevice(), frustum);
+        }
+    }
 
-        pPass->Apply(0);
-        mTerrainMesh->Draw(dx.GetDevice());
+    // Draw the water mesh
+    wvp = waterTransform * view * projectionMatrix;
+    frustum.Set(wvp);
 
-        // Draw the water mesh
-        wvp = waterTransform * view * projectionMatrix;
+    if (frustum.Intersects(mWaterMesh->Bounds()))
+    {
+        dx.GetDevice()->IASetInputLayout(mVertexLayout.Get());
 
-        pWVP->SetMatrix((float*)&wvp);
-        pWorldVar->SetMatrix((float*)&waterTransform);
+        pWaterTechnique->GetDesc(&technique);
 
-        pPass->Apply(0);
-        mWaterMesh->Draw(dx.GetDevice());
+        for (unsigned int passIndex = 0; passIndex < technique.Passes; ++passIndex)
+        {
+            ID3D10EffectPass * pPass = pWaterTechnique->GetPassByIndex(passIndex);
+            dx.SetDefaultRendering();
+
+            pWVP->SetMatrix((float*)&wvp);
+            pWorldVar->SetMatrix((float*)&waterTransform);
+            pFxGridStrength->SetFloat(0.0f);
+
+            pPass->Apply(0);
+            mWaterMesh->Draw(dx.GetDevice(), frustum);
+        }
     }
+
+    DrawPrimitiveField(dx, mCamera->GetViewMatrix() * projectionMatrix);
 }
 
 void WaterLandscapeDemoScene::OnLoadContent(DXRenderer& dx)
@@ -202,6 +375,115 @@ void WaterLandscapeDemoScene::BuildLights()
     mLights[2].range = 10000.0f;
 }
 
+void WaterLandscapeDemoScene::BuildPrimitiveField(DXRenderer& dx)
+{
+    // A few primitive shapes scattered over the dry land. The factory caches each shape, so every
+    // instance of a shape shares one mesh and the batcher can draw all of them with one call. The
+    // shapes all live in the content manager's geometry pool, so moving from one to the next does
+    // not rebind the vertex and index buffers either.
+    MeshFactory& factory = dx.ContentManager().meshFactory();
+    ResourceRegistry& resources = dx.ContentManager().resources();
+
+    const MeshHandle shapes[] =
+    {
+        factory.createBox(0.75f),
+        factory.createIcoSphere(0.75f, 2),
+        factory.createCylinder(0.6f, 1.5f, 16),
+        factory.createCone(0.75f, 1.5f, 16)
+    };
+
+    const unsigned int shapeCount = sizeof(shapes) / sizeof(shapes[0]);
+    const float extent = 0.5f * PRIMITIVE_FIELD_SPACING * (PRIMITIVE_FIELD_SIZE - 1);
+
+    for (unsigned int row = 0; row < PRIMITIVE_FIELD_SIZE; ++row)
+    {
+        for (unsigned int col = 0; col < PRIMITIVE_FIELD_SIZE; ++col)
+        {
+            float x = col * PRIMITIVE_FIELD_SPACING - extent;
+            float z = row * PRIMITIVE_FIELD_SPACING - extent;
+            float height = mTerrainMesh->GetHeight(x, z);
+
+            if (height < 0.5f)
+            {
+                continue;       // Under water.
+            }
+
+            FieldInstance instance;
+            D3DXMATRIX rotation, translation;
+
+            D3DXMatrixRotationY(&rotation, randF(0.0f, 2.0f * D3DX_PI));
+            D3DXMatrixTranslation(&translation, x, height + 0.75f, z);
+
+            instance.mesh = shapes[(row + col) % shapeCount];
+            instance.world = rotation * translation;
+            instance.color = D3DXCOLOR(randF(0.4f, 1.0f), randF(0.4f, 1.0f), randF(0.4f, 1.0f), 1.0f);
+            instance.bounds = BoundingVolume::Transform(resources.GetMesh(instance.mesh)->Bounds(), instance.world);
+
+            mPrimitiveField.push_back(instance);
+        }
+    }
+
+    mInstanceBatcher.reset(new InstanceBatcher(dx.GetDevice()));
+    mpGeometryPool = &dx.ContentManager().geometryPool();
+
+    LOG_INFO("Renderer") << "Scattered " << mPrimitiveField.size() << " primitives over the landscape";
+}
+
+void WaterLandscapeDemoScene::DrawPrimitiveField(DXRenderer& dx, const D3DXMATRIX& viewProjection) const
+{
+    MeshFactory& factory = dx.ContentManager().meshFactory();
+
+    if (!factory.isReady())
+    {
+        return;
+    }
+
+    ResourceRegistry& resources = dx.ContentManager().resources();
+    InstanceMaterial material = factory.instancedMaterial();
+    Frustum frustum(viewProjection);
+
+    factory.staticMeshEffect()->GetVariableByName("gViewProj")->AsMatrix()->SetMatrix((float*)&viewProjection);
+
+    // Queue every visible primitive, then draw them grouped by shape.
+    for (size_t i = 0; i < mPrimitiveField.size(); ++i)
+    {
+        const FieldInstance& instance = mPrimitiveField[i];
+        const StaticMesh * pMesh = resources.GetMesh(instance.mesh);
+
+        if (pMesh != nullptr && frustum.Intersects(instance.bounds))
+        {
+            mInstanceBatcher->Add(pMesh, material, instance.world, instance.color);
+        }
+    }
+
+    // The landscape and water bound buffers of their own.
+    mpGeometryPool->InvalidateBinding();
+
+    dx.SetDefaultRendering();
+    mInstanceBatcher->Flush(dx.GetDevice());
+}
+
+void WaterLandscapeDemoScene::ReportBatching(TimeT currentTime)
+{
+    if (currentTime - mLastBatchReportTime < BATCH_REPORT_INTERVAL)
+    {
+        return;
+    }
+
+    // The pool's counts are reset as each frame starts, so they cover the last frame drawn.
+    const InstanceBatchStats& frame = mInstanceBatcher->LastFlushStats();
+    const InstanceBatchStats& total = mInstanceBatcher->TotalStats();
+    const GeometryPoolStats& binds = mpGeometryPool->Stats();
+
+    LOG_INFO("Renderer") << "Primitive field drew " << frame.instanceCount << " instances in "
+        << frame.drawCount << " draws last frame (" << frame.DrawsSaved() << " saved) with "
+        << binds.bindCount << " buffer binds (" << binds.BindsSaved() << " saved), "
+        << total.DrawsSaved() << " draws saved in the last " << (currentTime - mLastBatchReportTime) << " s";
+
+    mInstanceBatcher->ResetStats();
+    mLastBatchReportTime = currentTime;
+}
+
 void WaterLandscapeDemoScene::BuildInputLayout(DXRenderer& dx)
 {
     // Describe the vertex input layout.
@@ -215,7 +497,7 @@ void WaterLandscapeDemoScene::BuildInputLayout(DXRenderer& dx)
 
     // Load the default pass from the .fx file we loaded earlier
     D3D10_PASS_DESC passDescription;
-    ID3D10EffectTechnique * pTechnique = mLandscapeEffect->GetTechniqueByName("LandscapeTechnique");
+    ID3D10EffectTechnique * pTechnique = mLandscapeEffect.get()->GetTechniqueByName("LandscapeTechnique");
 
     VerifyNotNull(pTechnique);
 
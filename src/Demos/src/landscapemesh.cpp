@@ -20,46 +20,167 @@
 #include <d3dx10.h>
 
 #include "runtime/debugging.h"
+#include "runtime/logging.h"
+#include "runtime/Noise.h"
+#include "runtime/Stopwatch.h"
+#include "terrain/TerrainBrush.h"
+#include "terrain/TerrainCache.h"
+#include "graphics/MeshOptimizer.h"
 #include "landscapemesh.h"
 #include "graphics/dxrenderer.h"
 #include "graphics/DirectXExceptions.h"
 
 #include <vector>
+#include <algorithm>
+#include <cfloat>
 #include <memory>                       // Shared pointers.
 #include <wrl\wrappers\corewrappers.h>  // ComPtr.
 #include <wrl\client.h>                 // ComPtr friends.
 
+#undef min
+#undef max
+
+// Number of grid cells along each side of a landscape patch.
+const unsigned int LANDSCAPE_PATCH_CELLS = 16;
+
+// Extra height above and below the generated terrain that vertex heights can represent, so most edits
+// fit in the quantization range without requantizing the whole landscape.
+const float LANDSCAPE_EDIT_HEADROOM = 16.0f;
+
 const int CUBE_VERTEX_COUNT = 8;
 const int CUBE_FACE_COUNT = 12;
 
 /**
- * The vertex structure that is used in the static mesh
+ * Landscape surface material, picked by the height of the vertex.
  */
-struct LandscapeVertex
+struct LandscapeMaterial
+{
+    float maxHeight;
+    D3DXCOLOR diffuse;
+    D3DXCOLOR spec; // (r, g, b, specPower);
+};
+
+// Must match TERRAIN_MATERIAL_COUNT in landscape.fx.
+const unsigned int LANDSCAPE_MATERIAL_COUNT = 5;
+
+const LandscapeMaterial LANDSCAPE_MATERIALS[LANDSCAPE_MATERIAL_COUNT] =
 {
-	D3DXVECTOR3 pos;
-	D3DXVECTOR3 normal;
-	D3DXCOLOR   diffuse;
-	D3DXCOLOR   spec; // (r, g, b, specPower);
+    { -10.0f,  D3DXCOLOR(1.0f, 0.96f, 0.62f, 1.0f),  D3DXCOLOR(0.2f, 0.2f, 0.2f, 32.0f) },   // Sand
+    { 5.0f,    D3DXCOLOR(0.48f, 0.77f, 0.46f, 1.0f), D3DXCOLOR(0.2f, 0.2f, 0.2f, 32.0f) },   // Light grass
+    { 12.0f,   D3DXCOLOR(0.1f, 0.48f, 0.19f, 1.0f),  D3DXCOLOR(0.2f, 0.2f, 0.2f, 32.0f) },   // Dark grass
+    { 20.0f,   D3DXCOLOR(0.45f, 0.39f, 0.34f, 1.0f), D3DXCOLOR(0.4f, 0.4f, 0.4f, 64.0f) },   // Rock
+    { FLT_MAX, D3DXCOLOR(1.0f, 1.0f, 1.0f, 1.0f),    D3DXCOLOR(0.8f, 0.8f, 0.8f, 64.0f) }    // Snow
 };
 
 /**
- * Static mesh constructor that takes an already constructed vertex and index
- * buffer.
+ * Landscape constructor. When a cache path is given the landscape is loaded from the baked cache file
+ * at that path, and if the cache is missing or was baked with different parameters the landscape is
+ * generated from the height source and the cache is rewritten.
  */
 LandscapeMesh::LandscapeMesh(
     ID3D10Device * pRenderDevice,
 	unsigned int rows,
 	unsigned int cols,
-	float spatialStep)
+	float spatialStep,
+    const Noise::NoiseGenerator& heightSource,
+    const Noise::FractalParams& terrainParams,
+    const std::wstring& cachePath)
     : mNumRows( rows ),
 	  mNumCols( cols ),
-	  mVertexCount( 0 ),
-      mFaceCount( 0 ),
+      mSpatialStep( spatialStep ),
+      mHeightField(),
+      mHeightTree(),
+      mPatches( rows, cols, LANDSCAPE_PATCH_CELLS ),
+      mBounds( BoundingVolume::Empty() ),
+	  mVertexCount( rows * cols ),
+      mFaceCount( ( rows - 1 ) * ( cols - 1 ) * 2 ),
+      mMinHeight( 0.0f ),
+      mHeightStep( 1.0f ),
+      mMaxHeight( 0.0f ),
+      mOcclusionParams(),
+      mAmbient(),
       mVertexBuffer(),
-      mIndexBuffer()
+      mVertexView(),
+      mIndexBuffer(),
+      mDirtyRects(),
+      mPendingEditCount( 0 ),
+      mUploadScratch(),
+      mVisibleRanges(),
+      mVisiblePatchCount( 0 )
 {
-	Init(pRenderDevice, spatialStep);
+    Stopwatch startupTimer;
+
+    TerrainCacheKey cacheKey;
+    cacheKey.rows = rows;
+    cacheKey.cols = cols;
+    cacheKey.spatialStep = spatialStep;
+    cacheKey.seed = heightSource.Seed();
+    cacheKey.params = terrainParams;
+    cacheKey.vertexStride = sizeof(QuantizedTerrainVertex);
+    cacheKey.patchCells = LANDSCAPE_PATCH_CELLS;
+    cacheKey.bakeHash = mOcclusionParams.Hash();
+
+    TerrainCache cache;
+
+    if ( !cachePath.empty() && cache.Open( cachePath, cacheKey ) )
+    {
+        // Warm start, the vertex and index streams are uploaded straight out of the mapped file.
+        InitHeightField();
+        std::copy( cache.Heights(), cache.Heights() + mVertexCount, mHeightField.Data() );
+        BuildHeightTree();
+        InitQuantization();
+
+        // Keep the baked occlusion around for rebaking edited areas.
+        const QuantizedTerrainVertex * pVertices = reinterpret_cast<const QuantizedTerrainVertex *>( cache.Vertices() );
+        mAmbient.resize( mVertexCount );
+
+        for ( unsigned int i = 0; i < mVertexCount; ++i )
+        {
+            mAmbient[i] = pVertices[i].ambient;
+        }
+
+        mPatches.UpdateBounds( mHeightField );
+        UpdateMeshBounds();
+        CreateBuffers( pRenderDevice, cache.Vertices(), cache.Indices() );
+        cache.Close();
+
+        LOG_INFO("Landscape") << "Warm start, loaded baked landscape in " << startupTimer.ElapsedMilliseconds() << " ms";
+    }
+    else
+    {
+        // Cold start, generate everything from scratch.
+        GenerateHeights( heightSource, terrainParams );
+        InitQuantization();
+        BakeOcclusion();
+
+        std::vector<QuantizedTerrainVertex> vertices;
+        std::vector<unsigned int> indices;
+
+        BuildVertices( &vertices );
+        mPatches.BuildIndices( &indices );
+        mPatches.UpdateBounds( mHeightField );
+        UpdateMeshBounds();
+        OptimizeMesh( &indices );
+        CreateBuffers( pRenderDevice, &vertices[0], &indices[0] );
+
+        LOG_INFO("Landscape") << "Cold start, generated landscape in " << startupTimer.ElapsedMilliseconds() << " ms";
+
+        if ( !cachePath.empty() )
+        {
+            TerrainCache::Write(
+                cachePath,
+                cacheKey,
+                mHeightField.Data(),
+                &vertices[0],
+                mVertexCount,
+                &indices[0],
+                static_cast<unsigned int>( indices.size() ) );
+        }
+    }
+
+    LOG_INFO("Landscape") << "Vertex buffer is " << VertexBufferSize() / 1024 << " KB ("
+        << sizeof(QuantizedTerrainVertex) << " bytes/vertex), index buffer is "
+        << sizeof(unsigned int) * mFaceCount * 3 / 1024 << " KB";
 }
 
 /**
@@ -70,71 +191,318 @@ LandscapeMesh::~LandscapeMesh()
 }
 
 /**
- * Magic.
+ * Returns the height of the landscape at world position (x, z) by bilinearly interpolating between the
+ * four closest grid heights. Positions off the edge of the landscape are clamped to the border.
  */
 float LandscapeMesh::GetHeight(float x, float z) const
 {
-	return 0.3f * ( z * sinf( 0.1f * x ) + x * cosf( 0.1f * z ) ) + 8.0f;
+    return mHeightField.SampleHeight( x, z );
 }
 
 /**
- * Takes an array of vertices and indices, uploads them to the video hardware
- * and places their data buffers in mVertexbuffer/mIndexBuffer
+ * Casts a ray against the landscape and returns the closest hit within maxDistance, if any.
+ */
+bool LandscapeMesh::Raycast(
+    const D3DXVECTOR3& origin,
+    const D3DXVECTOR3& direction,
+    float maxDistance,
+    TerrainRayHit * pHitOut) const
+{
+    return mHeightTree.Raycast( origin, direction, maxDistance, pHitOut );
+}
+
+/**
+ * Allocates the height field. Rows run from +z to -z and columns from -x to +x.
+ */
+void LandscapeMesh::InitHeightField()
+{
+	float halfWidth = ( mNumCols - 1 ) * mSpatialStep * 0.5f;
+	float halfDepth = ( mNumRows - 1 ) * mSpatialStep * 0.5f;
+
+    mHeightField = HeightField( mNumRows, mNumCols, -halfWidth, halfDepth, mSpatialStep, -mSpatialStep );
+}
+
+/**
+ * Samples the landscape height source at every grid point and builds the height tree used for ray
+ * casts.
+ */
+void LandscapeMesh::GenerateHeights(
+    const Noise::NoiseGenerator& heightSource,
+    const Noise::FractalParams& terrainParams)
+{
+    InitHeightField();
+
+    Stopwatch timer;
+    heightSource.FillGrid(
+        terrainParams,
+        mNumRows,
+        mNumCols,
+        mHeightField.OriginX(),
+        mHeightField.OriginZ(),
+        mHeightField.StepX(),
+        mHeightField.StepZ(),
+        mHeightField.Data() );
+
+    double elapsed = timer.ElapsedSeconds();
+
+    LOG_INFO("Landscape") << "Generated " << mVertexCount << " height samples in "
+        << elapsed * 1000.0 << " ms (" << mVertexCount / std::max(elapsed, 1e-9) << " samples/s)";
+
+    BuildHeightTree();
+}
+
+/**
+ * Builds the height tree over the current height field.
+ */
+void LandscapeMesh::BuildHeightTree()
+{
+    Stopwatch timer;
+    mHeightTree.Build( mHeightField );
+
+    LOG_INFO("Landscape") << "Built " << mHeightTree.LevelCount() << " level height tree in "
+        << timer.ElapsedMilliseconds() << " ms";
+}
+
+/**
+ * Bakes the ambient occlusion of every point in the height field.
+ */
+void LandscapeMesh::BakeOcclusion()
+{
+    TerrainOcclusionStats stats;
+    TerrainOcclusion::Bake( mHeightField, mOcclusionParams, &mAmbient, &stats );
+
+    LOG_INFO("Landscape") << "Baked ambient occlusion over " << mOcclusionParams.directionCount << " directions in "
+        << stats.seconds * 1000.0 << " ms on " << stats.threadCount << " threads";
+}
+
+/**
+ * Picks the range that vertex heights are quantized over. This only depends on the height field, so a
+ * cached landscape gets the same range it was baked with.
+ */
+void LandscapeMesh::InitQuantization()
+{
+    mHeightField.HeightRange( &mMinHeight, &mMaxHeight );
+
+    mMinHeight -= LANDSCAPE_EDIT_HEADROOM;
+    mMaxHeight += LANDSCAPE_EDIT_HEADROOM;
+    mHeightStep = TerrainQuantization::HeightStep( mMinHeight, mMaxHeight );
+}
+
+/**
+ * Checks if every height in a rectangle of the height field can be quantized without clamping.
+ */
+bool LandscapeMesh::IsInQuantizationRange(const GridRect& rect) const
+{
+    for ( unsigned int row = rect.rowBegin; row < rect.rowEnd; ++row )
+    {
+        for ( unsigned int col = rect.colBegin; col < rect.colEnd; ++col )
+        {
+            float height = mHeightField.Height( row, col );
+
+            if ( height < mMinHeight || height > mMaxHeight )
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Raises (or lowers, for a negative amount) the landscape around (x, z).
+ */
+void LandscapeMesh::Raise(float x, float z, float radius, float amount)
+{
+    MarkEdited( TerrainBrush::Raise( &mHeightField, x, z, radius, amount ) );
+}
+
+/**
+ * Pulls the landscape around (x, z) towards a height.
+ */
+void LandscapeMesh::Flatten(float x, float z, float radius, float height, float strength)
+{
+    MarkEdited( TerrainBrush::Flatten( &mHeightField, x, z, radius, height, strength ) );
+}
+
+/**
+ * Blasts a crater into the landscape at (x, z).
  */
-void LandscapeMesh::Init(ID3D10Device * pRenderDevice, float dx)
+void LandscapeMesh::Crater(float x, float z, float radius, float depth)
 {
-	// Initialize a vertex buffer that contains all the vertices making up our cube
-	mVertexCount = mNumRows * mNumCols;
-	mFaceCount = ( mNumRows - 1 ) * ( mNumCols - 1 ) * 2;
+    MarkEdited( TerrainBrush::Crater( &mHeightField, x, z, radius, depth ) );
+}
 
-	// Create a mesh that models the landscape
-	std::vector<LandscapeVertex> vertices( mVertexCount );
-	
-	float halfWidth  = ( mNumCols - 1 ) * dx * 0.5f;
-	float halfDepth  = ( mNumRows - 1 ) * dx * 0.5f;
+/**
+ * Records a rectangle of changed heights. Vertex normals and occlusion depend on neighboring heights,
+ * so vertices beyond the rectangle change too.
+ */
+void LandscapeMesh::MarkEdited(const GridRect& rect)
+{
+    if ( !rect.IsEmpty() )
+    {
+        mDirtyRects.Add( TerrainOcclusion::AffectedRect( mHeightField, mOcclusionParams, rect ) );
+        ++mPendingEditCount;
+    }
+}
 
-	for ( unsigned int i = 0; i < mNumRows; ++i )
-	{
-		float z = halfDepth - i * dx;
+/**
+ * Brings the height tree, patch bounds and vertex buffer up to date with the edits made since the
+ * last commit. The work done is proportional to the edited area rather than the size of the landscape,
+ * unless an edit moved the terrain outside of the quantization range.
+ */
+void LandscapeMesh::CommitEdits()
+{
+    if ( mDirtyRects.IsEmpty() )
+    {
+        return;
+    }
 
-		for ( unsigned int j = 0; j < mNumCols; ++j )
-		{
-			unsigned int index = i * mNumCols + j;
-			float x = -halfWidth + j * dx;
+    Stopwatch timer;
+    bool inRange = true;
 
-			// Graph of this function looks like a mountain range.
-			float y = GetHeight( x, z );
+    for ( size_t i = 0; i < mDirtyRects.Rects().size() && inRange; ++i )
+    {
+        inRange = IsInQuantizationRange( mDirtyRects.Rects()[i] );
+    }
 
-			vertices[index].pos = D3DXVECTOR3( x, y, z );
-			FindVertexColor( y, &vertices[index].diffuse, &vertices[index].spec );
+    if ( !inRange )
+    {
+        // Existing vertices were quantized over the old range, so every vertex needs redoing.
+        GridRect everything = { 0, 0, mNumRows, mNumCols };
+
+        InitQuantization();
+        mDirtyRects.Clear();
+        mDirtyRects.Add( everything );
 
-			// Calculate normal for this point. Since this landscape is mathematically generated we can use
-			// the book's nice formula for finding a smooth normal;
-			//  FORMULA: n = ( -df / dx, 1, -df/dz)
-			D3DXVECTOR3 normal;
+        LOG_INFO("Landscape") << "Edit left the quantization range, requantizing heights " << mMinHeight << " to " << mMaxHeight;
+    }
 
-			normal.x = -0.03f * z * cosf( 0.1f * x ) - 0.3f * cosf( 0.1f * z );
-			normal.y =  1.0f;
-			normal.z = -0.3f * sinf( 0.1f * x ) + 0.03f * x * sinf( 0.1f * z );
+    Microsoft::WRL::ComPtr<ID3D10Device> device;
+    mVertexBuffer->GetDevice( &device );
 
-			D3DXVec3Normalize( &vertices[index].normal, &normal );
-		}
-	}
+    const std::vector<GridRect>& rects = mDirtyRects.Rects();
 
+    for ( size_t i = 0; i < rects.size(); ++i )
+    {
+        mHeightTree.Update( rects[i] );
+        mPatches.UpdateBounds( mHeightField, rects[i] );
+        TerrainOcclusion::Bake( mHeightField, mOcclusionParams, rects[i], &mAmbient[0] );
+        UploadVertices( device.Get(), rects[i] );
+    }
+
+    UpdateMeshBounds();
+
+    LOG_DEBUG("Landscape") << "Committed " << mPendingEditCount << " edits as " << rects.size() << " rects, "
+        << mDirtyRects.Area() << " vertices updated in " << timer.ElapsedMilliseconds() << " ms";
+
+    mDirtyRects.Clear();
+    mPendingEditCount = 0;
+}
+
+/**
+ * The landscape's bounds are the union of its patch bounds, which are already kept up to date with
+ * every edit, so this never has to look at the heights.
+ */
+void LandscapeMesh::UpdateMeshBounds()
+{
+    D3DXVECTOR3 minCorner, maxCorner;
+
+    if ( mPatches.Bounds().Extent( &minCorner, &maxCorner ) )
+    {
+        mBounds = BoundingVolume::FromBox( minCorner, maxCorner );
+    }
+    else
+    {
+        mBounds = BoundingVolume::Empty();
+    }
+}
+
+/**
+ * Re-quantizes the vertices in a rectangle of the grid and uploads them. Vertices are stored in grid
+ * order, so each row of the rectangle is a contiguous run of the vertex buffer, and rectangles that
+ * span the full width of the grid are a single run.
+ */
+void LandscapeMesh::UploadVertices(ID3D10Device * pDevice, const GridRect& rect)
+{
+    mUploadScratch.resize( rect.Area() );
+    TerrainQuantization::PackVertices(
+        mHeightField, rect, mMinHeight, mHeightStep, &FindMaterial, &mAmbient[0], &mUploadScratch[0] );
+
+    const unsigned int vertexSize = sizeof(QuantizedTerrainVertex);
+    bool fullRows = ( rect.colBegin == 0 && rect.colEnd == mNumCols );
+    unsigned int runCount = fullRows ? 1 : rect.Rows();
+    unsigned int runLength = fullRows ? rect.Area() : rect.Cols();
+
+    for ( unsigned int run = 0; run < runCount; ++run )
+    {
+        unsigned int firstVertex = ( rect.rowBegin + run ) * mNumCols + rect.colBegin;
+
+        D3D10_BOX box;
+        box.left   = firstVertex * vertexSize;
+        box.right  = ( firstVertex + runLength ) * vertexSize;
+        box.top    = 0;
+        box.bottom = 1;
+        box.front  = 0;
+        box.back   = 1;
+
+        pDevice->UpdateSubresource( mVertexBuffer.Get(), 0, &box, &mUploadScratch[run * runLength], 0, 0 );
+    }
+}
+
+/**
+ * Creates a quantized vertex for every point in the height field.
+ */
+void LandscapeMesh::BuildVertices(std::vector<QuantizedTerrainVertex> * pVerticesOut) const
+{
+    TerrainQuantization::PackVertices( mHeightField, mMinHeight, mHeightStep, &FindMaterial, &mAmbient[0], pVerticesOut );
+}
+
+/**
+ * Reorders the triangles in each patch for the post transform vertex cache. The vertices themselves
+ * are left in grid order because the shader rebuilds x and z from the vertex index.
+ */
+void LandscapeMesh::OptimizeMesh(std::vector<unsigned int> * pIndices) const
+{
+    MeshOptimizer::VertexCacheStats before =
+        MeshOptimizer::AnalyzeVertexCache( &(*pIndices)[0], static_cast<unsigned int>( pIndices->size() ), mVertexCount );
+
+    std::vector<IndexRange> patchRanges;
+    mPatches.GetPatchRanges( &patchRanges );
+
+    MeshOptimizer::OptimizeVertexCache( &(*pIndices)[0], mVertexCount, patchRanges );
+
+    MeshOptimizer::VertexCacheStats after =
+        MeshOptimizer::AnalyzeVertexCache( &(*pIndices)[0], static_cast<unsigned int>( pIndices->size() ), mVertexCount );
+
+    MeshOptimizer::LogOptimization( "Landscape", before, after );
+}
+
+/**
+ * Takes an array of vertices and indices, uploads them to the video hardware
+ * and places their data buffers in mVertexbuffer/mIndexBuffer. The vertex buffer is bound as a
+ * shader resource of 16 bit elements rather than as a vertex buffer, and is kept updatable so that
+ * edited areas can be re-uploaded.
+ */
+void LandscapeMesh::CreateBuffers(
+    ID3D10Device * pRenderDevice,
+    const void * pVertices,
+    const unsigned int * pIndices)
+{
     // Describe the layout of the vertex buffer and create it.
     D3D10_BUFFER_DESC vbd;
     ZeroMemory( &vbd, sizeof(D3D10_BUFFER_DESC) );
     
-    vbd.Usage          = D3D10_USAGE_IMMUTABLE;
-    vbd.ByteWidth      = sizeof(LandscapeVertex) * mVertexCount;
-    vbd.BindFlags      = D3D10_BIND_VERTEX_BUFFER;
+    vbd.Usage          = D3D10_USAGE_DEFAULT;
+    vbd.ByteWidth      = static_cast<UINT>( VertexBufferSize() );
+    vbd.BindFlags      = D3D10_BIND_SHADER_RESOURCE;
 	vbd.CPUAccessFlags = 0;
 	vbd.MiscFlags      = 0;
     
     D3D10_SUBRESOURCE_DATA vInitData;
     ZeroMemory( &vInitData, sizeof(D3D10_SUBRESOURCE_DATA) );
 
-    vInitData.pSysMem = &vertices[0];
+    vInitData.pSysMem = pVertices;
 
 	// Upload the vertex buffer to the graphics card.
 	HRESULT hr = pRenderDevice->CreateBuffer(&vbd, &vInitData, &mVertexBuffer);
@@ -144,38 +512,33 @@ void LandscapeMesh::Init(ID3D10Device * pRenderDevice, float dx)
         throw new DirectXException(hr, L"Creating vertex buffer for landscape mesh", L"", __FILE__, __LINE__);
     }
 
-	// Generate the landscape index buffer
-	std::vector<DWORD> indices( mFaceCount * 3 );
-	int k = 0;
+    D3D10_SHADER_RESOURCE_VIEW_DESC srvd;
+    ZeroMemory( &srvd, sizeof(D3D10_SHADER_RESOURCE_VIEW_DESC) );
 
-	for ( unsigned int i = 0; i < mNumRows - 1; ++i )
-	{
-		for ( unsigned int j = 0; j < mNumCols - 1; ++j )
-		{
-			indices[k]   = i * mNumCols + j;
-			indices[k+1] = i * mNumCols + j + 1;
-			indices[k+2] = ( i + 1 ) * mNumCols + j;
+    srvd.Format               = DXGI_FORMAT_R16_UINT;
+    srvd.ViewDimension        = D3D10_SRV_DIMENSION_BUFFER;
+    srvd.Buffer.ElementOffset = 0;
+    srvd.Buffer.ElementWidth  = mVertexCount * sizeof(QuantizedTerrainVertex) / sizeof(unsigned short);
 
-			indices[k+3] = ( i + 1 ) * mNumCols + j;
-			indices[k+4] = i * mNumCols + j + 1;
-			indices[k+5] = ( i +1 ) * mNumCols + j + 1;
+    hr = pRenderDevice->CreateShaderResourceView( mVertexBuffer.Get(), &srvd, &mVertexView );
 
-			k += 6; // next quad
-		}
-	}
+    if (FAILED(hr))
+    {
+        throw new DirectXException(hr, L"Creating vertex view for landscape mesh", L"", __FILE__, __LINE__);
+    }
 
     // Describe the layout of the index buffer and create it.
     D3D10_BUFFER_DESC ibd;
     ZeroMemory( &ibd, sizeof(D3D10_BUFFER_DESC) );
 
     ibd.Usage     = D3D10_USAGE_IMMUTABLE;
-    ibd.ByteWidth = sizeof(DWORD) * mFaceCount * 3;
+    ibd.ByteWidth = sizeof(unsigned int) * mFaceCount * 3;
     ibd.BindFlags = D3D10_BIND_INDEX_BUFFER;
     
     D3D10_SUBRESOURCE_DATA iInitData;
     ZeroMemory( &iInitData, sizeof(D3D10_SUBRESOURCE_DATA) );
 
-    iInitData.pSysMem = &indices[0];
+    iInitData.pSysMem = pIndices;
 
 	// Upload the index buffer to the graphics card.
     hr = pRenderDevice->CreateBuffer(&ibd, &iInitData, &mIndexBuffer);
@@ -187,55 +550,100 @@ void LandscapeMesh::Init(ID3D10Device * pRenderDevice, float dx)
 }
 
 /**
- * Render the cube
+ * Sets the landscape's packed vertices and the constants needed to unpack them.
+ */
+void LandscapeMesh::ApplyShaderConstants(ID3D10Effect * pEffect) const
+{
+    VerifyNotNull( pEffect );
+
+    float grid[4] =
+    {
+        mHeightField.OriginX(), mHeightField.OriginZ(), mHeightField.StepX(), mHeightField.StepZ()
+    };
+
+    float height[2] = { mMinHeight, mHeightStep };
+
+    D3DXCOLOR diffuse[LANDSCAPE_MATERIAL_COUNT];
+    D3DXCOLOR spec[LANDSCAPE_MATERIAL_COUNT];
+
+    for ( unsigned int i = 0; i < LANDSCAPE_MATERIAL_COUNT; ++i )
+    {
+        diffuse[i] = LANDSCAPE_MATERIALS[i].diffuse;
+        spec[i] = LANDSCAPE_MATERIALS[i].spec;
+    }
+
+    pEffect->GetVariableByName("gTerrainGrid")->AsVector()->SetFloatVector( grid );
+    pEffect->GetVariableByName("gTerrainHeight")->SetRawValue( height, 0, sizeof(height) );
+    pEffect->GetVariableByName("gTerrainCols")->AsScalar()->SetInt( static_cast<int>( mNumCols ) );
+    pEffect->GetVariableByName("gMaterialDiffuse")->AsVector()->SetFloatVectorArray(
+        reinterpret_cast<float*>( diffuse ), 0, LANDSCAPE_MATERIAL_COUNT );
+    pEffect->GetVariableByName("gMaterialSpec")->AsVector()->SetFloatVectorArray(
+        reinterpret_cast<float*>( spec ), 0, LANDSCAPE_MATERIAL_COUNT );
+    pEffect->GetVariableByName("gTerrainVertices")->AsShaderResource()->SetResource(
+        const_cast<ID3D10ShaderResourceView*>( mVertexView.Get() ) );
+}
+
+/**
+ * Render the whole landscape
  */
 void LandscapeMesh::Draw(ID3D10Device * pDevice) const
 {
     assert( pDevice != NULL );
 
-    const unsigned int stride = sizeof( LandscapeVertex );
-    const unsigned int offset = 0;
+    mVisibleRanges.clear();
 
     if ( mFaceCount > 0 )
+    {
+        IndexRange everything = { 0, mFaceCount * 3 };
+        mVisibleRanges.push_back( everything );
+    }
+
+    mVisiblePatchCount = mPatches.PatchCount();
+    DrawRanges( pDevice );
+}
+
+/**
+ * Render the landscape patches that intersect the view frustum
+ */
+void LandscapeMesh::Draw(ID3D10Device * pDevice, const Frustum& frustum) const
+{
+    assert( pDevice != NULL );
+
+    mVisiblePatchCount = mPatches.Cull( frustum, &mVisibleRanges );
+    DrawRanges( pDevice );
+}
+
+/**
+ * Issues one draw call for each range in mVisibleRanges. Vertices are pulled by the shader, so only
+ * the index buffer is bound.
+ */
+void LandscapeMesh::DrawRanges(ID3D10Device * pDevice) const
+{
+    if ( !mVisibleRanges.empty() )
     {
         // Need to cast away const-ness when calling DirectX... /sigh
-        ID3D10Buffer * pVertexBuffer = const_cast<ID3D10Buffer*>(mVertexBuffer.Get());
         ID3D10Buffer * pIndexBuffer  = const_cast<ID3D10Buffer*>(mIndexBuffer.Get());
 
-        pDevice->IASetVertexBuffers( 0, 1, &pVertexBuffer, &stride, &offset );
         pDevice->IASetIndexBuffer( pIndexBuffer, DXGI_FORMAT_R32_UINT, 0 );
-        pDevice->DrawIndexed( mFaceCount * 3, 0, 0 );
+
+        for ( size_t i = 0; i < mVisibleRanges.size(); ++i )
+        {
+            pDevice->DrawIndexed( mVisibleRanges[i].indexCount, mVisibleRanges[i].firstIndex, 0 );
+        }
     }
 }
 
 /**
-* Returns an appropriate color for the landscape height.
-*/
-void LandscapeMesh::FindVertexColor(float y, D3DXCOLOR * pDiffuse, D3DXCOLOR * pSpecular)
+ * Returns the landscape material for a vertex.
+ */
+unsigned char LandscapeMesh::FindMaterial(float height, const D3DXVECTOR3& /*normal*/)
 {
-    if (y < -10.0f)
-    {
-        *pDiffuse = D3DXCOLOR(1.0f, 0.96f, 0.62f, 1.0f);
-        *pSpecular = D3DXCOLOR(0.2f, 0.2f, 0.2f, 32.0f);
-    }
-    else if (y < 5.0f)
-    {
-        *pDiffuse = D3DXCOLOR(0.48f, 0.77f, 0.46f, 1.0f);
-        *pSpecular = D3DXCOLOR(0.2f, 0.2f, 0.2f, 32.0f);
-    }
-    else if (y < 12.0f)
-    {
-        *pDiffuse = D3DXCOLOR(0.1f, 0.48f, 0.19f, 1.0f);
-        *pSpecular = D3DXCOLOR(0.2f, 0.2f, 0.2f, 32.0f);
-    }
-    else if (y < 20.0f)
-    {
-        *pDiffuse = D3DXCOLOR(0.45f, 0.39f, 0.34f, 1.0f);
-        *pSpecular = D3DXCOLOR(0.4f, 0.4f, 0.4f, 64.0f);
-    }
-    else
+    unsigned char material = 0;
+
+    while ( material + 1u < LANDSCAPE_MATERIAL_COUNT && height >= LANDSCAPE_MATERIALS[material].maxHeight )
     {
-        *pDiffuse = D3DXCOLOR(1.0f, 1.0f, 1.0f, 1.0f);
-        *pSpecular = D3DXCOLOR(0.8f, 0.8f, 0.8f, 64.0f);
+        ++material;
     }
-}
\ No newline at end of file
+
+    return material;
+}
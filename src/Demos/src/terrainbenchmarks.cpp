@@ -0,0 +1,729 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "stdafx.h"
+#include "terrainbenchmarks.h"
+
+#include <d3dx10.h>
+
+#include "landscapemesh.h"
+#include "graphics/Frustum.h"
+#include "runtime/logging.h"
+#include "runtime/Noise.h"
+#include "runtime/Parallel.h"
+#include "runtime/Stopwatch.h"
+#include "terrain/GridPatches.h"
+#include "terrain/HeightField.h"
+#include "terrain/MinMaxHeightTree.h"
+#include "terrain/QuantizedTerrain.h"
+#include "terrain/TerrainBrush.h"
+#include "terrain/TerrainCollision.h"
+#include "terrain/TerrainOcclusion.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#undef min
+#undef max
+
+namespace
+{
+    // Seed for the randomly generated benchmark inputs, so runs can be compared against each other.
+    const unsigned int BENCHMARK_SEED = 1234u;
+
+    /**
+     * Generates picking style rays. Rays are created in bundles of 64 that share an origin above the
+     * terrain and fan out in an 8x8 grid around a random downward view direction, much like the rays
+     * through neighboring pixels of a camera.
+     */
+    void GenerateRays(
+        const HeightField& field,
+        unsigned int rayCount,
+        std::vector<D3DXVECTOR3> * pOriginsOut,
+        std::vector<D3DXVECTOR3> * pDirectionsOut)
+    {
+        std::mt19937 random(BENCHMARK_SEED);
+        std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+        float minHeight = 0.0f, maxHeight = 0.0f;
+        field.HeightRange(&minHeight, &maxHeight);
+
+        float halfWidth = std::fabs(field.CellCols() * field.StepX()) * 0.5f;
+        float halfDepth = std::fabs(field.CellRows() * field.StepZ()) * 0.5f;
+        float centerX = field.OriginX() + field.CellCols() * field.StepX() * 0.5f;
+        float centerZ = field.OriginZ() + field.CellRows() * field.StepZ() * 0.5f;
+
+        pOriginsOut->resize(rayCount);
+        pDirectionsOut->resize(rayCount);
+
+        D3DXVECTOR3 origin, forward;
+
+        for (unsigned int i = 0; i < rayCount; ++i)
+        {
+            if (i % 64 == 0)
+            {
+                origin = D3DXVECTOR3(
+                    centerX + unit(random) * halfWidth,
+                    maxHeight + 5.0f + std::fabs(unit(random)) * 20.0f,
+                    centerZ + unit(random) * halfDepth);
+
+                forward = D3DXVECTOR3(unit(random), -0.25f - 0.75f * std::fabs(unit(random)), unit(random));
+            }
+
+            float s = static_cast<float>(i % 8) / 7.0f - 0.5f;
+            float t = static_cast<float>((i / 8) % 8) / 7.0f - 0.5f;
+
+            D3DXVECTOR3 direction = forward + D3DXVECTOR3(s * 0.1f, 0.0f, t * 0.1f);
+            D3DXVec3Normalize(&(*pDirectionsOut)[i], &direction);
+            (*pOriginsOut)[i] = origin;
+        }
+    }
+
+    /**
+     * Generates view projection matrices for cameras placed randomly above the terrain, looking at
+     * random points on it.
+     */
+    void GenerateViews(const HeightField& field, unsigned int viewCount, std::vector<D3DXMATRIX> * pViewsOut)
+    {
+        std::mt19937 random(BENCHMARK_SEED);
+        std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+        float halfWidth = std::fabs(field.CellCols() * field.StepX()) * 0.5f;
+        float halfDepth = std::fabs(field.CellRows() * field.StepZ()) * 0.5f;
+        float centerX = field.OriginX() + field.CellCols() * field.StepX() * 0.5f;
+        float centerZ = field.OriginZ() + field.CellRows() * field.StepZ() * 0.5f;
+
+        D3DXMATRIX projection;
+        D3DXMatrixPerspectiveFovLH(&projection, static_cast<float>(D3DX_PI) * 0.25f, 4.0f / 3.0f, 1.0f, 1000.0f);
+
+        pViewsOut->resize(viewCount);
+
+        for (unsigned int i = 0; i < viewCount; ++i)
+        {
+            D3DXVECTOR3 eye(centerX + unit(random) * halfWidth, 20.0f + std::fabs(unit(random)) * 40.0f, centerZ + unit(random) * halfDepth);
+            D3DXVECTOR3 target(centerX + unit(random) * halfWidth, 0.0f, centerZ + unit(random) * halfDepth);
+            D3DXVECTOR3 up(0.0f, 1.0f, 0.0f);
+            D3DXMATRIX view;
+
+            D3DXMatrixLookAtLH(&view, &eye, &target, &up);
+            (*pViewsOut)[i] = view * projection;
+        }
+    }
+
+    /**
+     * Culls a set of boxes from every view with both the SIMD and scalar tests, logs the timings and
+     * returns the number of boxes where the two disagree.
+     */
+    unsigned int CompareCulling(const char * pName, const BoundingBoxSet& boxes, const std::vector<D3DXMATRIX>& views)
+    {
+        std::vector<Frustum> frustums(views.begin(), views.end());
+        std::vector<unsigned char> simdVisible(boxes.Count() * views.size());
+        std::vector<unsigned char> scalarVisible(boxes.Count() * views.size());
+        unsigned int visibleCount = 0;
+
+        Stopwatch timer;
+
+        for (size_t v = 0; v < frustums.size(); ++v)
+        {
+            visibleCount += frustums[v].CullBoxes(boxes, &simdVisible[v * boxes.Count()]);
+        }
+
+        double simdSeconds = timer.ElapsedSeconds();
+        timer.Restart();
+
+        for (size_t v = 0; v < frustums.size(); ++v)
+        {
+            for (unsigned int i = 0; i < boxes.Count(); ++i)
+            {
+                scalarVisible[v * boxes.Count() + i] = frustums[v].IntersectsBox(boxes.Min(i), boxes.Max(i)) ? 1 : 0;
+            }
+        }
+
+        double scalarSeconds = timer.ElapsedSeconds();
+        unsigned int mismatchCount = 0;
+
+        for (size_t i = 0; i < simdVisible.size(); ++i)
+        {
+            mismatchCount += (simdVisible[i] != scalarVisible[i] ? 1 : 0);
+        }
+
+        double tested = static_cast<double>(boxes.Count()) * views.size();
+
+        LOG_INFO("Benchmark") << "Frustum culling " << pName << ": " << boxes.Count() << " boxes, " << views.size()
+            << " views, " << 100.0 * visibleCount / std::max(tested, 1.0) << "% visible, " << mismatchCount << " mismatches";
+        LOG_INFO("Benchmark") << "  SSE:     " << tested / std::max(simdSeconds, 1e-9) << " boxes/s";
+        LOG_INFO("Benchmark") << "  scalar:  " << tested / std::max(scalarSeconds, 1e-9) << " boxes/s";
+
+        return mismatchCount;
+    }
+
+    // Size of the unquantized landscape vertex: float3 position, float3 normal and float4 diffuse and
+    // specular colours.
+    const size_t FLOAT_VERTEX_SIZE = 56;
+
+    unsigned char FindBenchmarkMaterial(float height, const D3DXVECTOR3& /*normal*/)
+    {
+        return height < 0.0f ? 0 : 1;
+    }
+
+    double ToMegabytes(double bytes)
+    {
+        return bytes / (1024.0 * 1024.0);
+    }
+
+    /**
+     * Scalar version of the occlusion bake for a single grid point, to check the SIMD bake against.
+     */
+    unsigned char ReferenceVisibility(
+        const HeightField& field,
+        const TerrainOcclusionParams& params,
+        unsigned int row,
+        unsigned int col)
+    {
+        D3DXVECTOR3 point = field.Position(row, col);
+        float occlusion = 0.0f;
+
+        float slopeX = (field.Height(row, col + 1) - field.Height(row, col - 1)) / (2.0f * field.StepX());
+        float slopeZ = (field.Height(row + 1, col) - field.Height(row - 1, col)) / (2.0f * field.StepZ());
+
+        for (unsigned int d = 0; d < params.directionCount; ++d)
+        {
+            float angle = 2.0f * D3DX_PI * (d + 0.5f) / params.directionCount;
+            float tangent = slopeX * std::cos(angle) + slopeZ * std::sin(angle);
+            float horizon = tangent;
+
+            for (float distance = params.firstStep; distance <= params.maxDistance; distance *= params.stepGrowth)
+            {
+                float height = field.SampleHeight(point.x + std::cos(angle) * distance, point.z + std::sin(angle) * distance);
+                horizon = std::max(horizon, (height - point.y) / distance);
+            }
+
+            occlusion += horizon / std::sqrt(1.0f + horizon * horizon) - tangent / std::sqrt(1.0f + tangent * tangent);
+        }
+
+        float visibility = 255.0f - occlusion * 255.0f / params.directionCount;
+        return static_cast<unsigned char>(std::min(std::max(visibility, 0.0f), 255.0f) + 0.5f);
+    }
+
+    /**
+     * Fills a gridSize x gridSize height field, centered on the origin, with rolling fractal hills.
+     */
+    void GenerateField(unsigned int gridSize, HeightField * pFieldOut)
+    {
+        float halfSize = (gridSize - 1) * 0.5f;
+        *pFieldOut = HeightField(gridSize, gridSize, -halfSize, halfSize, 1.0f, -1.0f);
+
+        Noise::NoiseGenerator noise(BENCHMARK_SEED);
+        Noise::FractalParams params;
+
+        params.frequency = 0.015f;
+        params.amplitude = 25.0f;
+
+        noise.FillGrid(
+            params,
+            pFieldOut->Rows(),
+            pFieldOut->Cols(),
+            pFieldOut->OriginX(),
+            pFieldOut->OriginZ(),
+            pFieldOut->StepX(),
+            pFieldOut->StepZ(),
+            pFieldOut->Data());
+    }
+
+    /**
+     * Runs a batch of collision queries with a few different settings, checking they all produce the
+     * same contacts, and logs the speed of each.
+     */
+    template<typename Shape>
+    void MeasureCollisionQuery(
+        const char * pName,
+        const TerrainCollider& collider,
+        void (TerrainCollider::*query)(const Shape *, unsigned int, TerrainContact *, const TerrainCollisionParams&) const,
+        const std::vector<Shape>& shapes)
+    {
+        unsigned int count = static_cast<unsigned int>(shapes.size());
+        TerrainCollisionParams params[3];
+        const char * names[3] = { "1 thread, unsorted", "1 thread, sorted", "all threads, sorted" };
+
+        params[0].threadCount = 1;
+        params[0].sortByCell = false;
+        params[1].threadCount = 1;
+        params[2].threadCount = Parallel::DefaultThreadCount();
+
+        std::vector<TerrainContact> baseline(count), contacts(count);
+        unsigned int touchingCount = 0;
+
+        for (unsigned int p = 0; p < 3; ++p)
+        {
+            std::vector<TerrainContact>& results = (p == 0) ? baseline : contacts;
+
+            Stopwatch timer;
+            (collider.*query)(&shapes[0], count, &results[0], params[p]);
+            double seconds = timer.ElapsedSeconds();
+
+            unsigned int mismatchCount = 0;
+
+            for (unsigned int i = 0; i < count; ++i)
+            {
+                if (p == 0)
+                {
+                    touchingCount += baseline[i].touching ? 1 : 0;
+                }
+                else if (results[i].touching != baseline[i].touching ||
+                    (baseline[i].touching && (results[i].depth != baseline[i].depth || results[i].time != baseline[i].time)))
+                {
+                    ++mismatchCount;
+                }
+            }
+
+            if (p == 0)
+            {
+                LOG_INFO("Benchmark") << "  " << pName << ": " << touchingCount << " of " << count << " touching";
+            }
+
+            LOG_INFO("Benchmark") << "    " << names[p] << ": " << count / std::max(seconds, 1e-9) / 1000000.0
+                << " M queries/s, " << mismatchCount << " mismatches";
+        }
+    }
+}
+
+namespace TerrainBenchmarks
+{
+    void RunAll(const LandscapeMesh& terrain)
+    {
+        RunRaycastBenchmark(terrain, 4096);
+        RunCullingBenchmark(terrain, 256);
+        RunQuantizationReport(4097);
+        RunDeformationBenchmark(1025, 64);
+        RunOcclusionBenchmark(1025);
+        RunCollisionBenchmark(1025, 65536);
+    }
+
+    void RunRaycastBenchmark(const LandscapeMesh& terrain, unsigned int rayCount)
+    {
+        const HeightField& field = terrain.Heights();
+        const MinMaxHeightTree& tree = terrain.HeightTree();
+        const float maxDistance = 1000.0f;
+
+        std::vector<D3DXVECTOR3> origins, directions;
+        GenerateRays(field, rayCount, &origins, &directions);
+
+        std::vector<float> maxDistances(rayCount, maxDistance);
+        std::vector<TerrainRayHit> treeHits(rayCount), packetHits(rayCount), bruteHits(rayCount);
+        std::vector<char> treeDidHit(rayCount), bruteDidHit(rayCount);
+
+        // Height tree, one ray at a time.
+        Stopwatch timer;
+
+        for (unsigned int i = 0; i < rayCount; ++i)
+        {
+            treeDidHit[i] = tree.Raycast(origins[i], directions[i], maxDistance, &treeHits[i]);
+        }
+
+        double treeSeconds = timer.ElapsedSeconds();
+
+        // Height tree, four rays at a time.
+        timer.Restart();
+        tree.RaycastBatch(&origins[0], &directions[0], &maxDistances[0], rayCount, &packetHits[0]);
+
+        double packetSeconds = timer.ElapsedSeconds();
+
+        // Brute force is far slower, so only a slice of the rays are used to estimate its speed.
+        unsigned int bruteCount = std::max(1u, std::min(rayCount, 256u));
+        timer.Restart();
+
+        for (unsigned int i = 0; i < bruteCount; ++i)
+        {
+            bruteDidHit[i] = tree.RaycastBruteForce(origins[i], directions[i], maxDistance, &bruteHits[i]);
+        }
+
+        double bruteSeconds = timer.ElapsedSeconds();
+
+        // Every method should agree on what was hit.
+        unsigned int hitCount = 0, mismatchCount = 0;
+
+        for (unsigned int i = 0; i < rayCount; ++i)
+        {
+            bool packetDidHit = packetHits[i].distance >= 0.0f;
+
+            hitCount += treeDidHit[i] ? 1 : 0;
+
+            if ((treeDidHit[i] != 0) != packetDidHit ||
+                (packetDidHit && std::fabs(treeHits[i].distance - packetHits[i].distance) > 1e-3f))
+            {
+                ++mismatchCount;
+            }
+
+            if (i < bruteCount &&
+                (treeDidHit[i] != bruteDidHit[i] ||
+                (bruteDidHit[i] && std::fabs(treeHits[i].distance - bruteHits[i].distance) > 1e-3f)))
+            {
+                ++mismatchCount;
+            }
+        }
+
+        LOG_INFO("Benchmark") << "Terrain raycast: " << field.Rows() << "x" << field.Cols() << " grid, "
+            << tree.LevelCount() << " tree levels, " << rayCount << " rays, " << hitCount << " hits, "
+            << mismatchCount << " mismatches";
+        LOG_INFO("Benchmark") << "  height tree:    " << rayCount / std::max(treeSeconds, 1e-9) << " rays/s";
+        LOG_INFO("Benchmark") << "  4 ray packets:  " << rayCount / std::max(packetSeconds, 1e-9) << " rays/s";
+        LOG_INFO("Benchmark") << "  brute force:    " << bruteCount / std::max(bruteSeconds, 1e-9) << " rays/s";
+    }
+}
+
+namespace TerrainBenchmarks
+{
+    void RunCullingBenchmark(const LandscapeMesh& terrain, unsigned int viewCount)
+    {
+        std::vector<D3DXMATRIX> views;
+        GenerateViews(terrain.Heights(), viewCount, &views);
+
+        // The landscape's own patches.
+        const GridPatches& patches = terrain.Patches();
+        CompareCulling("landscape patches", patches.Bounds(), views);
+
+        std::vector<IndexRange> ranges;
+        size_t rangeCount = 0;
+        unsigned int visibleCount = 0;
+        Stopwatch timer;
+
+        for (unsigned int v = 0; v < viewCount; ++v)
+        {
+            visibleCount += patches.Cull(Frustum(views[v]), &ranges);
+            rangeCount += ranges.size();
+        }
+
+        LOG_INFO("Benchmark") << "  patch cull + merge: " << timer.ElapsedMilliseconds() * 1000.0 / std::max(viewCount, 1u)
+            << " us/view, " << static_cast<double>(visibleCount) / std::max(viewCount, 1u) << " of "
+            << patches.PatchCount() << " patches in " << static_cast<double>(rangeCount) / std::max(viewCount, 1u)
+            << " draw calls per view";
+
+        // A much larger set of small random boxes spread over the same area, to measure throughput.
+        const HeightField& field = terrain.Heights();
+        const unsigned int boxCount = 65536;
+
+        std::mt19937 random(BENCHMARK_SEED);
+        std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+        float halfWidth = std::fabs(field.CellCols() * field.StepX()) * 0.5f;
+        float halfDepth = std::fabs(field.CellRows() * field.StepZ()) * 0.5f;
+
+        BoundingBoxSet boxes;
+        boxes.Resize(boxCount);
+
+        for (unsigned int i = 0; i < boxCount; ++i)
+        {
+            D3DXVECTOR3 center(unit(random) * halfWidth, unit(random) * 20.0f, unit(random) * halfDepth);
+            D3DXVECTOR3 extent(1.0f + std::fabs(unit(random)), 1.0f + std::fabs(unit(random)), 1.0f + std::fabs(unit(random)));
+
+            boxes.Set(i, center - extent, center + extent);
+        }
+
+        CompareCulling("random boxes", boxes, std::vector<D3DXMATRIX>(views.begin(), views.begin() + std::min(viewCount, 16u)));
+    }
+}
+
+namespace TerrainBenchmarks
+{
+    void RunQuantizationReport(unsigned int gridSize)
+    {
+        HeightField field;
+        GenerateField(gridSize, &field);
+
+        float minHeight = 0.0f, maxHeight = 0.0f;
+        field.HeightRange(&minHeight, &maxHeight);
+        float heightStep = TerrainQuantization::HeightStep(minHeight, maxHeight);
+
+        Stopwatch timer;
+        std::vector<QuantizedTerrainVertex> vertices;
+        TerrainQuantization::PackVertices(field, minHeight, heightStep, &FindBenchmarkMaterial, nullptr, &vertices);
+        double packSeconds = timer.ElapsedSeconds();
+
+        // Worst case error after decoding.
+        float maxHeightError = 0.0f;
+        float minNormalDot = 1.0f;
+
+        for (unsigned int row = 0; row < field.Rows(); ++row)
+        {
+            for (unsigned int col = 0; col < field.Cols(); ++col)
+            {
+                const QuantizedTerrainVertex& vertex = vertices[static_cast<size_t>(row) * field.Cols() + col];
+
+                float height = TerrainQuantization::DecodeHeight(vertex.height, minHeight, heightStep);
+                D3DXVECTOR3 normal = TerrainQuantization::DecodeNormal(vertex.normal);
+                D3DXVECTOR3 expected = field.Normal(row, col);
+
+                maxHeightError = std::max(maxHeightError, std::fabs(height - field.Height(row, col)));
+                minNormalDot = std::min(minNormalDot, D3DXVec3Dot(&normal, &expected));
+            }
+        }
+
+        double vertexCount = static_cast<double>(vertices.size());
+        double indexBytes = static_cast<double>(field.CellRows()) * field.CellCols() * 6 * sizeof(unsigned int);
+        double floatBytes = vertexCount * FLOAT_VERTEX_SIZE;
+        double packedBytes = vertexCount * sizeof(QuantizedTerrainVertex);
+        float maxNormalError = std::acos(std::min(std::max(minNormalDot, -1.0f), 1.0f)) * 180.0f / D3DX_PI;
+
+        LOG_INFO("Benchmark") << "Terrain quantization: " << field.Rows() << "x" << field.Cols() << " grid, "
+            << packSeconds * 1000.0 << " ms to pack (" << vertexCount / std::max(packSeconds, 1e-9) << " vertices/s)";
+        LOG_INFO("Benchmark") << "  float vertices:     " << ToMegabytes(floatBytes) << " MB (" << FLOAT_VERTEX_SIZE
+            << " bytes/vertex), " << ToMegabytes(floatBytes + indexBytes) << " MB with indices";
+        LOG_INFO("Benchmark") << "  quantized vertices: " << ToMegabytes(packedBytes) << " MB ("
+            << sizeof(QuantizedTerrainVertex) << " bytes/vertex), " << ToMegabytes(packedBytes + indexBytes)
+            << " MB with indices";
+        LOG_INFO("Benchmark") << "  vertex memory saved: " << ToMegabytes(floatBytes - packedBytes) << " MB ("
+            << 100.0 * (1.0 - packedBytes / floatBytes) << "%)";
+        LOG_INFO("Benchmark") << "  max height error " << maxHeightError << " (range " << minHeight << " to "
+            << maxHeight << "), max normal error " << maxNormalError << " degrees";
+    }
+}
+
+namespace TerrainBenchmarks
+{
+    void RunDeformationBenchmark(unsigned int gridSize, unsigned int editCount)
+    {
+        HeightField field;
+        GenerateField(gridSize, &field);
+
+        float minHeight = 0.0f, maxHeight = 0.0f;
+        field.HeightRange(&minHeight, &maxHeight);
+
+        // Leave room for the craters so the quantization range never has to change.
+        minHeight -= 16.0f;
+        maxHeight += 16.0f;
+        float heightStep = TerrainQuantization::HeightStep(minHeight, maxHeight);
+
+        MinMaxHeightTree tree(field);
+        GridPatches patches(field.Rows(), field.Cols(), 16);
+        patches.UpdateBounds(field);
+
+        std::vector<QuantizedTerrainVertex> vertices;
+        TerrainQuantization::PackVertices(field, minHeight, heightStep, &FindBenchmarkMaterial, nullptr, &vertices);
+
+        std::mt19937 random(BENCHMARK_SEED);
+        std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+        float halfSize = field.CellCols() * 0.5f;
+
+        const float radii[] = { 4.0f, 16.0f, 64.0f };
+        std::vector<QuantizedTerrainVertex> scratch;
+
+        LOG_INFO("Benchmark") << "Terrain deformation: " << field.Rows() << "x" << field.Cols() << " grid, "
+            << editCount << " craters per radius";
+
+        for (size_t r = 0; r < sizeof(radii) / sizeof(radii[0]); ++r)
+        {
+            // Incremental rebuild of just the edited rectangle plus a one point border for normals.
+            unsigned int updatedVertices = 0;
+            double incrementalSeconds = 0.0;
+
+            for (unsigned int i = 0; i < editCount; ++i)
+            {
+                GridRect edited = TerrainBrush::Crater(
+                    &field, unit(random) * halfSize, unit(random) * halfSize, radii[r], 2.0f);
+
+                Stopwatch timer;
+                GridRect dirty = edited.Expand(1, field.Rows(), field.Cols());
+
+                tree.Update(dirty);
+                patches.UpdateBounds(field, dirty);
+
+                scratch.resize(dirty.Area());
+                TerrainQuantization::PackVertices(field, dirty, minHeight, heightStep, &FindBenchmarkMaterial, nullptr, &scratch[0]);
+
+                for (unsigned int row = dirty.rowBegin; row < dirty.rowEnd; ++row)
+                {
+                    std::copy(
+                        scratch.begin() + (row - dirty.rowBegin) * dirty.Cols(),
+                        scratch.begin() + (row - dirty.rowBegin + 1) * dirty.Cols(),
+                        vertices.begin() + static_cast<size_t>(row) * field.Cols() + dirty.colBegin);
+                }
+
+                incrementalSeconds += timer.ElapsedSeconds();
+                updatedVertices += dirty.Area();
+            }
+
+            // Rebuilding everything, which is what every edit would cost without dirty rectangles.
+            Stopwatch timer;
+            MinMaxHeightTree fullTree(field);
+            GridPatches fullPatches(field.Rows(), field.Cols(), 16);
+            std::vector<QuantizedTerrainVertex> fullVertices;
+
+            fullPatches.UpdateBounds(field);
+            TerrainQuantization::PackVertices(field, minHeight, heightStep, &FindBenchmarkMaterial, nullptr, &fullVertices);
+            double fullSeconds = timer.ElapsedSeconds();
+
+            // The incremental results must match a full rebuild.
+            unsigned int mismatchCount = 0;
+
+            for (size_t v = 0; v < vertices.size(); ++v)
+            {
+                mismatchCount += (vertices[v].height != fullVertices[v].height ||
+                                  vertices[v].normal != fullVertices[v].normal ||
+                                  vertices[v].material != fullVertices[v].material) ? 1 : 0;
+            }
+
+            for (unsigned int p = 0; p < patches.PatchCount(); ++p)
+            {
+                mismatchCount += (patches.Bounds().MinY()[p] != fullPatches.Bounds().MinY()[p] ||
+                                  patches.Bounds().MaxY()[p] != fullPatches.Bounds().MaxY()[p]) ? 1 : 0;
+            }
+
+            std::vector<D3DXVECTOR3> origins, directions;
+            GenerateRays(field, 1024, &origins, &directions);
+
+            for (size_t i = 0; i < origins.size(); ++i)
+            {
+                TerrainRayHit a, b;
+                bool hitA = tree.Raycast(origins[i], directions[i], 1000.0f, &a);
+                bool hitB = fullTree.Raycast(origins[i], directions[i], 1000.0f, &b);
+
+                mismatchCount += (hitA != hitB || (hitA && a.distance != b.distance)) ? 1 : 0;
+            }
+
+            LOG_INFO("Benchmark") << "  radius " << radii[r] << ": " << updatedVertices / std::max(editCount, 1u)
+                << " vertices/edit, incremental " << incrementalSeconds * 1000000.0 / std::max(editCount, 1u)
+                << " us/edit, full rebuild " << fullSeconds * 1000000.0 << " us, " << mismatchCount << " mismatches";
+        }
+    }
+}
+
+namespace TerrainBenchmarks
+{
+    void RunOcclusionBenchmark(unsigned int gridSize)
+    {
+        HeightField field;
+        GenerateField(gridSize, &field);
+
+        TerrainOcclusionParams params;
+        std::vector<unsigned char> baseline;
+        TerrainOcclusionStats baselineStats;
+
+        params.threadCount = 1;
+        TerrainOcclusion::Bake(field, params, &baseline, &baselineStats);
+
+        LOG_INFO("Benchmark") << "Terrain occlusion bake: " << field.Rows() << "x" << field.Cols() << " grid, "
+            << params.directionCount << " directions, " << baselineStats.sampleCount / baseline.size()
+            << " samples per point";
+
+        // Scale from one thread up to every hardware thread, doubling each time.
+        std::vector<unsigned int> threadCounts;
+
+        for (unsigned int threads = 1; threads < Parallel::DefaultThreadCount(); threads *= 2)
+        {
+            threadCounts.push_back(threads);
+        }
+
+        threadCounts.push_back(Parallel::DefaultThreadCount());
+
+        for (size_t t = 0; t < threadCounts.size(); ++t)
+        {
+            std::vector<unsigned char> visibility;
+            TerrainOcclusionStats stats = baselineStats;
+
+            params.threadCount = threadCounts[t];
+
+            if (threadCounts[t] > 1)
+            {
+                TerrainOcclusion::Bake(field, params, &visibility, &stats);
+            }
+            else
+            {
+                visibility = baseline;
+            }
+
+            unsigned int mismatchCount = 0;
+
+            for (size_t i = 0; i < visibility.size(); ++i)
+            {
+                mismatchCount += (visibility[i] != baseline[i]) ? 1 : 0;
+            }
+
+            LOG_INFO("Benchmark") << "  " << stats.threadCount << " threads: " << stats.seconds * 1000.0 << " ms, "
+                << baselineStats.seconds / std::max(stats.seconds, 1e-9) << "x speedup, "
+                << stats.sampleCount / std::max(stats.seconds, 1e-9) / 1000000.0 << " M samples/s, "
+                << stats.stealCount << " steals, " << mismatchCount << " mismatches";
+        }
+
+        // Spot check the SIMD bake against the scalar reference. Rounding can differ by one step.
+        std::mt19937 random(BENCHMARK_SEED);
+        std::uniform_int_distribution<unsigned int> rows(0, field.Rows() - 1), cols(0, field.Cols() - 1);
+        unsigned int checkCount = 4096, mismatchCount = 0;
+        double averageVisibility = 0.0;
+
+        for (unsigned int i = 0; i < checkCount; ++i)
+        {
+            unsigned int row = rows(random), col = cols(random);
+            int expected = ReferenceVisibility(field, params, row, col);
+            int actual = baseline[static_cast<size_t>(row) * field.Cols() + col];
+
+            mismatchCount += (std::abs(expected - actual) > 1) ? 1 : 0;
+            averageVisibility += actual / 255.0;
+        }
+
+        LOG_INFO("Benchmark") << "  scalar reference: " << checkCount << " points checked, " << mismatchCount
+            << " mismatches, average visibility " << averageVisibility / checkCount;
+    }
+}
+
+namespace TerrainBenchmarks
+{
+    void RunCollisionBenchmark(unsigned int gridSize, unsigned int shapeCount)
+    {
+        HeightField field;
+        GenerateField(gridSize, &field);
+
+        TerrainCollider collider(field);
+
+        // Shapes are scattered over the landscape, starting just above or slightly under the ground
+        // like bodies resting on it, and sweeps fall as far as they would in a few 60Hz steps.
+        std::mt19937 random(BENCHMARK_SEED);
+        std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+        float halfSize = field.CellCols() * 0.5f;
+
+        std::vector<CollisionSphere> spheres(shapeCount);
+        std::vector<CollisionCapsule> capsules(shapeCount);
+        std::vector<CollisionSweptSphere> sweeps(shapeCount);
+
+        for (unsigned int i = 0; i < shapeCount; ++i)
+        {
+            float x = unit(random) * halfSize, z = unit(random) * halfSize;
+            float radius = 1.0f + unit(random) * 0.5f;
+            D3DXVECTOR3 center(x, field.SampleHeight(x, z) + radius + unit(random) * 1.5f, z);
+
+            spheres[i].center = center;
+            spheres[i].radius = radius;
+
+            D3DXVECTOR3 axis(unit(random), unit(random) * 0.25f, unit(random));
+            D3DXVec3Normalize(&axis, &axis);
+
+            capsules[i].a = center - axis * 1.5f;
+            capsules[i].b = center + axis * 1.5f;
+            capsules[i].radius = radius * 0.5f;
+
+            sweeps[i].start = center + D3DXVECTOR3(0.0f, 2.0f, 0.0f);
+            sweeps[i].end = sweeps[i].start + D3DXVECTOR3(unit(random), -4.0f + unit(random), unit(random));
+            sweeps[i].radius = radius;
+        }
+
+        LOG_INFO("Benchmark") << "Terrain collision: " << field.Rows() << "x" << field.Cols() << " grid, "
+            << shapeCount << " shapes per batch";
+
+        MeasureCollisionQuery("spheres", collider, &TerrainCollider::CollideSpheres, spheres);
+        MeasureCollisionQuery("capsules", collider, &TerrainCollider::CollideCapsules, capsules);
+        MeasureCollisionQuery("swept spheres", collider, &TerrainCollider::SweepSpheres, sweeps);
+    }
+}
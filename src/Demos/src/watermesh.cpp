@@ -22,9 +22,17 @@
 #include <d3dx10.h>
 
 #include <vector>
+#include <algorithm>
 
 #include "graphics/dxrenderer.h"
 #include "graphics/DirectXExceptions.h"
+#include "graphics/MeshOptimizer.h"
+
+#undef min
+#undef max
+
+// Number of grid cells along each side of a water patch.
+const unsigned int WATER_PATCH_CELLS = 16;
 
 /**
  * Static mesh constructor that takes an already constructed vertex and index
@@ -53,7 +61,12 @@ WaterMesh::WaterMesh( ID3D10Device * pRenderDevice,
       mCurrentSolution(new D3DXVECTOR3[rows * cols]),
       mNormals(new D3DXVECTOR3[rows * cols]),
       mVertexBuffer(),
-      mIndexBuffer()
+      mIndexBuffer(),
+      mPatches( rows, cols, WATER_PATCH_CELLS ),
+      mBounds( BoundingVolume::Empty() ),
+      mFetchOrder(),
+      mVisibleRanges(),
+      mVisiblePatchCount( 0 )
 {
 	Init( pRenderDevice );
 }
@@ -128,32 +141,38 @@ void WaterMesh::Init(ID3D10Device * pRenderDevice)
         throw new DirectXException(hr, L"Creating vertex buffer for water mesh", L"", __FILE__, __LINE__);
     }
 
-	// Generate the landscape index buffer
-	std::vector<DWORD> indices( mFaceCount * 3 );
-	int k = 0;
+	// Generate the water index buffer, laid out patch by patch so that patches can be culled.
+	std::vector<unsigned int> indices;
+	mPatches.BuildIndices( &indices );
+	mPatches.UpdateBounds( mCurrentSolution.get(), sizeof(D3DXVECTOR3) );
+	mBounds = BoundingVolume::FromPoints( mCurrentSolution.get(), mVertexCount, sizeof(D3DXVECTOR3) );
 
-	for ( unsigned int i = 0; i < mNumRows - 1; ++i )
-	{
-		for ( unsigned int j = 0; j < mNumCols - 1; ++j )
-		{
-			indices[k]   = i * mNumCols + j;
-			indices[k+1] = i * mNumCols + j + 1;
-			indices[k+2] = ( i + 1 ) * mNumCols + j;
+	// Reorder each patch's triangles for the vertex cache. The simulation needs its vertices in grid
+	// order, so rather than moving them the vertex buffer is filled through mFetchOrder instead.
+	MeshOptimizer::VertexCacheStats before =
+		MeshOptimizer::AnalyzeVertexCache( &indices[0], static_cast<unsigned int>( indices.size() ), mVertexCount );
 
-			indices[k+3] = ( i + 1 ) * mNumCols + j;
-			indices[k+4] = i * mNumCols + j + 1;
-			indices[k+5] = ( i +1 ) * mNumCols + j + 1;
+	std::vector<IndexRange> patchRanges;
+	mPatches.GetPatchRanges( &patchRanges );
 
-			k += 6; // next quad
-		}
-	}
+	MeshOptimizer::OptimizeVertexCache( &indices[0], mVertexCount, patchRanges );
+	MeshOptimizer::OptimizeVertexFetchRemap(
+		&indices[0],
+		static_cast<unsigned int>( indices.size() ),
+		mVertexCount,
+		&mFetchOrder );
+
+	MeshOptimizer::VertexCacheStats after =
+		MeshOptimizer::AnalyzeVertexCache( &indices[0], static_cast<unsigned int>( indices.size() ), mVertexCount );
+
+	MeshOptimizer::LogOptimization( "Water", before, after );
 
     // Describe the layout of the index buffer and create it.
     D3D10_BUFFER_DESC ibd;
     ZeroMemory( &ibd, sizeof(D3D10_BUFFER_DESC) );
 
     ibd.Usage     = D3D10_USAGE_IMMUTABLE;
-    ibd.ByteWidth = sizeof(DWORD) * mFaceCount * 3;
+    ibd.ByteWidth = sizeof(unsigned int) * mFaceCount * 3;
     ibd.BindFlags = D3D10_BIND_INDEX_BUFFER;
     
     D3D10_SUBRESOURCE_DATA iInitData;
@@ -185,7 +204,10 @@ void WaterMesh::Update( float deltaTime )
 	// Only update the simulation at the specified time step
 	if ( t >= mTimeStep )
 	{
-        UpdateGrid();
+        float minHeight = 0.0f;
+        float maxHeight = 0.0f;
+
+        UpdateGrid( &minHeight, &maxHeight );
 
 		// We just overwrote the previous buffer with our new data, so this data needs to become
 		// the current data, and the current one should become the new previous data.
@@ -195,11 +217,23 @@ void WaterMesh::Update( float deltaTime )
 
         UpdateNormals();
         UpdateVertexBuffer();
+
+        // Ripples move the surface up and down, so the patch bounds need to follow.
+        mPatches.UpdateBounds( mCurrentSolution.get(), sizeof(D3DXVECTOR3) );
+        SetHeightRange( minHeight, maxHeight );
 	}
 }
 
-void WaterMesh::UpdateGrid()
+/**
+ * Steps the simulation, writing the new heights over the previous solution. The range of the new
+ * heights is gathered on the way so the bounds can be refreshed without another pass over the grid.
+ */
+void WaterMesh::UpdateGrid(float * pMinHeightOut, float * pMaxHeightOut)
 {
+    // Boundary points are held at zero and are part of the range too.
+    float minHeight = 0.0f;
+    float maxHeight = 0.0f;
+
     // Only update interior points; we use zero boundary conditions.
     for (unsigned int i = 1; i < mNumRows - 1; ++i)
     {
@@ -207,15 +241,22 @@ void WaterMesh::UpdateGrid()
         {
             // Note that j indexes x, and i indexes z.  Our +z axis goes "down" which
             // is to keep consistent with our row indices going down.
-            mPreviousSolution[i * mNumCols + j].y =
+            float height =
                 mK1 * mPreviousSolution[i * mNumCols + j].y +
                 mK2 * mCurrentSolution[i * mNumCols + j].y +
                 mK3 * (mCurrentSolution[(i + 1) * mNumCols + j].y +
                 mCurrentSolution[(i - 1) * mNumCols + j].y +
                 mCurrentSolution[i * mNumCols + j + 1].y +
                 mCurrentSolution[i * mNumCols + j - 1].y);
+
+            mPreviousSolution[i * mNumCols + j].y = height;
+            minHeight = std::min(minHeight, height);
+            maxHeight = std::max(maxHeight, height);
         }
     }
+
+    *pMinHeightOut = minHeight;
+    *pMaxHeightOut = maxHeight;
 }
 
 void WaterMesh::UpdateNormals()
@@ -247,12 +288,15 @@ void WaterMesh::UpdateVertexBuffer()
 
     if (SUCCEEDED(hr))
     {
+        // Vertices are written in the order the index buffer first uses them, see Init().
         for (unsigned int i = 0; i < mNumRows * mNumCols; ++i)
         {
-            pVertices[i].pos = mCurrentSolution[i];
+            unsigned int gridIndex = mFetchOrder[i];
+
+            pVertices[i].pos = mCurrentSolution[gridIndex];
             pVertices[i].diffuse = D3DXCOLOR(0.0f, 0.0f, 1.0f, 1.0f);
             pVertices[i].spec = D3DXCOLOR(1.0f, 1.0f, 1.0f, 128.0f);
-            pVertices[i].normal = mNormals[i];
+            pVertices[i].normal = mNormals[gridIndex];
         }
     }
     else
@@ -263,6 +307,21 @@ void WaterMesh::UpdateVertexBuffer()
     mVertexBuffer->Unmap();
 }
 
+/**
+ * The water only moves up and down, so its extent along x and z never changes and the bounds are
+ * rebuilt from the height range alone.
+ */
+void WaterMesh::SetHeightRange(float minHeight, float maxHeight)
+{
+    D3DXVECTOR3 minCorner = mBounds.minCorner;
+    D3DXVECTOR3 maxCorner = mBounds.maxCorner;
+
+    minCorner.y = minHeight;
+    maxCorner.y = maxHeight;
+
+    mBounds = BoundingVolume::FromBox( minCorner, maxCorner );
+}
+
 /**
  * Puts a ripple into the water
  */
@@ -280,19 +339,64 @@ void WaterMesh::Perturb( unsigned int i, unsigned int j, float magnitude )
 	mCurrentSolution[ i * mNumCols + j - 1 ].y     += halfMagnitude;
 	mCurrentSolution[ ( i + 1 ) * mNumCols + j ].y += halfMagnitude;
 	mCurrentSolution[ ( i + 1 ) * mNumCols + j ].y += halfMagnitude;
+
+	// The disturbed points can poke out of the bounds until the next simulation step.
+	const unsigned int disturbed[4] =
+	{
+		i * mNumCols + j, i * mNumCols + j + 1, i * mNumCols + j - 1, ( i + 1 ) * mNumCols + j
+	};
+
+	float minHeight = mBounds.minCorner.y;
+	float maxHeight = mBounds.maxCorner.y;
+
+	for ( unsigned int k = 0; k < 4; ++k )
+	{
+		minHeight = std::min( minHeight, mCurrentSolution[ disturbed[k] ].y );
+		maxHeight = std::max( maxHeight, mCurrentSolution[ disturbed[k] ].y );
+	}
+
+	SetHeightRange( minHeight, maxHeight );
 }
 
 /**
- * Render the cube
+ * Render the whole water surface
  */
 void WaterMesh::Draw(ID3D10Device * pDevice) const
 {
     assert(pDevice != NULL);
 
+    mVisibleRanges.clear();
+
+    if ( mFaceCount > 0 )
+    {
+        IndexRange everything = { 0, mFaceCount * 3 };
+        mVisibleRanges.push_back( everything );
+    }
+
+    mVisiblePatchCount = mPatches.PatchCount();
+    DrawRanges( pDevice );
+}
+
+/**
+ * Render the water patches that intersect the view frustum
+ */
+void WaterMesh::Draw(ID3D10Device * pDevice, const Frustum& frustum) const
+{
+    assert(pDevice != NULL);
+
+    mVisiblePatchCount = mPatches.Cull( frustum, &mVisibleRanges );
+    DrawRanges( pDevice );
+}
+
+/**
+ * Issues one draw call for each range in mVisibleRanges.
+ */
+void WaterMesh::DrawRanges(ID3D10Device * pDevice) const
+{
     const unsigned int stride = sizeof( WaterMeshVertex );
     const unsigned int offset = 0;
 
-    if ( mFaceCount > 0 )
+    if ( !mVisibleRanges.empty() )
     {
         // Need to cast away const-ness when calling DirectX... /sigh
         ID3D10Buffer * pVertexBuffer = const_cast<ID3D10Buffer*>(mVertexBuffer.Get());
@@ -300,6 +404,10 @@ void WaterMesh::Draw(ID3D10Device * pDevice) const
 
         pDevice->IASetVertexBuffers( 0, 1, &pVertexBuffer, &stride, &offset );
         pDevice->IASetIndexBuffer( pIndexBuffer, DXGI_FORMAT_R32_UINT, 0 );
-        pDevice->DrawIndexed( mFaceCount * 3, 0, 0 );
+
+        for ( size_t i = 0; i < mVisibleRanges.size(); ++i )
+        {
+            pDevice->DrawIndexed( mVisibleRanges[i].indexCount, mVisibleRanges[i].firstIndex, 0 );
+        }
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,170 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef SCOTT_HAILSTORM_GRAPHICS_ASSET_CACHE_H
+#define SCOTT_HAILSTORM_GRAPHICS_ASSET_CACHE_H
+
+#include <iosfwd>
+#include <list>
+#include <map>
+#include <string>
+
+#include "graphics/AssetFuture.h"
+
+class ResourceRegistry;
+
+enum class AssetType
+{
+    Mesh,
+    Effect,
+    Count
+};
+
+/**
+ * Memory used by an asset, or a set of assets. GPU bytes are an estimate of what the driver allocates
+ * for the asset's device objects (eg the size of its vertex and index buffers).
+ */
+struct AssetMemory
+{
+    unsigned long long cpuBytes;
+    unsigned long long gpuBytes;
+};
+
+/**
+ * Identifies a loaded asset by its type, its canonical path (see AssetCache::CanonicalPath) and the
+ * parameters it was loaded with (eg effect compile flags). Loading the same file with different
+ * parameters gives a different asset.
+ */
+struct AssetKey
+{
+    AssetType type;
+    std::wstring path;
+    unsigned int flags;
+
+    bool operator <(const AssetKey& other) const;
+};
+
+/**
+ * Counts and memory of the assets in a cache, split by type.
+ */
+struct AssetCacheStats
+{
+    unsigned int residentCount[static_cast<int>(AssetType::Count)];
+    AssetMemory memory[static_cast<int>(AssetType::Count)];
+    AssetMemory totalMemory;
+    unsigned int hitCount;              // Loads that found the asset already in the cache.
+    unsigned int missCount;             // Loads that had to read the asset.
+    unsigned int evictionCount;         // Assets evicted to stay in the budget, or by EvictUnreferenced.
+};
+
+/**
+ * Remembers every asset GraphicsContentManager loads, so loading the same asset again hands back the
+ * one that is already resident (or still loading) instead of a second copy.
+ *
+ * Ownership is shared through the asset's AssetFuture: each copy of a future is a reference, and an
+ * asset that nobody outside the cache holds a future to is unreferenced. Unreferenced assets stay
+ * resident, so a scene that comes back to them finds them still loaded, until the cache goes over its
+ * memory budget. Trim then evicts them, least recently used first. An evicted asset's device objects
+ * are handed to the ResourceRegistry to destroy once the GPU is done with them.
+ *
+ * Assets that are still referenced are never evicted, so the budget can be exceeded if the assets in
+ * use need more than it allows. The cache logs a warning when that happens.
+ *
+ * Only use the cache from the render thread.
+ */
+class AssetCache
+{
+public:
+    explicit AssetCache(ResourceRegistry * pResources);
+    AssetCache(const AssetCache&) = delete;
+    ~AssetCache();
+
+    AssetCache& operator =(const AssetCache&) = delete;
+
+    // Find an asset, and mark it as the most recently used. Returns false if it isn't in the cache.
+    template<typename T>
+    bool Find(const AssetKey& key, AssetFuture<T> * pFutureOut);
+
+    // Add an asset that has just started loading.
+    template<typename T>
+    void Insert(const AssetKey& key, const AssetFuture<T>& future);
+
+    // Record how much memory an asset uses once it has loaded. Does nothing if the asset has been
+    // removed from the cache in the meantime.
+    void SetMemory(const AssetKey& key, const AssetMemory& memory);
+
+    // Forget an asset without releasing it, eg because it failed to load. Futures that were handed out
+    // for it are unaffected.
+    void Remove(const AssetKey& key);
+
+    // Limit the memory the cache's assets can use. Zero means no limit.
+    void SetBudget(const AssetMemory& budget);
+    const AssetMemory& Budget() const { return mBudget; }
+
+    // Evict unreferenced assets, least recently used first, until the cache is within its budget.
+    // Returns the number evicted.
+    unsigned int Trim();
+
+    // Evict every unreferenced asset, eg after switching scenes. Returns the number evicted.
+    unsigned int EvictUnreferenced();
+
+    // Release every asset, referenced or not.
+    void Clear();
+
+    bool IsReferenced(const AssetKey& key) const;
+    unsigned int Count() const { return static_cast<unsigned int>(mEntries.size()); }
+
+    AssetCacheStats Stats() const;
+    void ResetStats();
+
+    // Write a line for each resident asset, most recently used first, followed by the totals.
+    void DumpResidentSet(std::ostream& out) const;
+
+    // Lower case the path, use backslashes for separators and remove "." and ".." parts, so different
+    // spellings of the same file give the same key.
+    static std::wstring CanonicalPath(const std::wstring& path);
+
+private:
+    struct Entry
+    {
+        AssetFuture<StaticMesh> mesh;
+        AssetFuture<ID3D10Effect> effect;
+        AssetMemory memory;
+        unsigned int lastUsedFrame;
+        std::list<AssetKey>::iterator recentPosition;
+    };
+
+    typedef std::map<AssetKey, Entry> EntryMap;
+
+    template<typename T>
+    static AssetFuture<T>& EntryFuture(Entry& entry);
+
+    static bool IsReferenced(const Entry& entry);
+    static bool IsOverBudget(const AssetMemory& memory, const AssetMemory& budget);
+
+    void Touch(EntryMap::iterator entry);
+    void Evict(EntryMap::iterator entry);
+
+private:
+    ResourceRegistry * mpResources;
+    EntryMap mEntries;
+    std::list<AssetKey> mRecentlyUsed;      // Most recently used at the front.
+    AssetMemory mBudget;
+    AssetMemory mMemory;
+    AssetCacheStats mStats;
+    bool mWarnedOverBudget;
+};
+
+#endif
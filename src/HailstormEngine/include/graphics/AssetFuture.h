@@ -0,0 +1,163 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef SCOTT_HAILSTORM_GRAPHICS_ASSET_FUTURE_H
+#define SCOTT_HAILSTORM_GRAPHICS_ASSET_FUTURE_H
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include <wrl\wrappers\corewrappers.h>  // ComPtr.
+#include <wrl\client.h>                 // ComPtr friends.
+
+#include "graphics/ResourceRegistry.h"
+
+class AssetCache;
+class GraphicsContentManager;
+struct ID3D10Effect;
+
+enum class AssetState
+{
+    Pending,    // Still being read, decoded or created.
+    Loaded,     // Ready to use.
+    Failed      // Could not be loaded. The reason has been logged.
+};
+
+/**
+ * What an asynchronous load of a T produces. Only the asset types that GraphicsContentManager knows
+ * how to load are defined.
+ */
+template<typename T>
+struct AssetTraits;
+
+template<>
+struct AssetTraits<StaticMesh>
+{
+    typedef MeshHandle ResultType;
+};
+
+template<>
+struct AssetTraits<ID3D10Effect>
+{
+    typedef Microsoft::WRL::ComPtr<ID3D10Effect> ResultType;
+};
+
+/**
+ * The result of GraphicsContentManager::loadAsync. Copies of a future share the same load, so one can
+ * be kept by a scene and polled each frame while another is handed to the completion callback.
+ *
+ * A future is also a reference to the asset: the asset cache keeps an asset resident for as long as
+ * any future for it is held (see AssetCache). Keep the future rather than just its result.
+ *
+ * A future is only ever completed on the render thread (by GraphicsContentManager::processLoads), and
+ * must only be used from the render thread.
+ */
+template<typename T>
+class AssetFuture
+{
+public:
+    typedef typename AssetTraits<T>::ResultType ResultType;
+    typedef std::function<void(const AssetFuture<T>&)> Callback;
+
+    AssetFuture()
+        : mpState()
+    {
+    }
+
+    // False for a default constructed future that is not attached to a load.
+    bool isValid() const { return mpState != nullptr; }
+
+    AssetState state() const { return mpState ? mpState->state : AssetState::Failed; }
+    bool isReady() const { return state() != AssetState::Pending; }
+    bool succeeded() const { return state() == AssetState::Loaded; }
+
+    // The loaded asset. Only valid once the load has succeeded.
+    const ResultType& get() const
+    {
+        Verify(succeeded());
+        return mpState->result;
+    }
+
+    // Full path of the file being loaded.
+    const std::wstring& path() const
+    {
+        VerifyNotNull(mpState);
+        return mpState->path;
+    }
+
+private:
+    friend class AssetCache;
+    friend class GraphicsContentManager;
+
+    struct SharedState
+    {
+        AssetState state;
+        ResultType result;
+        std::wstring path;
+        std::vector<Callback> callbacks;    // Called once the load finishes.
+    };
+
+    explicit AssetFuture(const std::wstring& path)
+        : mpState(std::make_shared<SharedState>())
+    {
+        mpState->state = AssetState::Pending;
+        mpState->path = path;
+    }
+
+    void complete(ResultType result)
+    {
+        mpState->result = std::move(result);
+        mpState->state = AssetState::Loaded;
+    }
+
+    void fail()
+    {
+        mpState->state = AssetState::Failed;
+    }
+
+    // Call a function once the load finishes, or right away if it already has.
+    void whenReady(const Callback& callback)
+    {
+        if (isReady())
+        {
+            callback(*this);
+        }
+        else
+        {
+            mpState->callbacks.push_back(callback);
+        }
+    }
+
+    // Call the functions waiting for the load to finish.
+    void notify()
+    {
+        std::vector<Callback> callbacks;
+        callbacks.swap(mpState->callbacks);
+
+        for (size_t i = 0; i < callbacks.size(); ++i)
+        {
+            callbacks[i](*this);
+        }
+    }
+
+    // Number of futures sharing this load.
+    long useCount() const { return mpState.use_count(); }
+
+private:
+    std::shared_ptr<SharedState> mpState;
+};
+
+#endif
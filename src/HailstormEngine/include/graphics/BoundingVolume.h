@@ -0,0 +1,71 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef SCOTT_HAILSTORM_GRAPHICS_BOUNDING_VOLUME_H
+#define SCOTT_HAILSTORM_GRAPHICS_BOUNDING_VOLUME_H
+
+#include <d3dx10.h>
+
+/**
+ * Spatial extent of a mesh as both an axis aligned box and a sphere. The sphere is cheaper to test
+ * and survives rotation, while the box is usually the tighter fit, so culling tests try both.
+ *
+ * Empty bounds (a mesh with no vertices) have a negative radius and an inverted box, and never
+ * intersect anything.
+ */
+struct MeshBounds
+{
+    D3DXVECTOR3 minCorner;
+    D3DXVECTOR3 maxCorner;
+    D3DXVECTOR3 center;     // Bounding sphere.
+    float radius;
+
+    bool IsEmpty() const { return radius < 0.0f; }
+};
+
+/**
+ * Anything that knows its spatial extent, so that a culling pass can reject it before any device
+ * calls are made for it. Bounds are in the mesh's own space; use BoundingVolume::Transform to place
+ * them in the world.
+ */
+class BoundedMesh
+{
+public:
+    virtual ~BoundedMesh() { }
+    virtual const MeshBounds& Bounds() const = 0;
+};
+
+namespace BoundingVolume
+{
+    MeshBounds Empty();
+
+    // Bounds of a box, with the sphere that passes through its corners.
+    MeshBounds FromBox(const D3DXVECTOR3& minCorner, const D3DXVECTOR3& maxCorner);
+
+    // Bounds of a set of points. pPositions points at the first position, and positions are stride
+    // bytes apart, so they can be read straight out of an interleaved vertex array. The box is found
+    // with an SSE min/max reduction, and the sphere is centered on the box with a radius reaching
+    // the furthest point, which is never larger than the box's sphere and often much smaller.
+    MeshBounds FromPoints(const void * pPositions, unsigned int count, unsigned int stride);
+
+    // Smallest bounds containing both a and b.
+    MeshBounds Merge(const MeshBounds& a, const MeshBounds& b);
+
+    // Bounds after an affine transform, eg a mesh instance's world matrix. The box is refitted around
+    // the transformed box (so it may grow), and the radius is scaled by the largest axis scale.
+    MeshBounds Transform(const MeshBounds& bounds, const D3DXMATRIX& transform);
+}
+
+#endif
@@ -38,12 +38,16 @@ public:
     void LoadContent(DXRenderer& dx) { OnLoadContent(dx); }
     void UnloadContent(DXRenderer& dx) { OnUnloadContent(dx); }
 
+    // Called once every asset the scene started loading asynchronously has finished loading.
+    void ContentLoaded(DXRenderer& dx) { OnContentLoaded(dx); }
+
 protected:
     virtual void OnInitialize(DXRenderer& dx) = 0;
     virtual void OnUpdate(TimeT currentTime, TimeT deltaTime) = 0;
     virtual void OnRender(DXRenderer& dx, TimeT currentTime, TimeT deltaTime) const = 0;
     virtual void OnLoadContent(DXRenderer& dx) = 0;
     virtual void OnUnloadContent(DXRenderer& dx) = 0;
+    virtual void OnContentLoaded(DXRenderer& dx) { }
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,72 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef SCOTT_HAILSTORM_GRAPHICS_EFFECT_COMPILER_H
+#define SCOTT_HAILSTORM_GRAPHICS_EFFECT_COMPILER_H
+
+#include <list>
+#include <string>
+#include <d3d10.h>
+
+#include "runtime/VirtualFileSystem.h"
+
+/**
+ * Resolves #include directives for an effect that is compiled from memory, by reading the included
+ * files through the virtual file system relative to the directory of the effect being compiled. Each
+ * included file stays open until the compiler closes it.
+ */
+class EffectInclude : public ID3D10Include
+{
+public:
+    EffectInclude(const VirtualFileSystem * pFileSystem, const std::wstring& effectPath);
+    EffectInclude(const EffectInclude&) = delete;
+    ~EffectInclude();
+
+    EffectInclude& operator =(const EffectInclude&) = delete;
+
+    STDMETHOD(Open)(
+        D3D10_INCLUDE_TYPE includeType,
+        LPCSTR pFileName,
+        LPCVOID pParentData,
+        LPCVOID * ppData,
+        UINT * pBytes) override;
+
+    STDMETHOD(Close)(LPCVOID pData) override;
+
+private:
+    const VirtualFileSystem * mpFileSystem;
+    std::string mDirectory;
+    std::list<VirtualFile> mOpenFiles;
+};
+
+/**
+ * Compiles .fx files read through the virtual file system.
+ */
+namespace EffectCompiler
+{
+    // Compiler flags every effect is compiled with.
+    DWORD DefaultFlags();
+
+    // Compile an effect to an fx_4_0 blob. Compiler errors, if any, are returned in ppErrorsOut.
+    // Returns D3D10_ERROR_FILE_NOT_FOUND (with no errors) if the file does not exist.
+    HRESULT CompileFile(
+        const VirtualFileSystem& fileSystem,
+        const std::wstring& path,
+        DWORD shaderFlags,
+        ID3D10Blob ** ppCompiledOut,
+        ID3D10Blob ** ppErrorsOut);
+}
+
+#endif
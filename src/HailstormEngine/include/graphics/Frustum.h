@@ -0,0 +1,97 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef SCOTT_HAILSTORM_GRAPHICS_FRUSTUM_H
+#define SCOTT_HAILSTORM_GRAPHICS_FRUSTUM_H
+
+#include <vector>
+#include <d3dx10.h>
+
+#include "graphics/BoundingVolume.h"
+
+/**
+ * A list of axis aligned bounding boxes stored as separate arrays for each min and max component, so
+ * that four boxes can be loaded into SSE registers at once.
+ */
+class BoundingBoxSet
+{
+public:
+    BoundingBoxSet();
+
+    // Resize the set. New boxes are empty (all zero).
+    void Resize(unsigned int count);
+
+    void Set(unsigned int index, const D3DXVECTOR3& minCorner, const D3DXVECTOR3& maxCorner);
+
+    unsigned int Count() const { return mCount; }
+    D3DXVECTOR3 Min(unsigned int index) const;
+    D3DXVECTOR3 Max(unsigned int index) const;
+
+    // Box around every box in the set. Returns false, leaving the corners alone, if the set is empty.
+    bool Extent(D3DXVECTOR3 * pMinCornerOut, D3DXVECTOR3 * pMaxCornerOut) const;
+
+    // Component arrays. Each array is padded with empty boxes up to a multiple of four entries.
+    const float * MinX() const { return &mMinX[0]; }
+    const float * MinY() const { return &mMinY[0]; }
+    const float * MinZ() const { return &mMinZ[0]; }
+    const float * MaxX() const { return &mMaxX[0]; }
+    const float * MaxY() const { return &mMaxY[0]; }
+    const float * MaxZ() const { return &mMaxZ[0]; }
+
+private:
+    unsigned int mCount;
+    std::vector<float> mMinX, mMinY, mMinZ;
+    std::vector<float> mMaxX, mMaxY, mMaxZ;
+};
+
+/**
+ * The six planes of a view frustum, pointing inwards.
+ */
+class Frustum
+{
+public:
+    enum
+    {
+        PlaneCount = 6
+    };
+
+    Frustum();
+    explicit Frustum(const D3DXMATRIX& viewProjection);
+
+    // Extract the frustum planes from a combined (world) view projection matrix.
+    void Set(const D3DXMATRIX& viewProjection);
+
+    const D3DXPLANE& Plane(unsigned int index) const { return mPlanes[index]; }
+
+    // Check if a box is at least partially inside the frustum. Boxes that are near the frustum but
+    // outside of it can be reported as visible, but visible boxes are never reported as hidden.
+    bool IntersectsBox(const D3DXVECTOR3& minCorner, const D3DXVECTOR3& maxCorner) const;
+
+    // Check if a sphere is at least partially inside the frustum, with the same guarantees.
+    bool IntersectsSphere(const D3DXVECTOR3& center, float radius) const;
+
+    // Check a mesh's bounds, rejecting it if either its sphere or its box is outside. Empty bounds are
+    // never visible.
+    bool Intersects(const MeshBounds& bounds) const;
+
+    // Test a whole set of boxes, four at a time. pVisibleOut[i] is set to 1 if box i intersects the
+    // frustum and 0 otherwise. Returns the number of visible boxes.
+    unsigned int CullBoxes(const BoundingBoxSet& boxes, unsigned char * pVisibleOut) const;
+
+private:
+    D3DXPLANE mPlanes[PlaneCount];
+};
+
+#endif
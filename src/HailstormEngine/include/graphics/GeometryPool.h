@@ -0,0 +1,162 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef SCOTT_HAILSTORM_GRAPHICS_GEOMETRY_POOL_H
+#define SCOTT_HAILSTORM_GRAPHICS_GEOMETRY_POOL_H
+
+#include <vector>
+#include <wrl\wrappers\corewrappers.h>  // ComPtr.
+#include <wrl\client.h>                 // ComPtr friends.
+
+#include "graphics/IndexRange.h"
+#include "runtime/OffsetAllocator.h"
+
+struct ID3D10Buffer;
+struct ID3D10Device;
+
+/**
+ * Where a mesh's vertices and indices live in a geometry pool. Indices are relative to the mesh's
+ * first vertex, so they are drawn with baseVertex added by the input assembler.
+ */
+struct GeometryRange
+{
+    unsigned int baseVertex;
+    unsigned int vertexCount;
+    unsigned int firstIndex;
+    unsigned int indexCount;
+};
+
+/**
+ * Counts of the input assembler calls made drawing from a geometry pool.
+ */
+struct GeometryPoolStats
+{
+    unsigned int drawCount;
+    unsigned int bindCount;             // Vertex and index buffer binds actually made.
+    unsigned int unpooledBindCount;     // Binds the same draws would take with a buffer pair per mesh.
+
+    unsigned int BindsSaved() const { return unpooledBindCount - bindCount; }
+};
+
+/**
+ * Suballocates many meshes with the same vertex format out of one large vertex buffer and one large
+ * index buffer, so that drawing one pooled mesh after another does not rebind any buffers.
+ *
+ * Space in each buffer is handed out by an OffsetAllocator. When an upload does not fit because the
+ * free space is fragmented, the pool is defragmented: the allocators pack every mesh towards the start
+ * of their buffers and the live ranges are copied into fresh buffers on the GPU. Meshes are referred to
+ * by handle and their ranges are looked up when drawn, so they can be moved freely.
+ *
+ * The pool remembers that its buffers are bound after the first draw, and skips binding them again.
+ * Anything that binds other vertex or index buffers in between must call InvalidateBinding, since the
+ * pool has no way to see it.
+ */
+class GeometryPool
+{
+public:
+    typedef unsigned int Handle;
+    static const Handle INVALID_HANDLE = 0xFFFFFFFF;
+
+    GeometryPool(ID3D10Device * pDevice, unsigned int vertexStride, unsigned int vertexCapacity, unsigned int indexCapacity);
+    GeometryPool(const GeometryPool&) = delete;
+    ~GeometryPool();
+
+    GeometryPool& operator =(const GeometryPool&) = delete;
+
+    // Copy a mesh into the pool. pVertices holds vertexCount vertices of the pool's stride. Returns
+    // INVALID_HANDLE if the pool is too full to hold the mesh even after defragmenting.
+    Handle Upload(
+        ID3D10Device * pDevice,
+        const void * pVertices,
+        unsigned int vertexCount,
+        const unsigned int * pIndices,
+        unsigned int indexCount);
+
+    // Release a mesh's space in the pool.
+    void Free(Handle handle);
+
+    const GeometryRange& Range(Handle handle) const;
+
+    // Bind the pool's vertex buffer to slot zero and its index buffer, unless they are already bound.
+    void Bind(ID3D10Device * pDevice);
+
+    // Forget that the pool's buffers are bound, so the next draw binds them again.
+    void InvalidateBinding() { mBound = false; }
+
+    // Draw a mesh, binding the pool's buffers first if needed.
+    void Draw(ID3D10Device * pDevice, Handle handle);
+
+    // Draw part of a mesh's indices, eg one level of detail. The range is relative to the mesh's own
+    // first index.
+    void Draw(ID3D10Device * pDevice, Handle handle, const IndexRange& indices);
+
+    // Draw instances of a mesh (or part of its indices) with per instance data from pInstanceBuffer
+    // in slot one.
+    void DrawInstanced(
+        ID3D10Device * pDevice,
+        Handle handle,
+        ID3D10Buffer * pInstanceBuffer,
+        unsigned int instanceStride,
+        unsigned int instanceCount,
+        unsigned int firstInstance);
+    void DrawInstanced(
+        ID3D10Device * pDevice,
+        Handle handle,
+        const IndexRange& indices,
+        ID3D10Buffer * pInstanceBuffer,
+        unsigned int instanceStride,
+        unsigned int instanceCount,
+        unsigned int firstInstance);
+
+    // Pack every mesh towards the start of the buffers, so all free space is in one range.
+    void Defragment(ID3D10Device * pDevice);
+
+    unsigned int VertexStride() const { return mVertexStride; }
+    unsigned int MeshCount() const { return mVertexAllocator.AllocationCount(); }
+    const OffsetAllocator& VertexAllocator() const { return mVertexAllocator; }
+    const OffsetAllocator& IndexAllocator() const { return mIndexAllocator; }
+
+    // Counts since the last ResetStats, eg once a frame.
+    const GeometryPoolStats& Stats() const { return mStats; }
+    void ResetStats();
+
+private:
+    struct Entry
+    {
+        GeometryRange range;
+        OffsetAllocator::NodeIndex vertexNode;
+        OffsetAllocator::NodeIndex indexNode;   // NO_NODE once the entry is freed.
+    };
+
+    void CreateBuffers(
+        ID3D10Device * pDevice,
+        ID3D10Buffer ** ppVertexBufferOut,
+        ID3D10Buffer ** ppIndexBufferOut) const;
+
+    bool TryAllocate(unsigned int vertexCount, unsigned int indexCount, Entry * pEntryOut);
+
+private:
+    unsigned int mVertexStride;
+    OffsetAllocator mVertexAllocator;   // In vertices.
+    OffsetAllocator mIndexAllocator;    // In indices.
+    Microsoft::WRL::ComPtr<ID3D10Buffer> mVertexBuffer;
+    Microsoft::WRL::ComPtr<ID3D10Buffer> mIndexBuffer;
+    std::vector<Entry> mEntries;
+    std::vector<Handle> mFreeHandles;
+    bool mBound;
+    GeometryPoolStats mStats;
+};
+
+#endif
@@ -0,0 +1,135 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef SCOTT_HAILSTORM_GRAPHICS_INSTANCE_BATCHER_H
+#define SCOTT_HAILSTORM_GRAPHICS_INSTANCE_BATCHER_H
+
+#include <vector>
+#include <d3dx10.h>
+#include <wrl\wrappers\corewrappers.h>  // ComPtr.
+#include <wrl\client.h>                 // ComPtr friends.
+
+#include "graphics/staticmeshvertex.h"
+
+class StaticMesh;
+struct ID3D10Buffer;
+struct ID3D10Device;
+struct ID3D10EffectTechnique;
+struct ID3D10InputLayout;
+
+/**
+ * How a batch of instanced static meshes is drawn: an effect technique whose vertex shader reads
+ * StaticMeshInstance data, and an input layout made for it with InstanceBatcher::CreateInputLayout.
+ */
+struct InstanceMaterial
+{
+    ID3D10EffectTechnique * pTechnique;
+    ID3D10InputLayout * pInputLayout;
+};
+
+/**
+ * Counts of the work done by an instance batcher.
+ */
+struct InstanceBatchStats
+{
+    unsigned int instanceCount;         // Instances submitted with Add.
+    unsigned int batchCount;            // Distinct mesh, level of detail and material combinations among them.
+    unsigned int drawCount;             // Instanced draw calls issued.
+    unsigned int unbatchedDrawCount;    // Draw calls it would take to draw every instance on its own.
+    unsigned int bufferMapCount;        // Times the instance buffer was mapped to be filled.
+
+    unsigned int DrawsSaved() const { return unbatchedDrawCount - drawCount; }
+};
+
+/**
+ * Collects instances of static meshes during a frame and draws every instance of the same mesh, level
+ * of detail and material with a single DrawIndexedInstanced call.
+ *
+ * Instances are grouped when the batcher is flushed, so they can be added in any order. Instance data
+ * is streamed through one dynamic vertex buffer that is filled front to back with no-overwrite maps
+ * and only discarded when it wraps, so the driver never has to wait for the GPU or hand out a new
+ * copy of the buffer in the middle of a frame. A batch with more instances than the buffer holds is
+ * split over several draws.
+ *
+ * The caller sets up the material's effect variables (eg the view projection matrix) and primitive
+ * topology before flushing.
+ */
+class InstanceBatcher
+{
+public:
+    static const unsigned int DEFAULT_CAPACITY = 4096;
+
+    explicit InstanceBatcher(ID3D10Device * pDevice, unsigned int capacity = DEFAULT_CAPACITY);
+    InstanceBatcher(const InstanceBatcher&) = delete;
+    ~InstanceBatcher();
+
+    InstanceBatcher& operator =(const InstanceBatcher&) = delete;
+
+    // Queue one instance of a mesh, drawn at a level of detail (see StaticMesh::selectLod). The mesh
+    // must stay alive until the batcher is flushed.
+    void Add(
+        const StaticMesh * pMesh,
+        const InstanceMaterial& material,
+        const D3DXMATRIX& world,
+        const D3DXCOLOR& color,
+        unsigned int lod = 0);
+
+    // Draw every queued instance and empty the queue.
+    void Flush(ID3D10Device * pDevice);
+
+    // Empty the queue without drawing anything.
+    void Clear();
+
+    unsigned int PendingCount() const { return static_cast<unsigned int>(mInstances.size()); }
+    unsigned int Capacity() const { return mCapacity; }
+
+    // Counts from the most recent flush, and totals across every flush since the last ResetStats.
+    const InstanceBatchStats& LastFlushStats() const { return mLastFlushStats; }
+    const InstanceBatchStats& TotalStats() const { return mTotalStats; }
+    void ResetStats();
+
+    // Create an input layout for instanced static meshes: StaticMeshVertex data in slot zero and
+    // StaticMeshInstance data in slot one, as WORLD0-3 and INSTANCECOLOR.
+    static void CreateInputLayout(
+        ID3D10Device * pDevice,
+        ID3D10EffectTechnique * pTechnique,
+        ID3D10InputLayout ** ppInputLayoutOut);
+
+private:
+    struct Entry
+    {
+        unsigned int material;      // Index into mMaterials.
+        const StaticMesh * pMesh;
+        unsigned int lod;
+        unsigned int instance;      // Index into mInstances, which keeps instances in submission order.
+
+        bool operator <(const Entry& other) const;
+    };
+
+    unsigned int FindMaterial(const InstanceMaterial& material);
+    unsigned int WriteInstances(const Entry * pEntries, unsigned int count, InstanceBatchStats * pStats);
+
+private:
+    unsigned int mCapacity;
+    unsigned int mWriteOffset;      // First free instance in the buffer.
+    Microsoft::WRL::ComPtr<ID3D10Buffer> mInstanceBuffer;
+    std::vector<InstanceMaterial> mMaterials;
+    std::vector<Entry> mEntries;
+    std::vector<StaticMeshInstance> mInstances;
+    InstanceBatchStats mLastFlushStats;
+    InstanceBatchStats mTotalStats;
+};
+
+#endif
@@ -0,0 +1,202 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef SCOTT_HAILSTORM_GRAPHICS_MESH_FILE_H
+#define SCOTT_HAILSTORM_GRAPHICS_MESH_FILE_H
+
+#include <string>
+#include <vector>
+
+#include "runtime/ByteSpan.h"
+#include "runtime/MappedFile.h"
+
+struct StaticMeshVertex;
+
+/**
+ * What a vertex element holds.
+ */
+enum class MeshFileSemantic : unsigned int
+{
+    Position,
+    Normal,
+    Texcoord,
+    Color
+};
+
+/**
+ * How a vertex element is stored.
+ */
+enum class MeshFileFormat : unsigned int
+{
+    Float2,
+    Float3,
+    Float4
+};
+
+/**
+ * One element of the vertex layout, matching a D3D10_INPUT_ELEMENT_DESC.
+ */
+struct MeshFileVertexElement
+{
+    MeshFileSemantic semantic;
+    unsigned int semanticIndex;
+    MeshFileFormat format;
+    unsigned int offset;            // Byte offset within the vertex.
+};
+
+/**
+ * A level of detail, as a range of the index buffer. Level zero is the full detail mesh, and each
+ * level after it should be used once the mesh covers less than screenSize of the screen's height.
+ */
+struct MeshFileLod
+{
+    unsigned int firstIndex;
+    unsigned int indexCount;
+    float screenSize;
+    unsigned int reserved;
+};
+
+/**
+ * Header at the start of a mesh file. All offsets are from the start of the file and are aligned to
+ * 16 bytes so every table and stream can be used in place once the file is mapped into memory.
+ */
+struct MeshFileHeader
+{
+    unsigned int magic;
+    unsigned int version;
+    unsigned int headerSize;
+
+    unsigned int vertexStride;
+    unsigned int vertexCount;
+    unsigned int indexCount;        // 32 bit triangle list indices.
+    unsigned int elementCount;
+    unsigned int lodCount;
+
+    // Bounds of every vertex position, in model space.
+    float boundsMin[3];
+    float boundsMax[3];
+    float sphereCenter[3];
+    float sphereRadius;
+
+    unsigned long long fileSize;
+    unsigned long long elementsOffset;      // elementCount MeshFileVertexElements.
+    unsigned long long lodsOffset;          // lodCount MeshFileLods.
+    unsigned long long verticesOffset;      // vertexCount * vertexStride bytes.
+    unsigned long long indicesOffset;       // indexCount 32 bit indices.
+};
+
+/**
+ * A mesh stored so that it can be loaded with no parsing or copying: open the file, check the header
+ * and hand the vertex and index streams straight to the graphics device.
+ *
+ * Opening maps the whole file into memory and validates the header and table sizes, after which the
+ * accessors point directly into the mapped file. A mesh can also be opened from bytes that are already
+ * in memory, eg an entry in a mapped AssetArchive. The header is written last, so a partially written
+ * file is never opened.
+ */
+class MeshFile
+{
+public:
+    MeshFile();
+    MeshFile(const MeshFile&) = delete;
+    ~MeshFile();
+
+    MeshFile& operator =(const MeshFile&) = delete;
+
+    // Map a mesh file. Returns false (and logs why) if it is missing, corrupt or an unsupported version.
+    bool Open(const std::wstring& path);
+
+    // Same as Open, but rather than logging why the file could not be opened the reason is returned in
+    // pReasonOut, so it can be called from threads other than the one that logs.
+    bool Open(const std::wstring& path, const char ** ppReasonOut);
+
+    // Open a mesh file that is already in memory. The bytes are used in place, so they must be aligned
+    // to 16 bytes and must outlive the MeshFile (or its next Close).
+    bool Open(const ByteSpan& data, const char ** ppReasonOut);
+
+    // Unmap the mesh file. Every pointer returned by the accessors is invalid after this is called.
+    void Close();
+
+    bool IsOpen() const { return mpHeader != nullptr; }
+
+    // Read the whole file in from disk now rather than as the streams are used (see MappedFile).
+    void Prefetch() const { MappedFile::Prefetch(mData.pData, mData.size); }
+
+    const MeshFileHeader& Header() const;
+    const MeshFileVertexElement * Elements() const;
+    const MeshFileLod * Lods() const;
+    const void * Vertices() const;
+    const unsigned int * Indices() const;
+
+    // Check if the vertices are laid out exactly as StaticMeshVertex, so they can be used as is.
+    bool HasStaticMeshLayout() const;
+
+    // Build a mesh file in memory, exactly as Write would write it, eg to store it in an archive.
+    static void Serialize(
+        const void * pVertices,
+        unsigned int vertexStride,
+        unsigned int vertexCount,
+        const MeshFileVertexElement * pElements,
+        unsigned int elementCount,
+        const unsigned int * pIndices,
+        unsigned int indexCount,
+        const MeshFileLod * pLods,
+        unsigned int lodCount,
+        std::vector<unsigned char> * pFileOut);
+
+    static void Serialize(
+        const StaticMeshVertex * pVertices,
+        unsigned int vertexCount,
+        const unsigned int * pIndices,
+        unsigned int indexCount,
+        const MeshFileLod * pLods,
+        unsigned int lodCount,
+        std::vector<unsigned char> * pFileOut);
+
+    // Write a mesh file with any vertex layout. One of the elements must be a Float3 position, which
+    // is used to compute the bounds. If no levels of detail are given a single level covering every
+    // index is written. Returns false (and logs why) if the file could not be written.
+    static bool Write(
+        const std::wstring& path,
+        const void * pVertices,
+        unsigned int vertexStride,
+        unsigned int vertexCount,
+        const MeshFileVertexElement * pElements,
+        unsigned int elementCount,
+        const unsigned int * pIndices,
+        unsigned int indexCount,
+        const MeshFileLod * pLods = nullptr,
+        unsigned int lodCount = 0);
+
+    // Write a mesh file of StaticMeshVertex vertices.
+    static bool Write(
+        const std::wstring& path,
+        const StaticMeshVertex * pVertices,
+        unsigned int vertexCount,
+        const unsigned int * pIndices,
+        unsigned int indexCount,
+        const MeshFileLod * pLods = nullptr,
+        unsigned int lodCount = 0);
+
+private:
+    bool Attach(const ByteSpan& data, const char ** ppReasonOut);
+
+private:
+    MappedFile mFile;
+    ByteSpan mData;
+    const MeshFileHeader * mpHeader;
+};
+
+#endif
@@ -0,0 +1,95 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef SCOTT_HAILSTORM_GRAPHICS_MESH_IMPORTER_H
+#define SCOTT_HAILSTORM_GRAPHICS_MESH_IMPORTER_H
+
+#include <string>
+#include <vector>
+
+struct StaticMeshVertex;
+
+/**
+ * Settings for importing a mesh.
+ */
+struct MeshImportParams
+{
+    MeshImportParams();
+
+    unsigned int threadCount;       // Zero for one thread per core.
+    unsigned int chunkBytes;        // Text is split into chunks of about this many bytes per task.
+    bool weldVertices;              // Merge vertices whose attributes are bit for bit identical.
+};
+
+/**
+ * Timings and counts from an import.
+ */
+struct MeshImportStats
+{
+    double seconds;
+    unsigned long long fileBytes;
+    unsigned int threadCount;
+    unsigned int chunkCount;            // Number of parallel parsing tasks.
+    unsigned int sourceVertexCount;     // Vertices before welding (OBJ face corners, PLY vertices).
+    unsigned int vertexCount;           // Vertices after welding.
+    unsigned int triangleCount;
+    bool generatedNormals;
+
+    double MegabytesPerSecond() const;
+};
+
+/**
+ * Reads meshes from interchange formats into StaticMeshVertex triangle lists. These are meant for
+ * offline conversion to mesh files (see MeshFile) rather than for loading at run time.
+ *
+ * Files are mapped into memory rather than read through streams, and text is split into chunks at
+ * line boundaries that are parsed in parallel with a hand written number parser. Faces are split into
+ * triangle fans. Vertices are welded with an open addressing hash table, and vertices without a normal
+ * get a smooth area weighted normal generated from the faces around their position.
+ *
+ * Each function returns false (and logs why) if the file could not be read or is malformed.
+ */
+namespace MeshImporter
+{
+    // Read a Wavefront OBJ file. Every unique combination of position, texture coordinate and normal
+    // indices becomes one vertex. Materials, groups and everything other than faces and vertex data
+    // are ignored.
+    bool LoadObj(
+        const std::wstring& path,
+        std::vector<StaticMeshVertex> * pVerticesOut,
+        std::vector<unsigned int> * pIndicesOut,
+        const MeshImportParams& params = MeshImportParams(),
+        MeshImportStats * pStatsOut = nullptr);
+
+    // Read an ASCII or binary (either byte order) Stanford PLY file. Vertex positions, normals,
+    // texture coordinates (u/v, s/t or texture_u/texture_v) and colors are read from the "vertex"
+    // element and polygons from the "face" element. Other elements are skipped.
+    bool LoadPly(
+        const std::wstring& path,
+        std::vector<StaticMeshVertex> * pVerticesOut,
+        std::vector<unsigned int> * pIndicesOut,
+        const MeshImportParams& params = MeshImportParams(),
+        MeshImportStats * pStatsOut = nullptr);
+
+    // Read an OBJ or PLY file, chosen by the file extension.
+    bool Load(
+        const std::wstring& path,
+        std::vector<StaticMeshVertex> * pVerticesOut,
+        std::vector<unsigned int> * pIndicesOut,
+        const MeshImportParams& params = MeshImportParams(),
+        MeshImportStats * pStatsOut = nullptr);
+}
+
+#endif
@@ -0,0 +1,58 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef SCOTT_HAILSTORM_GRAPHICS_MESH_LOD_H
+#define SCOTT_HAILSTORM_GRAPHICS_MESH_LOD_H
+
+#include <d3dx10.h>
+
+/**
+ * A level of detail of a mesh, as a range of its index buffer. Every level indexes the same vertices,
+ * so switching levels only changes which indices are drawn.
+ */
+struct MeshLod
+{
+    unsigned int firstIndex;
+    unsigned int indexCount;
+    float screenSize;       // Use this level once the mesh covers less than this fraction of the screen height.
+    float error;            // Simplification error, relative to the size of the mesh.
+};
+
+/**
+ * Fraction of the screen height covered by a bounding sphere, seen through a perspective projection
+ * from distance units away. Close enough for picking levels of detail, though not exact off axis.
+ */
+inline float ProjectedScreenSize(float radius, float distance, const D3DXMATRIX& projection)
+{
+    return (distance > radius) ? radius * projection._22 / distance : 1.0f;
+}
+
+/**
+ * Pick the coarsest level of detail that may be used at a screen size (see ProjectedScreenSize).
+ * Levels must be ordered from the most to the least detailed.
+ */
+inline unsigned int SelectLod(const MeshLod * pLods, unsigned int lodCount, float screenSize)
+{
+    unsigned int lod = 0;
+
+    while (lod + 1 < lodCount && screenSize < pLods[lod + 1].screenSize)
+    {
+        ++lod;
+    }
+
+    return lod;
+}
+
+#endif
@@ -0,0 +1,93 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef SCOTT_HAILSTORM_GRAPHICS_MESH_OPTIMIZER_H
+#define SCOTT_HAILSTORM_GRAPHICS_MESH_OPTIMIZER_H
+
+#include <vector>
+
+#include "graphics/IndexRange.h"
+
+/**
+ * Reorders triangle lists so that they make better use of the GPU's post transform vertex cache and
+ * vertex fetch, and measures how well a triangle list uses the cache.
+ *
+ * All indices are 32 bit triangle lists. None of these functions touch the graphics device.
+ */
+namespace MeshOptimizer
+{
+    /**
+     * Replacement policy for the simulated post transform vertex cache.
+     */
+    enum class CacheModel
+    {
+        Fifo,           // First in first out, which is how most hardware behaves.
+        Lru             // Least recently used.
+    };
+
+    /**
+     * Results of running a triangle list through a simulated vertex cache.
+     */
+    struct VertexCacheStats
+    {
+        unsigned int triangleCount;
+        unsigned int vertexCount;       // Number of unique vertices referenced.
+        unsigned int transformCount;    // Number of cache misses, ie vertex shader invocations.
+        float acmr;                     // Average cache miss ratio, transforms per triangle (0.5 - 3).
+        float atvr;                     // Average transform to vertex ratio (1 is ideal).
+    };
+
+    // Simulate a vertex cache of cacheSize entries and count how many vertices are transformed.
+    VertexCacheStats AnalyzeVertexCache(
+        const unsigned int * pIndices,
+        unsigned int indexCount,
+        unsigned int vertexCount,
+        unsigned int cacheSize = 16,
+        CacheModel model = CacheModel::Fifo);
+
+    // Reorder triangles for the vertex cache, using Tom Forsyth's linear speed vertex cache
+    // optimization. Vertex indices are unchanged; only the order of the triangles is.
+    void OptimizeVertexCache(unsigned int * pIndices, unsigned int indexCount, unsigned int vertexCount);
+
+    // Same as above, except that each range is optimized on its own and triangles never move from one
+    // range to another. Use this when ranges are drawn separately, eg culled patches.
+    void OptimizeVertexCache(
+        unsigned int * pIndices,
+        unsigned int vertexCount,
+        const std::vector<IndexRange>& ranges);
+
+    // Build a vertex order that matches the order the vertices are first used by the index buffer, and
+    // rewrite the indices to match. pNewToOldOut[i] is the original index of vertex i. Unused vertices
+    // are moved to the end.
+    void OptimizeVertexFetchRemap(
+        unsigned int * pIndices,
+        unsigned int indexCount,
+        unsigned int vertexCount,
+        std::vector<unsigned int> * pNewToOldOut);
+
+    // Reorder vertices to match the order they are first used by the index buffer, and rewrite the
+    // indices to match.
+    void OptimizeVertexFetch(
+        void * pVertices,
+        unsigned int vertexCount,
+        unsigned int vertexStride,
+        unsigned int * pIndices,
+        unsigned int indexCount);
+
+    // Write the cache statistics of a mesh before and after optimization to the log.
+    void LogOptimization(const char * pMeshName, const VertexCacheStats& before, const VertexCacheStats& after);
+}
+
+#endif
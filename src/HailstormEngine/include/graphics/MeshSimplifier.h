@@ -0,0 +1,115 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef SCOTT_HAILSTORM_GRAPHICS_MESH_SIMPLIFIER_H
+#define SCOTT_HAILSTORM_GRAPHICS_MESH_SIMPLIFIER_H
+
+#include <vector>
+
+#include "graphics/MeshLod.h"
+
+struct StaticMeshVertex;
+
+/**
+ * Reduces the triangle count of meshes with quadric error metric edge collapses, and builds chains of
+ * levels of detail from the simplified triangle lists.
+ *
+ * Collapses only ever move a vertex onto one of its neighbors, so simplified triangles still index the
+ * original vertices and a whole level of detail chain is one vertex buffer and a longer index buffer.
+ * The cost of a collapse combines the area weighted squared distance to the planes of every triangle
+ * merged into a vertex with the error of its normal, texture coordinates and color (Hoppe's memory
+ * efficient attribute quadrics), so detail is kept where shading would visibly change. Collapses are
+ * made cheapest first from a priority queue, and any that would flip a triangle or pinch the surface
+ * into a non manifold shape are skipped.
+ *
+ * Vertices split in two along a texture or normal seam only slide along the seam, both halves at once.
+ * Vertices on an open border only slide along the border, or not at all if borders are locked. Every
+ * other vertex whose neighborhood is not a simple disk never moves.
+ *
+ * All indices are 32 bit triangle lists. None of these functions touch the graphics device.
+ */
+namespace MeshSimplifier
+{
+    /**
+     * Controls how meshes are simplified. Errors are relative to the largest dimension of the mesh's
+     * bounding box, and attribute weights scale attribute error against that.
+     */
+    struct SimplifyParams
+    {
+        SimplifyParams();
+
+        float normalWeight;
+        float texcoordWeight;
+        float colorWeight;
+        float maxError;         // No collapse with more error than this is made, even if short of the target.
+        bool lockBorder;        // Keep open borders exactly as they are, eg where the mesh meets another.
+    };
+
+    /**
+     * Results of simplifying a mesh.
+     */
+    struct SimplifyStats
+    {
+        double seconds;
+        unsigned int sourceTriangleCount;
+        unsigned int triangleCount;         // Triangles left in the last (or only) simplified mesh.
+        unsigned int collapseCount;
+        unsigned int lockedVertexCount;     // Vertices that could never move.
+        float error;                        // Largest error of any collapse made.
+    };
+
+    /**
+     * Controls how level of detail chains are built.
+     */
+    struct LodChainParams
+    {
+        LodChainParams();
+
+        std::vector<float> triangleRatios;  // Fraction of the source triangles kept by each level after the first.
+        float pixelError;                   // Error, in pixels, that a level may show before it is replaced.
+        float screenHeight;                 // Screen height pixelError is measured at.
+        SimplifyParams simplify;
+    };
+
+    // Simplify a mesh to at most targetIndexCount indices, or as close as possible without exceeding
+    // params.maxError. Returns the number of indices written to pIndicesOut.
+    unsigned int Simplify(
+        const StaticMeshVertex * pVertices,
+        unsigned int vertexCount,
+        const unsigned int * pIndices,
+        unsigned int indexCount,
+        unsigned int targetIndexCount,
+        const SimplifyParams& params,
+        std::vector<unsigned int> * pIndicesOut,
+        SimplifyStats * pStatsOut = nullptr);
+
+    // Build a level of detail chain. pIndices holds the full detail triangle list, and each simplified
+    // level is appended to it and optimized for the vertex cache. Every level is made in a single pass,
+    // one level continuing from where the last left off. Levels that could not remove any triangles
+    // (eg because of maxError) are left out, so there may be fewer levels than ratios. Each level's
+    // screen size is the size at which its error would show as params.pixelError pixels.
+    void GenerateLodChain(
+        const StaticMeshVertex * pVertices,
+        unsigned int vertexCount,
+        std::vector<unsigned int> * pIndices,
+        const LodChainParams& params,
+        std::vector<MeshLod> * pLodsOut,
+        SimplifyStats * pStatsOut = nullptr);
+
+    // Write the triangle count, error and screen size of each level to the log.
+    void LogLodChain(const char * pMeshName, const std::vector<MeshLod>& lods, const SimplifyStats& stats);
+}
+
+#endif
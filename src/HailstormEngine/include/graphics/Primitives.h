@@ -0,0 +1,92 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef SCOTT_HAILSTORM_GRAPHICS_PRIMITIVES_H
+#define SCOTT_HAILSTORM_GRAPHICS_PRIMITIVES_H
+
+#include <vector>
+#include <d3dx10.h>
+
+#include "graphics/staticmeshvertex.h"
+
+/**
+ * Vertices and indices of a generated primitive. Clearing keeps the memory that was allocated, so a
+ * single PrimitiveMesh can be reused as scratch space to generate any number of primitives without
+ * allocating once it has grown to fit the largest one.
+ */
+struct PrimitiveMesh
+{
+    void Clear();
+
+    // Add a vertex and return its index. Vertices are white.
+    unsigned int AddVertex(const D3DXVECTOR3& position, const D3DXVECTOR3& normal, float u, float v);
+    void AddTriangle(unsigned int a, unsigned int b, unsigned int c);
+
+    unsigned int VertexCount() const { return static_cast<unsigned int>(vertices.size()); }
+
+    std::vector<StaticMeshVertex> vertices;
+    std::vector<unsigned int> indices;
+};
+
+/**
+ * Generators for simple shapes with normals and texture coordinates, centered on the origin with y
+ * up. Triangles are wound clockwise when seen from outside, matching Direct3D's default culling.
+ *
+ * Every generator clears pMeshOut before writing to it. Curved surfaces are divided into slices around
+ * the y axis and stacks (or rings) along it; texture coordinates wrap once around the slices, so the
+ * first column of vertices is duplicated to give the seam its own u = 1 copy.
+ */
+namespace Primitives
+{
+    // Box with its half extents along each axis. Each face has its own four vertices and a full 0-1
+    // texture.
+    void GenerateBox(const D3DXVECTOR3& halfExtents, PrimitiveMesh * pMeshOut);
+
+    // Latitude / longitude sphere.
+    void GenerateUvSphere(float radius, unsigned int slices, unsigned int stacks, PrimitiveMesh * pMeshOut);
+
+    // Sphere made by repeatedly splitting the faces of an icosahedron into four, which spreads
+    // triangles evenly instead of bunching them at the poles. Texture coordinates are spherical, and
+    // triangles crossing the u seam are not split, so it suits untextured or tiling materials.
+    void GenerateIcoSphere(float radius, unsigned int subdivisions, PrimitiveMesh * pMeshOut);
+
+    // Capped cylinder height units tall.
+    void GenerateCylinder(float radius, float height, unsigned int slices, PrimitiveMesh * pMeshOut);
+
+    // Capped cone height units tall with its point up.
+    void GenerateCone(float radius, float height, unsigned int slices, PrimitiveMesh * pMeshOut);
+
+    // Torus lying in the xz plane. rings divides the ring around the y axis and sides the tube.
+    void GenerateTorus(
+        float majorRadius,
+        float minorRadius,
+        unsigned int rings,
+        unsigned int sides,
+        PrimitiveMesh * pMeshOut);
+
+    // Flat grid in the xz plane facing up, with cols x rows quads.
+    void GeneratePlane(float width, float depth, unsigned int cols, unsigned int rows, PrimitiveMesh * pMeshOut);
+
+    // Cylinder with hemispherical ends. height is the length of the straight middle section, and each
+    // hemisphere is divided into stacks rings.
+    void GenerateCapsule(
+        float radius,
+        float height,
+        unsigned int slices,
+        unsigned int stacks,
+        PrimitiveMesh * pMeshOut);
+}
+
+#endif
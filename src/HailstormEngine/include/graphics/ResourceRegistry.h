@@ -0,0 +1,107 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef SCOTT_HAILSTORM_GRAPHICS_RESOURCE_REGISTRY_H
+#define SCOTT_HAILSTORM_GRAPHICS_RESOURCE_REGISTRY_H
+
+#include <vector>
+#include <wrl\wrappers\corewrappers.h>  // ComPtr.
+#include <wrl\client.h>                 // ComPtr friends.
+
+#include "graphics/staticmesh.h"
+#include "runtime/DensePool.h"
+
+struct IUnknown;
+
+typedef Handle<StaticMesh> MeshHandle;
+
+/**
+ * Counts of the resources a registry holds.
+ */
+struct ResourceRegistryStats
+{
+    unsigned int meshCount;             // Live meshes.
+    unsigned int retiredMeshCount;      // Released meshes waiting for the GPU to finish with them.
+    unsigned int retiredObjectCount;    // Released device objects waiting for the same.
+    unsigned int destroyedCount;        // Retired meshes and objects destroyed since the last ResetStats.
+};
+
+/**
+ * Owns the engine's meshes and hands out MeshHandles to them in place of shared pointers. Meshes are
+ * stored by value in a DensePool, so drawing every mesh walks one contiguous array, and copying a
+ * handle is copying an int.
+ *
+ * Releasing a mesh makes its handle stale straight away, but the mesh (and its buffers, or its slice
+ * of a geometry pool) is only destroyed once the frame it was released in is retireLatency frames in
+ * the past, by which point the GPU has finished any draws that were queued with it. Any other device
+ * object, eg a texture or effect that is being replaced, can be handed over with DeferRelease to get
+ * the same treatment.
+ *
+ * EndFrame must be called once per frame, after the frame is presented.
+ */
+class ResourceRegistry
+{
+public:
+    static const unsigned int DEFAULT_RETIRE_LATENCY = 3;
+
+    explicit ResourceRegistry(unsigned int retireLatency = DEFAULT_RETIRE_LATENCY);
+    ResourceRegistry(const ResourceRegistry&) = delete;
+    ~ResourceRegistry();
+
+    ResourceRegistry& operator =(const ResourceRegistry&) = delete;
+
+    // Move a mesh into the registry.
+    MeshHandle AddMesh(StaticMesh&& mesh);
+
+    // The mesh a handle refers to, or null if the handle is null or has been released. The pointer is
+    // only good until the next AddMesh or ReleaseMesh, which can move meshes around.
+    StaticMesh * GetMesh(MeshHandle handle) { return mMeshes.Get(handle); }
+    const StaticMesh * GetMesh(MeshHandle handle) const { return mMeshes.Get(handle); }
+    bool IsAlive(MeshHandle handle) const { return mMeshes.Contains(handle); }
+
+    // Stop using a mesh. Returns false if the handle was already stale.
+    bool ReleaseMesh(MeshHandle handle);
+
+    // Every live mesh, packed together in no particular order.
+    const DensePool<StaticMesh>& Meshes() const { return mMeshes; }
+
+    // Take over a reference to a device object and drop it once the GPU is done with this frame.
+    void DeferRelease(IUnknown * pObject);
+
+    // Finish the current frame and destroy whatever was released retireLatency frames ago.
+    void EndFrame();
+
+    // Destroy every mesh and retired object right away. Only safe when the GPU is idle.
+    void Clear();
+
+    unsigned int FrameIndex() const { return mFrameIndex; }
+    unsigned int RetireLatency() const { return mRetireLatency; }
+
+    ResourceRegistryStats Stats() const;
+    void ResetStats() { mDestroyedCount = 0; }
+
+private:
+    void DestroyRetiredObjects(unsigned int frame);
+
+private:
+    unsigned int mRetireLatency;
+    unsigned int mFrameIndex;
+    unsigned int mDestroyedCount;
+    DensePool<StaticMesh> mMeshes;
+    std::vector<Microsoft::WRL::ComPtr<IUnknown>> mRetiredObjects;
+    std::vector<unsigned int> mRetiredObjectFrames;
+};
+
+#endif
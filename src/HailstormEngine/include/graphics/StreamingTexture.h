@@ -0,0 +1,83 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef SCOTT_HAILSTORM_GRAPHICS_STREAMING_TEXTURE_H
+#define SCOTT_HAILSTORM_GRAPHICS_STREAMING_TEXTURE_H
+
+#include <wrl\wrappers\corewrappers.h>  // ComPtr.
+#include <wrl\client.h>                 // ComPtr friends.
+
+#include "runtime/DdsFile.h"
+#include "runtime/TextureStreamer.h"
+#include "runtime/VirtualFileSystem.h"
+
+struct ID3D10Device;
+struct ID3D10ShaderResourceView;
+struct ID3D10Texture2D;
+
+/**
+ * A 2D texture or cube map read from a DDS file and streamed in by a TextureStreamer. The device
+ * texture starts out holding only the smallest mips and is rebuilt with more detail each time the
+ * streamer loads another level, so View can change from frame to frame and should be fetched when
+ * drawing rather than kept.
+ *
+ * Surfaces are uploaded straight from the file's bytes, which the texture keeps open. One dimensional
+ * textures are uploaded as 2D textures one texel high. Volume textures and cube map arrays fail to
+ * open.
+ *
+ * Every method must be called on the thread that updates the streamer.
+ */
+class StreamingTexture
+{
+public:
+    StreamingTexture(ID3D10Device * pDevice, TextureStreamer * pStreamer);
+    StreamingTexture(const StreamingTexture&) = delete;
+    ~StreamingTexture();
+
+    StreamingTexture& operator =(const StreamingTexture&) = delete;
+
+    // Take ownership of a DDS file, upload its tail and start streaming it towards the requested
+    // resolution. Returns false, with the reason in ppReasonOut, if the file can't be used.
+    bool Open(VirtualFile&& file, unsigned int requestedSize, const char ** ppReasonOut);
+
+    // Change the resolution the texture is drawn at, in texels along its longer side.
+    void RequestSize(unsigned int requestedSize);
+
+    ID3D10ShaderResourceView * View() const { return mView.Get(); }
+    ID3D10Texture2D * Texture() const { return mTexture.Get(); }
+
+    // Most detailed mip of the file that is on the device.
+    unsigned int FirstMip() const { return mFirstMip; }
+
+    const DdsFile& File() const { return mDds; }
+
+    // Bytes of texel data on the device.
+    size_t DeviceSize() const;
+
+private:
+    HRESULT Upload(unsigned int firstMip);
+
+private:
+    Microsoft::WRL::ComPtr<ID3D10Device> mDevice;
+    TextureStreamer * mpStreamer;
+    TextureStreamer::TextureHandle mHandle;
+    VirtualFile mFile;
+    DdsFile mDds;
+    Microsoft::WRL::ComPtr<ID3D10Texture2D> mTexture;
+    Microsoft::WRL::ComPtr<ID3D10ShaderResourceView> mView;
+    unsigned int mFirstMip;
+};
+
+#endif
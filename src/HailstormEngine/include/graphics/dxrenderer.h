@@ -28,6 +28,7 @@
 class RenderingWindow;
 class DemoScene;
 class GraphicsContentManager;
+class VirtualFileSystem;
 class LandscapeMesh;
 class WaterMesh;
 class Camera;
@@ -62,10 +63,15 @@ public:
 
     void Initialize();
 
+    // Number of threads the content manager loads assets on. Zero loads everything serially on the
+    // render thread. Must be set before Initialize is called.
+    void SetLoaderThreadCount(unsigned int threadCount);
+
     // TODO: Don't pass scene here. Add a method for DXRenderer called "AttachScene". Update should call
     //       Scene::Update() and Scene::Render() at the appropriate time.
     void Update(const DemoScene& scene, TimeT currentTime, TimeT deltaTime);
 
+    // Compile and create an effect from a .fx file in the file system.
     HRESULT LoadFxFile(const std::wstring& fxFilePath, ID3D10Effect ** ppEffectOut) const;
     void SetDefaultRendering();
     void SetWireframeRendering();
@@ -73,6 +79,13 @@ public:
     // DONT STORE THIS POINTER WHEN CALLING
     ID3D10Device * GetDevice() { return mDevice.Get(); }
 
+    // Content manager for loading assets. Only valid once the renderer is initialized.
+    GraphicsContentManager& ContentManager();
+
+    // File system that every asset is read from. The content directory and the archive packed from
+    // it are mounted at the root when the renderer is initialized, and more can be mounted after.
+    VirtualFileSystem& FileSystem();
+
     // Create a font that can be used for drawing text.
     HRESULT CreateRenderFont(
         const std::wstring& fontName,
@@ -108,6 +121,8 @@ private:
 
     void ReleaseDeviceViews();
 
+    void MountContent(const std::wstring& contentDirectory);
+
 private:
     /// Main rendering window.
     std::shared_ptr<RenderingWindow> mWindow;
@@ -148,8 +163,14 @@ private:
     /// Flag if we are rendering in windowed mode or full screen
     bool mWindowedMode;
 	
+    /// File system the content manager reads assets from
+    std::unique_ptr<VirtualFileSystem> mFileSystem;
+
     /// The currently running graphics content manager
     std::unique_ptr<GraphicsContentManager> mContentManager;
+
+    /// Number of threads the content manager loads assets on
+    unsigned int mLoaderThreadCount;
 };
 
 #endif
\ No newline at end of file
@@ -16,21 +16,62 @@
 #ifndef SCOTT_HAILSTORM_GRAPHICS_CONTENT_MANAGER_H
 #define SCOTT_HAILSTORM_GRAPHICS_CONTENT_MANAGER_H
 
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>                       // Shared pointers.
+#include <mutex>
 #include <string>
+#include <vector>
+#include <wrl\wrappers\corewrappers.h>  // ComPtr.
+#include <wrl\client.h>                 // ComPtr friends.
 
+#include "graphics/AssetCache.h"
+#include "graphics/AssetFuture.h"
+#include "graphics/GeometryPool.h"
 #include "graphics/meshfactory.h"
+#include "graphics/ResourceRegistry.h"
 
 // Forward declarations
+class StaticMesh;
+class StreamingTexture;
+class TextureStreamer;
+class VirtualFileSystem;
+class WorkerPool;
 struct ID3D10Device;
+struct ID3D10Effect;
 
 /**
  * Manages the creation, loading and unloading of graphical assets in the game.
+ *
+ * Assets can be loaded asynchronously with loadAsync. The file is read (and for effects, compiled)
+ * on a pool of loader threads, and everything that needs the device is then handed back to the
+ * render thread, which creates the device objects in batches when processLoads is called once per
+ * frame. A content manager with no loader threads does each load inside loadAsync instead, the way
+ * content was loaded before loadAsync existed.
+ *
+ * Loaded assets are kept in an AssetCache, so asking for an asset that is already resident or loading
+ * shares it rather than loading it again. The cache is trimmed to its memory budget every frame.
+ *
+ * Every asset is read through a virtual file system, so assets are found in whichever directory or
+ * archive is mounted for them. Paths given to the content manager are paths in that file system.
+ *
+ * Textures are streamed rather than loaded whole (see loadTexture and TextureStreamer), using the same
+ * loader threads, and are upgraded towards the resolution they are drawn at by processLoads.
  */
 class GraphicsContentManager
 {
 public:
+    static const unsigned int DEFAULT_LOADER_THREADS = 2;
+    static const unsigned int DEFAULT_UPLOAD_BUDGET = 8;
+    static const unsigned long long DEFAULT_CPU_BUDGET = 256ull * 1024 * 1024;
+    static const unsigned long long DEFAULT_GPU_BUDGET = 512ull * 1024 * 1024;
+    static const unsigned int DEFAULT_POOL_VERTICES = 256 * 1024;
+    static const unsigned int DEFAULT_POOL_INDICES = 1024 * 1024;
+
     GraphicsContentManager( ID3D10Device * pRenderDevice,
-                            const std::wstring& mContentDir );
+                            const VirtualFileSystem * pFileSystem,
+                            unsigned int loaderThreadCount = DEFAULT_LOADER_THREADS );
     GraphicsContentManager(const GraphicsContentManager&) = delete;
     ~GraphicsContentManager();
 
@@ -39,9 +80,107 @@ public:
     // Get a reference to the mesh factory that constructs meshes on the fly
     MeshFactory& meshFactory();
 
+    // Get a reference to the registry that owns every mesh the content manager creates. Its
+    // EndFrame is called by the renderer once each frame is presented.
+    ResourceRegistry& resources();
+
+    // Get a reference to the geometry pool that the mesh factory places its primitives in. The
+    // renderer forgets its binding and resets its counts at the start of every frame.
+    GeometryPool& geometryPool();
+
+    // Get a reference to the cache of loaded assets, eg to change its memory budget or dump the
+    // resident set.
+    AssetCache& assets();
+
+    // Get the file system that assets are read from.
+    const VirtualFileSystem& fileSystem() const;
+
+    // Load a mesh file (see MeshFile) from the file system. The file's vertex and index streams are
+    // uploaded straight from the mapped file (or archive) without being copied.
+    // Returns a null handle (and logs why) if the file is missing, corrupt or not in the StaticMesh
+    // layout.
+    MeshHandle loadMesh( const std::wstring& path );
+
+    // Open a DDS texture from the file system and start streaming it in (see StreamingTexture). Its
+    // smallest mips are uploaded before this returns, and processLoads adds detail until it can be
+    // drawn at requestedSize texels along its longer side. Returns null (and logs why) if the file
+    // is missing, corrupt or in a layout Direct3D 10 can't use. Textures must be released before the
+    // content manager is destroyed.
+    std::shared_ptr<StreamingTexture> loadTexture( const std::wstring& path, unsigned int requestedSize = 0 );
+
+    // Get a reference to the streamer that upgrades textures opened with loadTexture.
+    TextureStreamer& textureStreamer();
+
+    // Start loading an asset from the file system, and return a future that is completed by
+    // processLoads once the asset is ready. The callback, if given, is called on the render thread
+    // when the load finishes, whether it succeeded or not, or straight away if the asset was already
+    // loaded. Supported asset types are StaticMesh (mesh files, see loadMesh)
+    // and ID3D10Effect (.fx files).
+    //
+    // The asset stays resident for as long as a copy of the future is held (see AssetCache).
+    template<typename T>
+    AssetFuture<T> loadAsync( const std::wstring& path,
+                              const typename AssetFuture<T>::Callback& callback = nullptr );
+
+    // Finish loads whose files are ready, creating their device objects and calling their
+    // callbacks, then trim the asset cache to its budget and update the texture streamer. At most
+    // uploadBudget loads are finished per call so a burst of loads is spread over several frames.
+    // Must be called on the render thread. Returns the number finished.
+    unsigned int processLoads();
+
+    // Block until every load that has been started is finished.
+    void waitForLoads();
+
+    // Call a function, once, on the render thread as soon as no loads are pending. It is called
+    // straight away if nothing is loading.
+    void notifyWhenIdle( const std::function<void()>& callback );
+
+    // Loads started but not yet finished by processLoads.
+    unsigned int pendingLoadCount() const;
+
+    unsigned int loaderThreadCount() const;
+
+    void setUploadBudget( unsigned int loadsPerFrame );
+
 private:
+    typedef std::function<void()> Completion;
+
+    template<typename T>
+    bool findOrInsertAsset( const AssetKey& key,
+                            const std::wstring& path,
+                            const typename AssetFuture<T>::Callback& callback,
+                            AssetFuture<T> * pFutureOut );
+
+    void startLoad( const std::function<Completion()>& job );
+    unsigned int finishLoads( unsigned int maxCount );
+
+private:
+    GeometryPool mGeometryPool;         // Declared first so it outlives every mesh placed in it.
+    ResourceRegistry mResources;
+    AssetCache mAssets;
     MeshFactory mMeshFactory;
-    std::wstring mContentDir;
+    AssetFuture<ID3D10Effect> mStaticMeshEffect;
+    const VirtualFileSystem * mpFileSystem;
+    Microsoft::WRL::ComPtr<ID3D10Device> mRenderDevice;
+
+    std::unique_ptr<WorkerPool> mpLoaders;
+    std::unique_ptr<TextureStreamer> mpTextureStreamer;
+    std::mutex mCompletedLock;
+    std::condition_variable mLoadCompleted;
+    std::deque<Completion> mCompleted;      // Filled by the loader threads, drained by processLoads.
+    unsigned int mPendingCount;             // Only touched on the render thread.
+    unsigned int mUploadBudget;
+    std::vector<std::function<void()>> mIdleCallbacks;
 };
 
+template<>
+AssetFuture<StaticMesh> GraphicsContentManager::loadAsync<StaticMesh>(
+    const std::wstring& path,
+    const AssetFuture<StaticMesh>::Callback& callback );
+
+template<>
+AssetFuture<ID3D10Effect> GraphicsContentManager::loadAsync<ID3D10Effect>(
+    const std::wstring& path,
+    const AssetFuture<ID3D10Effect>::Callback& callback );
+
 #endif
\ No newline at end of file
@@ -16,40 +16,138 @@
 #ifndef SCOTT_HAILSTORM_GRAPHICS_STATIC_MESH_FACTORY
 #define SCOTT_HAILSTORM_GRAPHICS_STATIC_MESH_FACTORY
 
+#include <map>
 #include <string>
+#include <vector>
 #include <memory>                       // Shared pointers.
 #include <wrl\wrappers\corewrappers.h>  // ComPtr.
 #include <wrl\client.h>                 // ComPtr friends.
 
+#include "graphics/InstanceBatcher.h"
+#include "graphics/MeshSimplifier.h"
+#include "graphics/ResourceRegistry.h"
+
 // Forward declarations
+class GeometryPool;
 class StaticMesh;
 struct ID3D10Device;
 struct ID3D10Effect;
 struct ID3D10EffectTechnique;
 struct ID3D10InputLayout;
+struct PrimitiveMesh;
+struct StaticMeshVertex;
 
 /**
- * Creates simple geometric static meshes at run time
+ * Creates simple geometric static meshes at run time.
+ *
+ * Meshes are placed in a ResourceRegistry, which owns them, and are returned as handles.
+ *
+ * Primitives are cached by their shape and parameters, so asking for the same primitive again returns
+ * the mesh that was created the first time instead of generating and uploading a new copy.
  */
 class MeshFactory
 {
 public:
-    MeshFactory(const std::wstring& dataDir, ID3D10Device * pRenderDevice);
+    MeshFactory(ID3D10Device * pRenderDevice, ResourceRegistry * pRegistry);
     MeshFactory(const MeshFactory&) = delete;
     ~MeshFactory();
 
     MeshFactory operator =(const MeshFactory&) = delete;
 
-    std::shared_ptr<StaticMesh> createBox( float scale ) const;
+    // Cube running from -scale to +scale along each axis.
+    MeshHandle createBox( float scale );
+    MeshHandle createBox( float halfWidth, float halfHeight, float halfDepth );
+    MeshHandle createUvSphere( float radius, unsigned int slices, unsigned int stacks );
+    MeshHandle createIcoSphere( float radius, unsigned int subdivisions );
+    MeshHandle createCylinder( float radius, float height, unsigned int slices );
+    MeshHandle createCone( float radius, float height, unsigned int slices );
+    MeshHandle createTorus( float majorRadius, float minorRadius, unsigned int rings, unsigned int sides );
+    MeshHandle createPlane( float width, float depth, unsigned int cols, unsigned int rows );
+    MeshHandle createCapsule( float radius, float height, unsigned int slices, unsigned int stacks );
+
+    // Release every cached primitive from the registry. Handles to them go stale, and the meshes are
+    // destroyed once the GPU is done with them.
+    void clearCache();
+
+    unsigned int cachedMeshCount() const;
+
+    // Place primitives created from now on in a geometry pool, or in buffers of their own if null.
+    // The pool must outlive every mesh placed in it.
+    void setGeometryPool( GeometryPool * pGeometryPool );
+
+    // Give primitives created from now on a chain of simplified levels of detail. Primitives have a
+    // single level until this is called, and passing params with no triangle ratios turns it off.
+    void setLodChain( const MeshSimplifier::LodChainParams& params );
+
+    // Give the factory the effect (cube.fx) that static meshes are drawn with. The content manager
+    // loads it in the background and calls this once it is ready; meshes can be created before then,
+    // but not drawn.
+    void setStaticMeshEffect( ID3D10Effect * pEffect );
+
+    // Check if the static mesh effect has been set.
+    bool isReady() const;
+
+    // Effect that static meshes are drawn with, for setting its matrices (gWVP, gViewProj). Null
+    // until setStaticMeshEffect is called.
+    ID3D10Effect * staticMeshEffect() const;
+
+    // Material for drawing static meshes with an InstanceBatcher.
+    InstanceMaterial instancedMaterial() const;
 
 private:
-    void Init(const std::wstring& dataDir);
+    enum class PrimitiveType
+    {
+        Box,
+        UvSphere,
+        IcoSphere,
+        Cylinder,
+        Cone,
+        Torus,
+        Plane,
+        Capsule
+    };
+
+    /**
+     * Identifies a generated primitive by its shape and the parameters it was generated with. Unused
+     * parameters are zero.
+     */
+    struct PrimitiveKey
+    {
+        PrimitiveType type;
+        float sizes[3];
+        unsigned int divisions[2];
+
+        bool operator <(const PrimitiveKey& other) const;
+    };
+
+    static PrimitiveKey MakeKey(
+        PrimitiveType type,
+        float size0,
+        float size1,
+        float size2,
+        unsigned int divisions0,
+        unsigned int divisions1);
+
+    MeshHandle FindPrimitive( const PrimitiveKey& key ) const;
+    MeshHandle UploadPrimitive( const PrimitiveKey& key, const char * pMeshName );
+
+    void OptimizeMesh(
+        const char * pMeshName,
+        std::vector<StaticMeshVertex> * pVertices,
+        std::vector<unsigned int> * pIndices) const;
 
 private:
     Microsoft::WRL::ComPtr<ID3D10Device> mRenderDevice;
     Microsoft::WRL::ComPtr<ID3D10Effect> mStaticMeshFX;
     Microsoft::WRL::ComPtr<ID3D10InputLayout> mStaticMeshInputLayout;
     ID3D10EffectTechnique * mpStaticMeshTechnique;
+    Microsoft::WRL::ComPtr<ID3D10InputLayout> mInstancedInputLayout;
+    ID3D10EffectTechnique * mpInstancedTechnique;
+    ResourceRegistry * mpRegistry;
+    GeometryPool * mpGeometryPool;
+    MeshSimplifier::LodChainParams mLodChainParams;
+    std::unique_ptr<PrimitiveMesh> mpScratch;   // Reused to generate every primitive.
+    std::map<PrimitiveKey, MeshHandle> mPrimitiveCache;
 };
 
 #endif
\ No newline at end of file
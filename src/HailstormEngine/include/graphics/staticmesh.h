@@ -17,9 +17,14 @@
 #define SCOTT_HAILSTORM_GRAPHICS_STATIC_MESH
 
 #include <memory>                       // Shared pointers.
+#include <vector>
 #include <wrl\wrappers\corewrappers.h>  // ComPtr.
 #include <wrl\client.h>                 // ComPtr friends.
 
+#include "graphics/BoundingVolume.h"
+#include "graphics/GeometryPool.h"
+#include "graphics/MeshLod.h"
+
 // Forward declarations
 struct ID3D10Buffer;
 struct ID3D10Device;
@@ -27,9 +32,10 @@ struct StaticMeshVertex;
 
 /**
  * [DESCRIPTION]
+ *
+ * Meshes can be moved (eg into a ResourceRegistry) but not copied. A moved from mesh is left empty.
  */
-// TODO: Support copying?
-class StaticMesh
+class StaticMesh : public BoundedMesh
 {
 public:
     StaticMesh();
@@ -37,27 +43,75 @@ public:
                 const StaticMeshVertex * pVertexArray,
                 unsigned int vertexCount,
                 const std::vector<unsigned int>& indexArray );
+    StaticMesh( ID3D10Device * pRenderDevice,
+                const StaticMeshVertex * pVertexArray,
+                unsigned int vertexCount,
+                const unsigned int * pIndexArray,
+                unsigned int indexCount );
+    StaticMesh( GeometryPool * pGeometryPool,
+                ID3D10Device * pRenderDevice,
+                const StaticMeshVertex * pVertexArray,
+                unsigned int vertexCount,
+                const unsigned int * pIndexArray,
+                unsigned int indexCount );
     StaticMesh(const StaticMesh&) = delete;
-    ~StaticMesh();
+    StaticMesh(StaticMesh&& other);
+    virtual ~StaticMesh();
 
     StaticMesh& operator =(const StaticMesh&) = delete;
+    StaticMesh& operator =(StaticMesh&& other);
 
+    // Draw the most detailed level, or another level of detail.
     void draw( ID3D10Device *pDevice ) const;
+    void draw( ID3D10Device *pDevice, unsigned int lod ) const;
+
+    // Draw instanceCount copies of the mesh, reading StaticMeshInstance data from slot one of the
+    // input assembler starting at firstInstance in pInstanceBuffer.
+    void drawInstanced( ID3D10Device *pDevice,
+                        ID3D10Buffer *pInstanceBuffer,
+                        unsigned int instanceCount,
+                        unsigned int firstInstance = 0,
+                        unsigned int lod = 0 ) const;
+
+    // Levels of detail, as ranges of the indices the mesh was created with, from the most to the
+    // least detailed (see MeshSimplifier::GenerateLodChain). Meshes start with a single level that
+    // covers every index.
+    void setLods( const MeshLod * pLods, unsigned int lodCount );
+    void setLods( const std::vector<MeshLod>& lods );
+    unsigned int lodCount() const { return static_cast<unsigned int>( mLods.size() ); }
+    const MeshLod& lod( unsigned int index ) const { return mLods[index]; }
+
+    // Pick the level of detail to draw when the mesh covers screenSize of the screen's height (see
+    // ProjectedScreenSize).
+    unsigned int selectLod( float screenSize ) const;
 
     unsigned int vertexCount() const;
     unsigned int faceCount() const;
 
+    // Model space bounds of the vertices the mesh was created with.
+    virtual const MeshBounds& Bounds() const override { return mBounds; }
+
+    // Pooled meshes live in a slice of a GeometryPool's shared buffers rather than their own.
+    bool isPooled() const { return mpGeometryPool != nullptr; }
+    const GeometryRange& geometryRange() const;
+
 private:
+    void swap( StaticMesh& other );
     void uploadMesh( ID3D10Device * pRenderDevice,
                      const StaticMeshVertex * pVertexArray,
                      unsigned int vertexCount,
-                     const std::vector<unsigned int>& indexArray );
+                     const unsigned int * pIndexArray,
+                     unsigned int indexCount );
 
 private:
     unsigned int mVertexCount;
     unsigned int mFaceCount;
     Microsoft::WRL::ComPtr<ID3D10Buffer> mVertexBuffer;
     Microsoft::WRL::ComPtr<ID3D10Buffer> mIndexBuffer;
+    GeometryPool * mpGeometryPool;
+    GeometryPool::Handle mGeometryHandle;
+    std::vector<MeshLod> mLods;
+    MeshBounds mBounds;
 };
 
 #endif
\ No newline at end of file
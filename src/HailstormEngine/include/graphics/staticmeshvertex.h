@@ -24,6 +24,18 @@
 struct StaticMeshVertex
 {
     D3DXVECTOR3 pos;
+    D3DXVECTOR3 normal;
+    D3DXVECTOR2 texcoord;
+    D3DXCOLOR color;
+};
+
+/**
+ * Per instance data streamed alongside a static mesh's vertices when it is drawn instanced. The
+ * instance color multiplies the vertex color.
+ */
+struct StaticMeshInstance
+{
+    D3DXMATRIX world;
     D3DXCOLOR color;
 };
 
@@ -0,0 +1,48 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef SCOTT_HAILSTORM_TERRAIN_DIRTY_RECT_SET_H
+#define SCOTT_HAILSTORM_TERRAIN_DIRTY_RECT_SET_H
+
+#include <vector>
+
+#include "terrain/GridRect.h"
+
+/**
+ * Collects the areas of a grid that were changed so they can be processed together later, eg once per
+ * frame. Rectangles that overlap or share an edge are merged as they are added, so an area edited
+ * several times is only processed once.
+ */
+class DirtyRectSet
+{
+public:
+    DirtyRectSet();
+
+    // Mark a rectangle as dirty. Empty rectangles are ignored.
+    void Add(const GridRect& rect);
+
+    void Clear();
+
+    bool IsEmpty() const { return mRects.empty(); }
+    const std::vector<GridRect>& Rects() const { return mRects; }
+
+    // Number of grid points covered by the dirty rectangles.
+    unsigned int Area() const;
+
+private:
+    std::vector<GridRect> mRects;
+};
+
+#endif
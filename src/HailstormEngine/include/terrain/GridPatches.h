@@ -0,0 +1,89 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef SCOTT_HAILSTORM_TERRAIN_GRID_PATCHES_H
+#define SCOTT_HAILSTORM_TERRAIN_GRID_PATCHES_H
+
+#include <vector>
+
+#include "graphics/Frustum.h"
+#include "graphics/IndexRange.h"
+#include "terrain/GridRect.h"
+
+class HeightField;
+
+/**
+ * Splits a rows x cols vertex grid into square patches of cells so that it can be frustum culled a
+ * patch at a time instead of being drawn in one piece.
+ *
+ * The grid's index buffer is laid out patch by patch (see BuildIndices), which puts every patch's
+ * triangles in one contiguous range and lets neighboring visible patches be drawn with a single call.
+ * Each patch has a bounding box that must be kept up to date with the grid's vertex positions.
+ */
+class GridPatches
+{
+public:
+    GridPatches();
+    GridPatches(unsigned int rows, unsigned int cols, unsigned int patchCells);
+
+    unsigned int PatchRows() const { return mPatchRows; }
+    unsigned int PatchCols() const { return mPatchCols; }
+    unsigned int PatchCount() const { return mPatchRows * mPatchCols; }
+    unsigned int IndexCount() const { return mFirstIndex.empty() ? 0 : mFirstIndex.back(); }
+
+    // Range of the index buffer that holds a patch's triangles.
+    IndexRange PatchIndices(unsigned int patch) const;
+
+    // Index ranges of every patch, in patch order.
+    void GetPatchRanges(std::vector<IndexRange> * pRangesOut) const;
+
+    // Create the grid's index buffer in patch order. Patches are stored row by row, and the cells in a
+    // patch are also stored row by row. Each cell is split into two triangles along the
+    // (row, col + 1) - (row + 1, col) diagonal.
+    void BuildIndices(std::vector<unsigned int> * pIndicesOut) const;
+
+    // Recompute every patch's bounding box from the grid vertices. pPositions points at the position
+    // of the first vertex, and vertices are stride bytes apart in row major order.
+    void UpdateBounds(const void * pPositions, unsigned int stride);
+
+    // Recompute every patch's bounding box from a height field with the same dimensions as the grid.
+    void UpdateBounds(const HeightField& field);
+
+    // Recompute the bounding boxes of the patches that contain any grid point in a rectangle.
+    void UpdateBounds(const HeightField& field, const GridRect& points);
+
+    const BoundingBoxSet& Bounds() const { return mBounds; }
+
+    // Find the patches that intersect the frustum and return the index ranges to draw them. Ranges of
+    // neighboring visible patches are merged. Returns the number of visible patches.
+    //
+    // Not safe to call from more than one thread at a time on the same instance.
+    unsigned int Cull(const Frustum& frustum, std::vector<IndexRange> * pRangesOut) const;
+
+private:
+    void UpdatePatchBounds(const HeightField& field, unsigned int patchRow, unsigned int patchCol);
+
+private:
+    unsigned int mRows;
+    unsigned int mCols;
+    unsigned int mPatchCells;
+    unsigned int mPatchRows;
+    unsigned int mPatchCols;
+    std::vector<unsigned int> mFirstIndex;          // First index of each patch, plus the total count.
+    BoundingBoxSet mBounds;
+    mutable std::vector<unsigned char> mVisible;    // Scratch space for Cull.
+};
+
+#endif
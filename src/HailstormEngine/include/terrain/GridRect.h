@@ -0,0 +1,72 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef SCOTT_HAILSTORM_TERRAIN_GRID_RECT_H
+#define SCOTT_HAILSTORM_TERRAIN_GRID_RECT_H
+
+#include <algorithm>
+
+/**
+ * A rectangle of grid points, covering rows [rowBegin, rowEnd) and columns [colBegin, colEnd).
+ */
+struct GridRect
+{
+    unsigned int rowBegin;
+    unsigned int colBegin;
+    unsigned int rowEnd;
+    unsigned int colEnd;
+
+    bool IsEmpty() const { return rowBegin >= rowEnd || colBegin >= colEnd; }
+    unsigned int Rows() const { return IsEmpty() ? 0 : rowEnd - rowBegin; }
+    unsigned int Cols() const { return IsEmpty() ? 0 : colEnd - colBegin; }
+    unsigned int Area() const { return Rows() * Cols(); }
+
+    // True if the rectangles overlap or share an edge, ie their union has no gaps along either axis.
+    bool Touches(const GridRect& other) const
+    {
+        return rowBegin <= other.rowEnd && other.rowBegin <= rowEnd &&
+               colBegin <= other.colEnd && other.colBegin <= colEnd;
+    }
+
+    // Smallest rectangle containing both rectangles.
+    GridRect Union(const GridRect& other) const
+    {
+        GridRect result =
+        {
+            std::min(rowBegin, other.rowBegin),
+            std::min(colBegin, other.colBegin),
+            std::max(rowEnd, other.rowEnd),
+            std::max(colEnd, other.colEnd)
+        };
+
+        return result;
+    }
+
+    // Grow the rectangle by border points on every side, without going past a rows x cols grid.
+    GridRect Expand(unsigned int border, unsigned int rows, unsigned int cols) const
+    {
+        GridRect result =
+        {
+            rowBegin > border ? rowBegin - border : 0,
+            colBegin > border ? colBegin - border : 0,
+            std::min(rowEnd + border, rows),
+            std::min(colEnd + border, cols)
+        };
+
+        return result;
+    }
+};
+
+#endif
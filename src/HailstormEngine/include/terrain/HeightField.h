@@ -0,0 +1,79 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef SCOTT_HAILSTORM_TERRAIN_HEIGHT_FIELD_H
+#define SCOTT_HAILSTORM_TERRAIN_HEIGHT_FIELD_H
+
+#include <vector>
+#include <d3dx10.h>
+
+/**
+ * A regular grid of terrain heights. Grid point (row, col) lies at world position
+ * (originX + col * stepX, height, originZ + row * stepZ). Steps may be negative, which lets the grid
+ * match meshes whose rows run from +z to -z.
+ *
+ * Each grid cell is split into two triangles along the (row, col + 1) - (row + 1, col) diagonal, which
+ * is the same triangulation that the landscape index buffer uses.
+ */
+class HeightField
+{
+public:
+    HeightField();
+    HeightField(unsigned int rows, unsigned int cols, float originX, float originZ, float stepX, float stepZ);
+
+    unsigned int Rows() const { return mRows; }
+    unsigned int Cols() const { return mCols; }
+    unsigned int CellRows() const { return mRows > 0 ? mRows - 1 : 0; }
+    unsigned int CellCols() const { return mCols > 0 ? mCols - 1 : 0; }
+    float OriginX() const { return mOriginX; }
+    float OriginZ() const { return mOriginZ; }
+    float StepX() const { return mStepX; }
+    float StepZ() const { return mStepZ; }
+
+    // Height stored at a grid point. Out of range rows and columns are clamped to the edge.
+    float Height(int row, int col) const;
+    void SetHeight(unsigned int row, unsigned int col, float height);
+
+    // Raw row major height storage.
+    float * Data() { return mHeights.empty() ? nullptr : &mHeights[0]; }
+    const float * Data() const { return mHeights.empty() ? nullptr : &mHeights[0]; }
+
+    // Bilinearly interpolated height at world position (x, z), clamped to the edge of the grid.
+    float SampleHeight(float x, float z) const;
+
+    // Smooth unit normal at a grid point computed from central differences of its neighbors.
+    D3DXVECTOR3 Normal(int row, int col) const;
+
+    // World position of a grid point.
+    D3DXVECTOR3 Position(unsigned int row, unsigned int col) const;
+
+    // Convert world x and z to fractional grid column and row.
+    float ToGridCol(float x) const { return (x - mOriginX) / mStepX; }
+    float ToGridRow(float z) const { return (z - mOriginZ) / mStepZ; }
+
+    // Find the minimum and maximum height stored in the grid.
+    void HeightRange(float * pMinHeightOut, float * pMaxHeightOut) const;
+
+private:
+    unsigned int mRows;
+    unsigned int mCols;
+    float mOriginX;
+    float mOriginZ;
+    float mStepX;
+    float mStepZ;
+    std::vector<float> mHeights;
+};
+
+#endif
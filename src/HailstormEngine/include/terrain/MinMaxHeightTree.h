@@ -0,0 +1,122 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef SCOTT_HAILSTORM_TERRAIN_MIN_MAX_HEIGHT_TREE_H
+#define SCOTT_HAILSTORM_TERRAIN_MIN_MAX_HEIGHT_TREE_H
+
+#include <vector>
+#include <d3dx10.h>
+
+#include "terrain/GridRect.h"
+
+class HeightField;
+
+/**
+ * Result of a ray cast against the terrain.
+ */
+struct TerrainRayHit
+{
+    float distance;         // Distance along the ray, in multiples of the ray direction.
+    D3DXVECTOR3 position;   // World position of the hit.
+    unsigned int row;       // Grid cell that was hit.
+    unsigned int col;
+};
+
+/**
+ * A quadtree of minimum and maximum heights over a height field. Level zero stores the height range
+ * of every grid cell, and each level above it stores the range of a 2x2 block of the level below,
+ * ending with a single root node covering the entire field.
+ *
+ * Ray queries walk the tree front to back, skipping any node whose bounding box the ray misses or
+ * enters beyond the closest hit found so far. Only the handful of cells the ray actually passes near
+ * are ever tested against triangles.
+ *
+ * The tree keeps a pointer to the height field it was built from, which must outlive it.
+ */
+class MinMaxHeightTree
+{
+public:
+    MinMaxHeightTree();
+    explicit MinMaxHeightTree(const HeightField& field);
+    MinMaxHeightTree(const MinMaxHeightTree&) = delete;
+
+    MinMaxHeightTree& operator =(const MinMaxHeightTree&) = delete;
+
+    // (Re)build the tree over a height field.
+    void Build(const HeightField& field);
+
+    // Refresh the tree after the heights in a rectangle of grid points changed.
+    void Update(const GridRect& points);
+
+    // Cast a ray against the terrain and find the closest hit within maxDistance.
+    bool Raycast(
+        const D3DXVECTOR3& origin,
+        const D3DXVECTOR3& direction,
+        float maxDistance,
+        TerrainRayHit * pHitOut) const;
+
+    // Check if the terrain blocks the line of sight between two points. Returns as soon as any hit is
+    // found rather than searching for the closest one.
+    bool IsSegmentBlocked(const D3DXVECTOR3& from, const D3DXVECTOR3& to) const;
+
+    // Cast a batch of rays. Rays are traced through the tree in packets of four sharing a single
+    // traversal, which works best when neighboring rays in the batch point in similar directions.
+    // pHitsOut[i].distance is negative when ray i did not hit anything.
+    void RaycastBatch(
+        const D3DXVECTOR3 * pOrigins,
+        const D3DXVECTOR3 * pDirections,
+        const float * pMaxDistances,
+        unsigned int rayCount,
+        TerrainRayHit * pHitsOut) const;
+
+    // Reference implementation that tests the ray against every triangle in the height field.
+    bool RaycastBruteForce(
+        const D3DXVECTOR3& origin,
+        const D3DXVECTOR3& direction,
+        float maxDistance,
+        TerrainRayHit * pHitOut) const;
+
+    unsigned int LevelCount() const { return static_cast<unsigned int>(mLevels.size()); }
+
+private:
+    struct Level
+    {
+        unsigned int width;
+        unsigned int height;
+        std::vector<float> minHeights;
+        std::vector<float> maxHeights;
+    };
+
+    struct GridRay;
+
+    void BuildLevel(unsigned int level);
+    void BuildNode(unsigned int level, unsigned int x, unsigned int y);
+    void RaycastPacket(
+        const D3DXVECTOR3 * pOrigins,
+        const D3DXVECTOR3 * pDirections,
+        const float * pMaxDistances,
+        unsigned int rayCount,
+        TerrainRayHit * pHitsOut) const;
+
+    bool Trace(const GridRay& ray, float maxDistance, bool anyHit, float * pDistanceOut, unsigned int * pRowOut, unsigned int * pColOut) const;
+    bool IntersectCell(const GridRay& ray, unsigned int row, unsigned int col, float maxDistance, float * pDistanceOut) const;
+    void FillHit(const D3DXVECTOR3& origin, const D3DXVECTOR3& direction, float distance, unsigned int row, unsigned int col, TerrainRayHit * pHitOut) const;
+
+private:
+    const HeightField * mpField;
+    std::vector<Level> mLevels;
+};
+
+#endif
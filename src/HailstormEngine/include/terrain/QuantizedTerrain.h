@@ -0,0 +1,82 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef SCOTT_HAILSTORM_TERRAIN_QUANTIZED_TERRAIN_H
+#define SCOTT_HAILSTORM_TERRAIN_QUANTIZED_TERRAIN_H
+
+#include <vector>
+#include <d3dx10.h>
+
+#include "terrain/GridRect.h"
+
+class HeightField;
+
+/**
+ * Compact terrain vertex. Everything else about the vertex is reconstructed in the vertex shader: x and
+ * z come from the grid position implied by the vertex's index, and colours are looked up in a palette
+ * by material.
+ *
+ * Vertices are read in the shader from a Buffer<uint> of R16_UINT elements, three per vertex, so the
+ * vertex buffer must stay in grid order (vertex index = row * cols + col).
+ */
+struct QuantizedTerrainVertex
+{
+    unsigned short height;          // Fraction of the terrain's height range, see HeightStep().
+    unsigned short normal;          // Octahedral encoded unit normal, 8 bits per axis.
+    unsigned char material;         // Palette index.
+    unsigned char ambient;          // Ambient visibility, 255 is unoccluded. See TerrainOcclusion.
+};
+
+/**
+ * Picks the material of a terrain vertex from its height and normal.
+ */
+typedef unsigned char (*TerrainMaterialFunction)(float height, const D3DXVECTOR3& normal);
+
+namespace TerrainQuantization
+{
+    // Map a unit normal onto an octahedron, unfold it into a square and store it in 16 bits. Terrain
+    // normals point mostly up so +y is used as the octahedron's primary axis.
+    unsigned short EncodeNormal(const D3DXVECTOR3& normal);
+    D3DXVECTOR3 DecodeNormal(unsigned short encoded);
+
+    // Size of one quantization step when storing heights in [minHeight, maxHeight] with 16 bits.
+    float HeightStep(float minHeight, float maxHeight);
+
+    unsigned short EncodeHeight(float height, float minHeight, float heightStep);
+    float DecodeHeight(unsigned short encoded, float minHeight, float heightStep);
+
+    // Build a quantized vertex for every grid point in the height field, in grid order. pAmbient holds
+    // the ambient visibility of every grid point, or is null if nothing is occluded.
+    void PackVertices(
+        const HeightField& field,
+        float minHeight,
+        float heightStep,
+        TerrainMaterialFunction findMaterial,
+        const unsigned char * pAmbient,
+        std::vector<QuantizedTerrainVertex> * pVerticesOut);
+
+    // Build quantized vertices for a rectangle of grid points. pVerticesOut must have room for
+    // rect.Area() vertices, which are written row by row.
+    void PackVertices(
+        const HeightField& field,
+        const GridRect& rect,
+        float minHeight,
+        float heightStep,
+        TerrainMaterialFunction findMaterial,
+        const unsigned char * pAmbient,
+        QuantizedTerrainVertex * pVerticesOut);
+}
+
+#endif
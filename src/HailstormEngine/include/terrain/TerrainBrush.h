@@ -0,0 +1,43 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef SCOTT_HAILSTORM_TERRAIN_TERRAIN_BRUSH_H
+#define SCOTT_HAILSTORM_TERRAIN_TERRAIN_BRUSH_H
+
+#include "terrain/GridRect.h"
+
+class HeightField;
+
+/**
+ * Height field editing brushes. Every brush affects the grid points within radius of world position
+ * (x, z), fading out smoothly towards the edge, and returns the rectangle of grid points it may have
+ * changed so the caller can rebuild just that area.
+ */
+namespace TerrainBrush
+{
+    // Rectangle of grid points within radius of (x, z), clipped to the grid.
+    GridRect CircleRect(const HeightField& field, float x, float z, float radius);
+
+    // Add amount to the terrain height. Negative amounts lower the terrain.
+    GridRect Raise(HeightField * pField, float x, float z, float radius, float amount);
+
+    // Move the terrain towards height. A strength of one flattens the centre of the brush completely.
+    GridRect Flatten(HeightField * pField, float x, float z, float radius, float height, float strength);
+
+    // Dig a bowl shaped crater that is depth deep in the centre, with a low raised rim around it.
+    GridRect Crater(HeightField * pField, float x, float z, float radius, float depth);
+}
+
+#endif
@@ -0,0 +1,128 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef SCOTT_HAILSTORM_TERRAIN_TERRAIN_CACHE_H
+#define SCOTT_HAILSTORM_TERRAIN_TERRAIN_CACHE_H
+
+#include <string>
+
+#include "runtime/MappedFile.h"
+#include "runtime/Noise.h"
+
+/**
+ * Everything that determines the contents of a baked terrain. A cache file is only used when the key
+ * it was written with hashes to the same value as the key of the terrain being loaded.
+ */
+struct TerrainCacheKey
+{
+    TerrainCacheKey();
+
+    unsigned int rows;
+    unsigned int cols;
+    float spatialStep;
+    unsigned int seed;
+    Noise::FractalParams params;
+    unsigned int vertexStride;      // Size of the baked vertex, changes whenever its layout changes.
+    unsigned int patchCells;        // Patch size the index buffer was laid out for, see GridPatches.
+    unsigned long long bakeHash;    // Hash of any other settings baked into the vertices, eg occlusion.
+
+    unsigned long long Hash() const;
+};
+
+/**
+ * Header at the start of a baked terrain file. All offsets are from the start of the file and are
+ * aligned to 16 bytes so the streams can be used in place once the file is mapped into memory.
+ */
+struct TerrainCacheHeader
+{
+    unsigned int magic;
+    unsigned int version;
+    unsigned int headerSize;
+
+    // Generator description, kept for tooling and debugging. Only keyHash is used to validate.
+    unsigned int rows;
+    unsigned int cols;
+    float spatialStep;
+    unsigned int seed;
+    unsigned int basis;
+    unsigned int fractalType;
+    unsigned int octaves;
+    float frequency;
+    float lacunarity;
+    float gain;
+    float ridgeOffset;
+    float amplitude;
+    float bias;
+
+    unsigned int vertexStride;
+    unsigned int vertexCount;
+    unsigned int indexCount;
+    unsigned int patchCells;
+
+    unsigned long long keyHash;
+    unsigned long long fileSize;
+    unsigned long long heightsOffset;       // rows * cols floats.
+    unsigned long long verticesOffset;      // vertexCount * vertexStride bytes.
+    unsigned long long indicesOffset;       // indexCount 32 bit indices.
+};
+
+/**
+ * A fully generated terrain (heights, vertex stream and index stream) saved to disk so it does not need
+ * to be regenerated on every launch.
+ *
+ * Opening a cache maps the file into memory and validates the header, after which the streams point
+ * directly into the mapped file. A file is only marked valid (by writing its header) after everything
+ * else has been written, so a partially written cache is never used.
+ */
+class TerrainCache
+{
+public:
+    TerrainCache();
+    TerrainCache(const TerrainCache&) = delete;
+    ~TerrainCache();
+
+    TerrainCache& operator =(const TerrainCache&) = delete;
+
+    // Map a cache file. Returns false if it is missing, corrupt or was baked from a different key.
+    bool Open(const std::wstring& path, const TerrainCacheKey& key);
+
+    // Unmap the cache file. Stream pointers are invalid after this is called.
+    void Close();
+
+    bool IsOpen() const { return mpHeader != nullptr; }
+
+    const float * Heights() const;
+    const void * Vertices() const;
+    const unsigned int * Indices() const;
+
+    unsigned int VertexCount() const { return mpHeader->vertexCount; }
+    unsigned int IndexCount() const { return mpHeader->indexCount; }
+
+    // Write a baked terrain to disk. Returns false (and logs why) if the file could not be written.
+    static bool Write(
+        const std::wstring& path,
+        const TerrainCacheKey& key,
+        const float * pHeights,
+        const void * pVertices,
+        unsigned int vertexCount,
+        const unsigned int * pIndices,
+        unsigned int indexCount);
+
+private:
+    MappedFile mFile;
+    const TerrainCacheHeader * mpHeader;
+};
+
+#endif
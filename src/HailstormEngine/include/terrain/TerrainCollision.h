@@ -0,0 +1,147 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef SCOTT_HAILSTORM_TERRAIN_TERRAIN_COLLISION_H
+#define SCOTT_HAILSTORM_TERRAIN_TERRAIN_COLLISION_H
+
+#include <vector>
+#include <d3dx10.h>
+
+class HeightField;
+
+struct CollisionSphere
+{
+    D3DXVECTOR3 center;
+    float radius;
+};
+
+// A line segment from a to b, grown by radius.
+struct CollisionCapsule
+{
+    D3DXVECTOR3 a;
+    D3DXVECTOR3 b;
+    float radius;
+};
+
+// A sphere moving in a straight line from start to end over one step.
+struct CollisionSweptSphere
+{
+    D3DXVECTOR3 start;
+    D3DXVECTOR3 end;
+    float radius;
+};
+
+/**
+ * Contact between a shape and the terrain. Only the deepest contact (or for swept spheres, the first)
+ * is reported for each shape.
+ */
+struct TerrainContact
+{
+    bool touching;          // False if the shape is clear of the terrain, the other members are unset.
+    D3DXVECTOR3 position;   // Contact point on the terrain surface.
+    D3DXVECTOR3 normal;     // Unit direction to move the shape in to separate it from the terrain.
+    float depth;            // How far the shape must move along the normal to separate.
+    float time;             // Swept spheres only, fraction of the sweep where contact begins.
+};
+
+/**
+ * Settings for a batch of collision queries.
+ */
+struct TerrainCollisionParams
+{
+    TerrainCollisionParams();
+
+    unsigned int threadCount;       // Zero for one thread per core.
+    unsigned int shapesPerTask;     // Shapes handed to a thread at a time.
+    unsigned int minParallelShapes; // Smaller batches run on the calling thread only.
+    bool sortByCell;                // Process shapes in grid order, so nearby shapes are tested together.
+};
+
+/**
+ * Collides batches of shapes against a height field, treating it as the same triangle mesh that the
+ * landscape renders. Shapes outside the height field's area never touch it.
+ *
+ * Batches are meant to be large (a physics step, or every particle in a system) and are run across
+ * threads with Parallel::For. Before running, shapes are ordered by the block of grid cells they are
+ * in, so that each thread works through shapes that read the same parts of the height field.
+ *
+ * The collider keeps a pointer to the height field, which must outlive it. Collision queries are
+ * const but share scratch space, so only one batch can run on a collider at a time.
+ */
+class TerrainCollider
+{
+public:
+    explicit TerrainCollider(const HeightField& field);
+    TerrainCollider(const TerrainCollider&) = delete;
+
+    TerrainCollider& operator =(const TerrainCollider&) = delete;
+
+    void CollideSpheres(
+        const CollisionSphere * pSpheres,
+        unsigned int count,
+        TerrainContact * pContactsOut,
+        const TerrainCollisionParams& params = TerrainCollisionParams()) const;
+
+    void CollideCapsules(
+        const CollisionCapsule * pCapsules,
+        unsigned int count,
+        TerrainContact * pContactsOut,
+        const TerrainCollisionParams& params = TerrainCollisionParams()) const;
+
+    // Find where each swept sphere first touches the terrain. Spheres that start inside the terrain
+    // report a time of zero.
+    void SweepSpheres(
+        const CollisionSweptSphere * pSweeps,
+        unsigned int count,
+        TerrainContact * pContactsOut,
+        const TerrainCollisionParams& params = TerrainCollisionParams()) const;
+
+    // Single shape versions of the batch queries.
+    TerrainContact CollideSphere(const CollisionSphere& sphere) const;
+    TerrainContact CollideCapsule(const CollisionCapsule& capsule) const;
+    TerrainContact SweepSphere(const CollisionSweptSphere& sweep) const;
+
+private:
+    struct Triangle;
+    struct SurfacePoint;
+
+    bool FindClosestPoint(const D3DXVECTOR3& point, float searchRadius, SurfacePoint * pClosestOut) const;
+    bool FindPointBelow(const D3DXVECTOR3& point, SurfacePoint * pSurfaceOut) const;
+    bool SweepTriangles(
+        const D3DXVECTOR3& start,
+        const D3DXVECTOR3& motion,
+        float radius,
+        float * pTimeOut,
+        SurfacePoint * pHitOut) const;
+    bool CellRange(float minX, float maxX, float minZ, float maxZ, unsigned int * pRange) const;
+    float CellDistanceSquared(unsigned int row, unsigned int col, const D3DXVECTOR3& point) const;
+    void CellBounds(unsigned int row, unsigned int col, D3DXVECTOR3 * pMinOut, D3DXVECTOR3 * pMaxOut) const;
+    void GetTriangle(unsigned int row, unsigned int col, unsigned int half, Triangle * pTriangleOut) const;
+    unsigned int CellKey(const D3DXVECTOR3& point) const;
+
+    template<typename Shape, typename Query>
+    void RunBatch(
+        const Shape * pShapes,
+        unsigned int count,
+        TerrainContact * pContactsOut,
+        const TerrainCollisionParams& params,
+        Query query) const;
+
+private:
+    const HeightField * mpField;
+    mutable std::vector<unsigned long long> mOrder;     // Scratch space, shapes sorted by cell.
+};
+
+#endif
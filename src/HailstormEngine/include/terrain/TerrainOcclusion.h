@@ -0,0 +1,89 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef SCOTT_HAILSTORM_TERRAIN_TERRAIN_OCCLUSION_H
+#define SCOTT_HAILSTORM_TERRAIN_TERRAIN_OCCLUSION_H
+
+#include <vector>
+
+#include "terrain/GridRect.h"
+
+class HeightField;
+
+/**
+ * Settings for baking horizon based ambient occlusion.
+ */
+struct TerrainOcclusionParams
+{
+    TerrainOcclusionParams();
+
+    unsigned int directionCount;    // Number of directions around each point searched for a horizon.
+    float maxDistance;              // How far to look for occluders, in world units.
+    float firstStep;                // Distance to the first height sample along each direction.
+    float stepGrowth;               // Each sample is this much further away than the previous one.
+    unsigned int threadCount;       // Zero for one thread per core.
+    unsigned int rowsPerTask;       // Rows of grid points handed to a thread at a time.
+
+    // Hash of the settings that change the baked result, for cache keys.
+    unsigned long long Hash() const;
+};
+
+/**
+ * Timings from an occlusion bake.
+ */
+struct TerrainOcclusionStats
+{
+    double seconds;
+    unsigned int threadCount;
+    unsigned int taskCount;
+    unsigned int stealCount;
+    unsigned long long sampleCount;     // Height samples taken across all points and directions.
+};
+
+/**
+ * Bakes per grid point ambient visibility from the terrain horizon. For each direction around a point
+ * the heights along that direction are sampled out to maxDistance to find the highest horizon angle
+ * above the surface's own slope, and the visibility is one minus the average of the sine of that
+ * angle less the sine of the slope. Open ground (flat or sloped) gets a visibility of one and the
+ * bottom of a narrow valley approaches zero.
+ *
+ * The bake sweeps four neighboring grid points through each direction together with SSE. Every point
+ * in a row samples at the same offsets, so the bilinear height lookups for four points are four
+ * unaligned loads rather than gathers. Rows are split between threads with Parallel::For.
+ *
+ * Visibility is stored as one byte per grid point, row major, with 255 being fully visible.
+ */
+namespace TerrainOcclusion
+{
+    // Bake the visibility of every grid point in the height field.
+    void Bake(
+        const HeightField& field,
+        const TerrainOcclusionParams& params,
+        std::vector<unsigned char> * pVisibilityOut,
+        TerrainOcclusionStats * pStatsOut = nullptr);
+
+    // Re-bake the grid points in a rectangle. pVisibility holds the visibility of the entire grid.
+    void Bake(
+        const HeightField& field,
+        const TerrainOcclusionParams& params,
+        const GridRect& rect,
+        unsigned char * pVisibility,
+        TerrainOcclusionStats * pStatsOut = nullptr);
+
+    // The grid points whose visibility can change when the heights in a rectangle change.
+    GridRect AffectedRect(const HeightField& field, const TerrainOcclusionParams& params, const GridRect& changed);
+}
+
+#endif
@@ -0,0 +1,427 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "stdafx.h"
+#include "graphics/AssetCache.h"
+
+#include <d3d10.h>
+#include <ostream>
+#include <vector>
+
+#include "graphics/ResourceRegistry.h"
+#include "runtime/logging.h"
+
+namespace
+{
+    const char * const ASSET_TYPE_NAMES[] = { "mesh", "effect" };
+
+    std::string NarrowPath(const std::wstring& path)
+    {
+        return std::string(path.begin(), path.end());
+    }
+
+    void AddMemory(AssetMemory * pTotal, const AssetMemory& memory)
+    {
+        pTotal->cpuBytes += memory.cpuBytes;
+        pTotal->gpuBytes += memory.gpuBytes;
+    }
+
+    // Round up, so that small assets don't show up as using nothing.
+    unsigned long long Kilobytes(unsigned long long bytes)
+    {
+        return (bytes + 1023) / 1024;
+    }
+
+    void SubtractMemory(AssetMemory * pTotal, const AssetMemory& memory)
+    {
+        pTotal->cpuBytes -= memory.cpuBytes;
+        pTotal->gpuBytes -= memory.gpuBytes;
+    }
+}
+
+bool AssetKey::operator <(const AssetKey& other) const
+{
+    if (type != other.type)
+    {
+        return type < other.type;
+    }
+
+    if (flags != other.flags)
+    {
+        return flags < other.flags;
+    }
+
+    return path < other.path;
+}
+
+AssetCache::AssetCache(ResourceRegistry * pResources)
+    : mpResources(pResources),
+      mEntries(),
+      mRecentlyUsed(),
+      mBudget(),
+      mMemory(),
+      mStats(),
+      mWarnedOverBudget(false)
+{
+    VerifyNotNull(pResources);
+
+    mBudget.cpuBytes = 0;
+    mBudget.gpuBytes = 0;
+    mMemory = mBudget;
+    ResetStats();
+}
+
+AssetCache::~AssetCache()
+{
+}
+
+template<>
+AssetFuture<StaticMesh>& AssetCache::EntryFuture<StaticMesh>(Entry& entry)
+{
+    return entry.mesh;
+}
+
+template<>
+AssetFuture<ID3D10Effect>& AssetCache::EntryFuture<ID3D10Effect>(Entry& entry)
+{
+    return entry.effect;
+}
+
+template<typename T>
+bool AssetCache::Find(const AssetKey& key, AssetFuture<T> * pFutureOut)
+{
+    VerifyNotNull(pFutureOut);
+    EntryMap::iterator entry = mEntries.find(key);
+
+    if (entry == mEntries.end())
+    {
+        mStats.missCount++;
+        return false;
+    }
+
+    mStats.hitCount++;
+    Touch(entry);
+
+    *pFutureOut = EntryFuture<T>(entry->second);
+    return true;
+}
+
+template<typename T>
+void AssetCache::Insert(const AssetKey& key, const AssetFuture<T>& future)
+{
+    Verify(future.isValid());
+    Verify(mEntries.find(key) == mEntries.end());
+
+    Entry& entry = mEntries[key];
+    EntryFuture<T>(entry) = future;
+    entry.memory.cpuBytes = 0;
+    entry.memory.gpuBytes = 0;
+
+    mRecentlyUsed.push_front(key);
+    entry.recentPosition = mRecentlyUsed.begin();
+    entry.lastUsedFrame = mpResources->FrameIndex();
+}
+
+template bool AssetCache::Find<StaticMesh>(const AssetKey&, AssetFuture<StaticMesh> *);
+template bool AssetCache::Find<ID3D10Effect>(const AssetKey&, AssetFuture<ID3D10Effect> *);
+template void AssetCache::Insert<StaticMesh>(const AssetKey&, const AssetFuture<StaticMesh>&);
+template void AssetCache::Insert<ID3D10Effect>(const AssetKey&, const AssetFuture<ID3D10Effect>&);
+
+void AssetCache::SetMemory(const AssetKey& key, const AssetMemory& memory)
+{
+    EntryMap::iterator entry = mEntries.find(key);
+
+    if (entry == mEntries.end())
+    {
+        return;
+    }
+
+    SubtractMemory(&mMemory, entry->second.memory);
+    entry->second.memory = memory;
+    AddMemory(&mMemory, memory);
+}
+
+void AssetCache::Remove(const AssetKey& key)
+{
+    EntryMap::iterator entry = mEntries.find(key);
+
+    if (entry != mEntries.end())
+    {
+        SubtractMemory(&mMemory, entry->second.memory);
+        mRecentlyUsed.erase(entry->second.recentPosition);
+        mEntries.erase(entry);
+    }
+}
+
+void AssetCache::SetBudget(const AssetMemory& budget)
+{
+    mBudget = budget;
+    mWarnedOverBudget = false;
+}
+
+/**
+ * Walks from the least recently used asset towards the most recent, evicting unreferenced assets
+ * until the cache fits. Warns (once, until the cache fits again) if referenced assets alone are over
+ * the budget.
+ */
+unsigned int AssetCache::Trim()
+{
+    unsigned int evictedCount = 0;
+    std::list<AssetKey>::iterator position = mRecentlyUsed.end();
+
+    while (IsOverBudget(mMemory, mBudget) && position != mRecentlyUsed.begin())
+    {
+        --position;
+        EntryMap::iterator entry = mEntries.find(*position);
+
+        if (!IsReferenced(entry->second))
+        {
+            // Evicting erases the list node, so step past it first.
+            std::list<AssetKey>::iterator next = position;
+            ++next;
+
+            Evict(entry);
+            evictedCount++;
+            position = next;
+        }
+    }
+
+    if (IsOverBudget(mMemory, mBudget))
+    {
+        if (!mWarnedOverBudget)
+        {
+            LOG_WARN("AssetCache") << "Assets in use need " << Kilobytes(mMemory.cpuBytes) << " KB of CPU memory and "
+                << Kilobytes(mMemory.gpuBytes) << " KB of GPU memory, which is over the budget of "
+                << Kilobytes(mBudget.cpuBytes) << " KB and " << Kilobytes(mBudget.gpuBytes) << " KB";
+            mWarnedOverBudget = true;
+        }
+    }
+    else
+    {
+        mWarnedOverBudget = false;
+    }
+
+    return evictedCount;
+}
+
+unsigned int AssetCache::EvictUnreferenced()
+{
+    unsigned int evictedCount = 0;
+    EntryMap::iterator entry = mEntries.begin();
+
+    while (entry != mEntries.end())
+    {
+        EntryMap::iterator next = entry;
+        ++next;
+
+        if (!IsReferenced(entry->second))
+        {
+            Evict(entry);
+            evictedCount++;
+        }
+
+        entry = next;
+    }
+
+    return evictedCount;
+}
+
+void AssetCache::Clear()
+{
+    while (!mEntries.empty())
+    {
+        Evict(mEntries.begin());
+    }
+}
+
+bool AssetCache::IsReferenced(const AssetKey& key) const
+{
+    EntryMap::const_iterator entry = mEntries.find(key);
+    return entry != mEntries.end() && IsReferenced(entry->second);
+}
+
+AssetCacheStats AssetCache::Stats() const
+{
+    AssetCacheStats stats = mStats;
+
+    for (int type = 0; type < static_cast<int>(AssetType::Count); ++type)
+    {
+        stats.residentCount[type] = 0;
+        stats.memory[type].cpuBytes = 0;
+        stats.memory[type].gpuBytes = 0;
+    }
+
+    for (EntryMap::const_iterator entry = mEntries.begin(); entry != mEntries.end(); ++entry)
+    {
+        int type = static_cast<int>(entry->first.type);
+
+        stats.residentCount[type]++;
+        AddMemory(&stats.memory[type], entry->second.memory);
+    }
+
+    stats.totalMemory = mMemory;
+    return stats;
+}
+
+void AssetCache::ResetStats()
+{
+    mStats.hitCount = 0;
+    mStats.missCount = 0;
+    mStats.evictionCount = 0;
+}
+
+void AssetCache::DumpResidentSet(std::ostream& out) const
+{
+    out << "Resident assets (frame " << mpResources->FrameIndex() << ")\n";
+
+    for (std::list<AssetKey>::const_iterator key = mRecentlyUsed.begin(); key != mRecentlyUsed.end(); ++key)
+    {
+        const Entry& entry = mEntries.find(*key)->second;
+        const char * pState = "loaded";
+
+        if (!(key->type == AssetType::Mesh ? entry.mesh.isReady() : entry.effect.isReady()))
+        {
+            pState = "loading";
+        }
+
+        out << "  " << ASSET_TYPE_NAMES[static_cast<int>(key->type)] << " " << NarrowPath(key->path);
+
+        if (key->flags != 0)
+        {
+            out << " (flags " << std::hex << key->flags << std::dec << ")";
+        }
+
+        out << ": " << pState
+            << ", " << (IsReferenced(entry) ? "referenced" : "unreferenced")
+            << ", cpu " << Kilobytes(entry.memory.cpuBytes) << " KB"
+            << ", gpu " << Kilobytes(entry.memory.gpuBytes) << " KB"
+            << ", last used frame " << entry.lastUsedFrame << "\n";
+    }
+
+    AssetCacheStats stats = Stats();
+
+    for (int type = 0; type < static_cast<int>(AssetType::Count); ++type)
+    {
+        out << "  " << stats.residentCount[type] << " " << ASSET_TYPE_NAMES[type] << " assets"
+            << ", cpu " << Kilobytes(stats.memory[type].cpuBytes) << " KB"
+            << ", gpu " << Kilobytes(stats.memory[type].gpuBytes) << " KB\n";
+    }
+
+    out << "  Total cpu " << Kilobytes(mMemory.cpuBytes) << " KB of " << Kilobytes(mBudget.cpuBytes)
+        << " KB budget, gpu " << Kilobytes(mMemory.gpuBytes) << " KB of " << Kilobytes(mBudget.gpuBytes)
+        << " KB budget (0 is unlimited)\n";
+    out << "  " << stats.hitCount << " hits, " << stats.missCount << " misses, "
+        << stats.evictionCount << " evictions\n";
+}
+
+std::wstring AssetCache::CanonicalPath(const std::wstring& path)
+{
+    std::vector<std::wstring> parts;
+    std::wstring part;
+
+    for (size_t i = 0; i <= path.size(); ++i)
+    {
+        wchar_t c = (i < path.size() ? path[i] : L'\\');
+
+        if (c == L'/' || c == L'\\')
+        {
+            if (part == L"..")
+            {
+                // Only collapse a ".." that has a real directory to cancel out.
+                if (!parts.empty() && parts.back() != L"..")
+                {
+                    parts.pop_back();
+                }
+                else
+                {
+                    parts.push_back(part);
+                }
+            }
+            else if (!part.empty() && part != L".")
+            {
+                parts.push_back(part);
+            }
+
+            part.clear();
+        }
+        else
+        {
+            part.push_back(c >= L'A' && c <= L'Z' ? static_cast<wchar_t>(c - L'A' + L'a') : c);
+        }
+    }
+
+    // Keep the root of an absolute path.
+    std::wstring canonical;
+
+    if (!path.empty() && (path[0] == L'/' || path[0] == L'\\'))
+    {
+        canonical.push_back(L'\\');
+    }
+
+    for (size_t i = 0; i < parts.size(); ++i)
+    {
+        if (i > 0)
+        {
+            canonical.push_back(L'\\');
+        }
+
+        canonical += parts[i];
+    }
+
+    return canonical;
+}
+
+bool AssetCache::IsReferenced(const Entry& entry)
+{
+    // The cache's own copy of the future accounts for one use.
+    return entry.mesh.useCount() > 1 || entry.effect.useCount() > 1;
+}
+
+bool AssetCache::IsOverBudget(const AssetMemory& memory, const AssetMemory& budget)
+{
+    return (budget.cpuBytes != 0 && memory.cpuBytes > budget.cpuBytes) ||
+           (budget.gpuBytes != 0 && memory.gpuBytes > budget.gpuBytes);
+}
+
+void AssetCache::Touch(EntryMap::iterator entry)
+{
+    mRecentlyUsed.splice(mRecentlyUsed.begin(), mRecentlyUsed, entry->second.recentPosition);
+    entry->second.lastUsedFrame = mpResources->FrameIndex();
+}
+
+/**
+ * Hand the asset's device objects to the resource registry and forget it. Futures still holding the
+ * asset keep their result, but the objects behind it go away once the retire latency has passed.
+ */
+void AssetCache::Evict(EntryMap::iterator entry)
+{
+    Entry& evicted = entry->second;
+
+    if (evicted.mesh.succeeded())
+    {
+        mpResources->ReleaseMesh(evicted.mesh.get());
+    }
+
+    if (evicted.effect.succeeded())
+    {
+        Microsoft::WRL::ComPtr<ID3D10Effect> effect = evicted.effect.get();
+        mpResources->DeferRelease(effect.Detach());
+    }
+
+    SubtractMemory(&mMemory, evicted.memory);
+    mRecentlyUsed.erase(evicted.recentPosition);
+    mEntries.erase(entry);
+    mStats.evictionCount++;
+}
@@ -0,0 +1,250 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "stdafx.h"
+#include "graphics/BoundingVolume.h"
+
+#include <d3dx10.h>
+#include <xmmintrin.h>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace
+{
+    // Load a position into the x, y and z lanes with w set to zero. Only twelve bytes are read, so
+    // the last position of a tightly packed array can be loaded safely.
+    inline __m128 LoadPosition(const unsigned char * pBytes)
+    {
+        __m128 xy = _mm_loadl_pi(_mm_setzero_ps(), reinterpret_cast<const __m64 *>(pBytes));
+        __m128 z = _mm_load_ss(reinterpret_cast<const float *>(pBytes) + 2);
+        return _mm_movelh_ps(xy, z);
+    }
+
+    inline D3DXVECTOR3 StoreVector(__m128 v)
+    {
+        float lanes[4];
+        _mm_storeu_ps(lanes, v);
+        return D3DXVECTOR3(lanes[0], lanes[1], lanes[2]);
+    }
+
+    // Furthest squared distance from center to any of the points, four points at a time.
+    float MaxDistanceSquared(const unsigned char * pBytes, unsigned int count, unsigned int stride, const D3DXVECTOR3& center)
+    {
+        const __m128 cx = _mm_set1_ps(center.x);
+        const __m128 cy = _mm_set1_ps(center.y);
+        const __m128 cz = _mm_set1_ps(center.z);
+        __m128 furthest = _mm_setzero_ps();
+        unsigned int i = 0;
+
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128 x = LoadPosition(pBytes + static_cast<size_t>(i) * stride);
+            __m128 y = LoadPosition(pBytes + static_cast<size_t>(i + 1) * stride);
+            __m128 z = LoadPosition(pBytes + static_cast<size_t>(i + 2) * stride);
+            __m128 w = LoadPosition(pBytes + static_cast<size_t>(i + 3) * stride);
+
+            // Rows become the x, y and z components of the four points.
+            _MM_TRANSPOSE4_PS(x, y, z, w);
+
+            __m128 dx = _mm_sub_ps(x, cx);
+            __m128 dy = _mm_sub_ps(y, cy);
+            __m128 dz = _mm_sub_ps(z, cz);
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+
+            furthest = _mm_max_ps(furthest, distance);
+        }
+
+        float lanes[4];
+        _mm_storeu_ps(lanes, furthest);
+
+        float result = std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+
+        for (; i < count; ++i)
+        {
+            const D3DXVECTOR3& p = *reinterpret_cast<const D3DXVECTOR3 *>(pBytes + static_cast<size_t>(i) * stride);
+            D3DXVECTOR3 d = p - center;
+
+            result = std::max(result, d.x * d.x + d.y * d.y + d.z * d.z);
+        }
+
+        return result;
+    }
+}
+
+MeshBounds BoundingVolume::Empty()
+{
+    MeshBounds bounds;
+    bounds.minCorner = D3DXVECTOR3(FLT_MAX, FLT_MAX, FLT_MAX);
+    bounds.maxCorner = D3DXVECTOR3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+    bounds.center = D3DXVECTOR3(0.0f, 0.0f, 0.0f);
+    bounds.radius = -1.0f;
+
+    return bounds;
+}
+
+MeshBounds BoundingVolume::FromBox(const D3DXVECTOR3& minCorner, const D3DXVECTOR3& maxCorner)
+{
+    assert(minCorner.x <= maxCorner.x && minCorner.y <= maxCorner.y && minCorner.z <= maxCorner.z);
+
+    D3DXVECTOR3 halfExtent = (maxCorner - minCorner) * 0.5f;
+
+    MeshBounds bounds;
+    bounds.minCorner = minCorner;
+    bounds.maxCorner = maxCorner;
+    bounds.center = minCorner + halfExtent;
+    bounds.radius = D3DXVec3Length(&halfExtent);
+
+    return bounds;
+}
+
+/**
+ * Two passes over the points: a min/max reduction for the box, then the furthest distance from the
+ * box's center. Each pass keeps two independent accumulators (or four points per register) so the
+ * min, max and compare chains don't wait on each other.
+ */
+MeshBounds BoundingVolume::FromPoints(const void * pPositions, unsigned int count, unsigned int stride)
+{
+    if (count == 0)
+    {
+        return Empty();
+    }
+
+    VerifyNotNull(pPositions);
+    assert(stride >= sizeof(D3DXVECTOR3));
+
+    const unsigned char * pBytes = reinterpret_cast<const unsigned char *>(pPositions);
+
+    __m128 min0 = LoadPosition(pBytes);
+    __m128 max0 = min0;
+    __m128 min1 = min0;
+    __m128 max1 = min0;
+    unsigned int i = 1;
+
+    for (; i + 2 <= count; i += 2)
+    {
+        __m128 a = LoadPosition(pBytes + static_cast<size_t>(i) * stride);
+        __m128 b = LoadPosition(pBytes + static_cast<size_t>(i + 1) * stride);
+
+        min0 = _mm_min_ps(min0, a);
+        max0 = _mm_max_ps(max0, a);
+        min1 = _mm_min_ps(min1, b);
+        max1 = _mm_max_ps(max1, b);
+    }
+
+    if (i < count)
+    {
+        __m128 a = LoadPosition(pBytes + static_cast<size_t>(i) * stride);
+
+        min0 = _mm_min_ps(min0, a);
+        max0 = _mm_max_ps(max0, a);
+    }
+
+    MeshBounds bounds = FromBox(StoreVector(_mm_min_ps(min0, min1)), StoreVector(_mm_max_ps(max0, max1)));
+    bounds.radius = std::min(bounds.radius, std::sqrt(MaxDistanceSquared(pBytes, count, stride, bounds.center)));
+
+    return bounds;
+}
+
+MeshBounds BoundingVolume::Merge(const MeshBounds& a, const MeshBounds& b)
+{
+    if (a.IsEmpty())
+    {
+        return b;
+    }
+    else if (b.IsEmpty())
+    {
+        return a;
+    }
+
+    MeshBounds bounds;
+    bounds.minCorner = D3DXVECTOR3(
+        std::min(a.minCorner.x, b.minCorner.x),
+        std::min(a.minCorner.y, b.minCorner.y),
+        std::min(a.minCorner.z, b.minCorner.z));
+    bounds.maxCorner = D3DXVECTOR3(
+        std::max(a.maxCorner.x, b.maxCorner.x),
+        std::max(a.maxCorner.y, b.maxCorner.y),
+        std::max(a.maxCorner.z, b.maxCorner.z));
+
+    // Either sphere may already contain the other, otherwise the merged sphere spans both along the
+    // line between their centers.
+    D3DXVECTOR3 offset = b.center - a.center;
+    float distance = D3DXVec3Length(&offset);
+
+    if (distance + b.radius <= a.radius)
+    {
+        bounds.center = a.center;
+        bounds.radius = a.radius;
+    }
+    else if (distance + a.radius <= b.radius)
+    {
+        bounds.center = b.center;
+        bounds.radius = b.radius;
+    }
+    else
+    {
+        bounds.radius = 0.5f * (distance + a.radius + b.radius);
+        bounds.center = a.center + offset * ((bounds.radius - a.radius) / distance);
+    }
+
+    return bounds;
+}
+
+/**
+ * Arvo's method: each transformed box axis adds its smaller and larger end to the new corners.
+ * Points are transformed as row vectors (v * M).
+ */
+MeshBounds BoundingVolume::Transform(const MeshBounds& bounds, const D3DXMATRIX& m)
+{
+    if (bounds.IsEmpty())
+    {
+        return bounds;
+    }
+
+    const float sourceMin[3] = { bounds.minCorner.x, bounds.minCorner.y, bounds.minCorner.z };
+    const float sourceMax[3] = { bounds.maxCorner.x, bounds.maxCorner.y, bounds.maxCorner.z };
+    float newMin[3] = { m.m[3][0], m.m[3][1], m.m[3][2] };
+    float newMax[3] = { m.m[3][0], m.m[3][1], m.m[3][2] };
+    float largestScaleSquared = 0.0f;
+
+    for (unsigned int row = 0; row < 3; ++row)
+    {
+        for (unsigned int col = 0; col < 3; ++col)
+        {
+            float a = m.m[row][col] * sourceMin[row];
+            float b = m.m[row][col] * sourceMax[row];
+
+            newMin[col] += std::min(a, b);
+            newMax[col] += std::max(a, b);
+        }
+
+        float scaleSquared = m.m[row][0] * m.m[row][0] + m.m[row][1] * m.m[row][1] + m.m[row][2] * m.m[row][2];
+        largestScaleSquared = std::max(largestScaleSquared, scaleSquared);
+    }
+
+    const D3DXVECTOR3& c = bounds.center;
+
+    MeshBounds result;
+    result.minCorner = D3DXVECTOR3(newMin[0], newMin[1], newMin[2]);
+    result.maxCorner = D3DXVECTOR3(newMax[0], newMax[1], newMax[2]);
+    result.center = D3DXVECTOR3(
+        c.x * m.m[0][0] + c.y * m.m[1][0] + c.z * m.m[2][0] + m.m[3][0],
+        c.x * m.m[0][1] + c.y * m.m[1][1] + c.z * m.m[2][1] + m.m[3][1],
+        c.x * m.m[0][2] + c.y * m.m[1][2] + c.z * m.m[2][2] + m.m[3][2]);
+    result.radius = bounds.radius * std::sqrt(largestScaleSquared);
+
+    return result;
+}
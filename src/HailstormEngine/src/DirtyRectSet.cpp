@@ -0,0 +1,76 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "stdafx.h"
+#include "terrain/DirtyRectSet.h"
+
+DirtyRectSet::DirtyRectSet()
+    : mRects()
+{
+}
+
+/**
+ * Merges the new rectangle with every dirty rectangle it touches. A merge can grow the rectangle into
+ * others it didn't touch before, so keep going until nothing else touches it.
+ */
+void DirtyRectSet::Add(const GridRect& rect)
+{
+    if (rect.IsEmpty())
+    {
+        return;
+    }
+
+    GridRect merged = rect;
+    bool mergedAny = true;
+
+    while (mergedAny)
+    {
+        mergedAny = false;
+
+        for (size_t i = 0; i < mRects.size(); )
+        {
+            if (merged.Touches(mRects[i]))
+            {
+                merged = merged.Union(mRects[i]);
+                mRects[i] = mRects.back();
+                mRects.pop_back();
+                mergedAny = true;
+            }
+            else
+            {
+                ++i;
+            }
+        }
+    }
+
+    mRects.push_back(merged);
+}
+
+void DirtyRectSet::Clear()
+{
+    mRects.clear();
+}
+
+unsigned int DirtyRectSet::Area() const
+{
+    unsigned int area = 0;
+
+    for (size_t i = 0; i < mRects.size(); ++i)
+    {
+        area += mRects[i].Area();
+    }
+
+    return area;
+}
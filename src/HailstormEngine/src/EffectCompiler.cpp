@@ -0,0 +1,122 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "stdafx.h"
+#include "graphics/EffectCompiler.h"
+
+#include <d3d10.h>
+#include <d3dx10.h>
+
+#include "runtime/StringUtils.h"
+
+EffectInclude::EffectInclude(const VirtualFileSystem * pFileSystem, const std::wstring& effectPath)
+    : mpFileSystem(pFileSystem),
+      mDirectory(VirtualFileSystem::MakePath(effectPath).name),
+      mOpenFiles()
+{
+    VerifyNotNull(pFileSystem);
+
+    size_t lastSlash = mDirectory.find_last_of('/');
+    mDirectory.erase(lastSlash == std::string::npos ? 0 : lastSlash + 1);
+}
+
+EffectInclude::~EffectInclude()
+{
+}
+
+HRESULT EffectInclude::Open(
+    D3D10_INCLUDE_TYPE includeType,
+    LPCSTR pFileName,
+    LPCVOID pParentData,
+    LPCVOID * ppData,
+    UINT * pBytes)
+{
+    mOpenFiles.push_back(VirtualFile());
+
+    if (!mpFileSystem->Open(mDirectory + pFileName, &mOpenFiles.back()))
+    {
+        mOpenFiles.pop_back();
+        return D3D10_ERROR_FILE_NOT_FOUND;
+    }
+
+    *ppData = mOpenFiles.back().Data().pData;
+    *pBytes = static_cast<UINT>(mOpenFiles.back().Size());
+
+    return S_OK;
+}
+
+HRESULT EffectInclude::Close(LPCVOID pData)
+{
+    for (auto itr = mOpenFiles.begin(); itr != mOpenFiles.end(); ++itr)
+    {
+        if (itr->Data().pData == pData)
+        {
+            mOpenFiles.erase(itr);
+            break;
+        }
+    }
+
+    return S_OK;
+}
+
+DWORD EffectCompiler::DefaultFlags()
+{
+    DWORD shaderFlags = D3D10_SHADER_ENABLE_STRICTNESS;
+
+#if defined( DEBUG ) || defined( _DEBUG )
+    shaderFlags |= D3D10_SHADER_DEBUG;
+    shaderFlags |= D3D10_SHADER_SKIP_OPTIMIZATION;
+#endif
+
+    return shaderFlags;
+}
+
+HRESULT EffectCompiler::CompileFile(
+    const VirtualFileSystem& fileSystem,
+    const std::wstring& path,
+    DWORD shaderFlags,
+    ID3D10Blob ** ppCompiledOut,
+    ID3D10Blob ** ppErrorsOut)
+{
+    VerifyNotNull(ppCompiledOut);
+    VerifyNotNull(ppErrorsOut);
+
+    *ppCompiledOut = nullptr;
+    *ppErrorsOut = nullptr;
+
+    VirtualFile file;
+
+    if (!fileSystem.Open(path, &file))
+    {
+        return D3D10_ERROR_FILE_NOT_FOUND;
+    }
+
+    EffectInclude includes(&fileSystem, path);
+
+    return D3DX10CompileFromMemory(
+        reinterpret_cast<const char *>(file.Data().pData),
+        file.Size(),
+        Utils::ConvertWideStringToUtf8(path).c_str(),   // Name used in error messages.
+        nullptr,                                        // Pointer to an array of shader macros.
+        &includes,
+        nullptr,                                        // Effects have no entry point.
+        "fx_4_0",
+        shaderFlags,
+        0,
+        nullptr,                                        // No thread pump.
+        ppCompiledOut,
+        ppErrorsOut,
+        nullptr);
+}
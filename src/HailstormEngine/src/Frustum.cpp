@@ -0,0 +1,275 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "stdafx.h"
+#include "graphics/Frustum.h"
+
+#include <d3dx10.h>
+#include <xmmintrin.h>
+#include <algorithm>
+#include <cmath>
+
+BoundingBoxSet::BoundingBoxSet()
+    : mCount(0),
+      mMinX(), mMinY(), mMinZ(),
+      mMaxX(), mMaxY(), mMaxZ()
+{
+    Resize(0);
+}
+
+void BoundingBoxSet::Resize(unsigned int count)
+{
+    // Always keep at least one group of four so the component accessors are valid.
+    size_t paddedCount = (count + 3) & ~3u;
+    paddedCount = (paddedCount == 0 ? 4 : paddedCount);
+
+    mCount = count;
+    mMinX.resize(paddedCount, 0.0f);
+    mMinY.resize(paddedCount, 0.0f);
+    mMinZ.resize(paddedCount, 0.0f);
+    mMaxX.resize(paddedCount, 0.0f);
+    mMaxY.resize(paddedCount, 0.0f);
+    mMaxZ.resize(paddedCount, 0.0f);
+}
+
+void BoundingBoxSet::Set(unsigned int index, const D3DXVECTOR3& minCorner, const D3DXVECTOR3& maxCorner)
+{
+    assert(index < mCount);
+
+    mMinX[index] = minCorner.x;
+    mMinY[index] = minCorner.y;
+    mMinZ[index] = minCorner.z;
+    mMaxX[index] = maxCorner.x;
+    mMaxY[index] = maxCorner.y;
+    mMaxZ[index] = maxCorner.z;
+}
+
+D3DXVECTOR3 BoundingBoxSet::Min(unsigned int index) const
+{
+    assert(index < mCount);
+    return D3DXVECTOR3(mMinX[index], mMinY[index], mMinZ[index]);
+}
+
+D3DXVECTOR3 BoundingBoxSet::Max(unsigned int index) const
+{
+    assert(index < mCount);
+    return D3DXVECTOR3(mMaxX[index], mMaxY[index], mMaxZ[index]);
+}
+
+/**
+ * Reduces each component array four boxes at a time. The padding boxes at the end are all zero, so
+ * the last partial group is folded in one box at a time instead.
+ */
+bool BoundingBoxSet::Extent(D3DXVECTOR3 * pMinCornerOut, D3DXVECTOR3 * pMaxCornerOut) const
+{
+    VerifyNotNull(pMinCornerOut);
+    VerifyNotNull(pMaxCornerOut);
+
+    if (mCount == 0)
+    {
+        return false;
+    }
+
+    const float * pComponents[6] = { MinX(), MinY(), MinZ(), MaxX(), MaxY(), MaxZ() };
+    float extent[6];
+    unsigned int fullCount = mCount & ~3u;
+
+    for (unsigned int component = 0; component < 6; ++component)
+    {
+        const float * pValues = pComponents[component];
+        bool isMin = component < 3;
+        float result = pValues[0];
+
+        if (fullCount > 0)
+        {
+            __m128 reduced = _mm_loadu_ps(pValues);
+
+            for (unsigned int first = 4; first < fullCount; first += 4)
+            {
+                __m128 values = _mm_loadu_ps(pValues + first);
+                reduced = isMin ? _mm_min_ps(reduced, values) : _mm_max_ps(reduced, values);
+            }
+
+            float lanes[4];
+            _mm_storeu_ps(lanes, reduced);
+
+            for (unsigned int lane = 0; lane < 4; ++lane)
+            {
+                result = isMin ? std::min(result, lanes[lane]) : std::max(result, lanes[lane]);
+            }
+        }
+
+        for (unsigned int i = fullCount; i < mCount; ++i)
+        {
+            result = isMin ? std::min(result, pValues[i]) : std::max(result, pValues[i]);
+        }
+
+        extent[component] = result;
+    }
+
+    *pMinCornerOut = D3DXVECTOR3(extent[0], extent[1], extent[2]);
+    *pMaxCornerOut = D3DXVECTOR3(extent[3], extent[4], extent[5]);
+
+    return true;
+}
+
+Frustum::Frustum()
+{
+    for (unsigned int i = 0; i < PlaneCount; ++i)
+    {
+        mPlanes[i] = D3DXPLANE(0.0f, 0.0f, 0.0f, 0.0f);
+    }
+}
+
+Frustum::Frustum(const D3DXMATRIX& viewProjection)
+{
+    Set(viewProjection);
+}
+
+/**
+ * Extracts the planes using the Gribb-Hartmann method. Points are transformed as row vectors
+ * (v * M), and clip space z runs from 0 to w as it does in Direct3D.
+ */
+void Frustum::Set(const D3DXMATRIX& m)
+{
+    mPlanes[0] = D3DXPLANE(m._14 + m._11, m._24 + m._21, m._34 + m._31, m._44 + m._41);   // Left
+    mPlanes[1] = D3DXPLANE(m._14 - m._11, m._24 - m._21, m._34 - m._31, m._44 - m._41);   // Right
+    mPlanes[2] = D3DXPLANE(m._14 + m._12, m._24 + m._22, m._34 + m._32, m._44 + m._42);   // Bottom
+    mPlanes[3] = D3DXPLANE(m._14 - m._12, m._24 - m._22, m._34 - m._32, m._44 - m._42);   // Top
+    mPlanes[4] = D3DXPLANE(m._13, m._23, m._33, m._43);                                   // Near
+    mPlanes[5] = D3DXPLANE(m._14 - m._13, m._24 - m._23, m._34 - m._33, m._44 - m._43);   // Far
+
+    for (unsigned int i = 0; i < PlaneCount; ++i)
+    {
+        D3DXPLANE& plane = mPlanes[i];
+        float length = std::sqrt(plane.a * plane.a + plane.b * plane.b + plane.c * plane.c);
+
+        if (length > 0.0f)
+        {
+            plane.a /= length;
+            plane.b /= length;
+            plane.c /= length;
+            plane.d /= length;
+        }
+    }
+}
+
+/**
+ * A box is outside of the frustum if its corner furthest along a plane's normal (the "positive
+ * vertex") is behind that plane.
+ */
+bool Frustum::IntersectsBox(const D3DXVECTOR3& minCorner, const D3DXVECTOR3& maxCorner) const
+{
+    for (unsigned int i = 0; i < PlaneCount; ++i)
+    {
+        const D3DXPLANE& plane = mPlanes[i];
+
+        float x = plane.a >= 0.0f ? maxCorner.x : minCorner.x;
+        float y = plane.b >= 0.0f ? maxCorner.y : minCorner.y;
+        float z = plane.c >= 0.0f ? maxCorner.z : minCorner.z;
+
+        if (plane.a * x + plane.b * y + plane.c * z + plane.d < 0.0f)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool Frustum::IntersectsSphere(const D3DXVECTOR3& center, float radius) const
+{
+    for (unsigned int i = 0; i < PlaneCount; ++i)
+    {
+        const D3DXPLANE& plane = mPlanes[i];
+
+        if (plane.a * center.x + plane.b * center.y + plane.c * center.z + plane.d < -radius)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * The sphere test is the cheaper of the two and rejects most meshes that are well outside, so it goes
+ * first. The box catches meshes that are long and thin, where the sphere is a poor fit.
+ */
+bool Frustum::Intersects(const MeshBounds& bounds) const
+{
+    return !bounds.IsEmpty() &&
+        IntersectsSphere(bounds.center, bounds.radius) &&
+        IntersectsBox(bounds.minCorner, bounds.maxCorner);
+}
+
+/**
+ * Same test as IntersectsBox. The positive vertex only depends on the plane, so for each plane the
+ * min or max component array is picked once and four boxes are tested per iteration.
+ */
+unsigned int Frustum::CullBoxes(const BoundingBoxSet& boxes, unsigned char * pVisibleOut) const
+{
+    VerifyNotNull(pVisibleOut);
+
+    const float * pX[PlaneCount];
+    const float * pY[PlaneCount];
+    const float * pZ[PlaneCount];
+    __m128 a[PlaneCount], b[PlaneCount], c[PlaneCount], d[PlaneCount];
+
+    for (unsigned int i = 0; i < PlaneCount; ++i)
+    {
+        const D3DXPLANE& plane = mPlanes[i];
+
+        pX[i] = plane.a >= 0.0f ? boxes.MaxX() : boxes.MinX();
+        pY[i] = plane.b >= 0.0f ? boxes.MaxY() : boxes.MinY();
+        pZ[i] = plane.c >= 0.0f ? boxes.MaxZ() : boxes.MinZ();
+
+        a[i] = _mm_set1_ps(plane.a);
+        b[i] = _mm_set1_ps(plane.b);
+        c[i] = _mm_set1_ps(plane.c);
+        d[i] = _mm_set1_ps(plane.d);
+    }
+
+    const __m128 zero = _mm_setzero_ps();
+    const unsigned int count = boxes.Count();
+    unsigned int visibleCount = 0;
+
+    for (unsigned int first = 0; first < count; first += 4)
+    {
+        __m128 outside = _mm_setzero_ps();
+
+        for (unsigned int i = 0; i < PlaneCount; ++i)
+        {
+            __m128 distance = _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(a[i], _mm_loadu_ps(pX[i] + first)), _mm_mul_ps(b[i], _mm_loadu_ps(pY[i] + first))),
+                _mm_add_ps(_mm_mul_ps(c[i], _mm_loadu_ps(pZ[i] + first)), d[i]));
+
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(distance, zero));
+        }
+
+        int outsideMask = _mm_movemask_ps(outside);
+        unsigned int laneCount = (count - first < 4 ? count - first : 4);
+
+        for (unsigned int lane = 0; lane < laneCount; ++lane)
+        {
+            unsigned char visible = ((outsideMask >> lane) & 1) == 0 ? 1 : 0;
+
+            pVisibleOut[first + lane] = visible;
+            visibleCount += visible;
+        }
+    }
+
+    return visibleCount;
+}
@@ -0,0 +1,322 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "stdafx.h"
+#include "graphics/GeometryPool.h"
+#include "graphics/DirectXExceptions.h"
+
+#include <d3d10.h>
+#include <vector>
+
+#include "runtime/logging.h"
+
+const GeometryPool::Handle GeometryPool::INVALID_HANDLE;
+
+namespace
+{
+    // Indices are 32 bit. A UINT, so byte offsets fit straight into a D3D10_BOX.
+    const UINT INDEX_SIZE = sizeof(unsigned int);
+}
+
+GeometryPool::GeometryPool(
+    ID3D10Device * pDevice,
+    unsigned int vertexStride,
+    unsigned int vertexCapacity,
+    unsigned int indexCapacity)
+    : mVertexStride(vertexStride),
+      mVertexAllocator(vertexCapacity),
+      mIndexAllocator(indexCapacity),
+      mVertexBuffer(),
+      mIndexBuffer(),
+      mEntries(),
+      mFreeHandles(),
+      mBound(false)
+{
+    AssertNotNull(pDevice);
+    Verify(vertexStride > 0);
+
+    ResetStats();
+    CreateBuffers(pDevice, &mVertexBuffer, &mIndexBuffer);
+}
+
+GeometryPool::~GeometryPool()
+{
+}
+
+GeometryPool::Handle GeometryPool::Upload(
+    ID3D10Device * pDevice,
+    const void * pVertices,
+    unsigned int vertexCount,
+    const unsigned int * pIndices,
+    unsigned int indexCount)
+{
+    AssertNotNull(pDevice);
+    AssertNotNull(pVertices);
+    AssertNotNull(pIndices);
+    Verify(vertexCount > 0 && indexCount > 0);
+
+    Entry entry;
+
+    if (!TryAllocate(vertexCount, indexCount, &entry))
+    {
+        // There may be enough space in total, just not in one piece.
+        if (mVertexAllocator.FreeSpace() < vertexCount || mIndexAllocator.FreeSpace() < indexCount)
+        {
+            return INVALID_HANDLE;
+        }
+
+        Defragment(pDevice);
+
+        if (!TryAllocate(vertexCount, indexCount, &entry))
+        {
+            return INVALID_HANDLE;
+        }
+    }
+
+    D3D10_BOX vertexBox = { entry.range.baseVertex * mVertexStride, 0, 0, (entry.range.baseVertex + vertexCount) * mVertexStride, 1, 1 };
+    D3D10_BOX indexBox = { entry.range.firstIndex * INDEX_SIZE, 0, 0, (entry.range.firstIndex + indexCount) * INDEX_SIZE, 1, 1 };
+
+    pDevice->UpdateSubresource(mVertexBuffer.Get(), 0, &vertexBox, pVertices, 0, 0);
+    pDevice->UpdateSubresource(mIndexBuffer.Get(), 0, &indexBox, pIndices, 0, 0);
+
+    Handle handle = static_cast<Handle>(mEntries.size());
+
+    if (!mFreeHandles.empty())
+    {
+        handle = mFreeHandles.back();
+        mFreeHandles.pop_back();
+        mEntries[handle] = entry;
+    }
+    else
+    {
+        mEntries.push_back(entry);
+    }
+
+    return handle;
+}
+
+void GeometryPool::Free(Handle handle)
+{
+    Verify(handle < mEntries.size() && mEntries[handle].indexNode != OffsetAllocator::NO_NODE);
+
+    Entry& entry = mEntries[handle];
+
+    mVertexAllocator.Free(entry.vertexNode);
+    mIndexAllocator.Free(entry.indexNode);
+
+    entry.vertexNode = OffsetAllocator::NO_NODE;
+    entry.indexNode = OffsetAllocator::NO_NODE;
+    mFreeHandles.push_back(handle);
+}
+
+const GeometryRange& GeometryPool::Range(Handle handle) const
+{
+    assert(handle < mEntries.size() && mEntries[handle].indexNode != OffsetAllocator::NO_NODE);
+    return mEntries[handle].range;
+}
+
+void GeometryPool::Bind(ID3D10Device * pDevice)
+{
+    if (!mBound)
+    {
+        ID3D10Buffer * pVertexBuffer = mVertexBuffer.Get();
+        unsigned int offset = 0;
+
+        pDevice->IASetVertexBuffers(0, 1, &pVertexBuffer, &mVertexStride, &offset);
+        pDevice->IASetIndexBuffer(mIndexBuffer.Get(), DXGI_FORMAT_R32_UINT, 0);
+
+        mStats.bindCount += 2;
+        mBound = true;
+    }
+}
+
+void GeometryPool::Draw(ID3D10Device * pDevice, Handle handle)
+{
+    IndexRange indices = { 0, Range(handle).indexCount };
+    Draw(pDevice, handle, indices);
+}
+
+void GeometryPool::Draw(ID3D10Device * pDevice, Handle handle, const IndexRange& indices)
+{
+    AssertNotNull(pDevice);
+
+    const GeometryRange& range = Range(handle);
+    assert(indices.firstIndex + indices.indexCount <= range.indexCount);
+
+    Bind(pDevice);
+    pDevice->DrawIndexed(indices.indexCount, range.firstIndex + indices.firstIndex, static_cast<int>(range.baseVertex));
+
+    ++mStats.drawCount;
+    mStats.unpooledBindCount += 2;
+}
+
+void GeometryPool::DrawInstanced(
+    ID3D10Device * pDevice,
+    Handle handle,
+    ID3D10Buffer * pInstanceBuffer,
+    unsigned int instanceStride,
+    unsigned int instanceCount,
+    unsigned int firstInstance)
+{
+    IndexRange indices = { 0, Range(handle).indexCount };
+    DrawInstanced(pDevice, handle, indices, pInstanceBuffer, instanceStride, instanceCount, firstInstance);
+}
+
+void GeometryPool::DrawInstanced(
+    ID3D10Device * pDevice,
+    Handle handle,
+    const IndexRange& indices,
+    ID3D10Buffer * pInstanceBuffer,
+    unsigned int instanceStride,
+    unsigned int instanceCount,
+    unsigned int firstInstance)
+{
+    AssertNotNull(pDevice);
+    AssertNotNull(pInstanceBuffer);
+
+    const GeometryRange& range = Range(handle);
+    unsigned int offset = 0;
+
+    assert(indices.firstIndex + indices.indexCount <= range.indexCount);
+
+    // Slot one does not disturb the pool's own binding in slot zero.
+    Bind(pDevice);
+    pDevice->IASetVertexBuffers(1, 1, &pInstanceBuffer, &instanceStride, &offset);
+    pDevice->DrawIndexedInstanced(
+        indices.indexCount,
+        instanceCount,
+        range.firstIndex + indices.firstIndex,
+        static_cast<int>(range.baseVertex),
+        firstInstance);
+
+    ++mStats.drawCount;
+    ++mStats.bindCount;
+    mStats.unpooledBindCount += 2;
+}
+
+/**
+ * Packs both allocators and copies every mesh to its new place in a fresh pair of buffers. The GPU
+ * cannot copy between overlapping ranges of one buffer, so the copy goes through new buffers even
+ * though the allocator's moves could be applied in place.
+ */
+void GeometryPool::Defragment(ID3D10Device * pDevice)
+{
+    AssertNotNull(pDevice);
+
+    std::vector<OffsetAllocator::Move> moves;
+    unsigned int freeVerticesBefore = mVertexAllocator.LargestFreeRange();
+    unsigned int freeIndicesBefore = mIndexAllocator.LargestFreeRange();
+
+    mVertexAllocator.Defragment(&moves);
+    mIndexAllocator.Defragment(&moves);
+
+    Microsoft::WRL::ComPtr<ID3D10Buffer> vertexBuffer, indexBuffer;
+    CreateBuffers(pDevice, &vertexBuffer, &indexBuffer);
+
+    for (size_t i = 0; i < mEntries.size(); ++i)
+    {
+        Entry& entry = mEntries[i];
+
+        if (entry.indexNode == OffsetAllocator::NO_NODE)
+        {
+            continue;
+        }
+
+        GeometryRange& range = entry.range;
+        unsigned int baseVertex = mVertexAllocator.Offset(entry.vertexNode);
+        unsigned int firstIndex = mIndexAllocator.Offset(entry.indexNode);
+
+        D3D10_BOX vertexBox = { range.baseVertex * mVertexStride, 0, 0, (range.baseVertex + range.vertexCount) * mVertexStride, 1, 1 };
+        D3D10_BOX indexBox = { range.firstIndex * INDEX_SIZE, 0, 0, (range.firstIndex + range.indexCount) * INDEX_SIZE, 1, 1 };
+
+        pDevice->CopySubresourceRegion(vertexBuffer.Get(), 0, baseVertex * mVertexStride, 0, 0, mVertexBuffer.Get(), 0, &vertexBox);
+        pDevice->CopySubresourceRegion(indexBuffer.Get(), 0, firstIndex * INDEX_SIZE, 0, 0, mIndexBuffer.Get(), 0, &indexBox);
+
+        range.baseVertex = baseVertex;
+        range.firstIndex = firstIndex;
+    }
+
+    mVertexBuffer.Swap(vertexBuffer);
+    mIndexBuffer.Swap(indexBuffer);
+    mBound = false;
+
+    LOG_INFO("GeometryPool") << "Defragmented " << MeshCount() << " meshes, largest free range "
+        << freeVerticesBefore << " -> " << mVertexAllocator.LargestFreeRange() << " vertices, "
+        << freeIndicesBefore << " -> " << mIndexAllocator.LargestFreeRange() << " indices";
+}
+
+void GeometryPool::ResetStats()
+{
+    GeometryPoolStats noStats = { 0 };
+    mStats = noStats;
+}
+
+void GeometryPool::CreateBuffers(
+    ID3D10Device * pDevice,
+    ID3D10Buffer ** ppVertexBufferOut,
+    ID3D10Buffer ** ppIndexBufferOut) const
+{
+    D3D10_BUFFER_DESC vertexDesc;
+    ZeroMemory(&vertexDesc, sizeof(vertexDesc));
+
+    vertexDesc.Usage = D3D10_USAGE_DEFAULT;
+    vertexDesc.ByteWidth = mVertexStride * mVertexAllocator.Capacity();
+    vertexDesc.BindFlags = D3D10_BIND_VERTEX_BUFFER;
+
+    D3D10_BUFFER_DESC indexDesc;
+    ZeroMemory(&indexDesc, sizeof(indexDesc));
+
+    indexDesc.Usage = D3D10_USAGE_DEFAULT;
+    indexDesc.ByteWidth = INDEX_SIZE * mIndexAllocator.Capacity();
+    indexDesc.BindFlags = D3D10_BIND_INDEX_BUFFER;
+
+    HRESULT hr = pDevice->CreateBuffer(&vertexDesc, nullptr, ppVertexBufferOut);
+
+    if (SUCCEEDED(hr))
+    {
+        hr = pDevice->CreateBuffer(&indexDesc, nullptr, ppIndexBufferOut);
+    }
+
+    if (FAILED(hr))
+    {
+        throw new DirectXException(hr, L"Creating geometry pool buffers", L"", __FILE__, __LINE__);
+    }
+}
+
+bool GeometryPool::TryAllocate(unsigned int vertexCount, unsigned int indexCount, Entry * pEntryOut)
+{
+    OffsetAllocator::Allocation vertices = mVertexAllocator.Allocate(vertexCount);
+
+    if (!vertices.IsValid())
+    {
+        return false;
+    }
+
+    OffsetAllocator::Allocation indices = mIndexAllocator.Allocate(indexCount);
+
+    if (!indices.IsValid())
+    {
+        mVertexAllocator.Free(vertices.node);
+        return false;
+    }
+
+    pEntryOut->range.baseVertex = vertices.offset;
+    pEntryOut->range.vertexCount = vertexCount;
+    pEntryOut->range.firstIndex = indices.offset;
+    pEntryOut->range.indexCount = indexCount;
+    pEntryOut->vertexNode = vertices.node;
+    pEntryOut->indexNode = indices.node;
+    return true;
+}
@@ -0,0 +1,266 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "stdafx.h"
+#include "terrain/GridPatches.h"
+#include "terrain/HeightField.h"
+
+#include <d3dx10.h>
+#include <algorithm>
+
+GridPatches::GridPatches()
+    : mRows(0),
+      mCols(0),
+      mPatchCells(1),
+      mPatchRows(0),
+      mPatchCols(0),
+      mFirstIndex(),
+      mBounds(),
+      mVisible()
+{
+}
+
+GridPatches::GridPatches(unsigned int rows, unsigned int cols, unsigned int patchCells)
+    : mRows(rows),
+      mCols(cols),
+      mPatchCells(patchCells),
+      mPatchRows(0),
+      mPatchCols(0),
+      mFirstIndex(),
+      mBounds(),
+      mVisible()
+{
+    Verify(rows >= 2 && cols >= 2);
+    Verify(patchCells > 0);
+
+    // Patches along the far edges are smaller when the cell count is not a multiple of the patch size.
+    mPatchRows = (rows - 1 + patchCells - 1) / patchCells;
+    mPatchCols = (cols - 1 + patchCells - 1) / patchCells;
+
+    mFirstIndex.resize(PatchCount() + 1);
+    mFirstIndex[0] = 0;
+
+    for (unsigned int pr = 0; pr < mPatchRows; ++pr)
+    {
+        for (unsigned int pc = 0; pc < mPatchCols; ++pc)
+        {
+            unsigned int cellRows = std::min(patchCells, rows - 1 - pr * patchCells);
+            unsigned int cellCols = std::min(patchCells, cols - 1 - pc * patchCells);
+            unsigned int patch = pr * mPatchCols + pc;
+
+            mFirstIndex[patch + 1] = mFirstIndex[patch] + cellRows * cellCols * 6;
+        }
+    }
+
+    mBounds.Resize(PatchCount());
+    mVisible.resize(PatchCount());
+}
+
+IndexRange GridPatches::PatchIndices(unsigned int patch) const
+{
+    assert(patch < PatchCount());
+
+    IndexRange range = { mFirstIndex[patch], mFirstIndex[patch + 1] - mFirstIndex[patch] };
+    return range;
+}
+
+void GridPatches::GetPatchRanges(std::vector<IndexRange> * pRangesOut) const
+{
+    VerifyNotNull(pRangesOut);
+    pRangesOut->resize(PatchCount());
+
+    for (unsigned int patch = 0; patch < PatchCount(); ++patch)
+    {
+        (*pRangesOut)[patch] = PatchIndices(patch);
+    }
+}
+
+void GridPatches::BuildIndices(std::vector<unsigned int> * pIndicesOut) const
+{
+    VerifyNotNull(pIndicesOut);
+
+    std::vector<unsigned int>& indices = *pIndicesOut;
+    indices.resize(IndexCount());
+
+    unsigned int k = 0;
+
+    for (unsigned int pr = 0; pr < mPatchRows; ++pr)
+    {
+        for (unsigned int pc = 0; pc < mPatchCols; ++pc)
+        {
+            unsigned int rowEnd = std::min((pr + 1) * mPatchCells, mRows - 1);
+            unsigned int colEnd = std::min((pc + 1) * mPatchCells, mCols - 1);
+
+            for (unsigned int i = pr * mPatchCells; i < rowEnd; ++i)
+            {
+                for (unsigned int j = pc * mPatchCells; j < colEnd; ++j)
+                {
+                    indices[k]     = i * mCols + j;
+                    indices[k + 1] = i * mCols + j + 1;
+                    indices[k + 2] = (i + 1) * mCols + j;
+
+                    indices[k + 3] = (i + 1) * mCols + j;
+                    indices[k + 4] = i * mCols + j + 1;
+                    indices[k + 5] = (i + 1) * mCols + j + 1;
+
+                    k += 6;
+                }
+            }
+        }
+    }
+}
+
+void GridPatches::UpdateBounds(const void * pPositions, unsigned int stride)
+{
+    VerifyNotNull(pPositions);
+
+    const unsigned char * pBytes = reinterpret_cast<const unsigned char *>(pPositions);
+
+    for (unsigned int pr = 0; pr < mPatchRows; ++pr)
+    {
+        for (unsigned int pc = 0; pc < mPatchCols; ++pc)
+        {
+            // Patches share their border vertices with their neighbors.
+            unsigned int rowEnd = std::min((pr + 1) * mPatchCells, mRows - 1);
+            unsigned int colEnd = std::min((pc + 1) * mPatchCells, mCols - 1);
+
+            D3DXVECTOR3 minCorner = *reinterpret_cast<const D3DXVECTOR3 *>(
+                pBytes + static_cast<size_t>(pr * mPatchCells * mCols + pc * mPatchCells) * stride);
+            D3DXVECTOR3 maxCorner = minCorner;
+
+            for (unsigned int i = pr * mPatchCells; i <= rowEnd; ++i)
+            {
+                for (unsigned int j = pc * mPatchCells; j <= colEnd; ++j)
+                {
+                    const D3DXVECTOR3& p = *reinterpret_cast<const D3DXVECTOR3 *>(
+                        pBytes + static_cast<size_t>(i * mCols + j) * stride);
+
+                    minCorner.x = std::min(minCorner.x, p.x);
+                    minCorner.y = std::min(minCorner.y, p.y);
+                    minCorner.z = std::min(minCorner.z, p.z);
+                    maxCorner.x = std::max(maxCorner.x, p.x);
+                    maxCorner.y = std::max(maxCorner.y, p.y);
+                    maxCorner.z = std::max(maxCorner.z, p.z);
+                }
+            }
+
+            mBounds.Set(pr * mPatchCols + pc, minCorner, maxCorner);
+        }
+    }
+}
+
+void GridPatches::UpdateBounds(const HeightField& field)
+{
+    Verify(field.Rows() == mRows && field.Cols() == mCols);
+
+    for (unsigned int pr = 0; pr < mPatchRows; ++pr)
+    {
+        for (unsigned int pc = 0; pc < mPatchCols; ++pc)
+        {
+            UpdatePatchBounds(field, pr, pc);
+        }
+    }
+}
+
+void GridPatches::UpdateBounds(const HeightField& field, const GridRect& points)
+{
+    Verify(field.Rows() == mRows && field.Cols() == mCols);
+
+    if (points.IsEmpty() || PatchCount() == 0)
+    {
+        return;
+    }
+
+    // Points on a patch border belong to the patches on both sides of it.
+    unsigned int firstRow = points.rowBegin > 0 ? (points.rowBegin - 1) / mPatchCells : 0;
+    unsigned int firstCol = points.colBegin > 0 ? (points.colBegin - 1) / mPatchCells : 0;
+    unsigned int lastRow = std::min((points.rowEnd - 1) / mPatchCells, mPatchRows - 1);
+    unsigned int lastCol = std::min((points.colEnd - 1) / mPatchCells, mPatchCols - 1);
+
+    for (unsigned int pr = firstRow; pr <= lastRow; ++pr)
+    {
+        for (unsigned int pc = firstCol; pc <= lastCol; ++pc)
+        {
+            UpdatePatchBounds(field, pr, pc);
+        }
+    }
+}
+
+void GridPatches::UpdatePatchBounds(const HeightField& field, unsigned int pr, unsigned int pc)
+{
+    unsigned int rowStart = pr * mPatchCells, colStart = pc * mPatchCells;
+    unsigned int rowEnd = std::min(rowStart + mPatchCells, mRows - 1);
+    unsigned int colEnd = std::min(colStart + mPatchCells, mCols - 1);
+
+    float minHeight = field.Height(rowStart, colStart);
+    float maxHeight = minHeight;
+
+    for (unsigned int i = rowStart; i <= rowEnd; ++i)
+    {
+        for (unsigned int j = colStart; j <= colEnd; ++j)
+        {
+            float height = field.Height(i, j);
+
+            minHeight = std::min(minHeight, height);
+            maxHeight = std::max(maxHeight, height);
+        }
+    }
+
+    // Steps can be negative, so opposite corners need sorting.
+    D3DXVECTOR3 a = field.Position(rowStart, colStart);
+    D3DXVECTOR3 b = field.Position(rowEnd, colEnd);
+
+    mBounds.Set(
+        pr * mPatchCols + pc,
+        D3DXVECTOR3(std::min(a.x, b.x), minHeight, std::min(a.z, b.z)),
+        D3DXVECTOR3(std::max(a.x, b.x), maxHeight, std::max(a.z, b.z)));
+}
+
+unsigned int GridPatches::Cull(const Frustum& frustum, std::vector<IndexRange> * pRangesOut) const
+{
+    VerifyNotNull(pRangesOut);
+    pRangesOut->clear();
+
+    if (PatchCount() == 0)
+    {
+        return 0;
+    }
+
+    unsigned int visibleCount = frustum.CullBoxes(mBounds, &mVisible[0]);
+
+    // Patches are stored in the same order in the index buffer, so visible neighbors are adjacent.
+    for (unsigned int patch = 0; patch < PatchCount(); ++patch)
+    {
+        if (mVisible[patch] == 0)
+        {
+            continue;
+        }
+
+        unsigned int indexCount = mFirstIndex[patch + 1] - mFirstIndex[patch];
+
+        if (!pRangesOut->empty() &&
+            pRangesOut->back().firstIndex + pRangesOut->back().indexCount == mFirstIndex[patch])
+        {
+            pRangesOut->back().indexCount += indexCount;
+        }
+        else
+        {
+            IndexRange range = { mFirstIndex[patch], indexCount };
+            pRangesOut->push_back(range);
+        }
+    }
+
+    return visibleCount;
+}
@@ -0,0 +1,117 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "stdafx.h"
+#include "terrain/HeightField.h"
+
+#include <d3dx10.h>
+#include <algorithm>
+#include <cmath>
+
+HeightField::HeightField()
+    : mRows(0),
+      mCols(0),
+      mOriginX(0.0f),
+      mOriginZ(0.0f),
+      mStepX(1.0f),
+      mStepZ(1.0f),
+      mHeights()
+{
+}
+
+HeightField::HeightField(
+    unsigned int rows,
+    unsigned int cols,
+    float originX,
+    float originZ,
+    float stepX,
+    float stepZ)
+    : mRows(rows),
+      mCols(cols),
+      mOriginX(originX),
+      mOriginZ(originZ),
+      mStepX(stepX),
+      mStepZ(stepZ),
+      mHeights(static_cast<size_t>(rows) * cols, 0.0f)
+{
+    Verify(rows >= 2 && cols >= 2);
+    Verify(stepX != 0.0f && stepZ != 0.0f);
+}
+
+float HeightField::Height(int row, int col) const
+{
+    row = std::min(std::max(row, 0), static_cast<int>(mRows) - 1);
+    col = std::min(std::max(col, 0), static_cast<int>(mCols) - 1);
+
+    return mHeights[static_cast<size_t>(row) * mCols + col];
+}
+
+void HeightField::SetHeight(unsigned int row, unsigned int col, float height)
+{
+    assert(row < mRows && col < mCols);
+    mHeights[static_cast<size_t>(row) * mCols + col] = height;
+}
+
+float HeightField::SampleHeight(float x, float z) const
+{
+    float col = std::min(std::max(ToGridCol(x), 0.0f), static_cast<float>(mCols - 1));
+    float row = std::min(std::max(ToGridRow(z), 0.0f), static_cast<float>(mRows - 1));
+
+    int c0 = static_cast<int>(col);
+    int r0 = static_cast<int>(row);
+    float s = col - c0;
+    float t = row - r0;
+
+    float top    = Height(r0, c0) + s * (Height(r0, c0 + 1) - Height(r0, c0));
+    float bottom = Height(r0 + 1, c0) + s * (Height(r0 + 1, c0 + 1) - Height(r0 + 1, c0));
+
+    return top + t * (bottom - top);
+}
+
+D3DXVECTOR3 HeightField::Normal(int row, int col) const
+{
+    // n = ( -df/dx, 1, -df/dz )
+    D3DXVECTOR3 normal(
+        -(Height(row, col + 1) - Height(row, col - 1)) / (2.0f * mStepX),
+        1.0f,
+        -(Height(row + 1, col) - Height(row - 1, col)) / (2.0f * mStepZ));
+
+    D3DXVec3Normalize(&normal, &normal);
+    return normal;
+}
+
+D3DXVECTOR3 HeightField::Position(unsigned int row, unsigned int col) const
+{
+    return D3DXVECTOR3(
+        mOriginX + col * mStepX,
+        mHeights[static_cast<size_t>(row) * mCols + col],
+        mOriginZ + row * mStepZ);
+}
+
+void HeightField::HeightRange(float * pMinHeightOut, float * pMaxHeightOut) const
+{
+    VerifyNotNull(pMinHeightOut);
+    VerifyNotNull(pMaxHeightOut);
+
+    if (mHeights.empty())
+    {
+        *pMinHeightOut = 0.0f;
+        *pMaxHeightOut = 0.0f;
+        return;
+    }
+
+    *pMinHeightOut = *std::min_element(mHeights.begin(), mHeights.end());
+    *pMaxHeightOut = *std::max_element(mHeights.begin(), mHeights.end());
+}
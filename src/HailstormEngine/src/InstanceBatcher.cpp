@@ -0,0 +1,296 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "stdafx.h"
+#include "graphics/InstanceBatcher.h"
+#include "graphics/DirectXExceptions.h"
+
+#include <d3d10.h>
+#include <d3dx10.h>
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+#include "graphics/staticmesh.h"
+
+bool InstanceBatcher::Entry::operator <(const Entry& other) const
+{
+    if (material != other.material)
+    {
+        return material < other.material;
+    }
+
+    if (pMesh != other.pMesh)
+    {
+        return pMesh < other.pMesh;
+    }
+
+    if (lod != other.lod)
+    {
+        return lod < other.lod;
+    }
+
+    return instance < other.instance;
+}
+
+InstanceBatcher::InstanceBatcher(ID3D10Device * pDevice, unsigned int capacity)
+    : mCapacity(capacity),
+      mWriteOffset(capacity),
+      mInstanceBuffer(),
+      mMaterials(),
+      mEntries(),
+      mInstances()
+{
+    AssertNotNull(pDevice);
+    Verify(capacity > 0);
+
+    ResetStats();
+    mLastFlushStats = mTotalStats;
+
+    D3D10_BUFFER_DESC desc;
+    ZeroMemory(&desc, sizeof(desc));
+
+    desc.Usage = D3D10_USAGE_DYNAMIC;
+    desc.ByteWidth = sizeof(StaticMeshInstance) * capacity;
+    desc.BindFlags = D3D10_BIND_VERTEX_BUFFER;
+    desc.CPUAccessFlags = D3D10_CPU_ACCESS_WRITE;
+
+    HRESULT hr = pDevice->CreateBuffer(&desc, nullptr, &mInstanceBuffer);
+
+    if (FAILED(hr))
+    {
+        throw new DirectXException(hr, L"Creating instance buffer", L"", __FILE__, __LINE__);
+    }
+}
+
+InstanceBatcher::~InstanceBatcher()
+{
+}
+
+void InstanceBatcher::Add(
+    const StaticMesh * pMesh,
+    const InstanceMaterial& material,
+    const D3DXMATRIX& world,
+    const D3DXCOLOR& color,
+    unsigned int lod)
+{
+    AssertNotNull(pMesh);
+    assert(lod < pMesh->lodCount());
+
+    Entry entry;
+    entry.material = FindMaterial(material);
+    entry.pMesh = pMesh;
+    entry.lod = lod;
+    entry.instance = static_cast<unsigned int>(mInstances.size());
+
+    StaticMeshInstance instance;
+    instance.world = world;
+    instance.color = color;
+
+    mEntries.push_back(entry);
+    mInstances.push_back(instance);
+}
+
+/**
+ * Sorts the queued instances by material, then by mesh and level of detail, and draws each run of
+ * identical entries with as few instanced draws as the buffer allows.
+ */
+void InstanceBatcher::Flush(ID3D10Device * pDevice)
+{
+    AssertNotNull(pDevice);
+
+    InstanceBatchStats stats = { 0 };
+    stats.instanceCount = static_cast<unsigned int>(mEntries.size());
+
+    std::sort(mEntries.begin(), mEntries.end());
+
+    unsigned int appliedMaterial = static_cast<unsigned int>(mMaterials.size());
+    size_t batchStart = 0;
+
+    while (batchStart < mEntries.size())
+    {
+        const Entry& first = mEntries[batchStart];
+        size_t batchEnd = batchStart + 1;
+
+        while (batchEnd < mEntries.size() &&
+               mEntries[batchEnd].material == first.material &&
+               mEntries[batchEnd].pMesh == first.pMesh &&
+               mEntries[batchEnd].lod == first.lod)
+        {
+            ++batchEnd;
+        }
+
+        const InstanceMaterial& material = mMaterials[first.material];
+        D3D10_TECHNIQUE_DESC techniqueDesc;
+        material.pTechnique->GetDesc(&techniqueDesc);
+
+        if (first.material != appliedMaterial)
+        {
+            pDevice->IASetInputLayout(material.pInputLayout);
+        }
+
+        ++stats.batchCount;
+        stats.unbatchedDrawCount += static_cast<unsigned int>(batchEnd - batchStart) * techniqueDesc.Passes;
+
+        for (size_t drawStart = batchStart; drawStart < batchEnd; )
+        {
+            unsigned int count = std::min(static_cast<unsigned int>(batchEnd - drawStart), mCapacity);
+            unsigned int firstInstance = WriteInstances(&mEntries[drawStart], count, &stats);
+
+            for (unsigned int pass = 0; pass < techniqueDesc.Passes; ++pass)
+            {
+                // A single pass material only has to be applied once for all of its meshes.
+                if (techniqueDesc.Passes > 1 || first.material != appliedMaterial)
+                {
+                    material.pTechnique->GetPassByIndex(pass)->Apply(0);
+                    appliedMaterial = first.material;
+                }
+
+                first.pMesh->drawInstanced(pDevice, mInstanceBuffer.Get(), count, firstInstance, first.lod);
+                ++stats.drawCount;
+            }
+
+            drawStart += count;
+        }
+
+        batchStart = batchEnd;
+    }
+
+    mLastFlushStats = stats;
+    mTotalStats.instanceCount += stats.instanceCount;
+    mTotalStats.batchCount += stats.batchCount;
+    mTotalStats.drawCount += stats.drawCount;
+    mTotalStats.unbatchedDrawCount += stats.unbatchedDrawCount;
+    mTotalStats.bufferMapCount += stats.bufferMapCount;
+
+    Clear();
+}
+
+void InstanceBatcher::Clear()
+{
+    mEntries.clear();
+    mInstances.clear();
+    mMaterials.clear();
+}
+
+void InstanceBatcher::ResetStats()
+{
+    InstanceBatchStats noStats = { 0 };
+    mTotalStats = noStats;
+}
+
+/**
+ * Copies the instances of a batch into the instance buffer and returns the index of the first one.
+ * New data is appended after whatever earlier draws are still reading, and the buffer is only
+ * discarded once it is full.
+ */
+unsigned int InstanceBatcher::WriteInstances(const Entry * pEntries, unsigned int count, InstanceBatchStats * pStats)
+{
+    assert(count > 0 && count <= mCapacity);
+
+    D3D10_MAP mapType = D3D10_MAP_WRITE_NO_OVERWRITE;
+
+    if (mWriteOffset + count > mCapacity)
+    {
+        mapType = D3D10_MAP_WRITE_DISCARD;
+        mWriteOffset = 0;
+    }
+
+    void * pMapped = nullptr;
+    HRESULT hr = mInstanceBuffer->Map(mapType, 0, &pMapped);
+
+    if (FAILED(hr))
+    {
+        throw new DirectXException(hr, L"Mapping instance buffer", L"", __FILE__, __LINE__);
+    }
+
+    StaticMeshInstance * pInstances = static_cast<StaticMeshInstance *>(pMapped) + mWriteOffset;
+
+    for (unsigned int i = 0; i < count; ++i)
+    {
+        pInstances[i] = mInstances[pEntries[i].instance];
+    }
+
+    mInstanceBuffer->Unmap();
+    ++pStats->bufferMapCount;
+
+    unsigned int firstInstance = mWriteOffset;
+    mWriteOffset += count;
+
+    return firstInstance;
+}
+
+unsigned int InstanceBatcher::FindMaterial(const InstanceMaterial& material)
+{
+    AssertNotNull(material.pTechnique);
+    AssertNotNull(material.pInputLayout);
+
+    // There are only ever a handful of materials in a frame, so a linear search beats hashing.
+    for (size_t i = 0; i < mMaterials.size(); ++i)
+    {
+        if (mMaterials[i].pTechnique == material.pTechnique && mMaterials[i].pInputLayout == material.pInputLayout)
+        {
+            return static_cast<unsigned int>(i);
+        }
+    }
+
+    mMaterials.push_back(material);
+    return static_cast<unsigned int>(mMaterials.size() - 1);
+}
+
+void InstanceBatcher::CreateInputLayout(
+    ID3D10Device * pDevice,
+    ID3D10EffectTechnique * pTechnique,
+    ID3D10InputLayout ** ppInputLayoutOut)
+{
+    AssertNotNull(pDevice);
+    AssertNotNull(pTechnique);
+    AssertNotNull(ppInputLayoutOut);
+
+    const unsigned int ELEMENT_COUNT = 9;
+    const unsigned int WORLD = offsetof(StaticMeshInstance, world);
+    const unsigned int ROW = sizeof(float) * 4;
+
+    D3D10_INPUT_ELEMENT_DESC elements[ELEMENT_COUNT] =
+    {
+        { "POSITION",      0, DXGI_FORMAT_R32G32B32_FLOAT,    0, offsetof(StaticMeshVertex, pos),      D3D10_INPUT_PER_VERTEX_DATA,   0 },
+        { "NORMAL",        0, DXGI_FORMAT_R32G32B32_FLOAT,    0, offsetof(StaticMeshVertex, normal),   D3D10_INPUT_PER_VERTEX_DATA,   0 },
+        { "TEXCOORD",      0, DXGI_FORMAT_R32G32_FLOAT,       0, offsetof(StaticMeshVertex, texcoord), D3D10_INPUT_PER_VERTEX_DATA,   0 },
+        { "COLOR",         0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, offsetof(StaticMeshVertex, color),    D3D10_INPUT_PER_VERTEX_DATA,   0 },
+        { "WORLD",         0, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, WORLD,                                D3D10_INPUT_PER_INSTANCE_DATA, 1 },
+        { "WORLD",         1, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, WORLD + ROW,                          D3D10_INPUT_PER_INSTANCE_DATA, 1 },
+        { "WORLD",         2, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, WORLD + ROW * 2,                      D3D10_INPUT_PER_INSTANCE_DATA, 1 },
+        { "WORLD",         3, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, WORLD + ROW * 3,                      D3D10_INPUT_PER_INSTANCE_DATA, 1 },
+        { "INSTANCECOLOR", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, offsetof(StaticMeshInstance, color),  D3D10_INPUT_PER_INSTANCE_DATA, 1 }
+    };
+
+    D3D10_PASS_DESC passDesc;
+    HRESULT hr = pTechnique->GetPassByIndex(0)->GetDesc(&passDesc);
+
+    if (SUCCEEDED(hr))
+    {
+        hr = pDevice->CreateInputLayout(
+            elements,
+            ELEMENT_COUNT,
+            passDesc.pIAInputSignature,
+            passDesc.IAInputSignatureSize,
+            ppInputLayoutOut);
+    }
+
+    if (FAILED(hr))
+    {
+        throw new DirectXException(hr, L"Creating instanced input layout", L"", __FILE__, __LINE__);
+    }
+}
@@ -0,0 +1,493 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "stdafx.h"
+#include "graphics/MeshFile.h"
+
+#include <d3dx10.h>
+#include <algorithm>
+#include <cmath>
+#include <cfloat>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+#include "graphics/staticmeshvertex.h"
+#include "runtime/logging.h"
+
+static_assert(sizeof(MeshFileVertexElement) == 16, "Mesh file vertex elements must not contain padding");
+static_assert(sizeof(MeshFileLod) == 16, "Mesh file levels of detail must not contain padding");
+static_assert(sizeof(MeshFileHeader) == 112, "Mesh file header must not contain padding");
+
+namespace
+{
+    const unsigned int MESH_FILE_MAGIC = 0x464D5348;    // "HSMF"
+
+    // Bump this whenever the file layout changes.
+    const unsigned int MESH_FILE_VERSION = 1;
+
+    const unsigned long long STREAM_ALIGNMENT = 16;
+
+    // Layout of StaticMeshVertex, see MeshFactory::Init for the matching input layout.
+    const MeshFileVertexElement STATIC_MESH_LAYOUT[] =
+    {
+        { MeshFileSemantic::Position, 0, MeshFileFormat::Float3, offsetof(StaticMeshVertex, pos) },
+        { MeshFileSemantic::Normal,   0, MeshFileFormat::Float3, offsetof(StaticMeshVertex, normal) },
+        { MeshFileSemantic::Texcoord, 0, MeshFileFormat::Float2, offsetof(StaticMeshVertex, texcoord) },
+        { MeshFileSemantic::Color,    0, MeshFileFormat::Float4, offsetof(StaticMeshVertex, color) }
+    };
+
+    const unsigned int STATIC_MESH_LAYOUT_COUNT = sizeof(STATIC_MESH_LAYOUT) / sizeof(STATIC_MESH_LAYOUT[0]);
+
+    unsigned long long AlignOffset(unsigned long long offset)
+    {
+        return (offset + STREAM_ALIGNMENT - 1) & ~(STREAM_ALIGNMENT - 1);
+    }
+
+    std::string NarrowPath(const std::wstring& path)
+    {
+        return std::string(path.begin(), path.end());
+    }
+
+    // Check that a table of count items of itemSize bytes at offset lies inside the file.
+    bool IsInFile(unsigned long long offset, unsigned long long count, unsigned long long itemSize, unsigned long long fileSize)
+    {
+        return offset % STREAM_ALIGNMENT == 0 && offset <= fileSize && count * itemSize <= fileSize - offset;
+    }
+
+    // Check that every level of detail is a whole number of triangles within the index stream.
+    bool AreLodsInIndices(const MeshFileLod * pLods, unsigned int lodCount, unsigned int indexCount)
+    {
+        for (unsigned int i = 0; i < lodCount; ++i)
+        {
+            if (pLods[i].indexCount % 3 != 0 ||
+                pLods[i].firstIndex > indexCount ||
+                pLods[i].indexCount > indexCount - pLods[i].firstIndex)
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    // Check that every index refers to a vertex in the file, since the device does not.
+    bool AreIndicesInVertices(const unsigned int * pIndices, unsigned int indexCount, unsigned int vertexCount)
+    {
+        unsigned int highestIndex = 0;
+
+        for (unsigned int i = 0; i < indexCount; ++i)
+        {
+            highestIndex = std::max(highestIndex, pIndices[i]);
+        }
+
+        return indexCount == 0 || highestIndex < vertexCount;
+    }
+
+    /**
+     * Computes the bounding box of the vertex positions, and a bounding sphere centered on the box.
+     */
+    void ComputeBounds(
+        const unsigned char * pVertices,
+        unsigned int vertexStride,
+        unsigned int vertexCount,
+        unsigned int positionOffset,
+        MeshFileHeader * pHeader)
+    {
+        for (unsigned int axis = 0; axis < 3; ++axis)
+        {
+            pHeader->boundsMin[axis] = vertexCount > 0 ? FLT_MAX : 0.0f;
+            pHeader->boundsMax[axis] = vertexCount > 0 ? -FLT_MAX : 0.0f;
+        }
+
+        for (unsigned int i = 0; i < vertexCount; ++i)
+        {
+            const float * pPosition = reinterpret_cast<const float *>(pVertices + static_cast<size_t>(i) * vertexStride + positionOffset);
+
+            for (unsigned int axis = 0; axis < 3; ++axis)
+            {
+                pHeader->boundsMin[axis] = std::min(pHeader->boundsMin[axis], pPosition[axis]);
+                pHeader->boundsMax[axis] = std::max(pHeader->boundsMax[axis], pPosition[axis]);
+            }
+        }
+
+        float radiusSquared = 0.0f;
+
+        for (unsigned int axis = 0; axis < 3; ++axis)
+        {
+            pHeader->sphereCenter[axis] = 0.5f * (pHeader->boundsMin[axis] + pHeader->boundsMax[axis]);
+        }
+
+        for (unsigned int i = 0; i < vertexCount; ++i)
+        {
+            const float * pPosition = reinterpret_cast<const float *>(pVertices + static_cast<size_t>(i) * vertexStride + positionOffset);
+            float distanceSquared = 0.0f;
+
+            for (unsigned int axis = 0; axis < 3; ++axis)
+            {
+                float offset = pPosition[axis] - pHeader->sphereCenter[axis];
+                distanceSquared += offset * offset;
+            }
+
+            radiusSquared = std::max(radiusSquared, distanceSquared);
+        }
+
+        pHeader->sphereRadius = std::sqrt(radiusSquared);
+    }
+}
+
+MeshFile::MeshFile()
+    : mFile(),
+      mData(),
+      mpHeader(nullptr)
+{
+}
+
+MeshFile::~MeshFile()
+{
+}
+
+bool MeshFile::Open(const std::wstring& path)
+{
+    const char * pReason = nullptr;
+
+    if (Open(path, &pReason))
+    {
+        return true;
+    }
+
+    LOG_WARN("MeshFile") << "Could not open mesh file " << NarrowPath(path) << ": " << pReason;
+    return false;
+}
+
+bool MeshFile::Open(const std::wstring& path, const char ** ppReasonOut)
+{
+    VerifyNotNull(ppReasonOut);
+    Close();
+
+    if (!mFile.Open(path))
+    {
+        *ppReasonOut = "file is missing or could not be mapped";
+        return false;
+    }
+
+    if (!Attach(ByteSpan(mFile.Data(), mFile.Size()), ppReasonOut))
+    {
+        mFile.Close();
+        return false;
+    }
+
+    return true;
+}
+
+bool MeshFile::Open(const ByteSpan& data, const char ** ppReasonOut)
+{
+    VerifyNotNull(ppReasonOut);
+    Close();
+
+    return Attach(data, ppReasonOut);
+}
+
+/**
+ * Validates the header and tables of a mesh file in memory, and points the accessors at it.
+ */
+bool MeshFile::Attach(const ByteSpan& data, const char ** ppReasonOut)
+{
+    const MeshFileHeader * pHeader = reinterpret_cast<const MeshFileHeader *>(data.pData);
+    unsigned long long fileSize = data.size;
+    const char * pReason = nullptr;
+
+    if (reinterpret_cast<size_t>(data.pData) % STREAM_ALIGNMENT != 0)
+    {
+        pReason = "data is not aligned";
+    }
+    else if (fileSize < sizeof(MeshFileHeader) || pHeader->magic != MESH_FILE_MAGIC)
+    {
+        pReason = "not a mesh file";
+    }
+    else if (pHeader->version != MESH_FILE_VERSION || pHeader->headerSize != sizeof(MeshFileHeader))
+    {
+        pReason = "unsupported version";
+    }
+    else if (pHeader->fileSize != fileSize ||
+             pHeader->indexCount % 3 != 0 ||
+             !IsInFile(pHeader->elementsOffset, pHeader->elementCount, sizeof(MeshFileVertexElement), fileSize) ||
+             !IsInFile(pHeader->lodsOffset, pHeader->lodCount, sizeof(MeshFileLod), fileSize) ||
+             !IsInFile(pHeader->verticesOffset, pHeader->vertexCount, pHeader->vertexStride, fileSize) ||
+             !IsInFile(pHeader->indicesOffset, pHeader->indexCount, sizeof(unsigned int), fileSize))
+    {
+        pReason = "file is truncated or corrupt";
+    }
+    else if (!AreLodsInIndices(
+                reinterpret_cast<const MeshFileLod *>(data.pData + pHeader->lodsOffset),
+                pHeader->lodCount,
+                pHeader->indexCount))
+    {
+        pReason = "level of detail is outside of the indices";
+    }
+    else if (!AreIndicesInVertices(
+                reinterpret_cast<const unsigned int *>(data.pData + pHeader->indicesOffset),
+                pHeader->indexCount,
+                pHeader->vertexCount))
+    {
+        pReason = "index is outside of the vertices";
+    }
+
+    if (pReason != nullptr)
+    {
+        *ppReasonOut = pReason;
+        return false;
+    }
+
+    mData = data;
+    mpHeader = pHeader;
+    return true;
+}
+
+void MeshFile::Close()
+{
+    mpHeader = nullptr;
+    mData = ByteSpan();
+    mFile.Close();
+}
+
+const MeshFileHeader& MeshFile::Header() const
+{
+    VerifyNotNull(mpHeader);
+    return *mpHeader;
+}
+
+const MeshFileVertexElement * MeshFile::Elements() const
+{
+    VerifyNotNull(mpHeader);
+    return reinterpret_cast<const MeshFileVertexElement *>(mData.pData + mpHeader->elementsOffset);
+}
+
+const MeshFileLod * MeshFile::Lods() const
+{
+    VerifyNotNull(mpHeader);
+    return reinterpret_cast<const MeshFileLod *>(mData.pData + mpHeader->lodsOffset);
+}
+
+const void * MeshFile::Vertices() const
+{
+    VerifyNotNull(mpHeader);
+    return mData.pData + mpHeader->verticesOffset;
+}
+
+const unsigned int * MeshFile::Indices() const
+{
+    VerifyNotNull(mpHeader);
+    return reinterpret_cast<const unsigned int *>(mData.pData + mpHeader->indicesOffset);
+}
+
+bool MeshFile::HasStaticMeshLayout() const
+{
+    VerifyNotNull(mpHeader);
+
+    if (mpHeader->vertexStride != sizeof(StaticMeshVertex) || mpHeader->elementCount != STATIC_MESH_LAYOUT_COUNT)
+    {
+        return false;
+    }
+
+    const MeshFileVertexElement * pElements = Elements();
+
+    for (unsigned int i = 0; i < STATIC_MESH_LAYOUT_COUNT; ++i)
+    {
+        if (pElements[i].semantic != STATIC_MESH_LAYOUT[i].semantic ||
+            pElements[i].semanticIndex != STATIC_MESH_LAYOUT[i].semanticIndex ||
+            pElements[i].format != STATIC_MESH_LAYOUT[i].format ||
+            pElements[i].offset != STATIC_MESH_LAYOUT[i].offset)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void MeshFile::Serialize(
+    const void * pVertices,
+    unsigned int vertexStride,
+    unsigned int vertexCount,
+    const MeshFileVertexElement * pElements,
+    unsigned int elementCount,
+    const unsigned int * pIndices,
+    unsigned int indexCount,
+    const MeshFileLod * pLods,
+    unsigned int lodCount,
+    std::vector<unsigned char> * pFileOut)
+{
+    VerifyNotNull(pVertices);
+    VerifyNotNull(pElements);
+    VerifyNotNull(pIndices);
+    VerifyNotNull(pFileOut);
+    Verify(indexCount % 3 == 0);
+
+    const MeshFileVertexElement * pPosition = nullptr;
+
+    for (unsigned int i = 0; i < elementCount; ++i)
+    {
+        if (pElements[i].semantic == MeshFileSemantic::Position && pElements[i].format == MeshFileFormat::Float3)
+        {
+            pPosition = &pElements[i];
+            break;
+        }
+    }
+
+    VerifyNotNull(pPosition);
+
+    MeshFileLod wholeMesh = { 0, indexCount, 0.0f, 0 };
+
+    if (lodCount == 0)
+    {
+        pLods = &wholeMesh;
+        lodCount = 1;
+    }
+
+    MeshFileHeader header = { 0 };
+
+    header.magic = MESH_FILE_MAGIC;
+    header.version = MESH_FILE_VERSION;
+    header.headerSize = sizeof(MeshFileHeader);
+    header.vertexStride = vertexStride;
+    header.vertexCount = vertexCount;
+    header.indexCount = indexCount;
+    header.elementCount = elementCount;
+    header.lodCount = lodCount;
+
+    ComputeBounds(static_cast<const unsigned char *>(pVertices), vertexStride, vertexCount, pPosition->offset, &header);
+
+    size_t elementsSize = static_cast<size_t>(elementCount) * sizeof(MeshFileVertexElement);
+    size_t lodsSize = static_cast<size_t>(lodCount) * sizeof(MeshFileLod);
+    size_t verticesSize = static_cast<size_t>(vertexCount) * vertexStride;
+    size_t indicesSize = static_cast<size_t>(indexCount) * sizeof(unsigned int);
+
+    header.elementsOffset = AlignOffset(sizeof(MeshFileHeader));
+    header.lodsOffset = AlignOffset(header.elementsOffset + elementsSize);
+    header.verticesOffset = AlignOffset(header.lodsOffset + lodsSize);
+    header.indicesOffset = AlignOffset(header.verticesOffset + verticesSize);
+    header.fileSize = header.indicesOffset + indicesSize;
+
+    // Padding between the tables is left as zeros.
+    pFileOut->assign(static_cast<size_t>(header.fileSize), 0);
+    unsigned char * pFile = &(*pFileOut)[0];
+
+    std::memcpy(pFile, &header, sizeof(header));
+    std::memcpy(pFile + header.elementsOffset, pElements, elementsSize);
+    std::memcpy(pFile + header.lodsOffset, pLods, lodsSize);
+
+    if (verticesSize > 0)
+    {
+        std::memcpy(pFile + header.verticesOffset, pVertices, verticesSize);
+    }
+
+    if (indicesSize > 0)
+    {
+        std::memcpy(pFile + header.indicesOffset, pIndices, indicesSize);
+    }
+}
+
+void MeshFile::Serialize(
+    const StaticMeshVertex * pVertices,
+    unsigned int vertexCount,
+    const unsigned int * pIndices,
+    unsigned int indexCount,
+    const MeshFileLod * pLods,
+    unsigned int lodCount,
+    std::vector<unsigned char> * pFileOut)
+{
+    Serialize(
+        pVertices,
+        sizeof(StaticMeshVertex),
+        vertexCount,
+        STATIC_MESH_LAYOUT,
+        STATIC_MESH_LAYOUT_COUNT,
+        pIndices,
+        indexCount,
+        pLods,
+        lodCount,
+        pFileOut);
+}
+
+bool MeshFile::Write(
+    const std::wstring& path,
+    const void * pVertices,
+    unsigned int vertexStride,
+    unsigned int vertexCount,
+    const MeshFileVertexElement * pElements,
+    unsigned int elementCount,
+    const unsigned int * pIndices,
+    unsigned int indexCount,
+    const MeshFileLod * pLods,
+    unsigned int lodCount)
+{
+    std::vector<unsigned char> bytes;
+    Serialize(pVertices, vertexStride, vertexCount, pElements, elementCount, pIndices, indexCount, pLods, lodCount, &bytes);
+
+#if defined(_WIN32)
+    std::ofstream file(path.c_str(), std::ios::binary | std::ios::trunc);
+#else
+    std::ofstream file(NarrowPath(path).c_str(), std::ios::binary | std::ios::trunc);
+#endif
+
+    if (!file)
+    {
+        LOG_WARN("MeshFile") << "Could not create mesh file " << NarrowPath(path);
+        return false;
+    }
+
+    // Write a blank header first and fill it in once everything else is safely on disk.
+    MeshFileHeader blankHeader = { 0 };
+
+    file.write(reinterpret_cast<const char *>(&blankHeader), sizeof(blankHeader));
+    file.write(reinterpret_cast<const char *>(&bytes[sizeof(MeshFileHeader)]), static_cast<std::streamsize>(bytes.size() - sizeof(MeshFileHeader)));
+    file.flush();
+
+    file.seekp(0);
+    file.write(reinterpret_cast<const char *>(&bytes[0]), sizeof(MeshFileHeader));
+    file.close();
+
+    if (!file)
+    {
+        LOG_WARN("MeshFile") << "Failed while writing mesh file " << NarrowPath(path);
+        return false;
+    }
+
+    return true;
+}
+
+bool MeshFile::Write(
+    const std::wstring& path,
+    const StaticMeshVertex * pVertices,
+    unsigned int vertexCount,
+    const unsigned int * pIndices,
+    unsigned int indexCount,
+    const MeshFileLod * pLods,
+    unsigned int lodCount)
+{
+    return Write(
+        path,
+        pVertices,
+        sizeof(StaticMeshVertex),
+        vertexCount,
+        STATIC_MESH_LAYOUT,
+        STATIC_MESH_LAYOUT_COUNT,
+        pIndices,
+        indexCount,
+        pLods,
+        lodCount);
+}
@@ -0,0 +1,1827 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "stdafx.h"
+#include "graphics/MeshImporter.h"
+
+#include <d3dx10.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <cwctype>
+#include <string>
+#include <vector>
+
+#include "graphics/staticmeshvertex.h"
+#include "runtime/logging.h"
+#include "runtime/MappedFile.h"
+#include "runtime/Parallel.h"
+#include "runtime/Stopwatch.h"
+
+namespace
+{
+    const unsigned int NO_INDEX = 0xFFFFFFFF;
+    const unsigned int MAX_CHUNK_COUNT = 4096;
+    const unsigned int MAX_SIGNIFICANT_DIGITS = 19;     // Digits that always fit in 64 bits.
+    const unsigned int MAX_EXACT_POWER_OF_TEN = 22;     // Largest power of ten a double holds exactly.
+
+    const double POWERS_OF_TEN[MAX_EXACT_POWER_OF_TEN + 1] =
+    {
+        1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    static_assert(sizeof(StaticMeshVertex) % sizeof(unsigned int) == 0, "Vertices are hashed a word at a time");
+
+    std::string NarrowPath(const std::wstring& path)
+    {
+        return std::string(path.begin(), path.end());
+    }
+
+    /**
+     * Mixes one word into a running hash (the MurmurHash3 body step).
+     */
+    inline unsigned int MixHash(unsigned int hash, unsigned int value)
+    {
+        value *= 0xCC9E2D51u;
+        value = (value << 15) | (value >> 17);
+        value *= 0x1B873593u;
+
+        hash ^= value;
+        hash = (hash << 13) | (hash >> 19);
+        return hash * 5 + 0xE6546B64u;
+    }
+
+    /**
+     * Scrambles the bits of a finished hash so that neighboring keys land in distant slots.
+     */
+    inline unsigned int FinishHash(unsigned int hash)
+    {
+        hash ^= hash >> 16;
+        hash *= 0x85EBCA6Bu;
+        hash ^= hash >> 13;
+        hash *= 0xC2B2AE35u;
+        hash ^= hash >> 16;
+        return hash;
+    }
+
+    unsigned int HashWords(const void * pKey, size_t byteCount)
+    {
+        unsigned int words[16];
+        unsigned int hash = 0;
+
+        assert(byteCount <= sizeof(words));
+        std::memcpy(words, pKey, byteCount);
+
+        for (size_t i = 0; i < byteCount / sizeof(unsigned int); ++i)
+        {
+            hash = MixHash(hash, words[i]);
+        }
+
+        return FinishHash(hash);
+    }
+
+    /**
+     * Open addressing hash set with linear probing, used to weld vertices. The keys themselves live in
+     * the caller's array of unique vertices, so a slot only holds a key's hash and its index in that
+     * array. That keeps slots at eight bytes, and most probes end in the first cache line touched.
+     */
+    class WeldTable
+    {
+    public:
+        explicit WeldTable(size_t expectedCount)
+            : mSlots(),
+              mCount(0)
+        {
+            size_t capacity = 16;
+
+            while (capacity * 3 < expectedCount * 4)
+            {
+                capacity *= 2;
+            }
+
+            Slot empty = { 0, NO_INDEX };
+            mSlots.assign(capacity, empty);
+        }
+
+        /**
+         * Looks for a key equal to the caller's (isEqual(index) compares the caller's key against the
+         * unique key at index). Returns its index if found, otherwise adds newIndex and returns that.
+         */
+        template<typename Equal>
+        unsigned int FindOrAdd(unsigned int hash, unsigned int newIndex, const Equal& isEqual)
+        {
+            if ((mCount + 1) * 4 > mSlots.size() * 3)
+            {
+                Grow();
+            }
+
+            size_t mask = mSlots.size() - 1;
+
+            for (size_t slot = hash & mask; ; slot = (slot + 1) & mask)
+            {
+                Slot& current = mSlots[slot];
+
+                if (current.index == NO_INDEX)
+                {
+                    current.hash = hash;
+                    current.index = newIndex;
+                    ++mCount;
+                    return newIndex;
+                }
+
+                if (current.hash == hash && isEqual(current.index))
+                {
+                    return current.index;
+                }
+            }
+        }
+
+    private:
+        struct Slot
+        {
+            unsigned int hash;
+            unsigned int index;
+        };
+
+        void Grow()
+        {
+            std::vector<Slot> oldSlots(mSlots.size() * 2);
+            oldSlots.swap(mSlots);
+
+            Slot empty = { 0, NO_INDEX };
+            std::fill(mSlots.begin(), mSlots.end(), empty);
+
+            size_t mask = mSlots.size() - 1;
+
+            for (size_t i = 0; i < oldSlots.size(); ++i)
+            {
+                if (oldSlots[i].index != NO_INDEX)
+                {
+                    size_t slot = oldSlots[i].hash & mask;
+
+                    while (mSlots[slot].index != NO_INDEX)
+                    {
+                        slot = (slot + 1) & mask;
+                    }
+
+                    mSlots[slot] = oldSlots[i];
+                }
+            }
+        }
+
+    private:
+        std::vector<Slot> mSlots;
+        size_t mCount;
+    };
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////
+    // Text parsing
+    /////////////////////////////////////////////////////////////////////////////////////////////////
+    inline bool IsBlank(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\r';
+    }
+
+    inline bool IsDigit(char c)
+    {
+        return static_cast<unsigned char>(c - '0') < 10;
+    }
+
+    inline const char * SkipBlanks(const char * pText, const char * pEnd)
+    {
+        while (pText < pEnd && IsBlank(*pText))
+        {
+            ++pText;
+        }
+
+        return pText;
+    }
+
+    // Number of blank separated tokens between pText and pEnd.
+    inline size_t CountTokens(const char * pText, const char * pEnd)
+    {
+        size_t count = 0;
+
+        for (pText = SkipBlanks(pText, pEnd); pText < pEnd; pText = SkipBlanks(pText, pEnd))
+        {
+            ++count;
+
+            while (pText < pEnd && !IsBlank(*pText))
+            {
+                ++pText;
+            }
+        }
+
+        return count;
+    }
+
+    inline const char * LineEnd(const char * pText, const char * pEnd)
+    {
+        const void * pNewline = std::memchr(pText, '\n', pEnd - pText);
+        return (pNewline != nullptr) ? static_cast<const char *>(pNewline) : pEnd;
+    }
+
+    inline const char * NextLine(const char * pText, const char * pEnd)
+    {
+        const char * pLineEnd = LineEnd(pText, pEnd);
+        return (pLineEnd < pEnd) ? pLineEnd + 1 : pEnd;
+    }
+
+    /**
+     * Reads a decimal floating point number (eg "-1.25e-3") after any leading blanks, and advances the
+     * text past it. Up to 19 significant digits are gathered into an integer, which is then scaled by
+     * an exact power of ten. That is within an ulp or so of a correctly rounded double, far closer than
+     * a float needs, and several times faster than strtof since there is no locale or stream handling.
+     */
+    bool ParseFloat(const char ** ppText, const char * pEnd, float * pValueOut)
+    {
+        const char * pText = SkipBlanks(*ppText, pEnd);
+        bool negative = false;
+
+        if (pText < pEnd && (*pText == '-' || *pText == '+'))
+        {
+            negative = (*pText == '-');
+            ++pText;
+        }
+
+        unsigned long long mantissa = 0;
+        unsigned int significantDigits = 0;
+        int exponent = 0;
+        bool anyDigits = false;
+
+        for (; pText < pEnd && IsDigit(*pText); ++pText)
+        {
+            anyDigits = true;
+
+            if (significantDigits < MAX_SIGNIFICANT_DIGITS)
+            {
+                mantissa = mantissa * 10 + (*pText - '0');
+                significantDigits += (mantissa != 0) ? 1 : 0;
+            }
+            else
+            {
+                ++exponent;
+            }
+        }
+
+        if (pText < pEnd && *pText == '.')
+        {
+            for (++pText; pText < pEnd && IsDigit(*pText); ++pText)
+            {
+                anyDigits = true;
+
+                if (significantDigits < MAX_SIGNIFICANT_DIGITS)
+                {
+                    mantissa = mantissa * 10 + (*pText - '0');
+                    significantDigits += (mantissa != 0) ? 1 : 0;
+                    --exponent;
+                }
+            }
+        }
+
+        if (!anyDigits)
+        {
+            return false;
+        }
+
+        if (pText < pEnd && (*pText == 'e' || *pText == 'E'))
+        {
+            const char * pExponent = pText + 1;
+            bool negativeExponent = false;
+
+            if (pExponent < pEnd && (*pExponent == '-' || *pExponent == '+'))
+            {
+                negativeExponent = (*pExponent == '-');
+                ++pExponent;
+            }
+
+            if (pExponent < pEnd && IsDigit(*pExponent))
+            {
+                int value = 0;
+
+                for (; pExponent < pEnd && IsDigit(*pExponent); ++pExponent)
+                {
+                    value = std::min(value * 10 + (*pExponent - '0'), 100000);
+                }
+
+                exponent += negativeExponent ? -value : value;
+                pText = pExponent;
+            }
+        }
+
+        double value = static_cast<double>(mantissa);
+
+        if (mantissa != 0 && exponent != 0)
+        {
+            unsigned int magnitude = static_cast<unsigned int>(std::abs(exponent));
+            double scale = (magnitude <= MAX_EXACT_POWER_OF_TEN) ?
+                POWERS_OF_TEN[magnitude] :
+                std::pow(10.0, static_cast<double>(magnitude));
+
+            value = (exponent < 0) ? value / scale : value * scale;
+        }
+
+        *pValueOut = static_cast<float>(negative ? -value : value);
+        *ppText = pText;
+        return true;
+    }
+
+    /**
+     * Reads a decimal integer after any leading blanks, and advances the text past it.
+     */
+    bool ParseInt(const char ** ppText, const char * pEnd, long long * pValueOut)
+    {
+        const char * pText = SkipBlanks(*ppText, pEnd);
+        bool negative = false;
+
+        if (pText < pEnd && (*pText == '-' || *pText == '+'))
+        {
+            negative = (*pText == '-');
+            ++pText;
+        }
+
+        if (pText == pEnd || !IsDigit(*pText))
+        {
+            return false;
+        }
+
+        long long value = 0;
+
+        for (; pText < pEnd && IsDigit(*pText); ++pText)
+        {
+            value = std::min(value * 10 + (*pText - '0'), 0x7FFFFFFFFFFFll);
+        }
+
+        *pValueOut = negative ? -value : value;
+        *ppText = pText;
+        return true;
+    }
+
+    /**
+     * Splits text into chunks of roughly chunkBytes that start and end on line boundaries. The first
+     * boundary is pBegin and the last is pEnd.
+     */
+    void SplitLines(const char * pBegin, const char * pEnd, size_t chunkBytes, std::vector<const char *> * pBoundariesOut)
+    {
+        chunkBytes = std::max(chunkBytes, static_cast<size_t>(pEnd - pBegin) / MAX_CHUNK_COUNT + 1);
+
+        pBoundariesOut->clear();
+        pBoundariesOut->push_back(pBegin);
+
+        const char * pText = pBegin;
+
+        while (static_cast<size_t>(pEnd - pText) > chunkBytes)
+        {
+            pText = NextLine(pText + chunkBytes, pEnd);
+
+            if (pText == pEnd)
+            {
+                break;
+            }
+
+            pBoundariesOut->push_back(pText);
+        }
+
+        pBoundariesOut->push_back(pEnd);
+    }
+
+    unsigned int LineNumber(const char * pBegin, const char * pText)
+    {
+        return 1 + static_cast<unsigned int>(std::count(pBegin, pText, '\n'));
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////
+    // Shared post processing
+    /////////////////////////////////////////////////////////////////////////////////////////////////
+
+    /**
+     * Merges vertices that are bit for bit identical, compacting the vertex array in place and
+     * rewriting the indices to match.
+     */
+    void WeldIdenticalVertices(std::vector<StaticMeshVertex> * pVertices, std::vector<unsigned int> * pIndices)
+    {
+        std::vector<StaticMeshVertex>& vertices = *pVertices;
+        std::vector<unsigned int> remap(vertices.size());
+        WeldTable table(vertices.size());
+        unsigned int uniqueCount = 0;
+
+        for (size_t i = 0; i < vertices.size(); ++i)
+        {
+            const StaticMeshVertex& vertex = vertices[i];
+
+            // Unique vertices are compacted to the front of the array as they are found, which never
+            // overwrites a vertex that has not been looked at yet.
+            unsigned int unique = table.FindOrAdd(
+                HashWords(&vertex, sizeof(vertex)),
+                uniqueCount,
+                [&](unsigned int other) { return std::memcmp(&vertices[other], &vertex, sizeof(vertex)) == 0; });
+
+            if (unique == uniqueCount)
+            {
+                vertices[uniqueCount++] = vertex;
+            }
+
+            remap[i] = unique;
+        }
+
+        vertices.resize(uniqueCount);
+
+        for (size_t i = 0; i < pIndices->size(); ++i)
+        {
+            (*pIndices)[i] = remap[(*pIndices)[i]];
+        }
+    }
+
+    /**
+     * Adds the area weighted normal of every triangle to its corners' entries in pNormals, where
+     * pCornerKeys maps a vertex index to the entry it shares with every vertex at the same position.
+     */
+    void AccumulateFaceNormals(
+        const D3DXVECTOR3 * pPositions,
+        const unsigned int * pIndices,
+        size_t indexCount,
+        const unsigned int * pCornerKeys,
+        D3DXVECTOR3 * pNormals)
+    {
+        for (size_t i = 0; i + 2 < indexCount; i += 3)
+        {
+            unsigned int a = pCornerKeys[pIndices[i]];
+            unsigned int b = pCornerKeys[pIndices[i + 1]];
+            unsigned int c = pCornerKeys[pIndices[i + 2]];
+
+            // The cross product's length is twice the triangle's area, so summing unnormalized face
+            // normals weights each face by its area.
+            D3DXVECTOR3 ab = pPositions[b] - pPositions[a], ac = pPositions[c] - pPositions[a], normal;
+            D3DXVec3Cross(&normal, &ab, &ac);
+
+            pNormals[a] += normal;
+            pNormals[b] += normal;
+            pNormals[c] += normal;
+        }
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////
+    // OBJ
+    /////////////////////////////////////////////////////////////////////////////////////////////////
+
+    /**
+     * One corner of an OBJ face: zero based indices of its position, texture coordinate and normal,
+     * with NO_INDEX for a missing texture coordinate or normal.
+     */
+    struct ObjCorner
+    {
+        unsigned int position;
+        unsigned int texcoord;
+        unsigned int normal;
+
+        bool operator ==(const ObjCorner& other) const
+        {
+            return position == other.position && texcoord == other.texcoord && normal == other.normal;
+        }
+    };
+
+    enum class ObjLine
+    {
+        Other,
+        Position,
+        Texcoord,
+        Normal,
+        Face
+    };
+
+    /**
+     * A line aligned slice of an OBJ file parsed by one task. Indices in OBJ faces count every vertex
+     * line from the start of the file, so chunks are counted first to find where each chunk's vertex
+     * data starts, and then parsed straight into the combined vertex data arrays.
+     */
+    struct ObjChunk
+    {
+        const char * pBegin;
+        const char * pEnd;
+        unsigned int positionCount;         // Number of v, vt and vn lines in the chunk.
+        unsigned int texcoordCount;
+        unsigned int normalCount;
+        unsigned int positionBase;          // Number of v, vt and vn lines before the chunk.
+        unsigned int texcoordBase;
+        unsigned int normalBase;
+        std::vector<ObjCorner> corners;     // Three per triangle.
+        const char * pError;                // First malformed line, or null.
+    };
+
+    /**
+     * Works out what kind of data a line holds, and advances the text past the keyword.
+     */
+    ObjLine ClassifyObjLine(const char ** ppText, const char * pEnd)
+    {
+        const char * pText = SkipBlanks(*ppText, pEnd);
+        size_t length = pEnd - pText;
+        ObjLine kind = ObjLine::Other;
+        size_t keywordLength = 0;
+
+        if (length >= 2 && pText[0] == 'v' && IsBlank(pText[1]))
+        {
+            kind = ObjLine::Position;
+            keywordLength = 1;
+        }
+        else if (length >= 3 && pText[0] == 'v' && pText[1] == 't' && IsBlank(pText[2]))
+        {
+            kind = ObjLine::Texcoord;
+            keywordLength = 2;
+        }
+        else if (length >= 3 && pText[0] == 'v' && pText[1] == 'n' && IsBlank(pText[2]))
+        {
+            kind = ObjLine::Normal;
+            keywordLength = 2;
+        }
+        else if (length >= 2 && pText[0] == 'f' && IsBlank(pText[1]))
+        {
+            kind = ObjLine::Face;
+            keywordLength = 1;
+        }
+
+        *ppText = pText + keywordLength;
+        return kind;
+    }
+
+    void CountObjChunk(ObjChunk * pChunk)
+    {
+        pChunk->positionCount = 0;
+        pChunk->texcoordCount = 0;
+        pChunk->normalCount = 0;
+
+        for (const char * pLine = pChunk->pBegin; pLine < pChunk->pEnd; pLine = NextLine(pLine, pChunk->pEnd))
+        {
+            const char * pText = pLine;
+
+            switch (ClassifyObjLine(&pText, pChunk->pEnd))
+            {
+            case ObjLine::Position: ++pChunk->positionCount; break;
+            case ObjLine::Texcoord: ++pChunk->texcoordCount; break;
+            case ObjLine::Normal:   ++pChunk->normalCount;   break;
+            default:                                         break;
+            }
+        }
+    }
+
+    /**
+     * Converts a one based OBJ index (or negative, counting back from the last vertex defined so far)
+     * to zero based.
+     */
+    bool ResolveObjIndex(long long index, unsigned int definedCount, unsigned int totalCount, unsigned int * pIndexOut)
+    {
+        long long resolved = (index < 0) ? definedCount + index : index - 1;
+
+        if (index == 0 || resolved < 0 || resolved >= totalCount)
+        {
+            return false;
+        }
+
+        *pIndexOut = static_cast<unsigned int>(resolved);
+        return true;
+    }
+
+    /**
+     * Parses one face corner, eg "7", "7/3", "7//2" or "7/3/2".
+     */
+    bool ParseObjCorner(
+        const char ** ppText,
+        const char * pLineEnd,
+        const unsigned int definedCounts[3],
+        const unsigned int totalCounts[3],
+        ObjCorner * pCornerOut)
+    {
+        const char * pText = *ppText;
+        long long index = 0;
+
+        pCornerOut->texcoord = NO_INDEX;
+        pCornerOut->normal = NO_INDEX;
+
+        if (!ParseInt(&pText, pLineEnd, &index) ||
+            !ResolveObjIndex(index, definedCounts[0], totalCounts[0], &pCornerOut->position))
+        {
+            return false;
+        }
+
+        if (pText < pLineEnd && *pText == '/')
+        {
+            ++pText;
+
+            if (pText < pLineEnd && *pText != '/')
+            {
+                if (!ParseInt(&pText, pLineEnd, &index) ||
+                    !ResolveObjIndex(index, definedCounts[1], totalCounts[1], &pCornerOut->texcoord))
+                {
+                    return false;
+                }
+            }
+
+            if (pText < pLineEnd && *pText == '/')
+            {
+                ++pText;
+
+                if (!ParseInt(&pText, pLineEnd, &index) ||
+                    !ResolveObjIndex(index, definedCounts[2], totalCounts[2], &pCornerOut->normal))
+                {
+                    return false;
+                }
+            }
+        }
+
+        *ppText = pText;
+        return pText == pLineEnd || IsBlank(*pText);
+    }
+
+    /**
+     * Reads up to count floats from the rest of a line. Missing values are left alone.
+     */
+    void ParseFloats(const char * pText, const char * pLineEnd, float * pValues, unsigned int count)
+    {
+        for (unsigned int i = 0; i < count && ParseFloat(&pText, pLineEnd, &pValues[i]); ++i)
+        {
+        }
+    }
+
+    void ParseObjChunk(
+        ObjChunk * pChunk,
+        const unsigned int totalCounts[3],
+        D3DXVECTOR3 * pPositions,
+        D3DXVECTOR2 * pTexcoords,
+        D3DXVECTOR3 * pNormals)
+    {
+        unsigned int defined[3] = { pChunk->positionBase, pChunk->texcoordBase, pChunk->normalBase };
+        std::vector<ObjCorner> polygon;
+
+        pChunk->pError = nullptr;
+
+        for (const char * pLine = pChunk->pBegin; pLine < pChunk->pEnd; pLine = NextLine(pLine, pChunk->pEnd))
+        {
+            const char * pText = pLine;
+            ObjLine kind = ClassifyObjLine(&pText, pChunk->pEnd);
+
+            if (kind == ObjLine::Other)
+            {
+                continue;
+            }
+
+            const char * pLineEnd = LineEnd(pText, pChunk->pEnd);
+
+            if (kind == ObjLine::Position)
+            {
+                D3DXVECTOR3& position = pPositions[defined[0]++];
+                position = D3DXVECTOR3(0.0f, 0.0f, 0.0f);
+                ParseFloats(pText, pLineEnd, &position.x, 3);
+            }
+            else if (kind == ObjLine::Texcoord)
+            {
+                D3DXVECTOR2& texcoord = pTexcoords[defined[1]++];
+                texcoord = D3DXVECTOR2(0.0f, 0.0f);
+                ParseFloats(pText, pLineEnd, &texcoord.x, 2);
+
+                // OBJ texture coordinates start at the bottom left, Direct3D's at the top left.
+                texcoord.y = 1.0f - texcoord.y;
+            }
+            else if (kind == ObjLine::Normal)
+            {
+                D3DXVECTOR3& normal = pNormals[defined[2]++];
+                normal = D3DXVECTOR3(0.0f, 0.0f, 0.0f);
+                ParseFloats(pText, pLineEnd, &normal.x, 3);
+            }
+            else
+            {
+                polygon.clear();
+
+                for (pText = SkipBlanks(pText, pLineEnd); pText < pLineEnd; pText = SkipBlanks(pText, pLineEnd))
+                {
+                    ObjCorner corner;
+
+                    if (!ParseObjCorner(&pText, pLineEnd, defined, totalCounts, &corner))
+                    {
+                        pChunk->pError = pLine;
+                        return;
+                    }
+
+                    polygon.push_back(corner);
+                }
+
+                // OBJ files are right handed with counter clockwise faces. Read as is into the left
+                // handed engine both the handedness and the winding flip, so the faces still face out.
+                for (size_t i = 2; i < polygon.size(); ++i)
+                {
+                    pChunk->corners.push_back(polygon[0]);
+                    pChunk->corners.push_back(polygon[i - 1]);
+                    pChunk->corners.push_back(polygon[i]);
+                }
+            }
+        }
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////
+    // PLY
+    /////////////////////////////////////////////////////////////////////////////////////////////////
+    enum class PlyFormat
+    {
+        Ascii,
+        BinaryLittleEndian,
+        BinaryBigEndian
+    };
+
+    enum class PlyType
+    {
+        Invalid,
+        Int8,
+        UInt8,
+        Int16,
+        UInt16,
+        Int32,
+        UInt32,
+        Float32,
+        Float64
+    };
+
+    struct PlyProperty
+    {
+        std::string name;
+        PlyType type;           // Type of the value, or of each list item.
+        PlyType countType;      // Type of a list's item count, Invalid if not a list.
+
+        bool IsList() const { return countType != PlyType::Invalid; }
+    };
+
+    struct PlyElement
+    {
+        std::string name;
+        unsigned int count;
+        std::vector<PlyProperty> properties;
+    };
+
+    struct PlyHeader
+    {
+        PlyFormat format;
+        std::vector<PlyElement> elements;
+        size_t dataOffset;
+    };
+
+    /**
+     * Where each vertex attribute comes from, as property indices in the vertex element (-1 if the
+     * file does not have it).
+     */
+    struct PlyVertexLayout
+    {
+        int position[3];
+        int normal[3];
+        int texcoord[2];
+        int color[4];
+        float colorScale[4];    // Maps integer color channels to [0, 1].
+    };
+
+    PlyType ParsePlyType(const std::string& name)
+    {
+        if (name == "char" || name == "int8")       return PlyType::Int8;
+        if (name == "uchar" || name == "uint8")     return PlyType::UInt8;
+        if (name == "short" || name == "int16")     return PlyType::Int16;
+        if (name == "ushort" || name == "uint16")   return PlyType::UInt16;
+        if (name == "int" || name == "int32")       return PlyType::Int32;
+        if (name == "uint" || name == "uint32")     return PlyType::UInt32;
+        if (name == "float" || name == "float32")   return PlyType::Float32;
+        if (name == "double" || name == "float64")  return PlyType::Float64;
+        return PlyType::Invalid;
+    }
+
+    size_t PlyTypeSize(PlyType type)
+    {
+        switch (type)
+        {
+        case PlyType::Int8:
+        case PlyType::UInt8:    return 1;
+        case PlyType::Int16:
+        case PlyType::UInt16:   return 2;
+        case PlyType::Int32:
+        case PlyType::UInt32:
+        case PlyType::Float32:  return 4;
+        case PlyType::Float64:  return 8;
+        default:                return 0;
+        }
+    }
+
+    /**
+     * Reads one binary value of any type, swapping bytes if the file's byte order differs from ours.
+     */
+    double ReadPlyValue(const unsigned char * pData, PlyType type, bool swapBytes)
+    {
+        unsigned char bytes[8];
+        size_t size = PlyTypeSize(type);
+
+        if (swapBytes)
+        {
+            std::reverse_copy(pData, pData + size, bytes);
+        }
+        else
+        {
+            std::memcpy(bytes, pData, size);
+        }
+
+        switch (type)
+        {
+        case PlyType::Int8:     { signed char value;    std::memcpy(&value, bytes, 1); return value; }
+        case PlyType::UInt8:    { unsigned char value;  std::memcpy(&value, bytes, 1); return value; }
+        case PlyType::Int16:    { short value;          std::memcpy(&value, bytes, 2); return value; }
+        case PlyType::UInt16:   { unsigned short value; std::memcpy(&value, bytes, 2); return value; }
+        case PlyType::Int32:    { int value;            std::memcpy(&value, bytes, 4); return value; }
+        case PlyType::UInt32:   { unsigned int value;   std::memcpy(&value, bytes, 4); return value; }
+        case PlyType::Float32:  { float value;          std::memcpy(&value, bytes, 4); return value; }
+        case PlyType::Float64:  { double value;         std::memcpy(&value, bytes, 8); return value; }
+        default:                return 0.0;
+        }
+    }
+
+    bool IsLittleEndianHost()
+    {
+        unsigned int one = 1;
+        unsigned char firstByte = 0;
+        std::memcpy(&firstByte, &one, 1);
+        return firstByte == 1;
+    }
+
+    void SplitWords(const char * pText, const char * pEnd, std::vector<std::string> * pWordsOut)
+    {
+        pWordsOut->clear();
+
+        for (pText = SkipBlanks(pText, pEnd); pText < pEnd; pText = SkipBlanks(pText, pEnd))
+        {
+            const char * pWordEnd = pText;
+
+            while (pWordEnd < pEnd && !IsBlank(*pWordEnd))
+            {
+                ++pWordEnd;
+            }
+
+            pWordsOut->push_back(std::string(pText, pWordEnd));
+            pText = pWordEnd;
+        }
+    }
+
+    bool ReadPlyHeader(const char * pBegin, const char * pEnd, PlyHeader * pHeaderOut, const char ** ppReason)
+    {
+        std::vector<std::string> words;
+        bool hasFormat = false;
+
+        pHeaderOut->elements.clear();
+
+        const char * pLine = pBegin;
+        SplitWords(pLine, LineEnd(pLine, pEnd), &words);
+
+        if (words.size() != 1 || words[0] != "ply")
+        {
+            *ppReason = "missing ply signature";
+            return false;
+        }
+
+        for (pLine = NextLine(pLine, pEnd); pLine < pEnd; pLine = NextLine(pLine, pEnd))
+        {
+            SplitWords(pLine, LineEnd(pLine, pEnd), &words);
+
+            if (words.empty() || words[0] == "comment" || words[0] == "obj_info")
+            {
+                continue;
+            }
+
+            if (words[0] == "end_header")
+            {
+                if (!hasFormat)
+                {
+                    *ppReason = "missing format";
+                    return false;
+                }
+
+                pHeaderOut->dataOffset = NextLine(pLine, pEnd) - pBegin;
+                return true;
+            }
+
+            if (words[0] == "format" && words.size() == 3)
+            {
+                hasFormat = true;
+
+                if (words[1] == "ascii")
+                {
+                    pHeaderOut->format = PlyFormat::Ascii;
+                }
+                else if (words[1] == "binary_little_endian")
+                {
+                    pHeaderOut->format = PlyFormat::BinaryLittleEndian;
+                }
+                else if (words[1] == "binary_big_endian")
+                {
+                    pHeaderOut->format = PlyFormat::BinaryBigEndian;
+                }
+                else
+                {
+                    *ppReason = "unknown format";
+                    return false;
+                }
+            }
+            else if (words[0] == "element" && words.size() == 3)
+            {
+                PlyElement element;
+                element.name = words[1];
+                element.count = static_cast<unsigned int>(std::strtoul(words[2].c_str(), nullptr, 10));
+
+                pHeaderOut->elements.push_back(element);
+            }
+            else if (words[0] == "property" && !pHeaderOut->elements.empty())
+            {
+                PlyProperty property;
+
+                if (words.size() == 5 && words[1] == "list")
+                {
+                    property.countType = ParsePlyType(words[2]);
+                    property.type = ParsePlyType(words[3]);
+                    property.name = words[4];
+
+                    if (property.countType == PlyType::Invalid || property.countType == PlyType::Float32 ||
+                        property.countType == PlyType::Float64)
+                    {
+                        *ppReason = "bad list count type";
+                        return false;
+                    }
+                }
+                else if (words.size() == 3)
+                {
+                    property.countType = PlyType::Invalid;
+                    property.type = ParsePlyType(words[1]);
+                    property.name = words[2];
+                }
+                else
+                {
+                    property.type = PlyType::Invalid;
+                }
+
+                if (property.type == PlyType::Invalid)
+                {
+                    *ppReason = "bad property";
+                    return false;
+                }
+
+                pHeaderOut->elements.back().properties.push_back(property);
+            }
+            else
+            {
+                *ppReason = "unexpected header line";
+                return false;
+            }
+        }
+
+        *ppReason = "missing end_header";
+        return false;
+    }
+
+    int FindPlyProperty(const PlyElement& element, const char * pName, const char * pOtherName = nullptr, const char * pThirdName = nullptr)
+    {
+        for (size_t i = 0; i < element.properties.size(); ++i)
+        {
+            const std::string& name = element.properties[i].name;
+
+            if (name == pName || (pOtherName != nullptr && name == pOtherName) || (pThirdName != nullptr && name == pThirdName))
+            {
+                return element.properties[i].IsList() ? -1 : static_cast<int>(i);
+            }
+        }
+
+        return -1;
+    }
+
+    void FindPlyVertexLayout(const PlyElement& element, PlyVertexLayout * pLayoutOut)
+    {
+        pLayoutOut->position[0] = FindPlyProperty(element, "x");
+        pLayoutOut->position[1] = FindPlyProperty(element, "y");
+        pLayoutOut->position[2] = FindPlyProperty(element, "z");
+        pLayoutOut->normal[0] = FindPlyProperty(element, "nx");
+        pLayoutOut->normal[1] = FindPlyProperty(element, "ny");
+        pLayoutOut->normal[2] = FindPlyProperty(element, "nz");
+        pLayoutOut->texcoord[0] = FindPlyProperty(element, "u", "s", "texture_u");
+        pLayoutOut->texcoord[1] = FindPlyProperty(element, "v", "t", "texture_v");
+        pLayoutOut->color[0] = FindPlyProperty(element, "red", "r");
+        pLayoutOut->color[1] = FindPlyProperty(element, "green", "g");
+        pLayoutOut->color[2] = FindPlyProperty(element, "blue", "b");
+        pLayoutOut->color[3] = FindPlyProperty(element, "alpha", "a");
+
+        for (int i = 0; i < 4; ++i)
+        {
+            int property = pLayoutOut->color[i];
+            PlyType type = (property >= 0) ? element.properties[property].type : PlyType::Float32;
+
+            pLayoutOut->colorScale[i] =
+                (type == PlyType::UInt8 || type == PlyType::Int8) ? 1.0f / 255.0f :
+                (type == PlyType::UInt16 || type == PlyType::Int16) ? 1.0f / 65535.0f :
+                1.0f;
+        }
+    }
+
+    bool HasPlyNormals(const PlyVertexLayout& layout)
+    {
+        return layout.normal[0] >= 0 && layout.normal[1] >= 0 && layout.normal[2] >= 0;
+    }
+
+    /**
+     * Builds a vertex from the values of every property in a vertex element.
+     */
+    void AssignPlyVertex(const PlyVertexLayout& layout, const float * pValues, StaticMeshVertex * pVertexOut)
+    {
+        float * pPosition = &pVertexOut->pos.x;
+        float * pNormal = &pVertexOut->normal.x;
+        float * pColor = &pVertexOut->color.r;
+
+        for (int i = 0; i < 3; ++i)
+        {
+            pPosition[i] = (layout.position[i] >= 0) ? pValues[layout.position[i]] : 0.0f;
+            pNormal[i] = (layout.normal[i] >= 0) ? pValues[layout.normal[i]] : 0.0f;
+        }
+
+        for (int i = 0; i < 4; ++i)
+        {
+            pColor[i] = (layout.color[i] >= 0) ? pValues[layout.color[i]] * layout.colorScale[i] : 1.0f;
+        }
+
+        // Like OBJ, PLY texture coordinates start at the bottom left.
+        pVertexOut->texcoord.x = (layout.texcoord[0] >= 0) ? pValues[layout.texcoord[0]] : 0.0f;
+        pVertexOut->texcoord.y = (layout.texcoord[1] >= 0) ? 1.0f - pValues[layout.texcoord[1]] : 0.0f;
+
+        D3DXVec3Normalize(&pVertexOut->normal, &pVertexOut->normal);
+    }
+
+    bool IsPlyIndexList(const PlyProperty& property)
+    {
+        return property.IsList() && (property.name == "vertex_indices" || property.name == "vertex_index");
+    }
+
+    /**
+     * Splits a polygon into a triangle fan. PLY faces are counter clockwise in a right handed space
+     * like OBJ's, so the same reasoning applies and the order is kept as is.
+     */
+    bool AddPlyPolygon(const std::vector<long long>& polygon, unsigned int vertexCount, std::vector<unsigned int> * pIndices)
+    {
+        for (size_t i = 0; i < polygon.size(); ++i)
+        {
+            if (polygon[i] < 0 || polygon[i] >= vertexCount)
+            {
+                return false;
+            }
+        }
+
+        for (size_t i = 2; i < polygon.size(); ++i)
+        {
+            pIndices->push_back(static_cast<unsigned int>(polygon[0]));
+            pIndices->push_back(static_cast<unsigned int>(polygon[i - 1]));
+            pIndices->push_back(static_cast<unsigned int>(polygon[i]));
+        }
+
+        return true;
+    }
+
+    /**
+     * The fewest bytes one item of an element can take up. A binary item holds every scalar and every
+     * list count, and an ASCII item has at least one digit and a separator per property.
+     */
+    unsigned long long MinPlyItemBytes(const PlyElement& element, PlyFormat format)
+    {
+        unsigned long long bytes = 0;
+
+        for (size_t i = 0; i < element.properties.size(); ++i)
+        {
+            const PlyProperty& property = element.properties[i];
+
+            if (format == PlyFormat::Ascii)
+            {
+                bytes += 2;
+            }
+            else
+            {
+                bytes += PlyTypeSize(property.IsList() ? property.countType : property.type);
+            }
+        }
+
+        return (format == PlyFormat::Ascii) ? std::max(bytes, 1ull) : bytes;
+    }
+
+    /**
+     * Checks that the element counts in a header could fit in the bytes that follow it, so a corrupt
+     * count is caught before anything is allocated for it.
+     */
+    bool PlyElementsFit(const PlyHeader& header, size_t dataBytes)
+    {
+        // The last ASCII line does not need a line break.
+        unsigned long long bytesLeft = dataBytes + ((header.format == PlyFormat::Ascii) ? 1 : 0);
+
+        for (size_t i = 0; i < header.elements.size(); ++i)
+        {
+            unsigned long long itemBytes = MinPlyItemBytes(header.elements[i], header.format);
+            unsigned long long count = header.elements[i].count;
+
+            if (itemBytes > 0 && bytesLeft / itemBytes < count)
+            {
+                return false;
+            }
+
+            bytesLeft -= itemBytes * count;
+        }
+
+        return true;
+    }
+
+    /**
+     * A line aligned run of an ASCII element's items parsed by one task.
+     */
+    struct PlyTextChunk
+    {
+        const char * pBegin;
+        const char * pEnd;
+        unsigned int firstItem;
+        std::vector<unsigned int> indices;  // Triangles read from a face chunk.
+        bool failed;
+    };
+
+    /**
+     * Finds the end of an ASCII element's items, splitting them into chunks along the way. Returns
+     * null if the file ends first.
+     */
+    const char * SplitPlyTextElement(
+        const char * pText,
+        const char * pEnd,
+        unsigned int itemCount,
+        size_t chunkBytes,
+        std::vector<PlyTextChunk> * pChunksOut)
+    {
+        pChunksOut->clear();
+
+        PlyTextChunk chunk;
+        chunk.pBegin = pText;
+        chunk.firstItem = 0;
+        chunk.failed = false;
+
+        for (unsigned int item = 0; item < itemCount; ++item)
+        {
+            if (pText >= pEnd)
+            {
+                return nullptr;
+            }
+
+            if (static_cast<size_t>(pText - chunk.pBegin) >= chunkBytes)
+            {
+                chunk.pEnd = pText;
+                pChunksOut->push_back(chunk);
+
+                chunk.pBegin = pText;
+                chunk.firstItem = item;
+            }
+
+            pText = NextLine(pText, pEnd);
+        }
+
+        chunk.pEnd = pText;
+        pChunksOut->push_back(chunk);
+        return pText;
+    }
+
+    bool ParsePlyTextVertices(
+        PlyTextChunk * pChunk,
+        const PlyElement& element,
+        const PlyVertexLayout& layout,
+        StaticMeshVertex * pVertices)
+    {
+        std::vector<float> values(element.properties.size(), 0.0f);
+        unsigned int item = pChunk->firstItem;
+
+        for (const char * pLine = pChunk->pBegin; pLine < pChunk->pEnd; pLine = NextLine(pLine, pChunk->pEnd))
+        {
+            const char * pText = pLine;
+            const char * pLineEnd = LineEnd(pLine, pChunk->pEnd);
+
+            for (size_t i = 0; i < values.size(); ++i)
+            {
+                if (!ParseFloat(&pText, pLineEnd, &values[i]))
+                {
+                    return false;
+                }
+            }
+
+            AssignPlyVertex(layout, &values[0], &pVertices[item++]);
+        }
+
+        return true;
+    }
+
+    bool ParsePlyTextFaces(PlyTextChunk * pChunk, const PlyElement& element, unsigned int vertexCount)
+    {
+        std::vector<long long> polygon;
+
+        for (const char * pLine = pChunk->pBegin; pLine < pChunk->pEnd; pLine = NextLine(pLine, pChunk->pEnd))
+        {
+            const char * pText = pLine;
+            const char * pLineEnd = LineEnd(pLine, pChunk->pEnd);
+
+            for (size_t p = 0; p < element.properties.size(); ++p)
+            {
+                const PlyProperty& property = element.properties[p];
+                long long count = 1;
+                float ignored = 0.0f;
+
+                // A list can't be longer than the rest of its line, so a corrupt count is caught
+                // before anything is allocated for it.
+                if (property.IsList() &&
+                    (!ParseInt(&pText, pLineEnd, &count) ||
+                     count < 0 ||
+                     static_cast<unsigned long long>(count) > CountTokens(pText, pLineEnd)))
+                {
+                    return false;
+                }
+
+                if (IsPlyIndexList(property))
+                {
+                    polygon.resize(static_cast<size_t>(count));
+
+                    for (long long i = 0; i < count; ++i)
+                    {
+                        if (!ParseInt(&pText, pLineEnd, &polygon[static_cast<size_t>(i)]))
+                        {
+                            return false;
+                        }
+                    }
+
+                    if (!AddPlyPolygon(polygon, vertexCount, &pChunk->indices))
+                    {
+                        return false;
+                    }
+                }
+                else
+                {
+                    for (long long i = 0; i < count; ++i)
+                    {
+                        if (!ParseFloat(&pText, pLineEnd, &ignored))
+                        {
+                            return false;
+                        }
+                    }
+                }
+            }
+        }
+
+        return true;
+    }
+
+    /**
+     * Walks (and optionally reads the faces from) the items of a binary element. Items with lists
+     * vary in size, so they can only be found by walking them in order. Returns null if the file ends
+     * first or a face is malformed.
+     */
+    const unsigned char * ReadPlyBinaryItems(
+        const unsigned char * pData,
+        const unsigned char * pEnd,
+        const PlyElement& element,
+        bool swapBytes,
+        unsigned int vertexCount,
+        std::vector<unsigned int> * pIndices)
+    {
+        std::vector<long long> polygon;
+
+        for (unsigned int item = 0; item < element.count; ++item)
+        {
+            for (size_t p = 0; p < element.properties.size(); ++p)
+            {
+                const PlyProperty& property = element.properties[p];
+                size_t itemSize = PlyTypeSize(property.type);
+                size_t count = 1;
+
+                if (property.IsList())
+                {
+                    size_t countSize = PlyTypeSize(property.countType);
+
+                    if (static_cast<size_t>(pEnd - pData) < countSize)
+                    {
+                        return nullptr;
+                    }
+
+                    // Signed or floating point counts can be negative or too large to convert.
+                    double countValue = ReadPlyValue(pData, property.countType, swapBytes);
+                    pData += countSize;
+
+                    if (!(countValue >= 0.0 && countValue <= static_cast<double>(pEnd - pData)))
+                    {
+                        return nullptr;
+                    }
+
+                    count = static_cast<size_t>(countValue);
+                }
+
+                if (static_cast<size_t>(pEnd - pData) / itemSize < count)
+                {
+                    return nullptr;
+                }
+
+                if (pIndices != nullptr && IsPlyIndexList(property))
+                {
+                    polygon.resize(count);
+
+                    for (size_t i = 0; i < count; ++i)
+                    {
+                        polygon[i] = static_cast<long long>(ReadPlyValue(pData + i * itemSize, property.type, swapBytes));
+                    }
+
+                    if (!AddPlyPolygon(polygon, vertexCount, pIndices))
+                    {
+                        return nullptr;
+                    }
+                }
+
+                pData += count * itemSize;
+            }
+        }
+
+        return pData;
+    }
+
+    template<typename Function>
+    unsigned int RunChunks(unsigned int chunkCount, unsigned int threadCount, const Function& function)
+    {
+        Parallel::ForStats stats = { 0 };
+
+        Parallel::For(chunkCount, threadCount, [&](unsigned int chunk, unsigned int /*worker*/)
+        {
+            function(chunk);
+        }, &stats);
+
+        return stats.threadCount;
+    }
+
+    void BeginStats(size_t fileBytes, MeshImportStats * pStatsOut)
+    {
+        if (pStatsOut != nullptr)
+        {
+            MeshImportStats noStats = { 0 };
+            *pStatsOut = noStats;
+            pStatsOut->fileBytes = fileBytes;
+        }
+    }
+}
+
+MeshImportParams::MeshImportParams()
+    : threadCount(0),
+      chunkBytes(1024 * 1024),
+      weldVertices(true)
+{
+}
+
+double MeshImportStats::MegabytesPerSecond() const
+{
+    return (seconds > 0.0) ? static_cast<double>(fileBytes) / (1024.0 * 1024.0) / seconds : 0.0;
+}
+
+namespace MeshImporter
+{
+    bool LoadObj(
+        const std::wstring& path,
+        std::vector<StaticMeshVertex> * pVerticesOut,
+        std::vector<unsigned int> * pIndicesOut,
+        const MeshImportParams& params,
+        MeshImportStats * pStatsOut)
+    {
+        VerifyNotNull(pVerticesOut);
+        VerifyNotNull(pIndicesOut);
+
+        Stopwatch timer;
+
+        pVerticesOut->clear();
+        pIndicesOut->clear();
+
+        MappedFile file;
+
+        if (!file.Open(path))
+        {
+            LOG_WARN("MeshImporter") << "Could not open " << NarrowPath(path);
+            return false;
+        }
+
+        BeginStats(file.Size(), pStatsOut);
+
+        // Count the vertex data in each chunk, then parse every chunk straight into its slice of the
+        // combined vertex data.
+        const char * pBegin = reinterpret_cast<const char *>(file.Data());
+        std::vector<const char *> boundaries;
+        SplitLines(pBegin, pBegin + file.Size(), std::max(params.chunkBytes, 1u), &boundaries);
+
+        std::vector<ObjChunk> chunks(boundaries.size() - 1);
+        unsigned int chunkCount = static_cast<unsigned int>(chunks.size());
+
+        for (unsigned int i = 0; i < chunkCount; ++i)
+        {
+            chunks[i].pBegin = boundaries[i];
+            chunks[i].pEnd = boundaries[i + 1];
+        }
+
+        RunChunks(chunkCount, params.threadCount, [&](unsigned int chunk) { CountObjChunk(&chunks[chunk]); });
+
+        unsigned int totals[3] = { 0, 0, 0 };
+
+        for (unsigned int i = 0; i < chunkCount; ++i)
+        {
+            chunks[i].positionBase = totals[0];
+            chunks[i].texcoordBase = totals[1];
+            chunks[i].normalBase = totals[2];
+
+            totals[0] += chunks[i].positionCount;
+            totals[1] += chunks[i].texcoordCount;
+            totals[2] += chunks[i].normalCount;
+        }
+
+        std::vector<D3DXVECTOR3> positions(totals[0]), normals(totals[2]);
+        std::vector<D3DXVECTOR2> texcoords(totals[1]);
+
+        unsigned int threadCount = RunChunks(chunkCount, params.threadCount, [&](unsigned int chunk)
+        {
+            ParseObjChunk(
+                &chunks[chunk],
+                totals,
+                positions.empty() ? nullptr : &positions[0],
+                texcoords.empty() ? nullptr : &texcoords[0],
+                normals.empty() ? nullptr : &normals[0]);
+        });
+
+        size_t cornerCount = 0;
+
+        for (unsigned int i = 0; i < chunkCount; ++i)
+        {
+            if (chunks[i].pError != nullptr)
+            {
+                LOG_WARN("MeshImporter") << NarrowPath(path) << "(" << LineNumber(pBegin, chunks[i].pError)
+                    << "): bad face index";
+                return false;
+            }
+
+            cornerCount += chunks[i].corners.size();
+        }
+
+        // Weld corners with the same indices into one vertex. Positions are usually shared by a handful
+        // of corners, so their count is a good guess at the number of unique corners.
+        std::vector<ObjCorner> uniqueCorners;
+        WeldTable table(positions.size());
+        bool missingNormals = false;
+
+        pIndicesOut->reserve(cornerCount);
+
+        for (unsigned int i = 0; i < chunkCount; ++i)
+        {
+            std::vector<ObjCorner>& corners = chunks[i].corners;
+
+            for (size_t c = 0; c < corners.size(); ++c)
+            {
+                const ObjCorner& corner = corners[c];
+                unsigned int uniqueCount = static_cast<unsigned int>(uniqueCorners.size());
+
+                unsigned int vertex = table.FindOrAdd(
+                    HashWords(&corner, sizeof(corner)),
+                    uniqueCount,
+                    [&](unsigned int other) { return uniqueCorners[other] == corner; });
+
+                if (vertex == uniqueCount)
+                {
+                    uniqueCorners.push_back(corner);
+                    missingNormals |= (corner.normal == NO_INDEX);
+                }
+
+                pIndicesOut->push_back(vertex);
+            }
+
+            std::vector<ObjCorner>().swap(corners);
+        }
+
+        // Generate smooth normals for any position used by a corner without one.
+        std::vector<D3DXVECTOR3> generatedNormals;
+
+        if (missingNormals && !pIndicesOut->empty())
+        {
+            std::vector<unsigned int> cornerPositions(uniqueCorners.size());
+
+            for (size_t i = 0; i < uniqueCorners.size(); ++i)
+            {
+                cornerPositions[i] = uniqueCorners[i].position;
+            }
+
+            generatedNormals.assign(positions.size(), D3DXVECTOR3(0.0f, 0.0f, 0.0f));
+            AccumulateFaceNormals(&positions[0], &(*pIndicesOut)[0], pIndicesOut->size(), &cornerPositions[0], &generatedNormals[0]);
+        }
+
+        pVerticesOut->resize(uniqueCorners.size());
+
+        for (size_t i = 0; i < uniqueCorners.size(); ++i)
+        {
+            const ObjCorner& corner = uniqueCorners[i];
+            StaticMeshVertex& vertex = (*pVerticesOut)[i];
+
+            vertex.pos = positions[corner.position];
+            vertex.normal = (corner.normal != NO_INDEX) ? normals[corner.normal] : generatedNormals[corner.position];
+            vertex.texcoord = (corner.texcoord != NO_INDEX) ? texcoords[corner.texcoord] : D3DXVECTOR2(0.0f, 0.0f);
+            vertex.color = D3DXCOLOR(1.0f, 1.0f, 1.0f, 1.0f);
+
+            D3DXVec3Normalize(&vertex.normal, &vertex.normal);
+        }
+
+        if (params.weldVertices)
+        {
+            // Catches files that repeat the same position or texture coordinate under different indices.
+            WeldIdenticalVertices(pVerticesOut, pIndicesOut);
+        }
+
+        if (pStatsOut != nullptr)
+        {
+            pStatsOut->seconds = timer.ElapsedSeconds();
+            pStatsOut->threadCount = threadCount;
+            pStatsOut->chunkCount = chunkCount;
+            pStatsOut->sourceVertexCount = static_cast<unsigned int>(pIndicesOut->size());
+            pStatsOut->vertexCount = static_cast<unsigned int>(pVerticesOut->size());
+            pStatsOut->triangleCount = static_cast<unsigned int>(pIndicesOut->size() / 3);
+            pStatsOut->generatedNormals = missingNormals;
+        }
+
+        return true;
+    }
+
+    bool LoadPly(
+        const std::wstring& path,
+        std::vector<StaticMeshVertex> * pVerticesOut,
+        std::vector<unsigned int> * pIndicesOut,
+        const MeshImportParams& params,
+        MeshImportStats * pStatsOut)
+    {
+        VerifyNotNull(pVerticesOut);
+        VerifyNotNull(pIndicesOut);
+
+        Stopwatch timer;
+
+        pVerticesOut->clear();
+        pIndicesOut->clear();
+
+        MappedFile file;
+
+        if (!file.Open(path))
+        {
+            LOG_WARN("MeshImporter") << "Could not open " << NarrowPath(path);
+            return false;
+        }
+
+        BeginStats(file.Size(), pStatsOut);
+
+        const char * pBegin = reinterpret_cast<const char *>(file.Data());
+        const char * pEnd = pBegin + file.Size();
+        const char * pReason = nullptr;
+        PlyHeader header;
+
+        if (!ReadPlyHeader(pBegin, pEnd, &header, &pReason))
+        {
+            LOG_WARN("MeshImporter") << NarrowPath(path) << ": " << pReason;
+            return false;
+        }
+
+        const PlyElement * pVertexElement = nullptr;
+
+        for (size_t i = 0; i < header.elements.size(); ++i)
+        {
+            if (header.elements[i].name == "vertex")
+            {
+                pVertexElement = &header.elements[i];
+            }
+        }
+
+        PlyVertexLayout layout;
+
+        if (pVertexElement != nullptr)
+        {
+            FindPlyVertexLayout(*pVertexElement, &layout);
+        }
+
+        if (pVertexElement == nullptr || layout.position[0] < 0 || layout.position[1] < 0 || layout.position[2] < 0)
+        {
+            LOG_WARN("MeshImporter") << NarrowPath(path) << ": no vertex positions";
+            return false;
+        }
+
+        for (size_t i = 0; i < pVertexElement->properties.size(); ++i)
+        {
+            if (pVertexElement->properties[i].IsList())
+            {
+                LOG_WARN("MeshImporter") << NarrowPath(path) << ": vertices with list properties are not supported";
+                return false;
+            }
+        }
+
+        if (!PlyElementsFit(header, static_cast<size_t>(pEnd - pBegin) - header.dataOffset))
+        {
+            LOG_WARN("MeshImporter") << NarrowPath(path) << ": element counts are larger than the file";
+            return false;
+        }
+
+        unsigned int vertexCount = pVertexElement->count;
+        size_t chunkBytes = std::max(params.chunkBytes, 1u);
+        unsigned int threadCount = 0, chunkCount = 0;
+        bool swapBytes = (header.format == PlyFormat::BinaryBigEndian) == IsLittleEndianHost();
+
+        pVerticesOut->resize(vertexCount);
+
+        const char * pText = pBegin + header.dataOffset;
+        std::vector<PlyTextChunk> textChunks;
+
+        for (size_t e = 0; e < header.elements.size() && pText != nullptr; ++e)
+        {
+            const PlyElement& element = header.elements[e];
+            bool isVertex = (&element == pVertexElement);
+            bool isFace = (element.name == "face");
+
+            if (header.format == PlyFormat::Ascii)
+            {
+                const char * pElementEnd = SplitPlyTextElement(pText, pEnd, element.count, chunkBytes, &textChunks);
+
+                if (pElementEnd != nullptr && (isVertex || isFace))
+                {
+                    unsigned int count = static_cast<unsigned int>(textChunks.size());
+
+                    threadCount = std::max(threadCount, RunChunks(count, params.threadCount, [&](unsigned int chunk)
+                    {
+                        PlyTextChunk& textChunk = textChunks[chunk];
+
+                        textChunk.failed = isVertex ?
+                            !ParsePlyTextVertices(&textChunk, element, layout, pVerticesOut->empty() ? nullptr : &(*pVerticesOut)[0]) :
+                            !ParsePlyTextFaces(&textChunk, element, vertexCount);
+                    }));
+
+                    chunkCount += count;
+
+                    for (size_t i = 0; i < textChunks.size() && pElementEnd != nullptr; ++i)
+                    {
+                        if (textChunks[i].failed)
+                        {
+                            pElementEnd = nullptr;
+                        }
+                        else if (isFace)
+                        {
+                            pIndicesOut->insert(pIndicesOut->end(), textChunks[i].indices.begin(), textChunks[i].indices.end());
+                        }
+                    }
+                }
+
+                pText = pElementEnd;
+            }
+            else if (isVertex)
+            {
+                // Vertices have a fixed size, so they can be split between tasks without walking them.
+                std::vector<size_t> offsets(element.properties.size());
+                size_t stride = 0;
+
+                for (size_t i = 0; i < element.properties.size(); ++i)
+                {
+                    offsets[i] = stride;
+                    stride += PlyTypeSize(element.properties[i].type);
+                }
+
+                if (static_cast<size_t>(pEnd - pText) / stride < vertexCount)
+                {
+                    pText = nullptr;
+                    break;
+                }
+
+                const unsigned char * pData = reinterpret_cast<const unsigned char *>(pText);
+                unsigned int verticesPerChunk = static_cast<unsigned int>(std::max(chunkBytes / stride, static_cast<size_t>(1)));
+                unsigned int count = (vertexCount + verticesPerChunk - 1) / verticesPerChunk;
+
+                threadCount = std::max(threadCount, RunChunks(count, params.threadCount, [&](unsigned int chunk)
+                {
+                    std::vector<float> values(element.properties.size());
+                    unsigned int first = chunk * verticesPerChunk;
+                    unsigned int last = std::min(first + verticesPerChunk, vertexCount);
+
+                    for (unsigned int v = first; v < last; ++v)
+                    {
+                        const unsigned char * pVertex = pData + static_cast<size_t>(v) * stride;
+
+                        for (size_t i = 0; i < values.size(); ++i)
+                        {
+                            values[i] = static_cast<float>(ReadPlyValue(pVertex + offsets[i], element.properties[i].type, swapBytes));
+                        }
+
+                        AssignPlyVertex(layout, &values[0], &(*pVerticesOut)[v]);
+                    }
+                }));
+
+                chunkCount += count;
+                pText += static_cast<size_t>(vertexCount) * stride;
+            }
+            else
+            {
+                const unsigned char * pData = ReadPlyBinaryItems(
+                    reinterpret_cast<const unsigned char *>(pText),
+                    reinterpret_cast<const unsigned char *>(pEnd),
+                    element,
+                    swapBytes,
+                    vertexCount,
+                    isFace ? pIndicesOut : nullptr);
+
+                pText = reinterpret_cast<const char *>(pData);
+            }
+        }
+
+        if (pText == nullptr)
+        {
+            LOG_WARN("MeshImporter") << NarrowPath(path) << ": truncated or malformed element data";
+            pVerticesOut->clear();
+            pIndicesOut->clear();
+            return false;
+        }
+
+        if (params.weldVertices)
+        {
+            WeldIdenticalVertices(pVerticesOut, pIndicesOut);
+        }
+
+        // Generate smooth normals, sharing them between vertices at the same position (eg on either side
+        // of a texture seam) so the seam does not show up in the lighting.
+        bool generateNormals = !HasPlyNormals(layout) && !pIndicesOut->empty();
+
+        if (generateNormals)
+        {
+            std::vector<StaticMeshVertex>& vertices = *pVerticesOut;
+            std::vector<D3DXVECTOR3> positions;
+            std::vector<unsigned int> vertexPositions(vertices.size());
+            WeldTable table(vertices.size());
+
+            for (size_t i = 0; i < vertices.size(); ++i)
+            {
+                const D3DXVECTOR3& position = vertices[i].pos;
+                unsigned int uniqueCount = static_cast<unsigned int>(positions.size());
+
+                vertexPositions[i] = table.FindOrAdd(
+                    HashWords(&position, sizeof(position)),
+                    uniqueCount,
+                    [&](unsigned int other) { return std::memcmp(&positions[other], &position, sizeof(position)) == 0; });
+
+                if (vertexPositions[i] == uniqueCount)
+                {
+                    positions.push_back(position);
+                }
+            }
+
+            std::vector<D3DXVECTOR3> normals(positions.size(), D3DXVECTOR3(0.0f, 0.0f, 0.0f));
+            AccumulateFaceNormals(&positions[0], &(*pIndicesOut)[0], pIndicesOut->size(), &vertexPositions[0], &normals[0]);
+
+            for (size_t i = 0; i < vertices.size(); ++i)
+            {
+                D3DXVec3Normalize(&vertices[i].normal, &normals[vertexPositions[i]]);
+            }
+        }
+
+        if (pStatsOut != nullptr)
+        {
+            pStatsOut->seconds = timer.ElapsedSeconds();
+            pStatsOut->threadCount = threadCount;
+            pStatsOut->chunkCount = chunkCount;
+            pStatsOut->sourceVertexCount = vertexCount;
+            pStatsOut->vertexCount = static_cast<unsigned int>(pVerticesOut->size());
+            pStatsOut->triangleCount = static_cast<unsigned int>(pIndicesOut->size() / 3);
+            pStatsOut->generatedNormals = generateNormals;
+        }
+
+        return true;
+    }
+
+    bool Load(
+        const std::wstring& path,
+        std::vector<StaticMeshVertex> * pVerticesOut,
+        std::vector<unsigned int> * pIndicesOut,
+        const MeshImportParams& params,
+        MeshImportStats * pStatsOut)
+    {
+        size_t dot = path.find_last_of(L'.');
+        std::wstring extension = (dot != std::wstring::npos) ? path.substr(dot + 1) : std::wstring();
+
+        for (size_t i = 0; i < extension.size(); ++i)
+        {
+            extension[i] = static_cast<wchar_t>(std::towlower(extension[i]));
+        }
+
+        if (extension == L"ply")
+        {
+            return LoadPly(path, pVerticesOut, pIndicesOut, params, pStatsOut);
+        }
+
+        return LoadObj(path, pVerticesOut, pIndicesOut, params, pStatsOut);
+    }
+}
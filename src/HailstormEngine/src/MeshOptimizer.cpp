@@ -0,0 +1,463 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "stdafx.h"
+#include "graphics/MeshOptimizer.h"
+
+#include "runtime/logging.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+    const unsigned int INVALID_VERTEX = 0xFFFFFFFFu;
+
+    // Size of the LRU cache modeled while optimizing. Forsyth's scoring is tuned for a cache of 32
+    // entries, and gives good results on hardware caches of other sizes too.
+    const unsigned int OPTIMIZER_CACHE_SIZE = 32;
+
+    const float CACHE_DECAY_POWER = 1.5f;
+    const float LAST_TRIANGLE_SCORE = 0.75f;
+    const float VALENCE_BOOST_SCALE = 2.0f;
+    const float VALENCE_BOOST_POWER = 0.5f;
+
+    const unsigned int VALENCE_TABLE_SIZE = 64;
+
+    /**
+     * Precomputed vertex scores from Forsyth's paper. Vertices that are in the cache score higher the
+     * more recently they were used, except the three vertices of the last triangle which get a fixed
+     * score so the next triangle is not biased to share an edge. Vertices with only a few triangles
+     * left get a boost so they are finished off rather than left lying around.
+     */
+    class ScoreTable
+    {
+    public:
+        ScoreTable()
+        {
+            for (unsigned int i = 0; i < OPTIMIZER_CACHE_SIZE; ++i)
+            {
+                if (i < 3)
+                {
+                    mCacheScore[i] = LAST_TRIANGLE_SCORE;
+                }
+                else
+                {
+                    float scaler = 1.0f / (OPTIMIZER_CACHE_SIZE - 3);
+                    mCacheScore[i] = std::pow(1.0f - (i - 3) * scaler, CACHE_DECAY_POWER);
+                }
+            }
+
+            mValenceScore[0] = 0.0f;
+
+            for (unsigned int i = 1; i < VALENCE_TABLE_SIZE; ++i)
+            {
+                mValenceScore[i] = VALENCE_BOOST_SCALE * std::pow(static_cast<float>(i), -VALENCE_BOOST_POWER);
+            }
+        }
+
+        float Score(int cachePosition, unsigned int remainingTriangles) const
+        {
+            if (remainingTriangles == 0)
+            {
+                return -1.0f;       // No triangles left to draw, the vertex no longer matters.
+            }
+
+            float score = (cachePosition >= 0 ? mCacheScore[cachePosition] : 0.0f);
+
+            if (remainingTriangles < VALENCE_TABLE_SIZE)
+            {
+                score += mValenceScore[remainingTriangles];
+            }
+            else
+            {
+                score += VALENCE_BOOST_SCALE * std::pow(static_cast<float>(remainingTriangles), -VALENCE_BOOST_POWER);
+            }
+
+            return score;
+        }
+
+    private:
+        float mCacheScore[OPTIMIZER_CACHE_SIZE];
+        float mValenceScore[VALENCE_TABLE_SIZE];
+    };
+
+    // Built once at startup rather than as a function static, which VS2013 does not initialize in a
+    // thread safe way.
+    const ScoreTable gScores;
+
+    /**
+     * Forsyth's greedy optimizer on a triangle list whose vertex indices are all below vertexCount.
+     * The reordered list is written to pIndicesOut.
+     */
+    void OptimizeTriangles(
+        const unsigned int * pIndices,
+        unsigned int indexCount,
+        unsigned int vertexCount,
+        unsigned int * pIndicesOut)
+    {
+        const unsigned int triangleCount = indexCount / 3;
+
+        // Triangles that use each vertex, stored compactly. The first remaining[v] entries of vertex v's
+        // list are the triangles that have not been drawn yet.
+        std::vector<unsigned int> adjacencyStart(vertexCount + 1, 0);
+        std::vector<unsigned int> remaining(vertexCount, 0);
+
+        for (unsigned int i = 0; i < indexCount; ++i)
+        {
+            ++remaining[pIndices[i]];
+        }
+
+        for (unsigned int v = 0; v < vertexCount; ++v)
+        {
+            adjacencyStart[v + 1] = adjacencyStart[v] + remaining[v];
+        }
+
+        std::vector<unsigned int> adjacency(indexCount);
+        std::vector<unsigned int> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+
+        for (unsigned int t = 0; t < triangleCount; ++t)
+        {
+            for (unsigned int k = 0; k < 3; ++k)
+            {
+                adjacency[fill[pIndices[t * 3 + k]]++] = t;
+            }
+        }
+
+        // Initial scores.
+        std::vector<int> cachePosition(vertexCount, -1);
+        std::vector<float> vertexScore(vertexCount);
+        std::vector<float> triangleScore(triangleCount);
+        std::vector<char> emitted(triangleCount, 0);
+
+        for (unsigned int v = 0; v < vertexCount; ++v)
+        {
+            vertexScore[v] = gScores.Score(-1, remaining[v]);
+        }
+
+        int bestTriangle = -1;
+        float bestScore = -1.0f;
+
+        for (unsigned int t = 0; t < triangleCount; ++t)
+        {
+            triangleScore[t] = vertexScore[pIndices[t * 3]] + vertexScore[pIndices[t * 3 + 1]] + vertexScore[pIndices[t * 3 + 2]];
+
+            if (triangleScore[t] > bestScore)
+            {
+                bestScore = triangleScore[t];
+                bestTriangle = static_cast<int>(t);
+            }
+        }
+
+        // Simulated LRU cache, with room for the three vertices pushed in by each new triangle.
+        unsigned int cache[OPTIMIZER_CACHE_SIZE + 3];
+        unsigned int cacheCount = 0;
+        unsigned int nextUnemitted = 0;
+
+        for (unsigned int output = 0; output < triangleCount; ++output)
+        {
+            // None of the triangles touching the cache are left, fall back to the first one not drawn.
+            if (bestTriangle < 0)
+            {
+                while (emitted[nextUnemitted])
+                {
+                    ++nextUnemitted;
+                }
+
+                bestTriangle = static_cast<int>(nextUnemitted);
+            }
+
+            const unsigned int triangle = static_cast<unsigned int>(bestTriangle);
+            const unsigned int * pTriangle = pIndices + triangle * 3;
+
+            std::memcpy(pIndicesOut + output * 3, pTriangle, 3 * sizeof(unsigned int));
+            emitted[triangle] = 1;
+
+            // Remove the triangle from its vertices' lists of remaining triangles.
+            for (unsigned int k = 0; k < 3; ++k)
+            {
+                unsigned int v = pTriangle[k];
+                unsigned int * pBegin = &adjacency[adjacencyStart[v]];
+                unsigned int * pEnd = pBegin + remaining[v];
+                unsigned int * pFound = std::find(pBegin, pEnd, triangle);
+
+                if (pFound != pEnd)
+                {
+                    std::swap(*pFound, *(pEnd - 1));
+                    --remaining[v];
+                }
+            }
+
+            // Move the triangle's vertices to the front of the cache.
+            unsigned int newCache[OPTIMIZER_CACHE_SIZE + 3];
+            unsigned int newCount = 0;
+
+            for (unsigned int k = 0; k < 3; ++k)
+            {
+                if (std::find(newCache, newCache + newCount, pTriangle[k]) == newCache + newCount)
+                {
+                    newCache[newCount++] = pTriangle[k];
+                }
+            }
+
+            for (unsigned int i = 0; i < cacheCount; ++i)
+            {
+                unsigned int v = cache[i];
+
+                if (v != pTriangle[0] && v != pTriangle[1] && v != pTriangle[2])
+                {
+                    newCache[newCount++] = v;
+                }
+            }
+
+            // Rescore every vertex that is in the cache or was just pushed out of it.
+            for (unsigned int i = 0; i < newCount; ++i)
+            {
+                unsigned int v = newCache[i];
+
+                cachePosition[v] = (i < OPTIMIZER_CACHE_SIZE ? static_cast<int>(i) : -1);
+                vertexScore[v] = gScores.Score(cachePosition[v], remaining[v]);
+            }
+
+            cacheCount = std::min(newCount, OPTIMIZER_CACHE_SIZE);
+            std::memcpy(cache, newCache, cacheCount * sizeof(unsigned int));
+
+            // Rescore the triangles touching those vertices and pick the best one to draw next.
+            bestTriangle = -1;
+            bestScore = -1.0f;
+
+            for (unsigned int i = 0; i < newCount; ++i)
+            {
+                unsigned int v = newCache[i];
+
+                for (unsigned int a = 0; a < remaining[v]; ++a)
+                {
+                    unsigned int t = adjacency[adjacencyStart[v] + a];
+                    const unsigned int * pOther = pIndices + t * 3;
+
+                    triangleScore[t] = vertexScore[pOther[0]] + vertexScore[pOther[1]] + vertexScore[pOther[2]];
+
+                    if (triangleScore[t] > bestScore)
+                    {
+                        bestScore = triangleScore[t];
+                        bestTriangle = static_cast<int>(t);
+                    }
+                }
+            }
+        }
+    }
+}
+
+MeshOptimizer::VertexCacheStats MeshOptimizer::AnalyzeVertexCache(
+    const unsigned int * pIndices,
+    unsigned int indexCount,
+    unsigned int vertexCount,
+    unsigned int cacheSize,
+    CacheModel model)
+{
+    VerifyNotNull(pIndices);
+    Verify(cacheSize > 0);
+
+    std::vector<unsigned int> cache(cacheSize, INVALID_VERTEX);
+    std::vector<char> referenced(vertexCount, 0);
+    unsigned int fifoHead = 0;
+
+    VertexCacheStats stats = { indexCount / 3, 0, 0, 0.0f, 0.0f };
+
+    for (unsigned int i = 0; i < indexCount; ++i)
+    {
+        unsigned int v = pIndices[i];
+        assert(v < vertexCount);
+
+        if (!referenced[v])
+        {
+            referenced[v] = 1;
+            ++stats.vertexCount;
+        }
+
+        std::vector<unsigned int>::iterator found = std::find(cache.begin(), cache.end(), v);
+
+        if (model == CacheModel::Fifo)
+        {
+            // Hits do not change a FIFO cache, misses replace the oldest entry.
+            if (found == cache.end())
+            {
+                cache[fifoHead] = v;
+                fifoHead = (fifoHead + 1) % cacheSize;
+                ++stats.transformCount;
+            }
+        }
+        else
+        {
+            // Move the vertex to the front, evicting the last entry on a miss.
+            if (found == cache.end())
+            {
+                found = cache.end() - 1;
+                ++stats.transformCount;
+            }
+
+            std::copy_backward(cache.begin(), found, found + 1);
+            cache[0] = v;
+        }
+    }
+
+    stats.acmr = stats.triangleCount > 0 ? static_cast<float>(stats.transformCount) / stats.triangleCount : 0.0f;
+    stats.atvr = stats.vertexCount > 0 ? static_cast<float>(stats.transformCount) / stats.vertexCount : 0.0f;
+
+    return stats;
+}
+
+void MeshOptimizer::OptimizeVertexCache(unsigned int * pIndices, unsigned int indexCount, unsigned int vertexCount)
+{
+    std::vector<IndexRange> ranges(1);
+    ranges[0].firstIndex = 0;
+    ranges[0].indexCount = indexCount;
+
+    OptimizeVertexCache(pIndices, vertexCount, ranges);
+}
+
+/**
+ * Each range's vertices are renumbered into a compact local range before optimizing, so the cost of
+ * a range depends only on its own size and not on the size of the whole vertex buffer.
+ */
+void MeshOptimizer::OptimizeVertexCache(
+    unsigned int * pIndices,
+    unsigned int vertexCount,
+    const std::vector<IndexRange>& ranges)
+{
+    VerifyNotNull(pIndices);
+
+    std::vector<unsigned int> globalToLocal(vertexCount, INVALID_VERTEX);
+    std::vector<unsigned int> localToGlobal;
+    std::vector<unsigned int> localIndices, optimizedIndices;
+
+    for (size_t r = 0; r < ranges.size(); ++r)
+    {
+        unsigned int * pRange = pIndices + ranges[r].firstIndex;
+        unsigned int indexCount = ranges[r].indexCount;
+
+        Verify(indexCount % 3 == 0);
+
+        if (indexCount == 0)
+        {
+            continue;
+        }
+
+        localToGlobal.clear();
+        localIndices.resize(indexCount);
+        optimizedIndices.resize(indexCount);
+
+        for (unsigned int i = 0; i < indexCount; ++i)
+        {
+            unsigned int v = pRange[i];
+            Verify(v < vertexCount);
+
+            if (globalToLocal[v] == INVALID_VERTEX)
+            {
+                globalToLocal[v] = static_cast<unsigned int>(localToGlobal.size());
+                localToGlobal.push_back(v);
+            }
+
+            localIndices[i] = globalToLocal[v];
+        }
+
+        OptimizeTriangles(
+            &localIndices[0],
+            indexCount,
+            static_cast<unsigned int>(localToGlobal.size()),
+            &optimizedIndices[0]);
+
+        for (unsigned int i = 0; i < indexCount; ++i)
+        {
+            pRange[i] = localToGlobal[optimizedIndices[i]];
+        }
+
+        for (size_t i = 0; i < localToGlobal.size(); ++i)
+        {
+            globalToLocal[localToGlobal[i]] = INVALID_VERTEX;
+        }
+    }
+}
+
+void MeshOptimizer::OptimizeVertexFetchRemap(
+    unsigned int * pIndices,
+    unsigned int indexCount,
+    unsigned int vertexCount,
+    std::vector<unsigned int> * pNewToOldOut)
+{
+    VerifyNotNull(pIndices);
+    VerifyNotNull(pNewToOldOut);
+
+    std::vector<unsigned int> oldToNew(vertexCount, INVALID_VERTEX);
+    std::vector<unsigned int>& newToOld = *pNewToOldOut;
+
+    newToOld.clear();
+    newToOld.reserve(vertexCount);
+
+    for (unsigned int i = 0; i < indexCount; ++i)
+    {
+        unsigned int v = pIndices[i];
+        Verify(v < vertexCount);
+
+        if (oldToNew[v] == INVALID_VERTEX)
+        {
+            oldToNew[v] = static_cast<unsigned int>(newToOld.size());
+            newToOld.push_back(v);
+        }
+
+        pIndices[i] = oldToNew[v];
+    }
+
+    // Keep unused vertices, after all the used ones.
+    for (unsigned int v = 0; v < vertexCount; ++v)
+    {
+        if (oldToNew[v] == INVALID_VERTEX)
+        {
+            newToOld.push_back(v);
+        }
+    }
+}
+
+void MeshOptimizer::OptimizeVertexFetch(
+    void * pVertices,
+    unsigned int vertexCount,
+    unsigned int vertexStride,
+    unsigned int * pIndices,
+    unsigned int indexCount)
+{
+    VerifyNotNull(pVertices);
+
+    std::vector<unsigned int> newToOld;
+    OptimizeVertexFetchRemap(pIndices, indexCount, vertexCount, &newToOld);
+
+    unsigned char * pBytes = reinterpret_cast<unsigned char *>(pVertices);
+    std::vector<unsigned char> original(pBytes, pBytes + static_cast<size_t>(vertexCount) * vertexStride);
+
+    for (unsigned int i = 0; i < vertexCount; ++i)
+    {
+        std::memcpy(
+            pBytes + static_cast<size_t>(i) * vertexStride,
+            &original[static_cast<size_t>(newToOld[i]) * vertexStride],
+            vertexStride);
+    }
+}
+
+void MeshOptimizer::LogOptimization(const char * pMeshName, const VertexCacheStats& before, const VertexCacheStats& after)
+{
+    LOG_INFO("MeshOptimizer") << pMeshName << ": " << after.triangleCount << " triangles, "
+        << after.vertexCount << " vertices, ACMR " << before.acmr << " -> " << after.acmr
+        << ", ATVR " << before.atvr << " -> " << after.atvr;
+}
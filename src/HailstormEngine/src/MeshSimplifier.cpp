@@ -0,0 +1,1237 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "stdafx.h"
+#include "graphics/MeshSimplifier.h"
+
+#include "graphics/IndexRange.h"
+#include "graphics/MeshOptimizer.h"
+#include "graphics/staticmeshvertex.h"
+#include "runtime/logging.h"
+#include "runtime/Stopwatch.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <queue>
+
+namespace
+{
+    const unsigned int NO_VERTEX = 0xFFFFFFFFu;
+
+    // Normal xyz, texture coordinate uv and color rgba.
+    const unsigned int ATTRIBUTE_COUNT = 9;
+
+    // Open borders are held in place by planes standing at right angles to their triangles, weighted by
+    // this times the squared length of the border edge.
+    const float BORDER_PLANE_WEIGHT = 10.0f;
+
+    // Collapses that turn any triangle by more than about 78 degrees are treated as flips.
+    const float MIN_FLIP_COSINE = 0.2f;
+
+    // Added to the error of a collapse per unit of squared edge length. Far too small to matter
+    // against real error, it breaks ties in flat areas in favor of short edges; without it collapses
+    // with no error pile onto a few vertices, leaving slivers and fans that are slow to update.
+    const float EDGE_LENGTH_BIAS = 1e-6f;
+
+    /**
+     * What a vertex position may do, decided once from the topology of the source mesh.
+     */
+    enum class VertexKind : unsigned char
+    {
+        Manifold,       // Inside a disk of triangles that share one set of attributes.
+        Border,         // On a single open border.
+        Seam,           // On a seam between exactly two sets of attributes.
+        Locked          // Anything else. Never moves.
+    };
+
+    /**
+     * Sum of squared distances to planes, plus the squared error of linearly interpolated attributes
+     * over each triangle, all weighted by triangle area. Only holds floats so quadrics can be summed
+     * as flat arrays.
+     */
+    struct Quadric
+    {
+        float a00, a01, a02, a11, a12, a22;     // Symmetric 3x3 matrix.
+        float b0, b1, b2;
+        float c;
+        float weight;                           // Area of the triangles whose attributes are included.
+        float g[ATTRIBUTE_COUNT][3];            // Area weighted attribute gradients.
+        float d[ATTRIBUTE_COUNT];
+    };
+
+    static_assert(sizeof(Quadric) % sizeof(float) == 0, "Quadrics must only contain floats");
+
+    inline void Subtract(const float * pA, const float * pB, float * pOut)
+    {
+        pOut[0] = pA[0] - pB[0];
+        pOut[1] = pA[1] - pB[1];
+        pOut[2] = pA[2] - pB[2];
+    }
+
+    inline void Cross(const float * pA, const float * pB, float * pOut)
+    {
+        pOut[0] = pA[1] * pB[2] - pA[2] * pB[1];
+        pOut[1] = pA[2] * pB[0] - pA[0] * pB[2];
+        pOut[2] = pA[0] * pB[1] - pA[1] * pB[0];
+    }
+
+    inline float Dot(const float * pA, const float * pB)
+    {
+        return pA[0] * pB[0] + pA[1] * pB[1] + pA[2] * pB[2];
+    }
+
+    /**
+     * Add the squared distance to plane dot(n, p) + distance = 0 to a quadric. n need not be unit
+     * length, which lets attribute gradients be added the same way.
+     */
+    void AddPlane(Quadric * pQuadric, const float * pNormal, float distance, float weight)
+    {
+        pQuadric->a00 += weight * pNormal[0] * pNormal[0];
+        pQuadric->a01 += weight * pNormal[0] * pNormal[1];
+        pQuadric->a02 += weight * pNormal[0] * pNormal[2];
+        pQuadric->a11 += weight * pNormal[1] * pNormal[1];
+        pQuadric->a12 += weight * pNormal[1] * pNormal[2];
+        pQuadric->a22 += weight * pNormal[2] * pNormal[2];
+        pQuadric->b0 += weight * pNormal[0] * distance;
+        pQuadric->b1 += weight * pNormal[1] * distance;
+        pQuadric->b2 += weight * pNormal[2] * distance;
+        pQuadric->c += weight * distance * distance;
+    }
+
+    void AddQuadric(Quadric * pQuadric, const Quadric& other)
+    {
+        float * pDest = &pQuadric->a00;
+        const float * pSource = &other.a00;
+
+        for (unsigned int i = 0; i < sizeof(Quadric) / sizeof(float); ++i)
+        {
+            pDest[i] += pSource[i];
+        }
+    }
+
+    /**
+     * Build the quadric of one triangle, with attributes. Each attribute s is fitted with a gradient g
+     * lying in the triangle's plane and offset d so that dot(g, p) + d = s at all three corners.
+     * Returns false for triangles with no area.
+     */
+    bool MakeTriangleQuadric(
+        const float * pP0,
+        const float * pP1,
+        const float * pP2,
+        const float * pS0,
+        const float * pS1,
+        const float * pS2,
+        Quadric * pQuadricOut)
+    {
+        std::memset(pQuadricOut, 0, sizeof(Quadric));
+
+        float e1[3], e2[3], normal[3];
+        Subtract(pP1, pP0, e1);
+        Subtract(pP2, pP0, e2);
+        Cross(e1, e2, normal);
+
+        float lengthSquared = Dot(normal, normal);
+
+        if (lengthSquared <= 0.0f)
+        {
+            return false;
+        }
+
+        float length = std::sqrt(lengthSquared);
+        float area = 0.5f * length;
+        float unitNormal[3] = { normal[0] / length, normal[1] / length, normal[2] / length };
+
+        AddPlane(pQuadricOut, unitNormal, -Dot(unitNormal, pP0), area);
+
+        float e2CrossN[3], nCrossE1[3];
+        Cross(e2, normal, e2CrossN);
+        Cross(normal, e1, nCrossE1);
+
+        for (unsigned int j = 0; j < ATTRIBUTE_COUNT; ++j)
+        {
+            float ds1 = (pS1[j] - pS0[j]) / lengthSquared;
+            float ds2 = (pS2[j] - pS0[j]) / lengthSquared;
+            float gradient[3] =
+            {
+                ds1 * e2CrossN[0] + ds2 * nCrossE1[0],
+                ds1 * e2CrossN[1] + ds2 * nCrossE1[1],
+                ds1 * e2CrossN[2] + ds2 * nCrossE1[2]
+            };
+            float offset = pS0[j] - Dot(gradient, pP0);
+
+            AddPlane(pQuadricOut, gradient, offset, area);
+
+            pQuadricOut->g[j][0] = area * gradient[0];
+            pQuadricOut->g[j][1] = area * gradient[1];
+            pQuadricOut->g[j][2] = area * gradient[2];
+            pQuadricOut->d[j] = area * offset;
+        }
+
+        pQuadricOut->weight = area;
+        return true;
+    }
+
+    /**
+     * Error of placing a vertex with attributes pS at pP.
+     */
+    float EvaluateQuadric(const Quadric& q, const float * pP, const float * pS)
+    {
+        float x = pP[0], y = pP[1], z = pP[2];
+        float error =
+            q.a00 * x * x + q.a11 * y * y + q.a22 * z * z +
+            2.0f * (q.a01 * x * y + q.a02 * x * z + q.a12 * y * z) +
+            2.0f * (q.b0 * x + q.b1 * y + q.b2 * z) +
+            q.c;
+
+        for (unsigned int j = 0; j < ATTRIBUTE_COUNT; ++j)
+        {
+            error += q.weight * pS[j] * pS[j] - 2.0f * pS[j] * (q.g[j][0] * x + q.g[j][1] * y + q.g[j][2] * z + q.d[j]);
+        }
+
+        return error;
+    }
+
+    /**
+     * Simplifies one mesh by collapsing vertex positions onto their neighbors, cheapest first.
+     *
+     * Vertices with identical positions are grouped under the lowest numbered of them, and topology
+     * (adjacency, kinds, the queue) is tracked per position while quadrics are tracked per vertex, so
+     * each side of a seam keeps its own attribute error. Every position keeps its single best collapse
+     * in the queue, stamped with a version that is bumped whenever its neighborhood changes, so stale
+     * entries are recognized and skipped when they come off the queue.
+     */
+    class Simplifier
+    {
+    public:
+        Simplifier(
+            const StaticMeshVertex * pVertices,
+            unsigned int vertexCount,
+            const unsigned int * pIndices,
+            unsigned int indexCount,
+            const MeshSimplifier::SimplifyParams& params);
+
+        // Collapse until at most targetIndexCount indices are left. Returns false if it had to stop
+        // short, because every remaining collapse is invalid or has too much error.
+        bool Run(unsigned int targetIndexCount);
+
+        // Append the remaining triangles to an index list.
+        void AppendIndices(std::vector<unsigned int> * pIndicesOut) const;
+
+        unsigned int IndexCount() const { return mLiveTriangleCount * 3; }
+        unsigned int CollapseCount() const { return mCollapseCount; }
+        unsigned int LockedVertexCount() const { return mLockedVertexCount; }
+
+        // Largest error so far, relative to the largest dimension of the mesh.
+        float Error() const { return std::sqrt(mMaxError); }
+
+        // Length of the bounding box diagonal, relative to the largest dimension of the mesh.
+        float Diagonal() const { return mDiagonal; }
+
+    private:
+        /**
+         * Moves one or (on a seam) two vertices onto the vertices of a neighboring position.
+         */
+        struct Collapse
+        {
+            unsigned int from[2];
+            unsigned int to[2];
+            unsigned int pairCount;
+            float error;
+        };
+
+        struct QueueEntry
+        {
+            float error;
+            unsigned int position;
+            unsigned int version;
+
+            // Orders the queue cheapest first.
+            bool operator >(const QueueEntry& other) const { return error > other.error; }
+        };
+
+        typedef std::priority_queue<QueueEntry, std::vector<QueueEntry>, std::greater<QueueEntry>> Queue;
+
+        void BuildPositions(const StaticMeshVertex * pVertices);
+        void BuildTriangles(const unsigned int * pIndices, unsigned int indexCount);
+        void ClassifyPositions();
+        void BuildQuadrics();
+
+        int FindCorner(unsigned int triangle, unsigned int position) const;
+        bool HasEdge(unsigned int fromPosition, unsigned int toPosition) const;
+        void GatherNeighbors(unsigned int position, std::vector<unsigned int> * pNeighborsOut);
+        unsigned int NextMark();
+
+        void UpdatePosition(unsigned int position);
+        bool FindCollapse(unsigned int position, Collapse * pCollapseOut);
+        bool EvaluateCollapse(unsigned int position, unsigned int target, Collapse * pCollapseOut) const;
+        bool IsCollapseValid(unsigned int position, unsigned int target);
+        void ApplyCollapse(unsigned int position, const Collapse& collapse);
+
+        const float * Position(unsigned int vertex) const { return &mPositions[3 * vertex]; }
+        const float * Attributes(unsigned int vertex) const { return &mAttributes[ATTRIBUTE_COUNT * vertex]; }
+
+    private:
+        MeshSimplifier::SimplifyParams mParams;
+        unsigned int mVertexCount;
+        std::vector<float> mPositions;              // Scaled to fit a unit box, per vertex.
+        std::vector<float> mAttributes;             // Scaled by their weights, per vertex.
+        std::vector<unsigned int> mRemap;           // Vertex to its position, the first vertex found there.
+        std::vector<unsigned int> mIndices;
+        std::vector<unsigned char> mTriangleAlive;
+        std::vector<std::vector<unsigned int>> mPositionTriangles;
+        std::vector<VertexKind> mKinds;             // Per position.
+        std::vector<Quadric> mQuadrics;             // Per vertex.
+        std::vector<unsigned int> mVersions;        // Per position.
+        std::vector<Collapse> mBestCollapses;       // Per position.
+        std::vector<unsigned char> mQueued;         // Per position, set while its current version is queued.
+        std::vector<unsigned char> mDirty;          // Per position, set when its queued collapse is out of date.
+        Queue mQueue;
+        unsigned int mLiveTriangleCount;
+        unsigned int mCollapseCount;
+        unsigned int mLockedVertexCount;
+        float mMaxError;
+        float mDiagonal;
+
+        // Scratch space reused by every collapse. Positions are marked with a stamp that changes on
+        // every use, so the marks never need clearing.
+        std::vector<unsigned int> mTargets;
+        std::vector<unsigned int> mNeighbors;
+        std::vector<unsigned int> mChanged;
+        std::vector<Collapse> mCandidates;
+        std::vector<unsigned int> mMarks;
+        unsigned int mMarkStamp;
+    };
+
+    Simplifier::Simplifier(
+        const StaticMeshVertex * pVertices,
+        unsigned int vertexCount,
+        const unsigned int * pIndices,
+        unsigned int indexCount,
+        const MeshSimplifier::SimplifyParams& params)
+        : mParams(params),
+          mVertexCount(vertexCount),
+          mLiveTriangleCount(0),
+          mCollapseCount(0),
+          mLockedVertexCount(0),
+          mMaxError(0.0f),
+          mDiagonal(0.0f),
+          mMarkStamp(0)
+    {
+        BuildPositions(pVertices);
+        BuildTriangles(pIndices, indexCount);
+        ClassifyPositions();
+        BuildQuadrics();
+
+        mVersions.assign(vertexCount, 0);
+        mBestCollapses.resize(vertexCount);
+        mQueued.assign(vertexCount, 0);
+        mDirty.assign(vertexCount, 0);
+        mMarks.assign(vertexCount, 0);
+
+        for (unsigned int position = 0; position < vertexCount; ++position)
+        {
+            if (!mPositionTriangles[position].empty())
+            {
+                UpdatePosition(position);
+            }
+        }
+    }
+
+    /**
+     * Scales positions into a unit box, so errors do not depend on the size of the mesh, gathers the
+     * weighted attributes and groups vertices that share a position.
+     */
+    void Simplifier::BuildPositions(const StaticMeshVertex * pVertices)
+    {
+        D3DXVECTOR3 minCorner(0.0f, 0.0f, 0.0f), maxCorner(0.0f, 0.0f, 0.0f);
+
+        for (unsigned int i = 0; i < mVertexCount; ++i)
+        {
+            const D3DXVECTOR3& p = pVertices[i].pos;
+
+            minCorner = (i == 0) ? p : D3DXVECTOR3(std::min(minCorner.x, p.x), std::min(minCorner.y, p.y), std::min(minCorner.z, p.z));
+            maxCorner = (i == 0) ? p : D3DXVECTOR3(std::max(maxCorner.x, p.x), std::max(maxCorner.y, p.y), std::max(maxCorner.z, p.z));
+        }
+
+        D3DXVECTOR3 size = maxCorner - minCorner;
+        float extent = std::max(std::max(size.x, size.y), size.z);
+        float scale = (extent > 0.0f) ? 1.0f / extent : 1.0f;
+
+        mDiagonal = std::sqrt(size.x * size.x + size.y * size.y + size.z * size.z) * scale;
+        mPositions.resize(3 * mVertexCount);
+        mAttributes.resize(ATTRIBUTE_COUNT * mVertexCount);
+
+        for (unsigned int i = 0; i < mVertexCount; ++i)
+        {
+            const StaticMeshVertex& vertex = pVertices[i];
+            float * pPosition = &mPositions[3 * i];
+            float * pAttributes = &mAttributes[ATTRIBUTE_COUNT * i];
+
+            pPosition[0] = (vertex.pos.x - minCorner.x) * scale;
+            pPosition[1] = (vertex.pos.y - minCorner.y) * scale;
+            pPosition[2] = (vertex.pos.z - minCorner.z) * scale;
+
+            pAttributes[0] = vertex.normal.x * mParams.normalWeight;
+            pAttributes[1] = vertex.normal.y * mParams.normalWeight;
+            pAttributes[2] = vertex.normal.z * mParams.normalWeight;
+            pAttributes[3] = vertex.texcoord.x * mParams.texcoordWeight;
+            pAttributes[4] = vertex.texcoord.y * mParams.texcoordWeight;
+            pAttributes[5] = vertex.color.r * mParams.colorWeight;
+            pAttributes[6] = vertex.color.g * mParams.colorWeight;
+            pAttributes[7] = vertex.color.b * mParams.colorWeight;
+            pAttributes[8] = vertex.color.a * mParams.colorWeight;
+        }
+
+        // Sort the vertices by position so that every run of equal positions can share the first.
+        std::vector<unsigned int> order(mVertexCount);
+
+        for (unsigned int i = 0; i < mVertexCount; ++i)
+        {
+            order[i] = i;
+        }
+
+        std::sort(order.begin(), order.end(), [pVertices](unsigned int a, unsigned int b)
+        {
+            const D3DXVECTOR3& pa = pVertices[a].pos;
+            const D3DXVECTOR3& pb = pVertices[b].pos;
+
+            if (pa.x != pb.x) { return pa.x < pb.x; }
+            if (pa.y != pb.y) { return pa.y < pb.y; }
+            if (pa.z != pb.z) { return pa.z < pb.z; }
+            return a < b;
+        });
+
+        mRemap.resize(mVertexCount);
+
+        for (unsigned int i = 0; i < mVertexCount; ++i)
+        {
+            unsigned int vertex = order[i];
+            bool samePosition = (i > 0) && pVertices[vertex].pos == pVertices[order[i - 1]].pos;
+
+            mRemap[vertex] = samePosition ? mRemap[order[i - 1]] : vertex;
+        }
+    }
+
+    /**
+     * Copies the triangles, dropping any with two corners at the same position since they cover no
+     * area, and lists the triangles around each position.
+     */
+    void Simplifier::BuildTriangles(const unsigned int * pIndices, unsigned int indexCount)
+    {
+        unsigned int triangleCount = indexCount / 3;
+        std::vector<unsigned int> counts(mVertexCount, 0);
+
+        mIndices.assign(pIndices, pIndices + triangleCount * 3);
+        mTriangleAlive.assign(triangleCount, 0);
+
+        for (unsigned int t = 0; t < triangleCount; ++t)
+        {
+            unsigned int p0 = mRemap[mIndices[3 * t]];
+            unsigned int p1 = mRemap[mIndices[3 * t + 1]];
+            unsigned int p2 = mRemap[mIndices[3 * t + 2]];
+
+            if (p0 != p1 && p1 != p2 && p0 != p2)
+            {
+                mTriangleAlive[t] = 1;
+                ++counts[p0];
+                ++counts[p1];
+                ++counts[p2];
+                ++mLiveTriangleCount;
+            }
+        }
+
+        mPositionTriangles.resize(mVertexCount);
+
+        for (unsigned int position = 0; position < mVertexCount; ++position)
+        {
+            mPositionTriangles[position].reserve(counts[position]);
+        }
+
+        for (unsigned int t = 0; t < triangleCount; ++t)
+        {
+            if (mTriangleAlive[t])
+            {
+                for (unsigned int k = 0; k < 3; ++k)
+                {
+                    mPositionTriangles[mRemap[mIndices[3 * t + k]]].push_back(t);
+                }
+            }
+        }
+    }
+
+    /**
+     * Decides what each position may do by looking for an opposite to every edge around it. An edge
+     * with no opposite at all is on a border, and one whose opposite uses different vertices at either
+     * end is on a seam.
+     */
+    void Simplifier::ClassifyPositions()
+    {
+        mKinds.assign(mVertexCount, VertexKind::Locked);
+
+        for (unsigned int position = 0; position < mVertexCount; ++position)
+        {
+            const std::vector<unsigned int>& triangles = mPositionTriangles[position];
+
+            if (triangles.empty())
+            {
+                continue;
+            }
+
+            unsigned int borderEdges[2] = { 0, 0 };     // Outgoing and incoming edges.
+            unsigned int seamEdges[2] = { 0, 0 };
+            unsigned int vertices[2] = { NO_VERTEX, NO_VERTEX };
+            unsigned int vertexCount = 0;
+            bool complex = false;
+
+            for (size_t i = 0; i < triangles.size() && !complex; ++i)
+            {
+                unsigned int t = triangles[i];
+                int corner = FindCorner(t, position);
+                unsigned int vertex = mIndices[3 * t + corner];
+
+                if (vertex != vertices[0] && vertex != vertices[1])
+                {
+                    if (vertexCount < 2)
+                    {
+                        vertices[vertexCount] = vertex;
+                    }
+
+                    ++vertexCount;
+                }
+
+                // Direction 0 is the outgoing edge vertex -> next, whose opposite runs next -> vertex.
+                // Direction 1 is the incoming edge previous -> vertex.
+                for (unsigned int direction = 0; direction < 2; ++direction)
+                {
+                    unsigned int other = mIndices[3 * t + (corner + (direction == 0 ? 1 : 2)) % 3];
+                    unsigned int matches = 0;
+                    bool sameVertices = false;
+
+                    for (size_t j = 0; j < triangles.size(); ++j)
+                    {
+                        unsigned int u = triangles[j];
+                        int c = FindCorner(u, position);
+                        unsigned int oppositeOther = mIndices[3 * u + (c + (direction == 0 ? 2 : 1)) % 3];
+
+                        if (mRemap[oppositeOther] == mRemap[other])
+                        {
+                            ++matches;
+                            sameVertices = (oppositeOther == other && mIndices[3 * u + c] == vertex);
+                        }
+                    }
+
+                    if (matches == 0)
+                    {
+                        ++borderEdges[direction];
+                    }
+                    else if (matches > 1)
+                    {
+                        complex = true;
+                    }
+                    else if (!sameVertices)
+                    {
+                        ++seamEdges[direction];
+                    }
+                }
+            }
+
+            VertexKind kind = VertexKind::Locked;
+
+            if (complex)
+            {
+                kind = VertexKind::Locked;
+            }
+            else if (vertexCount == 1 && seamEdges[0] + seamEdges[1] == 0)
+            {
+                if (borderEdges[0] + borderEdges[1] == 0)
+                {
+                    kind = VertexKind::Manifold;
+                }
+                else if (borderEdges[0] == 1 && borderEdges[1] == 1 && !mParams.lockBorder)
+                {
+                    kind = VertexKind::Border;
+                }
+            }
+            else if (vertexCount == 2 && borderEdges[0] + borderEdges[1] == 0 && seamEdges[0] == 2 && seamEdges[1] == 2)
+            {
+                kind = VertexKind::Seam;
+            }
+
+            mKinds[position] = kind;
+            mLockedVertexCount += (kind == VertexKind::Locked) ? 1 : 0;
+        }
+    }
+
+    /**
+     * Sums the quadric of every triangle into each of its corners, plus the border planes that keep
+     * open edges from wandering.
+     */
+    void Simplifier::BuildQuadrics()
+    {
+        Quadric zero;
+        std::memset(&zero, 0, sizeof(Quadric));
+        mQuadrics.assign(mVertexCount, zero);
+
+        unsigned int triangleCount = static_cast<unsigned int>(mTriangleAlive.size());
+
+        for (unsigned int t = 0; t < triangleCount; ++t)
+        {
+            if (!mTriangleAlive[t])
+            {
+                continue;
+            }
+
+            const unsigned int * pCorners = &mIndices[3 * t];
+            Quadric quadric;
+
+            if (!MakeTriangleQuadric(
+                    Position(pCorners[0]), Position(pCorners[1]), Position(pCorners[2]),
+                    Attributes(pCorners[0]), Attributes(pCorners[1]), Attributes(pCorners[2]),
+                    &quadric))
+            {
+                continue;
+            }
+
+            for (unsigned int k = 0; k < 3; ++k)
+            {
+                AddQuadric(&mQuadrics[pCorners[k]], quadric);
+            }
+
+            float e1[3], e2[3], normal[3];
+            Subtract(Position(pCorners[1]), Position(pCorners[0]), e1);
+            Subtract(Position(pCorners[2]), Position(pCorners[0]), e2);
+            Cross(e1, e2, normal);
+
+            for (unsigned int k = 0; k < 3; ++k)
+            {
+                unsigned int a = pCorners[k];
+                unsigned int b = pCorners[(k + 1) % 3];
+
+                if (HasEdge(mRemap[b], mRemap[a]))
+                {
+                    continue;
+                }
+
+                float edge[3], planeNormal[3];
+                Subtract(Position(b), Position(a), edge);
+                Cross(edge, normal, planeNormal);
+
+                float length = std::sqrt(Dot(planeNormal, planeNormal));
+
+                if (length > 0.0f)
+                {
+                    planeNormal[0] /= length;
+                    planeNormal[1] /= length;
+                    planeNormal[2] /= length;
+
+                    Quadric border;
+                    std::memset(&border, 0, sizeof(Quadric));
+                    AddPlane(&border, planeNormal, -Dot(planeNormal, Position(a)), BORDER_PLANE_WEIGHT * Dot(edge, edge));
+
+                    AddQuadric(&mQuadrics[a], border);
+                    AddQuadric(&mQuadrics[b], border);
+                }
+            }
+        }
+    }
+
+    /**
+     * Returns which corner of a triangle is at a position, or -1 if none is.
+     */
+    int Simplifier::FindCorner(unsigned int triangle, unsigned int position) const
+    {
+        for (int k = 0; k < 3; ++k)
+        {
+            if (mRemap[mIndices[3 * triangle + k]] == position)
+            {
+                return k;
+            }
+        }
+
+        return -1;
+    }
+
+    /**
+     * Checks if any live triangle has the directed edge fromPosition -> toPosition.
+     */
+    bool Simplifier::HasEdge(unsigned int fromPosition, unsigned int toPosition) const
+    {
+        const std::vector<unsigned int>& triangles = mPositionTriangles[fromPosition];
+
+        for (size_t i = 0; i < triangles.size(); ++i)
+        {
+            unsigned int t = triangles[i];
+            int corner = FindCorner(t, fromPosition);
+
+            if (mTriangleAlive[t] && mRemap[mIndices[3 * t + (corner + 1) % 3]] == toPosition)
+            {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    /**
+     * Lists the distinct positions that share a live triangle with a position, not including itself.
+     */
+    void Simplifier::GatherNeighbors(unsigned int position, std::vector<unsigned int> * pNeighborsOut)
+    {
+        const std::vector<unsigned int>& triangles = mPositionTriangles[position];
+        unsigned int stamp = NextMark();
+
+        pNeighborsOut->clear();
+        mMarks[position] = stamp;
+
+        for (size_t i = 0; i < triangles.size(); ++i)
+        {
+            unsigned int t = triangles[i];
+
+            if (mTriangleAlive[t])
+            {
+                for (unsigned int k = 0; k < 3; ++k)
+                {
+                    unsigned int other = mRemap[mIndices[3 * t + k]];
+
+                    if (mMarks[other] != stamp)
+                    {
+                        mMarks[other] = stamp;
+                        pNeighborsOut->push_back(other);
+                    }
+                }
+            }
+        }
+    }
+
+    unsigned int Simplifier::NextMark()
+    {
+        if (++mMarkStamp == 0)
+        {
+            std::fill(mMarks.begin(), mMarks.end(), 0);
+            mMarkStamp = 1;
+        }
+
+        return mMarkStamp;
+    }
+
+    /**
+     * Finds the best collapse of a position again and queues it under a new version, which turns
+     * any older entry for the position stale.
+     */
+    void Simplifier::UpdatePosition(unsigned int position)
+    {
+        Collapse& best = mBestCollapses[position];
+
+        ++mVersions[position];
+        mDirty[position] = 0;
+        mQueued[position] = FindCollapse(position, &best) ? 1 : 0;
+
+        if (mQueued[position])
+        {
+            QueueEntry entry = { best.error, position, mVersions[position] };
+            mQueue.push(entry);
+        }
+    }
+
+    /**
+     * Picks the cheapest collapse of a position onto any neighbor that is allowed by its kind and
+     * does not flip triangles or pinch the surface.
+     */
+    bool Simplifier::FindCollapse(unsigned int position, Collapse * pCollapseOut)
+    {
+        if (mKinds[position] == VertexKind::Locked)
+        {
+            return false;
+        }
+
+        GatherNeighbors(position, &mTargets);
+        mCandidates.clear();
+
+        for (size_t i = 0; i < mTargets.size(); ++i)
+        {
+            Collapse collapse;
+
+            if (EvaluateCollapse(position, mTargets[i], &collapse))
+            {
+                mCandidates.push_back(collapse);
+            }
+        }
+
+        std::sort(mCandidates.begin(), mCandidates.end(), [](const Collapse& a, const Collapse& b)
+        {
+            return a.error < b.error;
+        });
+
+        for (size_t i = 0; i < mCandidates.size(); ++i)
+        {
+            if (IsCollapseValid(position, mRemap[mCandidates[i].to[0]]))
+            {
+                *pCollapseOut = mCandidates[i];
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    /**
+     * Works out which vertices a collapse of position onto target would move, and what it would cost.
+     * Returns false if the position's kind does not allow moving along that edge.
+     */
+    bool Simplifier::EvaluateCollapse(unsigned int position, unsigned int target, Collapse * pCollapseOut) const
+    {
+        const std::vector<unsigned int>& triangles = mPositionTriangles[position];
+        unsigned int sharedCount = 0;
+
+        pCollapseOut->pairCount = 0;
+
+        for (size_t i = 0; i < triangles.size(); ++i)
+        {
+            unsigned int t = triangles[i];
+            int targetCorner = FindCorner(t, target);
+
+            if (!mTriangleAlive[t] || targetCorner < 0)
+            {
+                continue;
+            }
+
+            unsigned int from = mIndices[3 * t + FindCorner(t, position)];
+            unsigned int to = mIndices[3 * t + targetCorner];
+
+            if (sharedCount++ == 0 || (pCollapseOut->pairCount == 1 && from != pCollapseOut->from[0]))
+            {
+                pCollapseOut->from[pCollapseOut->pairCount] = from;
+                pCollapseOut->to[pCollapseOut->pairCount] = to;
+                ++pCollapseOut->pairCount;
+            }
+        }
+
+        switch (mKinds[position])
+        {
+        case VertexKind::Manifold:
+            if (sharedCount != 2 || pCollapseOut->pairCount != 1) { return false; }
+            break;
+
+        case VertexKind::Border:
+            if (sharedCount != 1) { return false; }
+            break;
+
+        case VertexKind::Seam:
+            if (sharedCount != 2 || pCollapseOut->pairCount != 2) { return false; }
+            break;
+
+        default:
+            return false;
+        }
+
+        float error = 0.0f;
+        float weight = 0.0f;
+
+        for (unsigned int i = 0; i < pCollapseOut->pairCount; ++i)
+        {
+            unsigned int from = pCollapseOut->from[i];
+            unsigned int to = pCollapseOut->to[i];
+            const float * pPosition = Position(to);
+            const float * pAttributes = Attributes(to);
+
+            error += EvaluateQuadric(mQuadrics[from], pPosition, pAttributes);
+            weight += mQuadrics[from].weight;
+
+            // Both halves of a seam may end on the same vertex, which must only be counted once.
+            if (i == 0 || to != pCollapseOut->to[0])
+            {
+                error += EvaluateQuadric(mQuadrics[to], pPosition, pAttributes);
+                weight += mQuadrics[to].weight;
+            }
+        }
+
+        float edge[3];
+        Subtract(Position(pCollapseOut->to[0]), Position(pCollapseOut->from[0]), edge);
+
+        pCollapseOut->error = std::max(error, 0.0f) / std::max(weight, 1e-20f) + EDGE_LENGTH_BIAS * Dot(edge, edge);
+        return true;
+    }
+
+    /**
+     * Rejects collapses that would change the topology of the surface, by joining two positions that
+     * have more common neighbors than the triangles along their edge or by removing a whole piece of
+     * it, and collapses that would turn any of the remaining triangles around the position over.
+     */
+    bool Simplifier::IsCollapseValid(unsigned int position, unsigned int target)
+    {
+        // Count the neighbors of the target that are also neighbors of the position, unmarking each
+        // one as it is counted.
+        GatherNeighbors(position, &mNeighbors);
+
+        const std::vector<unsigned int>& targetTriangles = mPositionTriangles[target];
+        unsigned int stamp = mMarkStamp;
+        unsigned int commonCount = 0;
+        unsigned int sharedCount = 0;
+        unsigned int targetTriangleCount = 0;
+
+        mMarks[position] = 0;
+        mMarks[target] = 0;
+
+        for (size_t i = 0; i < targetTriangles.size(); ++i)
+        {
+            unsigned int t = targetTriangles[i];
+
+            targetTriangleCount += mTriangleAlive[t];
+
+            for (unsigned int k = 0; k < 3 && mTriangleAlive[t]; ++k)
+            {
+                unsigned int other = mRemap[mIndices[3 * t + k]];
+
+                if (mMarks[other] == stamp)
+                {
+                    mMarks[other] = 0;
+                    ++commonCount;
+                }
+            }
+        }
+
+        const std::vector<unsigned int>& triangles = mPositionTriangles[position];
+        const float * pTarget = Position(target);
+
+        for (size_t i = 0; i < triangles.size(); ++i)
+        {
+            unsigned int t = triangles[i];
+
+            if (!mTriangleAlive[t])
+            {
+                continue;
+            }
+
+            if (FindCorner(t, target) >= 0)
+            {
+                ++sharedCount;
+                continue;
+            }
+
+            int corner = FindCorner(t, position);
+            const float * pA = Position(mIndices[3 * t + corner]);
+            const float * pB = Position(mIndices[3 * t + (corner + 1) % 3]);
+            const float * pC = Position(mIndices[3 * t + (corner + 2) % 3]);
+
+            float ab[3], ac[3], tb[3], tc[3], before[3], after[3];
+            Subtract(pB, pA, ab);
+            Subtract(pC, pA, ac);
+            Subtract(pB, pTarget, tb);
+            Subtract(pC, pTarget, tc);
+            Cross(ab, ac, before);
+            Cross(tb, tc, after);
+
+            float beforeSquared = Dot(before, before);
+
+            if (beforeSquared > 0.0f &&
+                Dot(before, after) <= MIN_FLIP_COSINE * std::sqrt(beforeSquared * Dot(after, after)))
+            {
+                return false;
+            }
+        }
+
+        // A collapse that would remove every triangle of both positions removes a whole piece of the
+        // mesh, eg its last triangle.
+        return commonCount == sharedCount && targetTriangleCount > sharedCount;
+    }
+
+    /**
+     * Moves a position onto its target. Triangles along the collapsed edge disappear, and the rest of
+     * the position's triangles are handed over to the target.
+     */
+    void Simplifier::ApplyCollapse(unsigned int position, const Collapse& collapse)
+    {
+        unsigned int target = mRemap[collapse.to[0]];
+        std::vector<unsigned int>& triangles = mPositionTriangles[position];
+        std::vector<unsigned int>& targetTriangles = mPositionTriangles[target];
+
+        for (unsigned int i = 0; i < collapse.pairCount; ++i)
+        {
+            AddQuadric(&mQuadrics[collapse.to[i]], mQuadrics[collapse.from[i]]);
+        }
+
+        for (size_t i = 0; i < triangles.size(); ++i)
+        {
+            unsigned int t = triangles[i];
+
+            if (!mTriangleAlive[t])
+            {
+                continue;
+            }
+
+            if (FindCorner(t, target) >= 0)
+            {
+                mTriangleAlive[t] = 0;
+                --mLiveTriangleCount;
+                continue;
+            }
+
+            unsigned int& corner = mIndices[3 * t + FindCorner(t, position)];
+            corner = (collapse.pairCount == 2 && corner == collapse.from[1]) ? collapse.to[1] : collapse.to[0];
+
+            targetTriangles.push_back(t);
+        }
+
+        std::vector<unsigned int>().swap(triangles);
+
+        targetTriangles.erase(
+            std::remove_if(targetTriangles.begin(), targetTriangles.end(), [this](unsigned int t)
+            {
+                return mTriangleAlive[t] == 0;
+            }),
+            targetTriangles.end());
+
+        ++mVersions[position];
+        ++mCollapseCount;
+        mMaxError = std::max(mMaxError, collapse.error);
+
+        mQueued[position] = 0;
+
+        // Every position whose triangles just changed needs its best collapse found again. Queued
+        // ones are only marked, and found again if they reach the front of the queue, which saves
+        // most of the work since few of them ever do before changing again. The rest may only now
+        // have become collapsible, so they are looked at straight away.
+        GatherNeighbors(target, &mChanged);
+
+        for (size_t i = 0; i < mChanged.size(); ++i)
+        {
+            unsigned int neighbor = mChanged[i];
+
+            if (mQueued[neighbor])
+            {
+                mDirty[neighbor] = 1;
+            }
+            else
+            {
+                UpdatePosition(neighbor);
+            }
+        }
+    }
+
+    bool Simplifier::Run(unsigned int targetIndexCount)
+    {
+        float maxErrorSquared = mParams.maxError * mParams.maxError;
+
+        while (mLiveTriangleCount * 3 > targetIndexCount && !mQueue.empty())
+        {
+            QueueEntry entry = mQueue.top();
+            unsigned int position = entry.position;
+
+            if (entry.version != mVersions[position])
+            {
+                mQueue.pop();
+                continue;
+            }
+
+            if (mDirty[position])
+            {
+                mQueue.pop();
+                UpdatePosition(position);
+                continue;
+            }
+
+            if (entry.error > maxErrorSquared)
+            {
+                return false;
+            }
+
+            mQueue.pop();
+            mQueued[position] = 0;
+
+            // Collapses further away can still have changed the neighborhood of the target.
+            Collapse collapse = mBestCollapses[position];
+
+            if (!IsCollapseValid(position, mRemap[collapse.to[0]]))
+            {
+                UpdatePosition(position);
+                continue;
+            }
+
+            ApplyCollapse(position, collapse);
+        }
+
+        return mLiveTriangleCount * 3 <= targetIndexCount;
+    }
+
+    void Simplifier::AppendIndices(std::vector<unsigned int> * pIndicesOut) const
+    {
+        pIndicesOut->reserve(pIndicesOut->size() + IndexCount());
+
+        for (size_t t = 0; t < mTriangleAlive.size(); ++t)
+        {
+            if (mTriangleAlive[t])
+            {
+                pIndicesOut->insert(pIndicesOut->end(), &mIndices[3 * t], &mIndices[3 * t] + 3);
+            }
+        }
+    }
+}
+
+MeshSimplifier::SimplifyParams::SimplifyParams()
+    : normalWeight(0.5f),
+      texcoordWeight(1.0f),
+      colorWeight(0.5f),
+      maxError(1.0f),
+      lockBorder(false)
+{
+}
+
+MeshSimplifier::LodChainParams::LodChainParams()
+    : triangleRatios(),
+      pixelError(1.0f),
+      screenHeight(1080.0f),
+      simplify()
+{
+    triangleRatios.push_back(0.5f);
+    triangleRatios.push_back(0.25f);
+    triangleRatios.push_back(0.125f);
+}
+
+unsigned int MeshSimplifier::Simplify(
+    const StaticMeshVertex * pVertices,
+    unsigned int vertexCount,
+    const unsigned int * pIndices,
+    unsigned int indexCount,
+    unsigned int targetIndexCount,
+    const SimplifyParams& params,
+    std::vector<unsigned int> * pIndicesOut,
+    SimplifyStats * pStatsOut)
+{
+    VerifyNotNull(pVertices);
+    VerifyNotNull(pIndices);
+    VerifyNotNull(pIndicesOut);
+
+    Stopwatch timer;
+    Simplifier simplifier(pVertices, vertexCount, pIndices, indexCount, params);
+
+    simplifier.Run(targetIndexCount);
+
+    pIndicesOut->clear();
+    simplifier.AppendIndices(pIndicesOut);
+
+    if (pStatsOut != nullptr)
+    {
+        pStatsOut->seconds = timer.ElapsedSeconds();
+        pStatsOut->sourceTriangleCount = indexCount / 3;
+        pStatsOut->triangleCount = simplifier.IndexCount() / 3;
+        pStatsOut->collapseCount = simplifier.CollapseCount();
+        pStatsOut->lockedVertexCount = simplifier.LockedVertexCount();
+        pStatsOut->error = simplifier.Error();
+    }
+
+    return simplifier.IndexCount();
+}
+
+void MeshSimplifier::GenerateLodChain(
+    const StaticMeshVertex * pVertices,
+    unsigned int vertexCount,
+    std::vector<unsigned int> * pIndices,
+    const LodChainParams& params,
+    std::vector<MeshLod> * pLodsOut,
+    SimplifyStats * pStatsOut)
+{
+    VerifyNotNull(pVertices);
+    VerifyNotNull(pIndices);
+    VerifyNotNull(pLodsOut);
+
+    Stopwatch timer;
+    unsigned int sourceIndexCount = static_cast<unsigned int>(pIndices->size());
+    MeshLod fullDetail = { 0, sourceIndexCount, 1.0f, 0.0f };
+
+    pLodsOut->assign(1, fullDetail);
+
+    SimplifyStats noStats = { 0 };
+    SimplifyStats stats = noStats;
+    stats.sourceTriangleCount = sourceIndexCount / 3;
+    stats.triangleCount = sourceIndexCount / 3;
+
+    if (sourceIndexCount > 0)
+    {
+        Simplifier simplifier(pVertices, vertexCount, &(*pIndices)[0], sourceIndexCount, params.simplify);
+        std::vector<float> ratios(params.triangleRatios);
+        std::vector<IndexRange> ranges;
+
+        std::sort(ratios.begin(), ratios.end(), std::greater<float>());
+
+        for (size_t i = 0; i < ratios.size(); ++i)
+        {
+            unsigned int targetIndexCount = static_cast<unsigned int>(ratios[i] * (sourceIndexCount / 3)) * 3;
+            bool reachedTarget = simplifier.Run(targetIndexCount);
+
+            if (simplifier.IndexCount() >= pLodsOut->back().indexCount)
+            {
+                break;
+            }
+
+            MeshLod lod;
+            lod.firstIndex = static_cast<unsigned int>(pIndices->size());
+            lod.indexCount = simplifier.IndexCount();
+            lod.error = simplifier.Error();
+
+            // The error shows as pixelError pixels once the mesh's diagonal covers this much of the
+            // screen height. Levels must never be picked at a larger size than the one before them.
+            lod.screenSize = pLodsOut->back().screenSize;
+
+            if (lod.error > 0.0f)
+            {
+                float screenSize = params.pixelError * simplifier.Diagonal() / (lod.error * params.screenHeight);
+                lod.screenSize = std::min(screenSize, lod.screenSize);
+            }
+
+            simplifier.AppendIndices(pIndices);
+            pLodsOut->push_back(lod);
+
+            IndexRange range = { lod.firstIndex, lod.indexCount };
+            ranges.push_back(range);
+
+            if (!reachedTarget)
+            {
+                break;
+            }
+        }
+
+        if (!ranges.empty())
+        {
+            MeshOptimizer::OptimizeVertexCache(&(*pIndices)[0], vertexCount, ranges);
+        }
+
+        stats.triangleCount = pLodsOut->back().indexCount / 3;
+        stats.collapseCount = simplifier.CollapseCount();
+        stats.lockedVertexCount = simplifier.LockedVertexCount();
+        stats.error = simplifier.Error();
+    }
+
+    stats.seconds = timer.ElapsedSeconds();
+
+    if (pStatsOut != nullptr)
+    {
+        *pStatsOut = stats;
+    }
+}
+
+void MeshSimplifier::LogLodChain(const char * pMeshName, const std::vector<MeshLod>& lods, const SimplifyStats& stats)
+{
+    LOG_INFO("MeshSimplifier") << pMeshName << ": " << lods.size() << " levels of detail from "
+        << stats.sourceTriangleCount << " triangles in " << stats.seconds * 1000.0 << " ms, "
+        << stats.lockedVertexCount << " locked vertices";
+
+    for (size_t i = 0; i < lods.size(); ++i)
+    {
+        LOG_INFO("MeshSimplifier") << "  level " << i << ": " << lods[i].indexCount / 3 << " triangles, error "
+            << lods[i].error << ", below screen size " << lods[i].screenSize;
+    }
+}
@@ -0,0 +1,677 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "stdafx.h"
+#include "terrain/MinMaxHeightTree.h"
+#include "terrain/HeightField.h"
+
+#include <d3dx10.h>
+#include <xmmintrin.h>
+#include <algorithm>
+#include <cmath>
+
+// Visual C++ 2013 has no alignas.
+#if defined(_MSC_VER) && _MSC_VER < 1900
+#   define SSE_ALIGNED __declspec(align(16))
+#else
+#   define SSE_ALIGNED alignas(16)
+#endif
+
+namespace
+{
+    // Deepest possible traversal stack. Each level pushes at most three more nodes than it pops, and
+    // a 32 level tree would cover a height field four billion cells across.
+    const int MAX_STACK_DEPTH = 4 * 32;
+
+    // Direction components smaller than this are nudged away from zero before being inverted. This
+    // keeps the slab tests free of infinities (and the NaNs that come from multiplying them by zero).
+    const float MIN_DIRECTION = 1e-12f;
+
+    const unsigned int PACKET_SIZE = 4;
+
+    struct TraversalNode
+    {
+        unsigned int level;
+        unsigned int x;
+        unsigned int y;
+        unsigned int mask;      // Active rays, only used by packet traversal.
+    };
+
+    float SafeInverse(float v)
+    {
+        if (std::fabs(v) < MIN_DIRECTION)
+        {
+            v = (v < 0.0f ? -MIN_DIRECTION : MIN_DIRECTION);
+        }
+
+        return 1.0f / v;
+    }
+
+    // Moller-Trumbore ray triangle intersection.
+    bool IntersectTriangle(
+        const float * o,
+        const float * d,
+        const float * a,
+        const float * b,
+        const float * c,
+        float maxDistance,
+        float * pDistanceOut)
+    {
+        float e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+        float e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+        float p[3] = { d[1] * e2[2] - d[2] * e2[1], d[2] * e2[0] - d[0] * e2[2], d[0] * e2[1] - d[1] * e2[0] };
+        float det = e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2];
+
+        if (std::fabs(det) < 1e-12f)
+        {
+            return false;       // Ray is parallel to the triangle.
+        }
+
+        float invDet = 1.0f / det;
+        float s[3] = { o[0] - a[0], o[1] - a[1], o[2] - a[2] };
+        float u = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * invDet;
+
+        if (u < 0.0f || u > 1.0f)
+        {
+            return false;
+        }
+
+        float q[3] = { s[1] * e1[2] - s[2] * e1[1], s[2] * e1[0] - s[0] * e1[2], s[0] * e1[1] - s[1] * e1[0] };
+        float v = (d[0] * q[0] + d[1] * q[1] + d[2] * q[2]) * invDet;
+
+        if (v < 0.0f || u + v > 1.0f)
+        {
+            return false;
+        }
+
+        float t = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) * invDet;
+
+        if (t < 0.0f || t > maxDistance)
+        {
+            return false;
+        }
+
+        *pDistanceOut = t;
+        return true;
+    }
+}
+
+/**
+ * A ray transformed into grid space, where cell (row, col) spans [col, col + 1] on the first axis and
+ * [row, row + 1] on the third axis. Heights are left unchanged. Because the transform is affine the
+ * distance along the ray is the same in both spaces.
+ */
+struct MinMaxHeightTree::GridRay
+{
+    GridRay(const HeightField& field, const D3DXVECTOR3& origin, const D3DXVECTOR3& direction)
+    {
+        o[0] = field.ToGridCol(origin.x);
+        o[1] = origin.y;
+        o[2] = field.ToGridRow(origin.z);
+
+        d[0] = direction.x / field.StepX();
+        d[1] = direction.y;
+        d[2] = direction.z / field.StepZ();
+
+        for (int i = 0; i < 3; ++i)
+        {
+            inv[i] = SafeInverse(d[i]);
+        }
+    }
+
+    float o[3];
+    float d[3];
+    float inv[3];
+};
+
+MinMaxHeightTree::MinMaxHeightTree()
+    : mpField(nullptr),
+      mLevels()
+{
+}
+
+MinMaxHeightTree::MinMaxHeightTree(const HeightField& field)
+    : mpField(nullptr),
+      mLevels()
+{
+    Build(field);
+}
+
+/**
+ * Builds the tree from the bottom up.
+ */
+void MinMaxHeightTree::Build(const HeightField& field)
+{
+    Verify(field.Rows() >= 2 && field.Cols() >= 2);
+
+    mpField = &field;
+    mLevels.clear();
+
+    // Keep halving until there is a single root node.
+    unsigned int width = field.CellCols();
+    unsigned int height = field.CellRows();
+
+    while (true)
+    {
+        Level level;
+        level.width = width;
+        level.height = height;
+        level.minHeights.resize(static_cast<size_t>(width) * height);
+        level.maxHeights.resize(static_cast<size_t>(width) * height);
+
+        mLevels.push_back(level);
+        BuildLevel(static_cast<unsigned int>(mLevels.size() - 1));
+
+        if (width == 1 && height == 1)
+        {
+            break;
+        }
+
+        width = (width + 1) / 2;
+        height = (height + 1) / 2;
+    }
+}
+
+/**
+ * Rebuilds the nodes above a changed rectangle of grid points. Every grid point is a corner of up to
+ * four cells, and each level up halves the area, so the work done is proportional to the area of the
+ * rectangle plus the height of the tree.
+ */
+void MinMaxHeightTree::Update(const GridRect& points)
+{
+    Verify(mpField != nullptr && !mLevels.empty());
+
+    if (points.IsEmpty())
+    {
+        return;
+    }
+
+    unsigned int x0 = points.colBegin > 0 ? points.colBegin - 1 : 0;
+    unsigned int y0 = points.rowBegin > 0 ? points.rowBegin - 1 : 0;
+    unsigned int x1 = std::min(points.colEnd, mLevels[0].width);
+    unsigned int y1 = std::min(points.rowEnd, mLevels[0].height);
+
+    for (unsigned int levelIndex = 0; levelIndex < mLevels.size(); ++levelIndex)
+    {
+        for (unsigned int y = y0; y < y1; ++y)
+        {
+            for (unsigned int x = x0; x < x1; ++x)
+            {
+                BuildNode(levelIndex, x, y);
+            }
+        }
+
+        x0 /= 2;
+        y0 /= 2;
+        x1 = (x1 + 1) / 2;
+        y1 = (y1 + 1) / 2;
+    }
+}
+
+void MinMaxHeightTree::BuildLevel(unsigned int levelIndex)
+{
+    const Level& level = mLevels[levelIndex];
+
+    for (unsigned int y = 0; y < level.height; ++y)
+    {
+        for (unsigned int x = 0; x < level.width; ++x)
+        {
+            BuildNode(levelIndex, x, y);
+        }
+    }
+}
+
+void MinMaxHeightTree::BuildNode(unsigned int levelIndex, unsigned int x, unsigned int y)
+{
+    Level& level = mLevels[levelIndex];
+    float lo = 0.0f, hi = 0.0f;
+
+    if (levelIndex == 0)
+    {
+        // Height range of the four corners of the grid cell.
+        int row = static_cast<int>(y), col = static_cast<int>(x);
+        float h00 = mpField->Height(row, col);
+        float h01 = mpField->Height(row, col + 1);
+        float h10 = mpField->Height(row + 1, col);
+        float h11 = mpField->Height(row + 1, col + 1);
+
+        lo = std::min(std::min(h00, h01), std::min(h10, h11));
+        hi = std::max(std::max(h00, h01), std::max(h10, h11));
+    }
+    else
+    {
+        // Height range of the (up to) four children in the level below.
+        const Level& child = mLevels[levelIndex - 1];
+        bool first = true;
+
+        for (unsigned int cy = 2 * y; cy < std::min(2 * y + 2, child.height); ++cy)
+        {
+            for (unsigned int cx = 2 * x; cx < std::min(2 * x + 2, child.width); ++cx)
+            {
+                size_t childIndex = static_cast<size_t>(cy) * child.width + cx;
+
+                lo = first ? child.minHeights[childIndex] : std::min(lo, child.minHeights[childIndex]);
+                hi = first ? child.maxHeights[childIndex] : std::max(hi, child.maxHeights[childIndex]);
+                first = false;
+            }
+        }
+    }
+
+    level.minHeights[static_cast<size_t>(y) * level.width + x] = lo;
+    level.maxHeights[static_cast<size_t>(y) * level.width + x] = hi;
+}
+
+bool MinMaxHeightTree::Raycast(
+    const D3DXVECTOR3& origin,
+    const D3DXVECTOR3& direction,
+    float maxDistance,
+    TerrainRayHit * pHitOut) const
+{
+    VerifyNotNull(mpField);
+    GridRay ray(*mpField, origin, direction);
+
+    float distance = 0.0f;
+    unsigned int row = 0, col = 0;
+
+    if (Trace(ray, maxDistance, false, &distance, &row, &col))
+    {
+        if (pHitOut != nullptr)
+        {
+            FillHit(origin, direction, distance, row, col, pHitOut);
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+bool MinMaxHeightTree::IsSegmentBlocked(const D3DXVECTOR3& from, const D3DXVECTOR3& to) const
+{
+    VerifyNotNull(mpField);
+
+    // Distance is measured in multiples of the direction, so the segment ends at a distance of one.
+    GridRay ray(*mpField, from, to - from);
+    float distance = 0.0f;
+    unsigned int row = 0, col = 0;
+
+    return Trace(ray, 1.0f, true, &distance, &row, &col);
+}
+
+/**
+ * Front to back traversal of the tree for a single ray.
+ */
+bool MinMaxHeightTree::Trace(
+    const GridRay& ray,
+    float maxDistance,
+    bool anyHit,
+    float * pDistanceOut,
+    unsigned int * pRowOut,
+    unsigned int * pColOut) const
+{
+    const unsigned int cellCols = mpField->CellCols();
+    const unsigned int cellRows = mpField->CellRows();
+
+    // Children are visited nearest first, which depends only on the ray direction.
+    const unsigned int nearX = ray.d[0] >= 0.0f ? 0 : 1;
+    const unsigned int nearY = ray.d[2] >= 0.0f ? 0 : 1;
+    const unsigned int childOrder[4][2] =
+    {
+        { nearX, nearY }, { 1 - nearX, nearY }, { nearX, 1 - nearY }, { 1 - nearX, 1 - nearY }
+    };
+
+    TraversalNode stack[MAX_STACK_DEPTH];
+    int stackSize = 0;
+
+    TraversalNode root = { LevelCount() - 1, 0, 0, 0 };
+    stack[stackSize++] = root;
+
+    float closest = maxDistance;
+    bool didHit = false;
+
+    while (stackSize > 0)
+    {
+        TraversalNode node = stack[--stackSize];
+        const Level& level = mLevels[node.level];
+        size_t index = static_cast<size_t>(node.y) * level.width + node.x;
+
+        // Bounding box of the node in grid space.
+        float lo[3] = {
+            static_cast<float>(node.x << node.level),
+            level.minHeights[index],
+            static_cast<float>(node.y << node.level) };
+        float hi[3] = {
+            static_cast<float>(std::min((node.x + 1) << node.level, cellCols)),
+            level.maxHeights[index],
+            static_cast<float>(std::min((node.y + 1) << node.level, cellRows)) };
+
+        // Slab test, clipped to the closest hit so far.
+        float enter = 0.0f, exit = closest;
+
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            float ta = (lo[axis] - ray.o[axis]) * ray.inv[axis];
+            float tb = (hi[axis] - ray.o[axis]) * ray.inv[axis];
+
+            enter = std::max(enter, std::min(ta, tb));
+            exit = std::min(exit, std::max(ta, tb));
+        }
+
+        if (enter > exit)
+        {
+            continue;
+        }
+
+        if (node.level == 0)
+        {
+            float distance = 0.0f;
+
+            if (IntersectCell(ray, node.y, node.x, closest, &distance))
+            {
+                closest = distance;
+                didHit = true;
+                *pRowOut = node.y;
+                *pColOut = node.x;
+
+                if (anyHit)
+                {
+                    break;
+                }
+            }
+
+            continue;
+        }
+
+        // Push children far to near so the nearest is popped first.
+        const Level& child = mLevels[node.level - 1];
+
+        for (int i = 3; i >= 0; --i)
+        {
+            unsigned int cx = 2 * node.x + childOrder[i][0];
+            unsigned int cy = 2 * node.y + childOrder[i][1];
+
+            if (cx < child.width && cy < child.height)
+            {
+                TraversalNode next = { node.level - 1, cx, cy, 0 };
+                stack[stackSize++] = next;
+            }
+        }
+    }
+
+    *pDistanceOut = closest;
+    return didHit;
+}
+
+/**
+ * Tests a ray against the two triangles of a grid cell.
+ */
+bool MinMaxHeightTree::IntersectCell(
+    const GridRay& ray,
+    unsigned int row,
+    unsigned int col,
+    float maxDistance,
+    float * pDistanceOut) const
+{
+    int r = static_cast<int>(row), c = static_cast<int>(col);
+    float fr = static_cast<float>(row), fc = static_cast<float>(col);
+
+    float p00[3] = { fc,        mpField->Height(r, c),         fr };
+    float p01[3] = { fc + 1.0f, mpField->Height(r, c + 1),     fr };
+    float p10[3] = { fc,        mpField->Height(r + 1, c),     fr + 1.0f };
+    float p11[3] = { fc + 1.0f, mpField->Height(r + 1, c + 1), fr + 1.0f };
+
+    float closest = maxDistance, distance = 0.0f;
+    bool didHit = false;
+
+    if (IntersectTriangle(ray.o, ray.d, p00, p01, p10, closest, &distance))
+    {
+        closest = distance;
+        didHit = true;
+    }
+
+    if (IntersectTriangle(ray.o, ray.d, p10, p01, p11, closest, &distance))
+    {
+        closest = distance;
+        didHit = true;
+    }
+
+    *pDistanceOut = closest;
+    return didHit;
+}
+
+void MinMaxHeightTree::RaycastBatch(
+    const D3DXVECTOR3 * pOrigins,
+    const D3DXVECTOR3 * pDirections,
+    const float * pMaxDistances,
+    unsigned int rayCount,
+    TerrainRayHit * pHitsOut) const
+{
+    VerifyNotNull(mpField);
+    VerifyNotNull(pOrigins);
+    VerifyNotNull(pDirections);
+    VerifyNotNull(pMaxDistances);
+    VerifyNotNull(pHitsOut);
+
+    for (unsigned int first = 0; first < rayCount; first += PACKET_SIZE)
+    {
+        RaycastPacket(
+            pOrigins + first,
+            pDirections + first,
+            pMaxDistances + first,
+            std::min(PACKET_SIZE, rayCount - first),
+            pHitsOut + first);
+    }
+}
+
+/**
+ * Traces up to four rays through the tree together. Each node's bounding box is tested against all
+ * rays in the packet at once with SSE, and a node is only descended into by the rays that hit it.
+ */
+void MinMaxHeightTree::RaycastPacket(
+    const D3DXVECTOR3 * pOrigins,
+    const D3DXVECTOR3 * pDirections,
+    const float * pMaxDistances,
+    unsigned int rayCount,
+    TerrainRayHit * pHitsOut) const
+{
+    const unsigned int cellCols = mpField->CellCols();
+    const unsigned int cellRows = mpField->CellRows();
+
+    // Transpose the packet into SSE friendly structure of arrays form. Unused lanes duplicate the first
+    // ray and are masked out.
+    SSE_ALIGNED float origin[3][PACKET_SIZE];
+    SSE_ALIGNED float inverse[3][PACKET_SIZE];
+    SSE_ALIGNED float closest[PACKET_SIZE];
+
+    GridRay rays[PACKET_SIZE] =
+    {
+        GridRay(*mpField, pOrigins[0], pDirections[0]),
+        GridRay(*mpField, pOrigins[rayCount > 1 ? 1 : 0], pDirections[rayCount > 1 ? 1 : 0]),
+        GridRay(*mpField, pOrigins[rayCount > 2 ? 2 : 0], pDirections[rayCount > 2 ? 2 : 0]),
+        GridRay(*mpField, pOrigins[rayCount > 3 ? 3 : 0], pDirections[rayCount > 3 ? 3 : 0])
+    };
+
+    unsigned int rows[PACKET_SIZE] = { 0 };
+    unsigned int cols[PACKET_SIZE] = { 0 };
+    bool didHit[PACKET_SIZE] = { false };
+
+    for (unsigned int lane = 0; lane < PACKET_SIZE; ++lane)
+    {
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            origin[axis][lane] = rays[lane].o[axis];
+            inverse[axis][lane] = rays[lane].inv[axis];
+        }
+
+        closest[lane] = pMaxDistances[lane < rayCount ? lane : 0];
+    }
+
+    __m128 o[3], inv[3];
+
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        o[axis] = _mm_load_ps(origin[axis]);
+        inv[axis] = _mm_load_ps(inverse[axis]);
+    }
+
+    // Packets are assumed to be roughly coherent, so the first ray picks the child visiting order.
+    const unsigned int nearX = rays[0].d[0] >= 0.0f ? 0 : 1;
+    const unsigned int nearY = rays[0].d[2] >= 0.0f ? 0 : 1;
+    const unsigned int childOrder[4][2] =
+    {
+        { nearX, nearY }, { 1 - nearX, nearY }, { nearX, 1 - nearY }, { 1 - nearX, 1 - nearY }
+    };
+
+    TraversalNode stack[MAX_STACK_DEPTH];
+    int stackSize = 0;
+
+    TraversalNode root = { LevelCount() - 1, 0, 0, (1u << rayCount) - 1 };
+    stack[stackSize++] = root;
+
+    while (stackSize > 0)
+    {
+        TraversalNode node = stack[--stackSize];
+        const Level& level = mLevels[node.level];
+        size_t index = static_cast<size_t>(node.y) * level.width + node.x;
+
+        float lo[3] = {
+            static_cast<float>(node.x << node.level),
+            level.minHeights[index],
+            static_cast<float>(node.y << node.level) };
+        float hi[3] = {
+            static_cast<float>(std::min((node.x + 1) << node.level, cellCols)),
+            level.maxHeights[index],
+            static_cast<float>(std::min((node.y + 1) << node.level, cellRows)) };
+
+        // Four slab tests at once.
+        __m128 enter = _mm_setzero_ps();
+        __m128 exit = _mm_load_ps(closest);
+
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            __m128 ta = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(lo[axis]), o[axis]), inv[axis]);
+            __m128 tb = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(hi[axis]), o[axis]), inv[axis]);
+
+            enter = _mm_max_ps(enter, _mm_min_ps(ta, tb));
+            exit = _mm_min_ps(exit, _mm_max_ps(ta, tb));
+        }
+
+        unsigned int mask = node.mask & static_cast<unsigned int>(_mm_movemask_ps(_mm_cmple_ps(enter, exit)));
+
+        if (mask == 0)
+        {
+            continue;
+        }
+
+        if (node.level == 0)
+        {
+            for (unsigned int lane = 0; lane < PACKET_SIZE; ++lane)
+            {
+                float distance = 0.0f;
+
+                if ((mask & (1u << lane)) != 0 &&
+                    IntersectCell(rays[lane], node.y, node.x, closest[lane], &distance))
+                {
+                    closest[lane] = distance;
+                    didHit[lane] = true;
+                    rows[lane] = node.y;
+                    cols[lane] = node.x;
+                }
+            }
+
+            continue;
+        }
+
+        const Level& child = mLevels[node.level - 1];
+
+        for (int i = 3; i >= 0; --i)
+        {
+            unsigned int cx = 2 * node.x + childOrder[i][0];
+            unsigned int cy = 2 * node.y + childOrder[i][1];
+
+            if (cx < child.width && cy < child.height)
+            {
+                TraversalNode next = { node.level - 1, cx, cy, mask };
+                stack[stackSize++] = next;
+            }
+        }
+    }
+
+    for (unsigned int lane = 0; lane < rayCount; ++lane)
+    {
+        if (didHit[lane])
+        {
+            FillHit(pOrigins[lane], pDirections[lane], closest[lane], rows[lane], cols[lane], &pHitsOut[lane]);
+        }
+        else
+        {
+            pHitsOut[lane].distance = -1.0f;
+            pHitsOut[lane].position = pOrigins[lane];
+            pHitsOut[lane].row = 0;
+            pHitsOut[lane].col = 0;
+        }
+    }
+}
+
+bool MinMaxHeightTree::RaycastBruteForce(
+    const D3DXVECTOR3& origin,
+    const D3DXVECTOR3& direction,
+    float maxDistance,
+    TerrainRayHit * pHitOut) const
+{
+    VerifyNotNull(mpField);
+    GridRay ray(*mpField, origin, direction);
+
+    float closest = maxDistance;
+    unsigned int hitRow = 0, hitCol = 0;
+    bool didHit = false;
+
+    for (unsigned int row = 0; row < mpField->CellRows(); ++row)
+    {
+        for (unsigned int col = 0; col < mpField->CellCols(); ++col)
+        {
+            float distance = 0.0f;
+
+            if (IntersectCell(ray, row, col, closest, &distance))
+            {
+                closest = distance;
+                hitRow = row;
+                hitCol = col;
+                didHit = true;
+            }
+        }
+    }
+
+    if (didHit && pHitOut != nullptr)
+    {
+        FillHit(origin, direction, closest, hitRow, hitCol, pHitOut);
+    }
+
+    return didHit;
+}
+
+void MinMaxHeightTree::FillHit(
+    const D3DXVECTOR3& origin,
+    const D3DXVECTOR3& direction,
+    float distance,
+    unsigned int row,
+    unsigned int col,
+    TerrainRayHit * pHitOut) const
+{
+    pHitOut->distance = distance;
+    pHitOut->position = origin + direction * distance;
+    pHitOut->row = row;
+    pHitOut->col = col;
+}
@@ -0,0 +1,435 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "stdafx.h"
+#include "graphics/Primitives.h"
+
+#include <d3dx10.h>
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+#include <vector>
+
+namespace
+{
+    const float PI = 3.14159265358979f;
+    const float TWO_PI = 2.0f * PI;
+
+    /**
+     * Adds a ring of slices + 1 vertices around the y axis, at height y. The normal of each vertex
+     * points out from the axis by normalOut and up by normalUp, before being normalized.
+     */
+    void AddRing(
+        PrimitiveMesh * pMesh,
+        float radius,
+        float y,
+        float normalOut,
+        float normalUp,
+        float v,
+        unsigned int slices)
+    {
+        for (unsigned int slice = 0; slice <= slices; ++slice)
+        {
+            // The seam vertex reuses the first angle so that it lands exactly on the first vertex.
+            float angle = TWO_PI * (slice % slices) / slices;
+            float c = std::cos(angle), s = std::sin(angle);
+
+            D3DXVECTOR3 normal(normalOut * c, normalUp, normalOut * s);
+            D3DXVec3Normalize(&normal, &normal);
+
+            pMesh->AddVertex(
+                D3DXVECTOR3(radius * c, y, radius * s),
+                normal,
+                static_cast<float>(slice) / slices,
+                v);
+        }
+    }
+
+    /**
+     * Connects rows + 1 rows of cols + 1 vertices, starting at firstVertex, with two triangles per
+     * quad. Rows must run from top to bottom. The first and last rows can be skipped if they collapse
+     * to a point, eg at the pole of a sphere.
+     */
+    void AddGrid(
+        PrimitiveMesh * pMesh,
+        unsigned int firstVertex,
+        unsigned int rows,
+        unsigned int cols,
+        bool firstRowIsPoint,
+        bool lastRowIsPoint)
+    {
+        for (unsigned int row = 0; row < rows; ++row)
+        {
+            for (unsigned int col = 0; col < cols; ++col)
+            {
+                unsigned int a = firstVertex + row * (cols + 1) + col;
+                unsigned int b = a + 1;
+                unsigned int c = a + cols + 1;
+                unsigned int d = c + 1;
+
+                if (!(row == 0 && firstRowIsPoint))
+                {
+                    pMesh->AddTriangle(a, b, c);
+                }
+
+                if (!(row == rows - 1 && lastRowIsPoint))
+                {
+                    pMesh->AddTriangle(c, b, d);
+                }
+            }
+        }
+    }
+
+    /**
+     * Adds a flat disc at height y facing straight up or down, as a triangle fan around a center
+     * vertex. The disc is textured as if the texture was projected down onto it.
+     */
+    void AddCap(PrimitiveMesh * pMesh, float radius, float y, bool facingUp, unsigned int slices)
+    {
+        D3DXVECTOR3 normal(0.0f, facingUp ? 1.0f : -1.0f, 0.0f);
+        unsigned int center = pMesh->AddVertex(D3DXVECTOR3(0.0f, y, 0.0f), normal, 0.5f, 0.5f);
+
+        for (unsigned int slice = 0; slice < slices; ++slice)
+        {
+            float angle = TWO_PI * slice / slices;
+            float c = std::cos(angle), s = std::sin(angle);
+
+            pMesh->AddVertex(D3DXVECTOR3(radius * c, y, radius * s), normal, 0.5f + 0.5f * c, 0.5f - 0.5f * s);
+        }
+
+        for (unsigned int slice = 0; slice < slices; ++slice)
+        {
+            unsigned int current = center + 1 + slice;
+            unsigned int next = center + 1 + (slice + 1) % slices;
+
+            if (facingUp)
+            {
+                pMesh->AddTriangle(center, next, current);
+            }
+            else
+            {
+                pMesh->AddTriangle(center, current, next);
+            }
+        }
+    }
+
+    /**
+     * Adds one face of a box. up is the face's v direction; the u direction is chosen so that the
+     * face's two triangles are wound clockwise when seen from outside.
+     */
+    void AddBoxFace(
+        PrimitiveMesh * pMesh,
+        const D3DXVECTOR3& halfExtents,
+        const D3DXVECTOR3& normal,
+        const D3DXVECTOR3& up)
+    {
+        D3DXVECTOR3 right;
+        D3DXVec3Cross(&right, &normal, &up);
+
+        const float CORNERS[4][2] = { { -1.0f, -1.0f }, { -1.0f, 1.0f }, { 1.0f, 1.0f }, { 1.0f, -1.0f } };
+        unsigned int first = pMesh->VertexCount();
+
+        for (unsigned int i = 0; i < 4; ++i)
+        {
+            D3DXVECTOR3 corner = normal + right * CORNERS[i][0] + up * CORNERS[i][1];
+
+            pMesh->AddVertex(
+                D3DXVECTOR3(corner.x * halfExtents.x, corner.y * halfExtents.y, corner.z * halfExtents.z),
+                normal,
+                0.5f + 0.5f * CORNERS[i][0],
+                0.5f - 0.5f * CORNERS[i][1]);
+        }
+
+        pMesh->AddTriangle(first, first + 1, first + 2);
+        pMesh->AddTriangle(first, first + 2, first + 3);
+    }
+
+    /**
+     * Spherical texture coordinates for a point on the unit sphere.
+     */
+    void SphericalTexcoord(const D3DXVECTOR3& direction, float * pU, float * pV)
+    {
+        *pU = 0.5f + std::atan2(direction.z, direction.x) / TWO_PI;
+        *pV = std::acos(std::min(std::max(direction.y, -1.0f), 1.0f)) / PI;
+    }
+}
+
+void PrimitiveMesh::Clear()
+{
+    vertices.clear();
+    indices.clear();
+}
+
+unsigned int PrimitiveMesh::AddVertex(const D3DXVECTOR3& position, const D3DXVECTOR3& normal, float u, float v)
+{
+    StaticMeshVertex vertex;
+
+    vertex.pos = position;
+    vertex.normal = normal;
+    vertex.texcoord = D3DXVECTOR2(u, v);
+    vertex.color = D3DXCOLOR(1.0f, 1.0f, 1.0f, 1.0f);
+
+    vertices.push_back(vertex);
+    return static_cast<unsigned int>(vertices.size() - 1);
+}
+
+void PrimitiveMesh::AddTriangle(unsigned int a, unsigned int b, unsigned int c)
+{
+    indices.push_back(a);
+    indices.push_back(b);
+    indices.push_back(c);
+}
+
+namespace Primitives
+{
+    void GenerateBox(const D3DXVECTOR3& halfExtents, PrimitiveMesh * pMeshOut)
+    {
+        VerifyNotNull(pMeshOut);
+        pMeshOut->Clear();
+
+        AddBoxFace(pMeshOut, halfExtents, D3DXVECTOR3( 0.0f,  0.0f, -1.0f), D3DXVECTOR3(0.0f, 1.0f, 0.0f));
+        AddBoxFace(pMeshOut, halfExtents, D3DXVECTOR3( 0.0f,  0.0f,  1.0f), D3DXVECTOR3(0.0f, 1.0f, 0.0f));
+        AddBoxFace(pMeshOut, halfExtents, D3DXVECTOR3(-1.0f,  0.0f,  0.0f), D3DXVECTOR3(0.0f, 1.0f, 0.0f));
+        AddBoxFace(pMeshOut, halfExtents, D3DXVECTOR3( 1.0f,  0.0f,  0.0f), D3DXVECTOR3(0.0f, 1.0f, 0.0f));
+        AddBoxFace(pMeshOut, halfExtents, D3DXVECTOR3( 0.0f,  1.0f,  0.0f), D3DXVECTOR3(0.0f, 0.0f, 1.0f));
+        AddBoxFace(pMeshOut, halfExtents, D3DXVECTOR3( 0.0f, -1.0f,  0.0f), D3DXVECTOR3(0.0f, 0.0f, 1.0f));
+    }
+
+    void GenerateUvSphere(float radius, unsigned int slices, unsigned int stacks, PrimitiveMesh * pMeshOut)
+    {
+        VerifyNotNull(pMeshOut);
+        Verify(slices >= 3 && stacks >= 2);
+        pMeshOut->Clear();
+
+        for (unsigned int stack = 0; stack <= stacks; ++stack)
+        {
+            float polar = PI * stack / stacks;
+            float s = std::sin(polar), c = std::cos(polar);
+
+            AddRing(pMeshOut, radius * s, radius * c, s, c, static_cast<float>(stack) / stacks, slices);
+        }
+
+        AddGrid(pMeshOut, 0, stacks, slices, true, true);
+    }
+
+    void GenerateIcoSphere(float radius, unsigned int subdivisions, PrimitiveMesh * pMeshOut)
+    {
+        VerifyNotNull(pMeshOut);
+        pMeshOut->Clear();
+
+        const float T = 1.61803398875f;     // Golden ratio.
+        const float CORNERS[12][3] =
+        {
+            { -1.0f,  T, 0.0f }, { 1.0f,  T, 0.0f }, { -1.0f, -T, 0.0f }, { 1.0f, -T, 0.0f },
+            { 0.0f, -1.0f,  T }, { 0.0f, 1.0f,  T }, { 0.0f, -1.0f, -T }, { 0.0f, 1.0f, -T },
+            {  T, 0.0f, -1.0f }, {  T, 0.0f, 1.0f }, { -T, 0.0f, -1.0f }, { -T, 0.0f, 1.0f }
+        };
+
+        const unsigned int FACES[20 * 3] =
+        {
+            0, 11, 5,   0, 5, 1,    0, 1, 7,    0, 7, 10,   0, 10, 11,
+            1, 5, 9,    5, 11, 4,   11, 10, 2,  10, 7, 6,   7, 1, 8,
+            3, 9, 4,    3, 4, 2,    3, 2, 6,    3, 6, 8,    3, 8, 9,
+            4, 9, 5,    2, 4, 11,   6, 2, 10,   8, 6, 7,    9, 8, 1
+        };
+
+        // Build the unit sphere first, with only positions filled in. Normals and texture coordinates
+        // are set once at the end.
+        for (unsigned int i = 0; i < 12; ++i)
+        {
+            D3DXVECTOR3 position(CORNERS[i][0], CORNERS[i][1], CORNERS[i][2]);
+            D3DXVec3Normalize(&position, &position);
+
+            pMeshOut->AddVertex(position, position, 0.0f, 0.0f);
+        }
+
+        pMeshOut->indices.assign(&FACES[0], &FACES[20 * 3]);
+
+        // Split every triangle into four, sharing the new vertex on each edge with the triangle on the
+        // other side of it.
+        std::vector<unsigned int> previous;
+        std::unordered_map<unsigned long long, unsigned int> midpoints;
+
+        for (unsigned int level = 0; level < subdivisions; ++level)
+        {
+            previous.swap(pMeshOut->indices);
+            pMeshOut->indices.clear();
+            midpoints.clear();
+
+            for (size_t i = 0; i < previous.size(); i += 3)
+            {
+                unsigned int corners[3] = { previous[i], previous[i + 1], previous[i + 2] };
+                unsigned int edges[3];
+
+                for (unsigned int e = 0; e < 3; ++e)
+                {
+                    unsigned int a = corners[e], b = corners[(e + 1) % 3];
+                    unsigned long long key = (static_cast<unsigned long long>(std::min(a, b)) << 32) | std::max(a, b);
+                    auto existing = midpoints.find(key);
+
+                    if (existing != midpoints.end())
+                    {
+                        edges[e] = existing->second;
+                    }
+                    else
+                    {
+                        D3DXVECTOR3 position = pMeshOut->vertices[a].pos + pMeshOut->vertices[b].pos;
+                        D3DXVec3Normalize(&position, &position);
+
+                        edges[e] = pMeshOut->AddVertex(position, position, 0.0f, 0.0f);
+                        midpoints[key] = edges[e];
+                    }
+                }
+
+                pMeshOut->AddTriangle(corners[0], edges[0], edges[2]);
+                pMeshOut->AddTriangle(corners[1], edges[1], edges[0]);
+                pMeshOut->AddTriangle(corners[2], edges[2], edges[1]);
+                pMeshOut->AddTriangle(edges[0], edges[1], edges[2]);
+            }
+        }
+
+        for (size_t i = 0; i < pMeshOut->vertices.size(); ++i)
+        {
+            StaticMeshVertex& vertex = pMeshOut->vertices[i];
+
+            vertex.normal = vertex.pos;
+            SphericalTexcoord(vertex.normal, &vertex.texcoord.x, &vertex.texcoord.y);
+            vertex.pos *= radius;
+        }
+    }
+
+    void GenerateCylinder(float radius, float height, unsigned int slices, PrimitiveMesh * pMeshOut)
+    {
+        VerifyNotNull(pMeshOut);
+        Verify(slices >= 3);
+        pMeshOut->Clear();
+
+        float top = height * 0.5f;
+
+        AddRing(pMeshOut, radius, top, 1.0f, 0.0f, 0.0f, slices);
+        AddRing(pMeshOut, radius, -top, 1.0f, 0.0f, 1.0f, slices);
+        AddGrid(pMeshOut, 0, 1, slices, false, false);
+
+        AddCap(pMeshOut, radius, top, true, slices);
+        AddCap(pMeshOut, radius, -top, false, slices);
+    }
+
+    void GenerateCone(float radius, float height, unsigned int slices, PrimitiveMesh * pMeshOut)
+    {
+        VerifyNotNull(pMeshOut);
+        Verify(slices >= 3);
+        pMeshOut->Clear();
+
+        float top = height * 0.5f;
+
+        // The side normals lean up by the slope of the cone. The point gets its own vertex for each
+        // slice so each can carry that slice's normal.
+        AddRing(pMeshOut, 0.0f, top, height, radius, 0.0f, slices);
+        AddRing(pMeshOut, radius, -top, height, radius, 1.0f, slices);
+        AddGrid(pMeshOut, 0, 1, slices, true, false);
+
+        AddCap(pMeshOut, radius, -top, false, slices);
+    }
+
+    void GenerateTorus(
+        float majorRadius,
+        float minorRadius,
+        unsigned int rings,
+        unsigned int sides,
+        PrimitiveMesh * pMeshOut)
+    {
+        VerifyNotNull(pMeshOut);
+        Verify(rings >= 3 && sides >= 3);
+        pMeshOut->Clear();
+
+        for (unsigned int ring = 0; ring <= rings; ++ring)
+        {
+            float ringAngle = TWO_PI * (ring % rings) / rings;
+            float ringCos = std::cos(ringAngle), ringSin = std::sin(ringAngle);
+
+            for (unsigned int side = 0; side <= sides; ++side)
+            {
+                float sideAngle = TWO_PI * (side % sides) / sides;
+                float sideCos = std::cos(sideAngle), sideSin = std::sin(sideAngle);
+                float distance = majorRadius + minorRadius * sideCos;
+
+                pMeshOut->AddVertex(
+                    D3DXVECTOR3(distance * ringCos, minorRadius * sideSin, distance * ringSin),
+                    D3DXVECTOR3(sideCos * ringCos, sideSin, sideCos * ringSin),
+                    static_cast<float>(ring) / rings,
+                    static_cast<float>(side) / sides);
+            }
+        }
+
+        AddGrid(pMeshOut, 0, rings, sides, false, false);
+    }
+
+    void GeneratePlane(float width, float depth, unsigned int cols, unsigned int rows, PrimitiveMesh * pMeshOut)
+    {
+        VerifyNotNull(pMeshOut);
+        Verify(cols >= 1 && rows >= 1);
+        pMeshOut->Clear();
+
+        D3DXVECTOR3 up(0.0f, 1.0f, 0.0f);
+
+        // Rows run from +z to -z, so that the grid is wound the same way as the other shapes.
+        for (unsigned int row = 0; row <= rows; ++row)
+        {
+            float v = static_cast<float>(row) / rows;
+
+            for (unsigned int col = 0; col <= cols; ++col)
+            {
+                float u = static_cast<float>(col) / cols;
+                pMeshOut->AddVertex(D3DXVECTOR3((u - 0.5f) * width, 0.0f, (0.5f - v) * depth), up, u, v);
+            }
+        }
+
+        AddGrid(pMeshOut, 0, rows, cols, false, false);
+    }
+
+    void GenerateCapsule(
+        float radius,
+        float height,
+        unsigned int slices,
+        unsigned int stacks,
+        PrimitiveMesh * pMeshOut)
+    {
+        VerifyNotNull(pMeshOut);
+        Verify(slices >= 3 && stacks >= 1);
+        pMeshOut->Clear();
+
+        // v runs down the length of the capsule's outline so the texture is not stretched on the
+        // straight section.
+        float top = height * 0.5f;
+        float length = PI * radius + height;
+
+        for (unsigned int hemisphere = 0; hemisphere < 2; ++hemisphere)
+        {
+            float offset = (hemisphere == 0) ? top : -top;
+
+            for (unsigned int stack = 0; stack <= stacks; ++stack)
+            {
+                float polar = 0.5f * PI * (hemisphere + static_cast<float>(stack) / stacks);
+                float s = std::sin(polar), c = std::cos(polar);
+                float v = (polar * radius + (hemisphere == 0 ? 0.0f : height)) / length;
+
+                AddRing(pMeshOut, radius * s, radius * c + offset, s, c, v, slices);
+            }
+        }
+
+        // The two middle rows are the edges of the straight section.
+        AddGrid(pMeshOut, 0, 2 * stacks + 1, slices, true, true);
+    }
+}
@@ -0,0 +1,151 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "stdafx.h"
+#include "terrain/QuantizedTerrain.h"
+#include "terrain/HeightField.h"
+
+#include <d3dx10.h>
+#include <algorithm>
+#include <cmath>
+
+static_assert(sizeof(QuantizedTerrainVertex) == 6, "Shader expects three 16 bit values per vertex");
+
+namespace
+{
+    const float HEIGHT_LEVELS = 65535.0f;
+    const float NORMAL_LEVELS = 255.0f;
+
+    float SignNotZero(float v)
+    {
+        return v >= 0.0f ? 1.0f : -1.0f;
+    }
+
+    unsigned int QuantizeUnit(float v, float levels)
+    {
+        float clamped = std::min(std::max(v, 0.0f), 1.0f);
+        return static_cast<unsigned int>(clamped * levels + 0.5f);
+    }
+}
+
+unsigned short TerrainQuantization::EncodeNormal(const D3DXVECTOR3& normal)
+{
+    float length = std::fabs(normal.x) + std::fabs(normal.y) + std::fabs(normal.z);
+
+    if (length <= 0.0f)
+    {
+        return EncodeNormal(D3DXVECTOR3(0.0f, 1.0f, 0.0f));
+    }
+
+    float u = normal.x / length;
+    float v = normal.z / length;
+
+    // Fold the lower hemisphere over the diagonals.
+    if (normal.y < 0.0f)
+    {
+        float foldedU = (1.0f - std::fabs(v)) * SignNotZero(u);
+        float foldedV = (1.0f - std::fabs(u)) * SignNotZero(v);
+
+        u = foldedU;
+        v = foldedV;
+    }
+
+    unsigned int encodedU = QuantizeUnit(u * 0.5f + 0.5f, NORMAL_LEVELS);
+    unsigned int encodedV = QuantizeUnit(v * 0.5f + 0.5f, NORMAL_LEVELS);
+
+    return static_cast<unsigned short>(encodedU | (encodedV << 8));
+}
+
+/**
+ * Matches the decode in landscape.fx.
+ */
+D3DXVECTOR3 TerrainQuantization::DecodeNormal(unsigned short encoded)
+{
+    float u = (encoded & 0xFF) / NORMAL_LEVELS * 2.0f - 1.0f;
+    float v = (encoded >> 8) / NORMAL_LEVELS * 2.0f - 1.0f;
+
+    D3DXVECTOR3 normal(u, 1.0f - std::fabs(u) - std::fabs(v), v);
+
+    if (normal.y < 0.0f)
+    {
+        normal.x = (1.0f - std::fabs(v)) * SignNotZero(u);
+        normal.z = (1.0f - std::fabs(u)) * SignNotZero(v);
+    }
+
+    D3DXVec3Normalize(&normal, &normal);
+    return normal;
+}
+
+float TerrainQuantization::HeightStep(float minHeight, float maxHeight)
+{
+    float range = maxHeight - minHeight;
+    return range > 0.0f ? range / HEIGHT_LEVELS : 1.0f;
+}
+
+unsigned short TerrainQuantization::EncodeHeight(float height, float minHeight, float heightStep)
+{
+    return static_cast<unsigned short>(QuantizeUnit((height - minHeight) / (heightStep * HEIGHT_LEVELS), HEIGHT_LEVELS));
+}
+
+float TerrainQuantization::DecodeHeight(unsigned short encoded, float minHeight, float heightStep)
+{
+    return minHeight + encoded * heightStep;
+}
+
+void TerrainQuantization::PackVertices(
+    const HeightField& field,
+    float minHeight,
+    float heightStep,
+    TerrainMaterialFunction findMaterial,
+    const unsigned char * pAmbient,
+    std::vector<QuantizedTerrainVertex> * pVerticesOut)
+{
+    VerifyNotNull(pVerticesOut);
+
+    GridRect everything = { 0, 0, field.Rows(), field.Cols() };
+    pVerticesOut->resize(everything.Area());
+
+    PackVertices(field, everything, minHeight, heightStep, findMaterial, pAmbient, &(*pVerticesOut)[0]);
+}
+
+void TerrainQuantization::PackVertices(
+    const HeightField& field,
+    const GridRect& rect,
+    float minHeight,
+    float heightStep,
+    TerrainMaterialFunction findMaterial,
+    const unsigned char * pAmbient,
+    QuantizedTerrainVertex * pVerticesOut)
+{
+    VerifyNotNull(findMaterial);
+    VerifyNotNull(pVerticesOut);
+    Verify(rect.rowEnd <= field.Rows() && rect.colEnd <= field.Cols());
+
+    QuantizedTerrainVertex * pVertex = pVerticesOut;
+
+    for (unsigned int row = rect.rowBegin; row < rect.rowEnd; ++row)
+    {
+        for (unsigned int col = rect.colBegin; col < rect.colEnd; ++col, ++pVertex)
+        {
+            float height = field.Height(row, col);
+            D3DXVECTOR3 normal = field.Normal(row, col);
+
+            pVertex->height = EncodeHeight(height, minHeight, heightStep);
+            pVertex->normal = EncodeNormal(normal);
+            pVertex->material = findMaterial(height, normal);
+            pVertex->ambient = pAmbient != nullptr ? pAmbient[static_cast<size_t>(row) * field.Cols() + col] : 255;
+        }
+    }
+}
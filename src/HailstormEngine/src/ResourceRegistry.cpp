@@ -0,0 +1,114 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "stdafx.h"
+#include "graphics/ResourceRegistry.h"
+
+#include <Unknwn.h>
+
+const unsigned int ResourceRegistry::DEFAULT_RETIRE_LATENCY;
+
+ResourceRegistry::ResourceRegistry(unsigned int retireLatency)
+    : mRetireLatency(retireLatency),
+      mFrameIndex(0),
+      mDestroyedCount(0),
+      mMeshes(),
+      mRetiredObjects(),
+      mRetiredObjectFrames()
+{
+}
+
+ResourceRegistry::~ResourceRegistry()
+{
+    Clear();
+}
+
+MeshHandle ResourceRegistry::AddMesh(StaticMesh&& mesh)
+{
+    // Only fails if every one of the million or so handle slots is in use.
+    MeshHandle handle = mMeshes.Insert(std::move(mesh));
+    Verify(!handle.IsNull());
+
+    return handle;
+}
+
+bool ResourceRegistry::ReleaseMesh(MeshHandle handle)
+{
+    return mMeshes.Retire(handle, mFrameIndex);
+}
+
+void ResourceRegistry::DeferRelease(IUnknown * pObject)
+{
+    if (pObject != nullptr)
+    {
+        // Attach rather than assign, so the caller's reference is the one that gets dropped.
+        Microsoft::WRL::ComPtr<IUnknown> object;
+        object.Attach(pObject);
+
+        mRetiredObjects.push_back(std::move(object));
+        mRetiredObjectFrames.push_back(mFrameIndex);
+    }
+}
+
+/**
+ * Anything released in frame N may still be used by draws the GPU runs during the next few frames,
+ * so it is destroyed at the end of frame N + retireLatency.
+ */
+void ResourceRegistry::EndFrame()
+{
+    if (mFrameIndex >= mRetireLatency)
+    {
+        unsigned int safeFrame = mFrameIndex - mRetireLatency;
+
+        mDestroyedCount += mMeshes.DestroyRetired(safeFrame);
+        DestroyRetiredObjects(safeFrame);
+    }
+
+    ++mFrameIndex;
+}
+
+void ResourceRegistry::Clear()
+{
+    mDestroyedCount += mMeshes.RetiredCount() + static_cast<unsigned int>(mRetiredObjects.size());
+
+    mMeshes.Clear();
+    mRetiredObjects.clear();
+    mRetiredObjectFrames.clear();
+}
+
+ResourceRegistryStats ResourceRegistry::Stats() const
+{
+    ResourceRegistryStats stats;
+    stats.meshCount = mMeshes.Count();
+    stats.retiredMeshCount = mMeshes.RetiredCount();
+    stats.retiredObjectCount = static_cast<unsigned int>(mRetiredObjects.size());
+    stats.destroyedCount = mDestroyedCount;
+
+    return stats;
+}
+
+void ResourceRegistry::DestroyRetiredObjects(unsigned int frame)
+{
+    size_t dueCount = 0;
+
+    while (dueCount < mRetiredObjectFrames.size() && mRetiredObjectFrames[dueCount] <= frame)
+    {
+        ++dueCount;
+    }
+
+    mRetiredObjects.erase(mRetiredObjects.begin(), mRetiredObjects.begin() + dueCount);
+    mRetiredObjectFrames.erase(mRetiredObjectFrames.begin(), mRetiredObjectFrames.begin() + dueCount);
+    mDestroyedCount += static_cast<unsigned int>(dueCount);
+}
@@ -0,0 +1,207 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "stdafx.h"
+#include "graphics/StreamingTexture.h"
+
+#include <d3d10.h>
+#include <utility>
+#include <vector>
+
+#include "graphics/DirectXExceptions.h"
+#include "runtime/logging.h"
+
+namespace
+{
+    const unsigned int CUBE_FACE_COUNT = 6;
+}
+
+StreamingTexture::StreamingTexture(ID3D10Device * pDevice, TextureStreamer * pStreamer)
+    : mDevice(pDevice),
+      mpStreamer(pStreamer),
+      mHandle(),
+      mFile(),
+      mDds(),
+      mTexture(),
+      mView(),
+      mFirstMip(0)
+{
+    VerifyNotNull(pDevice);
+    VerifyNotNull(pStreamer);
+}
+
+/**
+ * Stops streaming before the file the streamer reads from is closed.
+ */
+StreamingTexture::~StreamingTexture()
+{
+    if (!mHandle.IsNull())
+    {
+        mpStreamer->Remove(mHandle);
+    }
+}
+
+bool StreamingTexture::Open(VirtualFile&& file, unsigned int requestedSize, const char ** ppReasonOut)
+{
+    VerifyNotNull(ppReasonOut);
+    Verify(mHandle.IsNull());
+
+    mFile = std::move(file);
+
+    if (!mDds.Open(mFile.Data(), ppReasonOut))
+    {
+        return false;
+    }
+
+    if (mDds.IsVolume())
+    {
+        *ppReasonOut = "volume textures are not supported";
+        return false;
+    }
+
+    if (mDds.IsCubeMap() && mDds.ItemCount() != CUBE_FACE_COUNT)
+    {
+        *ppReasonOut = "cube map arrays are not supported";
+        return false;
+    }
+
+    // The streamer uploads the tail through the callback before Add returns.
+    HRESULT tailResult = E_FAIL;
+
+    mHandle = mpStreamer->Add(&mDds, requestedSize, [this, &tailResult](unsigned int firstMip)
+    {
+        HRESULT hr = Upload(firstMip);
+
+        if (mHandle.IsNull())
+        {
+            tailResult = hr;
+        }
+        else if (FAILED(hr))
+        {
+            LOG_WARN("StreamingTexture") << "Could not upload mip " << firstMip << ": "
+                << DirectXException::ErrorCodeToString(hr).c_str();
+        }
+    });
+
+    if (mHandle.IsNull() || FAILED(tailResult))
+    {
+        if (!mHandle.IsNull())
+        {
+            mpStreamer->Remove(mHandle);
+            mHandle = TextureStreamer::TextureHandle();
+        }
+
+        *ppReasonOut = "device could not create the texture";
+        return false;
+    }
+
+    return true;
+}
+
+void StreamingTexture::RequestSize(unsigned int requestedSize)
+{
+    mpStreamer->RequestSize(mHandle, requestedSize);
+}
+
+size_t StreamingTexture::DeviceSize() const
+{
+    size_t size = 0;
+
+    for (unsigned int mip = mFirstMip; mTexture && mip < mDds.MipCount(); ++mip)
+    {
+        size += mDds.LevelSize(mip);
+    }
+
+    return size;
+}
+
+/**
+ * Creates a device texture holding mips firstMip onwards of every item, straight from the file's
+ * bytes, and replaces the old texture and view with it. The old texture is kept if this fails.
+ */
+HRESULT StreamingTexture::Upload(unsigned int firstMip)
+{
+    unsigned int levelCount = mDds.MipCount() - firstMip;
+    std::vector<D3D10_SUBRESOURCE_DATA> initialData(levelCount * mDds.ItemCount());
+
+    for (unsigned int item = 0; item < mDds.ItemCount(); ++item)
+    {
+        for (unsigned int level = 0; level < levelCount; ++level)
+        {
+            DdsSurface surface = mDds.Surface(item, firstMip + level);
+            D3D10_SUBRESOURCE_DATA& data = initialData[item * levelCount + level];
+
+            data.pSysMem = surface.data.pData;
+            data.SysMemPitch = static_cast<UINT>(surface.rowPitch);
+            data.SysMemSlicePitch = static_cast<UINT>(surface.slicePitch);
+        }
+    }
+
+    D3D10_TEXTURE2D_DESC desc;
+    desc.Width = mDds.MipWidth(firstMip);
+    desc.Height = mDds.MipHeight(firstMip);
+    desc.MipLevels = levelCount;
+    desc.ArraySize = mDds.ItemCount();
+    desc.Format = static_cast<DXGI_FORMAT>(mDds.Format());
+    desc.SampleDesc.Count = 1;
+    desc.SampleDesc.Quality = 0;
+    desc.Usage = D3D10_USAGE_IMMUTABLE;
+    desc.BindFlags = D3D10_BIND_SHADER_RESOURCE;
+    desc.CPUAccessFlags = 0;
+    desc.MiscFlags = mDds.IsCubeMap() ? D3D10_RESOURCE_MISC_TEXTURECUBE : 0;
+
+    D3D10_SHADER_RESOURCE_VIEW_DESC viewDesc;
+    viewDesc.Format = desc.Format;
+
+    if (mDds.IsCubeMap())
+    {
+        viewDesc.ViewDimension = D3D10_SRV_DIMENSION_TEXTURECUBE;
+        viewDesc.TextureCube.MostDetailedMip = 0;
+        viewDesc.TextureCube.MipLevels = levelCount;
+    }
+    else if (mDds.ItemCount() > 1)
+    {
+        viewDesc.ViewDimension = D3D10_SRV_DIMENSION_TEXTURE2DARRAY;
+        viewDesc.Texture2DArray.MostDetailedMip = 0;
+        viewDesc.Texture2DArray.MipLevels = levelCount;
+        viewDesc.Texture2DArray.FirstArraySlice = 0;
+        viewDesc.Texture2DArray.ArraySize = mDds.ItemCount();
+    }
+    else
+    {
+        viewDesc.ViewDimension = D3D10_SRV_DIMENSION_TEXTURE2D;
+        viewDesc.Texture2D.MostDetailedMip = 0;
+        viewDesc.Texture2D.MipLevels = levelCount;
+    }
+
+    Microsoft::WRL::ComPtr<ID3D10Texture2D> texture;
+    Microsoft::WRL::ComPtr<ID3D10ShaderResourceView> view;
+
+    HRESULT hr = mDevice->CreateTexture2D(&desc, &initialData[0], &texture);
+
+    if (SUCCEEDED(hr))
+    {
+        hr = mDevice->CreateShaderResourceView(texture.Get(), &viewDesc, &view);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        mTexture = texture;
+        mView = view;
+        mFirstMip = firstMip;
+    }
+
+    return hr;
+}
@@ -0,0 +1,126 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "stdafx.h"
+#include "terrain/TerrainBrush.h"
+#include "terrain/HeightField.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    // Fraction of the crater radius taken up by the bowl, the rest is the raised rim.
+    const float CRATER_BOWL_RADIUS = 0.7f;
+
+    // Height of the crater rim as a fraction of its depth.
+    const float CRATER_RIM_HEIGHT = 0.2f;
+
+    const float PI = 3.14159265f;
+
+    // Smooth falloff that is one at the centre of the brush and zero at its edge.
+    float Falloff(float distance)
+    {
+        float t = 1.0f - distance * distance;
+        return t * t;
+    }
+
+    /**
+     * Calls brush(height, distance) for every grid point inside the brush circle and stores the height
+     * it returns. Distance is from the centre of the brush as a fraction of its radius.
+     */
+    template<typename Brush>
+    GridRect ApplyBrush(HeightField * pField, float x, float z, float radius, Brush brush)
+    {
+        VerifyNotNull(pField);
+
+        GridRect rect = TerrainBrush::CircleRect(*pField, x, z, radius);
+        float inverseRadiusSquared = 1.0f / (radius * radius);
+
+        for (unsigned int row = rect.rowBegin; row < rect.rowEnd; ++row)
+        {
+            float dz = pField->OriginZ() + row * pField->StepZ() - z;
+
+            for (unsigned int col = rect.colBegin; col < rect.colEnd; ++col)
+            {
+                float dx = pField->OriginX() + col * pField->StepX() - x;
+                float t = (dx * dx + dz * dz) * inverseRadiusSquared;
+
+                if (t < 1.0f)
+                {
+                    pField->SetHeight(row, col, brush(pField->Height(row, col), std::sqrt(t)));
+                }
+            }
+        }
+
+        return rect;
+    }
+
+    void ToGridRange(float a, float b, unsigned int count, unsigned int * pBeginOut, unsigned int * pEndOut)
+    {
+        float lo = std::max(std::ceil(std::min(a, b)), 0.0f);
+        float hi = std::min(std::floor(std::max(a, b)) + 1.0f, static_cast<float>(count));
+
+        *pBeginOut = static_cast<unsigned int>(lo);
+        *pEndOut = std::max(static_cast<unsigned int>(std::max(hi, 0.0f)), *pBeginOut);
+    }
+}
+
+GridRect TerrainBrush::CircleRect(const HeightField& field, float x, float z, float radius)
+{
+    GridRect rect = { 0, 0, 0, 0 };
+
+    if (radius > 0.0f)
+    {
+        ToGridRange(field.ToGridRow(z - radius), field.ToGridRow(z + radius), field.Rows(), &rect.rowBegin, &rect.rowEnd);
+        ToGridRange(field.ToGridCol(x - radius), field.ToGridCol(x + radius), field.Cols(), &rect.colBegin, &rect.colEnd);
+    }
+
+    return rect;
+}
+
+GridRect TerrainBrush::Raise(HeightField * pField, float x, float z, float radius, float amount)
+{
+    return ApplyBrush(pField, x, z, radius, [amount](float h, float distance)
+    {
+        return h + amount * Falloff(distance);
+    });
+}
+
+GridRect TerrainBrush::Flatten(HeightField * pField, float x, float z, float radius, float height, float strength)
+{
+    float clampedStrength = std::min(std::max(strength, 0.0f), 1.0f);
+
+    return ApplyBrush(pField, x, z, radius, [height, clampedStrength](float h, float distance)
+    {
+        return h + (height - h) * Falloff(distance) * clampedStrength;
+    });
+}
+
+GridRect TerrainBrush::Crater(HeightField * pField, float x, float z, float radius, float depth)
+{
+    return ApplyBrush(pField, x, z, radius, [depth](float h, float distance) -> float
+    {
+        if (distance < CRATER_BOWL_RADIUS)
+        {
+            float t = distance / CRATER_BOWL_RADIUS;
+            return h - depth * (1.0f - t * t);
+        }
+
+        // Rim rises from the lip of the bowl and fades out at the edge of the brush.
+        float t = (distance - CRATER_BOWL_RADIUS) / (1.0f - CRATER_BOWL_RADIUS);
+        return h + depth * CRATER_RIM_HEIGHT * std::sin(PI * t);
+    });
+}
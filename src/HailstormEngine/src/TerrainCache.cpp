@@ -0,0 +1,249 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "stdafx.h"
+#include "terrain/TerrainCache.h"
+
+#include "runtime/Hash.h"
+#include "runtime/logging.h"
+
+#include <fstream>
+#include <vector>
+
+namespace
+{
+    const unsigned int TERRAIN_CACHE_MAGIC = 0x43545348;    // "HSTC"
+
+    // Bump this whenever the file layout or the terrain generation code changes in a way that alters
+    // the baked output.
+    const unsigned int TERRAIN_CACHE_VERSION = 5;
+
+    const unsigned long long STREAM_ALIGNMENT = 16;
+
+    unsigned long long AlignOffset(unsigned long long offset)
+    {
+        return (offset + STREAM_ALIGNMENT - 1) & ~(STREAM_ALIGNMENT - 1);
+    }
+
+    std::string NarrowPath(const std::wstring& path)
+    {
+        return std::string(path.begin(), path.end());
+    }
+}
+
+TerrainCacheKey::TerrainCacheKey()
+    : rows(0),
+      cols(0),
+      spatialStep(0.0f),
+      seed(0),
+      params(),
+      vertexStride(0),
+      patchCells(0),
+      bakeHash(0)
+{
+}
+
+/**
+ * Hashes each field on its own so that structure padding never leaks into the hash.
+ */
+unsigned long long TerrainCacheKey::Hash() const
+{
+    unsigned long long hash = Hash::Fnv1a64Value(TERRAIN_CACHE_VERSION);
+
+    hash = Hash::Fnv1a64Value(rows, hash);
+    hash = Hash::Fnv1a64Value(cols, hash);
+    hash = Hash::Fnv1a64Value(spatialStep, hash);
+    hash = Hash::Fnv1a64Value(seed, hash);
+    hash = Hash::Fnv1a64Value(static_cast<unsigned int>(params.basis), hash);
+    hash = Hash::Fnv1a64Value(static_cast<unsigned int>(params.type), hash);
+    hash = Hash::Fnv1a64Value(params.octaves, hash);
+    hash = Hash::Fnv1a64Value(params.frequency, hash);
+    hash = Hash::Fnv1a64Value(params.lacunarity, hash);
+    hash = Hash::Fnv1a64Value(params.gain, hash);
+    hash = Hash::Fnv1a64Value(params.ridgeOffset, hash);
+    hash = Hash::Fnv1a64Value(params.amplitude, hash);
+    hash = Hash::Fnv1a64Value(params.bias, hash);
+    hash = Hash::Fnv1a64Value(vertexStride, hash);
+    hash = Hash::Fnv1a64Value(patchCells, hash);
+    hash = Hash::Fnv1a64Value(bakeHash, hash);
+
+    return hash;
+}
+
+TerrainCache::TerrainCache()
+    : mFile(),
+      mpHeader(nullptr)
+{
+}
+
+TerrainCache::~TerrainCache()
+{
+}
+
+bool TerrainCache::Open(const std::wstring& path, const TerrainCacheKey& key)
+{
+    Close();
+
+    if (!mFile.Open(path))
+    {
+        LOG_INFO("TerrainCache") << "No terrain cache at " << NarrowPath(path);
+        return false;
+    }
+
+    const TerrainCacheHeader * pHeader = reinterpret_cast<const TerrainCacheHeader *>(mFile.Data());
+    const char * pReason = nullptr;
+
+    if (mFile.Size() < sizeof(TerrainCacheHeader) || pHeader->magic != TERRAIN_CACHE_MAGIC)
+    {
+        pReason = "not a terrain cache";
+    }
+    else if (pHeader->version != TERRAIN_CACHE_VERSION || pHeader->headerSize != sizeof(TerrainCacheHeader))
+    {
+        pReason = "unsupported version";
+    }
+    else if (pHeader->keyHash != key.Hash())
+    {
+        pReason = "generator parameters changed";
+    }
+    else if (pHeader->fileSize != mFile.Size() ||
+             pHeader->rows != key.rows ||
+             pHeader->cols != key.cols ||
+             pHeader->vertexStride != key.vertexStride ||
+             pHeader->heightsOffset + static_cast<unsigned long long>(pHeader->rows) * pHeader->cols * sizeof(float) > mFile.Size() ||
+             pHeader->verticesOffset + static_cast<unsigned long long>(pHeader->vertexCount) * pHeader->vertexStride > mFile.Size() ||
+             pHeader->indicesOffset + static_cast<unsigned long long>(pHeader->indexCount) * sizeof(unsigned int) > mFile.Size())
+    {
+        pReason = "file is truncated or corrupt";
+    }
+
+    if (pReason != nullptr)
+    {
+        LOG_INFO("TerrainCache") << "Ignoring terrain cache " << NarrowPath(path) << ": " << pReason;
+        mFile.Close();
+        return false;
+    }
+
+    mpHeader = pHeader;
+    return true;
+}
+
+void TerrainCache::Close()
+{
+    mpHeader = nullptr;
+    mFile.Close();
+}
+
+const float * TerrainCache::Heights() const
+{
+    VerifyNotNull(mpHeader);
+    return reinterpret_cast<const float *>(mFile.Data() + mpHeader->heightsOffset);
+}
+
+const void * TerrainCache::Vertices() const
+{
+    VerifyNotNull(mpHeader);
+    return mFile.Data() + mpHeader->verticesOffset;
+}
+
+const unsigned int * TerrainCache::Indices() const
+{
+    VerifyNotNull(mpHeader);
+    return reinterpret_cast<const unsigned int *>(mFile.Data() + mpHeader->indicesOffset);
+}
+
+bool TerrainCache::Write(
+    const std::wstring& path,
+    const TerrainCacheKey& key,
+    const float * pHeights,
+    const void * pVertices,
+    unsigned int vertexCount,
+    const unsigned int * pIndices,
+    unsigned int indexCount)
+{
+    VerifyNotNull(pHeights);
+    VerifyNotNull(pVertices);
+    VerifyNotNull(pIndices);
+
+    TerrainCacheHeader header = { 0 };
+
+    header.magic = TERRAIN_CACHE_MAGIC;
+    header.version = TERRAIN_CACHE_VERSION;
+    header.headerSize = sizeof(TerrainCacheHeader);
+    header.rows = key.rows;
+    header.cols = key.cols;
+    header.spatialStep = key.spatialStep;
+    header.seed = key.seed;
+    header.basis = static_cast<unsigned int>(key.params.basis);
+    header.fractalType = static_cast<unsigned int>(key.params.type);
+    header.octaves = key.params.octaves;
+    header.frequency = key.params.frequency;
+    header.lacunarity = key.params.lacunarity;
+    header.gain = key.params.gain;
+    header.ridgeOffset = key.params.ridgeOffset;
+    header.amplitude = key.params.amplitude;
+    header.bias = key.params.bias;
+    header.vertexStride = key.vertexStride;
+    header.vertexCount = vertexCount;
+    header.indexCount = indexCount;
+    header.patchCells = key.patchCells;
+    header.keyHash = key.Hash();
+
+    unsigned long long heightsSize = static_cast<unsigned long long>(key.rows) * key.cols * sizeof(float);
+    unsigned long long verticesSize = static_cast<unsigned long long>(vertexCount) * key.vertexStride;
+    unsigned long long indicesSize = static_cast<unsigned long long>(indexCount) * sizeof(unsigned int);
+
+    header.heightsOffset = AlignOffset(sizeof(TerrainCacheHeader));
+    header.verticesOffset = AlignOffset(header.heightsOffset + heightsSize);
+    header.indicesOffset = AlignOffset(header.verticesOffset + verticesSize);
+    header.fileSize = header.indicesOffset + indicesSize;
+
+#if defined(_WIN32)
+    std::ofstream file(path.c_str(), std::ios::binary | std::ios::trunc);
+#else
+    std::ofstream file(NarrowPath(path).c_str(), std::ios::binary | std::ios::trunc);
+#endif
+
+    if (!file)
+    {
+        LOG_WARN("TerrainCache") << "Could not create terrain cache " << NarrowPath(path);
+        return false;
+    }
+
+    // Write a blank header first and fill it in once the streams are safely on disk.
+    const char padding[STREAM_ALIGNMENT] = { 0 };
+    TerrainCacheHeader blankHeader = { 0 };
+
+    file.write(reinterpret_cast<const char *>(&blankHeader), sizeof(blankHeader));
+    file.write(padding, static_cast<std::streamsize>(header.heightsOffset - sizeof(TerrainCacheHeader)));
+    file.write(reinterpret_cast<const char *>(pHeights), static_cast<std::streamsize>(heightsSize));
+    file.write(padding, static_cast<std::streamsize>(header.verticesOffset - header.heightsOffset - heightsSize));
+    file.write(reinterpret_cast<const char *>(pVertices), static_cast<std::streamsize>(verticesSize));
+    file.write(padding, static_cast<std::streamsize>(header.indicesOffset - header.verticesOffset - verticesSize));
+    file.write(reinterpret_cast<const char *>(pIndices), static_cast<std::streamsize>(indicesSize));
+    file.flush();
+
+    file.seekp(0);
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.close();
+
+    if (!file)
+    {
+        LOG_WARN("TerrainCache") << "Failed while writing terrain cache " << NarrowPath(path);
+        return false;
+    }
+
+    LOG_INFO("TerrainCache") << "Wrote " << header.fileSize << " byte terrain cache to " << NarrowPath(path);
+    return true;
+}
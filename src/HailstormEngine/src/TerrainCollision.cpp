@@ -0,0 +1,966 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "stdafx.h"
+#include "terrain/TerrainCollision.h"
+#include "terrain/HeightField.h"
+
+#include "runtime/Parallel.h"
+
+#include <d3dx10.h>
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    // Shapes are sorted by which block of BLOCK_CELLS x BLOCK_CELLS grid cells they start in.
+    const unsigned int BLOCK_SHIFT = 3;
+
+    // Swept spheres advance by at most this many radii per step when nothing is nearby.
+    const float MAX_SWEEP_STEP_RADII = 4.0f;
+    const unsigned int MAX_SWEEP_ITERATIONS = 64;
+
+    // Contacts closer than this count as touching when sweeping.
+    const float SWEEP_TOLERANCE = 1e-3f;
+
+    const float EPSILON = 1e-6f;
+
+    float Clamp01(float v)
+    {
+        return std::min(std::max(v, 0.0f), 1.0f);
+    }
+
+    /**
+     * Closest point on triangle abc to p, from Real-Time Collision Detection (Ericson), 5.1.5.
+     */
+    D3DXVECTOR3 ClosestPointOnTriangle(const D3DXVECTOR3& p, const D3DXVECTOR3& a, const D3DXVECTOR3& b, const D3DXVECTOR3& c)
+    {
+        D3DXVECTOR3 ab = b - a, ac = c - a, ap = p - a;
+        float d1 = D3DXVec3Dot(&ab, &ap), d2 = D3DXVec3Dot(&ac, &ap);
+
+        if (d1 <= 0.0f && d2 <= 0.0f)
+        {
+            return a;
+        }
+
+        D3DXVECTOR3 bp = p - b;
+        float d3 = D3DXVec3Dot(&ab, &bp), d4 = D3DXVec3Dot(&ac, &bp);
+
+        if (d3 >= 0.0f && d4 <= d3)
+        {
+            return b;
+        }
+
+        float vc = d1 * d4 - d3 * d2;
+
+        if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+        {
+            return a + ab * (d1 / (d1 - d3));
+        }
+
+        D3DXVECTOR3 cp = p - c;
+        float d5 = D3DXVec3Dot(&ab, &cp), d6 = D3DXVec3Dot(&ac, &cp);
+
+        if (d6 >= 0.0f && d5 <= d6)
+        {
+            return c;
+        }
+
+        float vb = d5 * d2 - d1 * d6;
+
+        if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+        {
+            return a + ac * (d2 / (d2 - d6));
+        }
+
+        float va = d3 * d6 - d5 * d4;
+
+        if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f)
+        {
+            return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+        }
+
+        float denominator = 1.0f / (va + vb + vc);
+        return a + ab * (vb * denominator) + ac * (vc * denominator);
+    }
+
+    /**
+     * Closest points between segments p1q1 and p2q2, from Real-Time Collision Detection, 5.1.9.
+     */
+    void ClosestPointsOnSegments(
+        const D3DXVECTOR3& p1, const D3DXVECTOR3& q1,
+        const D3DXVECTOR3& p2, const D3DXVECTOR3& q2,
+        D3DXVECTOR3 * pOnFirst, D3DXVECTOR3 * pOnSecond)
+    {
+        D3DXVECTOR3 d1 = q1 - p1, d2 = q2 - p2, r = p1 - p2;
+        float a = D3DXVec3Dot(&d1, &d1), e = D3DXVec3Dot(&d2, &d2), f = D3DXVec3Dot(&d2, &r);
+        float s = 0.0f, t = 0.0f;
+
+        if (a <= EPSILON && e <= EPSILON)
+        {
+            s = t = 0.0f;
+        }
+        else if (a <= EPSILON)
+        {
+            t = Clamp01(f / e);
+        }
+        else
+        {
+            float c = D3DXVec3Dot(&d1, &r);
+
+            if (e <= EPSILON)
+            {
+                s = Clamp01(-c / a);
+            }
+            else
+            {
+                float b = D3DXVec3Dot(&d1, &d2);
+                float denominator = a * e - b * b;
+
+                s = denominator != 0.0f ? Clamp01((b * f - c * e) / denominator) : 0.0f;
+                t = (b * s + f) / e;
+
+                if (t < 0.0f)
+                {
+                    t = 0.0f;
+                    s = Clamp01(-c / a);
+                }
+                else if (t > 1.0f)
+                {
+                    t = 1.0f;
+                    s = Clamp01((b - c) / a);
+                }
+            }
+        }
+
+        *pOnFirst = p1 + d1 * s;
+        *pOnSecond = p2 + d2 * t;
+    }
+
+    /**
+     * Smallest root of a*t^2 + b*t + c = 0 in [0, maxTime], if there is one.
+     */
+    bool SmallestRoot(float a, float b, float c, float maxTime, float * pTimeOut)
+    {
+        if (std::abs(a) <= EPSILON)
+        {
+            return false;
+        }
+
+        float discriminant = b * b - 4.0f * a * c;
+
+        if (discriminant < 0.0f)
+        {
+            return false;
+        }
+
+        float root = std::sqrt(discriminant);
+        float t1 = (-b - root) / (2.0f * a);
+        float t2 = (-b + root) / (2.0f * a);
+
+        if (t1 > t2)
+        {
+            std::swap(t1, t2);
+        }
+
+        if (t1 >= 0.0f && t1 <= maxTime)
+        {
+            *pTimeOut = t1;
+            return true;
+        }
+
+        if (t2 >= 0.0f && t2 <= maxTime)
+        {
+            *pTimeOut = t2;
+            return true;
+        }
+
+        return false;
+    }
+
+    /**
+     * First time in [0, maxTime] at which a sphere moving from start by motion touches triangle abc,
+     * from Fauerby's "Improving the Collision Detection and Response" paper: the sphere either meets
+     * the inside of the face, or one of the edges, or one of the corners. The sphere must start clear
+     * of the triangle.
+     */
+    bool SweepSphereTriangle(
+        const D3DXVECTOR3& start,
+        const D3DXVECTOR3& motion,
+        float radius,
+        const D3DXVECTOR3& a, const D3DXVECTOR3& b, const D3DXVECTOR3& c,
+        const D3DXVECTOR3& normal,
+        float maxTime,
+        float * pTimeOut,
+        D3DXVECTOR3 * pPointOut)
+    {
+        bool found = false;
+
+        // Inside of the face, reached from whichever side the sphere starts on.
+        D3DXVECTOR3 toStart = start - a;
+        float startDistance = D3DXVec3Dot(&toStart, &normal);
+        float side = startDistance >= 0.0f ? 1.0f : -1.0f;
+        float approach = -side * D3DXVec3Dot(&motion, &normal);
+
+        if (side * startDistance >= radius && approach > EPSILON)
+        {
+            float t = (side * startDistance - radius) / approach;
+
+            if (t <= maxTime)
+            {
+                D3DXVECTOR3 point = start + motion * t - normal * (side * radius);
+                D3DXVECTOR3 closest = ClosestPointOnTriangle(point, a, b, c);
+                D3DXVECTOR3 offset = point - closest;
+
+                if (D3DXVec3Dot(&offset, &offset) <= EPSILON)
+                {
+                    maxTime = t;
+                    *pPointOut = point;
+                    found = true;
+                }
+            }
+        }
+
+        // Corners.
+        float motionSquared = D3DXVec3Dot(&motion, &motion);
+        const D3DXVECTOR3 * corners[3] = { &a, &b, &c };
+
+        for (unsigned int i = 0; i < 3; ++i)
+        {
+            D3DXVECTOR3 fromCorner = start - *corners[i];
+            float t = 0.0f;
+
+            if (SmallestRoot(
+                    motionSquared,
+                    2.0f * D3DXVec3Dot(&motion, &fromCorner),
+                    D3DXVec3Dot(&fromCorner, &fromCorner) - radius * radius,
+                    maxTime,
+                    &t))
+            {
+                maxTime = t;
+                *pPointOut = *corners[i];
+                found = true;
+            }
+        }
+
+        // Edges, treated as infinite cylinders whose hits are kept if they land between the corners.
+        for (unsigned int i = 0; i < 3; ++i)
+        {
+            const D3DXVECTOR3& p = *corners[i];
+            D3DXVECTOR3 edge = *corners[(i + 1) % 3] - p;
+            D3DXVECTOR3 toEdge = p - start;
+
+            float edgeSquared = D3DXVec3Dot(&edge, &edge);
+            float edgeDotMotion = D3DXVec3Dot(&edge, &motion);
+            float edgeDotToEdge = D3DXVec3Dot(&edge, &toEdge);
+            float t = 0.0f;
+
+            if (SmallestRoot(
+                    edgeDotMotion * edgeDotMotion - edgeSquared * motionSquared,
+                    2.0f * (edgeSquared * D3DXVec3Dot(&motion, &toEdge) - edgeDotMotion * edgeDotToEdge),
+                    edgeSquared * (radius * radius - D3DXVec3Dot(&toEdge, &toEdge)) + edgeDotToEdge * edgeDotToEdge,
+                    maxTime,
+                    &t))
+            {
+                float along = (edgeDotMotion * t - edgeDotToEdge) / edgeSquared;
+
+                if (along >= 0.0f && along <= 1.0f)
+                {
+                    maxTime = t;
+                    *pPointOut = p + edge * along;
+                    found = true;
+                }
+            }
+        }
+
+        if (found)
+        {
+            *pTimeOut = maxTime;
+        }
+
+        return found;
+    }
+
+    /**
+     * Checks if a point moving from start by motion is inside a box at any time in [0, maxTime].
+     */
+    bool SegmentHitsBox(
+        const D3DXVECTOR3& start,
+        const D3DXVECTOR3& motion,
+        const D3DXVECTOR3& boxMin,
+        const D3DXVECTOR3& boxMax,
+        float maxTime)
+    {
+        const float * pStart = &start.x;
+        const float * pMotion = &motion.x;
+        const float * pMin = &boxMin.x;
+        const float * pMax = &boxMax.x;
+        float enter = 0.0f, leave = maxTime;
+
+        for (unsigned int axis = 0; axis < 3; ++axis)
+        {
+            if (std::abs(pMotion[axis]) <= EPSILON)
+            {
+                if (pStart[axis] < pMin[axis] || pStart[axis] > pMax[axis])
+                {
+                    return false;
+                }
+
+                continue;
+            }
+
+            float t1 = (pMin[axis] - pStart[axis]) / pMotion[axis];
+            float t2 = (pMax[axis] - pStart[axis]) / pMotion[axis];
+
+            enter = std::max(enter, std::min(t1, t2));
+            leave = std::min(leave, std::max(t1, t2));
+
+            if (enter > leave)
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+}
+
+/**
+ * One of the two triangles in a grid cell, with its normal pointing up.
+ */
+struct TerrainCollider::Triangle
+{
+    D3DXVECTOR3 a, b, c;
+    D3DXVECTOR3 normal;
+};
+
+/**
+ * A point on the terrain surface and how far a query point is from it. The distance is negative when
+ * the query point is under the terrain.
+ */
+struct TerrainCollider::SurfacePoint
+{
+    D3DXVECTOR3 position;
+    D3DXVECTOR3 normal;
+    float distance;
+};
+
+TerrainCollisionParams::TerrainCollisionParams()
+    : threadCount(0),
+      shapesPerTask(256),
+      minParallelShapes(1024),
+      sortByCell(true)
+{
+}
+
+TerrainCollider::TerrainCollider(const HeightField& field)
+    : mpField(&field),
+      mOrder()
+{
+}
+
+void TerrainCollider::CollideSpheres(
+    const CollisionSphere * pSpheres,
+    unsigned int count,
+    TerrainContact * pContactsOut,
+    const TerrainCollisionParams& params) const
+{
+    RunBatch(pSpheres, count, pContactsOut, params, [this](const CollisionSphere& sphere)
+    {
+        return CollideSphere(sphere);
+    });
+}
+
+void TerrainCollider::CollideCapsules(
+    const CollisionCapsule * pCapsules,
+    unsigned int count,
+    TerrainContact * pContactsOut,
+    const TerrainCollisionParams& params) const
+{
+    RunBatch(pCapsules, count, pContactsOut, params, [this](const CollisionCapsule& capsule)
+    {
+        return CollideCapsule(capsule);
+    });
+}
+
+void TerrainCollider::SweepSpheres(
+    const CollisionSweptSphere * pSweeps,
+    unsigned int count,
+    TerrainContact * pContactsOut,
+    const TerrainCollisionParams& params) const
+{
+    RunBatch(pSweeps, count, pContactsOut, params, [this](const CollisionSweptSphere& sweep)
+    {
+        return SweepSphere(sweep);
+    });
+}
+
+/**
+ * Finds the closest point on the terrain to the sphere's center. The sphere touches the terrain if
+ * that point is within its radius, or if the center is under the terrain.
+ */
+TerrainContact TerrainCollider::CollideSphere(const CollisionSphere& sphere) const
+{
+    TerrainContact contact = { false };
+    SurfacePoint closest;
+
+    if (FindClosestPoint(sphere.center, sphere.radius, &closest) && closest.distance < sphere.radius)
+    {
+        contact.touching = true;
+        contact.position = closest.position;
+        contact.normal = closest.normal;
+        contact.depth = sphere.radius - closest.distance;
+        contact.time = 0.0f;
+    }
+
+    return contact;
+}
+
+/**
+ * Finds the closest points between the capsule's segment and the terrain triangles. If either end of
+ * the segment is under the terrain, the deeper end decides the contact instead. Otherwise the deepest
+ * contact wins, which is one where the segment passes through a triangle if there is one.
+ */
+TerrainContact TerrainCollider::CollideCapsule(const CollisionCapsule& capsule) const
+{
+    TerrainContact contact = { false };
+
+    // Ends under the terrain.
+    SurfacePoint below;
+    float deepest = 0.0f;
+    const D3DXVECTOR3 * ends[2] = { &capsule.a, &capsule.b };
+
+    for (unsigned int i = 0; i < 2; ++i)
+    {
+        if (FindPointBelow(*ends[i], &below) && below.distance < deepest)
+        {
+            deepest = below.distance;
+            contact.touching = true;
+            contact.position = below.position;
+            contact.normal = below.normal;
+            contact.depth = capsule.radius - below.distance;
+            contact.time = 0.0f;
+        }
+    }
+
+    if (contact.touching)
+    {
+        return contact;
+    }
+
+    unsigned int range[4];
+    float r = capsule.radius;
+
+    if (!CellRange(
+            std::min(capsule.a.x, capsule.b.x) - r, std::max(capsule.a.x, capsule.b.x) + r,
+            std::min(capsule.a.z, capsule.b.z) - r, std::max(capsule.a.z, capsule.b.z) + r,
+            range))
+    {
+        return contact;
+    }
+
+    D3DXVECTOR3 axis = capsule.b - capsule.a;
+
+    for (unsigned int row = range[0]; row <= range[1]; ++row)
+    {
+        for (unsigned int col = range[2]; col <= range[3]; ++col)
+        {
+            for (unsigned int half = 0; half < 2; ++half)
+            {
+                Triangle triangle;
+                GetTriangle(row, col, half, &triangle);
+
+                // Segment passing through the triangle, eg a capsule lying across a ridge.
+                D3DXVECTOR3 toStart = capsule.a - triangle.a, toEnd = capsule.b - triangle.a;
+                float startDistance = D3DXVec3Dot(&toStart, &triangle.normal);
+                float endDistance = D3DXVec3Dot(&toEnd, &triangle.normal);
+
+                if ((startDistance > 0.0f) != (endDistance > 0.0f))
+                {
+                    D3DXVECTOR3 crossing = capsule.a + axis * (startDistance / (startDistance - endDistance));
+                    D3DXVECTOR3 onTriangle = ClosestPointOnTriangle(crossing, triangle.a, triangle.b, triangle.c);
+                    D3DXVECTOR3 offset = crossing - onTriangle;
+
+                    // The capsule has to rise until its lower end is a radius above the triangle.
+                    float depth = r - std::min(startDistance, endDistance);
+
+                    if (D3DXVec3Dot(&offset, &offset) <= EPSILON && (!contact.touching || depth > contact.depth))
+                    {
+                        contact.touching = true;
+                        contact.position = crossing;
+                        contact.normal = triangle.normal;
+                        contact.depth = depth;
+                        contact.time = 0.0f;
+                    }
+                }
+
+                // Otherwise the closest points are at an end of the segment or on an edge.
+                D3DXVECTOR3 candidates[10];
+                candidates[0] = capsule.a;
+                candidates[1] = ClosestPointOnTriangle(capsule.a, triangle.a, triangle.b, triangle.c);
+                candidates[2] = capsule.b;
+                candidates[3] = ClosestPointOnTriangle(capsule.b, triangle.a, triangle.b, triangle.c);
+                ClosestPointsOnSegments(capsule.a, capsule.b, triangle.a, triangle.b, &candidates[4], &candidates[5]);
+                ClosestPointsOnSegments(capsule.a, capsule.b, triangle.b, triangle.c, &candidates[6], &candidates[7]);
+                ClosestPointsOnSegments(capsule.a, capsule.b, triangle.c, triangle.a, &candidates[8], &candidates[9]);
+
+                for (unsigned int i = 0; i < 10; i += 2)
+                {
+                    D3DXVECTOR3 offset = candidates[i] - candidates[i + 1];
+                    float distanceSquared = D3DXVec3Dot(&offset, &offset);
+
+                    if (distanceSquared < r * r && (!contact.touching || r - std::sqrt(distanceSquared) > contact.depth))
+                    {
+                        float distance = std::sqrt(distanceSquared);
+
+                        contact.touching = true;
+                        contact.position = candidates[i + 1];
+                        contact.normal = distance > EPSILON ? offset / distance : triangle.normal;
+                        contact.depth = r - distance;
+                        contact.time = 0.0f;
+                    }
+                }
+            }
+        }
+    }
+
+    return contact;
+}
+
+/**
+ * Conservative advancement. The sphere can safely move as far as the distance from its center to the
+ * terrain, less its radius, without touching anything, so it is stepped forward by that much until
+ * it either touches the terrain or reaches the end of the sweep. Long sweeps by small spheres, and
+ * sweeps that skim the surface, can take many steps, so after MAX_SWEEP_ITERATIONS the rest of the
+ * sweep is tested exactly against every triangle it passes over instead.
+ */
+TerrainContact TerrainCollider::SweepSphere(const CollisionSweptSphere& sweep) const
+{
+    TerrainContact contact = { false };
+
+    D3DXVECTOR3 motion = sweep.end - sweep.start;
+    float length = D3DXVec3Length(&motion);
+    float travelled = 0.0f;
+    float maxStep = std::max(sweep.radius * MAX_SWEEP_STEP_RADII, SWEEP_TOLERANCE);
+
+    for (unsigned int i = 0; i < MAX_SWEEP_ITERATIONS; ++i)
+    {
+        float time = length > 0.0f ? travelled / length : 0.0f;
+        D3DXVECTOR3 center = sweep.start + motion * time;
+
+        // Only look as far as the sphere could move this step.
+        float step = std::min(length - travelled, maxStep);
+        SurfacePoint closest;
+
+        if (FindClosestPoint(center, sweep.radius + step, &closest))
+        {
+            float gap = closest.distance - sweep.radius;
+
+            if (gap <= SWEEP_TOLERANCE)
+            {
+                contact.touching = true;
+                contact.position = closest.position;
+                contact.normal = closest.normal;
+                contact.depth = std::max(-gap, 0.0f);
+                contact.time = time;
+                return contact;
+            }
+
+            step = std::min(step, gap);
+        }
+
+        if (travelled >= length)
+        {
+            return contact;
+        }
+
+        travelled = std::min(travelled + step, length);
+    }
+
+    float time = travelled / length;
+    D3DXVECTOR3 center = sweep.start + motion * time;
+    float remainingTime = 0.0f;
+    SurfacePoint hit;
+
+    if (SweepTriangles(center, motion * (1.0f - time), sweep.radius, &remainingTime, &hit))
+    {
+        contact.touching = true;
+        contact.position = hit.position;
+        contact.normal = hit.normal;
+        contact.depth = 0.0f;
+        contact.time = time + remainingTime * (1.0f - time);
+    }
+
+    return contact;
+}
+
+/**
+ * Finds the first time a sphere moving from start by motion touches any terrain triangle, by walking
+ * the rows of cells the sweep passes over and testing the triangles of every cell whose bounding box
+ * it enters. The sphere must start clear of the terrain.
+ */
+bool TerrainCollider::SweepTriangles(
+    const D3DXVECTOR3& start,
+    const D3DXVECTOR3& motion,
+    float radius,
+    float * pTimeOut,
+    SurfacePoint * pHitOut) const
+{
+    D3DXVECTOR3 end = start + motion;
+    unsigned int rows[4];
+
+    if (!CellRange(
+            std::min(start.x, end.x) - radius, std::max(start.x, end.x) + radius,
+            std::min(start.z, end.z) - radius, std::max(start.z, end.z) + radius,
+            rows))
+    {
+        return false;
+    }
+
+    D3DXVECTOR3 grow(radius, radius, radius);
+    float bestTime = 1.0f;
+    bool found = false;
+
+    for (unsigned int row = rows[0]; row <= rows[1]; ++row)
+    {
+        // Part of the sweep within a radius of this row of cells, and the columns it covers.
+        float rowZ = mpField->Position(row, 0).z, nextRowZ = mpField->Position(row + 1, 0).z;
+        float minZ = std::min(rowZ, nextRowZ) - radius, maxZ = std::max(rowZ, nextRowZ) + radius;
+        float enter = 0.0f, leave = 1.0f;
+
+        if (std::abs(motion.z) > EPSILON)
+        {
+            float t1 = (minZ - start.z) / motion.z, t2 = (maxZ - start.z) / motion.z;
+            enter = std::max(std::min(t1, t2), 0.0f);
+            leave = std::min(std::max(t1, t2), 1.0f);
+        }
+        else if (start.z < minZ || start.z > maxZ)
+        {
+            continue;
+        }
+
+        if (enter > leave)
+        {
+            continue;
+        }
+
+        float enterX = start.x + motion.x * enter, leaveX = start.x + motion.x * leave;
+        float rowMiddle = 0.5f * (rowZ + nextRowZ);
+        unsigned int cols[4];
+
+        if (!CellRange(std::min(enterX, leaveX) - radius, std::max(enterX, leaveX) + radius, rowMiddle, rowMiddle, cols))
+        {
+            continue;
+        }
+
+        for (unsigned int col = cols[2]; col <= cols[3]; ++col)
+        {
+            D3DXVECTOR3 boxMin, boxMax;
+            CellBounds(row, col, &boxMin, &boxMax);
+
+            if (!SegmentHitsBox(start, motion, boxMin - grow, boxMax + grow, bestTime))
+            {
+                continue;
+            }
+
+            for (unsigned int half = 0; half < 2; ++half)
+            {
+                Triangle triangle;
+                GetTriangle(row, col, half, &triangle);
+
+                float time = 0.0f;
+                D3DXVECTOR3 point;
+
+                if (SweepSphereTriangle(
+                        start, motion, radius,
+                        triangle.a, triangle.b, triangle.c, triangle.normal,
+                        bestTime, &time, &point))
+                {
+                    D3DXVECTOR3 offset = start + motion * time - point;
+                    float distance = D3DXVec3Length(&offset);
+
+                    bestTime = time;
+                    pHitOut->position = point;
+                    pHitOut->normal = distance > EPSILON ? offset / distance : triangle.normal;
+                    pHitOut->distance = distance;
+                    found = true;
+                }
+            }
+        }
+    }
+
+    if (found)
+    {
+        *pTimeOut = bestTime;
+    }
+
+    return found;
+}
+
+/**
+ * Finds the closest point on the terrain surface within searchRadius of a point. Points under the
+ * terrain are pushed straight out through the triangle above them.
+ */
+bool TerrainCollider::FindClosestPoint(const D3DXVECTOR3& point, float searchRadius, SurfacePoint * pClosestOut) const
+{
+    if (FindPointBelow(point, pClosestOut))
+    {
+        return true;
+    }
+
+    unsigned int range[4];
+
+    if (!CellRange(point.x - searchRadius, point.x + searchRadius, point.z - searchRadius, point.z + searchRadius, range))
+    {
+        return false;
+    }
+
+    float bestDistanceSquared = searchRadius * searchRadius;
+    bool found = false;
+
+    for (unsigned int row = range[0]; row <= range[1]; ++row)
+    {
+        for (unsigned int col = range[2]; col <= range[3]; ++col)
+        {
+            // Skip cells whose bounding box is further away than the closest point found so far.
+            if (CellDistanceSquared(row, col, point) >= bestDistanceSquared)
+            {
+                continue;
+            }
+
+            for (unsigned int half = 0; half < 2; ++half)
+            {
+                Triangle triangle;
+                GetTriangle(row, col, half, &triangle);
+
+                D3DXVECTOR3 closest = ClosestPointOnTriangle(point, triangle.a, triangle.b, triangle.c);
+                D3DXVECTOR3 offset = point - closest;
+                float distanceSquared = D3DXVec3Dot(&offset, &offset);
+
+                if (distanceSquared < bestDistanceSquared)
+                {
+                    float distance = std::sqrt(distanceSquared);
+
+                    bestDistanceSquared = distanceSquared;
+                    pClosestOut->position = closest;
+                    pClosestOut->normal = distance > EPSILON ? offset / distance : triangle.normal;
+                    pClosestOut->distance = distance;
+                    found = true;
+                }
+            }
+        }
+    }
+
+    return found;
+}
+
+/**
+ * Checks if a point is under the terrain surface, and if so finds the point on the triangle above it
+ * that it is closest to.
+ */
+bool TerrainCollider::FindPointBelow(const D3DXVECTOR3& point, SurfacePoint * pSurfaceOut) const
+{
+    float col = mpField->ToGridCol(point.x);
+    float row = mpField->ToGridRow(point.z);
+
+    if (col < 0.0f || row < 0.0f || col > static_cast<float>(mpField->CellCols()) || row > static_cast<float>(mpField->CellRows()))
+    {
+        return false;
+    }
+
+    unsigned int cellCol = std::min(static_cast<unsigned int>(col), mpField->CellCols() - 1);
+    unsigned int cellRow = std::min(static_cast<unsigned int>(row), mpField->CellRows() - 1);
+    unsigned int half = (col - cellCol) + (row - cellRow) <= 1.0f ? 0 : 1;
+
+    Triangle triangle;
+    GetTriangle(cellRow, cellCol, half, &triangle);
+
+    D3DXVECTOR3 toPoint = point - triangle.a;
+    float distance = D3DXVec3Dot(&toPoint, &triangle.normal);
+
+    if (distance >= 0.0f)
+    {
+        return false;
+    }
+
+    pSurfaceOut->position = point - triangle.normal * distance;
+    pSurfaceOut->normal = triangle.normal;
+    pSurfaceOut->distance = distance;
+
+    return true;
+}
+
+/**
+ * Finds the grid cells overlapping a box in the xz plane. pRange is filled with the first and last
+ * row followed by the first and last column. Returns false if no cells overlap.
+ */
+bool TerrainCollider::CellRange(float minX, float maxX, float minZ, float maxZ, unsigned int * pRange) const
+{
+    // Steps can be negative, so the grid coordinates of the box corners need sorting.
+    float colA = mpField->ToGridCol(minX), colB = mpField->ToGridCol(maxX);
+    float rowA = mpField->ToGridRow(minZ), rowB = mpField->ToGridRow(maxZ);
+
+    float firstCol = std::floor(std::min(colA, colB)), lastCol = std::floor(std::max(colA, colB));
+    float firstRow = std::floor(std::min(rowA, rowB)), lastRow = std::floor(std::max(rowA, rowB));
+    float cellCols = static_cast<float>(mpField->CellCols()), cellRows = static_cast<float>(mpField->CellRows());
+
+    if (lastCol < 0.0f || lastRow < 0.0f || firstCol >= cellCols || firstRow >= cellRows)
+    {
+        return false;
+    }
+
+    pRange[0] = static_cast<unsigned int>(std::max(firstRow, 0.0f));
+    pRange[1] = static_cast<unsigned int>(std::min(lastRow, cellRows - 1.0f));
+    pRange[2] = static_cast<unsigned int>(std::max(firstCol, 0.0f));
+    pRange[3] = static_cast<unsigned int>(std::min(lastCol, cellCols - 1.0f));
+
+    return true;
+}
+
+/**
+ * Squared distance from a point to the bounding box of a cell, which no point in the cell can be any
+ * closer than.
+ */
+float TerrainCollider::CellDistanceSquared(unsigned int row, unsigned int col, const D3DXVECTOR3& point) const
+{
+    D3DXVECTOR3 boxMin, boxMax;
+    CellBounds(row, col, &boxMin, &boxMax);
+
+    float dx = std::max(std::max(boxMin.x - point.x, point.x - boxMax.x), 0.0f);
+    float dy = std::max(std::max(boxMin.y - point.y, point.y - boxMax.y), 0.0f);
+    float dz = std::max(std::max(boxMin.z - point.z, point.z - boxMax.z), 0.0f);
+
+    return dx * dx + dy * dy + dz * dz;
+}
+
+/**
+ * Bounding box of the two triangles in a cell.
+ */
+void TerrainCollider::CellBounds(unsigned int row, unsigned int col, D3DXVECTOR3 * pMinOut, D3DXVECTOR3 * pMaxOut) const
+{
+    D3DXVECTOR3 corner = mpField->Position(row, col);
+    D3DXVECTOR3 opposite = mpField->Position(row + 1, col + 1);
+
+    float minHeight = std::min(
+        std::min(corner.y, opposite.y),
+        std::min(mpField->Height(row, col + 1), mpField->Height(row + 1, col)));
+    float maxHeight = std::max(
+        std::max(corner.y, opposite.y),
+        std::max(mpField->Height(row, col + 1), mpField->Height(row + 1, col)));
+
+    *pMinOut = D3DXVECTOR3(std::min(corner.x, opposite.x), minHeight, std::min(corner.z, opposite.z));
+    *pMaxOut = D3DXVECTOR3(std::max(corner.x, opposite.x), maxHeight, std::max(corner.z, opposite.z));
+}
+
+/**
+ * Gets one of the two triangles in a cell, split the same way as the landscape's index buffer.
+ */
+void TerrainCollider::GetTriangle(unsigned int row, unsigned int col, unsigned int half, Triangle * pTriangleOut) const
+{
+    if (half == 0)
+    {
+        pTriangleOut->a = mpField->Position(row, col);
+        pTriangleOut->b = mpField->Position(row, col + 1);
+        pTriangleOut->c = mpField->Position(row + 1, col);
+    }
+    else
+    {
+        pTriangleOut->a = mpField->Position(row + 1, col);
+        pTriangleOut->b = mpField->Position(row, col + 1);
+        pTriangleOut->c = mpField->Position(row + 1, col + 1);
+    }
+
+    D3DXVECTOR3 ab = pTriangleOut->b - pTriangleOut->a, ac = pTriangleOut->c - pTriangleOut->a, normal;
+    D3DXVec3Cross(&normal, &ab, &ac);
+
+    if (normal.y < 0.0f)
+    {
+        normal = -normal;
+    }
+
+    D3DXVec3Normalize(&pTriangleOut->normal, &normal);
+}
+
+/**
+ * Sort key for a point, the block of cells it is in.
+ */
+unsigned int TerrainCollider::CellKey(const D3DXVECTOR3& point) const
+{
+    float col = std::min(std::max(mpField->ToGridCol(point.x), 0.0f), static_cast<float>(mpField->CellCols()));
+    float row = std::min(std::max(mpField->ToGridRow(point.z), 0.0f), static_cast<float>(mpField->CellRows()));
+    unsigned int blocksPerRow = (mpField->Cols() >> BLOCK_SHIFT) + 1;
+
+    return (static_cast<unsigned int>(row) >> BLOCK_SHIFT) * blocksPerRow + (static_cast<unsigned int>(col) >> BLOCK_SHIFT);
+}
+
+namespace
+{
+    // Point used to sort each kind of shape.
+    const D3DXVECTOR3& SortPoint(const CollisionSphere& sphere) { return sphere.center; }
+    const D3DXVECTOR3& SortPoint(const CollisionCapsule& capsule) { return capsule.a; }
+    const D3DXVECTOR3& SortPoint(const CollisionSweptSphere& sweep) { return sweep.start; }
+}
+
+/**
+ * Runs a query on every shape in a batch, in cell order if asked, spread across threads.
+ */
+template<typename Shape, typename Query>
+void TerrainCollider::RunBatch(
+    const Shape * pShapes,
+    unsigned int count,
+    TerrainContact * pContactsOut,
+    const TerrainCollisionParams& params,
+    Query query) const
+{
+    if (count == 0)
+    {
+        return;
+    }
+
+    VerifyNotNull(pShapes);
+    VerifyNotNull(pContactsOut);
+
+    // Pack the cell key above the shape index so a plain integer sort groups shapes by cell and keeps
+    // shapes in the same cell in their original order.
+    mOrder.resize(count);
+
+    for (unsigned int i = 0; i < count; ++i)
+    {
+        unsigned long long key = params.sortByCell ? CellKey(SortPoint(pShapes[i])) : 0;
+        mOrder[i] = (key << 32) | i;
+    }
+
+    if (params.sortByCell)
+    {
+        std::sort(mOrder.begin(), mOrder.end());
+    }
+
+    unsigned int shapesPerTask = std::max(params.shapesPerTask, 1u);
+    unsigned int taskCount = (count + shapesPerTask - 1) / shapesPerTask;
+    unsigned int threadCount = count < params.minParallelShapes ? 1 : params.threadCount;
+    const std::vector<unsigned long long>& order = mOrder;
+
+    Parallel::For(taskCount, threadCount, [&](unsigned int task, unsigned int /*worker*/)
+    {
+        unsigned int first = task * shapesPerTask;
+        unsigned int last = std::min(first + shapesPerTask, count);
+
+        for (unsigned int i = first; i < last; ++i)
+        {
+            unsigned int shape = static_cast<unsigned int>(order[i] & 0xFFFFFFFFu);
+            pContactsOut[shape] = query(pShapes[shape]);
+        }
+    });
+}
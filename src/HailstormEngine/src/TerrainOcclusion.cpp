@@ -0,0 +1,347 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "stdafx.h"
+#include "terrain/TerrainOcclusion.h"
+#include "terrain/HeightField.h"
+
+#include "runtime/Hash.h"
+#include "runtime/Parallel.h"
+#include "runtime/Stopwatch.h"
+
+#include <xmmintrin.h>
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    const float PI = 3.14159265f;
+
+    // Number of grid points swept together.
+    const unsigned int LANES = 4;
+
+    /**
+     * Where one height sample along one direction lands, relative to the point being baked. The
+     * sample is bilinearly interpolated from the four grid points at offset (row, col) and its
+     * neighbors below and to the right.
+     */
+    struct SampleOffset
+    {
+        int offset;             // Offset of the top left grid point in the padded height array.
+        float fracCol;
+        float fracRow;
+        float inverseDistance;
+    };
+
+    /**
+     * A copy of the heights around a rectangle, extended past the edge of the grid by repeating the
+     * border heights. With enough padding every sample along every direction is in bounds, and the
+     * inner loop needs no clamping.
+     */
+    struct PaddedHeights
+    {
+        std::vector<float> heights;
+        unsigned int width;
+        unsigned int border;
+
+        const float * Point(unsigned int rectRow, unsigned int rectCol) const
+        {
+            return &heights[static_cast<size_t>(rectRow + border) * width + rectCol + border];
+        }
+    };
+
+    /**
+     * How much the terrain's slope, measured by world x and z, changes the height per unit of distance
+     * travelled in a direction.
+     */
+    struct SlopeWeights
+    {
+        float x;
+        float z;
+    };
+
+    void BuildSampleOffsets(
+        const HeightField& field,
+        const TerrainOcclusionParams& params,
+        unsigned int border,
+        unsigned int width,
+        std::vector<SampleOffset> * pOffsetsOut,
+        std::vector<SlopeWeights> * pSlopeWeightsOut,
+        unsigned int * pSamplesPerDirectionOut)
+    {
+        std::vector<float> distances;
+
+        for (float distance = params.firstStep; distance <= params.maxDistance; distance *= params.stepGrowth)
+        {
+            distances.push_back(distance);
+        }
+
+        pOffsetsOut->clear();
+        pOffsetsOut->reserve(distances.size() * params.directionCount);
+        pSlopeWeightsOut->clear();
+
+        for (unsigned int d = 0; d < params.directionCount; ++d)
+        {
+            float angle = 2.0f * PI * (d + 0.5f) / params.directionCount;
+
+            // The slope is measured with central differences, in terms of grid heights.
+            SlopeWeights weights = { std::cos(angle) / (2.0f * field.StepX()), std::sin(angle) / (2.0f * field.StepZ()) };
+            pSlopeWeightsOut->push_back(weights);
+
+            for (size_t s = 0; s < distances.size(); ++s)
+            {
+                float col = std::cos(angle) * distances[s] / field.StepX();
+                float row = std::sin(angle) * distances[s] / field.StepZ();
+                int baseCol = static_cast<int>(std::floor(col));
+                int baseRow = static_cast<int>(std::floor(row));
+
+                assert(static_cast<unsigned int>(std::abs(baseCol) + 1) < border);
+                assert(static_cast<unsigned int>(std::abs(baseRow) + 1) < border);
+
+                SampleOffset offset;
+                offset.offset = baseRow * static_cast<int>(width) + baseCol;
+                offset.fracCol = col - baseCol;
+                offset.fracRow = row - baseRow;
+                offset.inverseDistance = 1.0f / distances[s];
+
+                pOffsetsOut->push_back(offset);
+            }
+        }
+
+        *pSamplesPerDirectionOut = static_cast<unsigned int>(distances.size());
+    }
+
+    void BuildPaddedHeights(const HeightField& field, const GridRect& rect, unsigned int border, PaddedHeights * pOut)
+    {
+        // Extra columns on the right so that the last group of lanes in a row can read past the end.
+        pOut->border = border;
+        pOut->width = rect.Cols() + 2 * border + LANES;
+        unsigned int height = rect.Rows() + 2 * border;
+
+        pOut->heights.resize(static_cast<size_t>(pOut->width) * height);
+
+        for (unsigned int y = 0; y < height; ++y)
+        {
+            int row = static_cast<int>(rect.rowBegin + y) - static_cast<int>(border);
+            float * pRow = &pOut->heights[static_cast<size_t>(y) * pOut->width];
+
+            for (unsigned int x = 0; x < pOut->width; ++x)
+            {
+                pRow[x] = field.Height(row, static_cast<int>(rect.colBegin + x) - static_cast<int>(border));
+            }
+        }
+    }
+
+    __m128 SinAtan(__m128 slope)
+    {
+        // sin(atan(slope)) = slope / sqrt(1 + slope^2)
+        return _mm_div_ps(slope, _mm_sqrt_ps(_mm_add_ps(_mm_set1_ps(1.0f), _mm_mul_ps(slope, slope))));
+    }
+
+    /**
+     * Bakes one row of the rectangle, four points at a time.
+     */
+    void BakeRow(
+        const PaddedHeights& padded,
+        const std::vector<SampleOffset>& offsets,
+        const std::vector<SlopeWeights>& slopeWeights,
+        unsigned int directionCount,
+        unsigned int samplesPerDirection,
+        unsigned int rectRow,
+        unsigned int rectCols,
+        unsigned char * pVisibilityOut)
+    {
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 scale = _mm_set1_ps(255.0f / directionCount);
+        const int width = static_cast<int>(padded.width);
+
+        for (unsigned int col = 0; col < rectCols; col += LANES)
+        {
+            const float * pPoint = padded.Point(rectRow, col);
+            __m128 center = _mm_loadu_ps(pPoint);
+            __m128 occlusion = zero;
+            const SampleOffset * pSample = &offsets[0];
+
+            // Height differences across each point, for the slope of the surface itself.
+            __m128 acrossX = _mm_sub_ps(_mm_loadu_ps(pPoint + 1), _mm_loadu_ps(pPoint - 1));
+            __m128 acrossZ = _mm_sub_ps(_mm_loadu_ps(pPoint + width), _mm_loadu_ps(pPoint - width));
+
+            for (unsigned int d = 0; d < directionCount; ++d)
+            {
+                // The surface's own slope is the lowest horizon possible. Terrain that rises above it
+                // blocks part of the sky, while a point on an even slope is not occluded at all.
+                __m128 tangent = _mm_add_ps(
+                    _mm_mul_ps(acrossX, _mm_set1_ps(slopeWeights[d].x)),
+                    _mm_mul_ps(acrossZ, _mm_set1_ps(slopeWeights[d].z)));
+                __m128 horizon = tangent;
+
+                for (unsigned int s = 0; s < samplesPerDirection; ++s, ++pSample)
+                {
+                    const float * p = pPoint + pSample->offset;
+
+                    __m128 h00 = _mm_loadu_ps(p);
+                    __m128 h01 = _mm_loadu_ps(p + 1);
+                    __m128 h10 = _mm_loadu_ps(p + width);
+                    __m128 h11 = _mm_loadu_ps(p + width + 1);
+
+                    __m128 fracCol = _mm_set1_ps(pSample->fracCol);
+                    __m128 top = _mm_add_ps(h00, _mm_mul_ps(fracCol, _mm_sub_ps(h01, h00)));
+                    __m128 bottom = _mm_add_ps(h10, _mm_mul_ps(fracCol, _mm_sub_ps(h11, h10)));
+                    __m128 height = _mm_add_ps(top, _mm_mul_ps(_mm_set1_ps(pSample->fracRow), _mm_sub_ps(bottom, top)));
+
+                    __m128 slope = _mm_mul_ps(_mm_sub_ps(height, center), _mm_set1_ps(pSample->inverseDistance));
+                    horizon = _mm_max_ps(horizon, slope);
+                }
+
+                occlusion = _mm_add_ps(occlusion, _mm_sub_ps(SinAtan(horizon), SinAtan(tangent)));
+            }
+
+            // visibility = 1 - occlusion / directionCount, scaled to a byte.
+            __m128 visibility = _mm_sub_ps(_mm_set1_ps(255.0f), _mm_mul_ps(occlusion, scale));
+            visibility = _mm_min_ps(_mm_max_ps(visibility, zero), _mm_set1_ps(255.0f));
+
+            float values[LANES];
+            _mm_storeu_ps(values, visibility);
+
+            for (unsigned int lane = 0; lane < LANES && col + lane < rectCols; ++lane)
+            {
+                pVisibilityOut[col + lane] = static_cast<unsigned char>(values[lane] + 0.5f);
+            }
+        }
+    }
+
+    unsigned int BorderSize(const HeightField& field, const TerrainOcclusionParams& params)
+    {
+        float smallestStep = std::min(std::fabs(field.StepX()), std::fabs(field.StepZ()));
+        return static_cast<unsigned int>(std::ceil(params.maxDistance / smallestStep)) + 2;
+    }
+}
+
+TerrainOcclusionParams::TerrainOcclusionParams()
+    : directionCount(16),
+      maxDistance(32.0f),
+      firstStep(1.0f),
+      stepGrowth(1.3f),
+      threadCount(0),
+      rowsPerTask(4)
+{
+}
+
+unsigned long long TerrainOcclusionParams::Hash() const
+{
+    unsigned long long hash = Hash::Fnv1a64Value(directionCount);
+
+    hash = Hash::Fnv1a64Value(maxDistance, hash);
+    hash = Hash::Fnv1a64Value(firstStep, hash);
+    hash = Hash::Fnv1a64Value(stepGrowth, hash);
+
+    return hash;
+}
+
+void TerrainOcclusion::Bake(
+    const HeightField& field,
+    const TerrainOcclusionParams& params,
+    std::vector<unsigned char> * pVisibilityOut,
+    TerrainOcclusionStats * pStatsOut)
+{
+    VerifyNotNull(pVisibilityOut);
+
+    GridRect everything = { 0, 0, field.Rows(), field.Cols() };
+    pVisibilityOut->resize(everything.Area());
+
+    Bake(field, params, everything, &(*pVisibilityOut)[0], pStatsOut);
+}
+
+void TerrainOcclusion::Bake(
+    const HeightField& field,
+    const TerrainOcclusionParams& params,
+    const GridRect& rect,
+    unsigned char * pVisibility,
+    TerrainOcclusionStats * pStatsOut)
+{
+    VerifyNotNull(pVisibility);
+    Verify(params.directionCount > 0 && params.firstStep > 0.0f && params.stepGrowth > 1.0f);
+    Verify(rect.rowEnd <= field.Rows() && rect.colEnd <= field.Cols());
+
+    Stopwatch timer;
+
+    if (pStatsOut != nullptr)
+    {
+        TerrainOcclusionStats noStats = { 0 };
+        *pStatsOut = noStats;
+    }
+
+    if (rect.IsEmpty())
+    {
+        return;
+    }
+
+    PaddedHeights padded;
+    BuildPaddedHeights(field, rect, BorderSize(field, params), &padded);
+
+    std::vector<SampleOffset> offsets;
+    std::vector<SlopeWeights> slopeWeights;
+    unsigned int samplesPerDirection = 0;
+    BuildSampleOffsets(field, params, padded.border, padded.width, &offsets, &slopeWeights, &samplesPerDirection);
+
+    if (offsets.empty())
+    {
+        // Nothing is close enough to occlude anything.
+        for (unsigned int row = rect.rowBegin; row < rect.rowEnd; ++row)
+        {
+            unsigned char * pRow = pVisibility + static_cast<size_t>(row) * field.Cols();
+            std::fill(pRow + rect.colBegin, pRow + rect.colEnd, static_cast<unsigned char>(255));
+        }
+
+        return;
+    }
+
+    unsigned int rowsPerTask = std::max(params.rowsPerTask, 1u);
+    unsigned int taskCount = (rect.Rows() + rowsPerTask - 1) / rowsPerTask;
+    Parallel::ForStats parallelStats = { 0 };
+
+    Parallel::For(taskCount, params.threadCount, [&](unsigned int task, unsigned int /*worker*/)
+    {
+        unsigned int firstRow = task * rowsPerTask;
+        unsigned int lastRow = std::min(firstRow + rowsPerTask, rect.Rows());
+
+        for (unsigned int row = firstRow; row < lastRow; ++row)
+        {
+            BakeRow(
+                padded,
+                offsets,
+                slopeWeights,
+                params.directionCount,
+                samplesPerDirection,
+                row,
+                rect.Cols(),
+                pVisibility + static_cast<size_t>(rect.rowBegin + row) * field.Cols() + rect.colBegin);
+        }
+    }, &parallelStats);
+
+    if (pStatsOut != nullptr)
+    {
+        pStatsOut->seconds = timer.ElapsedSeconds();
+        pStatsOut->threadCount = parallelStats.threadCount;
+        pStatsOut->taskCount = taskCount;
+        pStatsOut->stealCount = parallelStats.stealCount;
+        pStatsOut->sampleCount = static_cast<unsigned long long>(rect.Area()) * offsets.size();
+    }
+}
+
+GridRect TerrainOcclusion::AffectedRect(const HeightField& field, const TerrainOcclusionParams& params, const GridRect& changed)
+{
+    return changed.Expand(BorderSize(field, params), field.Rows(), field.Cols());
+}
@@ -19,8 +19,12 @@
 #include "graphics/graphicscontentmanager.h"
 #include "host/renderingwindow.h"
 #include "graphics/DirectXExceptions.h"
+#include "graphics/EffectCompiler.h"
 #include "graphics/DemoScene.h"
 #include "camera/RotationalCamera.h"
+#include "runtime/FileSystemBackends.h"
+#include "runtime/StringUtils.h"
+#include "runtime/VirtualFileSystem.h"
 
 #include <DXGI.h>
 #include <d3d10.h>
@@ -50,7 +54,9 @@ DXRenderer::DXRenderer(
       mMultisampleCount(4),
       mMultisampleQuality(1),
       mWindowedMode(true),
-      mContentManager()
+      mFileSystem(new VirtualFileSystem()),
+      mContentManager(),
+      mLoaderThreadCount(GraphicsContentManager::DEFAULT_LOADER_THREADS)
 {
 }
 
@@ -115,7 +121,8 @@ void DXRenderer::Initialize()
     if (SUCCEEDED(hr))
     {
         // Content manager allows us to create and load graphics
-        mContentManager.reset(new GraphicsContentManager(mDevice.Get(), L"..\\data"));
+        MountContent(L"..\\data");
+        mContentManager.reset(new GraphicsContentManager(mDevice.Get(), mFileSystem.get(), mLoaderThreadCount));
     }
 
     // Check for errors and throw an exception if one happened. We can push propogation of HRESULTs up to the caller,
@@ -128,6 +135,57 @@ void DXRenderer::Initialize()
     SetIsInitialized();
 }
 
+/**
+ * Set the number of asset loader threads.
+ */
+void DXRenderer::SetLoaderThreadCount(unsigned int threadCount)
+{
+    Verify(!IsInitialized());
+    mLoaderThreadCount = threadCount;
+}
+
+/**
+ * Get the content manager.
+ */
+GraphicsContentManager& DXRenderer::ContentManager()
+{
+    if (!IsInitialized()) { throw new NotInitializedException(L"DXRenderer", __FILE__, __LINE__); }
+    return *mContentManager;
+}
+
+/**
+ * Get the file system assets are read from.
+ */
+VirtualFileSystem& DXRenderer::FileSystem()
+{
+    return *mFileSystem;
+}
+
+/**
+ * Mounts the loose content directory, and above it the archive packed from it (if there is one), so
+ * packed assets are read from the archive and anything that isn't packed still loads.
+ */
+void DXRenderer::MountContent(const std::wstring& contentDirectory)
+{
+    mFileSystem->Mount("", std::unique_ptr<FileSystemBackend>(new DirectoryBackend(contentDirectory)), 0);
+
+    std::unique_ptr<ArchiveBackend> archive(new ArchiveBackend());
+    std::wstring archivePath = contentDirectory + L".pak";
+    const char * pReason = nullptr;
+
+    if (archive->Open(archivePath, &pReason))
+    {
+        LOG_INFO("Renderer") << "Mounted " << Utils::ConvertWideStringToUtf8(archivePath) << " ("
+            << archive->Archive().EntryCount() << " files)";
+
+        mFileSystem->Mount("", std::move(archive), 1);
+    }
+    else
+    {
+        LOG_INFO("Renderer") << "Not mounting " << Utils::ConvertWideStringToUtf8(archivePath) << ": " << pReason;
+    }
+}
+
 /**
  * Creates the Direct3D render device and DXGI swap chain.
  */
@@ -427,6 +485,10 @@ void DXRenderer::Update(const DemoScene& scene, TimeT currentTime, TimeT deltaTi
         mWindow->ClearResizedFlag();
     }
 
+    // Create the device objects for any assets that finished loading in the background, so the scene can
+    // draw them this frame.
+    mContentManager->processLoads();
+
     // Always draw a frame during an update cycle.
     //  TODO: Don't always draw a frame. Store the time the last frame was rendered, and render after that time is
     //        passed.
@@ -524,6 +586,14 @@ HRESULT DXRenderer::StartRenderingFrame(TimeT currentTime, TimeT deltaTime)
     mDevice->OMSetDepthStencilState(0, 0);
     mDevice->OMSetBlendState(0, blendFactors, 0xffffffff);
 
+    // The font (and anything else drawn last frame) left other buffers bound, and the pool's
+    // bind counts are kept per frame.
+    if (mContentManager)
+    {
+        mContentManager->geometryPool().InvalidateBinding();
+        mContentManager->geometryPool().ResetStats();
+    }
+
     return S_OK;
 }
 
@@ -555,6 +625,13 @@ void DXRenderer::FinishRenderingFrame(TimeT currentTime, TimeT deltaTime)
     {
         throw new DirectXException(hr, L"Failed to present the swap chain", L"Finish rendering frame", __FILE__, __LINE__);
     }
+
+    // Resources released while the frame was built are destroyed a few frames from now, once the
+    // GPU has finished with them.
+    if (mContentManager)
+    {
+        mContentManager->resources().EndFrame();
+    }
     
     mIsFrameBeingRendered = false;
 }
@@ -578,7 +655,7 @@ void DXRenderer::ReleaseDeviceViews()
 }
 
 /**
- * Loads a .FX file from disk.
+ * Loads a .FX file through the virtual file system.
  */
 HRESULT DXRenderer::LoadFxFile(
     const std::wstring& fxFilePath,
@@ -588,29 +665,27 @@ HRESULT DXRenderer::LoadFxFile(
     VerifyNotNull(ppEffectOut);
     *ppEffectOut = nullptr;
 
-	DWORD shaderFlags = D3D10_SHADER_ENABLE_STRICTNESS;
-
-#if defined( DEBUG ) || defined( _DEBUG )
-	shaderFlags |= D3D10_SHADER_DEBUG;
-	shaderFlags |= D3D10_SHADER_SKIP_OPTIMIZATION;
-#endif
-
+    Microsoft::WRL::ComPtr<ID3D10Blob> compiledEffect;
     Microsoft::WRL::ComPtr<ID3D10Blob> compilationErrors;
     Microsoft::WRL::ComPtr<ID3D10Effect> loadedEffect;
 
-	HRESULT hr = D3DX10CreateEffectFromFile(
-        fxFilePath.c_str(),     // Path to the FX file we want to load.
-		nullptr,                // Pointer to an array of shader macros.
-		nullptr,                // Pointer to an include interface for compiling.
-		"fx_4_0",               // HLSL profile to use when compiling.
-		shaderFlags,            // HLSL compiler flags.
-		0,                      // No options while compiling the shader.
-		mDevice.Get(),          // D3D device that will use this effect.
-		nullptr,                // Pointer to an effect pool for sharing variables between threads.
-		nullptr,                // Address to a thread pump interface. Not needed.            
-        &loadedEffect,          // Load FX object into this guy.
-        &compilationErrors,     // Blob holding error string, if there was one.
-		nullptr);               // Pointer to out HRESULT. Not neeeded. (Ever?)
+    HRESULT hr = EffectCompiler::CompileFile(
+        *mFileSystem,
+        fxFilePath,
+        EffectCompiler::DefaultFlags(),
+        &compiledEffect,
+        &compilationErrors);
+
+    if (SUCCEEDED(hr))
+    {
+        hr = D3D10CreateEffectFromMemory(
+            compiledEffect->GetBufferPointer(),
+            compiledEffect->GetBufferSize(),
+            0,                      // No effect flags.
+            mDevice.Get(),          // D3D device that will use this effect.
+            nullptr,                // Pointer to an effect pool for sharing variables between effects.
+            &loadedEffect);
+    }
 
     if (SUCCEEDED(hr))
     {
@@ -20,24 +20,97 @@
 #include <d3d10.h>
 #include <d3dx10.h>
 
+#include "graphics/DirectXExceptions.h"
+#include "graphics/EffectCompiler.h"
+#include "graphics/MeshFile.h"
 #include "graphics/meshfactory.h"
+#include "graphics/staticmesh.h"
+#include "graphics/staticmeshvertex.h"
+#include "graphics/StreamingTexture.h"
+#include "runtime/logging.h"
+#include "runtime/Stopwatch.h"
+#include "runtime/TextureStreamer.h"
+#include "runtime/VirtualFileSystem.h"
+#include "runtime/WorkerPool.h"
+
+const unsigned int GraphicsContentManager::DEFAULT_LOADER_THREADS;
+const unsigned int GraphicsContentManager::DEFAULT_UPLOAD_BUDGET;
+const unsigned long long GraphicsContentManager::DEFAULT_CPU_BUDGET;
+const unsigned long long GraphicsContentManager::DEFAULT_GPU_BUDGET;
+const unsigned int GraphicsContentManager::DEFAULT_POOL_VERTICES;
+const unsigned int GraphicsContentManager::DEFAULT_POOL_INDICES;
+
+namespace
+{
+    std::string NarrowPath( const std::wstring& path )
+    {
+        return std::string( path.begin(), path.end() );
+    }
+
+    /**
+     * A mesh file opened on a loader thread, along with the file it reads
+     * from, which has to stay open for as long as the mesh file is used
+     */
+    struct MeshFileLoad
+    {
+        VirtualFile file;
+        MeshFile mesh;
+    };
+
+    MeshHandle UploadMeshFile( ID3D10Device * pRenderDevice,
+                               ResourceRegistry * pResources,
+                               const MeshFile& file,
+                               const std::wstring& path,
+                               const Stopwatch& timer );
+}
 
 /**
- * Graphics content manager constructor
+ * Graphics content manager constructor. The effect that the mesh factory
+ * draws with is the first thing loaded in the background, and the primitives
+ * it creates share the buffers of one geometry pool
  */
 GraphicsContentManager::GraphicsContentManager( ID3D10Device *pRenderDevice,
-                                                const std::wstring& contentDir )
-    : mContentDir( contentDir ),
-      mMeshFactory( contentDir, pRenderDevice )
+                                                const VirtualFileSystem * pFileSystem,
+                                                unsigned int loaderThreadCount )
+    : mGeometryPool( pRenderDevice, sizeof( StaticMeshVertex ), DEFAULT_POOL_VERTICES, DEFAULT_POOL_INDICES ),
+      mResources(),
+      mAssets( &mResources ),
+      mMeshFactory( pRenderDevice, &mResources ),
+      mStaticMeshEffect(),
+      mpFileSystem( pFileSystem ),
+      mRenderDevice( pRenderDevice ),
+      mpLoaders( new WorkerPool( loaderThreadCount ) ),
+      mpTextureStreamer( new TextureStreamer( mpLoaders.get() ) ),
+      mCompletedLock(),
+      mLoadCompleted(),
+      mCompleted(),
+      mPendingCount( 0 ),
+      mUploadBudget( DEFAULT_UPLOAD_BUDGET ),
+      mIdleCallbacks()
 {
+    VerifyNotNull( pFileSystem );
+
+    AssetMemory budget = { DEFAULT_CPU_BUDGET, DEFAULT_GPU_BUDGET };
+    mAssets.SetBudget( budget );
+
+    mMeshFactory.setGeometryPool( &mGeometryPool );
+
+    MeshFactory * pMeshFactory = &mMeshFactory;
+
+    mStaticMeshEffect = loadAsync<ID3D10Effect>( L"shaders\\cube.fx", [pMeshFactory]( const AssetFuture<ID3D10Effect>& effect )
+    {
+        pMeshFactory->setStaticMeshEffect( effect.get().Get() );
+    } );
 }
 
 /**
- * Graphics content manager destructor
+ * Graphics content manager destructor. Waits for the loader threads so none
+ * of them are left holding on to the content manager or the texture streamer
  */
 GraphicsContentManager::~GraphicsContentManager()
 {
-
+    mpTextureStreamer.reset();
+    mpLoaders.reset();
 }
 
 /**
@@ -47,4 +120,444 @@ GraphicsContentManager::~GraphicsContentManager()
 MeshFactory& GraphicsContentManager::meshFactory()
 {
     return mMeshFactory;
-}
\ No newline at end of file
+}
+
+/**
+ * Return a reference to the resource registry that owns the content
+ * manager's meshes
+ */
+ResourceRegistry& GraphicsContentManager::resources()
+{
+    return mResources;
+}
+
+/**
+ * Return a reference to the geometry pool that mesh factory primitives live in
+ */
+GeometryPool& GraphicsContentManager::geometryPool()
+{
+    return mGeometryPool;
+}
+
+/**
+ * Return a reference to the cache of loaded assets
+ */
+AssetCache& GraphicsContentManager::assets()
+{
+    return mAssets;
+}
+
+/**
+ * Return the file system that assets are read from
+ */
+const VirtualFileSystem& GraphicsContentManager::fileSystem() const
+{
+    return *mpFileSystem;
+}
+
+/**
+ * Load a mesh file and upload it directly from the mapped file
+ */
+MeshHandle GraphicsContentManager::loadMesh( const std::wstring& path )
+{
+    Stopwatch timer;
+    MeshFileLoad load;
+    const char * pReason = "file is missing";
+
+    if ( !mpFileSystem->Open( path, &load.file ) || !load.mesh.Open( load.file.Data(), &pReason ) )
+    {
+        LOG_WARN("GraphicsContentManager") << "Could not open mesh file " << NarrowPath( path ) << ": " << pReason;
+        return MeshHandle();
+    }
+
+    return UploadMeshFile( mRenderDevice.Get(), &mResources, load.mesh, path, timer );
+}
+
+/**
+ * Open a DDS file and hand it to the texture streamer, which uploads its
+ * smallest mips straight away
+ */
+std::shared_ptr<StreamingTexture> GraphicsContentManager::loadTexture( const std::wstring& path,
+                                                                       unsigned int requestedSize )
+{
+    VirtualFile file;
+    const char * pReason = "file is missing";
+    std::shared_ptr<StreamingTexture> texture =
+        std::make_shared<StreamingTexture>( mRenderDevice.Get(), mpTextureStreamer.get() );
+
+    if ( !mpFileSystem->Open( path, &file ) || !texture->Open( std::move( file ), requestedSize, &pReason ) )
+    {
+        LOG_WARN("GraphicsContentManager") << "Could not open texture " << NarrowPath( path ) << ": " << pReason;
+        return nullptr;
+    }
+
+    return texture;
+}
+
+/**
+ * Return a reference to the streamer that upgrades textures
+ */
+TextureStreamer& GraphicsContentManager::textureStreamer()
+{
+    return *mpTextureStreamer;
+}
+
+/**
+ * Map and read a mesh file on a loader thread, then upload it on the render
+ * thread
+ */
+template<>
+AssetFuture<StaticMesh> GraphicsContentManager::loadAsync<StaticMesh>(
+    const std::wstring& path,
+    const AssetFuture<StaticMesh>::Callback& callback )
+{
+    AssetKey key = { AssetType::Mesh, AssetCache::CanonicalPath( path ), 0 };
+    AssetFuture<StaticMesh> future;
+
+    if ( findOrInsertAsset( key, path, callback, &future ) )
+    {
+        return future;
+    }
+
+    ID3D10Device * pRenderDevice = mRenderDevice.Get();
+    ResourceRegistry * pResources = &mResources;
+    AssetCache * pAssets = &mAssets;
+    const VirtualFileSystem * pFileSystem = mpFileSystem;
+    Stopwatch timer;
+
+    startLoad( [=]() -> Completion
+    {
+        // Loader thread: open the file and read all of it in, so the render
+        // thread never waits on the disk.
+        std::shared_ptr<MeshFileLoad> pLoad( new MeshFileLoad() );
+        const char * pReason = "file is missing";
+
+        if ( pFileSystem->Open( future.path(), &pLoad->file ) && pLoad->mesh.Open( pLoad->file.Data(), &pReason ) )
+        {
+            pLoad->mesh.Prefetch();
+        }
+
+        return [=]() mutable
+        {
+            // Render thread: create the buffers.
+            MeshHandle mesh;
+            AssetMemory memory = { 0, 0 };
+
+            if ( pLoad->mesh.IsOpen() )
+            {
+                const MeshFileHeader& header = pLoad->mesh.Header();
+
+                memory.cpuBytes = sizeof(StaticMesh) + header.lodCount * sizeof(MeshLod);
+                memory.gpuBytes = static_cast<unsigned long long>( header.vertexCount ) * header.vertexStride +
+                                  static_cast<unsigned long long>( header.indexCount ) * sizeof(unsigned int);
+
+                mesh = UploadMeshFile( pRenderDevice, pResources, pLoad->mesh, future.path(), timer );
+            }
+            else
+            {
+                LOG_WARN("GraphicsContentManager") << "Could not open mesh file "
+                    << NarrowPath( future.path() ) << ": " << pReason;
+            }
+
+            // Failures are dropped from the cache so that asking again retries the load.
+            if ( mesh.IsNull() )
+            {
+                pAssets->Remove( key );
+                future.fail();
+            }
+            else
+            {
+                pAssets->SetMemory( key, memory );
+                future.complete( mesh );
+            }
+
+            future.notify();
+        };
+    } );
+
+    return future;
+}
+
+/**
+ * Compile an effect file on a loader thread, then create the effect from the
+ * compiled blob on the render thread
+ */
+template<>
+AssetFuture<ID3D10Effect> GraphicsContentManager::loadAsync<ID3D10Effect>(
+    const std::wstring& path,
+    const AssetFuture<ID3D10Effect>::Callback& callback )
+{
+    DWORD shaderFlags = EffectCompiler::DefaultFlags();
+    AssetKey key = { AssetType::Effect, AssetCache::CanonicalPath( path ), static_cast<unsigned int>( shaderFlags ) };
+    AssetFuture<ID3D10Effect> future;
+
+    if ( findOrInsertAsset( key, path, callback, &future ) )
+    {
+        return future;
+    }
+
+    ID3D10Device * pRenderDevice = mRenderDevice.Get();
+    AssetCache * pAssets = &mAssets;
+    const VirtualFileSystem * pFileSystem = mpFileSystem;
+    Stopwatch timer;
+
+    startLoad( [=]() -> Completion
+    {
+        // Loader thread: compiling is the slow part of loading an effect and
+        // doesn't need the device.
+        Microsoft::WRL::ComPtr<ID3D10Blob> compiledEffect;
+        Microsoft::WRL::ComPtr<ID3D10Blob> compilationErrors;
+
+        HRESULT hr = EffectCompiler::CompileFile( *pFileSystem,
+                                                  future.path(),
+                                                  shaderFlags,
+                                                  &compiledEffect,
+                                                  &compilationErrors );
+
+        return [=]() mutable
+        {
+            // Render thread: create the effect. Failures are fatal, the same
+            // as they are for DXRenderer::LoadFxFile.
+            if ( FAILED(hr) )
+            {
+                pAssets->Remove( key );
+
+                if ( compilationErrors )
+                {
+                    throw ShaderCompileFailedException( hr,
+                                                        future.path(),
+                                                        static_cast<const char *>( compilationErrors->GetBufferPointer() ) );
+                }
+                else
+                {
+                    throw DirectXException( hr, L"Failed to compile effect file", future.path() );
+                }
+            }
+
+            Microsoft::WRL::ComPtr<ID3D10Effect> effect;
+            HRESULT createResult = D3D10CreateEffectFromMemory( compiledEffect->GetBufferPointer(),
+                                                                compiledEffect->GetBufferSize(),
+                                                                0,
+                                                                pRenderDevice,
+                                                                nullptr,
+                                                                &effect );
+
+            if ( FAILED(createResult) )
+            {
+                pAssets->Remove( key );
+                throw DirectXException( createResult, L"Failed to create effect", future.path() );
+            }
+
+            LOG_INFO("GraphicsContentManager") << "Loaded " << NarrowPath( future.path() ) << " in "
+                << timer.ElapsedSeconds() * 1000.0 << " ms";
+
+            // The driver keeps its own copy of the compiled shaders, and the
+            // effect keeps the reflection data, so count the blob against both.
+            AssetMemory memory = { compiledEffect->GetBufferSize(), compiledEffect->GetBufferSize() };
+            pAssets->SetMemory( key, memory );
+
+            future.complete( effect );
+            future.notify();
+        };
+    } );
+
+    return future;
+}
+
+/**
+ * Look for an asset in the cache, and if it isn't there add a new future for
+ * it. Returns true if the asset was found, and false if the caller needs to
+ * start loading it
+ */
+template<typename T>
+bool GraphicsContentManager::findOrInsertAsset( const AssetKey& key,
+                                                const std::wstring& path,
+                                                const typename AssetFuture<T>::Callback& callback,
+                                                AssetFuture<T> * pFutureOut )
+{
+    bool found = mAssets.Find( key, pFutureOut );
+
+    if ( !found )
+    {
+        *pFutureOut = AssetFuture<T>( path );
+        mAssets.Insert( key, *pFutureOut );
+    }
+
+    if ( callback )
+    {
+        pFutureOut->whenReady( callback );
+    }
+
+    return found;
+}
+
+/**
+ * Finish a batch of loads that the loader threads are done with, evict
+ * whatever the asset cache no longer has room for, then let the texture
+ * streamer upgrade textures
+ */
+unsigned int GraphicsContentManager::processLoads()
+{
+    unsigned int finishedCount = finishLoads( mUploadBudget );
+    mAssets.Trim();
+    mpTextureStreamer->Update();
+
+    return finishedCount;
+}
+
+/**
+ * Finish every load, waiting on the loader threads for those that are still
+ * being read
+ */
+void GraphicsContentManager::waitForLoads()
+{
+    while ( mPendingCount > 0 )
+    {
+        {
+            std::unique_lock<std::mutex> lock( mCompletedLock );
+            mLoadCompleted.wait( lock, [this]() { return !mCompleted.empty(); } );
+        }
+
+        finishLoads( mPendingCount );
+    }
+}
+
+/**
+ * Call a function once nothing is left loading
+ */
+void GraphicsContentManager::notifyWhenIdle( const std::function<void()>& callback )
+{
+    if ( mPendingCount == 0 )
+    {
+        callback();
+    }
+    else
+    {
+        mIdleCallbacks.push_back( callback );
+    }
+}
+
+unsigned int GraphicsContentManager::pendingLoadCount() const
+{
+    return mPendingCount;
+}
+
+unsigned int GraphicsContentManager::loaderThreadCount() const
+{
+    return mpLoaders->ThreadCount();
+}
+
+void GraphicsContentManager::setUploadBudget( unsigned int loadsPerFrame )
+{
+    Verify( loadsPerFrame > 0 );
+    mUploadBudget = loadsPerFrame;
+}
+
+/**
+ * Run a load job on a loader thread, and queue the completion it returns for
+ * the render thread. Without loader threads the load is finished right away
+ */
+void GraphicsContentManager::startLoad( const std::function<Completion()>& job )
+{
+    ++mPendingCount;
+
+    mpLoaders->Submit( [this, job]()
+    {
+        Completion completion = job();
+
+        std::lock_guard<std::mutex> lock( mCompletedLock );
+        mCompleted.push_back( std::move( completion ) );
+        mLoadCompleted.notify_one();
+    } );
+
+    if ( mpLoaders->ThreadCount() == 0 )
+    {
+        waitForLoads();
+    }
+}
+
+/**
+ * Take up to maxCount completed loads off the queue in one go and finish them
+ */
+unsigned int GraphicsContentManager::finishLoads( unsigned int maxCount )
+{
+    std::vector<Completion> batch;
+
+    {
+        std::lock_guard<std::mutex> lock( mCompletedLock );
+
+        while ( !mCompleted.empty() && batch.size() < maxCount )
+        {
+            batch.push_back( std::move( mCompleted.front() ) );
+            mCompleted.pop_front();
+        }
+    }
+
+    for ( size_t i = 0; i < batch.size(); ++i )
+    {
+        --mPendingCount;
+        batch[i]();
+    }
+
+    // Callbacks may have started more loads, so only notify once they are
+    // done too.
+    if ( mPendingCount == 0 && !mIdleCallbacks.empty() )
+    {
+        std::vector<std::function<void()>> idleCallbacks;
+        idleCallbacks.swap( mIdleCallbacks );
+
+        for ( size_t i = 0; i < idleCallbacks.size(); ++i )
+        {
+            idleCallbacks[i]();
+        }
+    }
+
+    return static_cast<unsigned int>( batch.size() );
+}
+
+namespace
+{
+    /**
+     * Create a static mesh from a mapped mesh file and add it to the registry
+     */
+    MeshHandle UploadMeshFile( ID3D10Device * pRenderDevice,
+                               ResourceRegistry * pResources,
+                               const MeshFile& file,
+                               const std::wstring& path,
+                               const Stopwatch& timer )
+    {
+        if ( !file.HasStaticMeshLayout() )
+        {
+            LOG_WARN("GraphicsContentManager") << "Mesh file " << NarrowPath( path )
+                << " does not use the static mesh vertex layout";
+            return MeshHandle();
+        }
+
+        const MeshFileHeader& header = file.Header();
+        StaticMesh mesh( pRenderDevice,
+                         static_cast<const StaticMeshVertex *>( file.Vertices() ),
+                         header.vertexCount,
+                         file.Indices(),
+                         header.indexCount );
+
+        if ( header.lodCount > 1 )
+        {
+            std::vector<MeshLod> lods( header.lodCount );
+
+            for ( unsigned int i = 0; i < header.lodCount; ++i )
+            {
+                MeshLod lod = { file.Lods()[i].firstIndex, file.Lods()[i].indexCount, file.Lods()[i].screenSize, 0.0f };
+                lods[i] = lod;
+            }
+
+            mesh.setLods( lods );
+        }
+
+        LOG_INFO("GraphicsContentManager") << "Loaded " << NarrowPath( path ) << " ("
+            << header.vertexCount << " vertices, " << header.indexCount / 3 << " triangles, "
+            << header.lodCount << " levels of detail) in "
+            << timer.ElapsedSeconds() * 1000.0 << " ms";
+
+        return pResources->AddMesh( std::move( mesh ) );
+    }
+}
@@ -19,9 +19,13 @@
 
 #include <d3d10.h>
 #include <d3dx10.h>
+#include <cstddef>
 #include <memory>
 #include <string>
+#include <vector>
 
+#include "graphics/MeshOptimizer.h"
+#include "graphics/Primitives.h"
 #include "graphics/staticmesh.h"
 #include "graphics/staticmeshvertex.h"
 #include "runtime/StringUtils.h"
@@ -30,14 +34,22 @@
  * Mesh factory constructor. Initializes the mesh factory with a pointer to the
  * active Direct3d renderer
  */
-MeshFactory::MeshFactory(const std::wstring& dataDir, ID3D10Device * pRenderDevice)
+MeshFactory::MeshFactory(ID3D10Device * pRenderDevice, ResourceRegistry * pRegistry)
     : mRenderDevice( pRenderDevice ),
       mStaticMeshFX(),
       mStaticMeshInputLayout(),
-      mpStaticMeshTechnique(nullptr)
+      mpStaticMeshTechnique(nullptr),
+      mInstancedInputLayout(),
+      mpInstancedTechnique(nullptr),
+      mpRegistry(pRegistry),
+      mpGeometryPool(nullptr),
+      mLodChainParams(),
+      mpScratch(new PrimitiveMesh()),
+      mPrimitiveCache()
 {
     AssertNotNull(pRenderDevice);
-    Init(dataDir);
+    AssertNotNull(pRegistry);
+    mLodChainParams.triangleRatios.clear();
 }
 
 /**
@@ -50,107 +62,388 @@ MeshFactory::~MeshFactory()
 /**
  * Generates a new static mesh for a 3d box
  */
-std::shared_ptr<StaticMesh> MeshFactory::createBox( float scale ) const
+MeshHandle MeshFactory::createBox( float scale )
 {
-    const unsigned int VERTEX_COUNT = 8;
-    const unsigned int FACE_COUNT   = 12;
+    return createBox( scale, scale, scale );
+}
+
+/**
+ * Box with the given half extents along x, y and z
+ */
+MeshHandle MeshFactory::createBox( float halfWidth, float halfHeight, float halfDepth )
+{
+    PrimitiveKey key = MakeKey( PrimitiveType::Box, halfWidth, halfHeight, halfDepth, 0, 0 );
+    MeshHandle mesh = FindPrimitive( key );
 
-    // The vertex buffer
-    const StaticMeshVertex VERTICES[VERTEX_COUNT] =
+    if ( mesh.IsNull() )
     {
-        {  D3DXVECTOR3( -1.0f, -1.0f, -1.0f ), D3DXCOLOR( 1.0f, 1.0f, 1.0f, 1.0f ) },
-        {  D3DXVECTOR3( -1.0f, +1.0f, -1.0f ), D3DXCOLOR( 1.0f, 1.0f, 0.0f, 1.0f ) },
-        {  D3DXVECTOR3( +1.0f, +1.0f, -1.0f ), D3DXCOLOR( 0.0f, 0.0f, 1.0f, 1.0f ) },
-        {  D3DXVECTOR3( +1.0f, -1.0f, -1.0f ), D3DXCOLOR( 1.0f, 0.0f, 0.0f, 1.0f ) },
-        {  D3DXVECTOR3( -1.0f, -1.0f, +1.0f ), D3DXCOLOR( 0.0f, 1.0f, 1.0f, 1.0f ) },
-        {  D3DXVECTOR3( -1.0f, +1.0f, +1.0f ), D3DXCOLOR( 0.0f, 1.0f, 0.0f, 1.0f ) },
-        {  D3DXVECTOR3( +1.0f, +1.0f, +1.0f ), D3DXCOLOR( 0.0f, 0.0f, 1.0f, 1.0f ) },
-        {  D3DXVECTOR3( +1.0f, -1.0f, +1.0f ), D3DXCOLOR( 0.0f, 0.0f, 0.0f, 1.0f ) },
-    };
+        Primitives::GenerateBox( D3DXVECTOR3( halfWidth, halfHeight, halfDepth ), mpScratch.get() );
+        mesh = UploadPrimitive( key, "Box" );
+    }
+
+    return mesh;
+}
+
+/**
+ * Latitude / longitude sphere
+ */
+MeshHandle MeshFactory::createUvSphere( float radius, unsigned int slices, unsigned int stacks )
+{
+    PrimitiveKey key = MakeKey( PrimitiveType::UvSphere, radius, 0.0f, 0.0f, slices, stacks );
+    MeshHandle mesh = FindPrimitive( key );
+
+    if ( mesh.IsNull() )
+    {
+        Primitives::GenerateUvSphere( radius, slices, stacks, mpScratch.get() );
+        mesh = UploadPrimitive( key, "UvSphere" );
+    }
+
+    return mesh;
+}
+
+/**
+ * Subdivided icosahedron sphere
+ */
+MeshHandle MeshFactory::createIcoSphere( float radius, unsigned int subdivisions )
+{
+    PrimitiveKey key = MakeKey( PrimitiveType::IcoSphere, radius, 0.0f, 0.0f, subdivisions, 0 );
+    MeshHandle mesh = FindPrimitive( key );
+
+    if ( mesh.IsNull() )
+    {
+        Primitives::GenerateIcoSphere( radius, subdivisions, mpScratch.get() );
+        mesh = UploadPrimitive( key, "IcoSphere" );
+    }
+
+    return mesh;
+}
+
+/**
+ * Capped cylinder centered on the origin
+ */
+MeshHandle MeshFactory::createCylinder( float radius, float height, unsigned int slices )
+{
+    PrimitiveKey key = MakeKey( PrimitiveType::Cylinder, radius, height, 0.0f, slices, 0 );
+    MeshHandle mesh = FindPrimitive( key );
 
-    // The index buffer
-    const unsigned int INDICES[FACE_COUNT*3] =
+    if ( mesh.IsNull() )
     {
-        // Front face
-        0u, 1u, 2u,
-        0u, 2u, 3u,
+        Primitives::GenerateCylinder( radius, height, slices, mpScratch.get() );
+        mesh = UploadPrimitive( key, "Cylinder" );
+    }
 
-        // Back face
-        4u, 6u, 5u,
-        4u, 7u, 6u,
+    return mesh;
+}
 
-        // Left face
-        4u, 5u, 1u,
-        4u, 1u, 0u,
+/**
+ * Capped cone centered on the origin, pointing up
+ */
+MeshHandle MeshFactory::createCone( float radius, float height, unsigned int slices )
+{
+    PrimitiveKey key = MakeKey( PrimitiveType::Cone, radius, height, 0.0f, slices, 0 );
+    MeshHandle mesh = FindPrimitive( key );
 
-        // Right face
-        3u, 2u, 6u,
-        3u, 6u, 7u,
+    if ( mesh.IsNull() )
+    {
+        Primitives::GenerateCone( radius, height, slices, mpScratch.get() );
+        mesh = UploadPrimitive( key, "Cone" );
+    }
 
-        // Top face
-        1u, 5u, 6u,
-        1u, 6u, 2u,
+    return mesh;
+}
 
-        // Bottom face
-        4u, 0u, 3u,
-        4u, 3u, 7u
-    };
+/**
+ * Torus lying in the xz plane
+ */
+MeshHandle MeshFactory::createTorus(
+    float majorRadius,
+    float minorRadius,
+    unsigned int rings,
+    unsigned int sides )
+{
+    PrimitiveKey key = MakeKey( PrimitiveType::Torus, majorRadius, minorRadius, 0.0f, rings, sides );
+    MeshHandle mesh = FindPrimitive( key );
+
+    if ( mesh.IsNull() )
+    {
+        Primitives::GenerateTorus( majorRadius, minorRadius, rings, sides, mpScratch.get() );
+        mesh = UploadPrimitive( key, "Torus" );
+    }
+
+    return mesh;
+}
+
+/**
+ * Upward facing grid of quads in the xz plane
+ */
+MeshHandle MeshFactory::createPlane( float width, float depth, unsigned int cols, unsigned int rows )
+{
+    PrimitiveKey key = MakeKey( PrimitiveType::Plane, width, depth, 0.0f, cols, rows );
+    MeshHandle mesh = FindPrimitive( key );
+
+    if ( mesh.IsNull() )
+    {
+        Primitives::GeneratePlane( width, depth, cols, rows, mpScratch.get() );
+        mesh = UploadPrimitive( key, "Plane" );
+    }
+
+    return mesh;
+}
+
+/**
+ * Cylinder with hemispherical ends
+ */
+MeshHandle MeshFactory::createCapsule(
+    float radius,
+    float height,
+    unsigned int slices,
+    unsigned int stacks )
+{
+    PrimitiveKey key = MakeKey( PrimitiveType::Capsule, radius, height, 0.0f, slices, stacks );
+    MeshHandle mesh = FindPrimitive( key );
+
+    if ( mesh.IsNull() )
+    {
+        Primitives::GenerateCapsule( radius, height, slices, stacks, mpScratch.get() );
+        mesh = UploadPrimitive( key, "Capsule" );
+    }
+
+    return mesh;
+}
+
+/**
+ * Releases every cached primitive
+ */
+void MeshFactory::clearCache()
+{
+    for ( auto cached = mPrimitiveCache.begin(); cached != mPrimitiveCache.end(); ++cached )
+    {
+        mpRegistry->ReleaseMesh( cached->second );
+    }
+
+    mPrimitiveCache.clear();
+}
+
+/**
+ * Number of primitives currently held in the cache
+ */
+unsigned int MeshFactory::cachedMeshCount() const
+{
+    return static_cast<unsigned int>( mPrimitiveCache.size() );
+}
 
-    // Construct and return the static mesh object
-    std::vector<unsigned int> indices( &INDICES[0], &INDICES[FACE_COUNT*3] );
-    return std::shared_ptr<StaticMesh>(new StaticMesh(mRenderDevice.Get(), VERTICES, VERTEX_COUNT, indices));
+/**
+ * Sets the geometry pool that new primitives are placed in
+ */
+void MeshFactory::setGeometryPool( GeometryPool * pGeometryPool )
+{
+    mpGeometryPool = pGeometryPool;
+}
+
+/**
+ * Sets how levels of detail are generated for new primitives
+ */
+void MeshFactory::setLodChain( const MeshSimplifier::LodChainParams& params )
+{
+    mLodChainParams = params;
+}
+
+/**
+ * Check if the static mesh effect has been set
+ */
+bool MeshFactory::isReady() const
+{
+    return mStaticMeshFX.Get() != nullptr;
 }
 
 /**
- * Initializes the mesh factory. Only call this once, and call it from the
- * class constructor
+ * Returns the effect that static meshes are drawn with
  */
-void MeshFactory::Init(const std::wstring& dataDir)
+ID3D10Effect * MeshFactory::staticMeshEffect() const
 {
-    // TODO: Make sure we are initializing only once
-    // TODO - Follow example from dxrenderer for this code. What's here isn't correct.
-    AssertNotNull(mpStaticMeshTechnique);
+    return mStaticMeshFX.Get();
+}
 
-    // Create string that contains file path to effects file
-    std::wstring fxfilepath = dataDir + std::wstring( L"\\shaders\\cube.fx" );
+/**
+ * Returns the technique and input layout for drawing instanced static meshes
+ */
+InstanceMaterial MeshFactory::instancedMaterial() const
+{
+    InstanceMaterial material = { mpInstancedTechnique, mInstancedInputLayout.Get() };
+    return material;
+}
 
-    // Load the shader FX file from disk
-    ID3D10Blob *pError = NULL;
-    HRESULT result     = S_OK;
-    DWORD shaderFlags  = D3D10_SHADER_ENABLE_STRICTNESS | D3D10_SHADER_DEBUG;
+/**
+ * Orders keys by type, then sizes, then divisions
+ */
+bool MeshFactory::PrimitiveKey::operator <(const PrimitiveKey& other) const
+{
+    if ( type != other.type )
+    {
+        return type < other.type;
+    }
 
-    result = D3DX10CreateEffectFromFileW( fxfilepath.c_str(),
-                                         NULL,
-                                         NULL,
-                                         "fx_4_0",
-                                         shaderFlags,
-                                         NULL,
-                                         mRenderDevice.Get(),
-                                         NULL,
-                                         NULL,
-                                         &mStaticMeshFX,
-                                         &pError,
-                                         NULL );
+    for ( unsigned int i = 0; i < 3; ++i )
+    {
+        if ( sizes[i] != other.sizes[i] )
+        {
+            return sizes[i] < other.sizes[i];
+        }
+    }
 
-    // Check if there were errors while loading the shader from disk
-    if ( FAILED(result) )
+    for ( unsigned int i = 0; i < 2; ++i )
     {
-        throw DirectXException(result);
+        if ( divisions[i] != other.divisions[i] )
+        {
+            return divisions[i] < other.divisions[i];
+        }
     }
 
-    // Make sure the effect file was loaded
-    AssertNotNull(mStaticMeshFX.Get());
+    return false;
+}
+
+/**
+ * Builds a cache key from a primitive's parameters
+ */
+MeshFactory::PrimitiveKey MeshFactory::MakeKey(
+    PrimitiveType type,
+    float size0,
+    float size1,
+    float size2,
+    unsigned int divisions0,
+    unsigned int divisions1)
+{
+    PrimitiveKey key;
+
+    key.type = type;
+    key.sizes[0] = size0;
+    key.sizes[1] = size1;
+    key.sizes[2] = size2;
+    key.divisions[0] = divisions0;
+    key.divisions[1] = divisions1;
+
+    return key;
+}
+
+/**
+ * Returns the cached mesh for a primitive, or a null handle if it has not been
+ * created yet or was released by someone else
+ */
+MeshHandle MeshFactory::FindPrimitive( const PrimitiveKey& key ) const
+{
+    auto cached = mPrimitiveCache.find( key );
+
+    if ( cached != mPrimitiveCache.end() && mpRegistry->IsAlive( cached->second ) )
+    {
+        return cached->second;
+    }
+
+    return MeshHandle();
+}
+
+/**
+ * Optimizes and uploads the primitive that was just generated into the scratch mesh, and adds it to
+ * the cache
+ */
+MeshHandle MeshFactory::UploadPrimitive( const PrimitiveKey& key, const char * pMeshName )
+{
+    OptimizeMesh( pMeshName, &mpScratch->vertices, &mpScratch->indices );
+
+    std::vector<MeshLod> lods;
+
+    if ( !mLodChainParams.triangleRatios.empty() )
+    {
+        MeshSimplifier::SimplifyStats stats;
+        MeshSimplifier::GenerateLodChain(
+            &mpScratch->vertices[0],
+            mpScratch->VertexCount(),
+            &mpScratch->indices,
+            mLodChainParams,
+            &lods,
+            &stats );
+
+        MeshSimplifier::LogLodChain( pMeshName, lods, stats );
+    }
+
+    StaticMesh mesh;
+
+    if ( mpGeometryPool != nullptr )
+    {
+        mesh = StaticMesh(
+            mpGeometryPool,
+            mRenderDevice.Get(),
+            &mpScratch->vertices[0],
+            mpScratch->VertexCount(),
+            &mpScratch->indices[0],
+            static_cast<unsigned int>( mpScratch->indices.size() ) );
+    }
+    else
+    {
+        mesh = StaticMesh(
+            mRenderDevice.Get(),
+            &mpScratch->vertices[0],
+            mpScratch->VertexCount(),
+            mpScratch->indices );
+    }
+
+    if ( lods.size() > 1 )
+    {
+        mesh.setLods( lods );
+    }
+
+    MeshHandle handle = mpRegistry->AddMesh( std::move( mesh ) );
+
+    mPrimitiveCache[key] = handle;
+    return handle;
+}
+
+/**
+ * Reorders a generated mesh's triangles for the post transform vertex cache and its vertices for
+ * vertex fetch, and logs the change in cache efficiency.
+ */
+void MeshFactory::OptimizeMesh(
+    const char * pMeshName,
+    std::vector<StaticMeshVertex> * pVertices,
+    std::vector<unsigned int> * pIndices) const
+{
+    unsigned int vertexCount = static_cast<unsigned int>( pVertices->size() );
+    unsigned int indexCount = static_cast<unsigned int>( pIndices->size() );
+
+    MeshOptimizer::VertexCacheStats before =
+        MeshOptimizer::AnalyzeVertexCache( &(*pIndices)[0], indexCount, vertexCount );
+
+    MeshOptimizer::OptimizeVertexCache( &(*pIndices)[0], indexCount, vertexCount );
+    MeshOptimizer::OptimizeVertexFetch( &(*pVertices)[0], vertexCount, sizeof(StaticMeshVertex), &(*pIndices)[0], indexCount );
+
+    MeshOptimizer::VertexCacheStats after =
+        MeshOptimizer::AnalyzeVertexCache( &(*pIndices)[0], indexCount, vertexCount );
+
+    MeshOptimizer::LogOptimization( pMeshName, before, after );
+}
+
+/**
+ * Takes the effect that static meshes are drawn with, and creates the input
+ * layouts for its techniques. Only call this once
+ */
+void MeshFactory::setStaticMeshEffect( ID3D10Effect * pEffect )
+{
+    VerifyNotNull(pEffect);
+    VerifyNull(mStaticMeshFX.Get());
+
+    mStaticMeshFX = pEffect;
 
     // Now grab the technique
     mpStaticMeshTechnique = mStaticMeshFX->GetTechniqueByName("DefaultCubeTechnique");
     VerifyNotNull(mpStaticMeshTechnique);
 
     // Create the vertex layout expected in a static mesh
-    const unsigned int NUM_VERTEX_ELEMENTS = 2;
+    const unsigned int NUM_VERTEX_ELEMENTS = 4;
     D3D10_INPUT_ELEMENT_DESC staticVertexDesc[NUM_VERTEX_ELEMENTS] =
     {
-        { "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D10_INPUT_PER_VERTEX_DATA, 0 },
-        { "COLOR",    0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, 0, D3D10_INPUT_PER_VERTEX_DATA, 0 }
+        { "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, offsetof(StaticMeshVertex, pos), D3D10_INPUT_PER_VERTEX_DATA, 0 },
+        { "NORMAL",   0, DXGI_FORMAT_R32G32B32_FLOAT, 0, offsetof(StaticMeshVertex, normal), D3D10_INPUT_PER_VERTEX_DATA, 0 },
+        { "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, offsetof(StaticMeshVertex, texcoord), D3D10_INPUT_PER_VERTEX_DATA, 0 },
+        { "COLOR",    0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, offsetof(StaticMeshVertex, color), D3D10_INPUT_PER_VERTEX_DATA, 0 }
     };
 
     // Grab a description struct from the loaded effects file for the first stage.
@@ -162,10 +455,16 @@ void MeshFactory::Init(const std::wstring& dataDir)
     
     // Now use the vertex description and the effects pass description to create
     // an input layout we can bind vertices to
-    result = mRenderDevice->CreateInputLayout( staticVertexDesc,
-                                                NUM_VERTEX_ELEMENTS,
-                                                staticPassDesc.pIAInputSignature,
-                                                staticPassDesc.IAInputSignatureSize,
-                                                &mStaticMeshInputLayout );
+    HRESULT result = mRenderDevice->CreateInputLayout( staticVertexDesc,
+                                                       NUM_VERTEX_ELEMENTS,
+                                                       staticPassDesc.pIAInputSignature,
+                                                       staticPassDesc.IAInputSignatureSize,
+                                                       &mStaticMeshInputLayout );
     // TODO: Check HR
+
+    // The instanced technique reads the same vertices plus a per instance stream
+    mpInstancedTechnique = mStaticMeshFX->GetTechniqueByName("InstancedCubeTechnique");
+    VerifyNotNull(mpInstancedTechnique);
+
+    InstanceBatcher::CreateInputLayout( mRenderDevice.Get(), mpInstancedTechnique, &mInstancedInputLayout );
 }
\ No newline at end of file
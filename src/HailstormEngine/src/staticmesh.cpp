@@ -23,6 +23,7 @@
 
 #include "graphics/dxrenderer.h"
 #include "graphics/staticmeshvertex.h"
+#include "runtime/logging.h"
 
 /**
  * Default static mesh constructor. Creates an empty static mesh that has no
@@ -32,9 +33,14 @@ StaticMesh::StaticMesh()
     : mVertexCount( 0 ),
       mFaceCount( 0 ),
       mVertexBuffer(),
-      mIndexBuffer()
+      mIndexBuffer(),
+      mpGeometryPool( nullptr ),
+      mGeometryHandle( GeometryPool::INVALID_HANDLE ),
+      mLods(),
+      mBounds( BoundingVolume::Empty() )
 {
-
+    MeshLod noMesh = { 0, 0, 1.0f, 0.0f };
+    mLods.assign( 1, noMesh );
 }
 
 /**
@@ -45,21 +51,116 @@ StaticMesh::StaticMesh( ID3D10Device * pRenderDevice,
                         const StaticMeshVertex *pVertexArray,
                         unsigned int vertexCount,
                         const std::vector<unsigned int>& indexArray )
+    : StaticMesh( pRenderDevice,
+                  pVertexArray,
+                  vertexCount,
+                  indexArray.empty() ? NULL : &indexArray[0],
+                  static_cast<unsigned int>( indexArray.size() ) )
+{
+}
+
+/**
+ * Static mesh constructor that uploads vertices and indices from raw arrays,
+ * eg streams in a memory mapped mesh file. The arrays are only read during
+ * construction.
+ */
+StaticMesh::StaticMesh( ID3D10Device * pRenderDevice,
+                        const StaticMeshVertex *pVertexArray,
+                        unsigned int vertexCount,
+                        const unsigned int * pIndexArray,
+                        unsigned int indexCount )
     : mVertexCount( vertexCount ),
-      mFaceCount( static_cast<unsigned int>( indexArray.size() / 3 ) ),
+      mFaceCount( indexCount / 3 ),
       mVertexBuffer(),
-      mIndexBuffer()
+      mIndexBuffer(),
+      mpGeometryPool( nullptr ),
+      mGeometryHandle( GeometryPool::INVALID_HANDLE ),
+      mLods(),
+      mBounds( BoundingVolume::Empty() )
+{
+    assert( pRenderDevice != NULL );
+    assert( (mVertexCount == 0 && mFaceCount == 0   ) || (mVertexCount > 0 && mFaceCount > 0 ) );
+    assert( (mVertexCount == 0 && pVertexArray == NULL ) || pVertexArray != NULL );
+    assert( (mFaceCount   == 0 && indexCount == 0   ) || pIndexArray != NULL );
+    assert( (indexCount % 3 == 0 ) );
+
+    if ( mFaceCount > 0 )
+    {
+        uploadMesh( pRenderDevice, pVertexArray, vertexCount, pIndexArray, indexCount );
+    }
+
+    MeshLod wholeMesh = { 0, indexCount, 1.0f, 0.0f };
+    mLods.assign( 1, wholeMesh );
+
+    mBounds = BoundingVolume::FromPoints( pVertexArray != NULL ? &pVertexArray->pos : NULL,
+                                          vertexCount,
+                                          sizeof( StaticMeshVertex ) );
+}
+
+/**
+ * Static mesh constructor that places the mesh in a geometry pool, so that it
+ * can be drawn without rebinding buffers. Falls back to buffers of its own if
+ * the pool is full. The pool must outlive the mesh.
+ */
+StaticMesh::StaticMesh( GeometryPool * pGeometryPool,
+                        ID3D10Device * pRenderDevice,
+                        const StaticMeshVertex *pVertexArray,
+                        unsigned int vertexCount,
+                        const unsigned int * pIndexArray,
+                        unsigned int indexCount )
+    : StaticMesh()
 {
+    assert( pGeometryPool != NULL );
+    assert( pGeometryPool->VertexStride() == sizeof( StaticMeshVertex ) );
     assert( pRenderDevice != NULL );
-    assert( (mVertexCount == 0 && mFaceCount == 0        ) || (mVertexCount > 0 && mFaceCount > 0 ) );
-    assert( (mVertexCount == 0 && pVertexArray == NULL   ) || pVertexArray != NULL );
-    assert( (mFaceCount   == 0 && indexArray.size() == 0 ) || indexArray.size() > 0 );
-    assert( (mFaceCount % 3 == 0 ) );
+    assert( (indexCount % 3 == 0 ) );
+
+    mVertexCount = vertexCount;
+    mFaceCount   = indexCount / 3;
 
     if ( mFaceCount > 0 )
     {
-        uploadMesh( pRenderDevice, pVertexArray, vertexCount, indexArray );
+        mGeometryHandle = pGeometryPool->Upload( pRenderDevice, pVertexArray, vertexCount, pIndexArray, indexCount );
+
+        if ( mGeometryHandle != GeometryPool::INVALID_HANDLE )
+        {
+            mpGeometryPool = pGeometryPool;
+        }
+        else
+        {
+            LOG_WARN("StaticMesh") << "Geometry pool is full, mesh gets its own buffers";
+            uploadMesh( pRenderDevice, pVertexArray, vertexCount, pIndexArray, indexCount );
+        }
     }
+
+    MeshLod wholeMesh = { 0, indexCount, 1.0f, 0.0f };
+    mLods.assign( 1, wholeMesh );
+
+    mBounds = BoundingVolume::FromPoints( pVertexArray != NULL ? &pVertexArray->pos : NULL,
+                                          vertexCount,
+                                          sizeof( StaticMeshVertex ) );
+}
+
+/**
+ * Static mesh move constructor. Takes over the other mesh's buffers (or its
+ * slice of a geometry pool) and leaves it empty
+ */
+StaticMesh::StaticMesh( StaticMesh&& other )
+    : StaticMesh()
+{
+    swap( other );
+}
+
+/**
+ * Static mesh move assignment. This mesh's old buffers are released by the
+ * temporary it is swapped into
+ */
+StaticMesh& StaticMesh::operator =( StaticMesh&& other )
+{
+    StaticMesh moved( std::move( other ) );
+    swap( moved );
+
+    return *this;
 }
 
 /**
@@ -67,6 +168,65 @@ StaticMesh::StaticMesh( ID3D10Device * pRenderDevice,
  */
 StaticMesh::~StaticMesh()
 {
+    if ( mpGeometryPool != NULL )
+    {
+        mpGeometryPool->Free( mGeometryHandle );
+    }
+}
+
+/**
+ * Exchanges everything with another mesh
+ */
+void StaticMesh::swap( StaticMesh& other )
+{
+    std::swap( mVertexCount, other.mVertexCount );
+    std::swap( mFaceCount, other.mFaceCount );
+    mVertexBuffer.Swap( other.mVertexBuffer );
+    mIndexBuffer.Swap( other.mIndexBuffer );
+    std::swap( mpGeometryPool, other.mpGeometryPool );
+    std::swap( mGeometryHandle, other.mGeometryHandle );
+    mLods.swap( other.mLods );
+    std::swap( mBounds, other.mBounds );
+}
+
+/**
+ * Replaces the mesh's levels of detail. Every level must lie within the
+ * indices the mesh was created with
+ */
+void StaticMesh::setLods( const MeshLod * pLods, unsigned int lodCount )
+{
+    assert( pLods != NULL && lodCount > 0 );
+
+    for ( unsigned int i = 0; i < lodCount; ++i )
+    {
+        assert( pLods[i].firstIndex + pLods[i].indexCount <= mFaceCount * 3 );
+        assert( pLods[i].indexCount % 3 == 0 );
+    }
+
+    mLods.assign( pLods, pLods + lodCount );
+}
+
+void StaticMesh::setLods( const std::vector<MeshLod>& lods )
+{
+    setLods( lods.empty() ? NULL : &lods[0], static_cast<unsigned int>( lods.size() ) );
+}
+
+/**
+ * Picks the coarsest level of detail whose error will not show at a screen
+ * size
+ */
+unsigned int StaticMesh::selectLod( float screenSize ) const
+{
+    return SelectLod( &mLods[0], lodCount(), screenSize );
+}
+
+/**
+ * Returns where a pooled mesh lives in its geometry pool
+ */
+const GeometryRange& StaticMesh::geometryRange() const
+{
+    assert( mpGeometryPool != NULL );
+    return mpGeometryPool->Range( mGeometryHandle );
 }
 
 /**
@@ -76,10 +236,11 @@ StaticMesh::~StaticMesh()
 void StaticMesh::uploadMesh( ID3D10Device * pRenderDevice,
                              const StaticMeshVertex *pVertexArray,
                              unsigned int vertexCount,
-                             const std::vector<unsigned int>& indexArray )
+                             const unsigned int * pIndexArray,
+                             unsigned int indexCount )
 {
     assert( vertexCount > 0 );
-    assert( indexArray.size() > 0 && (indexArray.size() % 3) == 0 );
+    assert( indexCount > 0 && (indexCount % 3) == 0 );
 
     // Construct the vertex buffer by first describing its layout
     D3D10_BUFFER_DESC vbd;
@@ -98,14 +259,14 @@ void StaticMesh::uploadMesh( ID3D10Device * pRenderDevice,
     D3D10_BUFFER_DESC ibd;
     ZeroMemory( &ibd, sizeof(D3D10_BUFFER_DESC) );
 
-    vbd.Usage     = D3D10_USAGE_IMMUTABLE;
-    vbd.ByteWidth = sizeof(DWORD) * mFaceCount * 3;
-    vbd.BindFlags = D3D10_BIND_INDEX_BUFFER;
+    ibd.Usage     = D3D10_USAGE_IMMUTABLE;
+    ibd.ByteWidth = sizeof(DWORD) * mFaceCount * 3;
+    ibd.BindFlags = D3D10_BIND_INDEX_BUFFER;
     
     D3D10_SUBRESOURCE_DATA iInitData;
     ZeroMemory( &iInitData, sizeof(D3D10_SUBRESOURCE_DATA) );
 
-    iInitData.pSysMem = &indexArray[0];
+    iInitData.pSysMem = pIndexArray;
 
     // Now upload both the vertex buffer and index buffer
     HRESULT hr = pRenderDevice->CreateBuffer( &vbd, &vInitData, &mVertexBuffer );
@@ -122,20 +283,36 @@ void StaticMesh::uploadMesh( ID3D10Device * pRenderDevice,
 
     // Update the instance variables by replacing them with this mesh's values
     mVertexCount = vertexCount;
-    mFaceCount   = static_cast<unsigned int>( indexArray.size() / 3 );
+    mFaceCount   = indexCount / 3;
 }
 
 /**
  * Render dat mesh
  */
 void StaticMesh::draw( ID3D10Device * pDevice ) const
+{
+    draw( pDevice, 0 );
+}
+
+/**
+ * Render one level of detail of dat mesh
+ */
+void StaticMesh::draw( ID3D10Device * pDevice, unsigned int lod ) const
 {
     assert( pDevice != NULL );
+    assert( lod < mLods.size() );
+
+    const MeshLod& level = mLods[lod];
+    IndexRange indices = { level.firstIndex, level.indexCount };
 
     const unsigned int stride = sizeof( StaticMeshVertex );
     const unsigned int offset = 0;
 
-    if ( mFaceCount > 0 )
+    if ( mpGeometryPool != NULL )
+    {
+        mpGeometryPool->Draw( pDevice, mGeometryHandle, indices );
+    }
+    else if ( mFaceCount > 0 )
     {
         // Need to cast away const-ness when calling DirectX... /sigh
         ID3D10Buffer * pVertexBuffer = const_cast<ID3D10Buffer*>(mVertexBuffer.Get());
@@ -143,6 +320,52 @@ void StaticMesh::draw( ID3D10Device * pDevice ) const
 
         pDevice->IASetVertexBuffers( 0, 1, &pVertexBuffer, &stride, &offset );
         pDevice->IASetIndexBuffer( pIndexBuffer, DXGI_FORMAT_R32_UINT, 0 );
-        pDevice->DrawIndexed( mFaceCount * 3, 0, 0 );
+        pDevice->DrawIndexed( indices.indexCount, indices.firstIndex, 0 );
     }
-}
\ No newline at end of file
+}
+
+/**
+ * Render many copies of dat mesh in a single draw call. The mesh's vertices
+ * go in slot zero and the per instance stream in slot one.
+ */
+void StaticMesh::drawInstanced( ID3D10Device * pDevice,
+                                ID3D10Buffer * pInstanceBuffer,
+                                unsigned int instanceCount,
+                                unsigned int firstInstance,
+                                unsigned int lod ) const
+{
+    assert( pDevice != NULL );
+    assert( pInstanceBuffer != NULL );
+    assert( lod < mLods.size() );
+
+    const MeshLod& level = mLods[lod];
+    IndexRange indices = { level.firstIndex, level.indexCount };
+
+    const unsigned int strides[2] = { sizeof( StaticMeshVertex ), sizeof( StaticMeshInstance ) };
+    const unsigned int offsets[2] = { 0, 0 };
+
+    if ( mpGeometryPool != NULL && instanceCount > 0 )
+    {
+        mpGeometryPool->DrawInstanced( pDevice,
+                                       mGeometryHandle,
+                                       indices,
+                                       pInstanceBuffer,
+                                       sizeof( StaticMeshInstance ),
+                                       instanceCount,
+                                       firstInstance );
+    }
+    else if ( mFaceCount > 0 && instanceCount > 0 )
+    {
+        ID3D10Buffer * buffers[2] =
+        {
+            const_cast<ID3D10Buffer*>(mVertexBuffer.Get()),
+            pInstanceBuffer
+        };
+
+        ID3D10Buffer * pIndexBuffer = const_cast<ID3D10Buffer*>(mIndexBuffer.Get());
+
+        pDevice->IASetVertexBuffers( 0, 2, buffers, strides, offsets );
+        pDevice->IASetIndexBuffer( pIndexBuffer, DXGI_FORMAT_R32_UINT, 0 );
+        pDevice->DrawIndexedInstanced( indices.indexCount, instanceCount, indices.firstIndex, 0, firstInstance );
+    }
+}
@@ -0,0 +1,43 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef SCOTT_HAILSTORM_ALIGNED_BUFFER_H
+#define SCOTT_HAILSTORM_ALIGNED_BUFFER_H
+
+#include <cstddef>
+
+/**
+ * A heap buffer with a given alignment, eg for unbuffered reads (see AsyncFileReader) or for
+ * formats that are used in place once they are decompressed.
+ */
+class AlignedBuffer
+{
+public:
+    explicit AlignedBuffer(size_t size, size_t alignment);
+    AlignedBuffer(const AlignedBuffer&) = delete;
+    ~AlignedBuffer();
+
+    AlignedBuffer& operator =(const AlignedBuffer&) = delete;
+
+    unsigned char * Data() { return mpData; }
+    const unsigned char * Data() const { return mpData; }
+    size_t Size() const { return mSize; }
+
+private:
+    unsigned char * mpData;
+    size_t mSize;
+};
+
+#endif
@@ -0,0 +1,193 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef SCOTT_HAILSTORM_ASSET_ARCHIVE_H
+#define SCOTT_HAILSTORM_ASSET_ARCHIVE_H
+
+#include <string>
+#include <vector>
+
+#include "runtime/ByteSpan.h"
+#include "runtime/MappedFile.h"
+
+/**
+ * How an archive entry's bytes are stored.
+ */
+enum class ArchiveCompression : unsigned int
+{
+    None,
+    Lz                                  // An Lz frame (see Lz.h).
+};
+
+/**
+ * Table of contents entry for one file in an archive. Entries are sorted by pathHash.
+ */
+struct ArchiveEntry
+{
+    unsigned long long pathHash;        // AssetArchive::HashPath of the entry's path.
+    unsigned long long offset;          // Start of the stored bytes, from the start of the archive.
+    unsigned long long storedSize;      // Bytes stored in the archive.
+    unsigned long long size;            // Bytes once decompressed.
+    unsigned int nameOffset;            // Offset of the entry's null terminated path in the name table.
+    ArchiveCompression compression;
+    unsigned int reserved[2];
+};
+
+/**
+ * Header at the start of an archive. All offsets are from the start of the file.
+ *
+ * The table of contents is followed by a bucket table that indexes it by the top bits of the path
+ * hash: the entries for bucket b are [buckets[b], buckets[b + 1]). With at least as many buckets as
+ * entries a lookup only looks at one or two entries on average.
+ */
+struct ArchiveHeader
+{
+    unsigned int magic;
+    unsigned int version;
+    unsigned int headerSize;
+    unsigned int entryCount;
+    unsigned int bucketCount;           // A power of two.
+    unsigned int bucketShift;           // 64 - log2(bucketCount).
+    unsigned int alignment;             // Alignment of every entry's offset.
+    unsigned int reserved;
+
+    unsigned long long fileSize;
+    unsigned long long entriesOffset;   // entryCount ArchiveEntries.
+    unsigned long long bucketsOffset;   // bucketCount + 1 unsigned ints.
+    unsigned long long namesOffset;     // Null terminated entry paths.
+};
+
+/**
+ * Many asset files packed into one, so a game opens a single file at startup instead of one per
+ * asset. The archive is mapped into memory once, and entries are served as spans that point straight
+ * into the mapping without being copied. Entries are aligned (to 16 bytes by default), so formats that
+ * are used in place, like mesh files, work the same inside an archive as they do loose.
+ *
+ * Entries can also be compressed (see Lz), trading the zero copy span for a smaller archive. Their
+ * bytes have to be read out with Decompress.
+ *
+ * Entries are looked up by the hash of their path (see HashPath), which can be computed once ahead of
+ * time. Paths are normalized before hashing, so "Shaders\Cube.fx" and "shaders/cube.fx" are the same
+ * entry.
+ *
+ * Archives are written with AssetArchiveWriter.
+ */
+class AssetArchive
+{
+public:
+    AssetArchive();
+    AssetArchive(const AssetArchive&) = delete;
+    ~AssetArchive();
+
+    AssetArchive& operator =(const AssetArchive&) = delete;
+
+    // Map an archive. Returns false if it is missing, corrupt or an unsupported version, and sets
+    // ppReasonOut (if not null) to say why.
+    bool Open(const std::wstring& path, const char ** ppReasonOut = nullptr);
+
+    // Unmap the archive. Every span and entry pointer it handed out is invalid after this is called.
+    void Close();
+
+    bool IsOpen() const { return mpHeader != nullptr; }
+
+    // Find an entry by its path hash, or by its path. Returns null if there is no such entry. Looking
+    // up by path also checks the stored path, so it can't be fooled by a hash collision.
+    const ArchiveEntry * Find(unsigned long long pathHash) const;
+    const ArchiveEntry * Find(const std::string& path) const;
+    const ArchiveEntry * Find(const std::wstring& path) const;
+
+    // The bytes stored for an entry, as they are in the mapped archive.
+    ByteSpan Data(const ArchiveEntry& entry) const;
+
+    // Copy an entry's bytes, decompressing them if they are compressed, into pOut, which must hold
+    // entry.size bytes. Blocks of large entries are decompressed on threadCount threads (zero for one
+    // per hardware thread). Returns false if the entry is corrupt.
+    bool Decompress(const ArchiveEntry& entry, void * pOut, unsigned int threadCount = 1) const;
+
+    // The entry's normalized path.
+    const char * Name(const ArchiveEntry& entry) const;
+
+    unsigned int EntryCount() const;
+    const ArchiveEntry& Entry(unsigned int index) const;
+
+    // Read the whole archive, or one entry, in from disk now (see MappedFile::Prefetch).
+    void Prefetch() const;
+    void Prefetch(const ArchiveEntry& entry) const;
+
+    // Use forward slashes, remove "." and ".." parts and (unless asked not to) lower case the path. A
+    // ".." with no directory before it to cancel out is kept at the front.
+    static std::string NormalizePath(const std::string& path, bool lowerCase = true);
+    static std::string NormalizePath(const std::wstring& path, bool lowerCase = true);
+
+    // Hash of a normalized path.
+    static unsigned long long HashPath(const std::string& path);
+    static unsigned long long HashPath(const std::wstring& path);
+
+private:
+    MappedFile mFile;
+    const ArchiveHeader * mpHeader;
+    const ArchiveEntry * mpEntries;
+    const unsigned int * mpBuckets;
+};
+
+/**
+ * Collects files and writes them out as an archive.
+ */
+class AssetArchiveWriter
+{
+public:
+    static const unsigned int DEFAULT_ALIGNMENT = 16;
+
+    AssetArchiveWriter();
+    AssetArchiveWriter(const AssetArchiveWriter&) = delete;
+    ~AssetArchiveWriter();
+
+    AssetArchiveWriter& operator =(const AssetArchiveWriter&) = delete;
+
+    // Add a file, copying its bytes. Returns false if a file with the same normalized path (or the
+    // same path hash) was already added. Files added with compression are stored uncompressed anyway
+    // if compressing them hardly makes them smaller.
+    bool Add(
+        const std::string& path,
+        const void * pData,
+        size_t size,
+        ArchiveCompression compression = ArchiveCompression::None);
+
+    // Level that files are compressed at, from Lz::MIN_LEVEL to Lz::MAX_LEVEL.
+    void SetCompressionLevel(int level);
+    int CompressionLevel() const { return mCompressionLevel; }
+
+    unsigned int Count() const { return static_cast<unsigned int>(mFiles.size()); }
+
+    // Write every file added so far to an archive, with each entry's bytes aligned to alignment (a
+    // power of two). Files are compressed here, in parallel. The header is written last, so a partially
+    // written archive never opens. Returns false if the archive could not be written.
+    bool Write(const std::wstring& path, unsigned int alignment = DEFAULT_ALIGNMENT) const;
+
+private:
+    struct File
+    {
+        std::string path;
+        unsigned long long pathHash;
+        std::vector<unsigned char> data;
+        ArchiveCompression compression;
+    };
+
+private:
+    std::vector<File> mFiles;
+    int mCompressionLevel;
+};
+
+#endif
@@ -0,0 +1,135 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef SCOTT_HAILSTORM_ASYNC_FILE_READER_H
+#define SCOTT_HAILSTORM_ASYNC_FILE_READER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "runtime/AlignedBuffer.h"
+
+/**
+ * A read of part of a file into a buffer that the caller owns. The buffer has to stay alive until
+ * the read's completion is called.
+ */
+struct FileReadRequest
+{
+    std::wstring path;
+    unsigned long long offset;
+    void * pBuffer;
+    size_t size;                    // Bytes to read. Reads that run past the end of the file stop short.
+    void * pUserData;
+};
+
+/**
+ * How a read turned out.
+ */
+struct FileReadResult
+{
+    unsigned int index;             // Index of the request in the batch it was submitted with.
+    size_t bytesRead;
+    bool succeeded;
+};
+
+/**
+ * How an AsyncFileReader talks to the operating system.
+ */
+enum class FileReadMethod
+{
+    Threads,                        // Blocking reads on a pool of threads.
+    IoUring,                        // Linux io_uring.
+    Overlapped                      // Windows overlapped reads on an I/O completion port.
+};
+
+/**
+ * Settings for an AsyncFileReader.
+ */
+struct AsyncFileReaderParams
+{
+    AsyncFileReaderParams();
+
+    bool useKernelQueue;            // Use io_uring or overlapped I/O where available, not threads.
+    unsigned int queueDepth;        // Most reads in flight at once.
+    unsigned int threadCount;       // Threads used when reads are done on threads.
+    bool unbuffered;                // Bypass the OS file cache. See AsyncFileReader.
+};
+
+/**
+ * Reads batches of files in the background, keeping many reads in flight at once so the disk can
+ * reorder and overlap them, rather than opening and reading one file at a time.
+ *
+ * On Linux reads are queued with io_uring, falling back to a pool of threads doing blocking reads
+ * if the kernel doesn't support it. On Windows reads are overlapped and finish on an I/O completion
+ * port.
+ *
+ * Each read's completion is called on one of the reader's threads as soon as that read finishes,
+ * so reads in a batch can complete in any order. Completions are never called at the same time as
+ * each other, but must not block for long.
+ *
+ * Unbuffered reads skip the file cache, which is useful for measuring the disk itself. Their
+ * buffers, offsets and sizes must be multiples of BUFFER_ALIGNMENT.
+ */
+class AsyncFileReader
+{
+public:
+    static const size_t BUFFER_ALIGNMENT = 4096;
+
+    typedef std::function<void(const FileReadRequest&, const FileReadResult&)> Completion;
+
+    explicit AsyncFileReader(const AsyncFileReaderParams& params = AsyncFileReaderParams());
+    AsyncFileReader(const AsyncFileReader&) = delete;
+    ~AsyncFileReader();
+
+    AsyncFileReader& operator =(const AsyncFileReader&) = delete;
+
+    // Start reading a batch of files. The requests are copied.
+    void Submit(const std::vector<FileReadRequest>& requests, const Completion& onComplete);
+
+    // Block until every read that was submitted has completed.
+    void WaitIdle();
+
+    FileReadMethod Method() const { return mMethod; }
+    const char * MethodName() const;
+
+    unsigned int PendingCount() const;
+    unsigned long long BytesRead() const { return mBytesRead; }
+
+private:
+    struct Batch;
+    class Backend;
+    class ThreadBackend;
+    class IoUringBackend;
+    class OverlappedBackend;
+
+    void Finish(const std::shared_ptr<Batch>& pBatch, unsigned int index, size_t bytesRead, bool succeeded);
+
+private:
+    std::unique_ptr<Backend> mpBackend;
+    FileReadMethod mMethod;
+    mutable std::mutex mLock;
+    std::condition_variable mIdle;
+    unsigned int mPendingCount;
+    std::mutex mCompletionLock;             // Keeps completions from running at the same time.
+    std::atomic<unsigned long long> mBytesRead;
+};
+
+#endif
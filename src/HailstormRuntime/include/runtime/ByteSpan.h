@@ -0,0 +1,47 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef SCOTT_HAILSTORM_BYTE_SPAN_H
+#define SCOTT_HAILSTORM_BYTE_SPAN_H
+
+#include <cstddef>
+
+/**
+ * A read only view of bytes owned by something else, eg a mapped file or an archive. The view is only
+ * valid for as long as its owner keeps the bytes alive.
+ */
+struct ByteSpan
+{
+    const unsigned char * pData;
+    size_t size;
+
+    ByteSpan()
+        : pData(nullptr),
+          size(0)
+    {
+    }
+
+    ByteSpan(const void * pBytes, size_t byteCount)
+        : pData(static_cast<const unsigned char *>(pBytes)),
+          size(byteCount)
+    {
+    }
+
+    bool IsEmpty() const { return size == 0; }
+    const unsigned char * begin() const { return pData; }
+    const unsigned char * end() const { return pData + size; }
+};
+
+#endif
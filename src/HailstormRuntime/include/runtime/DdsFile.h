@@ -0,0 +1,239 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef SCOTT_HAILSTORM_DDS_FILE_H
+#define SCOTT_HAILSTORM_DDS_FILE_H
+
+#include <string>
+#include <vector>
+
+#include "runtime/ByteSpan.h"
+#include "runtime/MappedFile.h"
+
+/**
+ * Texel formats that a DDS file can hold. The values match DXGI_FORMAT, so a format can be cast
+ * straight to one when creating a texture, but this header does not need any DirectX headers.
+ */
+enum class TextureFormat : unsigned int
+{
+    Unknown = 0,
+    R32G32B32A32Float = 2,
+    R16G16B16A16Float = 10,
+    R16G16B16A16Unorm = 11,
+    R32G32Float = 16,
+    R10G10B10A2Unorm = 24,
+    R8G8B8A8Unorm = 28,
+    R8G8B8A8UnormSrgb = 29,
+    R16G16Float = 34,
+    R16G16Unorm = 35,
+    R32Float = 41,
+    R8G8Unorm = 49,
+    R16Float = 54,
+    R16Unorm = 56,
+    R8Unorm = 61,
+    A8Unorm = 65,
+    Bc1Unorm = 71,
+    Bc1UnormSrgb = 72,
+    Bc2Unorm = 74,
+    Bc2UnormSrgb = 75,
+    Bc3Unorm = 77,
+    Bc3UnormSrgb = 78,
+    Bc4Unorm = 80,
+    Bc4Snorm = 81,
+    Bc5Unorm = 83,
+    Bc5Snorm = 84,
+    B5G6R5Unorm = 85,
+    B5G5R5A1Unorm = 86,
+    B8G8R8A8Unorm = 87,
+    B8G8R8X8Unorm = 88,
+    B8G8R8A8UnormSrgb = 91,
+    B8G8R8X8UnormSrgb = 93,
+    Bc6hUf16 = 95,
+    Bc6hSf16 = 96,
+    Bc7Unorm = 98,
+    Bc7UnormSrgb = 99
+};
+
+namespace TextureFormats
+{
+    // Check if a format is one that DdsFile can read.
+    bool IsSupported(TextureFormat format);
+
+    // Check if a format is stored in 4x4 blocks (BC1 to BC7).
+    bool IsBlockCompressed(TextureFormat format);
+
+    // Bytes in one block of a block compressed format, or one texel of any other format. Zero for
+    // unsupported formats.
+    unsigned int ElementSize(TextureFormat format);
+
+    // Bytes in one row of blocks (or texels) of a surface, and the number of such rows.
+    void SurfacePitch(TextureFormat format, unsigned int width, unsigned int height, size_t * pRowPitchOut, unsigned int * pRowCountOut);
+
+    const char * Name(TextureFormat format);
+}
+
+/**
+ * The pixel format block of a DDS header, which describes the format of files without a DX10 header.
+ */
+struct DdsPixelFormat
+{
+    unsigned int size;
+    unsigned int flags;
+    unsigned int fourCC;
+    unsigned int rgbBitCount;
+    unsigned int rBitMask;
+    unsigned int gBitMask;
+    unsigned int bBitMask;
+    unsigned int aBitMask;
+};
+
+/**
+ * Header following the "DDS " magic number at the start of every DDS file.
+ */
+struct DdsHeader
+{
+    unsigned int size;
+    unsigned int flags;
+    unsigned int height;
+    unsigned int width;
+    unsigned int pitchOrLinearSize;
+    unsigned int depth;
+    unsigned int mipMapCount;
+    unsigned int reserved1[11];
+    DdsPixelFormat pixelFormat;
+    unsigned int caps;
+    unsigned int caps2;
+    unsigned int caps3;
+    unsigned int caps4;
+    unsigned int reserved2;
+};
+
+/**
+ * Extra header that follows DdsHeader when the pixel format's four character code is "DX10". It
+ * gives the format as a DXGI_FORMAT and allows texture arrays.
+ */
+struct DdsHeaderDx10
+{
+    unsigned int dxgiFormat;
+    unsigned int resourceDimension;     // A D3D10_RESOURCE_DIMENSION.
+    unsigned int miscFlag;
+    unsigned int arraySize;
+    unsigned int miscFlags2;
+};
+
+/**
+ * One mip level of one item of a texture, pointing into the file's bytes.
+ */
+struct DdsSurface
+{
+    ByteSpan data;
+    unsigned int width;
+    unsigned int height;
+    unsigned int depth;
+    size_t rowPitch;                    // Bytes between rows of blocks (or texels).
+    size_t slicePitch;                  // Bytes between depth slices.
+};
+
+/**
+ * A DDS texture read in place, from a mapped file or from bytes already in memory such as an entry in
+ * a mapped AssetArchive.
+ *
+ * Opening checks the header (either the legacy DX9 form or the DX10 extension), works out the format,
+ * dimensions, mip chain and array size, and checks that the file is long enough for every surface.
+ * Nothing is copied: each surface is a span of the original bytes, so it can be handed straight to
+ * the graphics device. Neither this class nor anything it uses needs a device, so parsing can be done
+ * (and tested) on any platform.
+ *
+ * Surfaces are stored item by item, and each item holds its full mip chain from the largest mip down.
+ * Cube maps have six items per cube, in +x, -x, +y, -y, +z, -z order.
+ */
+class DdsFile
+{
+public:
+    static const unsigned int MAGIC = 0x20534444;   // "DDS "
+    static const unsigned int MAX_DIMENSION = 16384;
+    static const unsigned int MAX_ARRAY_SIZE = 2048;
+
+    DdsFile();
+    DdsFile(const DdsFile&) = delete;
+    ~DdsFile();
+
+    DdsFile& operator =(const DdsFile&) = delete;
+
+    // Map a DDS file. Returns false, with the reason in ppReasonOut, if it is missing, corrupt or in
+    // a format that isn't supported.
+    bool Open(const std::wstring& path, const char ** ppReasonOut = nullptr);
+
+    // Open a DDS file that is already in memory. The bytes are used in place, so they must outlive
+    // the DdsFile (or its next Close). They need no particular alignment.
+    bool Open(const ByteSpan& data, const char ** ppReasonOut = nullptr);
+
+    void Close();
+
+    bool IsOpen() const { return !mData.IsEmpty(); }
+
+    TextureFormat Format() const { return mFormat; }
+    unsigned int Width() const { return mWidth; }
+    unsigned int Height() const { return mHeight; }
+    unsigned int Depth() const { return mDepth; }
+    unsigned int MipCount() const { return mMipCount; }
+    unsigned int ItemCount() const { return mItemCount; }          // Array size, times six for cube maps.
+    bool IsCubeMap() const { return mIsCubeMap; }
+    bool IsVolume() const { return mDepth > 1; }
+    bool HasDx10Header() const { return mHasDx10Header; }
+
+    unsigned int MipWidth(unsigned int mip) const;
+    unsigned int MipHeight(unsigned int mip) const;
+    unsigned int MipDepth(unsigned int mip) const;
+
+    // A single mip level of a single item.
+    DdsSurface Surface(unsigned int item, unsigned int mip) const;
+
+    // Bytes in a mip level of one item, and in a mip level summed over every item.
+    size_t MipSize(unsigned int mip) const;
+    size_t LevelSize(unsigned int mip) const { return MipSize(mip) * mItemCount; }
+
+    // Bytes of texel data in the whole file.
+    size_t DataSize() const { return mItemSize * mItemCount; }
+
+    const DdsHeader& Header() const { return mHeader; }
+    ByteSpan Data() const { return mData; }
+
+    // Read a mip level of every item in from disk now, rather than when it is first used.
+    void Prefetch(unsigned int mip) const;
+
+private:
+    bool Attach(const ByteSpan& data, const char ** ppReasonOut);
+    bool ReadLegacyFormat(const char ** ppReasonOut);
+    bool ReadDx10Header(const DdsHeaderDx10& header, const char ** ppReasonOut);
+
+private:
+    MappedFile mFile;
+    ByteSpan mData;
+    DdsHeader mHeader;
+    TextureFormat mFormat;
+    unsigned int mWidth;
+    unsigned int mHeight;
+    unsigned int mDepth;
+    unsigned int mMipCount;
+    unsigned int mItemCount;
+    bool mIsCubeMap;
+    bool mHasDx10Header;
+    size_t mDataOffset;                     // Offset of the first surface, just past the headers.
+    size_t mItemSize;                       // Bytes in one item's mip chain.
+    std::vector<size_t> mMipOffsets;        // Offset of each mip within an item, plus the item's size.
+};
+
+#endif
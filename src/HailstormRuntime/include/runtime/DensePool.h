@@ -0,0 +1,293 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef SCOTT_HAILSTORM_DENSE_POOL_H
+#define SCOTT_HAILSTORM_DENSE_POOL_H
+
+#include <utility>
+#include <vector>
+
+#include "runtime/debugging.h"
+
+/**
+ * A 32 bit reference to an object in a DensePool. The low bits pick a slot in the pool and the high
+ * bits hold the slot's generation, which changes every time the slot's object is removed, so a handle
+ * to a removed object never finds whatever later reuses the slot.
+ *
+ * Generations start at one, which leaves a value of zero free for the null handle.
+ */
+template<typename T>
+class Handle
+{
+public:
+    enum
+    {
+        INDEX_BITS = 20,
+        GENERATION_BITS = 12,
+        MAX_INDEX = (1 << INDEX_BITS) - 1,
+        MAX_GENERATION = (1 << GENERATION_BITS) - 1
+    };
+
+    Handle() : mValue(0) { }
+
+    Handle(unsigned int index, unsigned int generation)
+        : mValue((generation << INDEX_BITS) | index)
+    {
+        assert(index <= MAX_INDEX);
+        assert(generation > 0 && generation <= MAX_GENERATION);
+    }
+
+    unsigned int Index() const { return mValue & MAX_INDEX; }
+    unsigned int Generation() const { return mValue >> INDEX_BITS; }
+    unsigned int Value() const { return mValue; }
+
+    // Null handles never refer to anything. A handle that is not null may still be stale.
+    bool IsNull() const { return mValue == 0; }
+
+    bool operator ==(const Handle& other) const { return mValue == other.mValue; }
+    bool operator !=(const Handle& other) const { return mValue != other.mValue; }
+    bool operator <(const Handle& other) const { return mValue < other.mValue; }
+
+private:
+    unsigned int mValue;
+};
+
+/**
+ * Stores objects contiguously in one array and hands out generational handles to them. Looking up a
+ * handle is two array reads and a compare, and stale handles (to removed objects) are detected by the
+ * compare rather than by reference counting.
+ *
+ * Objects are kept packed at the front of the array in no particular order: removing one moves the
+ * last object into its place. Loops over every object should walk Data() to Data() + Count(), or
+ * begin() to end(), which touches nothing but the objects themselves. Handles go through a slot
+ * table that tracks where each object currently is, so handles stay valid while objects move, but
+ * pointers and references to objects do not survive an Insert or Remove.
+ *
+ * Objects can also be retired rather than removed. A retired object's handle goes stale straight away,
+ * but the object itself lives on, out of the array, until DestroyRetired is called for a frame at or
+ * after the one it was retired in. This is for objects that the GPU may still be reading.
+ *
+ * T must be movable. Slots whose generation runs out are never reused, so after about four thousand
+ * removals of objects in the same slot the slot is abandoned rather than risk a stale handle matching.
+ */
+template<typename T>
+class DensePool
+{
+public:
+    typedef ::Handle<T> HandleType;
+
+    DensePool()
+        : mObjects(), mDenseToSlot(), mSlots(), mFreeSlots(), mRetired(), mRetiredFrames()
+    {
+    }
+
+    DensePool(const DensePool&) = delete;
+    DensePool& operator =(const DensePool&) = delete;
+
+    // Move an object into the pool. Returns a null handle if every slot is in use.
+    HandleType Insert(T&& object)
+    {
+        unsigned int slot = 0;
+
+        if (!mFreeSlots.empty())
+        {
+            slot = mFreeSlots.back();
+            mFreeSlots.pop_back();
+        }
+        else if (mSlots.size() <= HandleType::MAX_INDEX)
+        {
+            Slot newSlot = { NO_OBJECT, 1 };
+
+            slot = static_cast<unsigned int>(mSlots.size());
+            mSlots.push_back(newSlot);
+        }
+        else
+        {
+            return HandleType();
+        }
+
+        mSlots[slot].denseIndex = static_cast<unsigned int>(mObjects.size());
+        mObjects.push_back(std::move(object));
+        mDenseToSlot.push_back(slot);
+
+        return HandleType(slot, mSlots[slot].generation);
+    }
+
+    // Destroy an object straight away. Returns false if the handle was already stale.
+    bool Remove(HandleType handle)
+    {
+        unsigned int denseIndex = FindDenseIndex(handle);
+
+        if (denseIndex == NO_OBJECT)
+        {
+            return false;
+        }
+
+        FreeSlot(handle.Index());
+        RemoveDense(denseIndex);
+
+        return true;
+    }
+
+    // Take an object out of the pool and keep it alive until DestroyRetired(frame) or later. Its
+    // handle is stale from now on. Returns false if the handle was already stale.
+    bool Retire(HandleType handle, unsigned int frame)
+    {
+        unsigned int denseIndex = FindDenseIndex(handle);
+
+        if (denseIndex == NO_OBJECT)
+        {
+            return false;
+        }
+
+        assert(mRetiredFrames.empty() || mRetiredFrames.back() <= frame);
+
+        mRetired.push_back(std::move(mObjects[denseIndex]));
+        mRetiredFrames.push_back(frame);
+
+        FreeSlot(handle.Index());
+        RemoveDense(denseIndex);
+
+        return true;
+    }
+
+    // Destroy every object retired at or before a frame. Returns the number destroyed.
+    unsigned int DestroyRetired(unsigned int frame)
+    {
+        // Objects are retired in frame order, so the ones due are all at the front.
+        size_t dueCount = 0;
+
+        while (dueCount < mRetiredFrames.size() && mRetiredFrames[dueCount] <= frame)
+        {
+            ++dueCount;
+        }
+
+        mRetired.erase(mRetired.begin(), mRetired.begin() + dueCount);
+        mRetiredFrames.erase(mRetiredFrames.begin(), mRetiredFrames.begin() + dueCount);
+
+        return static_cast<unsigned int>(dueCount);
+    }
+
+    // Destroy every object, live and retired. Every handle goes stale.
+    void Clear()
+    {
+        for (size_t denseIndex = 0; denseIndex < mDenseToSlot.size(); ++denseIndex)
+        {
+            FreeSlot(mDenseToSlot[denseIndex]);
+        }
+
+        mObjects.clear();
+        mDenseToSlot.clear();
+        mRetired.clear();
+        mRetiredFrames.clear();
+    }
+
+    // The object a handle refers to, or null if the handle is null or stale.
+    T * Get(HandleType handle)
+    {
+        unsigned int denseIndex = FindDenseIndex(handle);
+        return denseIndex != NO_OBJECT ? &mObjects[denseIndex] : nullptr;
+    }
+
+    const T * Get(HandleType handle) const
+    {
+        unsigned int denseIndex = FindDenseIndex(handle);
+        return denseIndex != NO_OBJECT ? &mObjects[denseIndex] : nullptr;
+    }
+
+    bool Contains(HandleType handle) const { return FindDenseIndex(handle) != NO_OBJECT; }
+
+    // Handle of the object at a position in the dense array.
+    HandleType HandleAt(unsigned int denseIndex) const
+    {
+        assert(denseIndex < mDenseToSlot.size());
+
+        unsigned int slot = mDenseToSlot[denseIndex];
+        return HandleType(slot, mSlots[slot].generation);
+    }
+
+    unsigned int Count() const { return static_cast<unsigned int>(mObjects.size()); }
+    unsigned int RetiredCount() const { return static_cast<unsigned int>(mRetired.size()); }
+    bool IsEmpty() const { return mObjects.empty(); }
+
+    T * Data() { return mObjects.empty() ? nullptr : &mObjects[0]; }
+    const T * Data() const { return mObjects.empty() ? nullptr : &mObjects[0]; }
+
+    T * begin() { return Data(); }
+    T * end() { return Data() + mObjects.size(); }
+    const T * begin() const { return Data(); }
+    const T * end() const { return Data() + mObjects.size(); }
+
+private:
+    enum
+    {
+        NO_OBJECT = 0xFFFFFFFF
+    };
+
+    struct Slot
+    {
+        unsigned int denseIndex;    // NO_OBJECT while the slot is free.
+        unsigned int generation;    // Generation of the handle to the slot's current object.
+    };
+
+    unsigned int FindDenseIndex(HandleType handle) const
+    {
+        unsigned int slot = handle.Index();
+
+        if (slot >= mSlots.size() || mSlots[slot].generation != handle.Generation())
+        {
+            return NO_OBJECT;
+        }
+
+        return mSlots[slot].denseIndex;
+    }
+
+    void FreeSlot(unsigned int slot)
+    {
+        mSlots[slot].denseIndex = NO_OBJECT;
+        mSlots[slot].generation++;
+
+        if (mSlots[slot].generation <= HandleType::MAX_GENERATION)
+        {
+            mFreeSlots.push_back(slot);
+        }
+    }
+
+    // Fill the hole at denseIndex with the last object, and point its slot at the new position.
+    void RemoveDense(unsigned int denseIndex)
+    {
+        unsigned int lastIndex = static_cast<unsigned int>(mObjects.size()) - 1;
+
+        if (denseIndex != lastIndex)
+        {
+            mObjects[denseIndex] = std::move(mObjects[lastIndex]);
+            mDenseToSlot[denseIndex] = mDenseToSlot[lastIndex];
+            mSlots[mDenseToSlot[denseIndex]].denseIndex = denseIndex;
+        }
+
+        mObjects.pop_back();
+        mDenseToSlot.pop_back();
+    }
+
+private:
+    std::vector<T> mObjects;
+    std::vector<unsigned int> mDenseToSlot;
+    std::vector<Slot> mSlots;
+    std::vector<unsigned int> mFreeSlots;
+    std::vector<T> mRetired;
+    std::vector<unsigned int> mRetiredFrames;
+};
+
+#endif
@@ -0,0 +1,105 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef SCOTT_HAILSTORM_FILE_SYSTEM_BACKENDS_H
+#define SCOTT_HAILSTORM_FILE_SYSTEM_BACKENDS_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "runtime/AssetArchive.h"
+#include "runtime/VirtualFileSystem.h"
+
+/**
+ * Reads loose files from a directory on disk. Each file is mapped into memory when it is opened.
+ */
+class DirectoryBackend : public FileSystemBackend
+{
+public:
+    explicit DirectoryBackend(const std::wstring& directory);
+
+    virtual bool Open(const VirtualPath& path, VirtualFile * pFileOut) const override;
+    virtual bool Exists(const VirtualPath& path) const override;
+    virtual const char * TypeName() const override { return "directory"; }
+
+    const std::wstring& Directory() const { return mDirectory; }
+
+private:
+    std::wstring NativePath(const VirtualPath& path) const;
+
+private:
+    std::wstring mDirectory;
+};
+
+/**
+ * Reads files out of an archive (see AssetArchive), which is mapped once when the backend is opened.
+ * Files are looked up by their path hash and served straight from the mapping, except for compressed
+ * files, which are decompressed into memory owned by the opened file. A compressed file that turns
+ * out to be corrupt fails to open.
+ */
+class ArchiveBackend : public FileSystemBackend
+{
+public:
+    ArchiveBackend();
+
+    // Map the archive. Returns false (and sets ppReasonOut, if not null) if it could not be opened.
+    bool Open(const std::wstring& archivePath, const char ** ppReasonOut = nullptr);
+
+    virtual bool Open(const VirtualPath& path, VirtualFile * pFileOut) const override;
+    virtual bool Exists(const VirtualPath& path) const override;
+    virtual const char * TypeName() const override { return "archive"; }
+
+    const AssetArchive& Archive() const { return mArchive; }
+
+private:
+    const ArchiveEntry * Find(const VirtualPath& path) const;
+
+private:
+    AssetArchive mArchive;
+};
+
+/**
+ * Serves files from memory, eg generated content or files embedded in the executable. Add every file
+ * before mounting the backend, because adding a file invalidates files opened from it.
+ */
+class MemoryBackend : public FileSystemBackend
+{
+public:
+    MemoryBackend();
+
+    // Add a file, copying its bytes. A file already at the same path is replaced.
+    void Add(const std::string& path, const void * pData, size_t size);
+
+    virtual bool Open(const VirtualPath& path, VirtualFile * pFileOut) const override;
+    virtual bool Exists(const VirtualPath& path) const override;
+    virtual const char * TypeName() const override { return "memory"; }
+
+    unsigned int Count() const { return static_cast<unsigned int>(mFiles.size()); }
+
+private:
+    struct File
+    {
+        std::string path;
+        std::vector<unsigned char> data;
+    };
+
+    const File * Find(const VirtualPath& path) const;
+
+private:
+    std::map<unsigned long long, File> mFiles;      // Keyed by path hash.
+};
+
+#endif
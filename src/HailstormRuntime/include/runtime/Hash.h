@@ -0,0 +1,45 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef SCOTT_HAILSTORM_HASH_H
+#define SCOTT_HAILSTORM_HASH_H
+
+#include <cstddef>
+#include <string>
+
+namespace Hash
+{
+    // Starting value for a new FNV-1a hash.
+    const unsigned long long FNV1A_64_OFFSET = 14695981039346656037ull;
+
+    /**
+     * 64 bit FNV-1a hash of a block of memory. Pass the result of a previous call as the starting hash
+     * to hash several blocks as if they were one. The result is stable across runs and platforms, which
+     * makes it suitable for identifying data saved to disk.
+     */
+    unsigned long long Fnv1a64(const void * pData, size_t size, unsigned long long hash = FNV1A_64_OFFSET);
+
+    // Hash a single value by its bytes. Only use this with types that have no padding.
+    template<typename T>
+    unsigned long long Fnv1a64Value(const T& value, unsigned long long hash = FNV1A_64_OFFSET)
+    {
+        return Fnv1a64(&value, sizeof(T), hash);
+    }
+
+    // Hash the characters of a string.
+    unsigned long long Fnv1a64(const std::string& text, unsigned long long hash = FNV1A_64_OFFSET);
+}
+
+#endif
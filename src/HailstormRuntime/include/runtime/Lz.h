@@ -0,0 +1,171 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef SCOTT_HAILSTORM_LZ_H
+#define SCOTT_HAILSTORM_LZ_H
+
+#include <cstddef>
+#include <vector>
+
+#include "runtime/ByteSpan.h"
+
+/**
+ * Header at the start of a compressed frame (see Lz).
+ *
+ * The header is followed by blockCount blocks, each of them an unsigned int holding the block's stored
+ * size and then its bytes. Blocks are compressed independently of each other. Every block but the
+ * last decompresses to blockSize bytes. A block whose stored size has LZ_RAW_BLOCK_FLAG set is stored
+ * as it is, because compressing it did not make it smaller.
+ */
+struct LzFrameHeader
+{
+    unsigned int magic;
+    unsigned int version;
+    unsigned int blockSize;
+    unsigned int blockCount;
+    unsigned long long size;            // Bytes once decompressed.
+    unsigned int level;                 // Level the frame was compressed at, for information only.
+    unsigned int reserved;
+};
+
+const unsigned int LZ_RAW_BLOCK_FLAG = 0x80000000u;
+
+/**
+ * Settings for compressing a frame.
+ */
+struct LzParams
+{
+    LzParams();
+
+    int level;                          // From Lz::MIN_LEVEL (fastest) to Lz::MAX_LEVEL (smallest).
+    unsigned int blockSize;             // Bytes per block. Smaller blocks decompress in parallel better.
+    unsigned int threadCount;           // Threads to compress blocks with, zero for one per hardware thread.
+};
+
+/**
+ * A byte oriented LZ77 compressor in the same family as LZ4, tuned for decompression speed rather than
+ * ratio. Assets are compressed once, offline, so the packer can spend as long as it likes finding
+ * matches, while decompression is a tight loop of copies with no entropy coding.
+ *
+ * Blocks use the LZ4 block format: sequences of a token byte, literals, a two byte offset back into a
+ * 64 KB window and a match length. Higher levels only change how hard the compressor searches, so
+ * every level decompresses at the same speed.
+ *
+ * Decompression checks every length and offset against the input and output buffers, so corrupt data
+ * makes it fail rather than read or write out of bounds.
+ */
+namespace Lz
+{
+    const int MIN_LEVEL = 1;
+    const int MAX_LEVEL = 9;
+    const int DEFAULT_LEVEL = 6;
+
+    const unsigned int DEFAULT_BLOCK_SIZE = 256 * 1024;
+    const unsigned int MAX_BLOCK_SIZE = 4 * 1024 * 1024;
+
+    // Largest size that size bytes can grow to when compressed as one block.
+    size_t CompressBlockBound(size_t size);
+
+    // Compress one block into pOut, which must hold at least CompressBlockBound(size) bytes. size must be
+    // at most MAX_BLOCK_SIZE. Returns the compressed size, which may be larger than size.
+    size_t CompressBlock(const void * pData, size_t size, void * pOut, int level);
+
+    // Decompress one block that decompresses to exactly size bytes. Returns false if the block is
+    // corrupt.
+    bool DecompressBlock(const void * pData, size_t storedSize, void * pOut, size_t size);
+
+    // Compress a buffer into a frame, appending it to pFrameOut.
+    void Compress(const void * pData, size_t size, const LzParams& params, std::vector<unsigned char> * pFrameOut);
+
+    // Read and check a frame's header. Returns false if the bytes are not a frame.
+    bool ReadHeader(const ByteSpan& frame, LzFrameHeader * pHeaderOut);
+
+    // Decompress a whole frame into pOut, which must hold exactly the frame's size. Blocks are spread
+    // across threadCount threads (zero for one per hardware thread). Returns false if the frame is
+    // corrupt or its size is not size.
+    bool Decompress(const ByteSpan& frame, void * pOut, size_t size, unsigned int threadCount = 1);
+}
+
+/**
+ * Compresses data as it arrives into a frame, one block at a time, without needing all of the data
+ * up front. The frame's header is filled in by Finish.
+ */
+class LzStreamWriter
+{
+public:
+    explicit LzStreamWriter(std::vector<unsigned char> * pFrameOut, int level = Lz::DEFAULT_LEVEL, unsigned int blockSize = Lz::DEFAULT_BLOCK_SIZE);
+    LzStreamWriter(const LzStreamWriter&) = delete;
+
+    LzStreamWriter& operator =(const LzStreamWriter&) = delete;
+
+    void Write(const void * pData, size_t size);
+
+    // Compress whatever is left and write the header. Nothing can be written after this.
+    void Finish();
+
+private:
+    void FlushBlock();
+
+private:
+    std::vector<unsigned char> * mpFrame;
+    size_t mHeaderOffset;
+    int mLevel;
+    unsigned int mBlockSize;
+    unsigned int mBlockCount;
+    unsigned long long mSize;
+    std::vector<unsigned char> mBlock;
+    std::vector<unsigned char> mCompressed;
+    bool mFinished;
+};
+
+/**
+ * Decompresses a frame a piece at a time, holding no more than one decompressed block in memory, eg
+ * to stream a large asset into a fixed size upload buffer.
+ */
+class LzStreamReader
+{
+public:
+    LzStreamReader();
+    LzStreamReader(const LzStreamReader&) = delete;
+
+    LzStreamReader& operator =(const LzStreamReader&) = delete;
+
+    // Start reading a frame, which has to stay alive while it is read. Returns false if it is not a
+    // frame.
+    bool Open(const ByteSpan& frame);
+
+    // Decompress up to size bytes into pOut. Returns the number of bytes read, which is less than size
+    // only at the end of the frame or if the frame is corrupt (see IsCorrupt).
+    size_t Read(void * pOut, size_t size);
+
+    unsigned long long Size() const { return mHeader.size; }
+    unsigned long long Position() const { return mPosition; }
+    bool IsCorrupt() const { return mIsCorrupt; }
+
+private:
+    bool DecodeNextBlock();
+
+private:
+    ByteSpan mFrame;
+    LzFrameHeader mHeader;
+    size_t mNextBlockOffset;
+    unsigned int mNextBlock;
+    std::vector<unsigned char> mBlock;
+    size_t mBlockPosition;
+    unsigned long long mPosition;
+    bool mIsCorrupt;
+};
+
+#endif
@@ -0,0 +1,65 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef SCOTT_HAILSTORM_MAPPED_FILE_H
+#define SCOTT_HAILSTORM_MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+
+/**
+ * Read only view of an entire file mapped into memory. Pages are loaded by the operating system on
+ * first touch, so opening a file is cheap and data can be handed straight to consumers (eg a vertex
+ * buffer upload) without first being copied into an intermediate buffer.
+ *
+ * The view stays valid until the file is closed or the MappedFile is destroyed.
+ */
+class MappedFile
+{
+public:
+    MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    ~MappedFile();
+
+    MappedFile& operator =(const MappedFile&) = delete;
+
+    // Map a file into memory. Returns false if the file does not exist or could not be mapped.
+    bool Open(const std::wstring& path);
+
+    // Unmap the file.
+    void Close();
+
+    // Touch every page of the file so that it is read from disk now, on the calling thread, rather
+    // than when the data is first used. Useful for loading files from a background thread.
+    void Prefetch() const;
+
+    // Touch every page of a range of mapped memory, eg one entry in a mapped archive.
+    static void Prefetch(const void * pData, size_t size);
+
+    bool IsOpen() const { return mpData != nullptr; }
+    const unsigned char * Data() const { return mpData; }
+    size_t Size() const { return mSize; }
+
+private:
+    const unsigned char * mpData;
+    size_t mSize;
+
+#if defined(_WIN32)
+    void * mFileHandle;
+    void * mMappingHandle;
+#endif
+};
+
+#endif
@@ -0,0 +1,123 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef SCOTT_HAILSTORM_NOISE_H
+#define SCOTT_HAILSTORM_NOISE_H
+
+namespace Noise
+{
+    /**
+     * The basis function that is sampled by the noise generator. All of them return values in the
+     * range [-1, 1].
+     */
+    enum class NoiseBasis
+    {
+        Value,          // Interpolated random lattice values.
+        Perlin,         // Classic gradient noise.
+        Simplex,        // Gradient noise on a simplex (triangle) grid.
+        Worley          // Distance to the closest cellular feature point (F1).
+    };
+
+    /**
+     * How individual octaves of noise are combined into a single fractal value. Octaves are summed
+     * without being normalized, so with G the sum of the octave amplitudes (1 + gain + gain^2 + ...,
+     * just under 2 for the default six octaves at gain 0.5) the fractal value, before amplitude and
+     * bias are applied, lies in:
+     *
+     *   Fbm:    [-G, G]
+     *   Ridged: [0, ridgeOffset^2 * G], for a ridgeOffset of at least 1
+     */
+    enum class FractalType
+    {
+        Fbm,            // Fractional brownian motion. Smooth rolling hills.
+        Ridged          // Ridged multifractal. Sharp mountain ridges. Never negative.
+    };
+
+    /**
+     * Parameters describing a multi-octave fractal noise function.
+     */
+    struct FractalParams
+    {
+        FractalParams();
+
+        NoiseBasis basis;
+        FractalType type;
+        unsigned int octaves;
+        float frequency;        // Frequency of the first octave.
+        float lacunarity;       // Frequency multiplier between octaves.
+        float gain;             // Amplitude multiplier between octaves.
+        float ridgeOffset;      // Offset subtracted from the absolute value of ridged octaves.
+        float amplitude;        // Scale applied to the final value.
+        float bias;             // Value added to the final scaled value.
+    };
+
+    /**
+     * Seedable noise generator that evaluates several points per call using SSE (4 wide) or AVX2
+     * (8 wide, when compiled with /arch:AVX2).
+     *
+     * The generator holds no tables; every value is derived from an integer hash of the lattice
+     * coordinate and the seed. Results only depend on the seed and the sample position, so they are
+     * identical no matter how many threads the work is split over, or whether a point was evaluated
+     * on its own or as part of a batch.
+     */
+    class NoiseGenerator
+    {
+    public:
+        explicit NoiseGenerator(unsigned int seed);
+
+        unsigned int Seed() const { return mSeed; }
+
+        // Evaluate a single octave of noise.
+        float Evaluate(NoiseBasis basis, float x, float y) const;
+        void Evaluate4(NoiseBasis basis, const float * pX, const float * pY, float * pOut) const;
+        void Evaluate8(NoiseBasis basis, const float * pX, const float * pY, float * pOut) const;
+
+        // Evaluate multi-octave fractal noise. See FractalType for the range of the result.
+        float EvaluateFractal(const FractalParams& params, float x, float y) const;
+        void EvaluateFractal4(const FractalParams& params, const float * pX, const float * pY, float * pOut) const;
+        void EvaluateFractal8(const FractalParams& params, const float * pX, const float * pY, float * pOut) const;
+
+        // Fill a row major grid of fractal noise values where sample (row, col) is taken at
+        // (originX + col * stepX, originY + row * stepY). Rows are split across threadCount worker
+        // threads, or one per core if threadCount is zero.
+        void FillGrid(
+            const FractalParams& params,
+            unsigned int rows,
+            unsigned int cols,
+            float originX,
+            float originY,
+            float stepX,
+            float stepY,
+            float * pOut,
+            unsigned int threadCount = 0) const;
+
+    private:
+        void FillRows(
+            const FractalParams& params,
+            unsigned int firstRow,
+            unsigned int lastRow,
+            unsigned int cols,
+            float originX,
+            float originY,
+            float stepX,
+            float stepY,
+            float * pOut) const;
+
+    private:
+        unsigned int mSeed;
+    };
+}
+
+#endif
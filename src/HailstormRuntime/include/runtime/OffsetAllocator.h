@@ -0,0 +1,129 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef SCOTT_HAILSTORM_OFFSET_ALLOCATOR_H
+#define SCOTT_HAILSTORM_OFFSET_ALLOCATOR_H
+
+#include <vector>
+
+/**
+ * Hands out ranges of offsets within a fixed size region, eg slices of one large GPU buffer. The
+ * allocator never touches the memory it manages, so it works in whatever units the caller likes
+ * (bytes, vertices, indices) and can be used without a device.
+ *
+ * Free ranges are kept in a two level segregated fit (TLSF) structure. Sizes are sorted into 256
+ * bins that work like tiny floating point numbers, with three mantissa bits, so each power of two is
+ * split into eight bins and the bin sizes are never more than 12.5% apart. Two levels of bit masks
+ * record which bins have free ranges, which finds a range big enough for any request in constant time
+ * with a couple of bit scans. Freed ranges are merged with free neighbors straight away.
+ *
+ * Allocations are identified by a node index, which stays valid until the allocation is freed. Its
+ * offset only changes when the allocator is defragmented.
+ */
+class OffsetAllocator
+{
+public:
+    typedef unsigned int NodeIndex;
+    static const NodeIndex NO_NODE = 0xFFFFFFFF;
+
+    struct Allocation
+    {
+        unsigned int offset;
+        unsigned int size;
+        NodeIndex node;             // NO_NODE if the allocation failed.
+
+        bool IsValid() const { return node != NO_NODE; }
+    };
+
+    // An allocation that was moved by Defragment.
+    struct Move
+    {
+        NodeIndex node;
+        unsigned int oldOffset;
+        unsigned int newOffset;
+        unsigned int size;
+    };
+
+    explicit OffsetAllocator(unsigned int capacity);
+
+    // Allocate size units. Returns an invalid allocation if there is no free range big enough.
+    Allocation Allocate(unsigned int size);
+
+    // Return an allocation's range to the allocator.
+    void Free(NodeIndex node);
+
+    // Free every allocation.
+    void Reset();
+
+    // Slide every allocation towards offset zero so that all free space is in one range at the end.
+    // Allocations keep their order. pMovesOut receives the allocations that moved in order of
+    // increasing offset, so copying them in that order never overwrites data that has yet to move.
+    void Defragment(std::vector<Move> * pMovesOut);
+
+    unsigned int Offset(NodeIndex node) const;
+    unsigned int Size(NodeIndex node) const;
+
+    unsigned int Capacity() const { return mCapacity; }
+    unsigned int FreeSpace() const { return mFreeSpace; }
+    unsigned int AllocationCount() const { return mAllocationCount; }
+
+    // Size of the largest free range, ie the largest allocation that would currently succeed.
+    unsigned int LargestFreeRange() const;
+
+private:
+    static const unsigned int MANTISSA_BITS = 3;
+    static const unsigned int BINS_PER_GROUP = 1 << MANTISSA_BITS;
+    static const unsigned int GROUP_COUNT = 32;
+    static const unsigned int BIN_COUNT = GROUP_COUNT * BINS_PER_GROUP;
+
+    enum class NodeState : unsigned char
+    {
+        Unused,         // Slot is waiting to be reused.
+        Free,
+        Allocated
+    };
+
+    struct Node
+    {
+        unsigned int offset;
+        unsigned int size;
+        NodeIndex binPrevious;      // Other free nodes in the same bin.
+        NodeIndex binNext;
+        NodeIndex neighborPrevious; // Nodes on either side in offset order.
+        NodeIndex neighborNext;
+        NodeState state;
+    };
+
+    static unsigned int RoundDownToBin(unsigned int size);
+    static unsigned int RoundUpToBin(unsigned int size);
+
+    unsigned int FindFreeBin(unsigned int firstBin) const;
+    NodeIndex NewNode(unsigned int offset, unsigned int size, NodeState state);
+    void ReleaseNode(NodeIndex node);
+    void AddToBin(NodeIndex node);
+    void RemoveFromBin(NodeIndex node);
+
+private:
+    unsigned int mCapacity;
+    unsigned int mFreeSpace;
+    unsigned int mAllocationCount;
+    unsigned int mGroupMask;                        // Bit g is set if bin group g has any free nodes.
+    unsigned char mBinMasks[GROUP_COUNT];           // Bit b is set if bin b of the group has free nodes.
+    NodeIndex mBinHeads[BIN_COUNT];
+    std::vector<Node> mNodes;
+    std::vector<NodeIndex> mUnusedNodes;
+};
+
+#endif
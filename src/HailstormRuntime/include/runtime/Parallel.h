@@ -0,0 +1,52 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef SCOTT_HAILSTORM_PARALLEL_H
+#define SCOTT_HAILSTORM_PARALLEL_H
+
+#include <functional>
+
+namespace Parallel
+{
+    /**
+     * Statistics from a parallel loop, for benchmarking.
+     */
+    struct ForStats
+    {
+        unsigned int threadCount;   // Number of threads that worked on the loop.
+        unsigned int stealCount;    // Number of times a thread ran out of work and stole from another.
+    };
+
+    // Number of threads to use when a caller asks for zero threads, one per hardware thread.
+    unsigned int DefaultThreadCount();
+
+    /**
+     * Calls task(index, worker) for every index in [0, taskCount), spread across threadCount threads
+     * (zero for one per hardware thread). The calling thread is used as worker zero. Returns once
+     * every task has finished, rethrowing the first exception thrown by a task.
+     *
+     * Tasks are split with work stealing. Each worker starts with an equal contiguous share of the
+     * indices and takes them from the front, and a worker that runs out steals the back half of the
+     * largest share left. Neighboring indices stay on the same thread where possible, and uneven
+     * tasks still keep every thread busy until the end.
+     */
+    void For(
+        unsigned int taskCount,
+        unsigned int threadCount,
+        const std::function<void(unsigned int index, unsigned int worker)>& task,
+        ForStats * pStatsOut = nullptr);
+}
+
+#endif
@@ -0,0 +1,48 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef SCOTT_HAILSTORM_STOPWATCH_H
+#define SCOTT_HAILSTORM_STOPWATCH_H
+
+/**
+ * High resolution wall clock timer for measuring how long a chunk of work takes. The stopwatch starts
+ * running as soon as it is constructed.
+ *
+ * (std::chrono::high_resolution_clock is not actually high resolution under VS2013, which is why this
+ * uses the performance counter on Windows).
+ */
+class Stopwatch
+{
+public:
+    Stopwatch();
+
+    // Reset the start time to now.
+    void Restart();
+
+    // Number of seconds that have elapsed since the stopwatch was started.
+    double ElapsedSeconds() const;
+
+    // Number of milliseconds that have elapsed since the stopwatch was started.
+    double ElapsedMilliseconds() const { return ElapsedSeconds() * 1000.0; }
+
+private:
+    static long long CurrentTicks();
+    static long long TicksPerSecond();
+
+private:
+    long long mStartTicks;
+};
+
+#endif
@@ -0,0 +1,149 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef SCOTT_HAILSTORM_TEXTURE_STREAMER_H
+#define SCOTT_HAILSTORM_TEXTURE_STREAMER_H
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "runtime/DensePool.h"
+
+class DdsFile;
+class WorkerPool;
+
+/**
+ * Settings for a TextureStreamer.
+ */
+struct MipStreamingParams
+{
+    MipStreamingParams();
+
+    unsigned int tailSize;              // Mips no larger than this on either side are loaded up front.
+    unsigned int maxLoadsInFlight;      // Mip levels being loaded at once, across every texture.
+};
+
+namespace MipStreaming
+{
+    // Most detailed mip needed to draw a texture with requestedSize texels along its longer side, ie
+    // the smallest mip that is still at least that large. A requested size of zero asks for the
+    // smallest mip.
+    unsigned int SelectMip(unsigned int width, unsigned int height, unsigned int mipCount, unsigned int requestedSize);
+
+    // First mip of the tail of the chain, the mips no larger than tailSize on either side. At least
+    // the smallest mip is always in the tail.
+    unsigned int TailMip(unsigned int width, unsigned int height, unsigned int mipCount, unsigned int tailSize);
+}
+
+/**
+ * Streams the mip chains of DDS textures in, smallest mips first, so that a texture can be drawn
+ * almost as soon as it is added and then sharpens as the detail it needs arrives.
+ *
+ * Adding a texture loads its tail (see MipStreamingParams::tailSize) straight away. After that each
+ * texture is given the resolution it will be drawn at, which picks the most detailed mip it needs
+ * (see MipStreaming::SelectMip), and Update upgrades it towards that mip one level at a time. Each
+ * upgrade reads the level's bytes in from disk (see DdsFile::Prefetch) on a WorkerPool thread, so that
+ * uploading them later never stalls on a page fault. Textures furthest from their target are upgraded
+ * first, and asking for a lower resolution drops the extra mips at once.
+ *
+ * Whenever the most detailed resident mip of a texture changes, its callback is called with the new
+ * first mip so the owner can rebuild its device texture from that mip down. Callbacks, and every
+ * method, are called on the thread that owns the streamer; only the reads happen elsewhere. Nothing
+ * here touches a graphics device.
+ */
+class TextureStreamer
+{
+public:
+    typedef std::function<void(unsigned int firstMip)> ResidencyCallback;
+
+    /**
+     * Streaming state of one texture. Only the streamer uses this, through a TextureHandle.
+     */
+    struct Texture
+    {
+        Texture();
+
+        const DdsFile * pFile;
+        ResidencyCallback onResidencyChanged;
+        unsigned int tailMip;
+        unsigned int residentMip;
+        unsigned int targetMip;
+        bool isLoading;
+    };
+
+    typedef Handle<Texture> TextureHandle;
+
+    // Loads are run on the given pool, which must outlive the streamer. A pool with no threads loads
+    // each level inside Update.
+    explicit TextureStreamer(WorkerPool * pLoaders, const MipStreamingParams& params = MipStreamingParams());
+    TextureStreamer(const TextureStreamer&) = delete;
+    ~TextureStreamer();
+
+    TextureStreamer& operator =(const TextureStreamer&) = delete;
+
+    // Start streaming an open DDS file, which must stay open until the texture is removed. The tail
+    // is loaded, and the callback called for it, before this returns. Callbacks must not add or
+    // remove textures.
+    TextureHandle Add(const DdsFile * pFile, unsigned int requestedSize, const ResidencyCallback& onResidencyChanged);
+
+    // Stop streaming a texture, waiting for its load if one is running. Returns false for a stale
+    // handle.
+    bool Remove(TextureHandle handle);
+
+    // Change the resolution a texture is drawn at, in texels along its longer side.
+    void RequestSize(TextureHandle handle, unsigned int requestedSize);
+
+    // Most detailed mip that is loaded, and the one the texture is being streamed towards.
+    unsigned int ResidentMip(TextureHandle handle) const;
+    unsigned int TargetMip(TextureHandle handle) const;
+
+    // Apply the loads that have finished, calling their callbacks, then start loads for the textures
+    // that still need detail. Call once a frame. Returns the number of textures that were upgraded.
+    unsigned int Update();
+
+    // Keep updating until every texture has reached its target.
+    void WaitIdle();
+
+    unsigned int Count() const { return mTextures.Count(); }
+    unsigned int LoadingCount() const { return mLoadingCount; }
+
+    // Bytes of mip levels read in by background loads since the streamer was created.
+    unsigned long long BytesLoaded() const { return mBytesLoaded; }
+
+    const MipStreamingParams& Params() const { return mParams; }
+
+private:
+    typedef std::pair<TextureHandle, unsigned int> FinishedLoad;
+
+    void StartLoad(TextureHandle handle, Texture * pTexture);
+    void WaitForLoad(TextureHandle handle);
+    void DropTo(Texture * pTexture, unsigned int mip);
+
+private:
+    WorkerPool * mpLoaders;
+    MipStreamingParams mParams;
+    DensePool<Texture> mTextures;
+    unsigned int mLoadingCount;
+    unsigned long long mBytesLoaded;
+
+    std::mutex mFinishedLock;
+    std::condition_variable mLoadFinished;
+    std::vector<FinishedLoad> mFinished;            // Filled by the loader threads, drained by Update.
+};
+
+#endif
@@ -0,0 +1,174 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef SCOTT_HAILSTORM_VIRTUAL_FILE_SYSTEM_H
+#define SCOTT_HAILSTORM_VIRTUAL_FILE_SYSTEM_H
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "runtime/ByteSpan.h"
+
+class AlignedBuffer;
+class MappedFile;
+
+/**
+ * A path in the virtual file system, after it has been cleaned up: separators are forward slashes and
+ * "." and ".." parts are removed.
+ */
+struct VirtualPath
+{
+    std::string name;               // Cleaned path with its case kept, for backends on real file systems.
+    std::string normalized;         // Lower cased name (see AssetArchive::NormalizePath).
+    unsigned long long hash;        // Hash of the normalized path (see AssetArchive::HashPath).
+};
+
+/**
+ * A file opened through the virtual file system. Its bytes either belong to the file (a mapped loose
+ * file or a decompressed archive entry) or to the backend that opened it (an uncompressed archive
+ * entry or a memory blob), in which case the backend has to stay mounted for as long as the file is
+ * used.
+ */
+class VirtualFile
+{
+public:
+    VirtualFile();
+    VirtualFile(VirtualFile&& other);
+    VirtualFile(const VirtualFile&) = delete;
+    ~VirtualFile();
+
+    VirtualFile& operator =(VirtualFile&& other);
+    VirtualFile& operator =(const VirtualFile&) = delete;
+
+    // Point the file at bytes owned by a backend.
+    void Attach(const ByteSpan& data);
+
+    // Take ownership of a mapped file and point the file at its bytes.
+    void Attach(std::unique_ptr<MappedFile> pMappedFile);
+
+    // Take ownership of a buffer and point the file at its bytes.
+    void Attach(std::unique_ptr<AlignedBuffer> pBuffer);
+
+    void Close();
+
+    bool IsOpen() const { return mIsOpen; }
+    ByteSpan Data() const { return mData; }
+    size_t Size() const { return mData.size; }
+
+    // Read the whole file in from disk now (see MappedFile::Prefetch).
+    void Prefetch() const;
+
+private:
+    ByteSpan mData;
+    std::unique_ptr<MappedFile> mpMappedFile;
+    std::unique_ptr<AlignedBuffer> mpBuffer;
+    bool mIsOpen;
+};
+
+/**
+ * Somewhere files can be read from, eg a directory or an archive. Backends are given paths relative to
+ * the point they are mounted at, and Open and Exists may be called from several threads at once.
+ */
+class FileSystemBackend
+{
+public:
+    virtual ~FileSystemBackend() { }
+
+    virtual bool Open(const VirtualPath& path, VirtualFile * pFileOut) const = 0;
+    virtual bool Exists(const VirtualPath& path) const = 0;
+
+    // Short name of the kind of backend, eg "directory", for statistics and logging.
+    virtual const char * TypeName() const = 0;
+};
+
+/**
+ * Reads and timings for one mount point.
+ */
+struct MountStats
+{
+    std::string mountPoint;
+    const char * pTypeName;
+    int priority;
+    unsigned long long openCount;
+    unsigned long long byteCount;
+    double openSeconds;             // Time spent opening files, not reading them.
+};
+
+/**
+ * Reads and timings for every mount point, in the order they are searched.
+ */
+struct FileSystemStats
+{
+    std::vector<MountStats> mounts;
+    unsigned long long missCount;   // Opens that no mount point could satisfy.
+};
+
+/**
+ * Every asset read goes through the virtual file system, so where assets are stored can change without
+ * changing the code that loads them, and all of the game's file I/O can be measured in one place.
+ *
+ * Backends (see FileSystemBackends.h) are mounted at a mount point, which is a directory in the
+ * virtual file system. Paths are case insensitive and may use either separator. When several mounts
+ * have the same file the one with the highest priority wins, eg an archive mounted above the loose
+ * directory it was packed from, or a patch mounted above both. Mounts with equal priority are
+ * searched most recently mounted first.
+ *
+ * Mount everything before sharing the file system with other threads. After that Open and Exists
+ * can be called from any thread.
+ */
+class VirtualFileSystem
+{
+public:
+    VirtualFileSystem();
+    VirtualFileSystem(const VirtualFileSystem&) = delete;
+    ~VirtualFileSystem();
+
+    VirtualFileSystem& operator =(const VirtualFileSystem&) = delete;
+
+    // Mount a backend at a mount point. "" mounts it at the root.
+    void Mount(const std::string& mountPoint, std::unique_ptr<FileSystemBackend> pBackend, int priority = 0);
+
+    // Unmount every backend at a mount point. Returns false if nothing was mounted there.
+    bool Unmount(const std::string& mountPoint);
+
+    unsigned int MountCount() const { return static_cast<unsigned int>(mMounts.size()); }
+
+    // Open a file from the highest priority mount that has it. Returns false if none do.
+    bool Open(const std::string& path, VirtualFile * pFileOut) const;
+    bool Open(const std::wstring& path, VirtualFile * pFileOut) const;
+
+    bool Exists(const std::string& path) const;
+    bool Exists(const std::wstring& path) const;
+
+    FileSystemStats Stats() const;
+    void ResetStats();
+
+    // Clean up a path and hash it.
+    static VirtualPath MakePath(const std::string& path);
+    static VirtualPath MakePath(const std::wstring& path);
+
+private:
+    struct MountPoint;
+
+    static bool MakeRelativePath(const MountPoint& mount, const VirtualPath& path, VirtualPath * pRelativePathOut);
+
+private:
+    std::vector<std::unique_ptr<MountPoint>> mMounts;   // Sorted by search order.
+    mutable std::atomic<unsigned long long> mMissCount;
+};
+
+#endif
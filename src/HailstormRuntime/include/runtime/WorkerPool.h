@@ -0,0 +1,69 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef SCOTT_HAILSTORM_WORKER_POOL_H
+#define SCOTT_HAILSTORM_WORKER_POOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * A fixed set of threads that run jobs from a shared first in, first out queue, for long lived
+ * background work such as loading assets. (Parallel::For is the better fit for splitting one big
+ * computation across every core.)
+ *
+ * A pool with zero threads runs each job inside Submit on the calling thread, which keeps code that
+ * uses a pool working, serially, where threads are unwanted.
+ *
+ * Jobs must not throw. Destroying the pool waits for every queued job to finish.
+ */
+class WorkerPool
+{
+public:
+    explicit WorkerPool(unsigned int threadCount);
+    WorkerPool(const WorkerPool&) = delete;
+    ~WorkerPool();
+
+    WorkerPool& operator =(const WorkerPool&) = delete;
+
+    // Queue a job to run on one of the pool's threads.
+    void Submit(const std::function<void()>& job);
+
+    // Block until the queue is empty and no job is running.
+    void WaitIdle();
+
+    unsigned int ThreadCount() const { return static_cast<unsigned int>(mThreads.size()); }
+
+    // Jobs that are queued or running.
+    unsigned int BusyCount() const;
+
+private:
+    void Run();
+
+private:
+    std::vector<std::thread> mThreads;
+    std::deque<std::function<void()>> mJobs;
+    mutable std::mutex mLock;
+    std::condition_variable mJobAdded;
+    std::condition_variable mJobFinished;
+    unsigned int mRunningCount;
+    bool mStopping;
+};
+
+#endif
@@ -0,0 +1,54 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "stdafx.h"
+#include "runtime/AlignedBuffer.h"
+#include "runtime/debugging.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+#if defined(_WIN32)
+#   include <malloc.h>
+#endif
+
+AlignedBuffer::AlignedBuffer(size_t size, size_t alignment)
+    : mpData(nullptr),
+      mSize(size)
+{
+    Verify(alignment > 0 && (alignment & (alignment - 1)) == 0);
+
+#if defined(_WIN32)
+    mpData = static_cast<unsigned char *>(_aligned_malloc(std::max<size_t>(size, 1), alignment));
+#else
+    void * pData = nullptr;
+
+    if (posix_memalign(&pData, std::max(alignment, sizeof(void *)), std::max<size_t>(size, 1)) == 0)
+    {
+        mpData = static_cast<unsigned char *>(pData);
+    }
+#endif
+
+    VerifyNotNull(mpData);
+}
+
+AlignedBuffer::~AlignedBuffer()
+{
+#if defined(_WIN32)
+    _aligned_free(mpData);
+#else
+    std::free(mpData);
+#endif
+}
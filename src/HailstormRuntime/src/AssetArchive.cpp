@@ -0,0 +1,586 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "stdafx.h"
+#include "runtime/AssetArchive.h"
+#include "runtime/debugging.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+#include "runtime/Hash.h"
+#include "runtime/Lz.h"
+#include "runtime/Parallel.h"
+
+static_assert(sizeof(ArchiveEntry) == 48, "Archive entries must not contain padding");
+static_assert(sizeof(ArchiveHeader) == 64, "Archive header must not contain padding");
+
+const unsigned int AssetArchiveWriter::DEFAULT_ALIGNMENT;
+
+namespace
+{
+    const unsigned int ARCHIVE_MAGIC = 0x4B505348;      // "HSPK"
+
+    // Bump this whenever the file layout changes.
+    const unsigned int ARCHIVE_VERSION = 1;
+
+    // Tables inside the archive are aligned to this, whatever the entry alignment is.
+    const unsigned long long TABLE_ALIGNMENT = 16;
+
+    // Compressing a file has to save at least 1 / MIN_SAVING_FRACTION of its size, or it is stored as
+    // it is and keeps its zero copy span.
+    const size_t MIN_SAVING_FRACTION = 16;
+
+    // The bucket shift of a table of 2^31 buckets, the most that bucketCount + 1 leaves room for,
+    // and of a table of one bucket.
+    const unsigned int MIN_BUCKET_SHIFT = 33;
+    const unsigned int MAX_BUCKET_SHIFT = 64;
+
+    unsigned long long AlignOffset(unsigned long long offset, unsigned long long alignment)
+    {
+        return (offset + alignment - 1) & ~(alignment - 1);
+    }
+
+    // Check that a table of count items of itemSize bytes at offset lies inside the file.
+    bool IsInFile(unsigned long long offset, unsigned long long count, unsigned long long itemSize, unsigned long long fileSize)
+    {
+        return offset <= fileSize && count * itemSize <= fileSize - offset;
+    }
+
+    unsigned int BucketOf(unsigned long long pathHash, unsigned int bucketShift)
+    {
+        return bucketShift >= 64 ? 0 : static_cast<unsigned int>(pathHash >> bucketShift);
+    }
+
+    /**
+     * Encodes a wide string as UTF-8. Paths are wide on Windows, but archives store them as UTF-8.
+     */
+    std::string ToUtf8(const std::wstring& text)
+    {
+        std::string utf8;
+        utf8.reserve(text.size());
+
+        for (size_t i = 0; i < text.size(); ++i)
+        {
+            unsigned int c = static_cast<unsigned int>(text[i]);
+
+            if (c < 0x80)
+            {
+                utf8.push_back(static_cast<char>(c));
+            }
+            else if (c < 0x800)
+            {
+                utf8.push_back(static_cast<char>(0xC0 | (c >> 6)));
+                utf8.push_back(static_cast<char>(0x80 | (c & 0x3F)));
+            }
+            else
+            {
+                utf8.push_back(static_cast<char>(0xE0 | (c >> 12)));
+                utf8.push_back(static_cast<char>(0x80 | ((c >> 6) & 0x3F)));
+                utf8.push_back(static_cast<char>(0x80 | (c & 0x3F)));
+            }
+        }
+
+        return utf8;
+    }
+}
+
+AssetArchive::AssetArchive()
+    : mFile(),
+      mpHeader(nullptr),
+      mpEntries(nullptr),
+      mpBuckets(nullptr)
+{
+}
+
+AssetArchive::~AssetArchive()
+{
+    Close();
+}
+
+bool AssetArchive::Open(const std::wstring& path, const char ** ppReasonOut)
+{
+    Close();
+
+    const char * pReason = nullptr;
+
+    if (!mFile.Open(path))
+    {
+        pReason = "file is missing or could not be mapped";
+    }
+    else
+    {
+        const ArchiveHeader * pHeader = reinterpret_cast<const ArchiveHeader *>(mFile.Data());
+        unsigned long long fileSize = mFile.Size();
+
+        if (fileSize < sizeof(ArchiveHeader) || pHeader->magic != ARCHIVE_MAGIC)
+        {
+            pReason = "not an asset archive";
+        }
+        else if (pHeader->version != ARCHIVE_VERSION || pHeader->headerSize != sizeof(ArchiveHeader))
+        {
+            pReason = "unsupported version";
+        }
+        else if (pHeader->fileSize != fileSize ||
+                 pHeader->bucketShift < MIN_BUCKET_SHIFT ||
+                 pHeader->bucketShift > MAX_BUCKET_SHIFT ||
+                 pHeader->bucketCount != (1ull << (64 - pHeader->bucketShift)) ||
+                 pHeader->entriesOffset % TABLE_ALIGNMENT != 0 ||
+                 pHeader->bucketsOffset % TABLE_ALIGNMENT != 0 ||
+                 !IsInFile(pHeader->entriesOffset, pHeader->entryCount, sizeof(ArchiveEntry), fileSize) ||
+                 !IsInFile(pHeader->bucketsOffset, pHeader->bucketCount + 1ull, sizeof(unsigned int), fileSize) ||
+                 pHeader->namesOffset > fileSize)
+        {
+            pReason = "file is truncated or corrupt";
+        }
+        else
+        {
+            const ArchiveEntry * pEntries = reinterpret_cast<const ArchiveEntry *>(mFile.Data() + pHeader->entriesOffset);
+            const unsigned int * pBuckets = reinterpret_cast<const unsigned int *>(mFile.Data() + pHeader->bucketsOffset);
+            unsigned long long namesSize = fileSize - pHeader->namesOffset;
+
+            // Every entry has to lie inside the file and be in its bucket, or lookups could run off
+            // the end of the mapping.
+            if (pBuckets[0] != 0 || pBuckets[pHeader->bucketCount] != pHeader->entryCount)
+            {
+                pReason = "table of contents is corrupt";
+            }
+
+            for (unsigned int b = 0; pReason == nullptr && b < pHeader->bucketCount; ++b)
+            {
+                if (pBuckets[b] > pBuckets[b + 1])
+                {
+                    pReason = "table of contents is corrupt";
+                }
+            }
+
+            for (unsigned int i = 0; pReason == nullptr && i < pHeader->entryCount; ++i)
+            {
+                const ArchiveEntry& entry = pEntries[i];
+                unsigned int bucket = BucketOf(entry.pathHash, pHeader->bucketShift);
+
+                if (entry.compression != ArchiveCompression::None && entry.compression != ArchiveCompression::Lz)
+                {
+                    pReason = "entry uses an unsupported compression method";
+                }
+                else if (!IsInFile(entry.offset, entry.storedSize, 1, fileSize) ||
+                         (entry.compression == ArchiveCompression::None && entry.storedSize != entry.size) ||
+                         entry.nameOffset >= namesSize ||
+                         bucket >= pHeader->bucketCount ||
+                         i < pBuckets[bucket] || i >= pBuckets[bucket + 1] ||
+                         (i > 0 && pEntries[i - 1].pathHash >= entry.pathHash))
+                {
+                    pReason = "table of contents is corrupt";
+                }
+            }
+
+            if (pReason == nullptr && namesSize > 0 && mFile.Data()[fileSize - 1] != '\0')
+            {
+                pReason = "name table is not terminated";
+            }
+
+            if (pReason == nullptr)
+            {
+                mpHeader = pHeader;
+                mpEntries = pEntries;
+                mpBuckets = pBuckets;
+            }
+        }
+    }
+
+    if (pReason != nullptr)
+    {
+        mFile.Close();
+
+        if (ppReasonOut != nullptr)
+        {
+            *ppReasonOut = pReason;
+        }
+
+        return false;
+    }
+
+    return true;
+}
+
+void AssetArchive::Close()
+{
+    mFile.Close();
+    mpHeader = nullptr;
+    mpEntries = nullptr;
+    mpBuckets = nullptr;
+}
+
+/**
+ * Jumps to the hash's bucket and scans the handful of entries in it. Entries are sorted by hash, so
+ * the scan stops as soon as it passes the hash.
+ */
+const ArchiveEntry * AssetArchive::Find(unsigned long long pathHash) const
+{
+    if (mpHeader == nullptr)
+    {
+        return nullptr;
+    }
+
+    unsigned int bucket = BucketOf(pathHash, mpHeader->bucketShift);
+
+    if (bucket >= mpHeader->bucketCount)
+    {
+        return nullptr;
+    }
+
+    unsigned int last = mpBuckets[bucket + 1];
+
+    for (unsigned int i = mpBuckets[bucket]; i < last && mpEntries[i].pathHash <= pathHash; ++i)
+    {
+        if (mpEntries[i].pathHash == pathHash)
+        {
+            return &mpEntries[i];
+        }
+    }
+
+    return nullptr;
+}
+
+const ArchiveEntry * AssetArchive::Find(const std::string& path) const
+{
+    std::string normalized = NormalizePath(path);
+    const ArchiveEntry * pEntry = Find(Hash::Fnv1a64(normalized));
+
+    if (pEntry != nullptr && normalized != Name(*pEntry))
+    {
+        return nullptr;
+    }
+
+    return pEntry;
+}
+
+const ArchiveEntry * AssetArchive::Find(const std::wstring& path) const
+{
+    return Find(ToUtf8(path));
+}
+
+ByteSpan AssetArchive::Data(const ArchiveEntry& entry) const
+{
+    VerifyNotNull(mpHeader);
+    return ByteSpan(mFile.Data() + entry.offset, static_cast<size_t>(entry.storedSize));
+}
+
+bool AssetArchive::Decompress(const ArchiveEntry& entry, void * pOut, unsigned int threadCount) const
+{
+    ByteSpan data = Data(entry);
+
+    switch (entry.compression)
+    {
+    case ArchiveCompression::None:
+        std::memcpy(pOut, data.pData, data.size);
+        return true;
+
+    case ArchiveCompression::Lz:
+        return Lz::Decompress(data, pOut, static_cast<size_t>(entry.size), threadCount);
+
+    default:
+        return false;
+    }
+}
+
+const char * AssetArchive::Name(const ArchiveEntry& entry) const
+{
+    VerifyNotNull(mpHeader);
+    return reinterpret_cast<const char *>(mFile.Data() + mpHeader->namesOffset + entry.nameOffset);
+}
+
+unsigned int AssetArchive::EntryCount() const
+{
+    return mpHeader != nullptr ? mpHeader->entryCount : 0;
+}
+
+const ArchiveEntry& AssetArchive::Entry(unsigned int index) const
+{
+    Verify(index < EntryCount());
+    return mpEntries[index];
+}
+
+void AssetArchive::Prefetch() const
+{
+    mFile.Prefetch();
+}
+
+void AssetArchive::Prefetch(const ArchiveEntry& entry) const
+{
+    ByteSpan data = Data(entry);
+    MappedFile::Prefetch(data.pData, data.size);
+}
+
+std::string AssetArchive::NormalizePath(const std::string& path, bool lowerCase)
+{
+    std::vector<std::string> parts;
+    std::string part;
+
+    for (size_t i = 0; i <= path.size(); ++i)
+    {
+        char c = (i < path.size() ? path[i] : '/');
+
+        if (c == '/' || c == '\\')
+        {
+            if (part == "..")
+            {
+                // Only collapse a ".." that has a real directory to cancel out.
+                if (!parts.empty() && parts.back() != "..")
+                {
+                    parts.pop_back();
+                }
+                else
+                {
+                    parts.push_back(part);
+                }
+            }
+            else if (!part.empty() && part != ".")
+            {
+                parts.push_back(part);
+            }
+
+            part.clear();
+        }
+        else
+        {
+            part.push_back(lowerCase && c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c);
+        }
+    }
+
+    std::string normalized;
+
+    for (size_t i = 0; i < parts.size(); ++i)
+    {
+        if (i > 0)
+        {
+            normalized.push_back('/');
+        }
+
+        normalized += parts[i];
+    }
+
+    return normalized;
+}
+
+std::string AssetArchive::NormalizePath(const std::wstring& path, bool lowerCase)
+{
+    return NormalizePath(ToUtf8(path), lowerCase);
+}
+
+unsigned long long AssetArchive::HashPath(const std::string& path)
+{
+    return Hash::Fnv1a64(NormalizePath(path));
+}
+
+unsigned long long AssetArchive::HashPath(const std::wstring& path)
+{
+    return Hash::Fnv1a64(NormalizePath(path));
+}
+
+AssetArchiveWriter::AssetArchiveWriter()
+    : mFiles(),
+      mCompressionLevel(Lz::DEFAULT_LEVEL)
+{
+}
+
+AssetArchiveWriter::~AssetArchiveWriter()
+{
+}
+
+bool AssetArchiveWriter::Add(
+    const std::string& path,
+    const void * pData,
+    size_t size,
+    ArchiveCompression compression)
+{
+    Verify(pData != nullptr || size == 0);
+
+    std::string normalized = AssetArchive::NormalizePath(path);
+    unsigned long long pathHash = Hash::Fnv1a64(normalized);
+
+    for (size_t i = 0; i < mFiles.size(); ++i)
+    {
+        if (mFiles[i].pathHash == pathHash)
+        {
+            return false;
+        }
+    }
+
+    const unsigned char * pBytes = static_cast<const unsigned char *>(pData);
+
+    mFiles.push_back(File());
+    mFiles.back().path.swap(normalized);
+    mFiles.back().pathHash = pathHash;
+    mFiles.back().data.assign(pBytes, pBytes + size);
+    mFiles.back().compression = compression;
+
+    return true;
+}
+
+void AssetArchiveWriter::SetCompressionLevel(int level)
+{
+    Verify(level >= Lz::MIN_LEVEL && level <= Lz::MAX_LEVEL);
+    mCompressionLevel = level;
+}
+
+bool AssetArchiveWriter::Write(const std::wstring& path, unsigned int alignment) const
+{
+    Verify(alignment > 0 && (alignment & (alignment - 1)) == 0);
+
+    // Sort the files by hash, which is the order the table of contents is stored in.
+    std::vector<unsigned int> order(mFiles.size());
+
+    for (unsigned int i = 0; i < order.size(); ++i)
+    {
+        order[i] = i;
+    }
+
+    std::sort(order.begin(), order.end(), [this](unsigned int a, unsigned int b)
+    {
+        return mFiles[a].pathHash < mFiles[b].pathHash;
+    });
+
+    // Use the smallest power of two number of buckets that is at least the number of entries.
+    unsigned int bucketBits = 0;
+
+    while ((1ull << bucketBits) < mFiles.size())
+    {
+        ++bucketBits;
+    }
+
+    // Compress every file that asked for it, one file per task.
+    std::vector<std::vector<unsigned char>> compressed(mFiles.size());
+    LzParams lzParams;
+    lzParams.level = mCompressionLevel;
+
+    if (!mFiles.empty())
+    {
+        Parallel::For(static_cast<unsigned int>(mFiles.size()), 0, [&](unsigned int index, unsigned int)
+        {
+            const File& file = mFiles[index];
+
+            if (file.compression == ArchiveCompression::Lz && !file.data.empty())
+            {
+                Lz::Compress(&file.data[0], file.data.size(), lzParams, &compressed[index]);
+
+                if (compressed[index].size() > file.data.size() - file.data.size() / MIN_SAVING_FRACTION)
+                {
+                    std::vector<unsigned char>().swap(compressed[index]);
+                }
+            }
+        });
+    }
+
+    ArchiveHeader header = { 0 };
+
+    header.magic = ARCHIVE_MAGIC;
+    header.version = ARCHIVE_VERSION;
+    header.headerSize = sizeof(ArchiveHeader);
+    header.entryCount = static_cast<unsigned int>(mFiles.size());
+    header.bucketCount = 1u << bucketBits;
+    header.bucketShift = 64 - bucketBits;
+    header.alignment = alignment;
+
+    // Build the table of contents, bucket table and name table.
+    std::vector<ArchiveEntry> entries(mFiles.size());
+    std::vector<unsigned int> buckets(header.bucketCount + 1, 0);
+    std::string names;
+
+    unsigned long long dataOffset = AlignOffset(sizeof(ArchiveHeader), std::max<unsigned long long>(alignment, TABLE_ALIGNMENT));
+
+    for (size_t i = 0; i < order.size(); ++i)
+    {
+        const File& file = mFiles[order[i]];
+        bool isCompressed = !compressed[order[i]].empty();
+        ArchiveEntry& entry = entries[i];
+
+        std::memset(&entry, 0, sizeof(entry));
+        entry.pathHash = file.pathHash;
+        entry.offset = dataOffset;
+        entry.storedSize = isCompressed ? compressed[order[i]].size() : file.data.size();
+        entry.size = file.data.size();
+        entry.nameOffset = static_cast<unsigned int>(names.size());
+        entry.compression = isCompressed ? ArchiveCompression::Lz : ArchiveCompression::None;
+
+        names += file.path;
+        names.push_back('\0');
+
+        dataOffset = AlignOffset(dataOffset + entry.storedSize, alignment);
+        buckets[BucketOf(entry.pathHash, header.bucketShift) + 1]++;
+    }
+
+    for (unsigned int b = 0; b < header.bucketCount; ++b)
+    {
+        buckets[b + 1] += buckets[b];
+    }
+
+    header.entriesOffset = AlignOffset(dataOffset, TABLE_ALIGNMENT);
+    header.bucketsOffset = AlignOffset(header.entriesOffset + entries.size() * sizeof(ArchiveEntry), TABLE_ALIGNMENT);
+    header.namesOffset = header.bucketsOffset + buckets.size() * sizeof(unsigned int);
+    header.fileSize = header.namesOffset + names.size();
+
+#if defined(_WIN32)
+    std::ofstream out(path.c_str(), std::ios::binary | std::ios::trunc);
+#else
+    std::ofstream out(std::string(path.begin(), path.end()).c_str(), std::ios::binary | std::ios::trunc);
+#endif
+
+    if (!out)
+    {
+        return false;
+    }
+
+    // Write a blank header first and fill it in once everything else is safely on disk.
+    std::vector<char> padding(std::max<unsigned int>(alignment, static_cast<unsigned int>(TABLE_ALIGNMENT)), 0);
+    ArchiveHeader blankHeader = { 0 };
+    unsigned long long position = sizeof(ArchiveHeader);
+
+    out.write(reinterpret_cast<const char *>(&blankHeader), sizeof(blankHeader));
+
+    for (size_t i = 0; i < order.size(); ++i)
+    {
+        const std::vector<unsigned char>& stored = compressed[order[i]].empty() ? mFiles[order[i]].data : compressed[order[i]];
+
+        out.write(&padding[0], static_cast<std::streamsize>(entries[i].offset - position));
+
+        if (!stored.empty())
+        {
+            out.write(reinterpret_cast<const char *>(&stored[0]), static_cast<std::streamsize>(stored.size()));
+        }
+
+        position = entries[i].offset + entries[i].storedSize;
+    }
+
+    out.write(&padding[0], static_cast<std::streamsize>(header.entriesOffset - position));
+
+    if (!entries.empty())
+    {
+        out.write(reinterpret_cast<const char *>(&entries[0]), static_cast<std::streamsize>(entries.size() * sizeof(ArchiveEntry)));
+    }
+
+    position = header.entriesOffset + entries.size() * sizeof(ArchiveEntry);
+    out.write(&padding[0], static_cast<std::streamsize>(header.bucketsOffset - position));
+    out.write(reinterpret_cast<const char *>(&buckets[0]), static_cast<std::streamsize>(buckets.size() * sizeof(unsigned int)));
+    out.write(names.data(), static_cast<std::streamsize>(names.size()));
+    out.flush();
+
+    out.seekp(0);
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.close();
+
+    return !out.fail();
+}
@@ -0,0 +1,940 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "stdafx.h"
+#include "runtime/AsyncFileReader.h"
+#include "runtime/debugging.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <thread>
+
+#include "runtime/WorkerPool.h"
+
+#if defined(_WIN32)
+#   ifndef WIN32_LEAN_AND_MEAN
+#       define WIN32_LEAN_AND_MEAN
+#   endif
+#   include <windows.h>
+#else
+#   include <cerrno>
+#   include <fcntl.h>
+#   include <unistd.h>
+#   if defined(__linux__)
+#       include <linux/io_uring.h>
+#       include <sys/mman.h>
+#       include <sys/syscall.h>
+#   endif
+#endif
+
+const size_t AsyncFileReader::BUFFER_ALIGNMENT;
+
+namespace
+{
+    const unsigned int DEFAULT_QUEUE_DEPTH = 64;
+    const unsigned int DEFAULT_THREAD_COUNT = 8;
+
+#if defined(_WIN32)
+    HANDLE OpenForRead(const std::wstring& path, bool overlapped, bool unbuffered)
+    {
+        DWORD flags = (overlapped ? FILE_FLAG_OVERLAPPED : 0) |
+                      (unbuffered ? FILE_FLAG_NO_BUFFERING : FILE_FLAG_SEQUENTIAL_SCAN);
+
+        return CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, flags, nullptr);
+    }
+
+    /**
+     * Reads with an explicit offset on a handle opened without FILE_FLAG_OVERLAPPED, which blocks
+     * until the read is done.
+     */
+    bool ReadRange(const FileReadRequest& request, bool unbuffered, size_t * pBytesReadOut)
+    {
+        HANDLE file = OpenForRead(request.path, false, unbuffered);
+        *pBytesReadOut = 0;
+
+        if (file == INVALID_HANDLE_VALUE)
+        {
+            return false;
+        }
+
+        bool succeeded = true;
+
+        while (*pBytesReadOut < request.size)
+        {
+            unsigned long long offset = request.offset + *pBytesReadOut;
+            DWORD toRead = static_cast<DWORD>(std::min<size_t>(request.size - *pBytesReadOut, 0x40000000));
+            DWORD bytesRead = 0;
+            OVERLAPPED position = { 0 };
+
+            position.Offset = static_cast<DWORD>(offset);
+            position.OffsetHigh = static_cast<DWORD>(offset >> 32);
+
+            if (!ReadFile(file, static_cast<unsigned char *>(request.pBuffer) + *pBytesReadOut, toRead, &bytesRead, &position))
+            {
+                succeeded = (GetLastError() == ERROR_HANDLE_EOF);
+                break;
+            }
+
+            if (bytesRead == 0)
+            {
+                break;
+            }
+
+            *pBytesReadOut += bytesRead;
+        }
+
+        CloseHandle(file);
+        return succeeded;
+    }
+#else
+    // Paths are converted the same way as MappedFile converts them.
+    bool ToNativePath(const std::wstring& path, std::string * pNativePathOut)
+    {
+        pNativePathOut->assign(path.size() * 4 + 1, '\0');
+        size_t length = std::wcstombs(&(*pNativePathOut)[0], path.c_str(), pNativePathOut->size());
+
+        if (length == static_cast<size_t>(-1))
+        {
+            return false;
+        }
+
+        pNativePathOut->resize(length);
+        return true;
+    }
+
+    int OpenFlags(bool unbuffered)
+    {
+        int flags = O_RDONLY | O_CLOEXEC;
+
+#if defined(O_DIRECT)
+        if (unbuffered)
+        {
+            flags |= O_DIRECT;
+        }
+#endif
+
+        return flags;
+    }
+
+    int OpenForRead(const std::wstring& path, bool unbuffered)
+    {
+        std::string nativePath;
+        return ToNativePath(path, &nativePath) ? ::open(nativePath.c_str(), OpenFlags(unbuffered)) : -1;
+    }
+
+    bool ReadRange(const FileReadRequest& request, bool unbuffered, size_t * pBytesReadOut)
+    {
+        int fd = OpenForRead(request.path, unbuffered);
+        *pBytesReadOut = 0;
+
+        if (fd < 0)
+        {
+            return false;
+        }
+
+        bool succeeded = true;
+
+        while (*pBytesReadOut < request.size)
+        {
+            ssize_t bytesRead = ::pread(
+                fd,
+                static_cast<unsigned char *>(request.pBuffer) + *pBytesReadOut,
+                request.size - *pBytesReadOut,
+                static_cast<off_t>(request.offset + *pBytesReadOut));
+
+            if (bytesRead < 0 && errno == EINTR)
+            {
+                continue;
+            }
+
+            if (bytesRead <= 0)
+            {
+                succeeded = (bytesRead == 0);
+                break;
+            }
+
+            *pBytesReadOut += static_cast<size_t>(bytesRead);
+        }
+
+        ::close(fd);
+        return succeeded;
+    }
+#endif
+}
+
+/**
+ * A batch of requests, shared by every read in it.
+ */
+struct AsyncFileReader::Batch
+{
+    std::vector<FileReadRequest> requests;
+    Completion onComplete;
+};
+
+/**
+ * Somewhere reads are queued. Backends call Complete once for every read they are given.
+ */
+class AsyncFileReader::Backend
+{
+public:
+    explicit Backend(AsyncFileReader * pReader)
+        : mpReader(pReader)
+    {
+    }
+
+    virtual ~Backend() { }
+
+    virtual void Submit(const std::shared_ptr<Batch>& pBatch) = 0;
+
+protected:
+    void Complete(const std::shared_ptr<Batch>& pBatch, unsigned int index, size_t bytesRead, bool succeeded)
+    {
+        mpReader->Finish(pBatch, index, bytesRead, succeeded);
+    }
+
+private:
+    AsyncFileReader * mpReader;
+};
+
+/**
+ * Blocking reads, one per job, on a worker pool.
+ */
+class AsyncFileReader::ThreadBackend : public AsyncFileReader::Backend
+{
+public:
+    ThreadBackend(AsyncFileReader * pReader, const AsyncFileReaderParams& params)
+        : Backend(pReader),
+          mPool(params.threadCount),
+          mUnbuffered(params.unbuffered)
+    {
+    }
+
+    virtual void Submit(const std::shared_ptr<Batch>& pBatch) override
+    {
+        for (unsigned int i = 0; i < pBatch->requests.size(); ++i)
+        {
+            mPool.Submit([this, pBatch, i]()
+            {
+                size_t bytesRead = 0;
+                bool succeeded = ReadRange(pBatch->requests[i], mUnbuffered, &bytesRead);
+
+                Complete(pBatch, i, bytesRead, succeeded);
+            });
+        }
+    }
+
+private:
+    WorkerPool mPool;
+    bool mUnbuffered;
+};
+
+#if defined(__linux__)
+
+/**
+ * Queues reads on an io_uring. A single thread owns the ring: it fills in submission queue entries
+ * and submits and waits for them with one system call per round. Files are opened through the ring
+ * as well, since with a warm file cache opening a small file costs more than reading it.
+ */
+class AsyncFileReader::IoUringBackend : public AsyncFileReader::Backend
+{
+public:
+    IoUringBackend(AsyncFileReader * pReader, const AsyncFileReaderParams& params)
+        : Backend(pReader),
+          mRingFd(-1),
+          mpSqRing(nullptr),
+          mSqRingSize(0),
+          mpCqRing(nullptr),
+          mCqRingSize(0),
+          mpSqes(nullptr),
+          mSqesSize(0),
+          mQueueDepth(0),
+          mUnbuffered(params.unbuffered),
+          mThread(),
+          mLock(),
+          mWake(),
+          mQueued(),
+          mStopping(false)
+    {
+        if (CreateRing(params.queueDepth))
+        {
+            mThread = std::thread(&IoUringBackend::Run, this);
+        }
+    }
+
+    virtual ~IoUringBackend()
+    {
+        if (mThread.joinable())
+        {
+            {
+                std::lock_guard<std::mutex> lock(mLock);
+                mStopping = true;
+            }
+
+            mWake.notify_one();
+            mThread.join();
+        }
+
+        DestroyRing();
+    }
+
+    // False if the kernel doesn't support io_uring (or doesn't support plain reads on it).
+    bool IsOpen() const { return mRingFd >= 0; }
+
+    virtual void Submit(const std::shared_ptr<Batch>& pBatch) override
+    {
+        {
+            std::lock_guard<std::mutex> lock(mLock);
+
+            for (unsigned int i = 0; i < pBatch->requests.size(); ++i)
+            {
+                Read read = { pBatch, i, std::string(), -1, 0 };
+                mQueued.push_back(read);
+            }
+        }
+
+        mWake.notify_one();
+    }
+
+private:
+    struct Read
+    {
+        std::shared_ptr<Batch> pBatch;
+        unsigned int index;
+        std::string nativePath;     // Must stay alive until the open completes.
+        int fd;                     // Negative until the open completes.
+        size_t bytesRead;
+    };
+
+    bool CreateRing(unsigned int queueDepth)
+    {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+
+        int ringFd = static_cast<int>(syscall(__NR_io_uring_setup, queueDepth, &params));
+
+        if (ringFd < 0)
+        {
+            return false;
+        }
+
+        // IORING_OP_OPENAT and IORING_OP_READ arrived in the same kernel (5.6) as this feature flag.
+        if ((params.features & IORING_FEAT_RW_CUR_POS) == 0)
+        {
+            ::close(ringFd);
+            return false;
+        }
+
+        mRingFd = ringFd;
+        mQueueDepth = params.sq_entries;
+        mSqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+        mCqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        mSqesSize = params.sq_entries * sizeof(io_uring_sqe);
+
+        bool singleMapping = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+
+        if (singleMapping)
+        {
+            mSqRingSize = mCqRingSize = std::max(mSqRingSize, mCqRingSize);
+        }
+
+        mpSqRing = mmap(nullptr, mSqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, mRingFd, IORING_OFF_SQ_RING);
+        mpCqRing = singleMapping ? mpSqRing :
+            mmap(nullptr, mCqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, mRingFd, IORING_OFF_CQ_RING);
+        mpSqes = mmap(nullptr, mSqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, mRingFd, IORING_OFF_SQES);
+
+        if (mpSqRing == MAP_FAILED || mpCqRing == MAP_FAILED || mpSqes == MAP_FAILED)
+        {
+            DestroyRing();
+            return false;
+        }
+
+        unsigned char * pSq = static_cast<unsigned char *>(mpSqRing);
+        unsigned char * pCq = static_cast<unsigned char *>(mpCqRing);
+
+        mpSqTail = reinterpret_cast<unsigned int *>(pSq + params.sq_off.tail);
+        mpSqMask = reinterpret_cast<unsigned int *>(pSq + params.sq_off.ring_mask);
+        mpSqArray = reinterpret_cast<unsigned int *>(pSq + params.sq_off.array);
+        mpCqHead = reinterpret_cast<unsigned int *>(pCq + params.cq_off.head);
+        mpCqTail = reinterpret_cast<unsigned int *>(pCq + params.cq_off.tail);
+        mpCqMask = reinterpret_cast<unsigned int *>(pCq + params.cq_off.ring_mask);
+        mpCqes = reinterpret_cast<io_uring_cqe *>(pCq + params.cq_off.cqes);
+
+        return true;
+    }
+
+    void DestroyRing()
+    {
+        if (mpSqes != nullptr && mpSqes != MAP_FAILED)
+        {
+            munmap(mpSqes, mSqesSize);
+        }
+
+        if (mpCqRing != nullptr && mpCqRing != MAP_FAILED && mpCqRing != mpSqRing)
+        {
+            munmap(mpCqRing, mCqRingSize);
+        }
+
+        if (mpSqRing != nullptr && mpSqRing != MAP_FAILED)
+        {
+            munmap(mpSqRing, mSqRingSize);
+        }
+
+        if (mRingFd >= 0)
+        {
+            ::close(mRingFd);
+        }
+
+        mpSqes = mpCqRing = mpSqRing = nullptr;
+        mRingFd = -1;
+    }
+
+    io_uring_sqe& NextEntry(Read * pRead)
+    {
+        unsigned int tail = *mpSqTail;
+        unsigned int slot = tail & *mpSqMask;
+        io_uring_sqe& sqe = static_cast<io_uring_sqe *>(mpSqes)[slot];
+
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.user_data = reinterpret_cast<unsigned long long>(pRead);
+
+        mpSqArray[slot] = slot;
+        return sqe;
+    }
+
+    void CommitEntry()
+    {
+        __atomic_store_n(mpSqTail, *mpSqTail + 1, __ATOMIC_RELEASE);
+    }
+
+    void EnqueueOpen(Read * pRead)
+    {
+        io_uring_sqe& sqe = NextEntry(pRead);
+
+        sqe.opcode = IORING_OP_OPENAT;
+        sqe.fd = AT_FDCWD;
+        sqe.addr = reinterpret_cast<unsigned long long>(pRead->nativePath.c_str());
+        sqe.open_flags = static_cast<unsigned int>(OpenFlags(mUnbuffered));
+
+        CommitEntry();
+    }
+
+    // Add a read of whatever is left of a request to the submission queue.
+    void EnqueueRead(Read * pRead)
+    {
+        const FileReadRequest& request = pRead->pBatch->requests[pRead->index];
+        io_uring_sqe& sqe = NextEntry(pRead);
+
+        sqe.opcode = IORING_OP_READ;
+        sqe.fd = pRead->fd;
+        sqe.addr = reinterpret_cast<unsigned long long>(static_cast<unsigned char *>(request.pBuffer) + pRead->bytesRead);
+        sqe.len = static_cast<unsigned int>(std::min<size_t>(request.size - pRead->bytesRead, 0x7FFFF000));
+        sqe.off = request.offset + pRead->bytesRead;
+
+        CommitEntry();
+    }
+
+    void Finish(Read * pRead, bool succeeded)
+    {
+        if (pRead->fd >= 0)
+        {
+            ::close(pRead->fd);
+        }
+
+        Complete(pRead->pBatch, pRead->index, pRead->bytesRead, succeeded);
+        delete pRead;
+    }
+
+    // Move a read on to its next step once the kernel finishes the current one. Returns true if
+    // another step was queued on the ring.
+    bool Advance(Read * pRead, int result)
+    {
+        const FileReadRequest& request = pRead->pBatch->requests[pRead->index];
+
+        if (result < 0)
+        {
+            Finish(pRead, false);
+            return false;
+        }
+
+        if (pRead->fd < 0)
+        {
+            pRead->fd = result;
+        }
+        else
+        {
+            pRead->bytesRead += static_cast<size_t>(result);
+
+            if (result == 0)
+            {
+                Finish(pRead, true);
+                return false;
+            }
+        }
+
+        if (pRead->bytesRead >= request.size)
+        {
+            Finish(pRead, true);
+            return false;
+        }
+
+        // Either the file was just opened or the kernel made a short read, which it is allowed to
+        // do. Either way, queue a read of the rest.
+        EnqueueRead(pRead);
+        return true;
+    }
+
+    void Run()
+    {
+        unsigned int inFlight = 0;
+        unsigned int unsubmitted = 0;
+
+        for (;;)
+        {
+            std::vector<Read> ready;
+
+            {
+                std::unique_lock<std::mutex> lock(mLock);
+
+                if (inFlight == 0)
+                {
+                    mWake.wait(lock, [this]() { return mStopping || !mQueued.empty(); });
+                }
+
+                if (mStopping && mQueued.empty() && inFlight == 0)
+                {
+                    return;
+                }
+
+                while (!mQueued.empty() && inFlight + ready.size() < mQueueDepth)
+                {
+                    ready.push_back(mQueued.front());
+                    mQueued.pop_front();
+                }
+            }
+
+            for (size_t i = 0; i < ready.size(); ++i)
+            {
+                Read * pRead = new Read(ready[i]);
+
+                if (!ToNativePath(pRead->pBatch->requests[pRead->index].path, &pRead->nativePath))
+                {
+                    Finish(pRead, false);
+                }
+                else
+                {
+                    EnqueueOpen(pRead);
+                    ++inFlight;
+                    ++unsubmitted;
+                }
+            }
+
+            if (inFlight == 0)
+            {
+                continue;
+            }
+
+            // Submit everything queued and wait for at least one read to finish.
+            int submitted = static_cast<int>(syscall(__NR_io_uring_enter, mRingFd, unsubmitted, 1, IORING_ENTER_GETEVENTS, nullptr, 0));
+
+            if (submitted > 0)
+            {
+                unsubmitted -= static_cast<unsigned int>(submitted);
+            }
+
+            unsigned int head = *mpCqHead;
+            unsigned int tail = __atomic_load_n(mpCqTail, __ATOMIC_ACQUIRE);
+
+            for (; head != tail; ++head)
+            {
+                const io_uring_cqe& cqe = mpCqes[head & *mpCqMask];
+                Read * pRead = reinterpret_cast<Read *>(cqe.user_data);
+
+                if (Advance(pRead, cqe.res))
+                {
+                    ++unsubmitted;
+                }
+                else
+                {
+                    --inFlight;
+                }
+            }
+
+            __atomic_store_n(mpCqHead, head, __ATOMIC_RELEASE);
+        }
+    }
+
+private:
+    int mRingFd;
+    void * mpSqRing;
+    size_t mSqRingSize;
+    void * mpCqRing;
+    size_t mCqRingSize;
+    void * mpSqes;
+    size_t mSqesSize;
+    unsigned int * mpSqTail;
+    unsigned int * mpSqMask;
+    unsigned int * mpSqArray;
+    unsigned int * mpCqHead;
+    unsigned int * mpCqTail;
+    unsigned int * mpCqMask;
+    io_uring_cqe * mpCqes;
+    unsigned int mQueueDepth;
+    bool mUnbuffered;
+
+    std::thread mThread;
+    std::mutex mLock;
+    std::condition_variable mWake;
+    std::deque<Read> mQueued;
+    bool mStopping;
+};
+
+#endif
+
+#if defined(_WIN32)
+
+/**
+ * Overlapped reads that complete on an I/O completion port. A single thread issues reads, up to the
+ * queue depth, and waits on the port for them to finish.
+ */
+class AsyncFileReader::OverlappedBackend : public AsyncFileReader::Backend
+{
+public:
+    OverlappedBackend(AsyncFileReader * pReader, const AsyncFileReaderParams& params)
+        : Backend(pReader),
+          mPort(CreateIoCompletionPort(INVALID_HANDLE_VALUE, nullptr, 0, 1)),
+          mQueueDepth(params.queueDepth),
+          mUnbuffered(params.unbuffered),
+          mThread(),
+          mLock(),
+          mQueued(),
+          mStopping(false)
+    {
+        if (mPort != nullptr)
+        {
+            mThread = std::thread(&OverlappedBackend::Run, this);
+        }
+    }
+
+    virtual ~OverlappedBackend()
+    {
+        if (mThread.joinable())
+        {
+            {
+                std::lock_guard<std::mutex> lock(mLock);
+                mStopping = true;
+            }
+
+            PostQueuedCompletionStatus(mPort, 0, WAKE_KEY, nullptr);
+            mThread.join();
+        }
+
+        if (mPort != nullptr)
+        {
+            CloseHandle(mPort);
+        }
+    }
+
+    bool IsOpen() const { return mPort != nullptr; }
+
+    virtual void Submit(const std::shared_ptr<Batch>& pBatch) override
+    {
+        {
+            std::lock_guard<std::mutex> lock(mLock);
+
+            for (unsigned int i = 0; i < pBatch->requests.size(); ++i)
+            {
+                Read * pRead = new Read();
+
+                std::memset(&pRead->overlapped, 0, sizeof(pRead->overlapped));
+                pRead->file = INVALID_HANDLE_VALUE;
+                pRead->pBatch = pBatch;
+                pRead->index = i;
+                pRead->bytesRead = 0;
+
+                mQueued.push_back(pRead);
+            }
+        }
+
+        PostQueuedCompletionStatus(mPort, 0, WAKE_KEY, nullptr);
+    }
+
+private:
+    static const ULONG_PTR WAKE_KEY = 1;
+    static const ULONG_PTR READ_KEY = 2;
+
+    struct Read
+    {
+        OVERLAPPED overlapped;
+        HANDLE file;
+        std::shared_ptr<Batch> pBatch;
+        unsigned int index;
+        size_t bytesRead;
+    };
+
+    void Finish(Read * pRead, bool succeeded)
+    {
+        if (pRead->file != INVALID_HANDLE_VALUE)
+        {
+            CloseHandle(pRead->file);
+        }
+
+        Complete(pRead->pBatch, pRead->index, pRead->bytesRead, succeeded);
+        delete pRead;
+    }
+
+    // Start reading whatever is left of a request. Returns false if the read finished (or failed)
+    // without being queued on the port.
+    bool Issue(Read * pRead)
+    {
+        const FileReadRequest& request = pRead->pBatch->requests[pRead->index];
+
+        if (pRead->file == INVALID_HANDLE_VALUE)
+        {
+            pRead->file = OpenForRead(request.path, true, mUnbuffered);
+
+            if (pRead->file == INVALID_HANDLE_VALUE || CreateIoCompletionPort(pRead->file, mPort, READ_KEY, 0) == nullptr)
+            {
+                Finish(pRead, false);
+                return false;
+            }
+        }
+
+        if (pRead->bytesRead >= request.size)
+        {
+            Finish(pRead, true);
+            return false;
+        }
+
+        unsigned long long offset = request.offset + pRead->bytesRead;
+        DWORD toRead = static_cast<DWORD>(std::min<size_t>(request.size - pRead->bytesRead, 0x40000000));
+
+        pRead->overlapped.Offset = static_cast<DWORD>(offset);
+        pRead->overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+
+        if (!ReadFile(pRead->file, static_cast<unsigned char *>(request.pBuffer) + pRead->bytesRead, toRead, nullptr, &pRead->overlapped))
+        {
+            DWORD error = GetLastError();
+
+            if (error != ERROR_IO_PENDING)
+            {
+                Finish(pRead, error == ERROR_HANDLE_EOF);
+                return false;
+            }
+        }
+
+        // Reads that finish straight away still post a completion to the port.
+        return true;
+    }
+
+    void Run()
+    {
+        unsigned int inFlight = 0;
+
+        for (;;)
+        {
+            for (;;)
+            {
+                Read * pRead = nullptr;
+
+                {
+                    std::lock_guard<std::mutex> lock(mLock);
+
+                    if (inFlight >= mQueueDepth || mQueued.empty())
+                    {
+                        if (mStopping && mQueued.empty() && inFlight == 0)
+                        {
+                            return;
+                        }
+
+                        break;
+                    }
+
+                    pRead = mQueued.front();
+                    mQueued.pop_front();
+                }
+
+                if (Issue(pRead))
+                {
+                    ++inFlight;
+                }
+            }
+
+            DWORD bytesRead = 0;
+            ULONG_PTR key = 0;
+            OVERLAPPED * pOverlapped = nullptr;
+            BOOL succeeded = GetQueuedCompletionStatus(mPort, &bytesRead, &key, &pOverlapped, INFINITE);
+
+            if (pOverlapped == nullptr)
+            {
+                // Woken up by Submit or the destructor.
+                continue;
+            }
+
+            Read * pRead = CONTAINING_RECORD(pOverlapped, Read, overlapped);
+            --inFlight;
+
+            if (!succeeded)
+            {
+                Finish(pRead, GetLastError() == ERROR_HANDLE_EOF);
+            }
+            else if (bytesRead == 0)
+            {
+                Finish(pRead, true);
+            }
+            else
+            {
+                pRead->bytesRead += bytesRead;
+
+                if (Issue(pRead))
+                {
+                    ++inFlight;
+                }
+            }
+        }
+    }
+
+private:
+    HANDLE mPort;
+    unsigned int mQueueDepth;
+    bool mUnbuffered;
+
+    std::thread mThread;
+    std::mutex mLock;
+    std::deque<Read *> mQueued;
+    bool mStopping;
+};
+
+#endif
+
+AsyncFileReaderParams::AsyncFileReaderParams()
+    : useKernelQueue(true),
+      queueDepth(DEFAULT_QUEUE_DEPTH),
+      threadCount(DEFAULT_THREAD_COUNT),
+      unbuffered(false)
+{
+}
+
+AsyncFileReader::AsyncFileReader(const AsyncFileReaderParams& params)
+    : mpBackend(),
+      mMethod(FileReadMethod::Threads),
+      mLock(),
+      mIdle(),
+      mPendingCount(0),
+      mCompletionLock(),
+      mBytesRead(0)
+{
+    Verify(params.queueDepth > 0);
+
+#if defined(__linux__)
+    if (params.useKernelQueue)
+    {
+        std::unique_ptr<IoUringBackend> pBackend(new IoUringBackend(this, params));
+
+        if (pBackend->IsOpen())
+        {
+            mpBackend = std::move(pBackend);
+            mMethod = FileReadMethod::IoUring;
+        }
+    }
+#elif defined(_WIN32)
+    if (params.useKernelQueue)
+    {
+        std::unique_ptr<OverlappedBackend> pBackend(new OverlappedBackend(this, params));
+
+        if (pBackend->IsOpen())
+        {
+            mpBackend = std::move(pBackend);
+            mMethod = FileReadMethod::Overlapped;
+        }
+    }
+#endif
+
+    if (!mpBackend)
+    {
+        mpBackend.reset(new ThreadBackend(this, params));
+    }
+}
+
+AsyncFileReader::~AsyncFileReader()
+{
+    WaitIdle();
+    mpBackend.reset();
+}
+
+void AsyncFileReader::Submit(const std::vector<FileReadRequest>& requests, const Completion& onComplete)
+{
+    VerifyNotNull(onComplete);
+
+    if (requests.empty())
+    {
+        return;
+    }
+
+    std::shared_ptr<Batch> pBatch(new Batch());
+    pBatch->requests = requests;
+    pBatch->onComplete = onComplete;
+
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mPendingCount += static_cast<unsigned int>(requests.size());
+    }
+
+    mpBackend->Submit(pBatch);
+}
+
+void AsyncFileReader::WaitIdle()
+{
+    std::unique_lock<std::mutex> lock(mLock);
+    mIdle.wait(lock, [this]() { return mPendingCount == 0; });
+}
+
+const char * AsyncFileReader::MethodName() const
+{
+    switch (mMethod)
+    {
+    case FileReadMethod::IoUring:
+        return "io_uring";
+    case FileReadMethod::Overlapped:
+        return "overlapped";
+    default:
+        return "threads";
+    }
+}
+
+unsigned int AsyncFileReader::PendingCount() const
+{
+    std::lock_guard<std::mutex> lock(mLock);
+    return mPendingCount;
+}
+
+void AsyncFileReader::Finish(const std::shared_ptr<Batch>& pBatch, unsigned int index, size_t bytesRead, bool succeeded)
+{
+    FileReadResult result = { index, bytesRead, succeeded };
+    mBytesRead += bytesRead;
+
+    {
+        std::lock_guard<std::mutex> lock(mCompletionLock);
+        pBatch->onComplete(pBatch->requests[index], result);
+    }
+
+    std::lock_guard<std::mutex> lock(mLock);
+
+    if (--mPendingCount == 0)
+    {
+        mIdle.notify_all();
+    }
+}
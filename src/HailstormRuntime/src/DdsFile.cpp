@@ -0,0 +1,639 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "stdafx.h"
+#include "runtime/DdsFile.h"
+#include "runtime/debugging.h"
+
+#include <algorithm>
+#include <cstring>
+
+static_assert(sizeof(DdsPixelFormat) == 32, "DDS pixel format must not contain padding");
+static_assert(sizeof(DdsHeader) == 124, "DDS header must not contain padding");
+static_assert(sizeof(DdsHeaderDx10) == 20, "DDS DX10 header must not contain padding");
+
+const unsigned int DdsFile::MAGIC;
+const unsigned int DdsFile::MAX_DIMENSION;
+const unsigned int DdsFile::MAX_ARRAY_SIZE;
+
+namespace
+{
+    // DdsHeader::flags
+    const unsigned int DDSD_MIPMAPCOUNT = 0x20000;
+    const unsigned int DDSD_DEPTH = 0x800000;
+
+    // DdsHeader::caps2
+    const unsigned int DDSCAPS2_CUBEMAP = 0x200;
+    const unsigned int DDSCAPS2_CUBEMAP_ALL_FACES = 0xFC00;
+    const unsigned int DDSCAPS2_VOLUME = 0x200000;
+
+    // DdsPixelFormat::flags
+    const unsigned int DDPF_ALPHAPIXELS = 0x1;
+    const unsigned int DDPF_ALPHA = 0x2;
+    const unsigned int DDPF_FOURCC = 0x4;
+    const unsigned int DDPF_RGB = 0x40;
+    const unsigned int DDPF_LUMINANCE = 0x20000;
+
+    // DdsHeaderDx10::resourceDimension and miscFlag
+    const unsigned int DX10_DIMENSION_TEXTURE1D = 2;
+    const unsigned int DX10_DIMENSION_TEXTURE2D = 3;
+    const unsigned int DX10_DIMENSION_TEXTURE3D = 4;
+    const unsigned int DX10_MISC_TEXTURECUBE = 0x4;
+
+    const unsigned int CUBE_FACE_COUNT = 6;
+    const unsigned int BLOCK_SIZE = 4;
+
+    unsigned int MakeFourCC(char a, char b, char c, char d)
+    {
+        return static_cast<unsigned int>(static_cast<unsigned char>(a)) |
+            (static_cast<unsigned int>(static_cast<unsigned char>(b)) << 8) |
+            (static_cast<unsigned int>(static_cast<unsigned char>(c)) << 16) |
+            (static_cast<unsigned int>(static_cast<unsigned char>(d)) << 24);
+    }
+
+    struct FormatInfo
+    {
+        TextureFormat format;
+        unsigned int elementSize;       // Bytes per block or texel.
+        bool isBlockCompressed;
+        const char * pName;
+    };
+
+    const FormatInfo FORMATS[] =
+    {
+        { TextureFormat::R32G32B32A32Float, 16, false, "R32G32B32A32_FLOAT" },
+        { TextureFormat::R16G16B16A16Float,  8, false, "R16G16B16A16_FLOAT" },
+        { TextureFormat::R16G16B16A16Unorm,  8, false, "R16G16B16A16_UNORM" },
+        { TextureFormat::R32G32Float,        8, false, "R32G32_FLOAT" },
+        { TextureFormat::R10G10B10A2Unorm,   4, false, "R10G10B10A2_UNORM" },
+        { TextureFormat::R8G8B8A8Unorm,      4, false, "R8G8B8A8_UNORM" },
+        { TextureFormat::R8G8B8A8UnormSrgb,  4, false, "R8G8B8A8_UNORM_SRGB" },
+        { TextureFormat::R16G16Float,        4, false, "R16G16_FLOAT" },
+        { TextureFormat::R16G16Unorm,        4, false, "R16G16_UNORM" },
+        { TextureFormat::R32Float,           4, false, "R32_FLOAT" },
+        { TextureFormat::R8G8Unorm,          2, false, "R8G8_UNORM" },
+        { TextureFormat::R16Float,           2, false, "R16_FLOAT" },
+        { TextureFormat::R16Unorm,           2, false, "R16_UNORM" },
+        { TextureFormat::R8Unorm,            1, false, "R8_UNORM" },
+        { TextureFormat::A8Unorm,            1, false, "A8_UNORM" },
+        { TextureFormat::Bc1Unorm,           8, true,  "BC1_UNORM" },
+        { TextureFormat::Bc1UnormSrgb,       8, true,  "BC1_UNORM_SRGB" },
+        { TextureFormat::Bc2Unorm,          16, true,  "BC2_UNORM" },
+        { TextureFormat::Bc2UnormSrgb,      16, true,  "BC2_UNORM_SRGB" },
+        { TextureFormat::Bc3Unorm,          16, true,  "BC3_UNORM" },
+        { TextureFormat::Bc3UnormSrgb,      16, true,  "BC3_UNORM_SRGB" },
+        { TextureFormat::Bc4Unorm,           8, true,  "BC4_UNORM" },
+        { TextureFormat::Bc4Snorm,           8, true,  "BC4_SNORM" },
+        { TextureFormat::Bc5Unorm,          16, true,  "BC5_UNORM" },
+        { TextureFormat::Bc5Snorm,          16, true,  "BC5_SNORM" },
+        { TextureFormat::B5G6R5Unorm,        2, false, "B5G6R5_UNORM" },
+        { TextureFormat::B5G5R5A1Unorm,      2, false, "B5G5R5A1_UNORM" },
+        { TextureFormat::B8G8R8A8Unorm,      4, false, "B8G8R8A8_UNORM" },
+        { TextureFormat::B8G8R8X8Unorm,      4, false, "B8G8R8X8_UNORM" },
+        { TextureFormat::B8G8R8A8UnormSrgb,  4, false, "B8G8R8A8_UNORM_SRGB" },
+        { TextureFormat::B8G8R8X8UnormSrgb,  4, false, "B8G8R8X8_UNORM_SRGB" },
+        { TextureFormat::Bc6hUf16,          16, true,  "BC6H_UF16" },
+        { TextureFormat::Bc6hSf16,          16, true,  "BC6H_SF16" },
+        { TextureFormat::Bc7Unorm,          16, true,  "BC7_UNORM" },
+        { TextureFormat::Bc7UnormSrgb,      16, true,  "BC7_UNORM_SRGB" }
+    };
+
+    const FormatInfo * FindFormat(TextureFormat format)
+    {
+        for (size_t i = 0; i < sizeof(FORMATS) / sizeof(FORMATS[0]); ++i)
+        {
+            if (FORMATS[i].format == format)
+            {
+                return &FORMATS[i];
+            }
+        }
+
+        return nullptr;
+    }
+
+    bool HasMasks(const DdsPixelFormat& format, unsigned int r, unsigned int g, unsigned int b, unsigned int a)
+    {
+        return format.rBitMask == r && format.gBitMask == g && format.bBitMask == b && format.aBitMask == a;
+    }
+
+    /**
+     * Works out the format of a file without a DX10 header from its four character code or bit masks,
+     * following the conventions of the D3DX and DirectXTex writers. Returns TextureFormat::Unknown for
+     * formats that have no DXGI equivalent, such as 24 bit RGB.
+     */
+    TextureFormat LegacyFormat(const DdsPixelFormat& format)
+    {
+        if ((format.flags & DDPF_FOURCC) != 0)
+        {
+            switch (format.fourCC)
+            {
+            case 36:    return TextureFormat::R16G16B16A16Unorm;    // D3DFMT_A16B16G16R16
+            case 111:   return TextureFormat::R16Float;             // D3DFMT_R16F
+            case 112:   return TextureFormat::R16G16Float;          // D3DFMT_G16R16F
+            case 113:   return TextureFormat::R16G16B16A16Float;    // D3DFMT_A16B16G16R16F
+            case 114:   return TextureFormat::R32Float;             // D3DFMT_R32F
+            case 115:   return TextureFormat::R32G32Float;          // D3DFMT_G32R32F
+            case 116:   return TextureFormat::R32G32B32A32Float;    // D3DFMT_A32B32G32R32F
+            }
+
+            if (format.fourCC == MakeFourCC('D', 'X', 'T', '1'))
+            {
+                return TextureFormat::Bc1Unorm;
+            }
+            else if (format.fourCC == MakeFourCC('D', 'X', 'T', '2') || format.fourCC == MakeFourCC('D', 'X', 'T', '3'))
+            {
+                return TextureFormat::Bc2Unorm;
+            }
+            else if (format.fourCC == MakeFourCC('D', 'X', 'T', '4') || format.fourCC == MakeFourCC('D', 'X', 'T', '5'))
+            {
+                return TextureFormat::Bc3Unorm;
+            }
+            else if (format.fourCC == MakeFourCC('A', 'T', 'I', '1') || format.fourCC == MakeFourCC('B', 'C', '4', 'U'))
+            {
+                return TextureFormat::Bc4Unorm;
+            }
+            else if (format.fourCC == MakeFourCC('B', 'C', '4', 'S'))
+            {
+                return TextureFormat::Bc4Snorm;
+            }
+            else if (format.fourCC == MakeFourCC('A', 'T', 'I', '2') || format.fourCC == MakeFourCC('B', 'C', '5', 'U'))
+            {
+                return TextureFormat::Bc5Unorm;
+            }
+            else if (format.fourCC == MakeFourCC('B', 'C', '5', 'S'))
+            {
+                return TextureFormat::Bc5Snorm;
+            }
+
+            return TextureFormat::Unknown;
+        }
+
+        if ((format.flags & DDPF_RGB) != 0)
+        {
+            if (format.rgbBitCount == 32)
+            {
+                if (HasMasks(format, 0x000000FF, 0x0000FF00, 0x00FF0000, 0xFF000000))
+                {
+                    return TextureFormat::R8G8B8A8Unorm;
+                }
+                else if (HasMasks(format, 0x00FF0000, 0x0000FF00, 0x000000FF, 0xFF000000))
+                {
+                    return TextureFormat::B8G8R8A8Unorm;
+                }
+                else if (HasMasks(format, 0x00FF0000, 0x0000FF00, 0x000000FF, 0))
+                {
+                    return TextureFormat::B8G8R8X8Unorm;
+                }
+                else if (HasMasks(format, 0x000003FF, 0x000FFC00, 0x3FF00000, 0xC0000000))
+                {
+                    return TextureFormat::R10G10B10A2Unorm;
+                }
+                else if (HasMasks(format, 0x0000FFFF, 0xFFFF0000, 0, 0))
+                {
+                    return TextureFormat::R16G16Unorm;
+                }
+                else if (HasMasks(format, 0xFFFFFFFF, 0, 0, 0))
+                {
+                    return TextureFormat::R32Float;
+                }
+            }
+            else if (format.rgbBitCount == 16)
+            {
+                if (HasMasks(format, 0xF800, 0x07E0, 0x001F, 0))
+                {
+                    return TextureFormat::B5G6R5Unorm;
+                }
+                else if (HasMasks(format, 0x7C00, 0x03E0, 0x001F, 0x8000))
+                {
+                    return TextureFormat::B5G5R5A1Unorm;
+                }
+            }
+
+            return TextureFormat::Unknown;
+        }
+
+        if ((format.flags & DDPF_LUMINANCE) != 0)
+        {
+            if (format.rgbBitCount == 8 && format.rBitMask == 0xFF)
+            {
+                return TextureFormat::R8Unorm;
+            }
+            else if (format.rgbBitCount == 16 && format.rBitMask == 0xFFFF && (format.flags & DDPF_ALPHAPIXELS) == 0)
+            {
+                return TextureFormat::R16Unorm;
+            }
+            else if (format.rgbBitCount == 16 && format.rBitMask == 0xFF && format.aBitMask == 0xFF00)
+            {
+                return TextureFormat::R8G8Unorm;
+            }
+
+            return TextureFormat::Unknown;
+        }
+
+        if ((format.flags & DDPF_ALPHA) != 0 && format.rgbBitCount == 8)
+        {
+            return TextureFormat::A8Unorm;
+        }
+
+        return TextureFormat::Unknown;
+    }
+
+    // Number of mips in a full chain down to 1x1x1.
+    unsigned int FullMipCount(unsigned int width, unsigned int height, unsigned int depth)
+    {
+        unsigned int largest = std::max(width, std::max(height, depth));
+        unsigned int count = 1;
+
+        while (largest > 1)
+        {
+            largest >>= 1;
+            ++count;
+        }
+
+        return count;
+    }
+}
+
+bool TextureFormats::IsSupported(TextureFormat format)
+{
+    return FindFormat(format) != nullptr;
+}
+
+bool TextureFormats::IsBlockCompressed(TextureFormat format)
+{
+    const FormatInfo * pInfo = FindFormat(format);
+    return pInfo != nullptr && pInfo->isBlockCompressed;
+}
+
+unsigned int TextureFormats::ElementSize(TextureFormat format)
+{
+    const FormatInfo * pInfo = FindFormat(format);
+    return pInfo != nullptr ? pInfo->elementSize : 0;
+}
+
+void TextureFormats::SurfacePitch(
+    TextureFormat format,
+    unsigned int width,
+    unsigned int height,
+    size_t * pRowPitchOut,
+    unsigned int * pRowCountOut)
+{
+    VerifyNotNull(pRowPitchOut);
+    VerifyNotNull(pRowCountOut);
+
+    const FormatInfo * pInfo = FindFormat(format);
+
+    if (pInfo == nullptr)
+    {
+        *pRowPitchOut = 0;
+        *pRowCountOut = 0;
+    }
+    else if (pInfo->isBlockCompressed)
+    {
+        *pRowPitchOut = static_cast<size_t>(std::max(1u, (width + BLOCK_SIZE - 1) / BLOCK_SIZE)) * pInfo->elementSize;
+        *pRowCountOut = std::max(1u, (height + BLOCK_SIZE - 1) / BLOCK_SIZE);
+    }
+    else
+    {
+        *pRowPitchOut = static_cast<size_t>(width) * pInfo->elementSize;
+        *pRowCountOut = height;
+    }
+}
+
+const char * TextureFormats::Name(TextureFormat format)
+{
+    const FormatInfo * pInfo = FindFormat(format);
+    return pInfo != nullptr ? pInfo->pName : "UNKNOWN";
+}
+
+DdsFile::DdsFile()
+    : mFile(),
+      mData(),
+      mHeader(),
+      mFormat(TextureFormat::Unknown),
+      mWidth(0),
+      mHeight(0),
+      mDepth(0),
+      mMipCount(0),
+      mItemCount(0),
+      mIsCubeMap(false),
+      mHasDx10Header(false),
+      mDataOffset(0),
+      mItemSize(0),
+      mMipOffsets()
+{
+}
+
+DdsFile::~DdsFile()
+{
+    Close();
+}
+
+bool DdsFile::Open(const std::wstring& path, const char ** ppReasonOut)
+{
+    Close();
+
+    if (!mFile.Open(path))
+    {
+        if (ppReasonOut != nullptr)
+        {
+            *ppReasonOut = "file is missing or could not be mapped";
+        }
+
+        return false;
+    }
+
+    if (!Attach(ByteSpan(mFile.Data(), mFile.Size()), ppReasonOut))
+    {
+        mFile.Close();
+        return false;
+    }
+
+    return true;
+}
+
+bool DdsFile::Open(const ByteSpan& data, const char ** ppReasonOut)
+{
+    Close();
+    return Attach(data, ppReasonOut);
+}
+
+void DdsFile::Close()
+{
+    mFile.Close();
+    mData = ByteSpan();
+    std::memset(&mHeader, 0, sizeof(mHeader));
+    mFormat = TextureFormat::Unknown;
+    mWidth = 0;
+    mHeight = 0;
+    mDepth = 0;
+    mMipCount = 0;
+    mItemCount = 0;
+    mIsCubeMap = false;
+    mHasDx10Header = false;
+    mDataOffset = 0;
+    mItemSize = 0;
+    mMipOffsets.clear();
+}
+
+/**
+ * Validates the headers of a DDS file in memory and works out where each surface is. The headers are
+ * copied out rather than read in place, so the bytes can have any alignment.
+ */
+bool DdsFile::Attach(const ByteSpan& data, const char ** ppReasonOut)
+{
+    const char * pReason = nullptr;
+    unsigned int magic = 0;
+
+    if (data.size < sizeof(magic) + sizeof(DdsHeader))
+    {
+        pReason = "not a DDS file";
+    }
+    else
+    {
+        std::memcpy(&magic, data.pData, sizeof(magic));
+        std::memcpy(&mHeader, data.pData + sizeof(magic), sizeof(DdsHeader));
+
+        mDataOffset = sizeof(magic) + sizeof(DdsHeader);
+
+        if (magic != MAGIC || mHeader.size != sizeof(DdsHeader) || mHeader.pixelFormat.size != sizeof(DdsPixelFormat))
+        {
+            pReason = "not a DDS file";
+        }
+        else if ((mHeader.pixelFormat.flags & DDPF_FOURCC) != 0 && mHeader.pixelFormat.fourCC == MakeFourCC('D', 'X', '1', '0'))
+        {
+            DdsHeaderDx10 header;
+
+            if (data.size < mDataOffset + sizeof(DdsHeaderDx10))
+            {
+                pReason = "file is truncated or corrupt";
+            }
+            else
+            {
+                std::memcpy(&header, data.pData + mDataOffset, sizeof(header));
+                mDataOffset += sizeof(header);
+                mHasDx10Header = true;
+
+                ReadDx10Header(header, &pReason);
+            }
+        }
+        else
+        {
+            ReadLegacyFormat(&pReason);
+        }
+    }
+
+    if (pReason == nullptr)
+    {
+        mMipCount = ((mHeader.flags & DDSD_MIPMAPCOUNT) != 0 && mHeader.mipMapCount > 0) ? mHeader.mipMapCount : 1;
+
+        if (mWidth == 0 || mHeight == 0 || mDepth == 0 ||
+            mWidth > MAX_DIMENSION || mHeight > MAX_DIMENSION || mDepth > MAX_DIMENSION)
+        {
+            pReason = "texture dimensions are out of range";
+        }
+        else if (mItemCount == 0 ||
+                 mItemCount > MAX_ARRAY_SIZE * (mIsCubeMap ? CUBE_FACE_COUNT : 1) ||
+                 (mDepth > 1 && mItemCount > 1))
+        {
+            pReason = "texture array size is out of range";
+        }
+        else if (mIsCubeMap && mWidth != mHeight)
+        {
+            pReason = "cube map faces are not square";
+        }
+        else if (mMipCount > FullMipCount(mWidth, mHeight, mDepth))
+        {
+            pReason = "texture has more mips than its size allows";
+        }
+    }
+
+    if (pReason == nullptr)
+    {
+        unsigned long long itemSize = 0;
+
+        mMipOffsets.resize(mMipCount + 1);
+
+        for (unsigned int mip = 0; mip < mMipCount; ++mip)
+        {
+            size_t rowPitch = 0;
+            unsigned int rowCount = 0;
+            TextureFormats::SurfacePitch(mFormat, MipWidth(mip), MipHeight(mip), &rowPitch, &rowCount);
+
+            mMipOffsets[mip] = static_cast<size_t>(itemSize);
+            itemSize += static_cast<unsigned long long>(rowPitch) * rowCount * MipDepth(mip);
+        }
+
+        // Volumes can't be arrays, so with the limits above this is at most 2^60 bytes and can't overflow.
+        if (itemSize * mItemCount > data.size - mDataOffset)
+        {
+            pReason = "file is truncated or corrupt";
+        }
+        else
+        {
+            mMipOffsets[mMipCount] = static_cast<size_t>(itemSize);
+            mItemSize = static_cast<size_t>(itemSize);
+        }
+    }
+
+    if (pReason != nullptr)
+    {
+        Close();
+
+        if (ppReasonOut != nullptr)
+        {
+            *ppReasonOut = pReason;
+        }
+
+        return false;
+    }
+
+    mData = data;
+    return true;
+}
+
+bool DdsFile::ReadLegacyFormat(const char ** ppReasonOut)
+{
+    mFormat = LegacyFormat(mHeader.pixelFormat);
+    mWidth = mHeader.width;
+    mHeight = mHeader.height;
+    mDepth = 1;
+    mItemCount = 1;
+
+    if ((mHeader.caps2 & DDSCAPS2_VOLUME) != 0 && (mHeader.flags & DDSD_DEPTH) != 0)
+    {
+        mDepth = mHeader.depth;
+    }
+    else if ((mHeader.caps2 & DDSCAPS2_CUBEMAP) != 0)
+    {
+        // Cube maps without every face can't be made into a texture cube.
+        if ((mHeader.caps2 & DDSCAPS2_CUBEMAP_ALL_FACES) != DDSCAPS2_CUBEMAP_ALL_FACES)
+        {
+            *ppReasonOut = "cube map is missing faces";
+            return false;
+        }
+
+        mIsCubeMap = true;
+        mItemCount = CUBE_FACE_COUNT;
+    }
+
+    if (mFormat == TextureFormat::Unknown)
+    {
+        *ppReasonOut = "unsupported pixel format";
+        return false;
+    }
+
+    return true;
+}
+
+bool DdsFile::ReadDx10Header(const DdsHeaderDx10& header, const char ** ppReasonOut)
+{
+    mFormat = static_cast<TextureFormat>(header.dxgiFormat);
+    mWidth = mHeader.width;
+    mHeight = 1;
+    mDepth = 1;
+    mItemCount = header.arraySize;
+
+    if (!TextureFormats::IsSupported(mFormat))
+    {
+        *ppReasonOut = "unsupported pixel format";
+        return false;
+    }
+
+    switch (header.resourceDimension)
+    {
+    case DX10_DIMENSION_TEXTURE1D:
+        if ((mHeader.flags & DDSD_DEPTH) != 0 && mHeader.depth > 1)
+        {
+            *ppReasonOut = "one dimensional texture has depth";
+            return false;
+        }
+        mHeight = std::max(mHeader.height, 1u);
+        break;
+
+    case DX10_DIMENSION_TEXTURE2D:
+        mHeight = mHeader.height;
+
+        if ((header.miscFlag & DX10_MISC_TEXTURECUBE) != 0)
+        {
+            mIsCubeMap = true;
+            mItemCount = (header.arraySize <= MAX_ARRAY_SIZE) ? header.arraySize * CUBE_FACE_COUNT : 0;
+        }
+        break;
+
+    case DX10_DIMENSION_TEXTURE3D:
+        if (header.arraySize != 1)
+        {
+            *ppReasonOut = "volume texture arrays are not allowed";
+            return false;
+        }
+        mHeight = mHeader.height;
+        mDepth = mHeader.depth;
+        break;
+
+    default:
+        *ppReasonOut = "unknown resource dimension";
+        return false;
+    }
+
+    return true;
+}
+
+unsigned int DdsFile::MipWidth(unsigned int mip) const
+{
+    return std::max(mWidth >> mip, 1u);
+}
+
+unsigned int DdsFile::MipHeight(unsigned int mip) const
+{
+    return std::max(mHeight >> mip, 1u);
+}
+
+unsigned int DdsFile::MipDepth(unsigned int mip) const
+{
+    return std::max(mDepth >> mip, 1u);
+}
+
+size_t DdsFile::MipSize(unsigned int mip) const
+{
+    assert(mip < mMipCount);
+    return mMipOffsets[mip + 1] - mMipOffsets[mip];
+}
+
+DdsSurface DdsFile::Surface(unsigned int item, unsigned int mip) const
+{
+    assert(item < mItemCount && mip < mMipCount);
+
+    DdsSurface surface;
+    unsigned int rowCount = 0;
+
+    surface.width = MipWidth(mip);
+    surface.height = MipHeight(mip);
+    surface.depth = MipDepth(mip);
+    TextureFormats::SurfacePitch(mFormat, surface.width, surface.height, &surface.rowPitch, &rowCount);
+    surface.slicePitch = surface.rowPitch * rowCount;
+    surface.data = ByteSpan(mData.pData + mDataOffset + item * mItemSize + mMipOffsets[mip], MipSize(mip));
+
+    return surface;
+}
+
+void DdsFile::Prefetch(unsigned int mip) const
+{
+    for (unsigned int item = 0; item < mItemCount; ++item)
+    {
+        DdsSurface surface = Surface(item, mip);
+        MappedFile::Prefetch(surface.data.pData, surface.data.size);
+    }
+}
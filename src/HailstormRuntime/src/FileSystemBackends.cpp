@@ -0,0 +1,190 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "stdafx.h"
+#include "runtime/FileSystemBackends.h"
+#include "runtime/debugging.h"
+
+#include <algorithm>
+
+#include "runtime/AlignedBuffer.h"
+#include "runtime/MappedFile.h"
+#include "runtime/StringUtils.h"
+
+#if defined(_WIN32)
+#   ifndef WIN32_LEAN_AND_MEAN
+#       define WIN32_LEAN_AND_MEAN
+#   endif
+#   include <windows.h>
+#else
+#   include <sys/stat.h>
+#endif
+
+namespace
+{
+    // Alignment of decompressed archive entries, which matches the default alignment of entries
+    // inside an archive (and is what mesh files need).
+    const size_t DECOMPRESSED_ALIGNMENT = AssetArchiveWriter::DEFAULT_ALIGNMENT;
+}
+
+DirectoryBackend::DirectoryBackend(const std::wstring& directory)
+    : mDirectory(directory)
+{
+}
+
+bool DirectoryBackend::Open(const VirtualPath& path, VirtualFile * pFileOut) const
+{
+    std::unique_ptr<MappedFile> pMappedFile(new MappedFile());
+
+    if (!pMappedFile->Open(NativePath(path)))
+    {
+        return false;
+    }
+
+    pFileOut->Attach(std::move(pMappedFile));
+    return true;
+}
+
+bool DirectoryBackend::Exists(const VirtualPath& path) const
+{
+#if defined(_WIN32)
+    DWORD attributes = GetFileAttributesW(NativePath(path).c_str());
+    return attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY) == 0;
+#else
+    std::wstring nativePath = NativePath(path);
+    struct stat info;
+
+    return stat(std::string(nativePath.begin(), nativePath.end()).c_str(), &info) == 0 && S_ISREG(info.st_mode);
+#endif
+}
+
+/**
+ * Uses the path with its case kept, for file systems that are case sensitive.
+ */
+std::wstring DirectoryBackend::NativePath(const VirtualPath& path) const
+{
+#if defined(_WIN32)
+    std::wstring relativePath = Utils::ConvertUtf8ToWideString(path.name);
+    std::replace(relativePath.begin(), relativePath.end(), L'/', L'\\');
+
+    return mDirectory + L"\\" + relativePath;
+#else
+    return mDirectory + L"/" + Utils::ConvertUtf8ToWideString(path.name);
+#endif
+}
+
+ArchiveBackend::ArchiveBackend()
+    : mArchive()
+{
+}
+
+bool ArchiveBackend::Open(const std::wstring& archivePath, const char ** ppReasonOut)
+{
+    return mArchive.Open(archivePath, ppReasonOut);
+}
+
+bool ArchiveBackend::Open(const VirtualPath& path, VirtualFile * pFileOut) const
+{
+    const ArchiveEntry * pEntry = Find(path);
+
+    if (pEntry == nullptr)
+    {
+        return false;
+    }
+
+    if (pEntry->compression == ArchiveCompression::None)
+    {
+        pFileOut->Attach(mArchive.Data(*pEntry));
+        return true;
+    }
+
+    // Compressed entries are decompressed into a buffer the file owns.
+    std::unique_ptr<AlignedBuffer> pBuffer(new AlignedBuffer(static_cast<size_t>(pEntry->size), DECOMPRESSED_ALIGNMENT));
+
+    if (!mArchive.Decompress(*pEntry, pBuffer->Data()))
+    {
+        return false;
+    }
+
+    pFileOut->Attach(std::move(pBuffer));
+    return true;
+}
+
+bool ArchiveBackend::Exists(const VirtualPath& path) const
+{
+    return Find(path) != nullptr;
+}
+
+/**
+ * Looks the entry up by its hash, then checks the stored path to rule out a hash collision.
+ */
+const ArchiveEntry * ArchiveBackend::Find(const VirtualPath& path) const
+{
+    const ArchiveEntry * pEntry = mArchive.IsOpen() ? mArchive.Find(path.hash) : nullptr;
+
+    if (pEntry != nullptr && path.normalized != mArchive.Name(*pEntry))
+    {
+        return nullptr;
+    }
+
+    return pEntry;
+}
+
+MemoryBackend::MemoryBackend()
+    : mFiles()
+{
+}
+
+void MemoryBackend::Add(const std::string& path, const void * pData, size_t size)
+{
+    Verify(pData != nullptr || size == 0);
+
+    VirtualPath virtualPath = VirtualFileSystem::MakePath(path);
+    const unsigned char * pBytes = static_cast<const unsigned char *>(pData);
+    File& file = mFiles[virtualPath.hash];
+
+    file.path = virtualPath.normalized;
+    file.data.assign(pBytes, pBytes + size);
+}
+
+bool MemoryBackend::Open(const VirtualPath& path, VirtualFile * pFileOut) const
+{
+    const File * pFile = Find(path);
+
+    if (pFile == nullptr)
+    {
+        return false;
+    }
+
+    pFileOut->Attach(ByteSpan(pFile->data.empty() ? nullptr : &pFile->data[0], pFile->data.size()));
+    return true;
+}
+
+bool MemoryBackend::Exists(const VirtualPath& path) const
+{
+    return Find(path) != nullptr;
+}
+
+const MemoryBackend::File * MemoryBackend::Find(const VirtualPath& path) const
+{
+    auto itr = mFiles.find(path.hash);
+
+    if (itr == mFiles.end() || itr->second.path != path.normalized)
+    {
+        return nullptr;
+    }
+
+    return &itr->second;
+}
@@ -0,0 +1,40 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "stdafx.h"
+#include "runtime/Hash.h"
+
+namespace
+{
+    const unsigned long long FNV1A_64_PRIME = 1099511628211ull;
+}
+
+unsigned long long Hash::Fnv1a64(const void * pData, size_t size, unsigned long long hash)
+{
+    const unsigned char * pBytes = reinterpret_cast<const unsigned char *>(pData);
+
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash ^= pBytes[i];
+        hash *= FNV1A_64_PRIME;
+    }
+
+    return hash;
+}
+
+unsigned long long Hash::Fnv1a64(const std::string& text, unsigned long long hash)
+{
+    return Fnv1a64(text.data(), text.size(), hash);
+}
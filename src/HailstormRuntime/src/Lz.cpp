@@ -0,0 +1,945 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "stdafx.h"
+#include "runtime/Lz.h"
+#include "runtime/debugging.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+#include "runtime/Parallel.h"
+
+#if defined(_MSC_VER)
+#   include <intrin.h>
+#endif
+
+static_assert(sizeof(LzFrameHeader) == 32, "Frame header must not contain padding");
+
+namespace
+{
+    const unsigned int FRAME_MAGIC = 0x5A4C5348;        // "HSLZ"
+
+    // Bump this whenever the frame or block format changes.
+    const unsigned int FRAME_VERSION = 1;
+
+    const size_t MIN_MATCH = 4;
+    const size_t MAX_OFFSET = 65535;
+
+    // The block format requires the last five bytes of a block to be literals and the last match to
+    // start at least twelve bytes before the end, which lets decoders copy in wide chunks.
+    const size_t LAST_LITERALS = 5;
+    const size_t MATCH_FIND_LIMIT = 12;
+
+    const unsigned int FAST_HASH_BITS = 14;
+    const unsigned int CHAIN_HASH_BITS = 15;
+    const unsigned int WINDOW_MASK = 0xFFFF;
+    const unsigned int NO_POSITION = 0xFFFFFFFFu;
+
+    // Levels at and above this look one byte ahead for a longer match before taking one.
+    const int LAZY_LEVEL = 6;
+
+    unsigned int Read16(const unsigned char * p)
+    {
+        return p[0] | (static_cast<unsigned int>(p[1]) << 8);
+    }
+
+    unsigned int Read32(const unsigned char * p)
+    {
+        unsigned int value;
+        std::memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+    unsigned long long Read64(const unsigned char * p)
+    {
+        unsigned long long value;
+        std::memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+    void Copy8(unsigned char * pOut, const unsigned char * pIn)
+    {
+        std::memcpy(pOut, pIn, 8);
+    }
+
+    void Copy16(unsigned char * pOut, const unsigned char * pIn)
+    {
+        std::memcpy(pOut, pIn, 16);
+    }
+
+    unsigned int Hash4(unsigned int value, unsigned int bits)
+    {
+        return (value * 2654435761u) >> (32 - bits);
+    }
+
+    // Index of the lowest non zero byte of a non zero little endian value.
+    unsigned int LowestSetByte(unsigned long long value)
+    {
+#if defined(_MSC_VER) && defined(_M_X64)
+        unsigned long index;
+        _BitScanForward64(&index, value);
+        return index >> 3;
+#elif defined(_MSC_VER)
+        unsigned long index;
+
+        if (_BitScanForward(&index, static_cast<unsigned long>(value)))
+        {
+            return index >> 3;
+        }
+
+        _BitScanForward(&index, static_cast<unsigned long>(value >> 32));
+        return 4 + (index >> 3);
+#else
+        return static_cast<unsigned int>(__builtin_ctzll(value)) >> 3;
+#endif
+    }
+
+    // Count how many bytes at p match the bytes at pMatch, stopping at pLimit.
+    size_t MatchLength(const unsigned char * p, const unsigned char * pMatch, const unsigned char * pLimit)
+    {
+        const unsigned char * pStart = p;
+
+        while (p + 8 <= pLimit)
+        {
+            unsigned long long difference = Read64(p) ^ Read64(pMatch);
+
+            if (difference != 0)
+            {
+                return static_cast<size_t>(p - pStart) + LowestSetByte(difference);
+            }
+
+            p += 8;
+            pMatch += 8;
+        }
+
+        while (p < pLimit && *p == *pMatch)
+        {
+            ++p;
+            ++pMatch;
+        }
+
+        return static_cast<size_t>(p - pStart);
+    }
+
+    // Lengths that don't fit in a token's four bits continue in bytes of 255 and a final smaller byte.
+    unsigned char * WriteLength(unsigned char * pOut, size_t length)
+    {
+        for (; length >= 255; length -= 255)
+        {
+            *pOut++ = 255;
+        }
+
+        *pOut++ = static_cast<unsigned char>(length);
+        return pOut;
+    }
+
+    bool ReadLength(const unsigned char ** ppIn, const unsigned char * pInEnd, size_t * pLengthOut)
+    {
+        unsigned int byte = 255;
+
+        while (byte == 255)
+        {
+            if (*ppIn >= pInEnd)
+            {
+                return false;
+            }
+
+            byte = *(*ppIn)++;
+            *pLengthOut += byte;
+        }
+
+        return true;
+    }
+
+    // Write a sequence of literals followed by a match. The last sequence in a block has literals
+    // only, which is written by passing a match length of zero.
+    unsigned char * WriteSequence(
+        unsigned char * pOut,
+        const unsigned char * pLiterals,
+        size_t literalCount,
+        size_t offset,
+        size_t matchLength)
+    {
+        unsigned char * pToken = pOut++;
+        unsigned int token = 0;
+
+        if (literalCount >= 15)
+        {
+            token = 15 << 4;
+            pOut = WriteLength(pOut, literalCount - 15);
+        }
+        else
+        {
+            token = static_cast<unsigned int>(literalCount) << 4;
+        }
+
+        std::memcpy(pOut, pLiterals, literalCount);
+        pOut += literalCount;
+
+        if (matchLength > 0)
+        {
+            size_t lengthCode = matchLength - MIN_MATCH;
+
+            pOut[0] = static_cast<unsigned char>(offset);
+            pOut[1] = static_cast<unsigned char>(offset >> 8);
+            pOut += 2;
+
+            if (lengthCode >= 15)
+            {
+                token |= 15;
+                pOut = WriteLength(pOut, lengthCode - 15);
+            }
+            else
+            {
+                token |= static_cast<unsigned int>(lengthCode);
+            }
+        }
+
+        *pToken = static_cast<unsigned char>(token);
+        return pOut;
+    }
+
+    /**
+     * Level one: a single hash table slot per four byte prefix and a greedy parse. The step between
+     * positions grows while no matches are found, so incompressible data is skipped through quickly.
+     */
+    size_t CompressFast(const unsigned char * pIn, size_t size, unsigned char * pOut)
+    {
+        unsigned char * const pOutStart = pOut;
+        const unsigned char * const pInEnd = pIn + size;
+        const unsigned char * pAnchor = pIn;
+
+        if (size > MATCH_FIND_LIMIT)
+        {
+            const unsigned char * const pMatchLimit = pInEnd - LAST_LITERALS;
+            const unsigned char * const pFindLimit = pInEnd - MATCH_FIND_LIMIT;
+            std::vector<unsigned int> table(1u << FAST_HASH_BITS, 0);
+            const unsigned char * p = pIn + 1;
+            unsigned int missCount = 0;
+
+            while (p < pFindLimit)
+            {
+                unsigned int& slot = table[Hash4(Read32(p), FAST_HASH_BITS)];
+                const unsigned char * pMatch = pIn + slot;
+                slot = static_cast<unsigned int>(p - pIn);
+
+                if (static_cast<size_t>(p - pMatch) > MAX_OFFSET || Read32(pMatch) != Read32(p))
+                {
+                    p += 1 + (missCount++ >> 6);
+                    continue;
+                }
+
+                missCount = 0;
+
+                while (p > pAnchor && pMatch > pIn && p[-1] == pMatch[-1])
+                {
+                    --p;
+                    --pMatch;
+                }
+
+                size_t length = MIN_MATCH + MatchLength(p + MIN_MATCH, pMatch + MIN_MATCH, pMatchLimit);
+
+                pOut = WriteSequence(pOut, pAnchor, static_cast<size_t>(p - pAnchor), static_cast<size_t>(p - pMatch), length);
+                p += length;
+                pAnchor = p;
+
+                if (p < pFindLimit)
+                {
+                    table[Hash4(Read32(p - 2), FAST_HASH_BITS)] = static_cast<unsigned int>(p - 2 - pIn);
+                }
+            }
+        }
+
+        pOut = WriteSequence(pOut, pAnchor, static_cast<size_t>(pInEnd - pAnchor), 0, 0);
+        return static_cast<size_t>(pOut - pOutStart);
+    }
+
+    /**
+     * Finds the longest match for a position by walking a chain of earlier positions with the same
+     * hash, newest first. Chain links are stored as distances in a table indexed by position within the
+     * 64 KB window, so the tables stay the same size however large the block is.
+     */
+    class ChainMatcher
+    {
+    public:
+        ChainMatcher(const unsigned char * pIn, unsigned int maxAttempts)
+            : mpIn(pIn),
+              mHeads(1u << CHAIN_HASH_BITS, NO_POSITION),
+              mLinks(WINDOW_MASK + 1, 0),
+              mNextInsert(0),
+              mMaxAttempts(maxAttempts)
+        {
+        }
+
+        size_t Find(const unsigned char * p, const unsigned char * pMatchLimit, const unsigned char ** ppMatchOut)
+        {
+            unsigned int position = static_cast<unsigned int>(p - mpIn);
+
+            while (mNextInsert < position)
+            {
+                Insert(mNextInsert++);
+            }
+
+            unsigned int candidate = mHeads[Hash4(Read32(p), CHAIN_HASH_BITS)];
+            size_t bestLength = 0;
+
+            for (unsigned int attempt = 0;
+                 attempt < mMaxAttempts && candidate != NO_POSITION && position - candidate <= MAX_OFFSET;
+                 ++attempt)
+            {
+                const unsigned char * pCandidate = mpIn + candidate;
+
+                // Checking the byte that would make the match longer than the best one first rejects
+                // most candidates without a full comparison.
+                if (pCandidate[bestLength] == p[bestLength] && Read32(pCandidate) == Read32(p))
+                {
+                    size_t length = MIN_MATCH + MatchLength(p + MIN_MATCH, pCandidate + MIN_MATCH, pMatchLimit);
+
+                    if (length > bestLength)
+                    {
+                        bestLength = length;
+                        *ppMatchOut = pCandidate;
+
+                        if (p + length >= pMatchLimit)
+                        {
+                            break;
+                        }
+                    }
+                }
+
+                unsigned int distance = mLinks[candidate & WINDOW_MASK];
+
+                if (distance == 0)
+                {
+                    break;
+                }
+
+                candidate -= distance;
+            }
+
+            return bestLength;
+        }
+
+    private:
+        void Insert(unsigned int position)
+        {
+            unsigned int& head = mHeads[Hash4(Read32(mpIn + position), CHAIN_HASH_BITS)];
+            unsigned int distance = (head == NO_POSITION || position - head > MAX_OFFSET) ? 0 : position - head;
+
+            mLinks[position & WINDOW_MASK] = static_cast<unsigned short>(distance);
+            head = position;
+        }
+
+    private:
+        const unsigned char * mpIn;
+        std::vector<unsigned int> mHeads;
+        std::vector<unsigned short> mLinks;
+        unsigned int mNextInsert;
+        unsigned int mMaxAttempts;
+    };
+
+    /**
+     * Levels two and up: hash chains, searching twice as many candidates per level, and from
+     * LAZY_LEVEL on a one byte lazy parse.
+     */
+    size_t CompressChain(const unsigned char * pIn, size_t size, unsigned char * pOut, int level)
+    {
+        unsigned char * const pOutStart = pOut;
+        const unsigned char * const pInEnd = pIn + size;
+        const unsigned char * pAnchor = pIn;
+
+        if (size > MATCH_FIND_LIMIT)
+        {
+            const unsigned char * const pMatchLimit = pInEnd - LAST_LITERALS;
+            const unsigned char * const pFindLimit = pInEnd - MATCH_FIND_LIMIT;
+            ChainMatcher matcher(pIn, 1u << level);
+            const unsigned char * p = pIn;
+
+            while (p < pFindLimit)
+            {
+                const unsigned char * pMatch = nullptr;
+                size_t length = matcher.Find(p, pMatchLimit, &pMatch);
+
+                if (length < MIN_MATCH)
+                {
+                    ++p;
+                    continue;
+                }
+
+                while (level >= LAZY_LEVEL && p + 1 < pFindLimit)
+                {
+                    const unsigned char * pNextMatch = nullptr;
+                    size_t nextLength = matcher.Find(p + 1, pMatchLimit, &pNextMatch);
+
+                    if (nextLength <= length)
+                    {
+                        break;
+                    }
+
+                    ++p;
+                    length = nextLength;
+                    pMatch = pNextMatch;
+                }
+
+                pOut = WriteSequence(pOut, pAnchor, static_cast<size_t>(p - pAnchor), static_cast<size_t>(p - pMatch), length);
+                p += length;
+                pAnchor = p;
+            }
+        }
+
+        pOut = WriteSequence(pOut, pAnchor, static_cast<size_t>(pInEnd - pAnchor), 0, 0);
+        return static_cast<size_t>(pOut - pOutStart);
+    }
+
+    // Decompressed size of a frame's block.
+    size_t BlockSize(const LzFrameHeader& header, unsigned int index)
+    {
+        return static_cast<size_t>(std::min<unsigned long long>(header.blockSize, header.size - static_cast<unsigned long long>(index) * header.blockSize));
+    }
+
+    // Check that the block starting at offset lies inside the frame and move offset past it.
+    bool SkipBlock(const ByteSpan& frame, size_t * pOffset)
+    {
+        unsigned int storedSize;
+
+        if (frame.size - *pOffset < sizeof(storedSize))
+        {
+            return false;
+        }
+
+        std::memcpy(&storedSize, frame.pData + *pOffset, sizeof(storedSize));
+        storedSize &= ~LZ_RAW_BLOCK_FLAG;
+        *pOffset += sizeof(storedSize);
+
+        if (frame.size - *pOffset < storedSize)
+        {
+            return false;
+        }
+
+        *pOffset += storedSize;
+        return true;
+    }
+
+    // Decompress the block at offset, which SkipBlock has already checked.
+    bool DecodeBlock(const ByteSpan& frame, size_t offset, unsigned char * pOut, size_t size)
+    {
+        unsigned int storedSize;
+        std::memcpy(&storedSize, frame.pData + offset, sizeof(storedSize));
+
+        const unsigned char * pBlock = frame.pData + offset + sizeof(storedSize);
+
+        if ((storedSize & LZ_RAW_BLOCK_FLAG) != 0)
+        {
+            if ((storedSize & ~LZ_RAW_BLOCK_FLAG) != size)
+            {
+                return false;
+            }
+
+            std::memcpy(pOut, pBlock, size);
+            return true;
+        }
+
+        return Lz::DecompressBlock(pBlock, storedSize, pOut, size);
+    }
+
+    // Compress a block for a frame, falling back to storing it raw when that would be smaller.
+    void EncodeBlock(const unsigned char * pIn, size_t size, int level, std::vector<unsigned char> * pBlockOut)
+    {
+        unsigned int storedSize;
+
+        pBlockOut->resize(sizeof(storedSize) + Lz::CompressBlockBound(size));
+
+        size_t compressedSize = Lz::CompressBlock(pIn, size, &(*pBlockOut)[sizeof(storedSize)], level);
+
+        if (compressedSize < size)
+        {
+            storedSize = static_cast<unsigned int>(compressedSize);
+        }
+        else
+        {
+            std::memcpy(&(*pBlockOut)[sizeof(storedSize)], pIn, size);
+            storedSize = static_cast<unsigned int>(size) | LZ_RAW_BLOCK_FLAG;
+            compressedSize = size;
+        }
+
+        std::memcpy(&(*pBlockOut)[0], &storedSize, sizeof(storedSize));
+        pBlockOut->resize(sizeof(storedSize) + compressedSize);
+    }
+
+    LzFrameHeader MakeHeader(int level, unsigned int blockSize, unsigned int blockCount, unsigned long long size)
+    {
+        LzFrameHeader header = { 0 };
+
+        header.magic = FRAME_MAGIC;
+        header.version = FRAME_VERSION;
+        header.blockSize = blockSize;
+        header.blockCount = blockCount;
+        header.size = size;
+        header.level = static_cast<unsigned int>(level);
+
+        return header;
+    }
+}
+
+LzParams::LzParams()
+    : level(Lz::DEFAULT_LEVEL),
+      blockSize(Lz::DEFAULT_BLOCK_SIZE),
+      threadCount(1)
+{
+}
+
+size_t Lz::CompressBlockBound(size_t size)
+{
+    return size + size / 255 + 16;
+}
+
+size_t Lz::CompressBlock(const void * pData, size_t size, void * pOut, int level)
+{
+    Verify(pData != nullptr || size == 0);
+    Verify(size <= MAX_BLOCK_SIZE);
+    Verify(level >= MIN_LEVEL && level <= MAX_LEVEL);
+
+    const unsigned char * pIn = static_cast<const unsigned char *>(pData);
+    unsigned char * pBytesOut = static_cast<unsigned char *>(pOut);
+
+    return level == MIN_LEVEL ? CompressFast(pIn, size, pBytesOut) : CompressChain(pIn, size, pBytesOut, level);
+}
+
+/**
+ * Copies in 16 or 8 byte chunks whenever there is room left in the output for a chunk to overrun the
+ * end of the run it copies, which it almost always has outside of the last few bytes of a block. Short
+ * repeating patterns (offsets under 8) are copied a byte at a time for one period and then in chunks
+ * from a whole number of periods back.
+ *
+ * Most sequences have fewer than 15 literals and a match of under 19 bytes, which fit in the token
+ * alone. Those take a shortcut with fixed size copies and no length bytes to read, as long as the match
+ * is far enough back not to overlap the bytes it copies to.
+ */
+bool Lz::DecompressBlock(const void * pData, size_t storedSize, void * pOut, size_t size)
+{
+    const unsigned char * pIn = static_cast<const unsigned char *>(pData);
+    const unsigned char * const pInEnd = pIn + storedSize;
+    unsigned char * pOutput = static_cast<unsigned char *>(pOut);
+    unsigned char * const pOutStart = pOutput;
+    unsigned char * const pOutEnd = pOutput + size;
+
+    for (;;)
+    {
+        if (pIn >= pInEnd)
+        {
+            return false;
+        }
+
+        unsigned int token = *pIn++;
+        size_t literalCount = token >> 4;
+        size_t length = token & 15;
+
+        if (literalCount < 15 && length < 15 && pInEnd - pIn >= 32 && pOutEnd - pOutput >= 48)
+        {
+            Copy16(pOutput, pIn);
+            pIn += literalCount;
+            pOutput += literalCount;
+
+            size_t offset = Read16(pIn);
+
+            if (offset >= 16 && offset <= static_cast<size_t>(pOutput - pOutStart))
+            {
+                const unsigned char * pMatch = pOutput - offset;
+                length += MIN_MATCH;
+
+                Copy16(pOutput, pMatch);
+
+                if (length > 16)
+                {
+                    Copy8(pOutput + 16, pMatch + 16);
+                }
+
+                pIn += 2;
+                pOutput += length;
+                continue;
+            }
+
+            // The match overlaps its own output (or is corrupt), so finish it the slow way.
+        }
+        else
+        {
+            if (literalCount == 15 && !ReadLength(&pIn, pInEnd, &literalCount))
+            {
+                return false;
+            }
+
+            if (literalCount > static_cast<size_t>(pInEnd - pIn) || literalCount > static_cast<size_t>(pOutEnd - pOutput))
+            {
+                return false;
+            }
+
+            if (literalCount <= 16 && pInEnd - pIn >= 16 && pOutEnd - pOutput >= 16)
+            {
+                Copy16(pOutput, pIn);
+            }
+            else
+            {
+                std::memcpy(pOutput, pIn, literalCount);
+            }
+
+            pIn += literalCount;
+            pOutput += literalCount;
+
+            if (pIn == pInEnd)
+            {
+                // The last sequence has no match.
+                return pOutput == pOutEnd;
+            }
+
+            if (pInEnd - pIn < 2)
+            {
+                return false;
+            }
+        }
+
+        size_t offset = Read16(pIn);
+        pIn += 2;
+
+        if (offset == 0 || offset > static_cast<size_t>(pOutput - pOutStart))
+        {
+            return false;
+        }
+
+        if (length == 15 && !ReadLength(&pIn, pInEnd, &length))
+        {
+            return false;
+        }
+
+        length += MIN_MATCH;
+
+        if (length > static_cast<size_t>(pOutEnd - pOutput))
+        {
+            return false;
+        }
+
+        const unsigned char * pMatch = pOutput - offset;
+        unsigned char * const pMatchEnd = pOutput + length;
+
+        if (pOutEnd - pMatchEnd < 16)
+        {
+            while (pOutput < pMatchEnd)
+            {
+                *pOutput++ = *pMatch++;
+            }
+        }
+        else if (offset >= 16)
+        {
+            for (; pOutput < pMatchEnd; pOutput += 16, pMatch += 16)
+            {
+                Copy16(pOutput, pMatch);
+            }
+        }
+        else if (offset >= 8)
+        {
+            for (; pOutput < pMatchEnd; pOutput += 8, pMatch += 8)
+            {
+                Copy8(pOutput, pMatch);
+            }
+        }
+        else
+        {
+            size_t period = offset;
+
+            while (period < 8)
+            {
+                period += offset;
+            }
+
+            for (size_t i = 0; i < period; ++i)
+            {
+                pOutput[i] = pMatch[i];
+            }
+
+            for (pOutput += period; pOutput < pMatchEnd; pOutput += 8)
+            {
+                Copy8(pOutput, pOutput - period);
+            }
+        }
+
+        pOutput = pMatchEnd;
+    }
+}
+
+void Lz::Compress(const void * pData, size_t size, const LzParams& params, std::vector<unsigned char> * pFrameOut)
+{
+    Verify(pData != nullptr || size == 0);
+    Verify(params.level >= MIN_LEVEL && params.level <= MAX_LEVEL);
+    Verify(params.blockSize > 0 && params.blockSize <= MAX_BLOCK_SIZE);
+    VerifyNotNull(pFrameOut);
+
+    const unsigned char * pIn = static_cast<const unsigned char *>(pData);
+    unsigned int blockCount = static_cast<unsigned int>((size + params.blockSize - 1) / params.blockSize);
+    std::vector<std::vector<unsigned char>> blocks(blockCount);
+
+    if (blockCount > 0)
+    {
+        Parallel::For(blockCount, params.threadCount, [&](unsigned int index, unsigned int)
+        {
+            size_t offset = static_cast<size_t>(index) * params.blockSize;
+            EncodeBlock(pIn + offset, std::min<size_t>(params.blockSize, size - offset), params.level, &blocks[index]);
+        });
+    }
+
+    LzFrameHeader header = MakeHeader(params.level, params.blockSize, blockCount, size);
+    const unsigned char * pHeader = reinterpret_cast<const unsigned char *>(&header);
+
+    pFrameOut->insert(pFrameOut->end(), pHeader, pHeader + sizeof(header));
+
+    for (unsigned int i = 0; i < blockCount; ++i)
+    {
+        pFrameOut->insert(pFrameOut->end(), blocks[i].begin(), blocks[i].end());
+    }
+}
+
+bool Lz::ReadHeader(const ByteSpan& frame, LzFrameHeader * pHeaderOut)
+{
+    VerifyNotNull(pHeaderOut);
+
+    if (frame.size < sizeof(LzFrameHeader))
+    {
+        return false;
+    }
+
+    LzFrameHeader header;
+    std::memcpy(&header, frame.pData, sizeof(header));
+
+    if (header.magic != FRAME_MAGIC ||
+        header.version != FRAME_VERSION ||
+        header.blockSize == 0 ||
+        header.blockSize > MAX_BLOCK_SIZE ||
+        header.size > static_cast<size_t>(-1) ||
+        header.blockCount != (header.size + header.blockSize - 1) / header.blockSize)
+    {
+        return false;
+    }
+
+    *pHeaderOut = header;
+    return true;
+}
+
+/**
+ * Walks the block sizes to find where every block starts, then decompresses the blocks independently,
+ * in parallel if asked to.
+ */
+bool Lz::Decompress(const ByteSpan& frame, void * pOut, size_t size, unsigned int threadCount)
+{
+    Verify(pOut != nullptr || size == 0);
+
+    LzFrameHeader header;
+
+    if (!ReadHeader(frame, &header) || header.size != size)
+    {
+        return false;
+    }
+
+    std::vector<size_t> offsets(header.blockCount);
+    size_t offset = sizeof(LzFrameHeader);
+
+    for (unsigned int i = 0; i < header.blockCount; ++i)
+    {
+        offsets[i] = offset;
+
+        if (!SkipBlock(frame, &offset))
+        {
+            return false;
+        }
+    }
+
+    if (offset != frame.size)
+    {
+        return false;
+    }
+
+    unsigned char * pBytesOut = static_cast<unsigned char *>(pOut);
+    std::atomic<bool> isCorrupt(false);
+
+    auto decode = [&](unsigned int index, unsigned int)
+    {
+        if (!DecodeBlock(frame, offsets[index], pBytesOut + static_cast<size_t>(index) * header.blockSize, BlockSize(header, index)))
+        {
+            isCorrupt = true;
+        }
+    };
+
+    if (threadCount == 1 || header.blockCount < 2)
+    {
+        for (unsigned int i = 0; i < header.blockCount && !isCorrupt; ++i)
+        {
+            decode(i, 0);
+        }
+    }
+    else
+    {
+        Parallel::For(header.blockCount, threadCount, decode);
+    }
+
+    return !isCorrupt;
+}
+
+LzStreamWriter::LzStreamWriter(std::vector<unsigned char> * pFrameOut, int level, unsigned int blockSize)
+    : mpFrame(pFrameOut),
+      mHeaderOffset(0),
+      mLevel(level),
+      mBlockSize(blockSize),
+      mBlockCount(0),
+      mSize(0),
+      mBlock(),
+      mCompressed(),
+      mFinished(false)
+{
+    VerifyNotNull(pFrameOut);
+    Verify(level >= Lz::MIN_LEVEL && level <= Lz::MAX_LEVEL);
+    Verify(blockSize > 0 && blockSize <= Lz::MAX_BLOCK_SIZE);
+
+    // Leave room for the header, which is written once the size is known.
+    mHeaderOffset = mpFrame->size();
+    mpFrame->resize(mHeaderOffset + sizeof(LzFrameHeader), 0);
+    mBlock.reserve(blockSize);
+}
+
+void LzStreamWriter::Write(const void * pData, size_t size)
+{
+    Verify(!mFinished);
+    Verify(pData != nullptr || size == 0);
+
+    const unsigned char * pIn = static_cast<const unsigned char *>(pData);
+
+    while (size > 0)
+    {
+        size_t count = std::min<size_t>(size, mBlockSize - mBlock.size());
+
+        mBlock.insert(mBlock.end(), pIn, pIn + count);
+        pIn += count;
+        size -= count;
+        mSize += count;
+
+        if (mBlock.size() == mBlockSize)
+        {
+            FlushBlock();
+        }
+    }
+}
+
+void LzStreamWriter::Finish()
+{
+    Verify(!mFinished);
+
+    if (!mBlock.empty())
+    {
+        FlushBlock();
+    }
+
+    LzFrameHeader header = MakeHeader(mLevel, mBlockSize, mBlockCount, mSize);
+    std::memcpy(&(*mpFrame)[mHeaderOffset], &header, sizeof(header));
+
+    mFinished = true;
+}
+
+void LzStreamWriter::FlushBlock()
+{
+    EncodeBlock(&mBlock[0], mBlock.size(), mLevel, &mCompressed);
+
+    mpFrame->insert(mpFrame->end(), mCompressed.begin(), mCompressed.end());
+    mBlock.clear();
+    ++mBlockCount;
+}
+
+LzStreamReader::LzStreamReader()
+    : mFrame(),
+      mHeader(),
+      mNextBlockOffset(0),
+      mNextBlock(0),
+      mBlock(),
+      mBlockPosition(0),
+      mPosition(0),
+      mIsCorrupt(false)
+{
+}
+
+bool LzStreamReader::Open(const ByteSpan& frame)
+{
+    mFrame = frame;
+    mNextBlockOffset = sizeof(LzFrameHeader);
+    mNextBlock = 0;
+    mBlock.clear();
+    mBlockPosition = 0;
+    mPosition = 0;
+    mIsCorrupt = false;
+
+    if (!Lz::ReadHeader(frame, &mHeader))
+    {
+        mFrame = ByteSpan();
+        mHeader = LzFrameHeader();
+        return false;
+    }
+
+    return true;
+}
+
+size_t LzStreamReader::Read(void * pOut, size_t size)
+{
+    Verify(pOut != nullptr || size == 0);
+
+    unsigned char * pBytesOut = static_cast<unsigned char *>(pOut);
+    size_t readCount = 0;
+
+    while (readCount < size)
+    {
+        if (mBlockPosition == mBlock.size() && !DecodeNextBlock())
+        {
+            break;
+        }
+
+        size_t count = std::min(size - readCount, mBlock.size() - mBlockPosition);
+
+        std::memcpy(pBytesOut + readCount, &mBlock[mBlockPosition], count);
+        mBlockPosition += count;
+        readCount += count;
+    }
+
+    mPosition += readCount;
+    return readCount;
+}
+
+bool LzStreamReader::DecodeNextBlock()
+{
+    if (mIsCorrupt || mNextBlock >= mHeader.blockCount)
+    {
+        return false;
+    }
+
+    size_t offset = mNextBlockOffset;
+    size_t size = BlockSize(mHeader, mNextBlock);
+
+    mBlock.resize(size);
+    mBlockPosition = 0;
+
+    if (!SkipBlock(mFrame, &mNextBlockOffset) || !DecodeBlock(mFrame, offset, mBlock.empty() ? nullptr : &mBlock[0], size))
+    {
+        mBlock.clear();
+        mIsCorrupt = true;
+        return false;
+    }
+
+    ++mNextBlock;
+    return true;
+}
@@ -0,0 +1,204 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "stdafx.h"
+#include "runtime/MappedFile.h"
+
+#if defined(_WIN32)
+#   ifndef WIN32_LEAN_AND_MEAN
+#       define WIN32_LEAN_AND_MEAN
+#   endif
+#   include <windows.h>
+#else
+#   include <fcntl.h>
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#   include <unistd.h>
+#   include <cstdlib>
+#endif
+
+MappedFile::MappedFile()
+    : mpData(nullptr),
+      mSize(0)
+#if defined(_WIN32)
+      , mFileHandle(INVALID_HANDLE_VALUE),
+      mMappingHandle(nullptr)
+#endif
+{
+}
+
+MappedFile::~MappedFile()
+{
+    Close();
+}
+
+#if defined(_WIN32)
+
+bool MappedFile::Open(const std::wstring& path)
+{
+    Close();
+
+    mFileHandle = ::CreateFileW(
+        path.c_str(),
+        GENERIC_READ,
+        FILE_SHARE_READ,
+        nullptr,
+        OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+        nullptr);
+
+    if (mFileHandle == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    LARGE_INTEGER fileSize;
+
+    if (!::GetFileSizeEx(mFileHandle, &fileSize) || fileSize.QuadPart == 0)
+    {
+        Close();
+        return false;
+    }
+
+    mMappingHandle = ::CreateFileMappingW(mFileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+    if (mMappingHandle == nullptr)
+    {
+        Close();
+        return false;
+    }
+
+    mpData = reinterpret_cast<const unsigned char *>(::MapViewOfFile(mMappingHandle, FILE_MAP_READ, 0, 0, 0));
+    mSize = static_cast<size_t>(fileSize.QuadPart);
+
+    if (mpData == nullptr)
+    {
+        Close();
+        return false;
+    }
+
+    return true;
+}
+
+void MappedFile::Close()
+{
+    if (mpData != nullptr)
+    {
+        ::UnmapViewOfFile(mpData);
+    }
+
+    if (mMappingHandle != nullptr)
+    {
+        ::CloseHandle(mMappingHandle);
+    }
+
+    if (mFileHandle != INVALID_HANDLE_VALUE)
+    {
+        ::CloseHandle(mFileHandle);
+    }
+
+    mpData = nullptr;
+    mSize = 0;
+    mMappingHandle = nullptr;
+    mFileHandle = INVALID_HANDLE_VALUE;
+}
+
+#else
+
+bool MappedFile::Open(const std::wstring& path)
+{
+    Close();
+
+    // Paths are converted with the current C locale, which is UTF-8 on any reasonable system.
+    std::string nativePath(path.size() * 4 + 1, '\0');
+    size_t length = std::wcstombs(&nativePath[0], path.c_str(), nativePath.size());
+
+    if (length == static_cast<size_t>(-1))
+    {
+        return false;
+    }
+
+    nativePath.resize(length);
+
+    int fd = ::open(nativePath.c_str(), O_RDONLY);
+
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    struct stat info;
+
+    if (::fstat(fd, &info) != 0 || info.st_size == 0)
+    {
+        ::close(fd);
+        return false;
+    }
+
+    void * pView = ::mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);            // The mapping keeps its own reference to the file.
+
+    if (pView == MAP_FAILED)
+    {
+        return false;
+    }
+
+    mpData = reinterpret_cast<const unsigned char *>(pView);
+    mSize = static_cast<size_t>(info.st_size);
+
+    return true;
+}
+
+void MappedFile::Close()
+{
+    if (mpData != nullptr)
+    {
+        ::munmap(const_cast<unsigned char *>(mpData), mSize);
+    }
+
+    mpData = nullptr;
+    mSize = 0;
+}
+
+#endif
+
+void MappedFile::Prefetch() const
+{
+    Prefetch(mpData, mSize);
+}
+
+/**
+ * Reads one byte from every page. The sum is stored through a volatile so the reads can't be
+ * optimized away.
+ */
+void MappedFile::Prefetch(const void * pData, size_t size)
+{
+    const size_t PAGE_SIZE = 4096;
+    const unsigned char * pBytes = static_cast<const unsigned char *>(pData);
+    unsigned char sum = 0;
+
+    for (size_t offset = 0; offset < size; offset += PAGE_SIZE)
+    {
+        sum += pBytes[offset];
+    }
+
+    if (size > 0)
+    {
+        sum += pBytes[size - 1];
+    }
+
+    volatile unsigned char sink = sum;
+    (void) sink;
+}
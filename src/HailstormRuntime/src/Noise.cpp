@@ -0,0 +1,559 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "stdafx.h"
+#include "runtime/Noise.h"
+#include "runtime/debugging.h"
+
+#include <emmintrin.h>      // SSE2
+
+#if defined(__AVX2__)
+#   include <immintrin.h>   // AVX2
+#endif
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+using namespace Noise;
+
+namespace
+{
+    // Hashing constants. Any large odd numbers with well mixed bits will do.
+    const unsigned int HASH_PRIME_X = 0x27D4EB2Du;
+    const unsigned int HASH_PRIME_Y = 0x165667B1u;
+    const unsigned int HASH_MIX_1   = 0x7FEB352Du;
+    const unsigned int HASH_MIX_2   = 0x846CA68Bu;
+    const unsigned int OCTAVE_SEED_STEP = 0x9E3779B9u;
+
+    // Simplex skew factors, (sqrt(3) - 1) / 2 and (3 - sqrt(3)) / 6.
+    const float SIMPLEX_F2 = 0.366025403784f;
+    const float SIMPLEX_G2 = 0.211324865405f;
+
+    // Scales that bring each basis into [-1, 1].
+    const float PERLIN_SCALE  = 1.0f;
+    const float SIMPLEX_SCALE = 70.0f;
+
+    /**
+     * 4 wide SSE2 operations used by the noise kernels.
+     */
+    struct Sse
+    {
+        typedef __m128 Float;
+        typedef __m128i Int;
+        enum { Width = 4 };
+
+        static Float Load(const float * p) { return _mm_loadu_ps(p); }
+        static void Store(float * p, Float v) { _mm_storeu_ps(p, v); }
+        static Float Set(float v) { return _mm_set1_ps(v); }
+        static Int SetI(unsigned int v) { return _mm_set1_epi32(static_cast<int>(v)); }
+
+        static Float Add(Float a, Float b) { return _mm_add_ps(a, b); }
+        static Float Sub(Float a, Float b) { return _mm_sub_ps(a, b); }
+        static Float Mul(Float a, Float b) { return _mm_mul_ps(a, b); }
+        static Float Min(Float a, Float b) { return _mm_min_ps(a, b); }
+        static Float Max(Float a, Float b) { return _mm_max_ps(a, b); }
+        static Float Sqrt(Float a) { return _mm_sqrt_ps(a); }
+        static Float And(Float a, Float b) { return _mm_and_ps(a, b); }
+        static Float Xor(Float a, Float b) { return _mm_xor_ps(a, b); }
+        static Float Greater(Float a, Float b) { return _mm_cmpgt_ps(a, b); }
+
+        static Float Floor(Float v)
+        {
+            // SSE2 has no floor instruction. Truncate, and step down by one for negative values that
+            // had a fractional part.
+            Float t = _mm_cvtepi32_ps(_mm_cvttps_epi32(v));
+            return _mm_sub_ps(t, _mm_and_ps(_mm_cmplt_ps(v, t), _mm_set1_ps(1.0f)));
+        }
+
+        static Int ToInt(Float v) { return _mm_cvttps_epi32(v); }
+        static Float ToFloat(Int v) { return _mm_cvtepi32_ps(v); }
+        static Float AsFloat(Int v) { return _mm_castsi128_ps(v); }
+
+        static Int AddI(Int a, Int b) { return _mm_add_epi32(a, b); }
+        static Int AndI(Int a, Int b) { return _mm_and_si128(a, b); }
+        static Int XorI(Int a, Int b) { return _mm_xor_si128(a, b); }
+        static Int ShiftRightI(Int a, int bits) { return _mm_srli_epi32(a, bits); }
+        static Int ShiftLeftI(Int a, int bits) { return _mm_slli_epi32(a, bits); }
+
+        static Int MulI(Int a, Int b)
+        {
+            // SSE2 can only multiply the even lanes (_mm_mullo_epi32 is SSE4.1), so multiply the even
+            // and odd lanes separately and shuffle the low halves back together.
+            Int even = _mm_mul_epu32(a, b);
+            Int odd  = _mm_mul_epu32(_mm_srli_si128(a, 4), _mm_srli_si128(b, 4));
+
+            return _mm_unpacklo_epi32(
+                _mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+                _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+        }
+    };
+
+#if defined(__AVX2__)
+    /**
+     * 8 wide AVX2 operations used by the noise kernels.
+     */
+    struct Avx2
+    {
+        typedef __m256 Float;
+        typedef __m256i Int;
+        enum { Width = 8 };
+
+        static Float Load(const float * p) { return _mm256_loadu_ps(p); }
+        static void Store(float * p, Float v) { _mm256_storeu_ps(p, v); }
+        static Float Set(float v) { return _mm256_set1_ps(v); }
+        static Int SetI(unsigned int v) { return _mm256_set1_epi32(static_cast<int>(v)); }
+
+        static Float Add(Float a, Float b) { return _mm256_add_ps(a, b); }
+        static Float Sub(Float a, Float b) { return _mm256_sub_ps(a, b); }
+        static Float Mul(Float a, Float b) { return _mm256_mul_ps(a, b); }
+        static Float Min(Float a, Float b) { return _mm256_min_ps(a, b); }
+        static Float Max(Float a, Float b) { return _mm256_max_ps(a, b); }
+        static Float Sqrt(Float a) { return _mm256_sqrt_ps(a); }
+        static Float And(Float a, Float b) { return _mm256_and_ps(a, b); }
+        static Float Xor(Float a, Float b) { return _mm256_xor_ps(a, b); }
+        static Float Greater(Float a, Float b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+        static Float Floor(Float v) { return _mm256_floor_ps(v); }
+
+        static Int ToInt(Float v) { return _mm256_cvttps_epi32(v); }
+        static Float ToFloat(Int v) { return _mm256_cvtepi32_ps(v); }
+        static Float AsFloat(Int v) { return _mm256_castsi256_ps(v); }
+
+        static Int AddI(Int a, Int b) { return _mm256_add_epi32(a, b); }
+        static Int AndI(Int a, Int b) { return _mm256_and_si256(a, b); }
+        static Int XorI(Int a, Int b) { return _mm256_xor_si256(a, b); }
+        static Int MulI(Int a, Int b) { return _mm256_mullo_epi32(a, b); }
+        static Int ShiftRightI(Int a, int bits) { return _mm256_srli_epi32(a, bits); }
+        static Int ShiftLeftI(Int a, int bits) { return _mm256_slli_epi32(a, bits); }
+    };
+#endif
+
+    ///////////////////////////////////////////////////////////////////////////////////////////////
+    // Noise kernels. These are written once against the operations above, which guarantees that
+    // the SSE and AVX2 paths perform exactly the same arithmetic in the same order.
+    ///////////////////////////////////////////////////////////////////////////////////////////////
+    template<class S>
+    typename S::Int Hash(typename S::Int x, typename S::Int y, typename S::Int seed)
+    {
+        typename S::Int h = S::XorI(
+            seed,
+            S::XorI(S::MulI(x, S::SetI(HASH_PRIME_X)), S::MulI(y, S::SetI(HASH_PRIME_Y))));
+
+        h = S::MulI(S::XorI(h, S::ShiftRightI(h, 16)), S::SetI(HASH_MIX_1));
+        h = S::MulI(S::XorI(h, S::ShiftRightI(h, 15)), S::SetI(HASH_MIX_2));
+        return S::XorI(h, S::ShiftRightI(h, 16));
+    }
+
+    // Quintic fade curve, 6t^5 - 15t^4 + 10t^3.
+    template<class S>
+    typename S::Float Fade(typename S::Float t)
+    {
+        typename S::Float inner = S::Add(S::Mul(t, S::Sub(S::Mul(t, S::Set(6.0f)), S::Set(15.0f))), S::Set(10.0f));
+        return S::Mul(S::Mul(S::Mul(t, t), t), inner);
+    }
+
+    template<class S>
+    typename S::Float Lerp(typename S::Float a, typename S::Float b, typename S::Float t)
+    {
+        return S::Add(a, S::Mul(S::Sub(b, a), t));
+    }
+
+    // Convert the low 24 bits of a hash into a value in [-1, 1].
+    template<class S>
+    typename S::Float HashToSigned(typename S::Int h)
+    {
+        typename S::Float v = S::ToFloat(S::AndI(h, S::SetI(0x00FFFFFFu)));
+        return S::Sub(S::Mul(v, S::Set(2.0f / 16777215.0f)), S::Set(1.0f));
+    }
+
+    // Dot product of (dx, dy) with one of the four diagonal gradients selected by the hash.
+    template<class S>
+    typename S::Float GradientDot(typename S::Int h, typename S::Float dx, typename S::Float dy)
+    {
+        typename S::Float signX = S::AsFloat(S::ShiftLeftI(h, 31));
+        typename S::Float signY = S::AsFloat(S::ShiftLeftI(S::ShiftRightI(h, 1), 31));
+
+        return S::Add(S::Xor(dx, signX), S::Xor(dy, signY));
+    }
+
+    template<class S>
+    typename S::Float ValueNoise(typename S::Float x, typename S::Float y, typename S::Int seed)
+    {
+        typename S::Float fx = S::Floor(x);
+        typename S::Float fy = S::Floor(y);
+        typename S::Int x0 = S::ToInt(fx);
+        typename S::Int y0 = S::ToInt(fy);
+        typename S::Int x1 = S::AddI(x0, S::SetI(1));
+        typename S::Int y1 = S::AddI(y0, S::SetI(1));
+
+        typename S::Float u = Fade<S>(S::Sub(x, fx));
+        typename S::Float v = Fade<S>(S::Sub(y, fy));
+
+        typename S::Float v00 = HashToSigned<S>(Hash<S>(x0, y0, seed));
+        typename S::Float v10 = HashToSigned<S>(Hash<S>(x1, y0, seed));
+        typename S::Float v01 = HashToSigned<S>(Hash<S>(x0, y1, seed));
+        typename S::Float v11 = HashToSigned<S>(Hash<S>(x1, y1, seed));
+
+        return Lerp<S>(Lerp<S>(v00, v10, u), Lerp<S>(v01, v11, u), v);
+    }
+
+    template<class S>
+    typename S::Float PerlinNoise(typename S::Float x, typename S::Float y, typename S::Int seed)
+    {
+        typename S::Float fx = S::Floor(x);
+        typename S::Float fy = S::Floor(y);
+        typename S::Int x0 = S::ToInt(fx);
+        typename S::Int y0 = S::ToInt(fy);
+        typename S::Int x1 = S::AddI(x0, S::SetI(1));
+        typename S::Int y1 = S::AddI(y0, S::SetI(1));
+
+        typename S::Float dx0 = S::Sub(x, fx);
+        typename S::Float dy0 = S::Sub(y, fy);
+        typename S::Float dx1 = S::Sub(dx0, S::Set(1.0f));
+        typename S::Float dy1 = S::Sub(dy0, S::Set(1.0f));
+
+        typename S::Float n00 = GradientDot<S>(Hash<S>(x0, y0, seed), dx0, dy0);
+        typename S::Float n10 = GradientDot<S>(Hash<S>(x1, y0, seed), dx1, dy0);
+        typename S::Float n01 = GradientDot<S>(Hash<S>(x0, y1, seed), dx0, dy1);
+        typename S::Float n11 = GradientDot<S>(Hash<S>(x1, y1, seed), dx1, dy1);
+
+        typename S::Float u = Fade<S>(dx0);
+        typename S::Float v = Fade<S>(dy0);
+
+        return S::Mul(Lerp<S>(Lerp<S>(n00, n10, u), Lerp<S>(n01, n11, u), v), S::Set(PERLIN_SCALE));
+    }
+
+    // Contribution of a single simplex corner, max(0, 0.5 - d^2)^4 * (g . d)
+    template<class S>
+    typename S::Float SimplexCorner(typename S::Int h, typename S::Float dx, typename S::Float dy)
+    {
+        typename S::Float t = S::Sub(S::Sub(S::Set(0.5f), S::Mul(dx, dx)), S::Mul(dy, dy));
+        t = S::Max(t, S::Set(0.0f));
+        t = S::Mul(t, t);
+
+        return S::Mul(S::Mul(t, t), GradientDot<S>(h, dx, dy));
+    }
+
+    template<class S>
+    typename S::Float SimplexNoise(typename S::Float x, typename S::Float y, typename S::Int seed)
+    {
+        // Skew the input space to find which simplex cell we are in.
+        typename S::Float s = S::Mul(S::Add(x, y), S::Set(SIMPLEX_F2));
+        typename S::Float i = S::Floor(S::Add(x, s));
+        typename S::Float j = S::Floor(S::Add(y, s));
+
+        // Unskew the cell origin back to (x, y) space and find the distances from it.
+        typename S::Float t = S::Mul(S::Add(i, j), S::Set(SIMPLEX_G2));
+        typename S::Float x0 = S::Sub(x, S::Sub(i, t));
+        typename S::Float y0 = S::Sub(y, S::Sub(j, t));
+
+        // Work out which of the two triangles in the cell we are in.
+        typename S::Float i1 = S::And(S::Greater(x0, y0), S::Set(1.0f));
+        typename S::Float j1 = S::Sub(S::Set(1.0f), i1);
+
+        typename S::Float x1 = S::Add(S::Sub(x0, i1), S::Set(SIMPLEX_G2));
+        typename S::Float y1 = S::Add(S::Sub(y0, j1), S::Set(SIMPLEX_G2));
+        typename S::Float x2 = S::Add(S::Sub(x0, S::Set(1.0f)), S::Set(2.0f * SIMPLEX_G2));
+        typename S::Float y2 = S::Add(S::Sub(y0, S::Set(1.0f)), S::Set(2.0f * SIMPLEX_G2));
+
+        typename S::Int ii = S::ToInt(i);
+        typename S::Int jj = S::ToInt(j);
+        typename S::Int one = S::SetI(1);
+
+        typename S::Float n0 = SimplexCorner<S>(Hash<S>(ii, jj, seed), x0, y0);
+        typename S::Float n1 = SimplexCorner<S>(
+            Hash<S>(S::AddI(ii, S::ToInt(i1)), S::AddI(jj, S::ToInt(j1)), seed), x1, y1);
+        typename S::Float n2 = SimplexCorner<S>(Hash<S>(S::AddI(ii, one), S::AddI(jj, one), seed), x2, y2);
+
+        return S::Mul(S::Add(S::Add(n0, n1), n2), S::Set(SIMPLEX_SCALE));
+    }
+
+    template<class S>
+    typename S::Float WorleyNoise(typename S::Float x, typename S::Float y, typename S::Int seed)
+    {
+        typename S::Float fx = S::Floor(x);
+        typename S::Float fy = S::Floor(y);
+        typename S::Int cellX = S::ToInt(fx);
+        typename S::Int cellY = S::ToInt(fy);
+        typename S::Float localX = S::Sub(x, fx);
+        typename S::Float localY = S::Sub(y, fy);
+
+        typename S::Float closest = S::Set(8.0f);
+        const float INV_65536 = 1.0f / 65536.0f;
+
+        // Each cell holds a single feature point. The closest point must lie in the 3x3 block of cells
+        // around the sample.
+        for (int oy = -1; oy <= 1; ++oy)
+        {
+            for (int ox = -1; ox <= 1; ++ox)
+            {
+                typename S::Int h = Hash<S>(
+                    S::AddI(cellX, S::SetI(static_cast<unsigned int>(ox))),
+                    S::AddI(cellY, S::SetI(static_cast<unsigned int>(oy))),
+                    seed);
+
+                typename S::Float px = S::Mul(S::ToFloat(S::AndI(h, S::SetI(0xFFFFu))), S::Set(INV_65536));
+                typename S::Float py = S::Mul(S::ToFloat(S::ShiftRightI(h, 16)), S::Set(INV_65536));
+
+                typename S::Float dx = S::Sub(S::Add(px, S::Set(static_cast<float>(ox))), localX);
+                typename S::Float dy = S::Sub(S::Add(py, S::Set(static_cast<float>(oy))), localY);
+
+                closest = S::Min(closest, S::Add(S::Mul(dx, dx), S::Mul(dy, dy)));
+            }
+        }
+
+        // F1 lies within [0, ~1], so remap it to [-1, 1] like the other bases.
+        typename S::Float f1 = S::Min(S::Sqrt(closest), S::Set(1.0f));
+        return S::Sub(S::Mul(f1, S::Set(2.0f)), S::Set(1.0f));
+    }
+
+    template<class S>
+    typename S::Float SampleBasis(
+        NoiseBasis basis,
+        typename S::Float x,
+        typename S::Float y,
+        typename S::Int seed)
+    {
+        switch (basis)
+        {
+        case NoiseBasis::Value:
+            return ValueNoise<S>(x, y, seed);
+        case NoiseBasis::Perlin:
+            return PerlinNoise<S>(x, y, seed);
+        case NoiseBasis::Simplex:
+            return SimplexNoise<S>(x, y, seed);
+        case NoiseBasis::Worley:
+            return WorleyNoise<S>(x, y, seed);
+        default:
+            Verify(false && "Unknown noise basis");
+            return S::Set(0.0f);
+        }
+    }
+
+    template<class S>
+    typename S::Float SampleFractal(
+        const FractalParams& params,
+        typename S::Float x,
+        typename S::Float y,
+        unsigned int seed)
+    {
+        typename S::Float sum = S::Set(0.0f);
+        typename S::Float weight = S::Set(1.0f);
+        typename S::Float absMask = S::AsFloat(S::SetI(0x7FFFFFFFu));
+        float frequency = params.frequency;
+        float amplitude = 1.0f;
+
+        for (unsigned int octave = 0; octave < params.octaves; ++octave)
+        {
+            typename S::Int octaveSeed = S::SetI(seed + octave * OCTAVE_SEED_STEP);
+            typename S::Float fx = S::Mul(x, S::Set(frequency));
+            typename S::Float fy = S::Mul(y, S::Set(frequency));
+            typename S::Float n = SampleBasis<S>(params.basis, fx, fy, octaveSeed);
+
+            if (params.type == FractalType::Ridged)
+            {
+                // Musgrave's ridged multifractal: fold the noise into sharp ridges, and let each octave
+                // be weighted by the previous one so that detail accumulates along the ridge lines.
+                typename S::Float signal = S::Sub(S::Set(params.ridgeOffset), S::And(n, absMask));
+                signal = S::Mul(S::Mul(signal, signal), weight);
+
+                weight = S::Min(S::Max(S::Mul(signal, S::Set(2.0f)), S::Set(0.0f)), S::Set(1.0f));
+                sum = S::Add(sum, S::Mul(signal, S::Set(amplitude)));
+            }
+            else
+            {
+                sum = S::Add(sum, S::Mul(n, S::Set(amplitude)));
+            }
+
+            frequency *= params.lacunarity;
+            amplitude *= params.gain;
+        }
+
+        return S::Add(S::Mul(sum, S::Set(params.amplitude)), S::Set(params.bias));
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// Fractal parameters.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+FractalParams::FractalParams()
+    : basis(NoiseBasis::Simplex),
+      type(FractalType::Fbm),
+      octaves(6),
+      frequency(0.01f),
+      lacunarity(2.0f),
+      gain(0.5f),
+      ridgeOffset(1.0f),
+      amplitude(1.0f),
+      bias(0.0f)
+{
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// Noise generator.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+NoiseGenerator::NoiseGenerator(unsigned int seed)
+    : mSeed(seed)
+{
+}
+
+/**
+ * Evaluates a single point. This goes through the SSE kernel with the point broadcast to all lanes so
+ * that a point sampled on its own is bit for bit identical to the same point sampled in a batch.
+ */
+float NoiseGenerator::Evaluate(NoiseBasis basis, float x, float y) const
+{
+    Sse::Float result = SampleBasis<Sse>(basis, Sse::Set(x), Sse::Set(y), Sse::SetI(mSeed));
+    return _mm_cvtss_f32(result);
+}
+
+void NoiseGenerator::Evaluate4(NoiseBasis basis, const float * pX, const float * pY, float * pOut) const
+{
+    Sse::Store(pOut, SampleBasis<Sse>(basis, Sse::Load(pX), Sse::Load(pY), Sse::SetI(mSeed)));
+}
+
+void NoiseGenerator::Evaluate8(NoiseBasis basis, const float * pX, const float * pY, float * pOut) const
+{
+#if defined(__AVX2__)
+    Avx2::Store(pOut, SampleBasis<Avx2>(basis, Avx2::Load(pX), Avx2::Load(pY), Avx2::SetI(mSeed)));
+#else
+    Evaluate4(basis, pX, pY, pOut);
+    Evaluate4(basis, pX + 4, pY + 4, pOut + 4);
+#endif
+}
+
+float NoiseGenerator::EvaluateFractal(const FractalParams& params, float x, float y) const
+{
+    return _mm_cvtss_f32(SampleFractal<Sse>(params, Sse::Set(x), Sse::Set(y), mSeed));
+}
+
+void NoiseGenerator::EvaluateFractal4(
+    const FractalParams& params,
+    const float * pX,
+    const float * pY,
+    float * pOut) const
+{
+    Sse::Store(pOut, SampleFractal<Sse>(params, Sse::Load(pX), Sse::Load(pY), mSeed));
+}
+
+void NoiseGenerator::EvaluateFractal8(
+    const FractalParams& params,
+    const float * pX,
+    const float * pY,
+    float * pOut) const
+{
+#if defined(__AVX2__)
+    Avx2::Store(pOut, SampleFractal<Avx2>(params, Avx2::Load(pX), Avx2::Load(pY), mSeed));
+#else
+    EvaluateFractal4(params, pX, pY, pOut);
+    EvaluateFractal4(params, pX + 4, pY + 4, pOut + 4);
+#endif
+}
+
+/**
+ * Fills a grid with fractal noise, splitting the rows between worker threads.
+ */
+void NoiseGenerator::FillGrid(
+    const FractalParams& params,
+    unsigned int rows,
+    unsigned int cols,
+    float originX,
+    float originY,
+    float stepX,
+    float stepY,
+    float * pOut,
+    unsigned int threadCount) const
+{
+    VerifyNotNull(pOut);
+
+    if (threadCount == 0)
+    {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    threadCount = std::min(threadCount, rows);
+
+    if (threadCount <= 1)
+    {
+        FillRows(params, 0, rows, cols, originX, originY, stepX, stepY, pOut);
+        return;
+    }
+
+    // Each worker takes a contiguous band of rows. Every sample is a pure function of its position, so
+    // the way rows are banded has no effect on the output.
+    std::vector<std::thread> workers;
+    workers.reserve(threadCount);
+
+    unsigned int rowsPerThread = (rows + threadCount - 1) / threadCount;
+
+    for (unsigned int firstRow = 0; firstRow < rows; firstRow += rowsPerThread)
+    {
+        unsigned int lastRow = std::min(rows, firstRow + rowsPerThread);
+
+        workers.push_back(std::thread(
+            &NoiseGenerator::FillRows,
+            this,
+            std::cref(params),
+            firstRow,
+            lastRow,
+            cols,
+            originX,
+            originY,
+            stepX,
+            stepY,
+            pOut));
+    }
+
+    for (size_t i = 0; i < workers.size(); ++i)
+    {
+        workers[i].join();
+    }
+}
+
+void NoiseGenerator::FillRows(
+    const FractalParams& params,
+    unsigned int firstRow,
+    unsigned int lastRow,
+    unsigned int cols,
+    float originX,
+    float originY,
+    float stepX,
+    float stepY,
+    float * pOut) const
+{
+    const unsigned int BATCH = 8;
+    float xs[BATCH], ys[BATCH], values[BATCH];
+
+    for (unsigned int row = firstRow; row < lastRow; ++row)
+    {
+        float y = originY + row * stepY;
+        float * pRow = pOut + static_cast<size_t>(row) * cols;
+
+        for (unsigned int col = 0; col < cols; col += BATCH)
+        {
+            unsigned int count = std::min(BATCH, cols - col);
+
+            // Pad a short final batch by repeating the last column. The padding lanes are discarded.
+            for (unsigned int lane = 0; lane < BATCH; ++lane)
+            {
+                xs[lane] = originX + (col + std::min(lane, count - 1)) * stepX;
+                ys[lane] = y;
+            }
+
+            EvaluateFractal8(params, xs, ys, values);
+            std::copy(values, values + count, pRow + col);
+        }
+    }
+}
@@ -0,0 +1,434 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "stdafx.h"
+#include "runtime/OffsetAllocator.h"
+#include "runtime/debugging.h"
+
+#include <algorithm>
+#include <vector>
+
+#if defined(_MSC_VER)
+#   include <intrin.h>
+#endif
+
+namespace
+{
+    // Index of the highest set bit. value must not be zero.
+    inline unsigned int HighestBit(unsigned int value)
+    {
+#if defined(_MSC_VER)
+        unsigned long index = 0;
+        _BitScanReverse(&index, value);
+        return index;
+#else
+        return 31 - __builtin_clz(value);
+#endif
+    }
+
+    // Index of the lowest set bit. value must not be zero.
+    inline unsigned int LowestBit(unsigned int value)
+    {
+#if defined(_MSC_VER)
+        unsigned long index = 0;
+        _BitScanForward(&index, value);
+        return index;
+#else
+        return __builtin_ctz(value);
+#endif
+    }
+
+    struct ByOffset
+    {
+        explicit ByOffset(const std::vector<unsigned int>& offsets) : mOffsets(offsets) {}
+
+        bool operator ()(unsigned int a, unsigned int b) const { return mOffsets[a] < mOffsets[b]; }
+
+        const std::vector<unsigned int>& mOffsets;
+    };
+}
+
+const OffsetAllocator::NodeIndex OffsetAllocator::NO_NODE;
+const unsigned int OffsetAllocator::MANTISSA_BITS;
+const unsigned int OffsetAllocator::BINS_PER_GROUP;
+const unsigned int OffsetAllocator::GROUP_COUNT;
+const unsigned int OffsetAllocator::BIN_COUNT;
+
+OffsetAllocator::OffsetAllocator(unsigned int capacity)
+    : mCapacity(capacity),
+      mFreeSpace(0),
+      mAllocationCount(0),
+      mGroupMask(0),
+      mNodes(),
+      mUnusedNodes()
+{
+    Verify(capacity > 0);
+    Reset();
+}
+
+/**
+ * Bins below eight hold exactly that size. Above that the bin is the size's exponent and the three
+ * bits under its highest bit, so every size in a bin lies between the bin's size and the next one's.
+ * Free ranges are filed under the bin rounded down, so any range in a bin is at least the bin's size.
+ */
+unsigned int OffsetAllocator::RoundDownToBin(unsigned int size)
+{
+    if (size < BINS_PER_GROUP)
+    {
+        return size;
+    }
+
+    unsigned int shift = HighestBit(size) - MANTISSA_BITS;
+    unsigned int mantissa = (size >> shift) & (BINS_PER_GROUP - 1);
+
+    return ((shift + 1) << MANTISSA_BITS) | mantissa;
+}
+
+/**
+ * Requests are rounded up, so that every free range in the bin (or any bin above it) is big enough.
+ * Rounding up the mantissa can carry into the exponent, which still gives the right bin.
+ */
+unsigned int OffsetAllocator::RoundUpToBin(unsigned int size)
+{
+    unsigned int bin = RoundDownToBin(size);
+
+    if (size >= BINS_PER_GROUP)
+    {
+        unsigned int shift = HighestBit(size) - MANTISSA_BITS;
+        bin += ((size & ((1u << shift) - 1)) != 0) ? 1 : 0;
+    }
+
+    return bin;
+}
+
+OffsetAllocator::Allocation OffsetAllocator::Allocate(unsigned int size)
+{
+    Allocation allocation = { 0, 0, NO_NODE };
+
+    if (size == 0 || size > mFreeSpace)
+    {
+        return allocation;
+    }
+
+    unsigned int firstBin = RoundUpToBin(size);
+    unsigned int bin = (firstBin < BIN_COUNT) ? FindFreeBin(firstBin) : BIN_COUNT;
+    NodeIndex node = (bin < BIN_COUNT) ? mBinHeads[bin] : NO_NODE;
+
+    if (node == NO_NODE)
+    {
+        // Ranges in the bin below the rounded up one are not all big enough, but some may be. This
+        // matters when the allocator is nearly full, eg right after defragmenting.
+        for (node = mBinHeads[RoundDownToBin(size)]; node != NO_NODE && mNodes[node].size < size; node = mNodes[node].binNext)
+        {
+        }
+
+        if (node == NO_NODE)
+        {
+            return allocation;
+        }
+    }
+
+    RemoveFromBin(node);
+
+    // Give the unused end of the range back as a new free node after this one.
+    unsigned int remainder = mNodes[node].size - size;
+
+    if (remainder > 0)
+    {
+        NodeIndex rest = NewNode(mNodes[node].offset + size, remainder, NodeState::Free);
+        NodeIndex next = mNodes[node].neighborNext;
+
+        mNodes[rest].neighborPrevious = node;
+        mNodes[rest].neighborNext = next;
+
+        if (next != NO_NODE)
+        {
+            mNodes[next].neighborPrevious = rest;
+        }
+
+        mNodes[node].neighborNext = rest;
+        mNodes[node].size = size;
+
+        AddToBin(rest);
+    }
+
+    mNodes[node].state = NodeState::Allocated;
+    mFreeSpace -= size;
+    ++mAllocationCount;
+
+    allocation.offset = mNodes[node].offset;
+    allocation.size = size;
+    allocation.node = node;
+    return allocation;
+}
+
+void OffsetAllocator::Free(NodeIndex node)
+{
+    Verify(node < mNodes.size() && mNodes[node].state == NodeState::Allocated);
+
+    mFreeSpace += mNodes[node].size;
+    --mAllocationCount;
+
+    // Merge with free neighbors on either side.
+    NodeIndex previous = mNodes[node].neighborPrevious;
+
+    if (previous != NO_NODE && mNodes[previous].state == NodeState::Free)
+    {
+        RemoveFromBin(previous);
+
+        mNodes[node].offset = mNodes[previous].offset;
+        mNodes[node].size += mNodes[previous].size;
+        mNodes[node].neighborPrevious = mNodes[previous].neighborPrevious;
+
+        if (mNodes[node].neighborPrevious != NO_NODE)
+        {
+            mNodes[mNodes[node].neighborPrevious].neighborNext = node;
+        }
+
+        ReleaseNode(previous);
+    }
+
+    NodeIndex next = mNodes[node].neighborNext;
+
+    if (next != NO_NODE && mNodes[next].state == NodeState::Free)
+    {
+        RemoveFromBin(next);
+
+        mNodes[node].size += mNodes[next].size;
+        mNodes[node].neighborNext = mNodes[next].neighborNext;
+
+        if (mNodes[node].neighborNext != NO_NODE)
+        {
+            mNodes[mNodes[node].neighborNext].neighborPrevious = node;
+        }
+
+        ReleaseNode(next);
+    }
+
+    mNodes[node].state = NodeState::Free;
+    AddToBin(node);
+}
+
+void OffsetAllocator::Reset()
+{
+    mNodes.clear();
+    mUnusedNodes.clear();
+    mFreeSpace = mCapacity;
+    mAllocationCount = 0;
+    mGroupMask = 0;
+
+    std::fill(mBinMasks, mBinMasks + GROUP_COUNT, static_cast<unsigned char>(0));
+    std::fill(mBinHeads, mBinHeads + BIN_COUNT, NO_NODE);
+
+    AddToBin(NewNode(0, mCapacity, NodeState::Free));
+}
+
+void OffsetAllocator::Defragment(std::vector<Move> * pMovesOut)
+{
+    VerifyNotNull(pMovesOut);
+    pMovesOut->clear();
+
+    // Gather the allocations in offset order, and drop every free node.
+    std::vector<NodeIndex> allocated;
+    std::vector<unsigned int> offsets(mNodes.size());
+
+    for (NodeIndex node = 0; node < mNodes.size(); ++node)
+    {
+        offsets[node] = mNodes[node].offset;
+
+        if (mNodes[node].state == NodeState::Allocated)
+        {
+            allocated.push_back(node);
+        }
+        else if (mNodes[node].state == NodeState::Free)
+        {
+            RemoveFromBin(node);
+            ReleaseNode(node);
+        }
+    }
+
+    std::sort(allocated.begin(), allocated.end(), ByOffset(offsets));
+
+    // Pack them from offset zero and relink them in order.
+    unsigned int offset = 0;
+    NodeIndex previous = NO_NODE;
+
+    for (size_t i = 0; i < allocated.size(); ++i)
+    {
+        Node& node = mNodes[allocated[i]];
+
+        if (node.offset != offset)
+        {
+            Move move = { allocated[i], node.offset, offset, node.size };
+            pMovesOut->push_back(move);
+
+            node.offset = offset;
+        }
+
+        node.neighborPrevious = previous;
+        node.neighborNext = NO_NODE;
+
+        if (previous != NO_NODE)
+        {
+            mNodes[previous].neighborNext = allocated[i];
+        }
+
+        previous = allocated[i];
+        offset += node.size;
+    }
+
+    if (offset < mCapacity)
+    {
+        NodeIndex rest = NewNode(offset, mCapacity - offset, NodeState::Free);
+        mNodes[rest].neighborPrevious = previous;
+
+        if (previous != NO_NODE)
+        {
+            mNodes[previous].neighborNext = rest;
+        }
+
+        AddToBin(rest);
+    }
+}
+
+unsigned int OffsetAllocator::Offset(NodeIndex node) const
+{
+    assert(node < mNodes.size() && mNodes[node].state == NodeState::Allocated);
+    return mNodes[node].offset;
+}
+
+unsigned int OffsetAllocator::Size(NodeIndex node) const
+{
+    assert(node < mNodes.size() && mNodes[node].state == NodeState::Allocated);
+    return mNodes[node].size;
+}
+
+unsigned int OffsetAllocator::LargestFreeRange() const
+{
+    if (mGroupMask == 0)
+    {
+        return 0;
+    }
+
+    // Only the highest bin needs searching, since every range in lower bins is smaller.
+    unsigned int group = HighestBit(mGroupMask);
+    unsigned int bin = (group << MANTISSA_BITS) + HighestBit(mBinMasks[group]);
+    unsigned int largest = 0;
+
+    for (NodeIndex node = mBinHeads[bin]; node != NO_NODE; node = mNodes[node].binNext)
+    {
+        largest = std::max(largest, mNodes[node].size);
+    }
+
+    return largest;
+}
+
+/**
+ * Finds the first bin at or above firstBin that has a free node, or BIN_COUNT if there is none.
+ */
+unsigned int OffsetAllocator::FindFreeBin(unsigned int firstBin) const
+{
+    unsigned int group = firstBin >> MANTISSA_BITS;
+    unsigned int binMask = mBinMasks[group] & (0xFFu << (firstBin & (BINS_PER_GROUP - 1)));
+
+    if (binMask == 0)
+    {
+        // Nothing left in this group, so take the smallest bin of the next group with free nodes.
+        unsigned int groupMask = (group + 1 < GROUP_COUNT) ? mGroupMask & ~((2u << group) - 1) : 0;
+
+        if (groupMask == 0)
+        {
+            return BIN_COUNT;
+        }
+
+        group = LowestBit(groupMask);
+        binMask = mBinMasks[group];
+    }
+
+    return (group << MANTISSA_BITS) + LowestBit(binMask);
+}
+
+OffsetAllocator::NodeIndex OffsetAllocator::NewNode(unsigned int offset, unsigned int size, NodeState state)
+{
+    Node node = { offset, size, NO_NODE, NO_NODE, NO_NODE, NO_NODE, state };
+
+    if (!mUnusedNodes.empty())
+    {
+        NodeIndex index = mUnusedNodes.back();
+        mUnusedNodes.pop_back();
+
+        mNodes[index] = node;
+        return index;
+    }
+
+    mNodes.push_back(node);
+    return static_cast<NodeIndex>(mNodes.size() - 1);
+}
+
+void OffsetAllocator::ReleaseNode(NodeIndex node)
+{
+    mNodes[node].state = NodeState::Unused;
+    mUnusedNodes.push_back(node);
+}
+
+void OffsetAllocator::AddToBin(NodeIndex node)
+{
+    unsigned int bin = RoundDownToBin(mNodes[node].size);
+    NodeIndex head = mBinHeads[bin];
+
+    mNodes[node].binPrevious = NO_NODE;
+    mNodes[node].binNext = head;
+
+    if (head != NO_NODE)
+    {
+        mNodes[head].binPrevious = node;
+    }
+
+    mBinHeads[bin] = node;
+    mBinMasks[bin >> MANTISSA_BITS] |= static_cast<unsigned char>(1u << (bin & (BINS_PER_GROUP - 1)));
+    mGroupMask |= 1u << (bin >> MANTISSA_BITS);
+}
+
+void OffsetAllocator::RemoveFromBin(NodeIndex node)
+{
+    unsigned int bin = RoundDownToBin(mNodes[node].size);
+    NodeIndex previous = mNodes[node].binPrevious;
+    NodeIndex next = mNodes[node].binNext;
+
+    if (previous != NO_NODE)
+    {
+        mNodes[previous].binNext = next;
+    }
+    else
+    {
+        mBinHeads[bin] = next;
+    }
+
+    if (next != NO_NODE)
+    {
+        mNodes[next].binPrevious = previous;
+    }
+
+    if (mBinHeads[bin] == NO_NODE)
+    {
+        unsigned int group = bin >> MANTISSA_BITS;
+        mBinMasks[group] &= static_cast<unsigned char>(~(1u << (bin & (BINS_PER_GROUP - 1))));
+
+        if (mBinMasks[group] == 0)
+        {
+            mGroupMask &= ~(1u << group);
+        }
+    }
+}
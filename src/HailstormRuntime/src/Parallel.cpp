@@ -0,0 +1,239 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "stdafx.h"
+#include "runtime/Parallel.h"
+
+#include <algorithm>
+#include <exception>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <vector>
+
+#include "runtime/AlignedBuffer.h"
+
+// Visual C++ 2013 has no alignas.
+#if defined(_MSC_VER) && _MSC_VER < 1900
+#   define CACHE_LINE_ALIGNED __declspec(align(64))
+#else
+#   define CACHE_LINE_ALIGNED alignas(64)
+#endif
+
+namespace
+{
+    const size_t CACHE_LINE_SIZE = 64;
+
+    /**
+     * The indices a worker has left to run. Kept on its own cache line so that workers taking tasks
+     * from their own share do not slow each other down.
+     */
+    struct CACHE_LINE_ALIGNED WorkShare
+    {
+        std::mutex lock;
+        unsigned int begin;
+        unsigned int end;
+    };
+
+    class WorkStealingLoop
+    {
+    public:
+        WorkStealingLoop(
+            unsigned int taskCount,
+            unsigned int threadCount,
+            const std::function<void(unsigned int, unsigned int)>& task)
+            : mShareStorage(sizeof(WorkShare) * threadCount, CACHE_LINE_SIZE),
+              mShares(reinterpret_cast<WorkShare *>(mShareStorage.Data())),
+              mThreadCount(threadCount),
+              mTask(task),
+              mStealCount(0),
+              mErrorLock(),
+              mError()
+        {
+            // operator new only guarantees cache line alignment from C++17 onwards, so the shares
+            // are constructed in a buffer that is aligned by hand.
+            for (unsigned int i = 0; i < threadCount; ++i)
+            {
+                new (&mShares[i]) WorkShare();
+                mShares[i].begin = static_cast<unsigned int>(static_cast<unsigned long long>(taskCount) * i / threadCount);
+                mShares[i].end = static_cast<unsigned int>(static_cast<unsigned long long>(taskCount) * (i + 1) / threadCount);
+            }
+        }
+
+        void Run(unsigned int worker)
+        {
+            unsigned int index = 0;
+
+            while (TakeOwn(worker, &index) || Steal(worker, &index))
+            {
+                try
+                {
+                    mTask(index, worker);
+                }
+                catch (...)
+                {
+                    std::lock_guard<std::mutex> guard(mErrorLock);
+
+                    if (!mError)
+                    {
+                        mError = std::current_exception();
+                    }
+                }
+            }
+        }
+
+        ~WorkStealingLoop()
+        {
+            for (unsigned int i = 0; i < mThreadCount; ++i)
+            {
+                mShares[i].~WorkShare();
+            }
+        }
+
+        unsigned int StealCount() const { return mStealCount; }
+        std::exception_ptr Error() const { return mError; }
+
+    private:
+        bool TakeOwn(unsigned int worker, unsigned int * pIndexOut)
+        {
+            WorkShare& share = mShares[worker];
+            std::lock_guard<std::mutex> guard(share.lock);
+
+            if (share.begin < share.end)
+            {
+                *pIndexOut = share.begin++;
+                return true;
+            }
+
+            return false;
+        }
+
+        /**
+         * Moves the back half of the largest remaining share into this worker's share and takes the
+         * first index from it. Returns false once there is nothing left to steal.
+         */
+        bool Steal(unsigned int worker, unsigned int * pIndexOut)
+        {
+            while (true)
+            {
+                unsigned int victim = worker;
+                unsigned int largest = 0;
+
+                for (unsigned int i = 0; i < mThreadCount; ++i)
+                {
+                    std::lock_guard<std::mutex> guard(mShares[i].lock);
+                    unsigned int remaining = mShares[i].end - mShares[i].begin;
+
+                    if (i != worker && remaining > largest)
+                    {
+                        victim = i;
+                        largest = remaining;
+                    }
+                }
+
+                if (victim == worker)
+                {
+                    return false;
+                }
+
+                unsigned int stolenBegin = 0, stolenEnd = 0;
+
+                {
+                    std::lock_guard<std::mutex> guard(mShares[victim].lock);
+                    unsigned int remaining = mShares[victim].end - mShares[victim].begin;
+
+                    if (remaining == 0)
+                    {
+                        // Someone else got there first, look again.
+                        continue;
+                    }
+
+                    stolenEnd = mShares[victim].end;
+                    stolenBegin = stolenEnd - (remaining + 1) / 2;
+                    mShares[victim].end = stolenBegin;
+                }
+
+                {
+                    std::lock_guard<std::mutex> guard(mShares[worker].lock);
+                    mShares[worker].begin = stolenBegin + 1;
+                    mShares[worker].end = stolenEnd;
+                }
+
+                {
+                    std::lock_guard<std::mutex> guard(mErrorLock);
+                    ++mStealCount;
+                }
+
+                *pIndexOut = stolenBegin;
+                return true;
+            }
+        }
+
+    private:
+        AlignedBuffer mShareStorage;
+        WorkShare * mShares;
+        unsigned int mThreadCount;
+        const std::function<void(unsigned int, unsigned int)>& mTask;
+        unsigned int mStealCount;
+        std::mutex mErrorLock;
+        std::exception_ptr mError;
+    };
+}
+
+unsigned int Parallel::DefaultThreadCount()
+{
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+void Parallel::For(
+    unsigned int taskCount,
+    unsigned int threadCount,
+    const std::function<void(unsigned int index, unsigned int worker)>& task,
+    ForStats * pStatsOut)
+{
+    if (threadCount == 0)
+    {
+        threadCount = DefaultThreadCount();
+    }
+
+    threadCount = std::max(1u, std::min(threadCount, taskCount));
+    WorkStealingLoop loop(taskCount, threadCount, task);
+
+    std::vector<std::thread> workers;
+    workers.reserve(threadCount - 1);
+
+    for (unsigned int i = 1; i < threadCount; ++i)
+    {
+        workers.push_back(std::thread(&WorkStealingLoop::Run, &loop, i));
+    }
+
+    loop.Run(0);
+
+    for (size_t i = 0; i < workers.size(); ++i)
+    {
+        workers[i].join();
+    }
+
+    if (pStatsOut != nullptr)
+    {
+        pStatsOut->threadCount = threadCount;
+        pStatsOut->stealCount = loop.StealCount();
+    }
+
+    if (loop.Error())
+    {
+        std::rethrow_exception(loop.Error());
+    }
+}
@@ -0,0 +1,71 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "stdafx.h"
+#include "runtime/Stopwatch.h"
+
+#if defined(_WIN32)
+#   ifndef WIN32_LEAN_AND_MEAN
+#       define WIN32_LEAN_AND_MEAN
+#   endif
+#   include <windows.h>
+#else
+#   include <chrono>
+#endif
+
+Stopwatch::Stopwatch()
+    : mStartTicks(CurrentTicks())
+{
+}
+
+void Stopwatch::Restart()
+{
+    mStartTicks = CurrentTicks();
+}
+
+double Stopwatch::ElapsedSeconds() const
+{
+    return static_cast<double>(CurrentTicks() - mStartTicks) / static_cast<double>(TicksPerSecond());
+}
+
+long long Stopwatch::CurrentTicks()
+{
+#if defined(_WIN32)
+    LARGE_INTEGER ticks;
+    QueryPerformanceCounter(&ticks);
+    return ticks.QuadPart;
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+long long Stopwatch::TicksPerSecond()
+{
+#if defined(_WIN32)
+    static long long sFrequency = 0;
+
+    if (sFrequency == 0)
+    {
+        LARGE_INTEGER frequency;
+        QueryPerformanceFrequency(&frequency);
+        sFrequency = frequency.QuadPart;
+    }
+
+    return sFrequency;
+#else
+    return 1000000000ll;
+#endif
+}
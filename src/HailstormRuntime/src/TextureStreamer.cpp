@@ -0,0 +1,346 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "stdafx.h"
+#include "runtime/TextureStreamer.h"
+#include "runtime/debugging.h"
+
+#include <algorithm>
+
+#include "runtime/DdsFile.h"
+#include "runtime/WorkerPool.h"
+
+namespace
+{
+    const unsigned int DEFAULT_TAIL_SIZE = 64;
+    const unsigned int DEFAULT_MAX_LOADS_IN_FLIGHT = 4;
+
+    unsigned int MipExtent(unsigned int width, unsigned int height, unsigned int mip)
+    {
+        return std::max(std::max(width >> mip, height >> mip), 1u);
+    }
+
+    // Order textures that need loads by how many levels they are short of their target, then by how
+    // little detail they have, so the blurriest textures are fixed first.
+    struct LoadCandidate
+    {
+        unsigned int missingLevels;
+        unsigned int residentMip;
+        unsigned int denseIndex;
+
+        bool operator <(const LoadCandidate& other) const
+        {
+            if (missingLevels != other.missingLevels)
+            {
+                return missingLevels > other.missingLevels;
+            }
+
+            return residentMip > other.residentMip;
+        }
+    };
+}
+
+MipStreamingParams::MipStreamingParams()
+    : tailSize(DEFAULT_TAIL_SIZE),
+      maxLoadsInFlight(DEFAULT_MAX_LOADS_IN_FLIGHT)
+{
+}
+
+unsigned int MipStreaming::SelectMip(unsigned int width, unsigned int height, unsigned int mipCount, unsigned int requestedSize)
+{
+    Verify(mipCount > 0);
+
+    if (requestedSize == 0)
+    {
+        return mipCount - 1;
+    }
+
+    unsigned int mip = 0;
+
+    while (mip + 1 < mipCount && MipExtent(width, height, mip + 1) >= requestedSize)
+    {
+        ++mip;
+    }
+
+    return mip;
+}
+
+unsigned int MipStreaming::TailMip(unsigned int width, unsigned int height, unsigned int mipCount, unsigned int tailSize)
+{
+    Verify(mipCount > 0);
+
+    unsigned int mip = 0;
+
+    while (mip + 1 < mipCount && MipExtent(width, height, mip) > tailSize)
+    {
+        ++mip;
+    }
+
+    return mip;
+}
+
+TextureStreamer::Texture::Texture()
+    : pFile(nullptr),
+      onResidencyChanged(),
+      tailMip(0),
+      residentMip(0),
+      targetMip(0),
+      isLoading(false)
+{
+}
+
+TextureStreamer::TextureStreamer(WorkerPool * pLoaders, const MipStreamingParams& params)
+    : mpLoaders(pLoaders),
+      mParams(params),
+      mTextures(),
+      mLoadingCount(0),
+      mBytesLoaded(0),
+      mFinishedLock(),
+      mLoadFinished(),
+      mFinished()
+{
+    VerifyNotNull(pLoaders);
+    Verify(params.maxLoadsInFlight > 0);
+}
+
+/**
+ * Waits for the loads that are still running, since they refer to the streamer.
+ */
+TextureStreamer::~TextureStreamer()
+{
+    std::unique_lock<std::mutex> lock(mFinishedLock);
+    mLoadFinished.wait(lock, [this]() { return mFinished.size() >= mLoadingCount; });
+}
+
+TextureStreamer::TextureHandle TextureStreamer::Add(
+    const DdsFile * pFile,
+    unsigned int requestedSize,
+    const ResidencyCallback& onResidencyChanged)
+{
+    VerifyNotNull(pFile);
+    Verify(pFile->IsOpen());
+
+    Texture texture;
+    texture.pFile = pFile;
+    texture.onResidencyChanged = onResidencyChanged;
+    texture.tailMip = MipStreaming::TailMip(pFile->Width(), pFile->Height(), pFile->MipCount(), mParams.tailSize);
+    texture.residentMip = texture.tailMip;
+    texture.targetMip = std::min(
+        MipStreaming::SelectMip(pFile->Width(), pFile->Height(), pFile->MipCount(), requestedSize),
+        texture.tailMip);
+
+    // The tail is small, so it is read here rather than waiting for a loader.
+    for (unsigned int mip = texture.tailMip; mip < pFile->MipCount(); ++mip)
+    {
+        pFile->Prefetch(mip);
+    }
+
+    TextureHandle handle = mTextures.Insert(std::move(texture));
+
+    if (!handle.IsNull() && onResidencyChanged)
+    {
+        onResidencyChanged(mTextures.Get(handle)->residentMip);
+    }
+
+    return handle;
+}
+
+bool TextureStreamer::Remove(TextureHandle handle)
+{
+    Texture * pTexture = mTextures.Get(handle);
+
+    if (pTexture == nullptr)
+    {
+        return false;
+    }
+
+    if (pTexture->isLoading)
+    {
+        WaitForLoad(handle);
+    }
+
+    return mTextures.Remove(handle);
+}
+
+void TextureStreamer::RequestSize(TextureHandle handle, unsigned int requestedSize)
+{
+    Texture * pTexture = mTextures.Get(handle);
+
+    if (pTexture == nullptr)
+    {
+        return;
+    }
+
+    const DdsFile& file = *pTexture->pFile;
+    pTexture->targetMip = std::min(
+        MipStreaming::SelectMip(file.Width(), file.Height(), file.MipCount(), requestedSize),
+        pTexture->tailMip);
+
+    if (pTexture->targetMip > pTexture->residentMip)
+    {
+        DropTo(pTexture, pTexture->targetMip);
+    }
+}
+
+unsigned int TextureStreamer::ResidentMip(TextureHandle handle) const
+{
+    const Texture * pTexture = mTextures.Get(handle);
+    VerifyNotNull(pTexture);
+
+    return pTexture->residentMip;
+}
+
+unsigned int TextureStreamer::TargetMip(TextureHandle handle) const
+{
+    const Texture * pTexture = mTextures.Get(handle);
+    VerifyNotNull(pTexture);
+
+    return pTexture->targetMip;
+}
+
+unsigned int TextureStreamer::Update()
+{
+    std::vector<FinishedLoad> finished;
+    unsigned int upgradedCount = 0;
+
+    {
+        std::lock_guard<std::mutex> lock(mFinishedLock);
+        finished.swap(mFinished);
+        mLoadingCount -= static_cast<unsigned int>(finished.size());
+    }
+
+    for (size_t i = 0; i < finished.size(); ++i)
+    {
+        Texture * pTexture = mTextures.Get(finished[i].first);
+        unsigned int mip = finished[i].second;
+
+        if (pTexture == nullptr)
+        {
+            continue;
+        }
+
+        pTexture->isLoading = false;
+
+        // A lower resolution may have been asked for while the level was loading.
+        if (mip + 1 == pTexture->residentMip && mip >= pTexture->targetMip)
+        {
+            pTexture->residentMip = mip;
+            ++upgradedCount;
+
+            if (pTexture->onResidencyChanged)
+            {
+                pTexture->onResidencyChanged(mip);
+            }
+        }
+    }
+
+    if (mLoadingCount >= mParams.maxLoadsInFlight)
+    {
+        return upgradedCount;
+    }
+
+    std::vector<LoadCandidate> candidates;
+
+    for (unsigned int i = 0; i < mTextures.Count(); ++i)
+    {
+        const Texture& texture = mTextures.Data()[i];
+
+        if (!texture.isLoading && texture.residentMip > texture.targetMip)
+        {
+            LoadCandidate candidate = { texture.residentMip - texture.targetMip, texture.residentMip, i };
+            candidates.push_back(candidate);
+        }
+    }
+
+    size_t startCount = std::min(candidates.size(), static_cast<size_t>(mParams.maxLoadsInFlight - mLoadingCount));
+    std::partial_sort(candidates.begin(), candidates.begin() + startCount, candidates.end());
+
+    for (size_t i = 0; i < startCount; ++i)
+    {
+        unsigned int denseIndex = candidates[i].denseIndex;
+        StartLoad(mTextures.HandleAt(denseIndex), &mTextures.Data()[denseIndex]);
+    }
+
+    return upgradedCount;
+}
+
+void TextureStreamer::WaitIdle()
+{
+    for (;;)
+    {
+        Update();
+
+        // Update starts a load for anything short of its target, so nothing loading means done.
+        if (mLoadingCount == 0)
+        {
+            return;
+        }
+
+        std::unique_lock<std::mutex> lock(mFinishedLock);
+        mLoadFinished.wait(lock, [this]() { return !mFinished.empty(); });
+    }
+}
+
+/**
+ * Queues a load of the next more detailed level of a texture.
+ */
+void TextureStreamer::StartLoad(TextureHandle handle, Texture * pTexture)
+{
+    assert(!pTexture->isLoading && pTexture->residentMip > 0);
+
+    const DdsFile * pFile = pTexture->pFile;
+    unsigned int mip = pTexture->residentMip - 1;
+
+    pTexture->isLoading = true;
+    mBytesLoaded += pFile->LevelSize(mip);
+
+    {
+        std::lock_guard<std::mutex> lock(mFinishedLock);
+        ++mLoadingCount;
+    }
+
+    mpLoaders->Submit([this, handle, pFile, mip]()
+    {
+        pFile->Prefetch(mip);
+
+        std::lock_guard<std::mutex> lock(mFinishedLock);
+        mFinished.push_back(FinishedLoad(handle, mip));
+        mLoadFinished.notify_all();
+    });
+}
+
+/**
+ * Blocks until a texture's load has finished and throws its result away.
+ */
+void TextureStreamer::WaitForLoad(TextureHandle handle)
+{
+    std::unique_lock<std::mutex> lock(mFinishedLock);
+    auto isFinished = [handle](const FinishedLoad& load) { return load.first == handle; };
+
+    mLoadFinished.wait(lock, [&]() { return std::any_of(mFinished.begin(), mFinished.end(), isFinished); });
+
+    mFinished.erase(std::find_if(mFinished.begin(), mFinished.end(), isFinished));
+    --mLoadingCount;
+}
+
+void TextureStreamer::DropTo(Texture * pTexture, unsigned int mip)
+{
+    pTexture->residentMip = mip;
+
+    if (pTexture->onResidencyChanged)
+    {
+        pTexture->onResidencyChanged(mip);
+    }
+}
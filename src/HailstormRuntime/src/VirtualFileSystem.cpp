@@ -0,0 +1,323 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "stdafx.h"
+#include "runtime/VirtualFileSystem.h"
+#include "runtime/debugging.h"
+
+#include <algorithm>
+
+#include "runtime/AlignedBuffer.h"
+#include "runtime/AssetArchive.h"
+#include "runtime/Hash.h"
+#include "runtime/MappedFile.h"
+#include "runtime/Stopwatch.h"
+#include "runtime/StringUtils.h"
+
+namespace
+{
+    std::string ToLower(std::string text)
+    {
+        for (size_t i = 0; i < text.size(); ++i)
+        {
+            if (text[i] >= 'A' && text[i] <= 'Z')
+            {
+                text[i] = static_cast<char>(text[i] - 'A' + 'a');
+            }
+        }
+
+        return text;
+    }
+}
+
+/**
+ * A mounted backend. Counters are atomic because files are opened from the loader threads.
+ */
+struct VirtualFileSystem::MountPoint
+{
+    std::string mountPoint;                     // Normalized, "" for the root.
+    std::unique_ptr<FileSystemBackend> pBackend;
+    int priority;
+    std::atomic<unsigned long long> openCount;
+    std::atomic<unsigned long long> byteCount;
+    std::atomic<unsigned long long> openNanoseconds;
+};
+
+VirtualFile::VirtualFile()
+    : mData(),
+      mpMappedFile(),
+      mpBuffer(),
+      mIsOpen(false)
+{
+}
+
+VirtualFile::VirtualFile(VirtualFile&& other)
+    : mData(other.mData),
+      mpMappedFile(std::move(other.mpMappedFile)),
+      mpBuffer(std::move(other.mpBuffer)),
+      mIsOpen(other.mIsOpen)
+{
+    other.mData = ByteSpan();
+    other.mIsOpen = false;
+}
+
+VirtualFile::~VirtualFile()
+{
+}
+
+VirtualFile& VirtualFile::operator =(VirtualFile&& other)
+{
+    if (this != &other)
+    {
+        mData = other.mData;
+        mpMappedFile = std::move(other.mpMappedFile);
+        mpBuffer = std::move(other.mpBuffer);
+        mIsOpen = other.mIsOpen;
+
+        other.mData = ByteSpan();
+        other.mIsOpen = false;
+    }
+
+    return *this;
+}
+
+void VirtualFile::Attach(const ByteSpan& data)
+{
+    Close();
+
+    mData = data;
+    mIsOpen = true;
+}
+
+void VirtualFile::Attach(std::unique_ptr<MappedFile> pMappedFile)
+{
+    VerifyNotNull(pMappedFile.get());
+    Close();
+
+    mData = ByteSpan(pMappedFile->Data(), pMappedFile->Size());
+    mpMappedFile = std::move(pMappedFile);
+    mIsOpen = true;
+}
+
+void VirtualFile::Attach(std::unique_ptr<AlignedBuffer> pBuffer)
+{
+    VerifyNotNull(pBuffer.get());
+    Close();
+
+    mData = ByteSpan(pBuffer->Data(), pBuffer->Size());
+    mpBuffer = std::move(pBuffer);
+    mIsOpen = true;
+}
+
+void VirtualFile::Close()
+{
+    mData = ByteSpan();
+    mpMappedFile.reset();
+    mpBuffer.reset();
+    mIsOpen = false;
+}
+
+void VirtualFile::Prefetch() const
+{
+    MappedFile::Prefetch(mData.pData, mData.size);
+}
+
+VirtualFileSystem::VirtualFileSystem()
+    : mMounts(),
+      mMissCount(0)
+{
+}
+
+VirtualFileSystem::~VirtualFileSystem()
+{
+}
+
+/**
+ * Inserts the mount after every mount with a higher priority, and before every mount with the same
+ * or a lower one, which keeps the list in search order.
+ */
+void VirtualFileSystem::Mount(const std::string& mountPoint, std::unique_ptr<FileSystemBackend> pBackend, int priority)
+{
+    VerifyNotNull(pBackend.get());
+
+    std::unique_ptr<MountPoint> pMount(new MountPoint());
+    pMount->mountPoint = MakePath(mountPoint).normalized;
+    pMount->pBackend = std::move(pBackend);
+    pMount->priority = priority;
+    pMount->openCount = 0;
+    pMount->byteCount = 0;
+    pMount->openNanoseconds = 0;
+
+    auto position = std::find_if(mMounts.begin(), mMounts.end(), [priority](const std::unique_ptr<MountPoint>& other)
+    {
+        return other->priority <= priority;
+    });
+
+    mMounts.insert(position, std::move(pMount));
+}
+
+bool VirtualFileSystem::Unmount(const std::string& mountPoint)
+{
+    std::string normalized = MakePath(mountPoint).normalized;
+    size_t oldCount = mMounts.size();
+
+    mMounts.erase(
+        std::remove_if(mMounts.begin(), mMounts.end(), [&normalized](const std::unique_ptr<MountPoint>& mount)
+        {
+            return mount->mountPoint == normalized;
+        }),
+        mMounts.end());
+
+    return mMounts.size() != oldCount;
+}
+
+bool VirtualFileSystem::Open(const std::string& path, VirtualFile * pFileOut) const
+{
+    VerifyNotNull(pFileOut);
+    pFileOut->Close();
+
+    VirtualPath virtualPath = MakePath(path);
+    VirtualPath relativePath;
+
+    for (size_t i = 0; i < mMounts.size(); ++i)
+    {
+        MountPoint& mount = *mMounts[i];
+
+        if (!MakeRelativePath(mount, virtualPath, &relativePath))
+        {
+            continue;
+        }
+
+        Stopwatch timer;
+
+        if (mount.pBackend->Open(relativePath, pFileOut))
+        {
+            mount.openCount += 1;
+            mount.byteCount += pFileOut->Size();
+            mount.openNanoseconds += static_cast<unsigned long long>(timer.ElapsedSeconds() * 1e9);
+
+            return true;
+        }
+    }
+
+    mMissCount += 1;
+    return false;
+}
+
+bool VirtualFileSystem::Open(const std::wstring& path, VirtualFile * pFileOut) const
+{
+    return Open(Utils::ConvertWideStringToUtf8(path), pFileOut);
+}
+
+bool VirtualFileSystem::Exists(const std::string& path) const
+{
+    VirtualPath virtualPath = MakePath(path);
+    VirtualPath relativePath;
+
+    for (size_t i = 0; i < mMounts.size(); ++i)
+    {
+        if (MakeRelativePath(*mMounts[i], virtualPath, &relativePath) && mMounts[i]->pBackend->Exists(relativePath))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool VirtualFileSystem::Exists(const std::wstring& path) const
+{
+    return Exists(Utils::ConvertWideStringToUtf8(path));
+}
+
+FileSystemStats VirtualFileSystem::Stats() const
+{
+    FileSystemStats stats;
+
+    for (size_t i = 0; i < mMounts.size(); ++i)
+    {
+        const MountPoint& mount = *mMounts[i];
+        MountStats mountStats;
+
+        mountStats.mountPoint = mount.mountPoint;
+        mountStats.pTypeName = mount.pBackend->TypeName();
+        mountStats.priority = mount.priority;
+        mountStats.openCount = mount.openCount;
+        mountStats.byteCount = mount.byteCount;
+        mountStats.openSeconds = mount.openNanoseconds / 1e9;
+
+        stats.mounts.push_back(mountStats);
+    }
+
+    stats.missCount = mMissCount;
+    return stats;
+}
+
+void VirtualFileSystem::ResetStats()
+{
+    for (size_t i = 0; i < mMounts.size(); ++i)
+    {
+        mMounts[i]->openCount = 0;
+        mMounts[i]->byteCount = 0;
+        mMounts[i]->openNanoseconds = 0;
+    }
+
+    mMissCount = 0;
+}
+
+VirtualPath VirtualFileSystem::MakePath(const std::string& path)
+{
+    VirtualPath virtualPath;
+
+    virtualPath.name = AssetArchive::NormalizePath(path, false);
+    virtualPath.normalized = ToLower(virtualPath.name);
+    virtualPath.hash = Hash::Fnv1a64(virtualPath.normalized);
+
+    return virtualPath;
+}
+
+VirtualPath VirtualFileSystem::MakePath(const std::wstring& path)
+{
+    return MakePath(Utils::ConvertWideStringToUtf8(path));
+}
+
+/**
+ * Strips the mount point off the front of a path. Files at the root keep their hash, so looking them
+ * up in an archive doesn't need to hash the path again.
+ */
+bool VirtualFileSystem::MakeRelativePath(const MountPoint& mount, const VirtualPath& path, VirtualPath * pRelativePathOut)
+{
+    const std::string& mountPoint = mount.mountPoint;
+
+    if (mountPoint.empty())
+    {
+        *pRelativePathOut = path;
+        return true;
+    }
+
+    if (path.normalized.size() <= mountPoint.size() ||
+        path.normalized.compare(0, mountPoint.size(), mountPoint) != 0 ||
+        path.normalized[mountPoint.size()] != '/')
+    {
+        return false;
+    }
+
+    // Lower casing doesn't change the length of a path, so the name and normalized path line up.
+    pRelativePathOut->name = path.name.substr(mountPoint.size() + 1);
+    pRelativePathOut->normalized = path.normalized.substr(mountPoint.size() + 1);
+    pRelativePathOut->hash = Hash::Fnv1a64(pRelativePathOut->normalized);
+
+    return true;
+}
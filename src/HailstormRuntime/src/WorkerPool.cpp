@@ -0,0 +1,114 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "stdafx.h"
+#include "runtime/WorkerPool.h"
+
+WorkerPool::WorkerPool(unsigned int threadCount)
+    : mThreads(),
+      mJobs(),
+      mLock(),
+      mJobAdded(),
+      mJobFinished(),
+      mRunningCount(0),
+      mStopping(false)
+{
+    mThreads.reserve(threadCount);
+
+    for (unsigned int i = 0; i < threadCount; ++i)
+    {
+        mThreads.push_back(std::thread(&WorkerPool::Run, this));
+    }
+}
+
+WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> guard(mLock);
+        mStopping = true;
+    }
+
+    mJobAdded.notify_all();
+
+    for (size_t i = 0; i < mThreads.size(); ++i)
+    {
+        mThreads[i].join();
+    }
+}
+
+void WorkerPool::Submit(const std::function<void()>& job)
+{
+    if (mThreads.empty())
+    {
+        job();
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(mLock);
+        mJobs.push_back(job);
+    }
+
+    mJobAdded.notify_one();
+}
+
+void WorkerPool::WaitIdle()
+{
+    std::unique_lock<std::mutex> guard(mLock);
+
+    while (!mJobs.empty() || mRunningCount > 0)
+    {
+        mJobFinished.wait(guard);
+    }
+}
+
+unsigned int WorkerPool::BusyCount() const
+{
+    std::lock_guard<std::mutex> guard(mLock);
+    return static_cast<unsigned int>(mJobs.size()) + mRunningCount;
+}
+
+/**
+ * Worker thread loop. Threads only exit once stopping and the queue is empty, so every job submitted
+ * before the pool is destroyed gets to run.
+ */
+void WorkerPool::Run()
+{
+    std::unique_lock<std::mutex> guard(mLock);
+
+    while (true)
+    {
+        while (mJobs.empty() && !mStopping)
+        {
+            mJobAdded.wait(guard);
+        }
+
+        if (mJobs.empty())
+        {
+            return;
+        }
+
+        std::function<void()> job = std::move(mJobs.front());
+        mJobs.pop_front();
+        ++mRunningCount;
+
+        guard.unlock();
+        job();
+        guard.lock();
+
+        --mRunningCount;
+        mJobFinished.notify_all();
+    }
+}
@@ -0,0 +1,170 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "stdafx.h"
+#include "runtime/AssetArchive.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+namespace
+{
+    const wchar_t * ARCHIVE_PATH = L"AssetArchiveTests.hspk";
+    const char * ARCHIVE_PATH_NARROW = "AssetArchiveTests.hspk";
+
+    std::vector<unsigned char> ReadArchive()
+    {
+        std::ifstream in(ARCHIVE_PATH_NARROW, std::ios::binary);
+        return std::vector<unsigned char>(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+
+    void WriteArchive(const std::vector<unsigned char>& bytes)
+    {
+        std::ofstream out(ARCHIVE_PATH_NARROW, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char *>(&bytes[0]), bytes.size());
+    }
+
+    /**
+     * Writes a small archive and keeps a copy of its bytes, so each test can patch the header and
+     * check that the reader turns the result away.
+     */
+    class AssetArchiveTests : public ::testing::Test
+    {
+    protected:
+        virtual void SetUp()
+        {
+            AssetArchiveWriter writer;
+            const char * names[] = { "textures/grid.dds", "meshes/cube.mesh", "shaders/cube.fx" };
+
+            for (size_t i = 0; i < 3; ++i)
+            {
+                ASSERT_TRUE(writer.Add(names[i], names[i], strlen(names[i]) + 1));
+            }
+
+            ASSERT_TRUE(writer.Write(ARCHIVE_PATH));
+            mBytes = ReadArchive();
+            ASSERT_EQ(mBytes.size(), Header().fileSize);
+        }
+
+        virtual void TearDown()
+        {
+            std::remove(ARCHIVE_PATH_NARROW);
+        }
+
+        ArchiveHeader& Header()
+        {
+            return *reinterpret_cast<ArchiveHeader *>(&mBytes[0]);
+        }
+
+        // Write the patched bytes back and try to open them.
+        bool OpenPatched(const char ** ppReasonOut)
+        {
+            WriteArchive(mBytes);
+            return mArchive.Open(ARCHIVE_PATH, ppReasonOut);
+        }
+
+        std::vector<unsigned char> mBytes;
+        AssetArchive mArchive;
+    };
+}
+
+TEST_F(AssetArchiveTests, OpensAndFindsEveryEntry)
+{
+    const char * pReason = nullptr;
+
+    ASSERT_TRUE(mArchive.Open(ARCHIVE_PATH, &pReason));
+    EXPECT_EQ(3u, mArchive.EntryCount());
+
+    const ArchiveEntry * pEntry = mArchive.Find(std::string("Meshes\\cube.mesh"));
+
+    ASSERT_NE(nullptr, pEntry);
+    EXPECT_STREQ("meshes/cube.mesh", mArchive.Name(*pEntry));
+    EXPECT_EQ(nullptr, mArchive.Find(std::string("meshes/sphere.mesh")));
+}
+
+TEST_F(AssetArchiveTests, RejectsABucketShiftOutOfRange)
+{
+    // A shift of 0 with one bucket used to pass, since shifting by 64 happens to give 1 on x86, and
+    // then every lookup indexed the bucket table with the whole top half of the hash.
+    const unsigned int shifts[] = { 0, 1, 31, 32, 65, 0xFFFFFFFF };
+
+    for (size_t i = 0; i < sizeof(shifts) / sizeof(shifts[0]); ++i)
+    {
+        Header().bucketShift = shifts[i];
+        Header().bucketCount = 1;
+
+        const char * pReason = nullptr;
+
+        EXPECT_FALSE(OpenPatched(&pReason)) << "bucket shift " << shifts[i];
+        EXPECT_STREQ("file is truncated or corrupt", pReason);
+        EXPECT_FALSE(mArchive.IsOpen());
+    }
+}
+
+TEST_F(AssetArchiveTests, RejectsABucketCountThatDoesNotMatchTheShift)
+{
+    Header().bucketCount *= 2;
+
+    const char * pReason = nullptr;
+
+    EXPECT_FALSE(OpenPatched(&pReason));
+    EXPECT_STREQ("file is truncated or corrupt", pReason);
+}
+
+TEST_F(AssetArchiveTests, RejectsTablesPastTheEndOfTheFile)
+{
+    Header().entryCount = 0x10000000;
+
+    const char * pReason = nullptr;
+
+    EXPECT_FALSE(OpenPatched(&pReason));
+    EXPECT_STREQ("file is truncated or corrupt", pReason);
+}
+
+TEST_F(AssetArchiveTests, RejectsATruncatedFile)
+{
+    mBytes.resize(mBytes.size() - 1);
+
+    const char * pReason = nullptr;
+
+    EXPECT_FALSE(OpenPatched(&pReason));
+    EXPECT_STREQ("file is truncated or corrupt", pReason);
+}
+
+TEST_F(AssetArchiveTests, RejectsAnEntryOutsideItsBucket)
+{
+    // Swapping two entries breaks both the hash order and the bucket they were filed under.
+    ArchiveEntry * pEntries = reinterpret_cast<ArchiveEntry *>(&mBytes[static_cast<size_t>(Header().entriesOffset)]);
+    std::swap(pEntries[0], pEntries[2]);
+
+    const char * pReason = nullptr;
+
+    EXPECT_FALSE(OpenPatched(&pReason));
+    EXPECT_STREQ("table of contents is corrupt", pReason);
+}
+
+TEST(AssetArchivePathTests, NormalizesSeparatorsDotsAndCase)
+{
+    EXPECT_EQ("textures/grid.dds", AssetArchive::NormalizePath(std::string("Textures\\.\\Old\\..\\Grid.DDS")));
+    EXPECT_EQ("Textures/Grid.DDS", AssetArchive::NormalizePath(std::string("Textures\\.\\Old\\..\\Grid.DDS"), false));
+    EXPECT_EQ("a/b", AssetArchive::NormalizePath(std::string("//a//b/")));
+
+    // A ".." with nothing before it to cancel out is kept, so callers can tell the path climbs out.
+    EXPECT_EQ("../shared.fx", AssetArchive::NormalizePath(std::string("fx/../../Shared.fx")));
+    EXPECT_EQ("../..", AssetArchive::NormalizePath(std::string("../..")));
+    EXPECT_EQ("", AssetArchive::NormalizePath(std::string("a/..")));
+}
@@ -0,0 +1,283 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "stdafx.h"
+#include "runtime/DdsFile.h"
+
+#include <cstring>
+
+namespace
+{
+    const unsigned int DDSD_MIPMAPCOUNT = 0x20000;
+    const unsigned int DDSCAPS2_CUBEMAP = 0x200;
+    const unsigned int DDSCAPS2_CUBEMAP_ALL_FACES = 0xFC00;
+    const unsigned int DDPF_FOURCC = 0x4;
+    const unsigned int DDPF_RGB = 0x40;
+    const unsigned int DX10_DIMENSION_TEXTURE2D = 3;
+
+    const size_t LEGACY_DATA_OFFSET = sizeof(unsigned int) + sizeof(DdsHeader);
+    const size_t DX10_DATA_OFFSET = LEGACY_DATA_OFFSET + sizeof(DdsHeaderDx10);
+
+    unsigned int FourCC(const char * pCode)
+    {
+        unsigned int code = 0;
+        std::memcpy(&code, pCode, sizeof(code));
+        return code;
+    }
+
+    /**
+     * Builds the bytes of a DDS file in memory. The texel data is filled with a byte count so that
+     * each surface can be told apart.
+     */
+    struct DdsBuilder
+    {
+        DdsBuilder(unsigned int width, unsigned int height, unsigned int mipCount)
+            : header(),
+              dx10(),
+              hasDx10(false),
+              dataSize(0)
+        {
+            header.size = sizeof(DdsHeader);
+            header.flags = (mipCount > 1) ? DDSD_MIPMAPCOUNT : 0;
+            header.width = width;
+            header.height = height;
+            header.mipMapCount = mipCount;
+            header.pixelFormat.size = sizeof(DdsPixelFormat);
+        }
+
+        void Legacy(const char * pFourCC)
+        {
+            header.pixelFormat.flags = DDPF_FOURCC;
+            header.pixelFormat.fourCC = FourCC(pFourCC);
+        }
+
+        void LegacyRgb(unsigned int bitCount, unsigned int r, unsigned int g, unsigned int b, unsigned int a)
+        {
+            header.pixelFormat.flags = DDPF_RGB;
+            header.pixelFormat.rgbBitCount = bitCount;
+            header.pixelFormat.rBitMask = r;
+            header.pixelFormat.gBitMask = g;
+            header.pixelFormat.bBitMask = b;
+            header.pixelFormat.aBitMask = a;
+        }
+
+        void Dx10(TextureFormat format, unsigned int arraySize)
+        {
+            Legacy("DX10");
+            hasDx10 = true;
+            dx10.dxgiFormat = static_cast<unsigned int>(format);
+            dx10.resourceDimension = DX10_DIMENSION_TEXTURE2D;
+            dx10.arraySize = arraySize;
+        }
+
+        std::vector<unsigned char> Build() const
+        {
+            unsigned int magic = DdsFile::MAGIC;
+            std::vector<unsigned char> bytes(sizeof(magic) + sizeof(header) + (hasDx10 ? sizeof(dx10) : 0));
+
+            std::memcpy(&bytes[0], &magic, sizeof(magic));
+            std::memcpy(&bytes[sizeof(magic)], &header, sizeof(header));
+
+            if (hasDx10)
+            {
+                std::memcpy(&bytes[sizeof(magic) + sizeof(header)], &dx10, sizeof(dx10));
+            }
+
+            for (size_t i = 0; i < dataSize; ++i)
+            {
+                bytes.push_back(static_cast<unsigned char>(i));
+            }
+
+            return bytes;
+        }
+
+        DdsHeader header;
+        DdsHeaderDx10 dx10;
+        bool hasDx10;
+        size_t dataSize;
+    };
+
+    // Open a file's bytes, expecting it to fail for the given reason.
+    void ExpectRejected(const std::vector<unsigned char>& bytes, const char * pExpectedReason)
+    {
+        DdsFile file;
+        const char * pReason = nullptr;
+
+        EXPECT_FALSE(file.Open(ByteSpan(&bytes[0], bytes.size()), &pReason));
+        EXPECT_STREQ(pExpectedReason, pReason);
+        EXPECT_FALSE(file.IsOpen());
+    }
+}
+
+TEST(DdsFileTests, OpensALegacyBc1MipChain)
+{
+    // 16x8 BC1 is 4x2 blocks of 8 bytes, then 2x1, then a single (partly used) block for each of the
+    // 4x2, 2x1 and 1x1 mips.
+    DdsBuilder builder(16, 8, 5);
+    builder.Legacy("DXT1");
+    builder.dataSize = 64 + 16 + 8 + 8 + 8;
+
+    std::vector<unsigned char> bytes = builder.Build();
+    DdsFile file;
+    const char * pReason = nullptr;
+
+    ASSERT_TRUE(file.Open(ByteSpan(&bytes[0], bytes.size()), &pReason)) << pReason;
+    EXPECT_EQ(TextureFormat::Bc1Unorm, file.Format());
+    EXPECT_FALSE(file.HasDx10Header());
+    EXPECT_EQ(16u, file.Width());
+    EXPECT_EQ(8u, file.Height());
+    EXPECT_EQ(5u, file.MipCount());
+    EXPECT_EQ(1u, file.ItemCount());
+    EXPECT_EQ(builder.dataSize, file.DataSize());
+
+    const size_t offsets[] = { 0, 64, 80, 88, 96 };
+    const size_t sizes[] = { 64, 16, 8, 8, 8 };
+    const size_t rowPitches[] = { 32, 16, 8, 8, 8 };
+
+    for (unsigned int mip = 0; mip < 5; ++mip)
+    {
+        DdsSurface surface = file.Surface(0, mip);
+
+        EXPECT_EQ(&bytes[LEGACY_DATA_OFFSET + offsets[mip]], surface.data.pData) << "mip " << mip;
+        EXPECT_EQ(sizes[mip], surface.data.size) << "mip " << mip;
+        EXPECT_EQ(sizes[mip], file.MipSize(mip)) << "mip " << mip;
+        EXPECT_EQ(rowPitches[mip], surface.rowPitch) << "mip " << mip;
+        EXPECT_EQ(std::max(16u >> mip, 1u), surface.width);
+        EXPECT_EQ(std::max(8u >> mip, 1u), surface.height);
+    }
+}
+
+TEST(DdsFileTests, LaysOutArrayItemsOneMipChainAfterAnother)
+{
+    // Three 4x4 RGBA items, each with 64 + 16 + 4 bytes of mips.
+    DdsBuilder builder(4, 4, 3);
+    builder.Dx10(TextureFormat::R8G8B8A8Unorm, 3);
+    builder.dataSize = 3 * 84;
+
+    std::vector<unsigned char> bytes = builder.Build();
+    DdsFile file;
+
+    ASSERT_TRUE(file.Open(ByteSpan(&bytes[0], bytes.size())));
+    EXPECT_TRUE(file.HasDx10Header());
+    EXPECT_EQ(3u, file.ItemCount());
+    EXPECT_EQ(3u * 16u, file.LevelSize(1));
+
+    for (unsigned int item = 0; item < 3; ++item)
+    {
+        EXPECT_EQ(&bytes[DX10_DATA_OFFSET + item * 84], file.Surface(item, 0).data.pData);
+        EXPECT_EQ(&bytes[DX10_DATA_OFFSET + item * 84 + 64], file.Surface(item, 1).data.pData);
+        EXPECT_EQ(&bytes[DX10_DATA_OFFSET + item * 84 + 80], file.Surface(item, 2).data.pData);
+    }
+
+    EXPECT_EQ(16u, file.Surface(2, 0).rowPitch);
+    EXPECT_EQ(64u, file.Surface(2, 0).slicePitch);
+}
+
+TEST(DdsFileTests, OpensACubeMapAsSixItems)
+{
+    DdsBuilder builder(4, 4, 1);
+    builder.LegacyRgb(32, 0x00FF0000, 0x0000FF00, 0x000000FF, 0xFF000000);
+    builder.header.caps2 = DDSCAPS2_CUBEMAP | DDSCAPS2_CUBEMAP_ALL_FACES;
+    builder.dataSize = 6 * 64;
+
+    std::vector<unsigned char> bytes = builder.Build();
+    DdsFile file;
+
+    ASSERT_TRUE(file.Open(ByteSpan(&bytes[0], bytes.size())));
+    EXPECT_EQ(TextureFormat::B8G8R8A8Unorm, file.Format());
+    EXPECT_TRUE(file.IsCubeMap());
+    EXPECT_EQ(6u, file.ItemCount());
+    EXPECT_EQ(&bytes[LEGACY_DATA_OFFSET + 5 * 64], file.Surface(5, 0).data.pData);
+}
+
+TEST(DdsFileTests, RejectsTruncatedFiles)
+{
+    DdsBuilder builder(16, 16, 1);
+    builder.Legacy("DXT5");
+    builder.dataSize = 4 * 4 * 16;
+
+    std::vector<unsigned char> bytes = builder.Build();
+
+    // One texel byte short.
+    std::vector<unsigned char> shortData(bytes.begin(), bytes.end() - 1);
+    ExpectRejected(shortData, "file is truncated or corrupt");
+
+    // Cut off inside the header.
+    std::vector<unsigned char> shortHeader(bytes.begin(), bytes.begin() + 100);
+    ExpectRejected(shortHeader, "not a DDS file");
+
+    // A DX10 header that is cut off.
+    builder.Dx10(TextureFormat::Bc3Unorm, 1);
+    bytes = builder.Build();
+
+    std::vector<unsigned char> shortDx10(bytes.begin(), bytes.begin() + LEGACY_DATA_OFFSET + 8);
+    ExpectRejected(shortDx10, "file is truncated or corrupt");
+}
+
+TEST(DdsFileTests, RejectsHeadersThatAreNotDds)
+{
+    DdsBuilder builder(4, 4, 1);
+    builder.Legacy("DXT1");
+    builder.dataSize = 8;
+
+    std::vector<unsigned char> bytes = builder.Build();
+    bytes[0] = 'X';
+    ExpectRejected(bytes, "not a DDS file");
+
+    builder.header.size = 100;
+    ExpectRejected(builder.Build(), "not a DDS file");
+}
+
+TEST(DdsFileTests, RejectsUnsupportedFormats)
+{
+    // 24 bit RGB has no DXGI equivalent.
+    DdsBuilder rgb(4, 4, 1);
+    rgb.LegacyRgb(24, 0xFF0000, 0x00FF00, 0x0000FF, 0);
+    rgb.dataSize = 48;
+    ExpectRejected(rgb.Build(), "unsupported pixel format");
+
+    DdsBuilder fourCC(4, 4, 1);
+    fourCC.Legacy("ETC1");
+    fourCC.dataSize = 8;
+    ExpectRejected(fourCC.Build(), "unsupported pixel format");
+
+    // DXGI_FORMAT_R32G32B32A32_TYPELESS.
+    DdsBuilder dx10(4, 4, 1);
+    dx10.Dx10(static_cast<TextureFormat>(1), 1);
+    dx10.dataSize = 256;
+    ExpectRejected(dx10.Build(), "unsupported pixel format");
+}
+
+TEST(DdsFileTests, RejectsDimensionsAndMipCountsOutOfRange)
+{
+    DdsBuilder tooManyMips(4, 4, 4);
+    tooManyMips.Legacy("DXT1");
+    tooManyMips.dataSize = 4 * 8;
+    ExpectRejected(tooManyMips.Build(), "texture has more mips than its size allows");
+
+    DdsBuilder empty(0, 4, 1);
+    empty.Legacy("DXT1");
+    empty.dataSize = 8;
+    ExpectRejected(empty.Build(), "texture dimensions are out of range");
+
+    DdsBuilder huge(DdsFile::MAX_DIMENSION * 2, 4, 1);
+    huge.Legacy("DXT1");
+    ExpectRejected(huge.Build(), "texture dimensions are out of range");
+
+    DdsBuilder noItems(4, 4, 1);
+    noItems.Dx10(TextureFormat::R8Unorm, 0);
+    noItems.dataSize = 16;
+    ExpectRejected(noItems.Build(), "texture array size is out of range");
+}
@@ -0,0 +1,264 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "stdafx.h"
+#include "graphics/GeometryPool.h"
+#include "MockDevice.h"
+
+#include <cstring>
+#include <vector>
+
+namespace
+{
+    struct TestVertex
+    {
+        float position[3];
+    };
+
+    /**
+     * A mesh whose vertices all hold the mesh's number, so it can be found in the pool's buffers,
+     * and whose indices count up from zero.
+     */
+    struct TestMesh
+    {
+        TestMesh(unsigned int id, unsigned int vertexCount, unsigned int indexCount)
+            : vertices(vertexCount),
+              indices(indexCount)
+        {
+            for (unsigned int i = 0; i < vertexCount; ++i)
+            {
+                vertices[i].position[0] = static_cast<float>(id);
+                vertices[i].position[1] = static_cast<float>(i);
+                vertices[i].position[2] = 0.0f;
+            }
+
+            for (unsigned int i = 0; i < indexCount; ++i)
+            {
+                indices[i] = i % vertexCount;
+            }
+        }
+
+        GeometryPool::Handle Upload(GeometryPool * pPool, ID3D10Device * pDevice) const
+        {
+            return pPool->Upload(
+                pDevice,
+                &vertices[0],
+                static_cast<unsigned int>(vertices.size()),
+                &indices[0],
+                static_cast<unsigned int>(indices.size()));
+        }
+
+        std::vector<TestVertex> vertices;
+        std::vector<unsigned int> indices;
+    };
+
+    // Check the pool's buffers hold a mesh at the place the pool says it is.
+    void ExpectInPool(const MockDevice& device, const GeometryPool& pool, GeometryPool::Handle handle, const TestMesh& mesh)
+    {
+        const GeometryRange& range = pool.Range(handle);
+        const MockBuffer * pVertexBuffer = static_cast<const MockBuffer *>(device.VertexBuffer(0));
+        const MockBuffer * pIndexBuffer = static_cast<const MockBuffer *>(device.IndexBuffer());
+
+        ASSERT_NE(nullptr, pVertexBuffer);
+        ASSERT_NE(nullptr, pIndexBuffer);
+        ASSERT_EQ(mesh.vertices.size(), range.vertexCount);
+        ASSERT_EQ(mesh.indices.size(), range.indexCount);
+
+        EXPECT_EQ(0, memcmp(
+            &pVertexBuffer->Contents()[range.baseVertex * sizeof(TestVertex)],
+            &mesh.vertices[0],
+            mesh.vertices.size() * sizeof(TestVertex)));
+
+        EXPECT_EQ(0, memcmp(
+            &pIndexBuffer->Contents()[range.firstIndex * sizeof(unsigned int)],
+            &mesh.indices[0],
+            mesh.indices.size() * sizeof(unsigned int)));
+    }
+}
+
+TEST(GeometryPoolTests, UploadCopiesMeshesIntoTheSharedBuffers)
+{
+    MockDevice device;
+    GeometryPool pool(&device, sizeof(TestVertex), 1000, 3000);
+
+    TestMesh a(1, 24, 36), b(2, 8, 12);
+    GeometryPool::Handle handleA = a.Upload(&pool, &device);
+    GeometryPool::Handle handleB = b.Upload(&pool, &device);
+
+    ASSERT_NE(GeometryPool::INVALID_HANDLE, handleA);
+    ASSERT_NE(GeometryPool::INVALID_HANDLE, handleB);
+    EXPECT_EQ(2u, device.BufferCount());
+    EXPECT_EQ(2u, pool.MeshCount());
+    EXPECT_EQ(24u, pool.Range(handleB).baseVertex);
+    EXPECT_EQ(36u, pool.Range(handleB).firstIndex);
+
+    pool.Draw(&device, handleA);
+    ExpectInPool(device, pool, handleA, a);
+    ExpectInPool(device, pool, handleB, b);
+}
+
+TEST(GeometryPoolTests, ConsecutiveDrawsBindTheBuffersOnce)
+{
+    MockDevice device;
+    GeometryPool pool(&device, sizeof(TestVertex), 4096, 16384);
+    std::vector<TestMesh> meshes;
+    std::vector<GeometryPool::Handle> handles;
+
+    for (unsigned int i = 0; i < 8; ++i)
+    {
+        meshes.push_back(TestMesh(i, 24 + i, 36 + 3 * i));
+    }
+
+    for (size_t i = 0; i < meshes.size(); ++i)
+    {
+        handles.push_back(meshes[i].Upload(&pool, &device));
+        ASSERT_NE(GeometryPool::INVALID_HANDLE, handles.back());
+    }
+
+    // 152 draws that switch mesh every time. Meshes with buffers of their own would bind a vertex
+    // and an index buffer before each one.
+    for (unsigned int i = 0; i < 152; ++i)
+    {
+        GeometryPool::Handle handle = handles[i % handles.size()];
+        pool.Draw(&device, handle);
+
+        EXPECT_EQ(pool.Range(handle).indexCount, device.LastIndexCount());
+        EXPECT_EQ(pool.Range(handle).firstIndex, device.LastStartIndex());
+        EXPECT_EQ(static_cast<INT>(pool.Range(handle).baseVertex), device.LastBaseVertex());
+    }
+
+    EXPECT_EQ(152u, device.DrawCount());
+    EXPECT_EQ(1u, device.VertexBufferBindCount());
+    EXPECT_EQ(1u, device.IndexBufferBindCount());
+
+    EXPECT_EQ(152u, pool.Stats().drawCount);
+    EXPECT_EQ(2u, pool.Stats().bindCount);
+    EXPECT_EQ(304u, pool.Stats().unpooledBindCount);
+    EXPECT_EQ(302u, pool.Stats().BindsSaved());
+
+    pool.ResetStats();
+    EXPECT_EQ(0u, pool.Stats().drawCount);
+    EXPECT_EQ(0u, pool.Stats().bindCount);
+}
+
+TEST(GeometryPoolTests, InvalidateBindingBindsAgainOnTheNextDraw)
+{
+    MockDevice device;
+    GeometryPool pool(&device, sizeof(TestVertex), 100, 300);
+
+    TestMesh mesh(1, 8, 12);
+    GeometryPool::Handle handle = mesh.Upload(&pool, &device);
+
+    pool.Draw(&device, handle);
+    pool.Draw(&device, handle);
+    EXPECT_EQ(1u, device.VertexBufferBindCount());
+
+    pool.InvalidateBinding();
+    pool.Draw(&device, handle);
+
+    EXPECT_EQ(2u, device.VertexBufferBindCount());
+    EXPECT_EQ(2u, device.IndexBufferBindCount());
+    EXPECT_EQ(4u, pool.Stats().bindCount);
+}
+
+TEST(GeometryPoolTests, InstancedDrawsOnlyBindTheInstanceStream)
+{
+    MockDevice device;
+    GeometryPool pool(&device, sizeof(TestVertex), 100, 300);
+
+    TestMesh a(1, 8, 12), b(2, 8, 12);
+    GeometryPool::Handle handleA = a.Upload(&pool, &device);
+    GeometryPool::Handle handleB = b.Upload(&pool, &device);
+
+    D3D10_BUFFER_DESC instanceDesc = { 64 * 16, D3D10_USAGE_DYNAMIC, D3D10_BIND_VERTEX_BUFFER, D3D10_CPU_ACCESS_WRITE, 0 };
+    Microsoft::WRL::ComPtr<ID3D10Buffer> instances;
+    ASSERT_EQ(S_OK, device.CreateBuffer(&instanceDesc, nullptr, &instances));
+
+    pool.DrawInstanced(&device, handleA, instances.Get(), 64, 10, 0);
+    pool.DrawInstanced(&device, handleB, instances.Get(), 64, 6, 10);
+
+    // One bind of the pool's vertex buffer, and one of the instance buffer per draw.
+    EXPECT_EQ(3u, device.VertexBufferBindCount());
+    EXPECT_EQ(1u, device.IndexBufferBindCount());
+    EXPECT_EQ(instances.Get(), device.VertexBuffer(1));
+    EXPECT_EQ(4u, pool.Stats().bindCount);
+    EXPECT_EQ(4u, pool.Stats().unpooledBindCount);
+}
+
+TEST(GeometryPoolTests, UploadDefragmentsWhenTheFreeSpaceIsSplit)
+{
+    MockDevice device;
+    GeometryPool pool(&device, sizeof(TestVertex), 100, 300);
+
+    TestMesh a(1, 30, 90), b(2, 30, 90), c(3, 30, 90), d(4, 35, 105);
+    GeometryPool::Handle handleA = a.Upload(&pool, &device);
+    GeometryPool::Handle handleB = b.Upload(&pool, &device);
+    GeometryPool::Handle handleC = c.Upload(&pool, &device);
+
+    pool.Draw(&device, handleA);
+    pool.Free(handleB);
+
+    // 40 vertices are free, but as a hole of 30 and 10 at the end.
+    ASSERT_EQ(40u, pool.VertexAllocator().FreeSpace());
+    ASSERT_LT(pool.VertexAllocator().LargestFreeRange(), 35u);
+
+    GeometryPool::Handle handleD = d.Upload(&pool, &device);
+
+    ASSERT_NE(GeometryPool::INVALID_HANDLE, handleD);
+    EXPECT_EQ(4u, device.BufferCount());
+    EXPECT_EQ(4u, device.CopyCount());       // The vertices and indices of A and C.
+    EXPECT_EQ(30u, pool.Range(handleC).baseVertex);
+    EXPECT_EQ(90u, pool.Range(handleC).firstIndex);
+    EXPECT_EQ(60u, pool.Range(handleD).baseVertex);
+
+    // The old buffers are gone, so the next draw has to bind the new ones.
+    pool.Draw(&device, handleA);
+    EXPECT_EQ(2u, device.VertexBufferBindCount());
+
+    ExpectInPool(device, pool, handleA, a);
+    ExpectInPool(device, pool, handleC, c);
+    ExpectInPool(device, pool, handleD, d);
+}
+
+TEST(GeometryPoolTests, UploadFailsWhenThePoolIsFull)
+{
+    MockDevice device;
+    GeometryPool pool(&device, sizeof(TestVertex), 100, 300);
+
+    TestMesh big(1, 80, 240), tooBig(2, 30, 60);
+
+    ASSERT_NE(GeometryPool::INVALID_HANDLE, big.Upload(&pool, &device));
+    EXPECT_EQ(GeometryPool::INVALID_HANDLE, tooBig.Upload(&pool, &device));
+
+    // Nothing was moved, since defragmenting could not have made room.
+    EXPECT_EQ(2u, device.BufferCount());
+    EXPECT_EQ(1u, pool.MeshCount());
+    EXPECT_EQ(20u, pool.VertexAllocator().FreeSpace());
+}
+
+TEST(GeometryPoolTests, FreedHandlesAreReused)
+{
+    MockDevice device;
+    GeometryPool pool(&device, sizeof(TestVertex), 100, 300);
+
+    TestMesh a(1, 10, 30), b(2, 10, 30);
+    GeometryPool::Handle handleA = a.Upload(&pool, &device);
+
+    pool.Free(handleA);
+
+    EXPECT_EQ(0u, pool.MeshCount());
+    EXPECT_EQ(handleA, b.Upload(&pool, &device));
+    EXPECT_EQ(100u, pool.VertexAllocator().FreeSpace() + 10u);
+}
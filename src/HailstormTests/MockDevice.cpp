@@ -0,0 +1,186 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "stdafx.h"
+#include "MockDevice.h"
+
+#include <cstring>
+
+MockBuffer::MockBuffer(const D3D10_BUFFER_DESC& desc)
+    : mReferenceCount(1),
+      mDesc(desc),
+      mContents(desc.ByteWidth)
+{
+}
+
+HRESULT MockBuffer::QueryInterface(REFIID, void ** ppvObject)
+{
+    *ppvObject = nullptr;
+    return E_NOINTERFACE;
+}
+
+ULONG MockBuffer::AddRef()
+{
+    return ++mReferenceCount;
+}
+
+ULONG MockBuffer::Release()
+{
+    ULONG count = --mReferenceCount;
+
+    if (count == 0)
+    {
+        delete this;
+    }
+
+    return count;
+}
+
+HRESULT MockBuffer::Map(D3D10_MAP, UINT, void ** ppData)
+{
+    *ppData = mContents.empty() ? nullptr : &mContents[0];
+    return S_OK;
+}
+
+MockDevice::MockDevice()
+    : mBufferCount(0),
+      mVertexBufferBindCount(0),
+      mIndexBufferBindCount(0),
+      mDrawCount(0),
+      mCopyCount(0),
+      mVertexBuffers(),
+      mIndexBuffer(nullptr),
+      mLastIndexCount(0),
+      mLastStartIndex(0),
+      mLastBaseVertex(0)
+{
+}
+
+void MockDevice::ResetCounts()
+{
+    mVertexBufferBindCount = 0;
+    mIndexBufferBindCount = 0;
+    mDrawCount = 0;
+    mCopyCount = 0;
+}
+
+void MockDevice::IASetVertexBuffers(
+    UINT StartSlot,
+    UINT NumBuffers,
+    ID3D10Buffer * const * ppVertexBuffers,
+    const UINT *,
+    const UINT *)
+{
+    for (UINT i = 0; i < NumBuffers; ++i)
+    {
+        mVertexBuffers[StartSlot + i] = ppVertexBuffers[i];
+    }
+
+    ++mVertexBufferBindCount;
+}
+
+void MockDevice::IASetIndexBuffer(ID3D10Buffer * pIndexBuffer, DXGI_FORMAT, UINT)
+{
+    mIndexBuffer = pIndexBuffer;
+    ++mIndexBufferBindCount;
+}
+
+void MockDevice::DrawIndexed(UINT IndexCount, UINT StartIndexLocation, INT BaseVertexLocation)
+{
+    mLastIndexCount = IndexCount;
+    mLastStartIndex = StartIndexLocation;
+    mLastBaseVertex = BaseVertexLocation;
+    ++mDrawCount;
+}
+
+void MockDevice::DrawIndexedInstanced(
+    UINT IndexCountPerInstance,
+    UINT,
+    UINT StartIndexLocation,
+    INT BaseVertexLocation,
+    UINT)
+{
+    DrawIndexed(IndexCountPerInstance, StartIndexLocation, BaseVertexLocation);
+}
+
+void MockDevice::CopySubresourceRegion(
+    ID3D10Resource * pDstResource,
+    UINT,
+    UINT DstX,
+    UINT,
+    UINT,
+    ID3D10Resource * pSrcResource,
+    UINT,
+    const D3D10_BOX * pSrcBox)
+{
+    // Only buffers are ever created, so every resource is a MockBuffer.
+    MockBuffer * pDestination = static_cast<MockBuffer *>(static_cast<ID3D10Buffer *>(pDstResource));
+    MockBuffer * pSource = static_cast<MockBuffer *>(static_cast<ID3D10Buffer *>(pSrcResource));
+    UINT begin = (pSrcBox != nullptr) ? pSrcBox->left : 0;
+    UINT end = (pSrcBox != nullptr) ? pSrcBox->right : static_cast<UINT>(pSource->Contents().size());
+
+    ASSERT_LE(end, pSource->Contents().size());
+    ASSERT_LE(DstX + (end - begin), pDestination->Contents().size());
+    ASSERT_NE(pDestination, pSource);
+
+    if (end > begin)
+    {
+        memcpy(&pDestination->Contents()[DstX], &pSource->Contents()[begin], end - begin);
+    }
+
+    ++mCopyCount;
+}
+
+void MockDevice::CopyResource(ID3D10Resource * pDstResource, ID3D10Resource * pSrcResource)
+{
+    CopySubresourceRegion(pDstResource, 0, 0, 0, 0, pSrcResource, 0, nullptr);
+}
+
+void MockDevice::UpdateSubresource(
+    ID3D10Resource * pDstResource,
+    UINT,
+    const D3D10_BOX * pDstBox,
+    const void * pSrcData,
+    UINT,
+    UINT)
+{
+    MockBuffer * pDestination = static_cast<MockBuffer *>(static_cast<ID3D10Buffer *>(pDstResource));
+    UINT begin = (pDstBox != nullptr) ? pDstBox->left : 0;
+    UINT end = (pDstBox != nullptr) ? pDstBox->right : static_cast<UINT>(pDestination->Contents().size());
+
+    ASSERT_LE(end, pDestination->Contents().size());
+
+    if (end > begin)
+    {
+        memcpy(&pDestination->Contents()[begin], pSrcData, end - begin);
+    }
+}
+
+HRESULT MockDevice::CreateBuffer(
+    const D3D10_BUFFER_DESC * pDesc,
+    const D3D10_SUBRESOURCE_DATA * pInitialData,
+    ID3D10Buffer ** ppBuffer)
+{
+    MockBuffer * pBuffer = new MockBuffer(*pDesc);
+
+    if (pInitialData != nullptr && pDesc->ByteWidth > 0)
+    {
+        memcpy(&pBuffer->Contents()[0], pInitialData->pSysMem, pDesc->ByteWidth);
+    }
+
+    *ppBuffer = pBuffer;
+    ++mBufferCount;
+    return S_OK;
+}
@@ -0,0 +1,205 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef SCOTT_HAILSTORM_TESTS_MOCK_DEVICE_H
+#define SCOTT_HAILSTORM_TESTS_MOCK_DEVICE_H
+
+#include <d3d10.h>
+#include <vector>
+
+/**
+ * A buffer made by MockDevice. Its contents are kept in system memory so tests can check what was
+ * written and copied into it.
+ */
+class MockBuffer : public ID3D10Buffer
+{
+public:
+    explicit MockBuffer(const D3D10_BUFFER_DESC& desc);
+
+    std::vector<unsigned char>& Contents() { return mContents; }
+    const std::vector<unsigned char>& Contents() const { return mContents; }
+
+    // IUnknown.
+    virtual HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void ** ppvObject) override;
+    virtual ULONG STDMETHODCALLTYPE AddRef() override;
+    virtual ULONG STDMETHODCALLTYPE Release() override;
+
+    // ID3D10DeviceChild.
+    virtual void STDMETHODCALLTYPE GetDevice(ID3D10Device ** ppDevice) override { *ppDevice = nullptr; }
+    virtual HRESULT STDMETHODCALLTYPE GetPrivateData(REFGUID, UINT *, void *) override { return E_NOTIMPL; }
+    virtual HRESULT STDMETHODCALLTYPE SetPrivateData(REFGUID, UINT, const void *) override { return E_NOTIMPL; }
+    virtual HRESULT STDMETHODCALLTYPE SetPrivateDataInterface(REFGUID, const IUnknown *) override { return E_NOTIMPL; }
+
+    // ID3D10Resource.
+    virtual void STDMETHODCALLTYPE GetType(D3D10_RESOURCE_DIMENSION * rType) override { *rType = D3D10_RESOURCE_DIMENSION_BUFFER; }
+    virtual void STDMETHODCALLTYPE SetEvictionPriority(UINT) override { }
+    virtual UINT STDMETHODCALLTYPE GetEvictionPriority() override { return 0; }
+
+    // ID3D10Buffer.
+    virtual HRESULT STDMETHODCALLTYPE Map(D3D10_MAP MapType, UINT MapFlags, void ** ppData) override;
+    virtual void STDMETHODCALLTYPE Unmap() override { }
+    virtual void STDMETHODCALLTYPE GetDesc(D3D10_BUFFER_DESC * pDesc) override { *pDesc = mDesc; }
+
+private:
+    ULONG mReferenceCount;
+    D3D10_BUFFER_DESC mDesc;
+    std::vector<unsigned char> mContents;
+};
+
+/**
+ * A Direct3D 10 device that draws nothing, for testing code that talks to the device without a
+ * graphics card. Only buffers can be created. Copies into buffers are carried out in system memory,
+ * and input assembler binds and draws are counted. Every other call is ignored.
+ */
+class MockDevice : public ID3D10Device
+{
+public:
+    MockDevice();
+
+    unsigned int BufferCount() const { return mBufferCount; }
+    unsigned int VertexBufferBindCount() const { return mVertexBufferBindCount; }
+    unsigned int IndexBufferBindCount() const { return mIndexBufferBindCount; }
+    unsigned int DrawCount() const { return mDrawCount; }
+    unsigned int CopyCount() const { return mCopyCount; }
+
+    // Buffer bound to a vertex buffer slot, and the index buffer, as of the last bind.
+    ID3D10Buffer * VertexBuffer(unsigned int slot) const { return mVertexBuffers[slot]; }
+    ID3D10Buffer * IndexBuffer() const { return mIndexBuffer; }
+
+    // Arguments of the last draw.
+    UINT LastIndexCount() const { return mLastIndexCount; }
+    UINT LastStartIndex() const { return mLastStartIndex; }
+    INT LastBaseVertex() const { return mLastBaseVertex; }
+
+    void ResetCounts();
+
+    // IUnknown. The device is owned by the test, so references are not counted.
+    virtual HRESULT STDMETHODCALLTYPE QueryInterface(REFIID, void ** ppvObject) override { *ppvObject = nullptr; return E_NOINTERFACE; }
+    virtual ULONG STDMETHODCALLTYPE AddRef() override { return 1; }
+    virtual ULONG STDMETHODCALLTYPE Release() override { return 1; }
+
+    // Input assembler, draws and copies, which are recorded.
+    virtual void STDMETHODCALLTYPE IASetVertexBuffers(UINT StartSlot, UINT NumBuffers, ID3D10Buffer * const * ppVertexBuffers, const UINT * pStrides, const UINT * pOffsets) override;
+    virtual void STDMETHODCALLTYPE IASetIndexBuffer(ID3D10Buffer * pIndexBuffer, DXGI_FORMAT Format, UINT Offset) override;
+    virtual void STDMETHODCALLTYPE DrawIndexed(UINT IndexCount, UINT StartIndexLocation, INT BaseVertexLocation) override;
+    virtual void STDMETHODCALLTYPE DrawIndexedInstanced(UINT IndexCountPerInstance, UINT InstanceCount, UINT StartIndexLocation, INT BaseVertexLocation, UINT StartInstanceLocation) override;
+    virtual void STDMETHODCALLTYPE CopySubresourceRegion(ID3D10Resource * pDstResource, UINT DstSubresource, UINT DstX, UINT DstY, UINT DstZ, ID3D10Resource * pSrcResource, UINT SrcSubresource, const D3D10_BOX * pSrcBox) override;
+    virtual void STDMETHODCALLTYPE CopyResource(ID3D10Resource * pDstResource, ID3D10Resource * pSrcResource) override;
+    virtual void STDMETHODCALLTYPE UpdateSubresource(ID3D10Resource * pDstResource, UINT DstSubresource, const D3D10_BOX * pDstBox, const void * pSrcData, UINT SrcRowPitch, UINT SrcDepthPitch) override;
+    virtual HRESULT STDMETHODCALLTYPE CreateBuffer(const D3D10_BUFFER_DESC * pDesc, const D3D10_SUBRESOURCE_DATA * pInitialData, ID3D10Buffer ** ppBuffer) override;
+
+    // Everything else is ignored.
+    virtual void STDMETHODCALLTYPE VSSetConstantBuffers(UINT, UINT, ID3D10Buffer * const *) override { }
+    virtual void STDMETHODCALLTYPE PSSetShaderResources(UINT, UINT, ID3D10ShaderResourceView * const *) override { }
+    virtual void STDMETHODCALLTYPE PSSetShader(ID3D10PixelShader *) override { }
+    virtual void STDMETHODCALLTYPE PSSetSamplers(UINT, UINT, ID3D10SamplerState * const *) override { }
+    virtual void STDMETHODCALLTYPE VSSetShader(ID3D10VertexShader *) override { }
+    virtual void STDMETHODCALLTYPE Draw(UINT, UINT) override { ++mDrawCount; }
+    virtual void STDMETHODCALLTYPE PSSetConstantBuffers(UINT, UINT, ID3D10Buffer * const *) override { }
+    virtual void STDMETHODCALLTYPE IASetInputLayout(ID3D10InputLayout *) override { }
+    virtual void STDMETHODCALLTYPE DrawInstanced(UINT, UINT, UINT, UINT) override { ++mDrawCount; }
+    virtual void STDMETHODCALLTYPE GSSetConstantBuffers(UINT, UINT, ID3D10Buffer * const *) override { }
+    virtual void STDMETHODCALLTYPE GSSetShader(ID3D10GeometryShader *) override { }
+    virtual void STDMETHODCALLTYPE IASetPrimitiveTopology(D3D10_PRIMITIVE_TOPOLOGY) override { }
+    virtual void STDMETHODCALLTYPE VSSetShaderResources(UINT, UINT, ID3D10ShaderResourceView * const *) override { }
+    virtual void STDMETHODCALLTYPE VSSetSamplers(UINT, UINT, ID3D10SamplerState * const *) override { }
+    virtual void STDMETHODCALLTYPE SetPredication(ID3D10Predicate *, BOOL) override { }
+    virtual void STDMETHODCALLTYPE GSSetShaderResources(UINT, UINT, ID3D10ShaderResourceView * const *) override { }
+    virtual void STDMETHODCALLTYPE GSSetSamplers(UINT, UINT, ID3D10SamplerState * const *) override { }
+    virtual void STDMETHODCALLTYPE OMSetRenderTargets(UINT, ID3D10RenderTargetView * const *, ID3D10DepthStencilView *) override { }
+    virtual void STDMETHODCALLTYPE OMSetBlendState(ID3D10BlendState *, const FLOAT [4], UINT) override { }
+    virtual void STDMETHODCALLTYPE OMSetDepthStencilState(ID3D10DepthStencilState *, UINT) override { }
+    virtual void STDMETHODCALLTYPE SOSetTargets(UINT, ID3D10Buffer * const *, const UINT *) override { }
+    virtual void STDMETHODCALLTYPE DrawAuto() override { ++mDrawCount; }
+    virtual void STDMETHODCALLTYPE RSSetState(ID3D10RasterizerState *) override { }
+    virtual void STDMETHODCALLTYPE RSSetViewports(UINT, const D3D10_VIEWPORT *) override { }
+    virtual void STDMETHODCALLTYPE RSSetScissorRects(UINT, const D3D10_RECT *) override { }
+    virtual void STDMETHODCALLTYPE ClearRenderTargetView(ID3D10RenderTargetView *, const FLOAT [4]) override { }
+    virtual void STDMETHODCALLTYPE ClearDepthStencilView(ID3D10DepthStencilView *, UINT, FLOAT, UINT8) override { }
+    virtual void STDMETHODCALLTYPE GenerateMips(ID3D10ShaderResourceView *) override { }
+    virtual void STDMETHODCALLTYPE ResolveSubresource(ID3D10Resource *, UINT, ID3D10Resource *, UINT, DXGI_FORMAT) override { }
+    virtual void STDMETHODCALLTYPE VSGetConstantBuffers(UINT, UINT, ID3D10Buffer **) override { }
+    virtual void STDMETHODCALLTYPE PSGetShaderResources(UINT, UINT, ID3D10ShaderResourceView **) override { }
+    virtual void STDMETHODCALLTYPE PSGetShader(ID3D10PixelShader **) override { }
+    virtual void STDMETHODCALLTYPE PSGetSamplers(UINT, UINT, ID3D10SamplerState **) override { }
+    virtual void STDMETHODCALLTYPE VSGetShader(ID3D10VertexShader **) override { }
+    virtual void STDMETHODCALLTYPE PSGetConstantBuffers(UINT, UINT, ID3D10Buffer **) override { }
+    virtual void STDMETHODCALLTYPE IAGetInputLayout(ID3D10InputLayout **) override { }
+    virtual void STDMETHODCALLTYPE IAGetVertexBuffers(UINT, UINT, ID3D10Buffer **, UINT *, UINT *) override { }
+    virtual void STDMETHODCALLTYPE IAGetIndexBuffer(ID3D10Buffer **, DXGI_FORMAT *, UINT *) override { }
+    virtual void STDMETHODCALLTYPE GSGetConstantBuffers(UINT, UINT, ID3D10Buffer **) override { }
+    virtual void STDMETHODCALLTYPE GSGetShader(ID3D10GeometryShader **) override { }
+    virtual void STDMETHODCALLTYPE IAGetPrimitiveTopology(D3D10_PRIMITIVE_TOPOLOGY *) override { }
+    virtual void STDMETHODCALLTYPE VSGetShaderResources(UINT, UINT, ID3D10ShaderResourceView **) override { }
+    virtual void STDMETHODCALLTYPE VSGetSamplers(UINT, UINT, ID3D10SamplerState **) override { }
+    virtual void STDMETHODCALLTYPE GetPredication(ID3D10Predicate **, BOOL *) override { }
+    virtual void STDMETHODCALLTYPE GSGetShaderResources(UINT, UINT, ID3D10ShaderResourceView **) override { }
+    virtual void STDMETHODCALLTYPE GSGetSamplers(UINT, UINT, ID3D10SamplerState **) override { }
+    virtual void STDMETHODCALLTYPE OMGetRenderTargets(UINT, ID3D10RenderTargetView **, ID3D10DepthStencilView **) override { }
+    virtual void STDMETHODCALLTYPE OMGetBlendState(ID3D10BlendState **, FLOAT [4], UINT *) override { }
+    virtual void STDMETHODCALLTYPE OMGetDepthStencilState(ID3D10DepthStencilState **, UINT *) override { }
+    virtual void STDMETHODCALLTYPE SOGetTargets(UINT, ID3D10Buffer **, UINT *) override { }
+    virtual void STDMETHODCALLTYPE RSGetState(ID3D10RasterizerState **) override { }
+    virtual void STDMETHODCALLTYPE RSGetViewports(UINT *, D3D10_VIEWPORT *) override { }
+    virtual void STDMETHODCALLTYPE RSGetScissorRects(UINT *, D3D10_RECT *) override { }
+    virtual HRESULT STDMETHODCALLTYPE GetDeviceRemovedReason() override { return S_OK; }
+    virtual HRESULT STDMETHODCALLTYPE SetExceptionMode(UINT) override { return S_OK; }
+    virtual UINT STDMETHODCALLTYPE GetExceptionMode() override { return 0; }
+    virtual HRESULT STDMETHODCALLTYPE GetPrivateData(REFGUID, UINT *, void *) override { return E_NOTIMPL; }
+    virtual HRESULT STDMETHODCALLTYPE SetPrivateData(REFGUID, UINT, const void *) override { return E_NOTIMPL; }
+    virtual HRESULT STDMETHODCALLTYPE SetPrivateDataInterface(REFGUID, const IUnknown *) override { return E_NOTIMPL; }
+    virtual void STDMETHODCALLTYPE ClearState() override { }
+    virtual void STDMETHODCALLTYPE Flush() override { }
+    virtual HRESULT STDMETHODCALLTYPE CreateTexture1D(const D3D10_TEXTURE1D_DESC *, const D3D10_SUBRESOURCE_DATA *, ID3D10Texture1D **) override { return E_NOTIMPL; }
+    virtual HRESULT STDMETHODCALLTYPE CreateTexture2D(const D3D10_TEXTURE2D_DESC *, const D3D10_SUBRESOURCE_DATA *, ID3D10Texture2D **) override { return E_NOTIMPL; }
+    virtual HRESULT STDMETHODCALLTYPE CreateTexture3D(const D3D10_TEXTURE3D_DESC *, const D3D10_SUBRESOURCE_DATA *, ID3D10Texture3D **) override { return E_NOTIMPL; }
+    virtual HRESULT STDMETHODCALLTYPE CreateShaderResourceView(ID3D10Resource *, const D3D10_SHADER_RESOURCE_VIEW_DESC *, ID3D10ShaderResourceView **) override { return E_NOTIMPL; }
+    virtual HRESULT STDMETHODCALLTYPE CreateRenderTargetView(ID3D10Resource *, const D3D10_RENDER_TARGET_VIEW_DESC *, ID3D10RenderTargetView **) override { return E_NOTIMPL; }
+    virtual HRESULT STDMETHODCALLTYPE CreateDepthStencilView(ID3D10Resource *, const D3D10_DEPTH_STENCIL_VIEW_DESC *, ID3D10DepthStencilView **) override { return E_NOTIMPL; }
+    virtual HRESULT STDMETHODCALLTYPE CreateInputLayout(const D3D10_INPUT_ELEMENT_DESC *, UINT, const void *, SIZE_T, ID3D10InputLayout **) override { return E_NOTIMPL; }
+    virtual HRESULT STDMETHODCALLTYPE CreateVertexShader(const void *, SIZE_T, ID3D10VertexShader **) override { return E_NOTIMPL; }
+    virtual HRESULT STDMETHODCALLTYPE CreateGeometryShader(const void *, SIZE_T, ID3D10GeometryShader **) override { return E_NOTIMPL; }
+    virtual HRESULT STDMETHODCALLTYPE CreateGeometryShaderWithStreamOutput(const void *, SIZE_T, const D3D10_SO_DECLARATION_ENTRY *, UINT, UINT, ID3D10GeometryShader **) override { return E_NOTIMPL; }
+    virtual HRESULT STDMETHODCALLTYPE CreatePixelShader(const void *, SIZE_T, ID3D10PixelShader **) override { return E_NOTIMPL; }
+    virtual HRESULT STDMETHODCALLTYPE CreateBlendState(const D3D10_BLEND_DESC *, ID3D10BlendState **) override { return E_NOTIMPL; }
+    virtual HRESULT STDMETHODCALLTYPE CreateDepthStencilState(const D3D10_DEPTH_STENCIL_DESC *, ID3D10DepthStencilState **) override { return E_NOTIMPL; }
+    virtual HRESULT STDMETHODCALLTYPE CreateRasterizerState(const D3D10_RASTERIZER_DESC *, ID3D10RasterizerState **) override { return E_NOTIMPL; }
+    virtual HRESULT STDMETHODCALLTYPE CreateSamplerState(const D3D10_SAMPLER_DESC *, ID3D10SamplerState **) override { return E_NOTIMPL; }
+    virtual HRESULT STDMETHODCALLTYPE CreateQuery(const D3D10_QUERY_DESC *, ID3D10Query **) override { return E_NOTIMPL; }
+    virtual HRESULT STDMETHODCALLTYPE CreatePredicate(const D3D10_QUERY_DESC *, ID3D10Predicate **) override { return E_NOTIMPL; }
+    virtual HRESULT STDMETHODCALLTYPE CreateCounter(const D3D10_COUNTER_DESC *, ID3D10Counter **) override { return E_NOTIMPL; }
+    virtual HRESULT STDMETHODCALLTYPE CheckFormatSupport(DXGI_FORMAT, UINT *) override { return E_NOTIMPL; }
+    virtual HRESULT STDMETHODCALLTYPE CheckMultisampleQualityLevels(DXGI_FORMAT, UINT, UINT *) override { return E_NOTIMPL; }
+    virtual void STDMETHODCALLTYPE CheckCounterInfo(D3D10_COUNTER_INFO *) override { }
+    virtual HRESULT STDMETHODCALLTYPE CheckCounter(const D3D10_COUNTER_DESC *, D3D10_COUNTER_TYPE *, UINT *, LPSTR, UINT *, LPSTR, UINT *, LPSTR, UINT *) override { return E_NOTIMPL; }
+    virtual UINT STDMETHODCALLTYPE GetCreationFlags() override { return 0; }
+    virtual HRESULT STDMETHODCALLTYPE OpenSharedResource(HANDLE, REFIID, void **) override { return E_NOTIMPL; }
+    virtual void STDMETHODCALLTYPE SetTextFilterSize(UINT, UINT) override { }
+    virtual void STDMETHODCALLTYPE GetTextFilterSize(UINT *, UINT *) override { }
+
+private:
+    unsigned int mBufferCount;
+    unsigned int mVertexBufferBindCount;
+    unsigned int mIndexBufferBindCount;
+    unsigned int mDrawCount;
+    unsigned int mCopyCount;
+    ID3D10Buffer * mVertexBuffers[D3D10_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT];
+    ID3D10Buffer * mIndexBuffer;
+    UINT mLastIndexCount;
+    UINT mLastStartIndex;
+    INT mLastBaseVertex;
+};
+
+#endif
@@ -0,0 +1,281 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "stdafx.h"
+#include "runtime/OffsetAllocator.h"
+
+#include <vector>
+
+namespace
+{
+    // Live allocations, kept by the tests to check the allocator against.
+    struct Range
+    {
+        OffsetAllocator::NodeIndex node;
+        unsigned int offset;
+        unsigned int size;
+    };
+
+    bool ByOffset(const Range& a, const Range& b)
+    {
+        return a.offset < b.offset;
+    }
+
+    // Check that no two ranges overlap, that they all fit and that the free space adds up.
+    void ExpectConsistent(const OffsetAllocator& allocator, std::vector<Range> ranges)
+    {
+        std::sort(ranges.begin(), ranges.end(), ByOffset);
+        unsigned int used = 0;
+
+        for (size_t i = 0; i < ranges.size(); ++i)
+        {
+            EXPECT_EQ(ranges[i].offset, allocator.Offset(ranges[i].node));
+            EXPECT_EQ(ranges[i].size, allocator.Size(ranges[i].node));
+            EXPECT_LE(ranges[i].offset + ranges[i].size, allocator.Capacity());
+
+            if (i > 0)
+            {
+                EXPECT_LE(ranges[i - 1].offset + ranges[i - 1].size, ranges[i].offset);
+            }
+
+            used += ranges[i].size;
+        }
+
+        EXPECT_EQ(allocator.Capacity() - used, allocator.FreeSpace());
+        EXPECT_EQ(ranges.size(), allocator.AllocationCount());
+        EXPECT_LE(allocator.LargestFreeRange(), allocator.FreeSpace());
+    }
+}
+
+TEST(OffsetAllocatorTests, AllocatesConsecutiveRangesFromTheStart)
+{
+    OffsetAllocator allocator(1000);
+
+    OffsetAllocator::Allocation a = allocator.Allocate(100);
+    OffsetAllocator::Allocation b = allocator.Allocate(250);
+
+    ASSERT_TRUE(a.IsValid());
+    ASSERT_TRUE(b.IsValid());
+    EXPECT_EQ(0u, a.offset);
+    EXPECT_EQ(100u, a.size);
+    EXPECT_EQ(100u, b.offset);
+    EXPECT_EQ(250u, b.size);
+    EXPECT_EQ(650u, allocator.FreeSpace());
+    EXPECT_EQ(650u, allocator.LargestFreeRange());
+    EXPECT_EQ(2u, allocator.AllocationCount());
+}
+
+TEST(OffsetAllocatorTests, FailsWhenNoRangeIsBigEnough)
+{
+    OffsetAllocator allocator(100);
+
+    EXPECT_FALSE(allocator.Allocate(0).IsValid());
+    EXPECT_FALSE(allocator.Allocate(101).IsValid());
+
+    OffsetAllocator::Allocation all = allocator.Allocate(100);
+
+    ASSERT_TRUE(all.IsValid());
+    EXPECT_FALSE(allocator.Allocate(1).IsValid());
+    EXPECT_EQ(0u, allocator.LargestFreeRange());
+}
+
+TEST(OffsetAllocatorTests, FillsAnExactlySizedRangeInTheBinBelow)
+{
+    // 100 does not sit on a bin boundary, so rounding the request up skips the bin the only free
+    // range is in. It still has to be found.
+    OffsetAllocator allocator(100);
+
+    EXPECT_TRUE(allocator.Allocate(100).IsValid());
+
+    OffsetAllocator nearlyFull(1000);
+    OffsetAllocator::Allocation head = nearlyFull.Allocate(900);
+
+    ASSERT_TRUE(head.IsValid());
+    EXPECT_TRUE(nearlyFull.Allocate(100).IsValid());
+}
+
+TEST(OffsetAllocatorTests, FreeMergesWithNeighbors)
+{
+    OffsetAllocator allocator(300);
+
+    OffsetAllocator::Allocation a = allocator.Allocate(100);
+    OffsetAllocator::Allocation b = allocator.Allocate(100);
+    OffsetAllocator::Allocation c = allocator.Allocate(100);
+
+    allocator.Free(a.node);
+    allocator.Free(c.node);
+
+    EXPECT_EQ(200u, allocator.FreeSpace());
+    EXPECT_EQ(100u, allocator.LargestFreeRange());
+    EXPECT_FALSE(allocator.Allocate(200).IsValid());
+
+    allocator.Free(b.node);
+
+    EXPECT_EQ(300u, allocator.LargestFreeRange());
+    EXPECT_EQ(0u, allocator.AllocationCount());
+
+    OffsetAllocator::Allocation all = allocator.Allocate(300);
+
+    ASSERT_TRUE(all.IsValid());
+    EXPECT_EQ(0u, all.offset);
+}
+
+TEST(OffsetAllocatorTests, ResetFreesEverything)
+{
+    OffsetAllocator allocator(64);
+
+    allocator.Allocate(10);
+    allocator.Allocate(20);
+    allocator.Reset();
+
+    EXPECT_EQ(64u, allocator.FreeSpace());
+    EXPECT_EQ(64u, allocator.LargestFreeRange());
+    EXPECT_EQ(0u, allocator.AllocationCount());
+}
+
+TEST(OffsetAllocatorTests, DefragmentPacksAllocationsInOrder)
+{
+    OffsetAllocator allocator(1000);
+    std::vector<Range> ranges;
+
+    for (unsigned int i = 0; i < 8; ++i)
+    {
+        OffsetAllocator::Allocation allocation = allocator.Allocate(50 + i * 10);
+        Range range = { allocation.node, allocation.offset, allocation.size };
+
+        ASSERT_TRUE(allocation.IsValid());
+        ranges.push_back(range);
+    }
+
+    // Free every other allocation, leaving holes the size of the allocations around them.
+    std::vector<Range> kept;
+
+    for (size_t i = 0; i < ranges.size(); ++i)
+    {
+        if (i % 2 == 0)
+        {
+            allocator.Free(ranges[i].node);
+        }
+        else
+        {
+            kept.push_back(ranges[i]);
+        }
+    }
+
+    std::vector<OffsetAllocator::Move> moves;
+    allocator.Defragment(&moves);
+
+    // Every kept allocation was after a hole, so every one moves, in increasing order of offset and
+    // never onto data that has yet to move.
+    ASSERT_EQ(kept.size(), moves.size());
+
+    unsigned int offset = 0;
+
+    for (size_t i = 0; i < kept.size(); ++i)
+    {
+        EXPECT_EQ(kept[i].node, moves[i].node);
+        EXPECT_EQ(kept[i].offset, moves[i].oldOffset);
+        EXPECT_EQ(offset, moves[i].newOffset);
+        EXPECT_EQ(kept[i].size, moves[i].size);
+        EXPECT_LT(moves[i].newOffset, moves[i].oldOffset);
+
+        if (i > 0)
+        {
+            EXPECT_LE(moves[i - 1].oldOffset + moves[i - 1].size, moves[i].oldOffset);
+        }
+
+        kept[i].offset = offset;
+        offset += kept[i].size;
+    }
+
+    ExpectConsistent(allocator, kept);
+    EXPECT_EQ(allocator.FreeSpace(), allocator.LargestFreeRange());
+
+    // Nothing is left to move.
+    allocator.Defragment(&moves);
+    EXPECT_TRUE(moves.empty());
+}
+
+TEST(OffsetAllocatorTests, StaysConsistentOverRandomAllocationsAndFrees)
+{
+    OffsetAllocator allocator(1 << 16);
+    std::vector<Range> ranges;
+    std::vector<OffsetAllocator::Move> moves;
+    unsigned int seed = 12345;
+
+    for (unsigned int step = 0; step < 20000; ++step)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        unsigned int choice = (seed >> 16) % 100;
+
+        if (choice < 55 || ranges.empty())
+        {
+            unsigned int size = 1 + (seed >> 8) % 1500;
+            unsigned int freeBefore = allocator.FreeSpace();
+            OffsetAllocator::Allocation allocation = allocator.Allocate(size);
+
+            if (allocation.IsValid())
+            {
+                Range range = { allocation.node, allocation.offset, allocation.size };
+                ranges.push_back(range);
+            }
+            else
+            {
+                // A failure is only allowed when no free range is big enough.
+                EXPECT_EQ(freeBefore, allocator.FreeSpace());
+                EXPECT_LT(allocator.LargestFreeRange(), size);
+            }
+        }
+        else if (choice < 99)
+        {
+            size_t index = (seed >> 4) % ranges.size();
+
+            allocator.Free(ranges[index].node);
+            ranges[index] = ranges.back();
+            ranges.pop_back();
+        }
+        else
+        {
+            allocator.Defragment(&moves);
+
+            for (size_t i = 0; i < moves.size(); ++i)
+            {
+                for (size_t j = 0; j < ranges.size(); ++j)
+                {
+                    if (ranges[j].node == moves[i].node)
+                    {
+                        ranges[j].offset = moves[i].newOffset;
+                    }
+                }
+            }
+
+            EXPECT_EQ(allocator.FreeSpace(), allocator.LargestFreeRange());
+        }
+
+        if (step % 500 == 0)
+        {
+            ExpectConsistent(allocator, ranges);
+        }
+    }
+
+    ExpectConsistent(allocator, ranges);
+
+    for (size_t i = 0; i < ranges.size(); ++i)
+    {
+        allocator.Free(ranges[i].node);
+    }
+
+    EXPECT_EQ(allocator.Capacity(), allocator.LargestFreeRange());
+}
@@ -0,0 +1,1088 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "stdafx.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#if !defined(_WIN32)
+#   include <dirent.h>
+#   include <sys/stat.h>
+#endif
+
+#include "graphics/MeshFile.h"
+#include "graphics/MeshImporter.h"
+#include "graphics/MeshOptimizer.h"
+#include "graphics/staticmeshvertex.h"
+#include "runtime/AssetArchive.h"
+#include "runtime/AsyncFileReader.h"
+#include "runtime/Hash.h"
+#include "runtime/Lz.h"
+#include "runtime/Parallel.h"
+#include "runtime/Stopwatch.h"
+
+/**
+ * Cooks a directory of source assets into an archive (see AssetArchive) as a build step, redoing only
+ * the work that changed since the last cook.
+ *
+ *   AssetCooker <source directory> <output.pak> [-compress [level]] [-align N] [-threads N] [-force] [-verbose]
+ *
+ * Every file under the source directory is a node in a dependency graph, and effects depend on the
+ * files they #include. A node's key hashes its contents, the keys of everything it depends on and
+ * the cooker version, so editing light.fx changes the key of landscape.fx as well.
+ *
+ * The keys of the last cook are kept in a manifest next to the archive (<output.pak>.cook), along with
+ * each file's size and modification time. Files whose size and time still match are not read again,
+ * nodes whose key still matches are not cooked again, and their cooked bytes are copied from the old
+ * archive. When nothing changed the archive is not touched at all. Changed files are read in one batch
+ * with AsyncFileReader and cooked in parallel.
+ *
+ * Cooking by file type:
+ *   .fx    #include directives are replaced by the included file, with #line directives so that the
+ *          compiler still reports errors against the original files. Missing or circular includes
+ *          fail the cook.
+ *   .dds   Checked for a complete DDS header and stored unchanged.
+ *   .obj   Imported, optimized for the vertex cache and vertex fetch and stored as a mesh file (see
+ *   .ply   MeshFile) under the same path with a .mesh extension, as MeshConverter would convert it.
+ *          Levels of detail are left to MeshConverter -lods.
+ *   other  Stored unchanged.
+ *
+ * Heightmaps are not cooked: the landscape is generated from noise at run time and cached on first
+ * use (see TerrainCache), keyed by the generation settings, so there is no heightmap source asset.
+ *
+ * -force ignores the manifest and cooks everything.
+ */
+namespace
+{
+    // Bump this whenever a change to the cooker changes what it outputs, so that old keys stop matching.
+    const unsigned int COOKER_VERSION = 2;
+    const char MANIFEST_MAGIC[] = "HailstormCook";
+    const char MANIFEST_EXTENSION[] = ".cook";
+
+    const unsigned int DDS_MAGIC = 0x20534444;      // "DDS "
+    const unsigned int DDS_HEADER_SIZE = 124;
+    const unsigned int DDS_PIXEL_FORMAT_FLAGS_OFFSET = 80;
+    const unsigned int DDS_FOURCC_OFFSET = 84;
+    const unsigned int DDS_FOURCC_FLAG = 0x4;
+    const unsigned int DDS_FOURCC_DX10 = 0x30315844; // "DX10"
+    const unsigned int DDS_DX10_HEADER_SIZE = 20;
+
+    /**
+     * A source file and its place in the dependency graph.
+     */
+    struct Asset
+    {
+        Asset()
+            : path(),
+              name(),
+              entryName(),
+              size(0),
+              modifiedTime(0),
+              contentHash(0),
+              key(0),
+              includes(),
+              dependencies(),
+              source(),
+              isLoaded(false),
+              isStale(false),
+              isDirty(false),
+              visitState(0),
+              cooked(),
+              error()
+        {
+        }
+
+        std::wstring path;                          // Path relative to the source directory.
+        std::string name;                           // Normalized source path.
+        std::string entryName;                      // Archive path of the cooked file.
+        unsigned long long size;
+        unsigned long long modifiedTime;
+        unsigned long long contentHash;
+        unsigned long long key;
+        std::vector<std::string> includes;          // Archive paths of included files, in order.
+        std::vector<unsigned int> dependencies;     // Index of each entry of includes.
+        std::vector<unsigned char> source;
+        bool isLoaded;
+        bool isStale;                               // Size or time differ from the manifest.
+        bool isDirty;                               // Needs to be cooked.
+        int visitState;                             // Used when walking the graph.
+        std::vector<unsigned char> cooked;
+        std::string error;
+    };
+
+    /**
+     * What the manifest remembers about a file from the last cook.
+     */
+    struct ManifestEntry
+    {
+        unsigned long long size;
+        unsigned long long modifiedTime;
+        unsigned long long contentHash;
+        unsigned long long key;
+        std::vector<std::string> includes;
+    };
+
+    /**
+     * An #include directive found in an effect.
+     */
+    struct IncludeDirective
+    {
+        size_t lineStart;                           // Offset of the directive's line in the file.
+        size_t lineEnd;                             // Offset just past the line, including its newline.
+        unsigned int lineNumber;                    // One based.
+        std::string path;
+    };
+
+    struct CookOptions
+    {
+        CookOptions()
+            : compression(ArchiveCompression::None),
+              compressionLevel(Lz::DEFAULT_LEVEL),
+              alignment(AssetArchiveWriter::DEFAULT_ALIGNMENT),
+              threadCount(0),
+              force(false),
+              verbose(false)
+        {
+        }
+
+        ArchiveCompression compression;
+        int compressionLevel;
+        unsigned int alignment;
+        unsigned int threadCount;                   // Zero for one per hardware thread.
+        bool force;
+        bool verbose;
+    };
+
+    std::wstring Widen(const char * pText)
+    {
+        return std::wstring(pText, pText + std::strlen(pText));
+    }
+
+    std::string Narrow(const std::wstring& text)
+    {
+        return std::string(text.begin(), text.end());
+    }
+
+    bool EndsWith(const std::string& text, const char * pSuffix)
+    {
+        size_t length = std::strlen(pSuffix);
+        return text.size() >= length && text.compare(text.size() - length, length, pSuffix) == 0;
+    }
+
+    std::string ToHex(unsigned long long value)
+    {
+        char text[17];
+        std::sprintf(text, "%016llx", value);
+        return text;
+    }
+
+    /**
+     * Finds every file under a directory along with its size and modification time. Archives and
+     * manifests are skipped so that output written inside the source directory is not cooked into the
+     * next archive.
+     */
+    void FindAssets(const std::wstring& directory, const std::wstring& relativeDirectory, std::vector<Asset> * pAssetsOut)
+    {
+#if defined(_WIN32)
+        WIN32_FIND_DATAW findData;
+        HANDLE findHandle = FindFirstFileW((directory + L"\\" + relativeDirectory + L"*").c_str(), &findData);
+
+        if (findHandle == INVALID_HANDLE_VALUE)
+        {
+            return;
+        }
+
+        do
+        {
+            std::wstring name = findData.cFileName;
+            bool isDirectory = (findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+            unsigned long long size = (static_cast<unsigned long long>(findData.nFileSizeHigh) << 32) | findData.nFileSizeLow;
+            unsigned long long modifiedTime =
+                (static_cast<unsigned long long>(findData.ftLastWriteTime.dwHighDateTime) << 32) | findData.ftLastWriteTime.dwLowDateTime;
+#else
+        DIR * pDirectory = opendir(Narrow(directory + L"/" + relativeDirectory).c_str());
+
+        if (pDirectory == nullptr)
+        {
+            return;
+        }
+
+        while (dirent * pEntry = readdir(pDirectory))
+        {
+            std::wstring name = Widen(pEntry->d_name);
+            struct stat info;
+
+            if (stat(Narrow(directory + L"/" + relativeDirectory + name).c_str(), &info) != 0)
+            {
+                continue;
+            }
+
+            bool isDirectory = S_ISDIR(info.st_mode);
+            unsigned long long size = static_cast<unsigned long long>(info.st_size);
+            unsigned long long modifiedTime =
+                static_cast<unsigned long long>(info.st_mtim.tv_sec) * 1000000000ull + info.st_mtim.tv_nsec;
+#endif
+            if (name == L"." || name == L"..")
+            {
+                continue;
+            }
+
+            std::string normalized = AssetArchive::NormalizePath(name);
+
+            if (isDirectory)
+            {
+                FindAssets(directory, relativeDirectory + name + L"/", pAssetsOut);
+            }
+            else if (!EndsWith(normalized, ".pak") && !EndsWith(normalized, MANIFEST_EXTENSION))
+            {
+                Asset asset;
+                asset.path = relativeDirectory + name;
+                asset.name = AssetArchive::NormalizePath(asset.path);
+                asset.size = size;
+                asset.modifiedTime = modifiedTime;
+
+                pAssetsOut->push_back(asset);
+            }
+#if defined(_WIN32)
+        }
+        while (FindNextFileW(findHandle, &findData));
+
+        FindClose(findHandle);
+#else
+        }
+
+        closedir(pDirectory);
+#endif
+    }
+
+    /**
+     * Finds the #include directives in an effect. Directives inside block comments are skipped, so are
+     * ones commented out with // since the line then doesn't start with #.
+     */
+    void FindIncludes(const unsigned char * pText, size_t size, std::vector<IncludeDirective> * pIncludesOut)
+    {
+        const char * pChars = reinterpret_cast<const char *>(pText);
+        bool inComment = false;
+        unsigned int lineNumber = 0;
+        size_t lineStart = 0;
+
+        pIncludesOut->clear();
+
+        while (lineStart < size)
+        {
+            const char * pNewLine = static_cast<const char *>(std::memchr(pChars + lineStart, '\n', size - lineStart));
+            size_t lineEnd = (pNewLine != nullptr) ? static_cast<size_t>(pNewLine - pChars) + 1 : size;
+            size_t i = lineStart;
+
+            ++lineNumber;
+
+            if (!inComment)
+            {
+                while (i < lineEnd && (pChars[i] == ' ' || pChars[i] == '\t'))
+                {
+                    ++i;
+                }
+
+                if (i < lineEnd && pChars[i] == '#')
+                {
+                    size_t j = i + 1;
+
+                    while (j < lineEnd && (pChars[j] == ' ' || pChars[j] == '\t'))
+                    {
+                        ++j;
+                    }
+
+                    if (lineEnd - j > 7 && std::strncmp(pChars + j, "include", 7) == 0)
+                    {
+                        j += 7;
+
+                        while (j < lineEnd && (pChars[j] == ' ' || pChars[j] == '\t'))
+                        {
+                            ++j;
+                        }
+
+                        char close = (j < lineEnd && pChars[j] == '<') ? '>' : '"';
+
+                        if (j < lineEnd && (pChars[j] == '"' || pChars[j] == '<'))
+                        {
+                            const char * pClose = static_cast<const char *>(std::memchr(pChars + j + 1, close, lineEnd - j - 1));
+
+                            if (pClose != nullptr)
+                            {
+                                IncludeDirective directive;
+                                directive.lineStart = lineStart;
+                                directive.lineEnd = lineEnd;
+                                directive.lineNumber = lineNumber;
+                                directive.path.assign(pChars + j + 1, pClose);
+
+                                pIncludesOut->push_back(directive);
+                            }
+                        }
+                    }
+                }
+            }
+
+            // Track block comments through the rest of the line.
+            for (; i < lineEnd; ++i)
+            {
+                if (inComment)
+                {
+                    if (pChars[i] == '*' && i + 1 < lineEnd && pChars[i + 1] == '/')
+                    {
+                        inComment = false;
+                        ++i;
+                    }
+                }
+                else if (pChars[i] == '/' && i + 1 < lineEnd)
+                {
+                    if (pChars[i + 1] == '/')
+                    {
+                        break;
+                    }
+
+                    if (pChars[i + 1] == '*')
+                    {
+                        inComment = true;
+                        ++i;
+                    }
+                }
+            }
+
+            lineStart = lineEnd;
+        }
+    }
+
+    bool IsEffect(const Asset& asset)
+    {
+        return EndsWith(asset.name, ".fx");
+    }
+
+    bool IsTexture(const Asset& asset)
+    {
+        return EndsWith(asset.name, ".dds");
+    }
+
+    bool IsMesh(const Asset& asset)
+    {
+        return EndsWith(asset.name, ".obj") || EndsWith(asset.name, ".ply");
+    }
+
+    // Archive path that a source file is cooked into.
+    std::string EntryName(const Asset& asset)
+    {
+        return IsMesh(asset) ? asset.name.substr(0, asset.name.find_last_of('.')) + ".mesh" : asset.name;
+    }
+
+    // Hash a loaded asset and, for effects, find what it includes.
+    void Scan(Asset * pAsset)
+    {
+        const unsigned char * pSource = pAsset->source.empty() ? nullptr : &pAsset->source[0];
+
+        pAsset->contentHash = Hash::Fnv1a64(pSource, pAsset->source.size());
+        pAsset->includes.clear();
+
+        if (!IsEffect(*pAsset))
+        {
+            return;
+        }
+
+        std::vector<IncludeDirective> directives;
+        FindIncludes(pSource, pAsset->source.size(), &directives);
+
+        size_t lastSlash = pAsset->name.find_last_of('/');
+        std::string directory = (lastSlash == std::string::npos) ? std::string() : pAsset->name.substr(0, lastSlash + 1);
+
+        for (size_t i = 0; i < directives.size(); ++i)
+        {
+            // NormalizePath keeps a ".." it has nothing to cancel out against at the front.
+            std::string includePath = AssetArchive::NormalizePath(directory + directives[i].path);
+
+            if (includePath == ".." || includePath.compare(0, 3, "../") == 0)
+            {
+                pAsset->error = "include of " + directives[i].path + " leaves the source directory";
+                return;
+            }
+
+            pAsset->includes.push_back(includePath);
+        }
+    }
+
+    /**
+     * Reads the sources of the given assets in one batch. Returns false if any could not be read, or
+     * changed size since the directory was scanned.
+     */
+    bool LoadSources(
+        const std::wstring& sourceDirectory,
+        const std::vector<unsigned int>& indices,
+        unsigned int threadCount,
+        std::vector<Asset> * pAssets)
+    {
+        std::vector<FileReadRequest> requests;
+        bool succeeded = true;
+
+        for (size_t i = 0; i < indices.size(); ++i)
+        {
+            Asset& asset = (*pAssets)[indices[i]];
+
+            if (asset.isLoaded)
+            {
+                continue;
+            }
+
+            asset.source.resize(static_cast<size_t>(asset.size));
+            asset.isLoaded = true;
+
+            if (asset.size > 0)
+            {
+                FileReadRequest request;
+                request.path = sourceDirectory + L"/" + asset.path;
+                request.offset = 0;
+                request.pBuffer = &asset.source[0];
+                request.size = asset.source.size();
+                request.pUserData = &asset;
+
+                requests.push_back(request);
+            }
+        }
+
+        if (requests.empty())
+        {
+            return true;
+        }
+
+        AsyncFileReaderParams params;
+
+        if (threadCount > 0)
+        {
+            params.threadCount = threadCount;
+        }
+
+        AsyncFileReader reader(params);
+
+        reader.Submit(requests, [&succeeded](const FileReadRequest& request, const FileReadResult& result)
+        {
+            if (!result.succeeded || result.bytesRead != request.size)
+            {
+                Asset * pAsset = static_cast<Asset *>(request.pUserData);
+                pAsset->error = "could not be read";
+                succeeded = false;
+            }
+        });
+
+        reader.WaitIdle();
+        return succeeded;
+    }
+
+    /**
+     * Computes the key of an asset after the keys of everything it includes. Returns false if the
+     * includes form a cycle.
+     */
+    bool ComputeKey(unsigned int index, std::vector<Asset> * pAssets)
+    {
+        Asset& asset = (*pAssets)[index];
+
+        if (asset.visitState == 2)
+        {
+            return true;
+        }
+
+        if (asset.visitState == 1)
+        {
+            asset.error = "includes itself";
+            return false;
+        }
+
+        asset.visitState = 1;
+
+        unsigned long long key = Hash::Fnv1a64Value(COOKER_VERSION);
+        key = Hash::Fnv1a64Value(asset.contentHash, key);
+
+        for (size_t i = 0; i < asset.dependencies.size(); ++i)
+        {
+            const Asset& dependency = (*pAssets)[asset.dependencies[i]];
+
+            if (!ComputeKey(asset.dependencies[i], pAssets))
+            {
+                asset.error = "includes itself through " + dependency.name;
+                return false;
+            }
+
+            key = Hash::Fnv1a64(dependency.name, key);
+            key = Hash::Fnv1a64Value(dependency.key, key);
+        }
+
+        asset.key = key;
+        asset.visitState = 2;
+        return true;
+    }
+
+    // Add an asset and everything it includes to a list of indices, once each.
+    void CollectDependencies(unsigned int index, std::vector<Asset> * pAssets, std::vector<bool> * pVisited, std::vector<unsigned int> * pIndicesOut)
+    {
+        if ((*pVisited)[index])
+        {
+            return;
+        }
+
+        (*pVisited)[index] = true;
+        pIndicesOut->push_back(index);
+
+        for (size_t i = 0; i < (*pAssets)[index].dependencies.size(); ++i)
+        {
+            CollectDependencies((*pAssets)[index].dependencies[i], pAssets, pVisited, pIndicesOut);
+        }
+    }
+
+    /**
+     * Appends an effect to the output with its includes replaced by the included files. Each include
+     * is bracketed by #line directives naming the file that the following lines came from.
+     */
+    void AppendEffect(const std::vector<Asset>& assets, unsigned int index, std::string * pOut)
+    {
+        const Asset& asset = assets[index];
+        const char * pText = asset.source.empty() ? nullptr : reinterpret_cast<const char *>(&asset.source[0]);
+        std::vector<IncludeDirective> directives;
+        size_t position = 0;
+
+        FindIncludes(asset.source.empty() ? nullptr : &asset.source[0], asset.source.size(), &directives);
+
+        for (size_t i = 0; i < directives.size(); ++i)
+        {
+            const IncludeDirective& directive = directives[i];
+            const Asset& included = assets[asset.dependencies[i]];
+
+            pOut->append(pText + position, pText + directive.lineStart);
+            *pOut += "#line 1 \"" + included.name + "\"\n";
+
+            AppendEffect(assets, asset.dependencies[i], pOut);
+
+            if (!pOut->empty() && (*pOut)[pOut->size() - 1] != '\n')
+            {
+                *pOut += "\n";
+            }
+
+            *pOut += "#line " + std::to_string(static_cast<unsigned long long>(directive.lineNumber + 1)) + " \"" + asset.name + "\"\n";
+            position = directive.lineEnd;
+        }
+
+        pOut->append(pText + position, pText + asset.source.size());
+    }
+
+    bool ValidateTexture(const Asset& asset, std::string * pErrorOut)
+    {
+        unsigned int magic = 0;
+        unsigned int headerSize = 0;
+        unsigned int formatFlags = 0;
+        unsigned int fourCC = 0;
+
+        if (asset.source.size() < sizeof(magic) + DDS_HEADER_SIZE)
+        {
+            *pErrorOut = "is too small to be a DDS texture";
+            return false;
+        }
+
+        std::memcpy(&magic, &asset.source[0], sizeof(magic));
+        std::memcpy(&headerSize, &asset.source[4], sizeof(headerSize));
+        std::memcpy(&formatFlags, &asset.source[4 + DDS_PIXEL_FORMAT_FLAGS_OFFSET], sizeof(formatFlags));
+        std::memcpy(&fourCC, &asset.source[4 + DDS_FOURCC_OFFSET], sizeof(fourCC));
+
+        if (magic != DDS_MAGIC || headerSize != DDS_HEADER_SIZE)
+        {
+            *pErrorOut = "does not have a DDS header";
+            return false;
+        }
+
+        if ((formatFlags & DDS_FOURCC_FLAG) != 0 && fourCC == DDS_FOURCC_DX10 &&
+            asset.source.size() < sizeof(magic) + DDS_HEADER_SIZE + DDS_DX10_HEADER_SIZE)
+        {
+            *pErrorOut = "is missing its DX10 header";
+            return false;
+        }
+
+        return true;
+    }
+
+    /**
+     * Imports a mesh the same way MeshConverter does and builds its mesh file. Assets are already cooked
+     * in parallel, so the import runs on the calling thread only.
+     */
+    bool CookMesh(const std::wstring& sourceDirectory, Asset * pAsset)
+    {
+        std::vector<StaticMeshVertex> vertices;
+        std::vector<unsigned int> indices;
+        MeshImportParams params;
+
+        params.threadCount = 1;
+
+        if (!MeshImporter::Load(sourceDirectory + L"/" + pAsset->path, &vertices, &indices, params) || indices.empty())
+        {
+            pAsset->error = "could not be imported as a mesh";
+            return false;
+        }
+
+        unsigned int vertexCount = static_cast<unsigned int>(vertices.size());
+        unsigned int indexCount = static_cast<unsigned int>(indices.size());
+
+        MeshOptimizer::OptimizeVertexCache(&indices[0], indexCount, vertexCount);
+        MeshOptimizer::OptimizeVertexFetch(&vertices[0], vertexCount, sizeof(StaticMeshVertex), &indices[0], indexCount);
+        MeshFile::Serialize(&vertices[0], vertexCount, &indices[0], indexCount, nullptr, 0, &pAsset->cooked);
+
+        return true;
+    }
+
+    // Turn an asset's source into what is stored in the archive.
+    void CookAsset(const std::wstring& sourceDirectory, std::vector<Asset> * pAssets, unsigned int index)
+    {
+        Asset& asset = (*pAssets)[index];
+
+        if (IsMesh(asset))
+        {
+            CookMesh(sourceDirectory, &asset);
+        }
+        else if (IsEffect(asset) && !asset.dependencies.empty())
+        {
+            std::string text;
+            AppendEffect(*pAssets, index, &text);
+
+            asset.cooked.assign(text.begin(), text.end());
+        }
+        else if (IsTexture(asset) && !ValidateTexture(asset, &asset.error))
+        {
+            return;
+        }
+        else
+        {
+            asset.cooked = asset.source;
+        }
+    }
+
+    /**
+     * Manifest layout: a "HailstormCook <version> <settings>" line, then one line per file of tab
+     * separated size, modification time, content hash, key, path and included paths.
+     */
+    bool LoadManifest(const std::wstring& path, unsigned long long * pSettingsOut, std::map<std::string, ManifestEntry> * pEntriesOut)
+    {
+#if defined(_WIN32)
+        std::ifstream file(path.c_str());
+#else
+        std::ifstream file(Narrow(path).c_str());
+#endif
+        std::string line;
+
+        if (!file || !std::getline(file, line))
+        {
+            return false;
+        }
+
+        std::istringstream header(line);
+        std::string magic;
+        unsigned int version = 0;
+        std::string settingsText;
+
+        if (!(header >> magic >> version >> settingsText) || magic != MANIFEST_MAGIC || version != COOKER_VERSION)
+        {
+            return false;
+        }
+
+        *pSettingsOut = std::strtoull(settingsText.c_str(), nullptr, 16);
+
+        while (std::getline(file, line))
+        {
+            std::vector<std::string> fields;
+            size_t start = 0;
+
+            while (start <= line.size())
+            {
+                size_t end = line.find('\t', start);
+                end = (end == std::string::npos) ? line.size() : end;
+
+                fields.push_back(line.substr(start, end - start));
+                start = end + 1;
+            }
+
+            if (fields.size() < 5)
+            {
+                return false;
+            }
+
+            ManifestEntry entry;
+            entry.size = std::strtoull(fields[0].c_str(), nullptr, 10);
+            entry.modifiedTime = std::strtoull(fields[1].c_str(), nullptr, 10);
+            entry.contentHash = std::strtoull(fields[2].c_str(), nullptr, 16);
+            entry.key = std::strtoull(fields[3].c_str(), nullptr, 16);
+            entry.includes.assign(fields.begin() + 5, fields.end());
+
+            (*pEntriesOut)[fields[4]] = entry;
+        }
+
+        return true;
+    }
+
+    bool SaveManifest(const std::wstring& path, unsigned long long settings, const std::vector<Asset>& assets)
+    {
+#if defined(_WIN32)
+        std::ofstream file(path.c_str(), std::ios::trunc);
+#else
+        std::ofstream file(Narrow(path).c_str(), std::ios::trunc);
+#endif
+
+        file << MANIFEST_MAGIC << " " << COOKER_VERSION << " " << ToHex(settings) << "\n";
+
+        for (size_t i = 0; i < assets.size(); ++i)
+        {
+            const Asset& asset = assets[i];
+
+            file << asset.size << "\t" << asset.modifiedTime << "\t" << ToHex(asset.contentHash) << "\t"
+                << ToHex(asset.key) << "\t" << asset.name;
+
+            for (size_t j = 0; j < asset.includes.size(); ++j)
+            {
+                file << "\t" << asset.includes[j];
+            }
+
+            file << "\n";
+        }
+
+        file.close();
+        return !file.fail();
+    }
+
+    // Print every asset that failed, returning the number of failures.
+    size_t ReportErrors(const std::vector<Asset>& assets)
+    {
+        size_t errorCount = 0;
+
+        for (size_t i = 0; i < assets.size(); ++i)
+        {
+            if (!assets[i].error.empty())
+            {
+                std::cerr << assets[i].name << ": " << assets[i].error << std::endl;
+                ++errorCount;
+            }
+        }
+
+        return errorCount;
+    }
+
+    bool NameLess(const Asset& a, const Asset& b)
+    {
+        return a.name < b.name;
+    }
+
+    int Cook(const std::wstring& sourceDirectory, const std::wstring& outputPath, const CookOptions& options)
+    {
+        Stopwatch timer;
+        std::wstring manifestPath = outputPath + Widen(MANIFEST_EXTENSION);
+        std::vector<Asset> assets;
+
+        // Settings that change the archive but not the cooked bytes. Changing them rewrites the archive
+        // without cooking anything.
+        unsigned long long settings = Hash::Fnv1a64Value(static_cast<unsigned int>(options.compression));
+        settings = Hash::Fnv1a64Value(options.compressionLevel, settings);
+        settings = Hash::Fnv1a64Value(options.alignment, settings);
+
+        FindAssets(sourceDirectory, L"", &assets);
+
+        if (assets.empty())
+        {
+            std::cerr << "No files found under " << Narrow(sourceDirectory) << std::endl;
+            return 1;
+        }
+
+        std::sort(assets.begin(), assets.end(), NameLess);
+
+        std::map<std::string, unsigned int> indices;
+        std::map<std::string, unsigned int> entryIndices;
+
+        for (unsigned int i = 0; i < assets.size(); ++i)
+        {
+            assets[i].entryName = EntryName(assets[i]);
+
+            if (!indices.insert(std::make_pair(assets[i].name, i)).second ||
+                !entryIndices.insert(std::make_pair(assets[i].entryName, i)).second)
+            {
+                std::cerr << "Two files map to the same archive path as " << Narrow(assets[i].path) << std::endl;
+                return 1;
+            }
+        }
+
+        // Reuse what the manifest knows about files that look unchanged, and read the rest.
+        std::map<std::string, ManifestEntry> manifest;
+        unsigned long long previousSettings = 0;
+        bool hasManifest = !options.force && LoadManifest(manifestPath, &previousSettings, &manifest);
+        std::vector<unsigned int> staleIndices;
+
+        for (unsigned int i = 0; i < assets.size(); ++i)
+        {
+            Asset& asset = assets[i];
+            auto entry = manifest.find(asset.name);
+
+            if (entry != manifest.end() && entry->second.size == asset.size && entry->second.modifiedTime == asset.modifiedTime)
+            {
+                asset.contentHash = entry->second.contentHash;
+                asset.includes = entry->second.includes;
+            }
+            else
+            {
+                asset.isStale = true;
+                staleIndices.push_back(i);
+            }
+        }
+
+        LoadSources(sourceDirectory, staleIndices, options.threadCount, &assets);
+
+        Parallel::For(static_cast<unsigned int>(staleIndices.size()), options.threadCount, [&](unsigned int index, unsigned int)
+        {
+            Asset& asset = assets[staleIndices[index]];
+
+            if (asset.error.empty())
+            {
+                Scan(&asset);
+            }
+        });
+
+        // Link includes to the assets they name and key every asset.
+        for (size_t i = 0; i < assets.size(); ++i)
+        {
+            Asset& asset = assets[i];
+
+            for (size_t j = 0; j < asset.includes.size() && asset.error.empty(); ++j)
+            {
+                auto included = indices.find(asset.includes[j]);
+
+                if (included == indices.end())
+                {
+                    asset.error = "includes " + asset.includes[j] + ", which does not exist";
+                }
+                else
+                {
+                    asset.dependencies.push_back(included->second);
+                }
+            }
+        }
+
+        if (ReportErrors(assets) > 0)
+        {
+            return 1;
+        }
+
+        for (unsigned int i = 0; i < assets.size(); ++i)
+        {
+            if (!ComputeKey(i, &assets))
+            {
+                ReportErrors(assets);
+                return 1;
+            }
+        }
+
+        // Anything whose key changed, or that the old archive is missing, has to be cooked.
+        AssetArchive previous;
+
+        if (hasManifest)
+        {
+            previous.Open(outputPath);
+        }
+
+        std::vector<unsigned int> dirtyIndices;
+        bool isStale = false;
+
+        for (unsigned int i = 0; i < assets.size(); ++i)
+        {
+            Asset& asset = assets[i];
+            auto entry = manifest.find(asset.name);
+
+            if (entry == manifest.end() || entry->second.key != asset.key || !previous.IsOpen() || previous.Find(asset.entryName) == nullptr)
+            {
+                asset.isDirty = true;
+                dirtyIndices.push_back(i);
+            }
+
+            isStale = isStale || asset.isStale;
+        }
+
+        size_t removedCount = 0;
+
+        for (auto itr = manifest.begin(); itr != manifest.end(); ++itr)
+        {
+            removedCount += (indices.count(itr->first) == 0) ? 1 : 0;
+        }
+
+        if (dirtyIndices.empty() && removedCount == 0 && previousSettings == settings && previous.IsOpen())
+        {
+            if (isStale && !SaveManifest(manifestPath, settings, assets))
+            {
+                std::cerr << "Could not write " << Narrow(manifestPath) << std::endl;
+                return 1;
+            }
+
+            std::cout << "All " << assets.size() << " assets are up to date (" << staleIndices.size()
+                << " rehashed) in " << timer.ElapsedSeconds() * 1000.0 << " ms" << std::endl;
+            return 0;
+        }
+
+        // Cooking an effect needs the source of everything it includes.
+        std::vector<bool> visited(assets.size(), false);
+        std::vector<unsigned int> neededIndices;
+
+        for (size_t i = 0; i < dirtyIndices.size(); ++i)
+        {
+            CollectDependencies(dirtyIndices[i], &assets, &visited, &neededIndices);
+        }
+
+        if (!LoadSources(sourceDirectory, neededIndices, options.threadCount, &assets))
+        {
+            ReportErrors(assets);
+            return 1;
+        }
+
+        Parallel::For(static_cast<unsigned int>(dirtyIndices.size()), options.threadCount, [&](unsigned int index, unsigned int)
+        {
+            CookAsset(sourceDirectory, &assets, dirtyIndices[index]);
+        });
+
+        if (ReportErrors(assets) > 0)
+        {
+            return 1;
+        }
+
+        AssetArchiveWriter writer;
+        std::vector<unsigned char> data;
+
+        writer.SetCompressionLevel(options.compressionLevel);
+
+        for (size_t i = 0; i < assets.size(); ++i)
+        {
+            const Asset& asset = assets[i];
+            const std::vector<unsigned char> * pData = &asset.cooked;
+
+            if (!asset.isDirty)
+            {
+                const ArchiveEntry * pPrevious = previous.Find(asset.entryName);
+                data.resize(static_cast<size_t>(pPrevious->size));
+
+                if (!previous.Decompress(*pPrevious, data.empty() ? nullptr : &data[0]))
+                {
+                    std::cerr << asset.name << ": could not be read from " << Narrow(outputPath)
+                        << ", run again with -force" << std::endl;
+                    return 1;
+                }
+
+                pData = &data;
+            }
+
+            if (options.verbose && asset.isDirty)
+            {
+                std::cout << "Cooked " << asset.entryName << " (" << pData->size() << " bytes)" << std::endl;
+            }
+
+            writer.Add(asset.entryName, pData->empty() ? nullptr : &(*pData)[0], pData->size(), options.compression);
+        }
+
+        // The old archive has to be closed before it can be replaced.
+        previous.Close();
+
+        if (!writer.Write(outputPath, options.alignment))
+        {
+            std::cerr << "Could not write " << Narrow(outputPath) << std::endl;
+            return 1;
+        }
+
+        if (!SaveManifest(manifestPath, settings, assets))
+        {
+            std::cerr << "Could not write " << Narrow(manifestPath) << std::endl;
+            return 1;
+        }
+
+        std::cout << "Cooked " << dirtyIndices.size() << " of " << assets.size() << " assets ("
+            << assets.size() - dirtyIndices.size() << " up to date) into " << Narrow(outputPath) << " in "
+            << timer.ElapsedSeconds() * 1000.0 << " ms" << std::endl;
+
+        return 0;
+    }
+
+    void PrintUsage()
+    {
+        std::cerr << "Usage: AssetCooker <source directory> <output.pak> [-compress [level]] [-align N] [-threads N] [-force] [-verbose]" << std::endl;
+    }
+}
+
+int main(int argc, char * argv[])
+{
+    if (argc < 3 || argv[1][0] == '-' || argv[2][0] == '-')
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    CookOptions options;
+
+    for (int i = 3; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "-compress") == 0)
+        {
+            options.compression = ArchiveCompression::Lz;
+
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+            {
+                options.compressionLevel = std::atoi(argv[++i]);
+
+                if (options.compressionLevel < Lz::MIN_LEVEL || options.compressionLevel > Lz::MAX_LEVEL)
+                {
+                    std::cerr << "Compression level must be from " << Lz::MIN_LEVEL << " to " << Lz::MAX_LEVEL << std::endl;
+                    return 1;
+                }
+            }
+        }
+        else if (std::strcmp(argv[i], "-align") == 0 && i + 1 < argc)
+        {
+            int requested = std::atoi(argv[++i]);
+
+            if (requested <= 0 || (requested & (requested - 1)) != 0)
+            {
+                PrintUsage();
+                return 1;
+            }
+
+            options.alignment = static_cast<unsigned int>(requested);
+        }
+        else if (std::strcmp(argv[i], "-threads") == 0 && i + 1 < argc)
+        {
+            options.threadCount = static_cast<unsigned int>(std::max(std::atoi(argv[++i]), 0));
+        }
+        else if (std::strcmp(argv[i], "-force") == 0)
+        {
+            options.force = true;
+        }
+        else if (std::strcmp(argv[i], "-verbose") == 0)
+        {
+            options.verbose = true;
+        }
+        else
+        {
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    return Cook(Widen(argv[1]), Widen(argv[2]), options);
+}
@@ -0,0 +1,754 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "stdafx.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#if !defined(_WIN32)
+#   include <dirent.h>
+#   include <sys/stat.h>
+#endif
+
+#include "runtime/AssetArchive.h"
+#include "runtime/AsyncFileReader.h"
+#include "runtime/Lz.h"
+#include "runtime/MappedFile.h"
+#include "runtime/Noise.h"
+#include "runtime/Parallel.h"
+#include "runtime/Stopwatch.h"
+
+/**
+ * Packs a directory of loose asset files into a single archive (see AssetArchive), which the game
+ * maps once at startup instead of opening every asset on its own.
+ *
+ *   AssetPacker <input directory> <output.pak> [-align N] [-compress [level]]
+ *       Pack every file under the directory, keyed by its path relative to the directory. Entries are
+ *       aligned to N bytes (16 by default). With -compress, files are compressed (see Lz) at the given
+ *       level, or Lz::DEFAULT_LEVEL, unless that would hardly make them smaller.
+ *
+ *   AssetPacker -list <archive.pak>
+ *       Print the archive's table of contents.
+ *
+ *   AssetPacker -benchmark <input directory> <archive.pak> [iterations]
+ *       Compare reading every file loose against finding and reading it in the archive.
+ *
+ *   AssetPacker -readbenchmark <scratch directory> [file count]
+ *       Write a few thousand small files into the directory, then compare reading them one at a time
+ *       against reading them in one batch with AsyncFileReader. The files are deleted afterwards.
+ *
+ *   AssetPacker -lzbenchmark [input directory]
+ *       Compress and decompress the files under the directory, along with generated mesh and height
+ *       map data, at several levels and report the ratio and speed of each.
+ */
+namespace
+{
+    const unsigned int DEFAULT_BENCHMARK_ITERATIONS = 10;
+    const unsigned int DEFAULT_READ_BENCHMARK_FILES = 4000;
+    const size_t READ_BENCHMARK_MAX_FILE_SIZE = 16 * 1024;
+
+    std::wstring Widen(const char * pText)
+    {
+        return std::wstring(pText, pText + std::strlen(pText));
+    }
+
+    std::string Narrow(const std::wstring& text)
+    {
+        return std::string(text.begin(), text.end());
+    }
+
+    /**
+     * Finds every file under a directory, returning paths relative to it. Archives are skipped so an
+     * archive written inside the directory it was packed from doesn't end up packed into the next one.
+     */
+    void FindFiles(const std::wstring& directory, const std::wstring& relativeDirectory, std::vector<std::wstring> * pPathsOut)
+    {
+#if defined(_WIN32)
+        WIN32_FIND_DATAW findData;
+        HANDLE findHandle = FindFirstFileW((directory + L"\\" + relativeDirectory + L"*").c_str(), &findData);
+
+        if (findHandle == INVALID_HANDLE_VALUE)
+        {
+            return;
+        }
+
+        do
+        {
+            std::wstring name = findData.cFileName;
+            bool isDirectory = (findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+#else
+        DIR * pDirectory = opendir(Narrow(directory + L"/" + relativeDirectory).c_str());
+
+        if (pDirectory == nullptr)
+        {
+            return;
+        }
+
+        while (dirent * pEntry = readdir(pDirectory))
+        {
+            std::wstring name = Widen(pEntry->d_name);
+            struct stat info;
+            bool isDirectory = stat(Narrow(directory + L"/" + relativeDirectory + name).c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+#endif
+            if (name == L"." || name == L"..")
+            {
+                continue;
+            }
+
+            if (isDirectory)
+            {
+                FindFiles(directory, relativeDirectory + name + L"/", pPathsOut);
+            }
+            else if (name.size() < 4 || AssetArchive::NormalizePath(name.substr(name.size() - 4)) != ".pak")
+            {
+                pPathsOut->push_back(relativeDirectory + name);
+            }
+#if defined(_WIN32)
+        }
+        while (FindNextFileW(findHandle, &findData));
+
+        FindClose(findHandle);
+#else
+        }
+
+        closedir(pDirectory);
+#endif
+    }
+
+    bool ReadFile(const std::wstring& path, std::vector<char> * pDataOut)
+    {
+#if defined(_WIN32)
+        std::ifstream file(path.c_str(), std::ios::binary);
+#else
+        std::ifstream file(Narrow(path).c_str(), std::ios::binary);
+#endif
+
+        if (!file)
+        {
+            return false;
+        }
+
+        pDataOut->assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        return !file.bad();
+    }
+
+    int Pack(
+        const std::wstring& inputDirectory,
+        const std::wstring& outputPath,
+        unsigned int alignment,
+        ArchiveCompression compression,
+        int compressionLevel)
+    {
+        Stopwatch timer;
+        std::vector<std::wstring> paths;
+        FindFiles(inputDirectory, L"", &paths);
+
+        if (paths.empty())
+        {
+            std::cerr << "No files found under " << Narrow(inputDirectory) << std::endl;
+            return 1;
+        }
+
+        AssetArchiveWriter writer;
+        std::vector<char> data;
+        size_t totalBytes = 0;
+
+        writer.SetCompressionLevel(compressionLevel);
+
+        for (size_t i = 0; i < paths.size(); ++i)
+        {
+            if (!ReadFile(inputDirectory + L"/" + paths[i], &data))
+            {
+                std::cerr << "Could not read " << Narrow(paths[i]) << std::endl;
+                return 1;
+            }
+
+            if (!writer.Add(Narrow(paths[i]), data.empty() ? nullptr : &data[0], data.size(), compression))
+            {
+                std::cerr << "Two files map to the same archive path as " << Narrow(paths[i]) << std::endl;
+                return 1;
+            }
+
+            totalBytes += data.size();
+        }
+
+        if (!writer.Write(outputPath, alignment))
+        {
+            std::cerr << "Could not write " << Narrow(outputPath) << std::endl;
+            return 1;
+        }
+
+        std::cout << "Packed " << writer.Count() << " files (" << totalBytes << " bytes) into "
+            << Narrow(outputPath) << " in " << timer.ElapsedSeconds() * 1000.0 << " ms" << std::endl;
+
+        AssetArchive archive;
+
+        if (compression != ArchiveCompression::None && archive.Open(outputPath))
+        {
+            unsigned long long storedBytes = 0;
+            unsigned int compressedCount = 0;
+
+            for (unsigned int i = 0; i < archive.EntryCount(); ++i)
+            {
+                storedBytes += archive.Entry(i).storedSize;
+                compressedCount += (archive.Entry(i).compression != ArchiveCompression::None) ? 1 : 0;
+            }
+
+            std::cout << "Compressed " << compressedCount << " files at level " << compressionLevel << ", "
+                << totalBytes << " bytes stored in " << storedBytes << std::endl;
+        }
+
+        return 0;
+    }
+
+    int List(const std::wstring& archivePath)
+    {
+        AssetArchive archive;
+        const char * pReason = nullptr;
+
+        if (!archive.Open(archivePath, &pReason))
+        {
+            std::cerr << "Could not open " << Narrow(archivePath) << ": " << pReason << std::endl;
+            return 1;
+        }
+
+        for (unsigned int i = 0; i < archive.EntryCount(); ++i)
+        {
+            const ArchiveEntry& entry = archive.Entry(i);
+            char hash[17];
+
+            std::sprintf(hash, "%016llx", entry.pathHash);
+            std::cout << hash << " " << entry.offset << " " << entry.size << " "
+                << (entry.compression == ArchiveCompression::Lz ? "lz " : "") << entry.storedSize << " "
+                << archive.Name(entry) << std::endl;
+        }
+
+        std::cout << archive.EntryCount() << " entries" << std::endl;
+        return 0;
+    }
+
+    // Read every byte of a span, so that the pages really are loaded from disk.
+    unsigned int Checksum(const ByteSpan& data)
+    {
+        unsigned int checksum = 0;
+
+        for (size_t i = 0; i < data.size; ++i)
+        {
+            checksum += data.pData[i];
+        }
+
+        return checksum;
+    }
+
+    /**
+     * Reads every file loose (one open per file, the way the game used to) and then through the
+     * archive (one open in total, with a lookup per file) and reports the time and file opens of each.
+     * Both read every byte, so only the cost of opening and finding files differs.
+     */
+    int Benchmark(const std::wstring& inputDirectory, const std::wstring& archivePath, unsigned int iterations)
+    {
+        std::vector<std::wstring> paths;
+        std::vector<unsigned long long> hashes;
+        FindFiles(inputDirectory, L"", &paths);
+
+        for (size_t i = 0; i < paths.size(); ++i)
+        {
+            hashes.push_back(AssetArchive::HashPath(paths[i]));
+        }
+
+        unsigned int looseChecksum = 0, archiveChecksum = 0;
+        unsigned int looseOpens = 0, archiveOpens = 0;
+        std::vector<unsigned char> decompressed;
+        Stopwatch timer;
+
+        for (unsigned int iteration = 0; iteration < iterations; ++iteration)
+        {
+            for (size_t i = 0; i < paths.size(); ++i)
+            {
+                MappedFile file;
+                ++looseOpens;
+
+                if (file.Open(inputDirectory + L"/" + paths[i]))
+                {
+                    looseChecksum += Checksum(ByteSpan(file.Data(), file.Size()));
+                }
+            }
+        }
+
+        double looseSeconds = timer.ElapsedSeconds() / iterations;
+        timer.Restart();
+
+        for (unsigned int iteration = 0; iteration < iterations; ++iteration)
+        {
+            AssetArchive archive;
+            ++archiveOpens;
+
+            if (!archive.Open(archivePath))
+            {
+                std::cerr << "Could not open " << Narrow(archivePath) << std::endl;
+                return 1;
+            }
+
+            for (size_t i = 0; i < hashes.size(); ++i)
+            {
+                const ArchiveEntry * pEntry = archive.Find(hashes[i]);
+
+                if (pEntry != nullptr && pEntry->compression == ArchiveCompression::None)
+                {
+                    archiveChecksum += Checksum(archive.Data(*pEntry));
+                }
+                else if (pEntry != nullptr)
+                {
+                    decompressed.resize(static_cast<size_t>(pEntry->size));
+
+                    if (!decompressed.empty() && archive.Decompress(*pEntry, &decompressed[0]))
+                    {
+                        archiveChecksum += Checksum(ByteSpan(&decompressed[0], decompressed.size()));
+                    }
+                }
+            }
+        }
+
+        double archiveSeconds = timer.ElapsedSeconds() / iterations;
+
+        std::cout << "Read " << paths.size() << " files, " << iterations << " iterations" << std::endl;
+        std::cout << "  loose:   " << looseSeconds * 1000.0 << " ms, " << looseOpens / iterations
+            << " file opens (checksum " << looseChecksum << ")" << std::endl;
+        std::cout << "  archive: " << archiveSeconds * 1000.0 << " ms, " << archiveOpens / iterations
+            << " file opens (checksum " << archiveChecksum << "), "
+            << looseSeconds / std::max(archiveSeconds, 1e-9) << "x faster" << std::endl;
+
+        if (looseChecksum != archiveChecksum)
+        {
+            std::cerr << "The archive does not match the loose files" << std::endl;
+            return 1;
+        }
+
+        return 0;
+    }
+
+    std::wstring ReadBenchmarkPath(const std::wstring& directory, unsigned int index)
+    {
+        char name[64];
+        std::sprintf(name, "read_benchmark_%05u.bin", index);
+
+        return directory + L"/" + Widen(name);
+    }
+
+    FILE * OpenFile(const std::wstring& path, const char * pMode)
+    {
+#if defined(_WIN32)
+        return _wfopen(path.c_str(), Widen(pMode).c_str());
+#else
+        return std::fopen(Narrow(path).c_str(), pMode);
+#endif
+    }
+
+    unsigned int Checksum(const std::vector<FileReadRequest>& requests)
+    {
+        unsigned int checksum = 0;
+
+        for (size_t i = 0; i < requests.size(); ++i)
+        {
+            checksum += Checksum(ByteSpan(static_cast<const unsigned char *>(requests[i].pBuffer), requests[i].size));
+        }
+
+        return checksum;
+    }
+
+    // Read a batch with an AsyncFileReader, returning the seconds it took or a negative number if
+    // any read failed.
+    double TimeBatchRead(const std::vector<FileReadRequest>& requests, bool useKernelQueue, std::string * pMethodOut)
+    {
+        AsyncFileReaderParams params;
+        params.useKernelQueue = useKernelQueue;
+
+        AsyncFileReader reader(params);
+        unsigned int failedCount = 0;
+        *pMethodOut = reader.MethodName();
+
+        Stopwatch timer;
+
+        reader.Submit(requests, [&failedCount](const FileReadRequest& request, const FileReadResult& result)
+        {
+            if (!result.succeeded || result.bytesRead != request.size)
+            {
+                ++failedCount;
+            }
+        });
+
+        reader.WaitIdle();
+        double seconds = timer.ElapsedSeconds();
+
+        return failedCount == 0 ? seconds : -1.0;
+    }
+
+    /**
+     * Writes many small files and reads them back three ways: one after another with a blocking open,
+     * read and close each (the baseline), as one batch on AsyncFileReader's thread pool, and as one
+     * batch on its kernel queue (io_uring or overlapped I/O). The files were just written, so this
+     * measures the cost of issuing reads rather than of the disk itself.
+     */
+    int ReadBenchmark(const std::wstring& directory, unsigned int fileCount)
+    {
+        std::vector<FileReadRequest> requests(fileCount);
+        AlignedBuffer buffer(fileCount * READ_BENCHMARK_MAX_FILE_SIZE, AsyncFileReader::BUFFER_ALIGNMENT);
+        std::vector<unsigned char> contents(READ_BENCHMARK_MAX_FILE_SIZE);
+        unsigned long long totalBytes = 0;
+
+        std::srand(1);
+
+        for (unsigned int i = 0; i < fileCount; ++i)
+        {
+            FileReadRequest& request = requests[i];
+            request.path = ReadBenchmarkPath(directory, i);
+            request.offset = 0;
+            request.pBuffer = buffer.Data() + i * READ_BENCHMARK_MAX_FILE_SIZE;
+            request.size = 512 + std::rand() % (READ_BENCHMARK_MAX_FILE_SIZE - 512);
+            request.pUserData = nullptr;
+
+            for (size_t j = 0; j < request.size; ++j)
+            {
+                contents[j] = static_cast<unsigned char>(std::rand());
+            }
+
+            FILE * pFile = OpenFile(request.path, "wb");
+
+            if (pFile == nullptr || std::fwrite(&contents[0], 1, request.size, pFile) != request.size)
+            {
+                std::cerr << "Could not write " << Narrow(request.path) << std::endl;
+                return 1;
+            }
+
+            std::fclose(pFile);
+            totalBytes += request.size;
+        }
+
+        std::memset(buffer.Data(), 0, buffer.Size());
+        Stopwatch timer;
+
+        for (unsigned int i = 0; i < fileCount; ++i)
+        {
+            FILE * pFile = OpenFile(requests[i].path, "rb");
+
+            if (pFile != nullptr)
+            {
+                std::fread(requests[i].pBuffer, 1, requests[i].size, pFile);
+                std::fclose(pFile);
+            }
+        }
+
+        double sequentialSeconds = timer.ElapsedSeconds();
+        unsigned int sequentialChecksum = Checksum(requests);
+
+        std::string threadMethod, kernelMethod;
+
+        std::memset(buffer.Data(), 0, buffer.Size());
+        double threadSeconds = TimeBatchRead(requests, false, &threadMethod);
+        unsigned int threadChecksum = Checksum(requests);
+
+        std::memset(buffer.Data(), 0, buffer.Size());
+        double kernelSeconds = TimeBatchRead(requests, true, &kernelMethod);
+        unsigned int kernelChecksum = Checksum(requests);
+
+        for (unsigned int i = 0; i < fileCount; ++i)
+        {
+#if defined(_WIN32)
+            _wremove(requests[i].path.c_str());
+#else
+            std::remove(Narrow(requests[i].path).c_str());
+#endif
+        }
+
+        std::cout << "Read " << fileCount << " files (" << totalBytes << " bytes)" << std::endl;
+        std::cout << "  sequential: " << sequentialSeconds * 1000.0 << " ms (checksum " << sequentialChecksum << ")" << std::endl;
+        std::cout << "  " << threadMethod << ": " << threadSeconds * 1000.0 << " ms (checksum " << threadChecksum << "), "
+            << sequentialSeconds / std::max(threadSeconds, 1e-9) << "x faster" << std::endl;
+        std::cout << "  " << kernelMethod << ": " << kernelSeconds * 1000.0 << " ms (checksum " << kernelChecksum << "), "
+            << sequentialSeconds / std::max(kernelSeconds, 1e-9) << "x faster" << std::endl;
+
+        if (threadSeconds < 0.0 || kernelSeconds < 0.0 ||
+            threadChecksum != sequentialChecksum || kernelChecksum != sequentialChecksum)
+        {
+            std::cerr << "Batched reads do not match the sequential reads" << std::endl;
+            return 1;
+        }
+
+        return 0;
+    }
+
+    /**
+     * A grid mesh over fractal noise, laid out like a mesh file's vertex and index buffers: position,
+     * normal and texture coordinate per vertex, then 32 bit triangle list indices.
+     */
+    std::vector<unsigned char> MakeMeshBlob(unsigned int gridSize)
+    {
+        struct Vertex
+        {
+            float position[3];
+            float normal[3];
+            float uv[2];
+        };
+
+        Noise::NoiseGenerator noise(7);
+        Noise::FractalParams params;
+        std::vector<float> heights(gridSize * gridSize);
+        noise.FillGrid(params, gridSize, gridSize, 0.0f, 0.0f, 1.0f / 64.0f, 1.0f / 64.0f, &heights[0]);
+
+        std::vector<Vertex> vertices(gridSize * gridSize);
+        std::vector<unsigned int> indices;
+
+        for (unsigned int row = 0; row < gridSize; ++row)
+        {
+            for (unsigned int col = 0; col < gridSize; ++col)
+            {
+                Vertex& vertex = vertices[row * gridSize + col];
+                float dx = heights[row * gridSize + std::min(col + 1, gridSize - 1)] - heights[row * gridSize + (col > 0 ? col - 1 : 0)];
+                float dz = heights[std::min(row + 1, gridSize - 1) * gridSize + col] - heights[(row > 0 ? row - 1 : 0) * gridSize + col];
+                float length = std::sqrt(dx * dx + 4.0f + dz * dz);
+
+                vertex.position[0] = static_cast<float>(col);
+                vertex.position[1] = heights[row * gridSize + col] * 32.0f;
+                vertex.position[2] = static_cast<float>(row);
+                vertex.normal[0] = -dx / length;
+                vertex.normal[1] = 2.0f / length;
+                vertex.normal[2] = -dz / length;
+                vertex.uv[0] = static_cast<float>(col) / (gridSize - 1);
+                vertex.uv[1] = static_cast<float>(row) / (gridSize - 1);
+
+                if (row + 1 < gridSize && col + 1 < gridSize)
+                {
+                    unsigned int corner = row * gridSize + col;
+                    unsigned int quad[6] = { corner, corner + 1, corner + gridSize, corner + 1, corner + gridSize + 1, corner + gridSize };
+                    indices.insert(indices.end(), quad, quad + 6);
+                }
+            }
+        }
+
+        const unsigned char * pVertices = reinterpret_cast<const unsigned char *>(&vertices[0]);
+        const unsigned char * pIndices = reinterpret_cast<const unsigned char *>(&indices[0]);
+        std::vector<unsigned char> blob(pVertices, pVertices + vertices.size() * sizeof(Vertex));
+
+        blob.insert(blob.end(), pIndices, pIndices + indices.size() * sizeof(unsigned int));
+        return blob;
+    }
+
+    // A height map of fractal noise quantized to 16 bits per sample, the usual format for terrain.
+    std::vector<unsigned char> MakeHeightMapBlob(unsigned int size)
+    {
+        Noise::NoiseGenerator noise(11);
+        Noise::FractalParams params;
+        std::vector<float> heights(size * size);
+        noise.FillGrid(params, size, size, 0.0f, 0.0f, 1.0f / 256.0f, 1.0f / 256.0f, &heights[0]);
+
+        std::vector<unsigned char> blob(heights.size() * sizeof(unsigned short));
+
+        for (size_t i = 0; i < heights.size(); ++i)
+        {
+            float height = std::min(std::max(heights[i] * 0.5f + 0.5f, 0.0f), 1.0f);
+            unsigned short sample = static_cast<unsigned short>(height * 65535.0f);
+
+            std::memcpy(&blob[i * sizeof(sample)], &sample, sizeof(sample));
+        }
+
+        return blob;
+    }
+
+    /**
+     * Compresses each blob at a few levels, checks that it decompresses back to the same bytes, and
+     * reports the ratio, compression speed on one thread and decompression speed on one thread and on
+     * every thread. Decompression is timed over several runs because each one is quick.
+     */
+    int LzBenchmark(const std::wstring& inputDirectory)
+    {
+        const unsigned int DECOMPRESS_RUNS = 10;
+        const int levels[] = { Lz::MIN_LEVEL, 3, Lz::DEFAULT_LEVEL, Lz::MAX_LEVEL };
+
+        std::vector<std::string> names;
+        std::vector<std::vector<unsigned char>> blobs;
+
+        if (!inputDirectory.empty())
+        {
+            std::vector<std::wstring> paths;
+            std::vector<char> data;
+            FindFiles(inputDirectory, L"", &paths);
+
+            names.push_back("corpus (" + std::to_string(static_cast<unsigned long long>(paths.size())) + " files)");
+            blobs.push_back(std::vector<unsigned char>());
+
+            for (size_t i = 0; i < paths.size(); ++i)
+            {
+                if (ReadFile(inputDirectory + L"/" + paths[i], &data))
+                {
+                    blobs.back().insert(blobs.back().end(), data.begin(), data.end());
+                }
+            }
+        }
+
+        names.push_back("mesh");
+        blobs.push_back(MakeMeshBlob(256));
+        names.push_back("height map");
+        blobs.push_back(MakeHeightMapBlob(1024));
+
+        for (size_t b = 0; b < blobs.size(); ++b)
+        {
+            const std::vector<unsigned char>& blob = blobs[b];
+            double megabytes = blob.size() / (1024.0 * 1024.0);
+
+            std::cout << names[b] << ": " << blob.size() << " bytes" << std::endl;
+
+            if (blob.empty())
+            {
+                continue;
+            }
+
+            for (size_t l = 0; l < sizeof(levels) / sizeof(levels[0]); ++l)
+            {
+                LzParams params;
+                params.level = levels[l];
+
+                std::vector<unsigned char> frame;
+                Stopwatch timer;
+                Lz::Compress(&blob[0], blob.size(), params, &frame);
+                double compressSeconds = timer.ElapsedSeconds();
+
+                ByteSpan frameSpan(&frame[0], frame.size());
+                std::vector<unsigned char> output(blob.size());
+                bool matches = true;
+
+                timer.Restart();
+
+                for (unsigned int run = 0; run < DECOMPRESS_RUNS; ++run)
+                {
+                    matches = Lz::Decompress(frameSpan, &output[0], output.size(), 1) && matches;
+                }
+
+                double decompressSeconds = timer.ElapsedSeconds() / DECOMPRESS_RUNS;
+                timer.Restart();
+
+                for (unsigned int run = 0; run < DECOMPRESS_RUNS; ++run)
+                {
+                    matches = Lz::Decompress(frameSpan, &output[0], output.size(), 0) && matches;
+                }
+
+                double parallelSeconds = timer.ElapsedSeconds() / DECOMPRESS_RUNS;
+
+                if (!matches || output != blob)
+                {
+                    std::cerr << "Level " << levels[l] << " did not decompress to the original bytes" << std::endl;
+                    return 1;
+                }
+
+                std::cout << "  level " << levels[l] << ": ratio " << static_cast<double>(frame.size()) / blob.size()
+                    << ", compress " << megabytes / std::max(compressSeconds, 1e-9) << " MB/s"
+                    << ", decompress " << megabytes / std::max(decompressSeconds, 1e-9) << " MB/s"
+                    << " (" << megabytes / std::max(parallelSeconds, 1e-9) << " MB/s on "
+                    << Parallel::DefaultThreadCount() << " threads)" << std::endl;
+            }
+        }
+
+        return 0;
+    }
+
+    void PrintUsage()
+    {
+        std::cerr << "Usage: AssetPacker <input directory> <output.pak> [-align N] [-compress [level]]" << std::endl;
+        std::cerr << "       AssetPacker -list <archive.pak>" << std::endl;
+        std::cerr << "       AssetPacker -benchmark <input directory> <archive.pak> [iterations]" << std::endl;
+        std::cerr << "       AssetPacker -readbenchmark <scratch directory> [file count]" << std::endl;
+        std::cerr << "       AssetPacker -lzbenchmark [input directory]" << std::endl;
+    }
+}
+
+int main(int argc, char * argv[])
+{
+    if (argc == 3 && std::strcmp(argv[1], "-list") == 0)
+    {
+        return List(Widen(argv[2]));
+    }
+
+    if (argc >= 4 && std::strcmp(argv[1], "-benchmark") == 0)
+    {
+        int iterations = (argc >= 5) ? std::atoi(argv[4]) : DEFAULT_BENCHMARK_ITERATIONS;
+        return Benchmark(Widen(argv[2]), Widen(argv[3]), static_cast<unsigned int>(std::max(iterations, 1)));
+    }
+
+    if (argc >= 3 && std::strcmp(argv[1], "-readbenchmark") == 0)
+    {
+        int fileCount = (argc >= 4) ? std::atoi(argv[3]) : DEFAULT_READ_BENCHMARK_FILES;
+        return ReadBenchmark(Widen(argv[2]), static_cast<unsigned int>(std::max(fileCount, 1)));
+    }
+
+    if (argc >= 2 && std::strcmp(argv[1], "-lzbenchmark") == 0)
+    {
+        return LzBenchmark(argc >= 3 ? Widen(argv[2]) : std::wstring());
+    }
+
+    if (argc >= 3 && argv[1][0] != '-')
+    {
+        unsigned int alignment = AssetArchiveWriter::DEFAULT_ALIGNMENT;
+        ArchiveCompression compression = ArchiveCompression::None;
+        int compressionLevel = Lz::DEFAULT_LEVEL;
+
+        for (int i = 3; i < argc; ++i)
+        {
+            if (std::strcmp(argv[i], "-align") == 0 && i + 1 < argc)
+            {
+                int requested = std::atoi(argv[++i]);
+
+                if (requested <= 0 || (requested & (requested - 1)) != 0)
+                {
+                    PrintUsage();
+                    return 1;
+                }
+
+                alignment = static_cast<unsigned int>(requested);
+            }
+            else if (std::strcmp(argv[i], "-compress") == 0)
+            {
+                compression = ArchiveCompression::Lz;
+
+                if (i + 1 < argc && argv[i + 1][0] != '-')
+                {
+                    compressionLevel = std::atoi(argv[++i]);
+
+                    if (compressionLevel < Lz::MIN_LEVEL || compressionLevel > Lz::MAX_LEVEL)
+                    {
+                        std::cerr << "Compression level must be from " << Lz::MIN_LEVEL << " to " << Lz::MAX_LEVEL << std::endl;
+                        return 1;
+                    }
+                }
+            }
+            else
+            {
+                PrintUsage();
+                return 1;
+            }
+        }
+
+        return Pack(Widen(argv[1]), Widen(argv[2]), alignment, compression, compressionLevel);
+    }
+
+    PrintUsage();
+    return 1;
+}
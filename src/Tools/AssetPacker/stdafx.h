@@ -0,0 +1,23 @@
+// stdafx.h : include file for standard system include files,
+// or project specific include files that are used frequently, but
+// are changed infrequently
+//
+
+#pragma once
+
+#include "targetver.h"
+
+#define WIN32_LEAN_AND_MEAN             // Exclude rarely-used stuff from Windows headers
+// Windows Header Files:
+#include <windows.h>
+
+// Remove min and max defined from windows.h
+#undef min
+#undef max
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+// Common application headers.
+#include "runtime/debugging.h"
@@ -0,0 +1,291 @@
+/*
+ * Copyright 2014 Scott MacDonald
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "stdafx.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "graphics/MeshFile.h"
+#include "graphics/MeshImporter.h"
+#include "graphics/MeshOptimizer.h"
+#include "graphics/MeshSimplifier.h"
+#include "graphics/staticmeshvertex.h"
+#include "runtime/Stopwatch.h"
+
+/**
+ * Offline converter from interchange mesh formats (OBJ and PLY) to mesh files (see MeshFile), which
+ * the game can load without parsing.
+ *
+ *   MeshConverter <input.obj|ply> <output.mesh> [-nooptimize] [-lods]
+ *       Convert a mesh, reordering it for the vertex cache and vertex fetch unless told not to, and
+ *       optionally adding simplified levels of detail with 50%, 25% and 12.5% of its triangles.
+ *
+ *   MeshConverter -benchmark <input.obj|ply> [iterations]
+ *       Measure import throughput on one thread and on every core, and compare it against loading
+ *       the converted mesh file.
+ */
+namespace
+{
+    const unsigned int DEFAULT_BENCHMARK_ITERATIONS = 10;
+
+    std::wstring Widen(const char * pText)
+    {
+        return std::wstring(pText, pText + std::strlen(pText));
+    }
+
+    bool ImportAndOptimize(
+        const std::wstring& inputPath,
+        bool optimize,
+        std::vector<StaticMeshVertex> * pVertices,
+        std::vector<unsigned int> * pIndices)
+    {
+        MeshImportStats stats;
+
+        if (!MeshImporter::Load(inputPath, pVertices, pIndices, MeshImportParams(), &stats) || pIndices->empty())
+        {
+            std::cerr << "Could not read any triangles from " << std::string(inputPath.begin(), inputPath.end()) << std::endl;
+            return false;
+        }
+
+        std::cout << "Imported " << stats.sourceVertexCount << " -> " << stats.vertexCount << " vertices, "
+            << stats.triangleCount << " triangles in " << stats.seconds * 1000.0 << " ms ("
+            << stats.MegabytesPerSecond() << " MB/s, " << stats.threadCount << " threads)"
+            << (stats.generatedNormals ? ", generated normals" : "") << std::endl;
+
+        if (optimize)
+        {
+            unsigned int vertexCount = static_cast<unsigned int>(pVertices->size());
+            unsigned int indexCount = static_cast<unsigned int>(pIndices->size());
+
+            MeshOptimizer::VertexCacheStats before =
+                MeshOptimizer::AnalyzeVertexCache(&(*pIndices)[0], indexCount, vertexCount);
+
+            MeshOptimizer::OptimizeVertexCache(&(*pIndices)[0], indexCount, vertexCount);
+            MeshOptimizer::OptimizeVertexFetch(&(*pVertices)[0], vertexCount, sizeof(StaticMeshVertex), &(*pIndices)[0], indexCount);
+
+            MeshOptimizer::VertexCacheStats after =
+                MeshOptimizer::AnalyzeVertexCache(&(*pIndices)[0], indexCount, vertexCount);
+
+            std::cout << "Vertex cache ACMR " << before.acmr << " -> " << after.acmr << std::endl;
+        }
+
+        return true;
+    }
+
+    /**
+     * Appends a level of detail chain to the indices and converts it into mesh file levels.
+     */
+    void GenerateLods(
+        const std::vector<StaticMeshVertex>& vertices,
+        std::vector<unsigned int> * pIndices,
+        std::vector<MeshFileLod> * pFileLodsOut)
+    {
+        std::vector<MeshLod> lods;
+        MeshSimplifier::SimplifyStats stats;
+
+        MeshSimplifier::GenerateLodChain(
+            &vertices[0],
+            static_cast<unsigned int>(vertices.size()),
+            pIndices,
+            MeshSimplifier::LodChainParams(),
+            &lods,
+            &stats);
+
+        std::cout << "Simplified " << stats.sourceTriangleCount << " triangles into " << lods.size()
+            << " levels of detail in " << stats.seconds * 1000.0 << " ms (" << stats.collapseCount
+            << " collapses, " << stats.lockedVertexCount << " locked vertices)" << std::endl;
+
+        pFileLodsOut->clear();
+
+        for (size_t i = 0; i < lods.size(); ++i)
+        {
+            MeshFileLod fileLod = { lods[i].firstIndex, lods[i].indexCount, lods[i].screenSize, 0 };
+            pFileLodsOut->push_back(fileLod);
+
+            std::cout << "  level " << i << ": " << lods[i].indexCount / 3 << " triangles, error "
+                << lods[i].error << ", below screen size " << lods[i].screenSize << std::endl;
+        }
+    }
+
+    int Convert(const std::wstring& inputPath, const std::wstring& outputPath, bool optimize, bool generateLods)
+    {
+        std::vector<StaticMeshVertex> vertices;
+        std::vector<unsigned int> indices;
+        std::vector<MeshFileLod> lods;
+
+        if (!ImportAndOptimize(inputPath, optimize, &vertices, &indices))
+        {
+            return 1;
+        }
+
+        if (generateLods)
+        {
+            GenerateLods(vertices, &indices, &lods);
+        }
+
+        if (!MeshFile::Write(
+                outputPath,
+                &vertices[0],
+                static_cast<unsigned int>(vertices.size()),
+                &indices[0],
+                static_cast<unsigned int>(indices.size()),
+                lods.empty() ? nullptr : &lods[0],
+                static_cast<unsigned int>(lods.size())))
+        {
+            std::cerr << "Could not write " << std::string(outputPath.begin(), outputPath.end()) << std::endl;
+            return 1;
+        }
+
+        std::cout << "Wrote " << vertices.size() << " vertices and " << indices.size() / 3 << " triangles to "
+            << std::string(outputPath.begin(), outputPath.end()) << std::endl;
+
+        return 0;
+    }
+
+    /**
+     * Imports the source mesh repeatedly with the given thread count, returning the average stats.
+     */
+    MeshImportStats MeasureImport(const std::wstring& inputPath, unsigned int threadCount, unsigned int iterations)
+    {
+        std::vector<StaticMeshVertex> vertices;
+        std::vector<unsigned int> indices;
+        MeshImportParams params;
+        MeshImportStats stats, total = { 0 };
+
+        params.threadCount = threadCount;
+
+        for (unsigned int i = 0; i < iterations; ++i)
+        {
+            MeshImporter::Load(inputPath, &vertices, &indices, params, &stats);
+            total.seconds += stats.seconds;
+        }
+
+        stats.seconds = total.seconds / iterations;
+        return stats;
+    }
+
+    /**
+     * Loads the source mesh and the mesh file repeatedly. Loading a mesh file reads every byte of its
+     * vertex and index streams, as uploading them would, so the mapped pages are really touched.
+     */
+    int Benchmark(const std::wstring& inputPath, unsigned int iterations)
+    {
+        std::wstring meshPath = inputPath + L".benchmark.mesh";
+
+        if (Convert(inputPath, meshPath, true, false) != 0)
+        {
+            return 1;
+        }
+
+        MeshImportStats serial = MeasureImport(inputPath, 1, iterations);
+        MeshImportStats parallel = MeasureImport(inputPath, 0, iterations);
+        double importSeconds = parallel.seconds;
+        unsigned int checksum = 0;
+        size_t streamBytes = 0;
+        Stopwatch timer;
+
+        for (unsigned int i = 0; i < iterations; ++i)
+        {
+            MeshFile file;
+
+            if (!file.Open(meshPath) || !file.HasStaticMeshLayout())
+            {
+                std::cerr << "Could not open the converted mesh file" << std::endl;
+                return 1;
+            }
+
+            const MeshFileHeader& header = file.Header();
+            const unsigned char * pVertexBytes = static_cast<const unsigned char *>(file.Vertices());
+            size_t vertexBytes = static_cast<size_t>(header.vertexCount) * header.vertexStride;
+
+            for (size_t b = 0; b < vertexBytes; b += sizeof(unsigned int))
+            {
+                checksum += *reinterpret_cast<const unsigned int *>(pVertexBytes + b);
+            }
+
+            for (unsigned int b = 0; b < header.indexCount; ++b)
+            {
+                checksum += file.Indices()[b];
+            }
+
+            streamBytes = vertexBytes + header.indexCount * sizeof(unsigned int);
+        }
+
+        double binarySeconds = timer.ElapsedSeconds() / iterations;
+
+        std::remove(std::string(meshPath.begin(), meshPath.end()).c_str());
+
+        std::cout << "Loaded " << parallel.vertexCount << " vertices, " << parallel.triangleCount << " triangles, "
+            << iterations << " iterations (checksum " << checksum << ")" << std::endl;
+        std::cout << "  import, 1 thread:  " << serial.seconds * 1000.0 << " ms, "
+            << serial.MegabytesPerSecond() << " MB/s" << std::endl;
+        std::cout << "  import, " << parallel.threadCount << " threads: " << parallel.seconds * 1000.0 << " ms, "
+            << parallel.MegabytesPerSecond() << " MB/s, "
+            << serial.seconds / std::max(parallel.seconds, 1e-9) << "x faster" << std::endl;
+        std::cout << "  mesh file: " << binarySeconds * 1000.0 << " ms, "
+            << streamBytes / std::max(binarySeconds, 1e-9) / (1024.0 * 1024.0) << " MB/s, "
+            << importSeconds / std::max(binarySeconds, 1e-9) << "x faster" << std::endl;
+
+        return 0;
+    }
+
+    void PrintUsage()
+    {
+        std::cerr << "Usage: MeshConverter <input.obj|ply> <output.mesh> [-nooptimize] [-lods]" << std::endl;
+        std::cerr << "       MeshConverter -benchmark <input.obj|ply> [iterations]" << std::endl;
+    }
+}
+
+int main(int argc, char * argv[])
+{
+    if (argc >= 3 && std::strcmp(argv[1], "-benchmark") == 0)
+    {
+        int iterations = (argc >= 4) ? std::atoi(argv[3]) : DEFAULT_BENCHMARK_ITERATIONS;
+        return Benchmark(Widen(argv[2]), static_cast<unsigned int>(std::max(iterations, 1)));
+    }
+
+    if (argc >= 3 && argv[1][0] != '-')
+    {
+        bool optimize = true;
+        bool generateLods = false;
+
+        for (int i = 3; i < argc; ++i)
+        {
+            if (std::strcmp(argv[i], "-nooptimize") == 0)
+            {
+                optimize = false;
+            }
+            else if (std::strcmp(argv[i], "-lods") == 0)
+            {
+                generateLods = true;
+            }
+            else
+            {
+                PrintUsage();
+                return 1;
+            }
+        }
+
+        return Convert(Widen(argv[1]), Widen(argv[2]), optimize, generateLods);
+    }
+
+    PrintUsage();
+    return 1;
+}